@@ -26,6 +26,7 @@
 
 #define ATOMIC_INC(s)                   __atomic_add_fetch(&(s), 1, __ATOMIC_SEQ_CST)
 #define ATOMIC_LOAD(s)                  __atomic_load_n(&(s), __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(s,v)               __atomic_store_n(&(s), (v), __ATOMIC_SEQ_CST)
 
 #define SEQ_WRITE(s)                    ATOMIC_INC(s)
 #define SEQ_WRITE_SUCCESS(s1,s2)        ((s1) + 1 == (s2) && ((s2) & 1) == 0)
@@ -65,8 +66,10 @@ typedef struct {
 	unsigned int hw_params_changed:1;
 	unsigned int active:1;
 	unsigned int negotiated:1;
+	unsigned int zerocopy:1;	/* graph reads the playback ring in place */
 
 	snd_pcm_uframes_t hw_ptr;
+	snd_pcm_uframes_t held;		/* frames handed to the graph, not yet released */
 	snd_pcm_uframes_t boundary;
 	snd_pcm_uframes_t min_avail;
 	unsigned int sample_bits;
@@ -85,6 +88,11 @@ typedef struct {
 	struct pw_stream *stream;
 	struct spa_hook stream_listener;
 
+	/* playback ring, followed by a scratch area of the same size */
+	struct pw_mempool *pool;
+	struct pw_memblock *ring;
+	snd_pcm_uframes_t ring_frames;
+
 	int64_t delay;
 	uint64_t transfered;
 	uint64_t buffered;
@@ -102,7 +110,7 @@ static int check_active(snd_pcm_ioplug_t *io)
 	snd_pcm_sframes_t avail;
 	bool active;
 
-	avail = snd_pcm_ioplug_avail(io, pw->hw_ptr, io->appl_ptr);
+	avail = snd_pcm_ioplug_avail(io, ATOMIC_LOAD(pw->hw_ptr), io->appl_ptr);
 
 	if (io->state == SND_PCM_STATE_DRAINING) {
 		active = pw->drained;
@@ -149,6 +157,10 @@ static void snd_pcm_pipewire_free(snd_pcm_pipewire_t *pw)
 		pw_thread_loop_stop(pw->main_loop);
 	if (pw->stream)
 		pw_stream_destroy(pw->stream);
+	if (pw->ring)
+		pw_memblock_unref(pw->ring);
+	if (pw->pool)
+		pw_mempool_destroy(pw->pool);
 	if (pw->context)
 		pw_context_destroy(pw->context);
 	if (pw->fd >= 0)
@@ -208,9 +220,9 @@ static snd_pcm_sframes_t snd_pcm_pipewire_pointer(snd_pcm_ioplug_t *io)
 	if (io->buffer_size == 0)
 		return 0;
 #ifdef SND_PCM_IOPLUG_FLAG_BOUNDARY_WA
-	return pw->hw_ptr;
+	return ATOMIC_LOAD(pw->hw_ptr);
 #else
-	return pw->hw_ptr % io->buffer_size;
+	return ATOMIC_LOAD(pw->hw_ptr) % io->buffer_size;
 #endif
 }
 
@@ -228,7 +240,7 @@ static int snd_pcm_pipewire_delay(snd_pcm_ioplug_t *io, snd_pcm_sframes_t *delay
 		delay = pw->delay + pw->transfered;
 		now = pw->now;
 		if (io->stream == SND_PCM_STREAM_PLAYBACK)
-			avail = snd_pcm_ioplug_hw_avail(io, pw->hw_ptr, io->appl_ptr);
+			avail = snd_pcm_ioplug_hw_avail(io, pw->hw_ptr, io->appl_ptr) - pw->held;
 		else
 			avail = snd_pcm_ioplug_avail(io, pw->hw_ptr, io->appl_ptr);
 
@@ -255,6 +267,35 @@ static int snd_pcm_pipewire_delay(snd_pcm_ioplug_t *io, snd_pcm_sframes_t *delay
 	return 0;
 }
 
+static void ring_areas(snd_pcm_pipewire_t *pw, snd_pcm_channel_area_t *areas)
+{
+	snd_pcm_ioplug_t *io = &pw->io;
+	void *ptr = pw->ring->map->ptr;
+	unsigned int channel;
+
+	for (channel = 0; channel < io->channels; channel++) {
+		if (pw->blocks == 1) {
+			areas[channel].addr = ptr;
+			areas[channel].first = channel * pw->sample_bits;
+			areas[channel].step = io->channels * pw->sample_bits;
+		} else {
+			areas[channel].addr = SPA_PTROFF(ptr,
+					channel * pw->ring_frames * pw->stride, void);
+			areas[channel].first = 0;
+			areas[channel].step = pw->sample_bits;
+		}
+	}
+}
+
+static void advance_hw_ptr(snd_pcm_pipewire_t *pw, snd_pcm_uframes_t frames)
+{
+	snd_pcm_uframes_t hw_ptr = pw->hw_ptr + frames;
+
+	if (hw_ptr >= pw->boundary)
+		hw_ptr -= pw->boundary;
+	ATOMIC_STORE(pw->hw_ptr, hw_ptr);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_pipewire_process(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
 		snd_pcm_uframes_t *hw_avail,snd_pcm_uframes_t want)
@@ -312,29 +353,28 @@ snd_pcm_pipewire_process(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
 
 	if (io->state == SND_PCM_STATE_RUNNING ||
 		io->state == SND_PCM_STATE_DRAINING) {
-		snd_pcm_uframes_t hw_ptr = pw->hw_ptr;
 		xfer = nframes;
 		if (xfer > 0) {
-			const snd_pcm_channel_area_t *areas = snd_pcm_ioplug_mmap_areas(io);
-			const snd_pcm_uframes_t offset = hw_ptr % io->buffer_size;
+			const snd_pcm_uframes_t offset = pw->hw_ptr % io->buffer_size;
+
+			if (io->stream == SND_PCM_STREAM_PLAYBACK) {
+				snd_pcm_channel_area_t *areas;
 
-			if (io->stream == SND_PCM_STREAM_PLAYBACK)
+				areas = alloca(io->channels * sizeof(snd_pcm_channel_area_t));
+				ring_areas(pw, areas);
 				snd_pcm_areas_copy_wrap(pwareas, 0, nframes,
 						areas, offset,
 						io->buffer_size,
 						io->channels, xfer,
 						io->format);
-			else
-				snd_pcm_areas_copy_wrap(areas, offset,
+			} else {
+				snd_pcm_areas_copy_wrap(snd_pcm_ioplug_mmap_areas(io), offset,
 						io->buffer_size,
 						pwareas, 0, nframes,
 						io->channels, xfer,
 						io->format);
-
-			hw_ptr += xfer;
-			if (hw_ptr >= pw->boundary)
-				hw_ptr -= pw->boundary;
-			pw->hw_ptr = hw_ptr;
+			}
+			advance_hw_ptr(pw, xfer);
 			*hw_avail -= xfer;
 		}
 	}
@@ -357,6 +397,64 @@ snd_pcm_pipewire_process(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
 	return xfer;
 }
 
+/* The buffers of a zero-copy stream all point at the playback ring, the
+ * chunk selects the frames at hw_ptr. The graph reads them in place so
+ * they are only released to the application in the next cycle. Frames
+ * that wrap around the end of the ring are copied to the scratch area
+ * behind it, an underrun is rendered completely in the scratch area. */
+static snd_pcm_uframes_t
+snd_pcm_pipewire_process_ring(snd_pcm_pipewire_t *pw, struct pw_buffer *b,
+		snd_pcm_uframes_t *hw_avail, snd_pcm_uframes_t want)
+{
+	snd_pcm_ioplug_t *io = &pw->io;
+	snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t xfer = 0, offset, wrap;
+	struct spa_data *d = b->buffer->datas;
+
+	if (d[0].data != pw->ring->map->ptr) {
+		/* buffer from before the ring was reallocated */
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = 0;
+		return 0;
+	}
+	areas = alloca(io->channels * sizeof(snd_pcm_channel_area_t));
+	ring_areas(pw, areas);
+
+	want = SPA_MIN(want, SPA_MIN(pw->min_avail, io->buffer_size));
+	offset = pw->hw_ptr % io->buffer_size;
+
+	if (io->state == SND_PCM_STATE_RUNNING ||
+		io->state == SND_PCM_STATE_DRAINING)
+		xfer = SPA_MIN(want, *hw_avail);
+
+	if (xfer < want) {
+		snd_pcm_areas_copy_wrap(areas, io->buffer_size, pw->ring_frames,
+				areas, offset, io->buffer_size,
+				io->channels, xfer, io->format);
+		snd_pcm_areas_silence(areas, io->buffer_size + xfer, io->channels,
+				want - xfer, io->format);
+		offset = io->buffer_size;
+
+		if (io->state == SND_PCM_STATE_RUNNING ||
+			io->state == SND_PCM_STATE_DRAINING) {
+			/* report Xrun to user application */
+			pw->xrun_detected = true;
+		}
+	} else if (offset + want > io->buffer_size) {
+		wrap = offset + want - io->buffer_size;
+		snd_pcm_areas_copy(areas, io->buffer_size, areas, 0,
+				io->channels, wrap, io->format);
+	}
+	d[0].chunk->offset = offset * pw->stride;
+	d[0].chunk->size = want * pw->stride;
+	d[0].chunk->stride = pw->stride;
+
+	pw->held = xfer;
+	*hw_avail -= xfer;
+
+	return want;
+}
+
 static void on_stream_param_changed(void *data, uint32_t id, const struct spa_pod *param)
 {
 	snd_pcm_pipewire_t *pw = data;
@@ -373,12 +471,22 @@ static void on_stream_param_changed(void *data, uint32_t id, const struct spa_po
 	io->period_size = pw->min_avail;
 
 	buffers = SPA_CLAMP(io->buffer_size / io->period_size, MIN_BUFFERS, MAX_BUFFERS);
-	size = io->period_size * pw->stride;
+	size = pw->zerocopy ? pw->ring->size : io->period_size * pw->stride;
 
-	pw_log_info("%p: buffer_size:%lu period_size:%lu buffers:%u size:%u min_avail:%lu",
-			pw, io->buffer_size, io->period_size, buffers, size, pw->min_avail);
+	pw_log_info("%p: buffer_size:%lu period_size:%lu buffers:%u size:%u min_avail:%lu zerocopy:%d",
+			pw, io->buffer_size, io->period_size, buffers, size, pw->min_avail,
+			pw->zerocopy);
 
-	params[n_params++] = spa_pod_builder_add_object(&b,
+	if (pw->zerocopy)
+		params[n_params++] = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(buffers, MIN_BUFFERS, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(size),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(pw->stride),
+			SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(1<<SPA_DATA_MemFd));
+	else
+		params[n_params++] = spa_pod_builder_add_object(&b,
 			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(buffers, MIN_BUFFERS, MAX_BUFFERS),
 			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(pw->blocks),
@@ -391,6 +499,24 @@ static void on_stream_param_changed(void *data, uint32_t id, const struct spa_po
 	pw_thread_loop_signal(pw->main_loop, false);
 }
 
+/* zero-copy streams allocate their buffers, they all share the ring */
+static void on_stream_add_buffer(void *data, struct pw_buffer *b)
+{
+	snd_pcm_pipewire_t *pw = data;
+	struct spa_data *d = b->buffer->datas;
+
+	if (pw->ring == NULL || (d[0].type & (1<<SPA_DATA_MemFd)) == 0) {
+		pw_log_error("%p: unsupported data type %08x", pw, d[0].type);
+		return;
+	}
+	d[0].type = SPA_DATA_MemFd;
+	d[0].flags = SPA_DATA_FLAG_READWRITE;
+	d[0].fd = pw->ring->fd;
+	d[0].mapoffset = 0;
+	d[0].maxsize = pw->ring->size;
+	d[0].data = pw->ring->map->ptr;
+}
+
 static void on_stream_state_changed(void *data, enum pw_stream_state old, enum pw_stream_state state, const char *error)
 {
 	snd_pcm_pipewire_t *pw = data;
@@ -422,6 +548,14 @@ static void on_stream_process(void *data)
 
 	pw_stream_get_time_n(pw->stream, &pwt, sizeof(pwt));
 
+	if (pw->held > 0) {
+		/* the graph is done with the frames of the previous cycle */
+		SEQ_WRITE(pw->seq);
+		advance_hw_ptr(pw, pw->held);
+		pw->held = 0;
+		SEQ_WRITE(pw->seq);
+	}
+
 	delay = pwt.delay;
 	if (pwt.rate.num != 0)
 		delay = delay * io->rate * pwt.rate.num / pwt.rate.denom;
@@ -444,7 +578,10 @@ static void on_stream_process(void *data)
 		pw->buffered = 0;
 	}
 
-	xfer = snd_pcm_pipewire_process(pw, b, &hw_avail, want);
+	if (pw->zerocopy)
+		xfer = snd_pcm_pipewire_process_ring(pw, b, &hw_avail, want);
+	else
+		xfer = snd_pcm_pipewire_process(pw, b, &hw_avail, want);
 
 	pw->delay = delay;
 	/* the buffer is now queued in the stream and consumed */
@@ -478,6 +615,7 @@ done:
 static const struct pw_stream_events stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.param_changed = on_stream_param_changed,
+	.add_buffer = on_stream_add_buffer,
 	.state_changed = on_stream_state_changed,
 	.process = on_stream_process,
 	.drained = on_stream_drained,
@@ -510,6 +648,71 @@ static int snd_pcm_pipewire_drain(snd_pcm_ioplug_t *io)
 	return res;
 }
 
+/* Playback frames are written to our own ring by the transfer callback.
+ * Interleaved formats share the ring with the graph as a memfd, planar
+ * formats are still copied to the stream buffers from it. */
+static int pipewire_setup_ring(snd_pcm_pipewire_t *pw)
+{
+	snd_pcm_ioplug_t *io = &pw->io;
+	snd_pcm_uframes_t frames;
+	size_t size;
+
+	pw->zerocopy = pw->blocks == 1 &&
+		pw_properties_get_bool(pw->props, "alsa.zero-copy", true);
+
+	frames = pw->zerocopy ? 2 * io->buffer_size : io->buffer_size;
+	size = frames * pw->stride * pw->blocks;
+
+	if (pw->ring != NULL && pw->ring->size == size && pw->ring_frames == frames)
+		return 0;
+
+	if (pw->ring != NULL) {
+		pw_memblock_unref(pw->ring);
+		pw->ring = NULL;
+	}
+	if (pw->pool == NULL &&
+	    (pw->pool = pw_mempool_new(NULL)) == NULL)
+		return -errno;
+
+	pw->ring = pw_mempool_alloc(pw->pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_SEAL |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd, size);
+	if (pw->ring == NULL)
+		return -errno;
+
+	pw->ring_frames = frames;
+	pw_log_debug("%p: ring fd:%d size:%zu frames:%lu zerocopy:%d", pw,
+			pw->ring->fd, size, frames, pw->zerocopy);
+	return 1;
+}
+
+static snd_pcm_sframes_t snd_pcm_pipewire_transfer(snd_pcm_ioplug_t *io,
+		const snd_pcm_channel_area_t *areas,
+		snd_pcm_uframes_t offset, snd_pcm_uframes_t size)
+{
+	snd_pcm_pipewire_t *pw = io->private_data;
+	snd_pcm_channel_area_t *dst;
+
+	if (io->stream != SND_PCM_STREAM_PLAYBACK)
+		return size;
+	if (pw->ring == NULL)
+		return -EBADFD;
+
+	dst = alloca(io->channels * sizeof(snd_pcm_channel_area_t));
+	ring_areas(pw, dst);
+	snd_pcm_areas_copy_wrap(dst, io->appl_ptr % io->buffer_size,
+			io->buffer_size,
+			areas, offset, offset + size,
+			io->channels, size, io->format);
+
+	/* the frames must be visible before ioplug moves appl_ptr */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	return size;
+}
+
 static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 {
 	snd_pcm_pipewire_t *pw = io->private_data;
@@ -518,6 +721,8 @@ static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 	uint32_t min_period;
+	bool zerocopy;
+	int res = 0;
 
 	pw_thread_loop_lock(pw->main_loop);
 
@@ -543,6 +748,23 @@ static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 		goto done;
 	pw->hw_params_changed = false;
 
+	zerocopy = pw->zerocopy;
+	if (io->stream == SND_PCM_STREAM_PLAYBACK &&
+	    (res = pipewire_setup_ring(pw)) < 0) {
+		pw_log_error("%p: can't allocate ring: %s", pw, spa_strerror(res));
+		pw->error = res;
+		goto error;
+	}
+	if (pw->stream != NULL && (zerocopy || pw->zerocopy) &&
+	    (res > 0 || zerocopy != pw->zerocopy)) {
+		/* the buffers of a zero-copy stream point into the ring and
+		 * buffer allocation is selected when connecting */
+		spa_hook_remove(&pw->stream_listener);
+		pw_stream_destroy(pw->stream);
+		pw->stream = NULL;
+		pw->activated = false;
+	}
+
 	pw_properties_setf(pw->props, PW_KEY_NODE_LATENCY, "%lu/%u", pw->min_avail, io->rate);
 	pw_properties_setf(pw->props, PW_KEY_NODE_RATE, "1/%u", io->rate);
 
@@ -569,12 +791,15 @@ static int snd_pcm_pipewire_prepare(snd_pcm_ioplug_t *io)
 				PW_DIRECTION_INPUT,
 				PW_ID_ANY,
 				PW_STREAM_FLAG_AUTOCONNECT |
-				PW_STREAM_FLAG_MAP_BUFFERS |
+				(pw->zerocopy ?
+				 PW_STREAM_FLAG_ALLOC_BUFFERS :
+				 PW_STREAM_FLAG_MAP_BUFFERS) |
 				PW_STREAM_FLAG_RT_PROCESS,
 				params, 1);
 
 done:
 	pw->hw_ptr = 0;
+	pw->held = 0;
 	pw->now = 0;
 	pw->xrun_detected = false;
 	pw->drained = false;
@@ -918,6 +1143,7 @@ static snd_pcm_ioplug_callback_t pipewire_pcm_callback = {
 	.delay = snd_pcm_pipewire_delay,
 	.drain = snd_pcm_pipewire_drain,
 	.prepare = snd_pcm_pipewire_prepare,
+	.transfer = snd_pcm_pipewire_transfer,
 	.poll_descriptors = snd_pcm_pipewire_poll_descriptors,
 	.poll_revents = snd_pcm_pipewire_poll_revents,
 	.hw_params = snd_pcm_pipewire_hw_params,
@@ -1193,7 +1419,8 @@ static int snd_pcm_pipewire_open(snd_pcm_t **pcmp,
 	pw->io.private_data = pw;
 	pw->io.poll_fd = pw->fd;
 	pw->io.poll_events = POLLIN;
-	pw->io.mmap_rw = 1;
+	/* playback frames go through the transfer callback into our ring */
+	pw->io.mmap_rw = stream == SND_PCM_STREAM_CAPTURE;
 #ifdef SND_PCM_IOPLUG_FLAG_BOUNDARY_WA
 	pw->io.flags = SND_PCM_IOPLUG_FLAG_BOUNDARY_WA;
 #else
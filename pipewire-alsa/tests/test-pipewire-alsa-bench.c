@@ -0,0 +1,291 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+/*
+ [title]
+ CPU usage per playback stream of pipewire-alsa.
+ [title]
+
+ Plays silence on a number of streams and reports the CPU time the
+ process used per stream. Compare the zero-copy ring with the copy
+ path by running once more with PIPEWIRE_ALSA='{ alsa.zero-copy=false }'.
+ */
+
+#include <alsa/asoundlib.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_PCM		"pipewire"
+#define DEFAULT_RATE		48000
+#define DEFAULT_CHANNELS	2
+#define DEFAULT_PERIOD		1024
+#define DEFAULT_STREAMS		8
+#define DEFAULT_DURATION	10
+#define MAX_STREAMS		64
+
+struct stream {
+	snd_pcm_t *pcm;
+	snd_pcm_uframes_t period;
+	snd_pcm_uframes_t buffer;
+	uint64_t frames;
+	uint32_t xruns;
+	int n_fds;
+};
+
+struct data {
+	const char *device;
+	unsigned int rate;
+	unsigned int channels;
+	snd_pcm_uframes_t period;
+	unsigned int n_streams;
+	unsigned int duration;
+	bool mmap;
+
+	int16_t *silence;
+	struct stream streams[MAX_STREAMS];
+};
+
+static uint64_t get_time_ns(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int open_stream(struct data *d, struct stream *s)
+{
+	snd_pcm_hw_params_t *params;
+	unsigned int rate = d->rate;
+	int res;
+
+	if ((res = snd_pcm_open(&s->pcm, d->device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK)) < 0) {
+		fprintf(stderr, "open failed: %s\n", snd_strerror(res));
+		s->pcm = NULL;
+		return res;
+	}
+	snd_pcm_hw_params_alloca(&params);
+	s->period = d->period;
+	s->buffer = d->period * 2;
+
+	if ((res = snd_pcm_hw_params_any(s->pcm, params)) < 0 ||
+	    (res = snd_pcm_hw_params_set_access(s->pcm, params, d->mmap ?
+			SND_PCM_ACCESS_MMAP_INTERLEAVED :
+			SND_PCM_ACCESS_RW_INTERLEAVED)) < 0 ||
+	    (res = snd_pcm_hw_params_set_format(s->pcm, params, SND_PCM_FORMAT_S16_LE)) < 0 ||
+	    (res = snd_pcm_hw_params_set_rate_near(s->pcm, params, &rate, 0)) < 0 ||
+	    (res = snd_pcm_hw_params_set_channels(s->pcm, params, d->channels)) < 0 ||
+	    (res = snd_pcm_hw_params_set_period_size_near(s->pcm, params, &s->period, 0)) < 0 ||
+	    (res = snd_pcm_hw_params_set_buffer_size_near(s->pcm, params, &s->buffer)) < 0 ||
+	    (res = snd_pcm_hw_params(s->pcm, params)) < 0) {
+		fprintf(stderr, "hw_params failed: %s\n", snd_strerror(res));
+		return res;
+	}
+	if ((res = snd_pcm_prepare(s->pcm)) < 0) {
+		fprintf(stderr, "prepare failed: %s\n", snd_strerror(res));
+		return res;
+	}
+	s->n_fds = snd_pcm_poll_descriptors_count(s->pcm);
+	return 0;
+}
+
+static int write_stream(struct data *d, struct stream *s)
+{
+	snd_pcm_sframes_t avail, res;
+	snd_pcm_uframes_t offset, frames;
+	const snd_pcm_channel_area_t *areas;
+
+	if ((res = avail = snd_pcm_avail_update(s->pcm)) < 0)
+		goto recover;
+
+	while (avail > 0) {
+		frames = (snd_pcm_uframes_t)avail < s->period ? (snd_pcm_uframes_t)avail : s->period;
+
+		if (d->mmap) {
+			if ((res = snd_pcm_mmap_begin(s->pcm, &areas, &offset, &frames)) < 0)
+				goto recover;
+			memset((uint8_t*)areas[0].addr + offset * d->channels * sizeof(int16_t),
+					0, frames * d->channels * sizeof(int16_t));
+			res = snd_pcm_mmap_commit(s->pcm, offset, frames);
+		} else {
+			res = snd_pcm_writei(s->pcm, d->silence, frames);
+		}
+		if (res < 0)
+			goto recover;
+		if (res == 0)
+			break;
+
+		s->frames += res;
+		avail -= res;
+	}
+	return 0;
+
+recover:
+	if (res == -EAGAIN)
+		return 0;
+	s->xruns++;
+	if ((res = snd_pcm_recover(s->pcm, res, 1)) < 0)
+		return res;
+	return snd_pcm_start(s->pcm);
+}
+
+static void show_help(const char *name, bool error)
+{
+	fprintf(error ? stderr : stdout, "%s [options]\n"
+		"  -h, --help        Show this help\n"
+		"  -D, --device      PCM device (default %s)\n"
+		"  -n, --streams     Number of streams (default %d)\n"
+		"  -t, --duration    Duration in seconds (default %d)\n"
+		"  -r, --rate        Sample rate (default %d)\n"
+		"  -c, --channels    Channels (default %d)\n"
+		"  -p, --period      Period size in frames (default %d)\n"
+		"  -m, --mmap        Use MMAP access instead of RW\n",
+		name, DEFAULT_PCM, DEFAULT_STREAMS, DEFAULT_DURATION,
+		DEFAULT_RATE, DEFAULT_CHANNELS, DEFAULT_PERIOD);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = {
+		.device = DEFAULT_PCM,
+		.rate = DEFAULT_RATE,
+		.channels = DEFAULT_CHANNELS,
+		.period = DEFAULT_PERIOD,
+		.n_streams = DEFAULT_STREAMS,
+		.duration = DEFAULT_DURATION,
+	};
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "device",	required_argument,	NULL, 'D' },
+		{ "streams",	required_argument,	NULL, 'n' },
+		{ "duration",	required_argument,	NULL, 't' },
+		{ "rate",	required_argument,	NULL, 'r' },
+		{ "channels",	required_argument,	NULL, 'c' },
+		{ "period",	required_argument,	NULL, 'p' },
+		{ "mmap",	no_argument,		NULL, 'm' },
+		{ NULL, 0, NULL, 0 }
+	};
+	struct pollfd *fds;
+	uint64_t start, end, cpu_start, cpu_end, frames = 0;
+	uint32_t xruns = 0;
+	unsigned int i;
+	int c, n_fds = 0, res = EXIT_FAILURE;
+	double wall, cpu;
+
+	while ((c = getopt_long(argc, argv, "hD:n:t:r:c:p:m", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0], false);
+			return EXIT_SUCCESS;
+		case 'D':
+			data.device = optarg;
+			break;
+		case 'n':
+			data.n_streams = atoi(optarg);
+			if (data.n_streams < 1 || data.n_streams > MAX_STREAMS) {
+				fprintf(stderr, "streams must be between 1 and %d\n", MAX_STREAMS);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			data.duration = atoi(optarg);
+			break;
+		case 'r':
+			data.rate = atoi(optarg);
+			break;
+		case 'c':
+			data.channels = atoi(optarg);
+			break;
+		case 'p':
+			data.period = atoi(optarg);
+			break;
+		case 'm':
+			data.mmap = true;
+			break;
+		default:
+			show_help(argv[0], true);
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* avoid rtkit in this test */
+	setenv("PIPEWIRE_CONFIG_NAME", "client.conf", false);
+
+	data.silence = calloc(data.period * data.channels, sizeof(int16_t));
+	if (data.silence == NULL)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < data.n_streams; i++) {
+		if (open_stream(&data, &data.streams[i]) < 0)
+			goto exit;
+		n_fds += data.streams[i].n_fds;
+	}
+	fds = alloca(n_fds * sizeof(struct pollfd));
+
+	cpu_start = get_time_ns(CLOCK_PROCESS_CPUTIME_ID);
+	start = get_time_ns(CLOCK_MONOTONIC);
+	end = start + data.duration * 1000000000ull;
+
+	for (i = 0; i < data.n_streams; i++) {
+		write_stream(&data, &data.streams[i]);
+		snd_pcm_start(data.streams[i].pcm);
+	}
+
+	while (get_time_ns(CLOCK_MONOTONIC) < end) {
+		struct pollfd *f = fds;
+
+		for (i = 0; i < data.n_streams; i++) {
+			struct stream *s = &data.streams[i];
+			snd_pcm_poll_descriptors(s->pcm, f, s->n_fds);
+			f += s->n_fds;
+		}
+		if (poll(fds, n_fds, 1000) < 0)
+			break;
+
+		f = fds;
+		for (i = 0; i < data.n_streams; i++) {
+			struct stream *s = &data.streams[i];
+			unsigned short revents = 0;
+
+			snd_pcm_poll_descriptors_revents(s->pcm, f, s->n_fds, &revents);
+			f += s->n_fds;
+
+			if ((revents & (POLLOUT | POLLERR)) &&
+			    write_stream(&data, s) < 0) {
+				fprintf(stderr, "stream %u failed\n", i);
+				goto exit;
+			}
+		}
+	}
+
+	cpu_end = get_time_ns(CLOCK_PROCESS_CPUTIME_ID);
+	wall = (get_time_ns(CLOCK_MONOTONIC) - start) / 1e9;
+	cpu = (cpu_end - cpu_start) / 1e9;
+
+	for (i = 0; i < data.n_streams; i++) {
+		frames += data.streams[i].frames;
+		xruns += data.streams[i].xruns;
+	}
+
+	printf("device:%s access:%s streams:%u rate:%u channels:%u period:%lu\n",
+			data.device, data.mmap ? "mmap" : "rw", data.n_streams,
+			data.rate, data.channels, data.period);
+	printf("wall:%.3fs cpu:%.3fs frames:%"PRIu64" xruns:%u\n", wall, cpu, frames, xruns);
+	printf("cpu per stream:%.3f%% per second of audio:%.3fms\n",
+			100.0 * cpu / wall / data.n_streams,
+			frames ? 1000.0 * cpu * data.rate / frames : 0.0);
+
+	res = EXIT_SUCCESS;
+exit:
+	for (i = 0; i < data.n_streams; i++)
+		if (data.streams[i].pcm != NULL)
+			snd_pcm_close(data.streams[i].pcm);
+	free(data.silence);
+	return res;
+}
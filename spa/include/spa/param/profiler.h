@@ -62,6 +62,18 @@ enum spa_profiler {
 							  *      Long : finish,
 							  *      Int : status,
 							  *      Fraction : latency))  */
+	SPA_PROFILER_linkBlock,				/**< counters of a link into a follower,
+							  *  accumulated since the link was made
+							  *  (Struct(
+							  *      Int : link id,
+							  *      Int : output node id,
+							  *      Int : output port id,
+							  *      Int : input node id,
+							  *      Int : input port id,
+							  *      Long : bytes,
+							  *      Long : buffers,
+							  *      Long : mixed buffers,
+							  *      Int : underruns))  */
 
 	SPA_PROFILER_START_CUSTOM	= 0x1000000,
 };
@@ -16,6 +16,7 @@ extern "C" {
 #include <string.h>
 
 #include <spa/param/props.h>
+#include <spa/param/format.h>
 #include <spa/pod/iter.h>
 #include <spa/pod/builder.h>
 #include <spa/pod/compare.h>
@@ -450,6 +451,247 @@ spa_pod_filter(struct spa_pod_builder *b,
 	return res;
 }
 
+/**
+ * Check if the values of two properties can have something in common.
+ *
+ * This does the checks of spa_pod_filter_prop() without building the
+ * result. It is conservative: when it returns false, spa_pod_filter_prop()
+ * fails, when it returns true, spa_pod_filter_prop() might still fail.
+ */
+static inline bool
+spa_pod_filter_prop_compatible(const struct spa_pod_prop *p1,
+		const struct spa_pod_prop *p2)
+{
+	const struct spa_pod *v1, *v2;
+	uint32_t j, k, nalt1, nalt2, type, size, p1c, p2c;
+	const void *alt1, *alt2, *a1, *a2;
+
+	v1 = spa_pod_get_values(&p1->value, &nalt1, &p1c);
+	v2 = spa_pod_get_values(&p2->value, &nalt2, &p2c);
+	alt1 = SPA_POD_BODY_CONST(v1);
+	alt2 = SPA_POD_BODY_CONST(v2);
+
+	type = v1->type;
+	size = v1->size;
+
+	if (type != v2->type || size != v2->size || p1->key != p2->key)
+		return false;
+
+	if (p1c == SPA_CHOICE_None || p1c == SPA_CHOICE_Flags) {
+		nalt1 = 1;
+	} else {
+		alt1 = SPA_PTROFF(alt1, size, void);
+		nalt1--;
+	}
+	if (p2c == SPA_CHOICE_None || p2c == SPA_CHOICE_Flags) {
+		nalt2 = 1;
+	} else {
+		alt2 = SPA_PTROFF(alt2, size, void);
+		nalt2--;
+	}
+
+	/* check the values against the range of the other property */
+	if (p1c == SPA_CHOICE_Range &&
+	    (p2c == SPA_CHOICE_None || p2c == SPA_CHOICE_Enum)) {
+		SPA_SWAP(alt1, alt2);
+		SPA_SWAP(nalt1, nalt2);
+		SPA_SWAP(p1c, p2c);
+	}
+
+	switch (p1c) {
+	case SPA_CHOICE_None:
+	case SPA_CHOICE_Enum:
+		switch (p2c) {
+		case SPA_CHOICE_None:
+		case SPA_CHOICE_Enum:
+			for (j = 0, a1 = alt1; j < nalt1; j++, a1 = SPA_PTROFF(a1, size, void))
+				for (k = 0, a2 = alt2; k < nalt2; k++, a2 = SPA_PTROFF(a2, size, void))
+					if (spa_pod_compare_value(type, a1, a2, size) == 0)
+						return true;
+			return false;
+		case SPA_CHOICE_Range:
+		case SPA_CHOICE_Step:
+			/* the step is checked by the filter */
+			for (j = 0, a1 = alt1; j < nalt1; j++, a1 = SPA_PTROFF(a1, size, void)) {
+				if (spa_pod_compare_value(type, a1, alt2, size) >= 0 &&
+				    spa_pod_compare_value(type, a1,
+					    SPA_PTROFF(alt2, size, void), size) <= 0)
+					return true;
+			}
+			return false;
+		case SPA_CHOICE_Flags:
+			if (p1c == SPA_CHOICE_Enum)
+				return false;
+			break;
+		}
+		break;
+	case SPA_CHOICE_Range:
+	case SPA_CHOICE_Step:
+		/* a step with values is left to the filter */
+		if (p2c == SPA_CHOICE_Flags)
+			return false;
+		break;
+	case SPA_CHOICE_Flags:
+		if (p2c != SPA_CHOICE_None && p2c != SPA_CHOICE_Flags)
+			return false;
+		break;
+	}
+	if (p1c == SPA_CHOICE_Flags || p2c == SPA_CHOICE_Flags) {
+		switch (type) {
+		case SPA_TYPE_Int:
+			return (*(const int32_t *) alt1 & *(const int32_t *) alt2) != 0;
+		case SPA_TYPE_Long:
+			return (*(const int64_t *) alt1 & *(const int64_t *) alt2) != 0;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Check if \a pod and \a filter can have something in common, without
+ * building the result. This is conservative in the same way as
+ * spa_pod_filter_prop_compatible().
+ */
+static inline bool
+spa_pod_filter_compatible(const struct spa_pod *pod, const struct spa_pod *filter)
+{
+	const struct spa_pod_object *op, *of;
+	const struct spa_pod_prop *p1, *p2;
+
+	if (filter == NULL)
+		return true;
+	if (SPA_POD_TYPE(pod) != SPA_POD_TYPE(filter))
+		return false;
+	if (!spa_pod_is_object(pod))
+		return true;
+
+	op = (const struct spa_pod_object *) pod;
+	of = (const struct spa_pod_object *) filter;
+
+	p2 = NULL;
+	SPA_POD_OBJECT_FOREACH(op, p1) {
+		p2 = spa_pod_object_find_prop(of, p2, p1->key);
+		if (p2 != NULL) {
+			if (!spa_pod_filter_prop_compatible(p1, p2))
+				return false;
+		} else if ((p1->flags & SPA_POD_PROP_FLAG_MANDATORY) != 0)
+			return false;
+	}
+	p1 = NULL;
+	SPA_POD_OBJECT_FOREACH(of, p2) {
+		if ((p2->flags & SPA_POD_PROP_FLAG_MANDATORY) == 0)
+			continue;
+		p1 = spa_pod_object_find_prop(op, p1, p2->key);
+		if (p1 == NULL)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * The media type and subtype of a format, used to skip pairs of formats
+ * that can't match with two compares.
+ */
+struct spa_pod_filter_key {
+	const struct spa_pod *pod;
+	uint32_t media_type;		/**< SPA_ID_INVALID when not fixed */
+	uint32_t media_subtype;		/**< SPA_ID_INVALID when not fixed */
+};
+
+static inline uint32_t spa_pod_filter_key_id(const struct spa_pod_object *obj, uint32_t key)
+{
+	const struct spa_pod_prop *prop;
+	const struct spa_pod *val;
+	uint32_t n_vals, choice;
+
+	if ((prop = spa_pod_object_find_prop(obj, NULL, key)) == NULL)
+		return SPA_ID_INVALID;
+	val = spa_pod_get_values(&prop->value, &n_vals, &choice);
+	if (choice != SPA_CHOICE_None || !spa_pod_is_id(val))
+		return SPA_ID_INVALID;
+	return SPA_POD_VALUE(struct spa_pod_id, val);
+}
+
+static inline void spa_pod_filter_key_init(struct spa_pod_filter_key *key,
+		const struct spa_pod *pod)
+{
+	key->pod = pod;
+	key->media_type = key->media_subtype = SPA_ID_INVALID;
+
+	if (pod != NULL && spa_pod_is_object_type(pod, SPA_TYPE_OBJECT_Format)) {
+		const struct spa_pod_object *obj = (const struct spa_pod_object *) pod;
+		key->media_type = spa_pod_filter_key_id(obj, SPA_FORMAT_mediaType);
+		key->media_subtype = spa_pod_filter_key_id(obj, SPA_FORMAT_mediaSubtype);
+	}
+}
+
+static inline bool spa_pod_filter_key_match(const struct spa_pod_filter_key *k1,
+		const struct spa_pod_filter_key *k2)
+{
+	if (k1->media_type != SPA_ID_INVALID && k2->media_type != SPA_ID_INVALID &&
+	    k1->media_type != k2->media_type)
+		return false;
+	if (k1->media_subtype != SPA_ID_INVALID && k2->media_subtype != SPA_ID_INVALID &&
+	    k1->media_subtype != k2->media_subtype)
+		return false;
+	return true;
+}
+
+/**
+ * Find the first pair of \a pods and \a filters that intersect.
+ *
+ * The filters are tried in order and for each filter the pods in order,
+ * which gives the same result as enumerating the pods with each filter in
+ * turn. Pairs with a different media type or subtype or with a property
+ * without common values are skipped before spa_pod_filter() is called.
+ *
+ * \param b the builder for the result
+ * \param result the intersection
+ * \param keys n_pods keys of the pods, from spa_pod_filter_key_init()
+ * \param n_pods the number of pods
+ * \param filters the filters, a NULL filter matches all pods
+ * \param n_filters the number of filters
+ * \param pod_index the index of the matching pod or NULL
+ * \param filter_index the index of the matching filter or NULL
+ * \return 1 when a pair was found, 0 when there is none, < 0 on error
+ */
+static inline int
+spa_pod_filter_intersect(struct spa_pod_builder *b,
+		struct spa_pod **result,
+		const struct spa_pod_filter_key *keys, uint32_t n_pods,
+		const struct spa_pod * const *filters, uint32_t n_filters,
+		uint32_t *pod_index, uint32_t *filter_index)
+{
+	struct spa_pod_filter_key fkey;
+	uint32_t i, j;
+	int res;
+
+	for (i = 0; i < n_filters; i++) {
+		spa_pod_filter_key_init(&fkey, filters[i]);
+
+		for (j = 0; j < n_pods; j++) {
+			if (!spa_pod_filter_key_match(&keys[j], &fkey) ||
+			    !spa_pod_filter_compatible(keys[j].pod, filters[i]))
+				continue;
+
+			res = spa_pod_filter(b, result, keys[j].pod, filters[i]);
+			if (res == -ENOSPC)
+				return res;
+			if (res < 0)
+				continue;
+
+			if (pod_index)
+				*pod_index = j;
+			if (filter_index)
+				*filter_index = i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
 /**
  * \}
  */
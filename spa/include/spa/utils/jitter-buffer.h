@@ -0,0 +1,658 @@
+/* Simple Plugin API */
+/* SPDX-FileCopyrightText: Copyright © 2022 Pauli Virtanen */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SPA_UTILS_JITTER_BUFFER_H
+#define SPA_UTILS_JITTER_BUFFER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup spa_jitter_buffer Jitter buffer
+ * Adaptive jitter buffer for network and Bluetooth receivers
+ */
+
+/**
+ * \addtogroup spa_jitter_buffer
+ * \{
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/support/log.h>
+#include <spa/node/io.h>
+
+/**
+ * The jitter buffer keeps received audio in a ring and calculates a rate
+ * correction factor that maintains the buffer level at a target value.
+ *
+ * Consider typical packet intervals with nominal frame duration
+ * of 10ms:
+ *
+ *     ... 5ms | 5ms | 20ms | 5ms | 5ms | 20ms ...
+ *
+ *     ... 3ms | 3ms | 4ms | 30ms | 3ms | 3ms | 4ms | 30ms ...
+ *
+ * plus random jitter; 10ms nominal may occasionally have 20+ms interval.
+ * The regular timer cycle cannot be aligned with this, so process()
+ * may occur at any time.
+ *
+ * The buffer level is the difference between the number of samples in
+ * buffer immediately after receiving a packet, and the samples consumed
+ * before receiving the next packet.
+ *
+ * The buffer level indicates how much any packet can be delayed without
+ * underrun. If it is positive, there are no underruns.
+ *
+ * The rate correction aims to maintain the average level at a safety margin.
+ * When no target is set, the margin is derived from the spikes of the
+ * level over a long window.
+ *
+ * The memory is owned by the caller. Indexes are in frames, sizes of
+ * data in bytes. The memory must have room for \a reserve frames after the
+ * end of the ring, so that packets can be decoded in place with
+ * spa_jitter_buffer_get_write(). The part that goes past the end is copied
+ * to the start of the ring in spa_jitter_buffer_write_packet(), so no
+ * compaction is needed.
+ */
+
+#define SPA_JITTER_BUFFER_LONG_MSEC		(2*60000)
+#define SPA_JITTER_BUFFER_SHORT_MSEC		1000
+#define SPA_JITTER_BUFFER_RATE_DIFF_MAX		0.005
+
+/**
+ * Safety margin.
+ *
+ * The spike is the long-window maximum difference
+ * between minimum and average buffer level.
+ */
+#define SPA_JITTER_BUFFER_TARGET(spike,packet_size,max_buf)			\
+	SPA_CLAMP((spike)*3/2, (packet_size), (max_buf) - 2*(packet_size))
+
+/** Windowed min/max */
+struct spa_jitter_window {
+	union {
+		int32_t min;
+		int32_t mins[4];
+	};
+	union {
+		int32_t max;
+		int32_t maxs[4];
+	};
+	uint32_t pos;
+	uint32_t period;
+};
+
+static inline void spa_jitter_window_init(struct spa_jitter_window *p, uint32_t period)
+{
+	size_t i;
+
+	spa_zero(*p);
+	for (i = 0; i < SPA_N_ELEMENTS(p->mins); ++i) {
+		p->mins[i] = INT32_MAX;
+		p->maxs[i] = INT32_MIN;
+	}
+	p->period = period;
+}
+
+static inline void spa_jitter_window_update(struct spa_jitter_window *p, int32_t value, uint32_t duration)
+{
+	const size_t n = SPA_N_ELEMENTS(p->mins);
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		p->mins[i] = SPA_MIN(p->mins[i], value);
+		p->maxs[i] = SPA_MAX(p->maxs[i], value);
+	}
+
+	p->pos += duration;
+	if (p->pos >= p->period / (n - 1)) {
+		p->pos = 0;
+		for (i = 1; i < SPA_N_ELEMENTS(p->mins); ++i) {
+			p->mins[i-1] = p->mins[i];
+			p->maxs[i-1] = p->maxs[i];
+		}
+		p->mins[n-1] = INT32_MAX;
+		p->maxs[n-1] = INT32_MIN;
+	}
+}
+
+/**
+ * Rate controller.
+ *
+ * It's here in a form, where it operates on the running average
+ * so it's compatible with the level spike determination, and
+ * clamping the rate to a range is easy. The impulse response
+ * is similar to spa_dll, and step response does not have sign changes.
+ *
+ * The controller iterates as
+ *
+ *    avg(j+1) = (1 - beta) avg(j) + beta level(j)
+ *    corr(j+1) = corr(j) + a [avg(j+1) - avg(j)] / duration
+ *			  + b [avg(j) - target] / duration
+ *
+ * with beta = duration/avg_period < 0.5 is the moving average parameter,
+ * and a = beta/3 + ..., b = beta^2/27 + ....
+ *
+ * This choice results to c(j) being low-pass filtered, and buffer level(j)
+ * converging towards target with stable damped evolution with eigenvalues
+ * real and close to each other around (1 - beta)^(1/3).
+ *
+ * Derivation:
+ *
+ * The deviation from the buffer level target evolves as
+ *
+ *     delta(j) = level(j) - target
+ *     delta(j+1) = delta(j) + r(j) - c(j+1)
+ *
+ * where r is samples received in one duration, and c corrected rate
+ * (samples per duration).
+ *
+ * The rate correction is in general determined by linear filter f
+ *
+ *     c(j+1) = c(j) + \sum_{k=0}^\infty delta(j - k) f(k)
+ *
+ * If \sum_k f(k) is not zero, the only fixed point is c=r, delta=0,
+ * so this structure (if the filter is stable) rate matches and
+ * drives buffer level to target.
+ *
+ * The z-transform then is
+ *
+ *     delta(z) = G(z) r(z)
+ *     c(z) = F(z) delta(z)
+ *     G(z) = (z - 1) / [(z - 1)^2 + z f(z)]
+ *     F(z) = f(z) / (z - 1)
+ *
+ * We now want: poles of G(z) must be in |z|<1 for stability, F(z)
+ * should damp high frequencies, and f(z) is causal.
+ *
+ * To satisfy the conditions, take
+ *
+ *     (z - 1)^2 + z f(z) = p(z) / q(z)
+ *
+ * where p(z) is polynomial with leading term z^n with wanted root
+ * structure, and q(z) is any polynomial with leading term z^{n-2}.
+ * This guarantees f(z) is causal, and G(z) = (z-1) q(z) / p(z).
+ * We can choose p(z) and q(z) to improve low-pass properties of F(z).
+ *
+ * Simplest choice is p(z)=(z-x)^2 and q(z)=1, but that gives flat
+ * high frequency response in F(z). Better choice is p(z) = (z-u)*(z-v)*(z-w)
+ * and q(z) = z - r. To make F(z) better lowpass, one can cancel
+ * a resulting 1/z pole in F(z) by setting r=u*v*w. Then,
+ *
+ *     G(z) = (z - u*v*w)*(z - 1) / [(z - u)*(z - v)*(z - w)]
+ *     F(z) = (a z + b - a) / (z - 1) *	 H(z)
+ *     H(z) = beta / (z - 1 + beta)
+ *     beta = 1 - u*v*w
+ *     a = [(1-u) + (1-v) + (1-w) - beta] / beta
+ *     b = (1-u)*(1-v)*(1-w) / beta
+ *
+ * which corresponds to iteration for c(j):
+ *
+ *    avg(j+1) = (1 - beta) avg(j) + beta delta(j)
+ *    c(j+1) = c(j) + a [avg(j+1) - avg(j)] + b avg(j)
+ *
+ * So the controller operates on the running average,
+ * which gives the low-pass property for c(j).
+ *
+ * The simplest filter is obtained by putting the poles at
+ * u=v=w=(1-beta)**(1/3). Since beta << 1, computing the root
+ * can be avoided by expanding in series.
+ *
+ * Overshoot in impulse response could be reduced by moving one of the
+ * poles closer to z=1, but this increases the step response time.
+ */
+struct spa_jitter_rate_control {
+	double avg;
+	double corr;
+};
+
+static inline void spa_jitter_rate_control_init(struct spa_jitter_rate_control *this_, double level)
+{
+	this_->avg = level;
+	this_->corr = 1.0;
+}
+
+static inline double spa_jitter_rate_control_update(struct spa_jitter_rate_control *this_, double level,
+		double target, double duration, double period, double rate_diff_max)
+{
+	/*
+	 * u = (1 - beta)^(1/3)
+	 * x = a / beta
+	 * y = b / beta
+	 * a = (2 + u) * (1 - u)^2 / beta
+	 * b = (1 - u)^3 / beta
+	 * beta -> 0
+	 */
+	const double beta = SPA_CLAMP(duration / period, 0, 0.5);
+	const double x = 1.0/3;
+	const double y = beta/27;
+	double avg;
+
+	avg = beta * level + (1 - beta) * this_->avg;
+	this_->corr += x * (avg - this_->avg) / period
+		+ y * (this_->avg - target) / period;
+	this_->avg = avg;
+
+	this_->corr = SPA_CLAMP(this_->corr, 1 - rate_diff_max, 1 + rate_diff_max);
+
+	return this_->corr;
+}
+
+/** Counters, updated by the jitter buffer */
+struct spa_jitter_buffer_stats {
+	uint64_t received;	/**< frames written */
+	uint64_t consumed;	/**< frames read */
+	uint64_t concealed;	/**< frames produced by concealment */
+	uint64_t dropped;	/**< frames dropped on overrun */
+	uint32_t underruns;	/**< cycles with not enough data */
+	uint32_t overruns;	/**< times data was dropped */
+	int32_t level;		/**< last buffer level */
+	int32_t target;		/**< last target level */
+};
+
+struct spa_jitter_buffer {
+	struct spa_log *log;
+
+	struct spa_ringbuffer ring;	/**< read and write index in frames */
+	void *data;
+	uint32_t size;			/**< ring size in bytes */
+	uint32_t n_frames;		/**< ring size in frames */
+	uint32_t reserve;		/**< frames of memory after the ring */
+
+	uint32_t frame_size;
+	uint32_t rate;
+
+	/** Fill \a frames of missing data at \a dst. The default writes
+	 * silence. */
+	void (*conceal) (void *data, void *dst, uint32_t frames);
+	void *conceal_data;
+
+	struct spa_jitter_window spike;		/**< spikes (long window) */
+	struct spa_jitter_window packet_size;	/**< packet size (short window) */
+
+	struct spa_jitter_rate_control ctl;
+	double corr;
+
+	uint32_t prev_consumed;
+	uint32_t prev_avail;
+	uint32_t prev_duration;
+	uint32_t underrun;
+	uint32_t pos;
+
+	int32_t target;		/**< target buffer (0: automatic) */
+	int32_t max_target;
+
+	uint8_t received:1;
+	uint8_t buffering:1;
+
+	struct spa_jitter_buffer_stats stats;
+};
+
+/**
+ * Initialize \a jb to use \a data as ring memory.
+ *
+ * \param jb a jitter buffer
+ * \param log log used for debug messages, can be NULL
+ * \param data memory of \a size bytes plus \a reserve frames
+ * \param size the ring size in bytes, a multiple of \a frame_size
+ * \param frame_size size of one frame in bytes
+ * \param rate the sample rate
+ * \param reserve frames of memory after the ring for in place writes
+ */
+static inline void spa_jitter_buffer_init(struct spa_jitter_buffer *jb, struct spa_log *log,
+		void *data, uint32_t size, uint32_t frame_size, uint32_t rate, uint32_t reserve)
+{
+	spa_zero(*jb);
+	jb->log = log;
+	jb->data = data;
+	jb->frame_size = frame_size;
+	jb->n_frames = size / frame_size;
+	jb->size = jb->n_frames * frame_size;
+	jb->reserve = reserve;
+	jb->rate = rate;
+	jb->corr = 1.0;
+	jb->buffering = true;
+	jb->max_target = INT32_MAX;
+
+	spa_ringbuffer_init(&jb->ring);
+	spa_jitter_rate_control_init(&jb->ctl, 0);
+
+	spa_jitter_window_init(&jb->spike, (uint64_t)rate * SPA_JITTER_BUFFER_LONG_MSEC / 1000);
+	spa_jitter_window_init(&jb->packet_size, (uint64_t)rate * SPA_JITTER_BUFFER_SHORT_MSEC / 1000);
+}
+
+static inline void spa_jitter_buffer_set_conceal(struct spa_jitter_buffer *jb,
+		void (*conceal) (void *data, void *dst, uint32_t frames), void *data)
+{
+	jb->conceal = conceal;
+	jb->conceal_data = data;
+}
+
+/** Target level in frames, 0 to derive it from the measured jitter */
+static inline void spa_jitter_buffer_set_target_latency(struct spa_jitter_buffer *jb, int32_t samples)
+{
+	jb->target = samples;
+}
+
+static inline void spa_jitter_buffer_set_max_latency(struct spa_jitter_buffer *jb, int32_t samples)
+{
+	jb->max_target = samples;
+}
+
+/** Frames in the ring, including while buffering */
+static inline uint32_t spa_jitter_buffer_get_size(struct spa_jitter_buffer *jb)
+{
+	uint32_t index;
+	int32_t filled = spa_ringbuffer_get_read_index(&jb->ring, &index);
+	return SPA_CLAMP(filled, 0, (int32_t)jb->n_frames);
+}
+
+/** Bytes that can be read, 0 while buffering */
+static inline uint32_t spa_jitter_buffer_get_avail(struct spa_jitter_buffer *jb)
+{
+	return jb->buffering ? 0 : spa_jitter_buffer_get_size(jb) * jb->frame_size;
+}
+
+/**
+ * Move the indexes to \a read_index and \a write_index. The frames
+ * between them are silence. Used by receivers that place packets by
+ * their timestamp.
+ */
+static inline void spa_jitter_buffer_reset(struct spa_jitter_buffer *jb,
+		uint32_t read_index, uint32_t write_index)
+{
+	uint32_t filled = SPA_MIN(write_index - read_index, jb->n_frames);
+
+	jb->ring.readindex = write_index - filled;
+	jb->ring.writeindex = write_index;
+	memset(jb->data, 0, jb->size);
+}
+
+/** Drop the oldest \a frames */
+static inline void spa_jitter_buffer_skip(struct spa_jitter_buffer *jb, uint32_t frames)
+{
+	uint32_t index;
+
+	spa_ringbuffer_get_read_index(&jb->ring, &index);
+	spa_ringbuffer_read_update(&jb->ring, index + frames);
+}
+
+static inline void spa_jitter_buffer_overrun(struct spa_jitter_buffer *jb, uint32_t frames)
+{
+	if (jb->log)
+		spa_log_info(jb->log, "%p buffer overrun: dropping %u frames", jb, frames);
+	spa_jitter_buffer_skip(jb, frames);
+	jb->stats.dropped += frames;
+	jb->stats.overruns++;
+}
+
+static inline void spa_jitter_buffer_packet_done(struct spa_jitter_buffer *jb, uint32_t frames)
+{
+	jb->received = true;
+	jb->stats.received += frames;
+	spa_jitter_window_update(&jb->packet_size, frames, frames);
+}
+
+/**
+ * Get memory to decode the next packet into. Room for at least the
+ * reserve is always available, dropping old data when needed.
+ *
+ * \param jb a jitter buffer
+ * \param avail number of bytes that can be written
+ * \return pointer to the memory to write to
+ */
+static inline void *spa_jitter_buffer_get_write(struct spa_jitter_buffer *jb, uint32_t *avail)
+{
+	uint32_t index, offset, space;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&jb->ring, &index);
+	filled = SPA_CLAMP(filled, 0, (int32_t)jb->n_frames);
+
+	space = jb->n_frames - filled;
+	if (space < jb->reserve) {
+		spa_jitter_buffer_overrun(jb, jb->reserve - space);
+		space = jb->reserve;
+	}
+	offset = index % jb->n_frames;
+	*avail = SPA_MIN(space, jb->n_frames + jb->reserve - offset) * jb->frame_size;
+	return SPA_PTROFF(jb->data, offset * jb->frame_size, void);
+}
+
+/** Commit \a size bytes written to the memory from spa_jitter_buffer_get_write() */
+static inline void spa_jitter_buffer_write_packet(struct spa_jitter_buffer *jb, uint32_t size)
+{
+	uint32_t index, offset, frames = size / jb->frame_size;
+
+	spa_ringbuffer_get_write_index(&jb->ring, &index);
+	offset = index % jb->n_frames;
+	if (offset + frames > jb->n_frames)
+		memcpy(jb->data, SPA_PTROFF(jb->data, jb->size, void),
+				(offset + frames - jb->n_frames) * jb->frame_size);
+
+	spa_ringbuffer_write_update(&jb->ring, index + frames);
+	spa_jitter_buffer_packet_done(jb, frames);
+}
+
+/**
+ * Copy \a size bytes of a packet at frame \a index. The write index is
+ * set to the end of the packet. Data that does not fit is dropped from
+ * the start of the ring.
+ */
+static inline void spa_jitter_buffer_write_at(struct spa_jitter_buffer *jb, uint32_t index,
+		const void *data, uint32_t size)
+{
+	uint32_t read_index, frames = size / jb->frame_size;
+	int32_t filled;
+
+	if (SPA_UNLIKELY(frames > jb->n_frames)) {
+		data = SPA_PTROFF(data, (frames - jb->n_frames) * jb->frame_size, const void);
+		index += frames - jb->n_frames;
+		frames = jb->n_frames;
+	}
+
+	spa_ringbuffer_get_read_index(&jb->ring, &read_index);
+	filled = (int32_t)(index + frames - read_index);
+	if (filled > (int32_t)jb->n_frames)
+		spa_jitter_buffer_overrun(jb, filled - jb->n_frames);
+
+	spa_ringbuffer_write_data(&jb->ring, jb->data, jb->size,
+			(index % jb->n_frames) * jb->frame_size, data,
+			frames * jb->frame_size);
+	spa_ringbuffer_write_update(&jb->ring, index + frames);
+	spa_jitter_buffer_packet_done(jb, frames);
+}
+
+/** Copy \a size bytes of a packet to the write position */
+static inline void spa_jitter_buffer_write(struct spa_jitter_buffer *jb, const void *data, uint32_t size)
+{
+	uint32_t index;
+
+	spa_ringbuffer_get_write_index(&jb->ring, &index);
+	spa_jitter_buffer_write_at(jb, index, data, size);
+}
+
+/**
+ * Read \a size bytes to \a dst. When there is not enough data, the rest is
+ * filled by the concealment function.
+ *
+ * \return number of bytes read from the ring
+ */
+static inline uint32_t spa_jitter_buffer_read(struct spa_jitter_buffer *jb, void *dst, uint32_t size)
+{
+	uint32_t index, avail;
+
+	avail = SPA_MIN(spa_jitter_buffer_get_avail(jb), size);
+	avail -= avail % jb->frame_size;
+
+	spa_ringbuffer_get_read_index(&jb->ring, &index);
+	spa_ringbuffer_read_data(&jb->ring, jb->data, jb->size,
+			(index % jb->n_frames) * jb->frame_size, dst, avail);
+	spa_ringbuffer_read_update(&jb->ring, index + avail / jb->frame_size);
+	jb->stats.consumed += avail / jb->frame_size;
+
+	if (avail < size) {
+		void *p = SPA_PTROFF(dst, avail, void);
+		uint32_t frames = (size - avail) / jb->frame_size;
+
+		if (jb->conceal)
+			jb->conceal(jb->conceal_data, p, frames);
+		else
+			memset(p, 0, size - avail);
+		jb->stats.concealed += frames;
+	}
+	return avail;
+}
+
+/** Restart level tracking from the current fill level */
+static inline void spa_jitter_buffer_recover(struct spa_jitter_buffer *jb)
+{
+	int32_t level;
+
+	jb->prev_avail = spa_jitter_buffer_get_size(jb);
+	jb->prev_consumed = jb->prev_duration;
+
+	level = (int32_t)jb->prev_avail - (int32_t)jb->prev_duration;
+	jb->corr = 1.0;
+
+	spa_jitter_rate_control_init(&jb->ctl, level);
+}
+
+/**
+ * Update the rate correction for a cycle that consumes \a samples frames
+ * with graph quantum \a duration. Call before spa_jitter_buffer_read().
+ */
+static inline void spa_jitter_buffer_process(struct spa_jitter_buffer *jb, uint32_t samples, uint32_t duration)
+{
+	const int32_t packet_size = SPA_CLAMP(jb->packet_size.max, 0, INT32_MAX/8);
+	const int32_t max_level = SPA_MAX(8 * packet_size, (int32_t)duration);
+	uint32_t avail;
+
+	if (SPA_UNLIKELY(duration != jb->prev_duration)) {
+		jb->prev_duration = duration;
+		spa_jitter_buffer_recover(jb);
+	}
+
+	if (SPA_UNLIKELY(jb->buffering)) {
+		int32_t size = spa_jitter_buffer_get_size(jb);
+
+		jb->corr = 1.0;
+
+		if (jb->log)
+			spa_log_trace(jb->log, "%p buffering size:%d", jb, (int)size);
+
+		if (jb->received &&
+				packet_size > 0 &&
+				size >= SPA_MAX(3*packet_size, (int32_t)duration))
+			jb->buffering = false;
+		else
+			return;
+
+		spa_jitter_buffer_recover(jb);
+	}
+
+	avail = spa_jitter_buffer_get_size(jb);
+
+	if (jb->received) {
+		const uint32_t avg_period = (uint64_t)jb->rate * SPA_JITTER_BUFFER_SHORT_MSEC / 1000;
+		const int32_t max_buf = jb->n_frames;
+		int32_t level, target;
+
+		/* Track buffer level */
+		level = (int32_t)jb->prev_avail - (int32_t)jb->prev_consumed;
+		level = SPA_MAX(level, -max_level);
+		jb->prev_consumed = SPA_MIN(jb->prev_consumed, avg_period);
+
+		spa_jitter_window_update(&jb->spike, jb->ctl.avg - level, jb->prev_consumed);
+
+		/* Update target level */
+		if (jb->target)
+			target = jb->target;
+		else
+			target = SPA_JITTER_BUFFER_TARGET(jb->spike.max, packet_size, max_buf);
+
+		target = SPA_MIN(target, jb->max_target);
+
+		if (level > SPA_MAX(4 * target, 2*(int32_t)duration) &&
+				avail > samples) {
+			/* Lagging too much: drop data */
+			uint32_t size = SPA_MIN(avail - samples, (uint32_t)(level - target));
+
+			spa_jitter_buffer_skip(jb, size);
+			jb->stats.dropped += size;
+			jb->stats.overruns++;
+			if (jb->log)
+				spa_log_trace(jb->log, "%p overrun samples:%d level:%d target:%d",
+						jb, (int)size, (int)level, (int)target);
+
+			spa_jitter_buffer_recover(jb);
+		}
+
+		jb->pos += jb->prev_consumed;
+		if (jb->pos > jb->rate) {
+			if (jb->log)
+				spa_log_debug(jb->log,
+						"%p avg:%d target:%d level:%d buffer:%d spike:%d corr:%f",
+						jb, (int)jb->ctl.avg, (int)target, (int)level,
+						(int)avail, (int)jb->spike.max, (double)jb->corr);
+			jb->pos = 0;
+		}
+
+		jb->corr = spa_jitter_rate_control_update(&jb->ctl,
+				level, target, jb->prev_consumed, avg_period,
+				SPA_JITTER_BUFFER_RATE_DIFF_MAX);
+
+		avail = spa_jitter_buffer_get_size(jb);
+
+		jb->stats.level = level;
+		jb->stats.target = target;
+
+		jb->prev_consumed = 0;
+		jb->prev_avail = avail;
+		jb->underrun = 0;
+		jb->received = false;
+	}
+
+	if (avail < samples) {
+		if (jb->log)
+			spa_log_trace(jb->log, "%p underrun samples:%d", jb, samples - avail);
+		jb->stats.underruns++;
+		jb->underrun += samples;
+		if (jb->underrun >= SPA_MIN((uint32_t)max_level, jb->n_frames)) {
+			jb->buffering = true;
+			if (jb->log)
+				spa_log_debug(jb->log, "%p underrun too much: start buffering", jb);
+		}
+	}
+
+	jb->prev_consumed += samples;
+}
+
+/**
+ * Update a rate match io area with the rate correction. Nothing is done
+ * when \a io is NULL.
+ */
+static inline void spa_jitter_buffer_update_rate_match(struct spa_jitter_buffer *jb,
+		struct spa_io_rate_match *io, bool active)
+{
+	if (io == NULL)
+		return;
+	io->rate = 1.0 / jb->corr;
+	SPA_FLAG_UPDATE(io->flags, SPA_IO_RATE_MATCH_FLAG_ACTIVE, active);
+}
+
+/**
+ * \}
+ */
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* SPA_UTILS_JITTER_BUFFER_H */
@@ -70,6 +70,10 @@ extern "C" {
 #define SPA_KEY_API_V4L2		"api.v4l2"			/**< key for the v4l2 api */
 #define SPA_KEY_API_V4L2_PATH		"api.v4l2.path"			/**< v4l2 device path as can be
 									  *  used in open() */
+#define SPA_KEY_API_V4L2_DECODE	"api.v4l2.decode"		/**< decode MJPEG into raw video in
+									  *  the source, boolean */
+#define SPA_KEY_API_V4L2_DECODE_THREADS	"api.v4l2.decode.threads"	/**< number of MJPEG decoder worker
+									  *  threads */
 
 /** keys for libcamera api */
 #define SPA_KEY_API_LIBCAMERA		"api.libcamera"			/**< key for the libcamera api */
@@ -116,6 +120,17 @@ extern "C" {
 #define SPA_KEY_API_JACK_SERVER		"api.jack.server"		/**< a jack server name */
 #define SPA_KEY_API_JACK_CLIENT		"api.jack.client"		/**< an internal jack client */
 
+/** keys for ffmpeg codec nodes */
+#define SPA_KEY_API_FFMPEG_CODEC	"api.ffmpeg.codec"		/**< name of the libavcodec codec to use */
+#define SPA_KEY_API_FFMPEG_THREADS	"api.ffmpeg.threads"		/**< number of codec threads, 0 is
+									  *  automatic */
+#define SPA_KEY_API_FFMPEG_THREAD_TYPE	"api.ffmpeg.thread-type"	/**< "frame", "slice" or
+									  *  "frame+slice" */
+#define SPA_KEY_API_FFMPEG_BIT_RATE	"api.ffmpeg.bit-rate"		/**< encoder bit rate in bits/s */
+#define SPA_KEY_API_FFMPEG_GOP_SIZE	"api.ffmpeg.gop-size"		/**< encoder frames between key frames */
+#define SPA_KEY_API_FFMPEG_OPTIONS	"api.ffmpeg.options"		/**< extra codec options as
+									  *  "key=value,key=value" */
+
 /** keys for glib api */
 #define SPA_KEY_API_GLIB_MAINLOOP	"api.glib.mainloop"		/**< whether glib mainloop runs
 									 * in same thread as PW loop */
@@ -107,6 +107,10 @@ extern "C" {
 
 /** keys for codec factory names */
 #define SPA_NAME_API_CODEC_BLUEZ5_MEDIA	"api.codec.bluez5.media"	/**< Bluez5 Media codec plugin */
+#define SPA_NAME_API_CODEC_FFMPEG_DECODER	"api.codec.ffmpeg.decoder"	/**< a libavcodec decoder Node
+									  *  interface */
+#define SPA_NAME_API_CODEC_FFMPEG_ENCODER	"api.codec.ffmpeg.encoder"	/**< a libavcodec encoder Node
+									  *  interface */
 
 /** keys for v4l2 factory names */
 #define SPA_NAME_API_V4L2_ENUM_UDEV	"api.v4l2.enum.udev"		/**< a v4l2 udev Device interface */
@@ -5,6 +5,9 @@
 #include "acp.h"
 #include "alsa-mixer.h"
 #include "alsa-ucm.h"
+#include "alsa-probe-cache.h"
+
+#include <time.h>
 
 #include <spa/utils/string.h>
 
@@ -1523,6 +1526,8 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 	const char *s, *profile_set = NULL, *profile = NULL;
 	char device_id[16];
 	uint32_t profile_index;
+	pa_alsa_probe_cache *cache = NULL;
+	struct timespec ts[2];
 	int res;
 
 	impl = calloc(1, sizeof(*impl));
@@ -1543,6 +1548,7 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 	impl->auto_profile = true;
 	impl->auto_port = true;
 	impl->ignore_dB = false;
+	impl->probe_cache = true;
 	impl->rate = DEFAULT_RATE;
 	impl->pro_channels = 64;
 
@@ -1565,6 +1571,8 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 			impl->rate = atoi(s);
 		if ((s = acp_dict_lookup(props, "api.acp.pro-channels")) != NULL)
 			impl->pro_channels = atoi(s);
+		if ((s = acp_dict_lookup(props, "api.acp.probe-cache")) != NULL)
+			impl->probe_cache = spa_atob(s);
 	}
 
 	impl->ucm.default_sample_spec.format = PA_SAMPLE_S16NE;
@@ -1606,12 +1614,32 @@ struct acp_card *acp_card_new(uint32_t index, const struct acp_dict *props)
 
 	impl->profile_set->ignore_dB = impl->ignore_dB;
 
+	clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+
+	/* UCM profiles are not probed by opening all PCMs, don't cache them */
+	if (impl->probe_cache && !impl->use_ucm)
+		cache = pa_alsa_probe_cache_new(NULL, card->index, impl->profile_set,
+				&impl->ucm.default_sample_spec,
+				impl->ucm.default_n_fragments,
+				impl->ucm.default_fragment_size_msec);
+	if (cache)
+		pa_alsa_probe_cache_load(cache, impl->profile_set, device_id);
+
 	pa_alsa_profile_set_probe(impl->profile_set, impl->ucm.mixers,
 			device_id,
 			&impl->ucm.default_sample_spec,
 			impl->ucm.default_n_fragments,
 			impl->ucm.default_fragment_size_msec);
 
+	if (cache && !impl->profile_set->cached)
+		pa_alsa_probe_cache_save(cache, impl->profile_set);
+	pa_alsa_probe_cache_free(cache);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+	pa_log_info("card %d: probed profiles in %.3f ms%s", card->index,
+			(SPA_TIMESPEC_TO_NSEC(&ts[1]) - SPA_TIMESPEC_TO_NSEC(&ts[0])) / 1e6,
+			impl->profile_set->cached ? " (cached)" : "");
+
 	pa_alsa_init_proplist_card(NULL, impl->proplist, impl->card.index);
 	pa_proplist_sets(impl->proplist, PA_PROP_DEVICE_STRING, device_id);
 	pa_alsa_init_description(impl->proplist, NULL);
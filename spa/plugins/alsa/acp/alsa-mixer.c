@@ -4415,7 +4415,7 @@ static void profile_set_set_availability_groups(pa_alsa_profile_set *ps) {
 
 static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
                                 pa_alsa_direction_t direction, pa_hashmap *used_paths,
-                                pa_hashmap *mixers) {
+                                pa_hashmap *mixers, const char *dev_id) {
 
     pa_alsa_path *p;
     void *state;
@@ -4438,9 +4438,11 @@ static void mapping_paths_probe(pa_alsa_mapping *m, pa_alsa_profile *profile,
     if (!ps)
         return; /* No paths */
 
-    pa_assert(pcm_handle);
-
-    mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    /* With a cached probe the PCM is not open, use the mixer of the card */
+    if (pcm_handle)
+        mixer_handle = pa_alsa_open_mixer_for_pcm(mixers, pcm_handle, true);
+    else
+        mixer_handle = pa_alsa_open_mixer(mixers, atoi(dev_id), true);
     if (!mixer_handle) {
         /* Cannot open mixer, remove all entries */
         pa_hashmap_remove_all(ps->paths);
@@ -5064,6 +5066,45 @@ static void mapping_query_hw_device(pa_alsa_mapping *mapping, snd_pcm_t *pcm) {
     mapping->hw_device_index = snd_pcm_info_get_device(pcm_info);
 }
 
+/* The supported profiles and mappings were restored from the probe cache,
+ * only probe the mixer paths of the mappings. */
+static void profile_set_probe_cached(pa_alsa_profile_set *ps, pa_hashmap *mixers, const char *dev_id) {
+    pa_alsa_profile *p;
+    pa_alsa_mapping *m;
+    pa_hashmap *used_paths;
+    void *state;
+    uint32_t idx;
+
+    used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
+
+    PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+        if (!p->supported)
+            continue;
+
+        pa_log_debug("Profile %s supported (cached).", p->name);
+
+        if (p->output_mappings)
+            PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+                if (m->cached_output)
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, dev_id);
+
+        if (p->input_mappings)
+            PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+                if (m->cached_input)
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, dev_id);
+    }
+
+    pa_alsa_profile_set_drop_unsupported(ps);
+
+    paths_drop_unused(ps->input_paths, used_paths);
+    paths_drop_unused(ps->output_paths, used_paths);
+    pa_hashmap_free(used_paths);
+
+    profile_set_set_availability_groups(ps);
+
+    ps->probed = true;
+}
+
 void pa_alsa_profile_set_probe(
         pa_alsa_profile_set *ps,
         pa_hashmap *mixers,
@@ -5087,6 +5128,11 @@ void pa_alsa_profile_set_probe(
     if (ps->probed)
         return;
 
+    if (ps->cached) {
+        profile_set_probe_cached(ps, mixers, dev_id);
+        return;
+    }
+
     broken_inputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     broken_outputs = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
     used_paths = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
@@ -5205,7 +5251,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_output && selected_fallback_output == NULL) {
                         selected_fallback_output = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_OUTPUT, used_paths, mixers, dev_id);
                 }
 
         if (p->input_mappings)
@@ -5215,7 +5261,7 @@ void pa_alsa_profile_set_probe(
                     if (p->fallback_input && selected_fallback_input == NULL) {
                         selected_fallback_input = m;
                     }
-                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers);
+                    mapping_paths_probe(m, p, PA_ALSA_DIRECTION_INPUT, used_paths, mixers, dev_id);
                 }
     }
 
@@ -344,6 +344,10 @@ struct pa_alsa_mapping {
      * queried, or if the query failed. */
     int hw_device_index;
 
+    /* Set by the probe cache for the directions whose paths need probing */
+    bool cached_output:1;
+    bool cached_input:1;
+
     /* Temporarily used during probing */
     snd_pcm_t *input_pcm;
     snd_pcm_t *output_pcm;
@@ -415,6 +419,7 @@ struct pa_alsa_profile_set {
     bool auto_profiles;
     bool ignore_dB:1;
     bool probed:1;
+    bool cached:1;
 };
 
 void pa_alsa_mapping_dump(pa_alsa_mapping *m);
@@ -0,0 +1,649 @@
+/* ALSA Card Profile probe cache */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <spa/utils/json.h>
+
+#include "compat.h"
+#include "alsa-util.h"
+#include "alsa-probe-cache.h"
+
+/* Bump when the meaning of the stored data changes */
+#define CACHE_VERSION	1
+
+struct pa_alsa_probe_cache {
+	char *path;
+	uint64_t key;
+
+	pa_sample_spec ss;
+	unsigned n_fragments;
+	unsigned fragment_size_msec;
+};
+
+struct cached_mapping {
+	pa_alsa_mapping *m;
+	unsigned supported;
+	int hw_device_index;
+	pa_channel_map channel_map;
+	bool output_paths;
+	bool input_paths;
+	pa_proplist *output_props;
+	pa_proplist *input_props;
+};
+
+struct cached_result {
+	pa_alsa_profile **profiles;
+	unsigned n_profiles;
+	struct cached_mapping *mappings;
+	unsigned n_mappings;
+};
+
+/* FNV-1a, the key only needs to change when anything it covers changes */
+static void hash_data(uint64_t *h, const void *data, size_t size)
+{
+	const uint8_t *d = data;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		*h ^= d[i];
+		*h *= 0x100000001b3ULL;
+	}
+}
+
+static void hash_str(uint64_t *h, const char *str)
+{
+	hash_data(h, str ? str : "", str ? strlen(str) + 1 : 1);
+}
+
+static void hash_int(uint64_t *h, int64_t val)
+{
+	hash_data(h, &val, sizeof(val));
+}
+
+static void hash_channel_map(uint64_t *h, const pa_channel_map *map)
+{
+	unsigned i;
+	hash_int(h, map->channels);
+	for (i = 0; i < map->channels; i++)
+		hash_int(h, map->map[i]);
+}
+
+/* Hash what identifies the card and its devices, without opening any PCM */
+static int hash_card(uint64_t *h, int card_index, char *id, size_t id_size)
+{
+	snd_ctl_t *ctl;
+	snd_ctl_card_info_t *info;
+	snd_ctl_elem_list_t *list;
+	snd_pcm_info_t *pcm_info;
+	char name[32];
+	unsigned i, count;
+	int err, dev = -1;
+
+	snd_ctl_card_info_alloca(&info);
+	snd_ctl_elem_list_alloca(&list);
+	snd_pcm_info_alloca(&pcm_info);
+
+	snprintf(name, sizeof(name), "hw:%d", card_index);
+	if ((err = snd_ctl_open(&ctl, name, 0)) < 0)
+		return err;
+
+	if ((err = snd_ctl_card_info(ctl, info)) < 0)
+		goto exit;
+
+	hash_str(h, snd_ctl_card_info_get_driver(info));
+	hash_str(h, snd_ctl_card_info_get_name(info));
+	hash_str(h, snd_ctl_card_info_get_mixername(info));
+	hash_str(h, snd_ctl_card_info_get_components(info));
+	snprintf(id, id_size, "%s", snd_ctl_card_info_get_id(info));
+
+	if ((err = snd_ctl_elem_list(ctl, list)) < 0)
+		goto exit;
+	count = snd_ctl_elem_list_get_count(list);
+	if ((err = snd_ctl_elem_list_alloc_space(list, count)) < 0)
+		goto exit;
+	if ((err = snd_ctl_elem_list(ctl, list)) < 0)
+		goto free_list;
+
+	hash_int(h, count);
+	for (i = 0; i < snd_ctl_elem_list_get_used(list); i++) {
+		hash_int(h, snd_ctl_elem_list_get_interface(list, i));
+		hash_int(h, snd_ctl_elem_list_get_device(list, i));
+		hash_int(h, snd_ctl_elem_list_get_subdevice(list, i));
+		hash_int(h, snd_ctl_elem_list_get_index(list, i));
+		hash_str(h, snd_ctl_elem_list_get_name(list, i));
+	}
+
+	while (snd_ctl_pcm_next_device(ctl, &dev) >= 0 && dev >= 0) {
+		snd_pcm_stream_t stream;
+
+		for (stream = SND_PCM_STREAM_PLAYBACK; stream <= SND_PCM_STREAM_LAST; stream++) {
+			snd_pcm_info_set_device(pcm_info, dev);
+			snd_pcm_info_set_subdevice(pcm_info, 0);
+			snd_pcm_info_set_stream(pcm_info, stream);
+			if (snd_ctl_pcm_info(ctl, pcm_info) < 0)
+				continue;
+			hash_int(h, dev);
+			hash_int(h, stream);
+			hash_int(h, snd_pcm_info_get_subdevices_count(pcm_info));
+			hash_str(h, snd_pcm_info_get_id(pcm_info));
+		}
+	}
+	err = 0;
+
+free_list:
+	snd_ctl_elem_list_free_space(list);
+exit:
+	snd_ctl_close(ctl);
+	return err;
+}
+
+static void hash_profile_set(uint64_t *h, pa_alsa_profile_set *ps)
+{
+	pa_alsa_mapping *m;
+	pa_alsa_profile *p;
+	void *state;
+	uint32_t idx;
+	char **s;
+
+	PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+		hash_str(h, m->name);
+		hash_int(h, m->direction);
+		hash_int(h, m->exact_channels);
+		hash_int(h, m->fallback);
+		hash_channel_map(h, &m->channel_map);
+		for (s = m->device_strings; s && *s; s++)
+			hash_str(h, *s);
+		hash_str(h, NULL);
+	}
+	PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+		hash_str(h, p->name);
+		hash_int(h, p->supported);
+		hash_int(h, p->fallback_input);
+		hash_int(h, p->fallback_output);
+		if (p->output_mappings)
+			PA_IDXSET_FOREACH(m, p->output_mappings, idx)
+				hash_str(h, m->name);
+		hash_str(h, NULL);
+		if (p->input_mappings)
+			PA_IDXSET_FOREACH(m, p->input_mappings, idx)
+				hash_str(h, m->name);
+		hash_str(h, NULL);
+	}
+}
+
+static char *default_dir(void)
+{
+	const char *d;
+
+	if ((d = getenv("XDG_CACHE_HOME")) != NULL)
+		return pa_sprintf_malloc("%s/pipewire", d);
+	if ((d = getenv("HOME")) != NULL)
+		return pa_sprintf_malloc("%s/.cache/pipewire", d);
+	return NULL;
+}
+
+static int ensure_dir(char *path)
+{
+	char *p;
+
+	/* make all parents, the last component is the cache file */
+	for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+			*p = '/';
+			return -errno;
+		}
+		*p = '/';
+	}
+	return 0;
+}
+
+pa_alsa_probe_cache *pa_alsa_probe_cache_new(const char *dir, int card_index,
+		pa_alsa_profile_set *ps, const pa_sample_spec *ss,
+		unsigned default_n_fragments, unsigned default_fragment_size_msec)
+{
+	pa_alsa_probe_cache *c;
+	char id[64], *d = NULL;
+	uint64_t key = 0xcbf29ce484222325ULL;
+	int err;
+	char *p;
+
+	if ((err = hash_card(&key, card_index, id, sizeof(id))) < 0) {
+		pa_log_debug("Can't identify card %d for the probe cache: %s",
+				card_index, pa_alsa_strerror(err));
+		return NULL;
+	}
+	if (dir == NULL && (dir = d = default_dir()) == NULL)
+		return NULL;
+
+	hash_profile_set(&key, ps);
+	hash_int(&key, ss->format);
+	hash_int(&key, ss->rate);
+	hash_int(&key, ss->channels);
+	hash_int(&key, default_n_fragments);
+	hash_int(&key, default_fragment_size_msec);
+	hash_str(&key, snd_asoundlib_version());
+	hash_int(&key, CACHE_VERSION);
+
+	/* the card id is unique in the system and stays the same when the
+	 * card index changes */
+	for (p = id; *p; p++)
+		if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_')
+			*p = '_';
+
+	c = pa_xnew0(pa_alsa_probe_cache, 1);
+	c->path = pa_sprintf_malloc("%s/alsa-probe-%s.json", dir, id);
+	c->key = key;
+	c->ss = *ss;
+	c->n_fragments = default_n_fragments;
+	c->fragment_size_msec = default_fragment_size_msec;
+	pa_xfree(d);
+
+	return c;
+}
+
+void pa_alsa_probe_cache_free(pa_alsa_probe_cache *c)
+{
+	if (c == NULL)
+		return;
+	pa_xfree(c->path);
+	pa_xfree(c);
+}
+
+static void cached_result_clear(struct cached_result *r)
+{
+	unsigned i;
+	for (i = 0; i < r->n_mappings; i++) {
+		if (r->mappings[i].output_props)
+			pa_proplist_free(r->mappings[i].output_props);
+		if (r->mappings[i].input_props)
+			pa_proplist_free(r->mappings[i].input_props);
+	}
+	pa_xfree(r->mappings);
+	pa_xfree(r->profiles);
+}
+
+static pa_proplist *parse_props(struct spa_json *it)
+{
+	struct spa_json sub;
+	pa_proplist *props;
+	char key[256], val[1024];
+
+	if (spa_json_enter_object(it, &sub) <= 0)
+		return NULL;
+
+	props = pa_proplist_new();
+	while (spa_json_get_string(&sub, key, sizeof(key)) > 0) {
+		if (spa_json_get_string(&sub, val, sizeof(val)) <= 0)
+			break;
+		pa_proplist_sets(props, key, val);
+	}
+	return props;
+}
+
+static int parse_mapping(struct spa_json *it, struct cached_mapping *cm)
+{
+	struct spa_json sub;
+	char key[64], val[PA_CHANNEL_MAP_SNPRINT_MAX];
+	const char *v;
+
+	if (spa_json_enter_object(it, &sub) <= 0)
+		return -EINVAL;
+
+	cm->hw_device_index = -1;
+	while (spa_json_get_string(&sub, key, sizeof(key)) > 0) {
+		int i;
+
+		if (spa_streq(key, "supported")) {
+			if (spa_json_get_int(&sub, &i) <= 0 || i <= 0)
+				return -EINVAL;
+			cm->supported = i;
+		} else if (spa_streq(key, "hw-device")) {
+			if (spa_json_get_int(&sub, &cm->hw_device_index) <= 0)
+				return -EINVAL;
+		} else if (spa_streq(key, "channels")) {
+			if (spa_json_get_string(&sub, val, sizeof(val)) <= 0 ||
+			    pa_channel_map_parse(&cm->channel_map, val) == NULL)
+				return -EINVAL;
+		} else if (spa_streq(key, "output-paths")) {
+			if (spa_json_get_bool(&sub, &cm->output_paths) <= 0)
+				return -EINVAL;
+		} else if (spa_streq(key, "input-paths")) {
+			if (spa_json_get_bool(&sub, &cm->input_paths) <= 0)
+				return -EINVAL;
+		} else if (spa_streq(key, "output-props") && cm->output_props == NULL) {
+			if ((cm->output_props = parse_props(&sub)) == NULL)
+				return -EINVAL;
+		} else if (spa_streq(key, "input-props") && cm->input_props == NULL) {
+			if ((cm->input_props = parse_props(&sub)) == NULL)
+				return -EINVAL;
+		} else if (spa_json_next(&sub, &v) <= 0)
+			return -EINVAL;
+	}
+	if (cm->supported == 0 || cm->channel_map.channels == 0)
+		return -EINVAL;
+	return 0;
+}
+
+static int parse_result(pa_alsa_probe_cache *c, pa_alsa_profile_set *ps,
+		const char *str, size_t size, struct cached_result *r)
+{
+	struct spa_json it[3];
+	char key[256];
+	bool have_key = false;
+	const char *v;
+	int res;
+
+	r->profiles = pa_xnew0(pa_alsa_profile *, pa_hashmap_size(ps->profiles));
+	r->mappings = pa_xnew0(struct cached_mapping, pa_hashmap_size(ps->mappings));
+
+	spa_json_init(&it[0], str, size);
+	if (spa_json_enter_object(&it[0], &it[1]) <= 0)
+		return -EINVAL;
+
+	while (spa_json_get_string(&it[1], key, sizeof(key)) > 0) {
+		if (spa_streq(key, "key")) {
+			char val[32];
+
+			if (spa_json_get_string(&it[1], val, sizeof(val)) <= 0)
+				return -EINVAL;
+			if (strtoull(val, NULL, 16) != c->key)
+				return -ESTALE;
+			have_key = true;
+		} else if (spa_streq(key, "profiles")) {
+			if (spa_json_enter_array(&it[1], &it[2]) <= 0)
+				return -EINVAL;
+			while (spa_json_get_string(&it[2], key, sizeof(key)) > 0) {
+				pa_alsa_profile *p;
+
+				if ((p = pa_hashmap_get(ps->profiles, key)) == NULL ||
+				    r->n_profiles >= pa_hashmap_size(ps->profiles))
+					return -EINVAL;
+				r->profiles[r->n_profiles++] = p;
+			}
+		} else if (spa_streq(key, "mappings")) {
+			if (spa_json_enter_object(&it[1], &it[2]) <= 0)
+				return -EINVAL;
+			while (spa_json_get_string(&it[2], key, sizeof(key)) > 0) {
+				struct cached_mapping *cm;
+				pa_alsa_mapping *m;
+
+				if ((m = pa_hashmap_get(ps->mappings, key)) == NULL ||
+				    r->n_mappings >= pa_hashmap_size(ps->mappings))
+					return -EINVAL;
+				cm = &r->mappings[r->n_mappings++];
+				cm->m = m;
+				if ((res = parse_mapping(&it[2], cm)) < 0)
+					return res;
+			}
+		} else if (spa_json_next(&it[1], &v) <= 0)
+			return -EINVAL;
+	}
+	return have_key ? 0 : -EINVAL;
+}
+
+static struct cached_mapping *find_mapping(struct cached_result *r, pa_alsa_mapping *m)
+{
+	unsigned i;
+	for (i = 0; i < r->n_mappings; i++)
+		if (r->mappings[i].m == m)
+			return &r->mappings[i];
+	return NULL;
+}
+
+static int verify_mapping(pa_alsa_probe_cache *c, struct cached_mapping *cm,
+		const char *dev_id, int mode)
+{
+	pa_sample_spec try_ss = c->ss;
+	pa_channel_map try_map = cm->channel_map;
+	snd_pcm_uframes_t try_period_size, try_buffer_size;
+	snd_pcm_t *handle;
+
+	try_ss.channels = try_map.channels;
+	try_period_size =
+		pa_usec_to_bytes(c->fragment_size_msec * PA_USEC_PER_MSEC, &try_ss) /
+		pa_frame_size(&try_ss);
+	try_buffer_size = c->n_fragments * try_period_size;
+
+	handle = pa_alsa_open_by_template(cm->m->device_strings, dev_id, NULL,
+			&try_ss, &try_map, mode, &try_period_size, &try_buffer_size,
+			0, NULL, NULL, true);
+	if (handle == NULL)
+		return -EIO;
+	pa_alsa_close(&handle);
+	return 0;
+}
+
+/* Only the PCMs of the profile that is most likely going to be used are
+ * opened, the others are opened when they are selected. */
+static int verify_result(pa_alsa_probe_cache *c, struct cached_result *r, const char *dev_id)
+{
+	pa_alsa_profile *best = NULL;
+	struct cached_mapping *cm;
+	pa_alsa_mapping *m;
+	uint32_t idx;
+	unsigned i;
+
+	for (i = 0; i < r->n_profiles; i++)
+		if (best == NULL || r->profiles[i]->priority > best->priority)
+			best = r->profiles[i];
+	if (best == NULL)
+		return 0;
+
+	if (best->output_mappings)
+		PA_IDXSET_FOREACH(m, best->output_mappings, idx) {
+			if ((cm = find_mapping(r, m)) == NULL ||
+			    verify_mapping(c, cm, dev_id, SND_PCM_STREAM_PLAYBACK) < 0)
+				return -EIO;
+		}
+	if (best->input_mappings)
+		PA_IDXSET_FOREACH(m, best->input_mappings, idx) {
+			if ((cm = find_mapping(r, m)) == NULL ||
+			    verify_mapping(c, cm, dev_id, SND_PCM_STREAM_CAPTURE) < 0)
+				return -EIO;
+		}
+	return 0;
+}
+
+static void apply_result(pa_alsa_profile_set *ps, struct cached_result *r)
+{
+	pa_alsa_profile *p;
+	pa_alsa_mapping *m;
+	void *state;
+	unsigned i;
+
+	for (i = 0; i < r->n_profiles; i++)
+		r->profiles[i]->supported = true;
+
+	PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+		struct cached_mapping *cm = find_mapping(r, m);
+
+		if (cm == NULL) {
+			m->supported = 0;
+			continue;
+		}
+		m->supported = cm->supported;
+		m->hw_device_index = cm->hw_device_index;
+		m->channel_map = cm->channel_map;
+		m->cached_output = cm->output_paths;
+		m->cached_input = cm->input_paths;
+		if (cm->output_props)
+			pa_proplist_update(m->output_proplist, PA_UPDATE_REPLACE, cm->output_props);
+		if (cm->input_props)
+			pa_proplist_update(m->input_proplist, PA_UPDATE_REPLACE, cm->input_props);
+	}
+
+	PA_HASHMAP_FOREACH(p, ps->profiles, state)
+		if (!p->supported)
+			pa_log_debug("Profile %s not supported (cached).", p->name);
+
+	ps->cached = true;
+}
+
+static char *read_file(const char *path, size_t *size)
+{
+	struct stat st;
+	char *data;
+	ssize_t len;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size <= 0 || st.st_size > 1024 * 1024) {
+		close(fd);
+		return NULL;
+	}
+	data = pa_xnew(char, st.st_size);
+	len = read(fd, data, st.st_size);
+	close(fd);
+
+	if (len != st.st_size) {
+		pa_xfree(data);
+		return NULL;
+	}
+	*size = len;
+	return data;
+}
+
+int pa_alsa_probe_cache_load(pa_alsa_probe_cache *c, pa_alsa_profile_set *ps, const char *dev_id)
+{
+	struct cached_result r;
+	char *data;
+	size_t size;
+	int res;
+
+	pa_assert(c);
+	pa_assert(ps);
+
+	if ((data = read_file(c->path, &size)) == NULL)
+		return -ENOENT;
+
+	spa_zero(r);
+	res = parse_result(c, ps, data, size, &r);
+	pa_xfree(data);
+
+	if (res == -ESTALE) {
+		pa_log_info("Probe cache %s is stale", c->path);
+		goto done;
+	} else if (res < 0) {
+		pa_log_warn("Probe cache %s is invalid", c->path);
+		goto done;
+	}
+
+	if ((res = verify_result(c, &r, dev_id)) < 0) {
+		pa_log_info("Probe cache %s doesn't match the card", c->path);
+		goto done;
+	}
+
+	apply_result(ps, &r);
+	pa_log_info("Using probe cache %s: %u profiles, %u mappings",
+			c->path, r.n_profiles, r.n_mappings);
+done:
+	cached_result_clear(&r);
+	return res;
+}
+
+static void write_string(FILE *f, const char *str)
+{
+	int len = spa_json_encode_string(NULL, 0, str ? str : "");
+	char *buf = alloca(len + 1);
+
+	spa_json_encode_string(buf, len + 1, str ? str : "");
+	fputs(buf, f);
+}
+
+static void write_props(FILE *f, const char *key, pa_proplist *props)
+{
+	pa_proplist_item *it;
+	bool first = true;
+
+	fprintf(f, ",\n      \"%s\": {", key);
+	pa_array_for_each(it, &props->array) {
+		fprintf(f, "%s\n        ", first ? "" : ",");
+		write_string(f, it->key);
+		fputs(": ", f);
+		write_string(f, it->value);
+		first = false;
+	}
+	fputs(first ? "}" : "\n      }", f);
+}
+
+int pa_alsa_probe_cache_save(pa_alsa_probe_cache *c, pa_alsa_profile_set *ps)
+{
+	char buf[PA_CHANNEL_MAP_SNPRINT_MAX], *tmp;
+	pa_alsa_profile *p;
+	pa_alsa_mapping *m;
+	void *state;
+	bool first;
+	FILE *f;
+	int res;
+
+	pa_assert(c);
+	pa_assert(ps);
+	pa_assert(ps->probed);
+
+	if ((res = ensure_dir(c->path)) < 0) {
+		pa_log_warn("Can't make directory for %s: %s", c->path, strerror(-res));
+		return res;
+	}
+
+	tmp = pa_sprintf_malloc("%s.tmp", c->path);
+	if ((f = fopen(tmp, "we")) == NULL) {
+		res = -errno;
+		pa_log_warn("Can't open %s: %m", tmp);
+		pa_xfree(tmp);
+		return res;
+	}
+
+	/* After probing, only the supported profiles and mappings are left */
+	fprintf(f, "{\n  \"key\": \"%016" PRIx64 "\",\n  \"profiles\": [", c->key);
+	first = true;
+	PA_HASHMAP_FOREACH(p, ps->profiles, state) {
+		fputs(first ? "\n    " : ",\n    ", f);
+		write_string(f, p->name);
+		first = false;
+	}
+	fputs("\n  ],\n  \"mappings\": {", f);
+	first = true;
+	PA_HASHMAP_FOREACH(m, ps->mappings, state) {
+		fputs(first ? "\n    " : ",\n    ", f);
+		write_string(f, m->name);
+		fprintf(f, ": {\n      \"supported\": %u,\n      \"hw-device\": %d,\n      \"channels\": ",
+				m->supported, m->hw_device_index);
+		write_string(f, pa_channel_map_snprint(buf, sizeof(buf), &m->channel_map));
+		fprintf(f, ",\n      \"output-paths\": %s,\n      \"input-paths\": %s",
+				m->output_path_set ? "true" : "false",
+				m->input_path_set ? "true" : "false");
+		write_props(f, "output-props", m->output_proplist);
+		write_props(f, "input-props", m->input_proplist);
+		fputs("\n    }", f);
+		first = false;
+	}
+	fputs("\n  }\n}\n", f);
+
+	if (fflush(f) != 0 || ferror(f)) {
+		res = -EIO;
+		fclose(f);
+		goto error;
+	}
+	fclose(f);
+
+	if (rename(tmp, c->path) < 0) {
+		res = -errno;
+		goto error;
+	}
+	pa_xfree(tmp);
+	pa_log_info("Saved probe cache %s", c->path);
+	return 0;
+
+error:
+	pa_log_warn("Can't write %s: %s", c->path, strerror(-res));
+	unlink(tmp);
+	pa_xfree(tmp);
+	return res;
+}
@@ -0,0 +1,33 @@
+/* ALSA Card Profile probe cache */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef fooalsaprobecachehfoo
+#define fooalsaprobecachehfoo
+
+#include "alsa-mixer.h"
+
+/* Keeps the result of pa_alsa_profile_set_probe() of a card in a file so
+ * that the next time the card is added, the PCMs of the profiles don't need
+ * to be opened again. The cache is keyed on the card driver and components,
+ * the control elements and PCM devices of the card, the profile set and the
+ * probe parameters. Any change to those makes the cache miss. */
+typedef struct pa_alsa_probe_cache pa_alsa_probe_cache;
+
+/* Make a cache for the card, must be called before the profile set is
+ * probed. With dir NULL, the cache is stored in $XDG_CACHE_HOME/pipewire. */
+pa_alsa_probe_cache *pa_alsa_probe_cache_new(const char *dir, int card_index,
+		pa_alsa_profile_set *ps, const pa_sample_spec *ss,
+		unsigned default_n_fragments, unsigned default_fragment_size_msec);
+void pa_alsa_probe_cache_free(pa_alsa_probe_cache *c);
+
+/* Restore the probe result into the profile set. The PCMs of the best
+ * profile are opened to check that the cache is still valid. On success,
+ * the profile set is marked as cached and pa_alsa_profile_set_probe() only
+ * probes the mixer paths. */
+int pa_alsa_probe_cache_load(pa_alsa_probe_cache *c, pa_alsa_profile_set *ps, const char *dev_id);
+
+/* Store the result of pa_alsa_profile_set_probe() */
+int pa_alsa_probe_cache_save(pa_alsa_probe_cache *c, pa_alsa_profile_set *ps);
+
+#endif
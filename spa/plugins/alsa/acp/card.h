@@ -47,6 +47,7 @@ struct pa_card {
 	bool auto_profile;
 	bool auto_port;
 	bool ignore_dB;
+	bool probe_cache;
 	uint32_t rate;
 	uint32_t pro_channels;
 
@@ -10,6 +10,7 @@
 #include <spa/support/plugin.h>
 #include <spa/support/cpu.h>
 #include <spa/support/log.h>
+#include <spa/support/loop.h>
 #include <spa/utils/result.h>
 #include <spa/utils/list.h>
 #include <spa/utils/json.h>
@@ -30,7 +31,7 @@
 #include "fmt-ops.h"
 #include "channelmix-ops.h"
 #include "resample.h"
-#include "wavfile.h"
+#include "tap.h"
 
 #undef SPA_LOG_TOPIC_DEFAULT
 #define SPA_LOG_TOPIC_DEFAULT log_topic
@@ -84,7 +85,9 @@ struct props {
 	unsigned int resample_disabled:1;
 	unsigned int resample_quality;
 	double rate;
-	char wav_path[512];
+	char tap_path[512];
+	enum tap_format tap_format;
+	uint32_t tap_buffer_msec;
 };
 
 static void props_reset(struct props *props)
@@ -102,7 +105,9 @@ static void props_reset(struct props *props)
 	props->resample_disabled = false;
 	props->resample_quality = RESAMPLE_DEFAULT_QUALITY;
 	props->rate = 1.0;
-	spa_zero(props->wav_path);
+	spa_zero(props->tap_path);
+	props->tap_format = TAP_FORMAT_AUTO;
+	props->tap_buffer_msec = TAP_DEFAULT_BUFFER_MSEC;
 }
 
 struct buffer {
@@ -226,7 +231,10 @@ struct impl {
 	float *tmp[2];
 	float *tmp_datas[2][MAX_PORTS];
 
-	struct wav_file *wav_file;
+	struct spa_loop *data_loop;
+	struct tap *tap;
+	struct tap_info tap_info;
+	unsigned int tap_changed:1;
 };
 
 #define CHECK_PORT(this,d,p)		((p) < this->dir[d].n_ports)
@@ -664,7 +672,60 @@ static int impl_node_enum_params(void *object, int seq,
 				SPA_TYPE_OBJECT_PropInfo, id,
 				SPA_PROP_INFO_name, SPA_POD_String("debug.wav-path"),
 				SPA_PROP_INFO_description, SPA_POD_String("Path to WAV file"),
-				SPA_PROP_INFO_type, SPA_POD_String(p->wav_path),
+				SPA_PROP_INFO_type, SPA_POD_String(
+					p->tap_format == TAP_FORMAT_WAV ? p->tap_path : ""),
+				SPA_PROP_INFO_params, SPA_POD_Bool(true));
+			break;
+		case 25:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_name, SPA_POD_String("debug.tap.path"),
+				SPA_PROP_INFO_description, SPA_POD_String("Capture to file or unix:<socket>"),
+				SPA_PROP_INFO_type, SPA_POD_String(p->tap_path),
+				SPA_PROP_INFO_params, SPA_POD_Bool(true));
+			break;
+		case 26:
+			spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_PropInfo, id);
+			spa_pod_builder_add(&b,
+				SPA_PROP_INFO_name, SPA_POD_String("debug.tap.format"),
+				SPA_PROP_INFO_description, SPA_POD_String("Capture file format"),
+				SPA_PROP_INFO_type, SPA_POD_String(tap_format_to_label(p->tap_format)),
+				SPA_PROP_INFO_params, SPA_POD_Bool(true),
+				0);
+			spa_pod_builder_prop(&b, SPA_PROP_INFO_labels, 0);
+			spa_pod_builder_push_struct(&b, &f[1]);
+			spa_pod_builder_string(&b, tap_format_to_label(TAP_FORMAT_AUTO));
+			spa_pod_builder_string(&b, "WAV for .wav paths, else raw");
+			spa_pod_builder_string(&b, tap_format_to_label(TAP_FORMAT_WAV));
+			spa_pod_builder_string(&b, "WAV");
+			spa_pod_builder_string(&b, tap_format_to_label(TAP_FORMAT_RAW));
+			spa_pod_builder_string(&b, "Raw samples");
+			spa_pod_builder_pop(&b, &f[1]);
+			param = spa_pod_builder_pop(&b, &f[0]);
+			break;
+		case 27:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_name, SPA_POD_String("debug.tap.buffer-msec"),
+				SPA_PROP_INFO_description, SPA_POD_String("Capture buffer size (ms)"),
+				SPA_PROP_INFO_type, SPA_POD_CHOICE_RANGE_Int(
+					p->tap_buffer_msec, 1, TAP_MAX_BUFFER_MSEC),
+				SPA_PROP_INFO_params, SPA_POD_Bool(true));
+			break;
+		case 28:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_name, SPA_POD_String("debug.tap.written"),
+				SPA_PROP_INFO_description, SPA_POD_String("Captured samples (read-only)"),
+				SPA_PROP_INFO_type, SPA_POD_Long(0),
+				SPA_PROP_INFO_params, SPA_POD_Bool(true));
+			break;
+		case 29:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_PropInfo, id,
+				SPA_PROP_INFO_name, SPA_POD_String("debug.tap.dropped"),
+				SPA_PROP_INFO_description, SPA_POD_String("Dropped capture samples (read-only)"),
+				SPA_PROP_INFO_type, SPA_POD_Long(0),
 				SPA_PROP_INFO_params, SPA_POD_Bool(true));
 			break;
 		default:
@@ -740,7 +801,22 @@ static int impl_node_enum_params(void *object, int seq,
 			spa_pod_builder_string(&b, "dither.method");
 			spa_pod_builder_string(&b, dither_method_info[this->dir[1].conv.method].label);
 			spa_pod_builder_string(&b, "debug.wav-path");
-			spa_pod_builder_string(&b, p->wav_path);
+			spa_pod_builder_string(&b,
+					p->tap_format == TAP_FORMAT_WAV ? p->tap_path : "");
+			spa_pod_builder_string(&b, "debug.tap.path");
+			spa_pod_builder_string(&b, p->tap_path);
+			spa_pod_builder_string(&b, "debug.tap.format");
+			spa_pod_builder_string(&b, tap_format_to_label(p->tap_format));
+			spa_pod_builder_string(&b, "debug.tap.buffer-msec");
+			spa_pod_builder_int(&b, p->tap_buffer_msec);
+			if (this->tap) {
+				uint64_t written, dropped;
+				tap_get_stats(this->tap, &written, &dropped);
+				spa_pod_builder_string(&b, "debug.tap.written");
+				spa_pod_builder_long(&b, written);
+				spa_pod_builder_string(&b, "debug.tap.dropped");
+				spa_pod_builder_long(&b, dropped);
+			}
 			spa_pod_builder_pop(&b, &f[1]);
 			param = spa_pod_builder_pop(&b, &f[0]);
 			break;
@@ -814,9 +890,20 @@ static int audioconvert_set_param(struct impl *this, const char *k, const char *
 		spa_atou32(s, &this->dir[1].conv.noise_bits, 0);
 	else if (spa_streq(k, "dither.method"))
 		this->dir[1].conv.method = dither_method_from_label(s);
-	else if (spa_streq(k, "debug.wav-path")) {
-		spa_scnprintf(this->props.wav_path,
-				sizeof(this->props.wav_path), "%s", s ? s : "");
+	else if (spa_streq(k, "debug.wav-path") || spa_streq(k, "debug.tap.path")) {
+		spa_scnprintf(this->props.tap_path,
+				sizeof(this->props.tap_path), "%s", s ? s : "");
+		if (spa_streq(k, "debug.wav-path"))
+			this->props.tap_format = TAP_FORMAT_WAV;
+		this->tap_changed = true;
+	}
+	else if (spa_streq(k, "debug.tap.format")) {
+		this->props.tap_format = tap_format_from_label(s);
+		this->tap_changed = true;
+	}
+	else if (spa_streq(k, "debug.tap.buffer-msec")) {
+		spa_atou32(s, &this->props.tap_buffer_msec, 0);
+		this->tap_changed = true;
 	}
 	else
 		return 0;
@@ -1262,6 +1349,65 @@ static int reconfigure_mode(struct impl *this, enum spa_param_port_config_mode m
 	return 0;
 }
 
+static int do_set_tap(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	this->tap = *(struct tap **)data;
+	return 0;
+}
+
+static void set_tap(struct impl *this, struct tap *tap)
+{
+	struct tap *old = this->tap;
+
+	if (this->data_loop)
+		spa_loop_invoke(this->data_loop, do_set_tap, 0, &tap, sizeof(tap), true, this);
+	else
+		this->tap = tap;
+	if (old)
+		tap_destroy(old);
+}
+
+/* (re)open the capture tap when its properties or the format changed, the
+ * data thread only ever sees a fully set up tap */
+static void update_tap(struct impl *this)
+{
+	struct props *p = &this->props;
+	struct tap_info info;
+	struct tap *tap;
+
+	if (p->tap_path[0] == '\0') {
+		if (this->tap)
+			set_tap(this, NULL);
+		this->tap_changed = false;
+		return;
+	}
+	if (!this->setup)
+		return;
+
+	spa_zero(info);
+	info.info = this->dir[this->direction].format;
+	info.format = p->tap_format;
+	info.buffer_msec = p->tap_buffer_msec;
+
+	if (this->tap && !this->tap_changed &&
+	    memcmp(&info, &this->tap_info, sizeof(info)) == 0)
+		return;
+
+	this->tap_changed = false;
+	if (this->tap)
+		set_tap(this, NULL);
+
+	if ((tap = tap_new(this->log, p->tap_path, &info)) == NULL) {
+		spa_log_warn(this->log, "%p: can't open tap '%s': %m", this, p->tap_path);
+		spa_zero(p->tap_path);
+		return;
+	}
+	this->tap_info = info;
+	set_tap(this, tap);
+}
+
 static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 			       const struct spa_pod *param)
 {
@@ -1323,6 +1469,8 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	case SPA_PARAM_Props:
 		if (apply_props(this, param) > 0)
 			emit_node_info(this, false);
+		if (this->tap_changed)
+			update_tap(this);
 		break;
 	default:
 		return -ENOENT;
@@ -1770,6 +1918,7 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 			return 0;
 		if ((res = setup_convert(this)) < 0)
 			return res;
+		update_tap(this);
 		this->started = true;
 		break;
 	case SPA_NODE_COMMAND_Suspend:
@@ -2396,28 +2545,10 @@ static int impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t
 	return 0;
 }
 
-static void handle_wav(struct impl *this, const void **src, uint32_t n_samples)
+static inline void handle_tap(struct impl *this, const void **src, uint32_t n_samples)
 {
-	if (SPA_UNLIKELY(this->props.wav_path[0])) {
-		if (this->wav_file == NULL) {
-			struct wav_file_info info;
-
-			info.info = this->dir[this->direction].format;
-
-			this->wav_file = wav_file_open(this->props.wav_path,
-					"w", &info);
-			if (this->wav_file == NULL)
-				spa_log_warn(this->log, "can't open wav path: %m");
-		}
-		if (this->wav_file) {
-			wav_file_write(this->wav_file, src, n_samples);
-		} else {
-			spa_zero(this->props.wav_path);
-		}
-	} else if (this->wav_file != NULL) {
-		wav_file_close(this->wav_file);
-		this->wav_file = NULL;
-	}
+	if (SPA_UNLIKELY(this->tap != NULL))
+		tap_write(this->tap, src, n_samples);
 }
 
 static int channelmix_process_apply_sequence(struct impl *this,
@@ -2824,7 +2955,7 @@ static int impl_node_process(void *object)
 	}
 
 	if (this->direction == SPA_DIRECTION_INPUT)
-		handle_wav(this, src_datas, n_samples);
+		handle_tap(this, src_datas, n_samples);
 
 	dir = &this->dir[SPA_DIRECTION_INPUT];
 	if (!in_passthrough) {
@@ -2921,7 +3052,7 @@ static int impl_node_process(void *object)
 		convert_process(&dir->conv, dst_datas, in_datas, n_samples);
 	}
 	if (this->direction == SPA_DIRECTION_OUTPUT)
-		handle_wav(this, (const void**)dst_datas, n_samples);
+		handle_tap(this, (const void**)dst_datas, n_samples);
 
 	spa_log_trace_fp(this->log, "%d/%d  %d/%d %d->%d", this->in_offset, max_in,
 			this->out_offset, max_out, n_samples, n_out);
@@ -3055,8 +3186,8 @@ static int impl_clear(struct spa_handle *handle)
 		convert_free(&this->dir[0].conv);
 	if (this->dir[1].conv.free)
 		convert_free(&this->dir[1].conv);
-	if (this->wav_file != NULL)
-		wav_file_close(this->wav_file);
+	if (this->tap != NULL)
+		tap_destroy(this->tap);
 	free (this->vol_ramp_sequence);
 	return 0;
 }
@@ -3117,6 +3248,8 @@ impl_init(const struct spa_handle_factory *factory,
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	spa_log_topic_init(this->log, log_topic);
 
+	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
+
 	this->cpu = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
 	if (this->cpu) {
 		this->cpu_flags = spa_cpu_get_flags(this->cpu);
@@ -11,6 +11,8 @@
 #include <errno.h>
 #include <time.h>
 
+#include <spa/param/audio/raw.h>
+
 #include "test-helper.h"
 #include "fmt-ops.h"
 
@@ -38,22 +40,19 @@ static uint8_t samp_out[MAX_SAMPLES * MAX_CHANNELS * 4];
 static const int sample_sizes[] = { 0, 1, 128, 513, 4096 };
 static const int channel_counts[] = { 1, 2, 4, 6, 8, 11 };
 
-#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 70
+#define MAX_RESULTS	SPA_N_ELEMENTS(sample_sizes) * SPA_N_ELEMENTS(channel_counts) * 100
 
 static uint32_t n_results = 0;
 static struct stats results[MAX_RESULTS];
 
-static void run_test1(const char *name, const char *impl, bool in_packed, bool out_packed,
-		convert_func_t func, int n_channels, int n_samples)
+static void run_test_conv(const char *name, const char *impl, struct convert *conv,
+		convert_func_t func, int n_samples)
 {
-	int i, j;
+	int i, j, n_channels = conv->n_channels;
 	const void *ip[n_channels];
 	void *op[n_channels];
 	struct timespec ts;
 	uint64_t count, t1, t2;
-	struct convert conv;
-
-	conv.n_channels = n_channels;
 
 	for (j = 0; j < n_channels; j++) {
 		ip[j] = &samp_in[j * n_samples * 4];
@@ -65,7 +64,7 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 
 	count = 0;
 	for (i = 0; i < MAX_COUNT; i++) {
-		func(&conv, op, ip, n_samples);
+		func(conv, op, ip, n_samples);
 		count++;
 	}
 	clock_gettime(CLOCK_MONOTONIC, &ts);
@@ -82,6 +81,15 @@ static void run_test1(const char *name, const char *impl, bool in_packed, bool o
 	};
 }
 
+static void run_test1(const char *name, const char *impl, bool in_packed, bool out_packed,
+		convert_func_t func, int n_channels, int n_samples)
+{
+	struct convert conv;
+
+	conv.n_channels = n_channels;
+	run_test_conv(name, impl, &conv, func, n_samples);
+}
+
 static void run_testc(const char *name, const char *impl, bool in_packed, bool out_packed, convert_func_t func,
 		int channel_count)
 {
@@ -137,6 +145,57 @@ static void test_f32_s16(void)
 	run_test("test_f32d_s16d", "c", false, false, conv_f32d_to_s16d_c);
 }
 
+static void run_test_dither(const char *name, const char *impl, uint32_t dst_fmt,
+		uint32_t method, uint32_t flags)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(sample_sizes, s) {
+		SPA_FOR_EACH_ELEMENT_VAR(channel_counts, c) {
+			struct convert conv;
+
+			spa_zero(conv);
+			conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+			conv.dst_fmt = dst_fmt;
+			conv.method = method;
+			conv.n_channels = *c;
+			conv.rate = 48000;
+			conv.cpu_flags = flags;
+			spa_assert_se(convert_init(&conv) == 0);
+			run_test_conv(name, impl, &conv, conv.process, (*s + (*c -1)) / *c);
+			convert_free(&conv);
+		}
+	}
+}
+
+static void test_f32_s16_dither(void)
+{
+	static const struct {
+		const char *name;
+		uint32_t fmt;
+		uint32_t method;
+	} tests[] = {
+		{ "test_f32d_s16_shaped", SPA_AUDIO_FORMAT_S16, DITHER_METHOD_LIPSHITZ },
+		{ "test_f32d_s16d_shaped", SPA_AUDIO_FORMAT_S16P, DITHER_METHOD_LIPSHITZ },
+		{ "test_f32d_s16s_shaped", SPA_AUDIO_FORMAT_S16_OE, DITHER_METHOD_LIPSHITZ },
+		{ "test_f32d_s16_shaped3", SPA_AUDIO_FORMAT_S16, DITHER_METHOD_WANNAMAKER_3 },
+		{ "test_f32d_s16_tri_hf", SPA_AUDIO_FORMAT_S16, DITHER_METHOD_TRIANGULAR_HF },
+		{ "test_f32d_s16d_tri_hf", SPA_AUDIO_FORMAT_S16P, DITHER_METHOD_TRIANGULAR_HF },
+		{ "test_f32d_s16s_tri_hf", SPA_AUDIO_FORMAT_S16_OE, DITHER_METHOD_TRIANGULAR_HF },
+	};
+
+	SPA_FOR_EACH_ELEMENT_VAR(tests, t) {
+		run_test_dither(t->name, "c", t->fmt, t->method, 0);
+#if defined (HAVE_SSE2)
+		if (cpu_flags & SPA_CPU_FLAG_SSE2)
+			run_test_dither(t->name, "sse2", t->fmt, t->method, SPA_CPU_FLAG_SSE2);
+#endif
+#if defined (HAVE_AVX2)
+		if (cpu_flags & SPA_CPU_FLAG_AVX2)
+			run_test_dither(t->name, "avx2", t->fmt, t->method,
+					SPA_CPU_FLAG_SSE2 | SPA_CPU_FLAG_AVX2);
+#endif
+	}
+}
+
 static void test_s16_f32(void)
 {
 	run_test("test_s16_f32", "c", true, true, conv_s16_to_f32_c);
@@ -282,6 +341,7 @@ int main(int argc, char *argv[])
 	test_f32_u8();
 	test_u8_f32();
 	test_f32_s16();
+	test_f32_s16_dither();
 	test_s16_f32();
 	test_f32_s32();
 	test_s32_f32();
@@ -1021,3 +1021,255 @@ conv_f32d_to_s16_2_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const v
 		d += 2;
 	}
 }
+
+/* 32 bit xorshift PRNG, see https://en.wikipedia.org/wiki/Xorshift */
+#define _MM256_XORSHIFT_EPI32(r)			\
+({							\
+	__m256i i, t;					\
+	i = _mm256_load_si256((__m256i*)r);		\
+	t = _mm256_slli_epi32(i, 13);			\
+	i = _mm256_xor_si256(i, t);			\
+	t = _mm256_srli_epi32(i, 17);			\
+	i = _mm256_xor_si256(i, t);			\
+	t = _mm256_slli_epi32(i, 5);			\
+	i = _mm256_xor_si256(i, t);			\
+	_mm256_store_si256((__m256i*)r, i);		\
+	i;						\
+})
+
+void conv_noise_rect_avx2(struct convert *conv, float *noise, uint32_t n_samples)
+{
+	uint32_t n;
+	const uint32_t *r = conv->random;
+	__m256 scale = _mm256_set1_ps(conv->scale);
+	__m256i in[1];
+	__m256 out[1];
+
+	for (n = 0; n < n_samples; n += 8) {
+		in[0] = _MM256_XORSHIFT_EPI32(r);
+		out[0] = _mm256_cvtepi32_ps(in[0]);
+		out[0] = _mm256_mul_ps(out[0], scale);
+		_mm256_store_ps(&noise[n], out[0]);
+	}
+}
+
+void conv_noise_tri_avx2(struct convert *conv, float *noise, uint32_t n_samples)
+{
+	uint32_t n;
+	const uint32_t *r = conv->random;
+	__m256 scale = _mm256_set1_ps(conv->scale);
+	__m256i in[1];
+	__m256 out[1];
+
+	for (n = 0; n < n_samples; n += 8) {
+		in[0] = _mm256_sub_epi32(_MM256_XORSHIFT_EPI32(r), _MM256_XORSHIFT_EPI32(r));
+		out[0] = _mm256_cvtepi32_ps(in[0]);
+		out[0] = _mm256_mul_ps(out[0], scale);
+		_mm256_store_ps(&noise[n], out[0]);
+	}
+}
+
+void conv_noise_tri_hf_avx2(struct convert *conv, float *noise, uint32_t n_samples)
+{
+	uint32_t n;
+	int32_t *p = conv->prev;
+	const uint32_t *r = conv->random;
+	__m256 scale = _mm256_set1_ps(conv->scale);
+	__m256i in[1], old[1], new[1];
+	__m256 out[1];
+
+	old[0] = _mm256_load_si256((__m256i*)p);
+	for (n = 0; n < n_samples; n += 8) {
+		new[0] = _MM256_XORSHIFT_EPI32(r);
+		in[0] = _mm256_sub_epi32(old[0], new[0]);
+		old[0] = new[0];
+		out[0] = _mm256_cvtepi32_ps(in[0]);
+		out[0] = _mm256_mul_ps(out[0], scale);
+		_mm256_store_ps(&noise[n], out[0]);
+	}
+	_mm256_store_si256((__m256i*)p, old[0]);
+}
+
+/* Noise shaped dither, 8 channels at a time with one channel in each lane.
+ * See the SSE2 version. */
+#define SHAPED_PLANAR		0
+#define SHAPED_INTERLEAVED	1
+#define SHAPED_INTERLEAVED_SWAP	2
+
+#define _MM_BSWAP_EPI16(x)				\
+	_mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8))
+
+#define _MM256_SHAPE_PS(in,noise,out)					\
+({									\
+	__m256 v, x;							\
+	v = _mm256_mul_ps(in, int_scale);				\
+	for (n = 0; n < n_ns; n++)					\
+		v = _mm256_add_ps(v, _mm256_mul_ps(h[n], f[n]));	\
+	x = _MM256_CLAMP_PS(_mm256_add_ps(v, noise), int_min, int_max);	\
+	out = _mm256_cvtps_epi32(x);					\
+	for (n = n_ns - 1; n > 0; n--)					\
+		h[n] = h[n-1];						\
+	h[0] = _mm256_sub_ps(v, _mm256_cvtepi32_ps(out));		\
+})
+
+#define _MM256_PACKS_EPI32(x)						\
+	_mm_packs_epi32(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1))
+
+static inline void
+conv_f32d_to_s16_shaped_8s_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t c, uint32_t n_lanes, uint32_t n_samples, const uint32_t n_ns, const int mode)
+{
+	const float *s[8], *noise = conv->noise;
+	struct shaper *sh[8], dummy;
+	uint32_t l, n, j, k, chunk, n_channels = conv->n_channels;
+	uint16_t *d = dst[0];
+	float e[8];
+	__m128 lo[4], hi[4];
+	__m256 in[4], h[NS_MAX], f[NS_MAX];
+	__m256i out[4];
+	__m128i p[4], q[4];
+	__m256 int_scale = _mm256_set1_ps(S16_SCALE);
+	__m256 int_max = _mm256_set1_ps(S16_MAX);
+	__m256 int_min = _mm256_set1_ps(S16_MIN);
+
+	/* unused lanes run on a copy of the first channel */
+	spa_zero(dummy);
+	for (l = 0; l < 8; l++) {
+		s[l] = src[c + (l < n_lanes ? l : 0)];
+		sh[l] = l < n_lanes ? &conv->shaper[c + l] : &dummy;
+	}
+	for (n = 0; n < n_ns; n++) {
+		for (l = 0; l < 8; l++)
+			e[l] = sh[l]->e[sh[l]->idx + n];
+		h[n] = _mm256_loadu_ps(e);
+		f[n] = _mm256_set1_ps(conv->ns[n]);
+	}
+
+	for (j = 0; j < n_samples;) {
+		chunk = SPA_MIN(n_samples - j, conv->noise_size);
+		for (k = 0; k + 4 <= chunk; k += 4, j += 4) {
+			for (l = 0; l < 4; l++) {
+				lo[l] = _mm_loadu_ps(&s[l][j]);
+				hi[l] = _mm_loadu_ps(&s[l+4][j]);
+			}
+			_MM_TRANSPOSE4_PS(lo[0], lo[1], lo[2], lo[3]);
+			_MM_TRANSPOSE4_PS(hi[0], hi[1], hi[2], hi[3]);
+			for (l = 0; l < 4; l++)
+				in[l] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[l]), hi[l], 1);
+
+			_MM256_SHAPE_PS(in[0], _mm256_set1_ps(noise[k+0]), out[0]);
+			_MM256_SHAPE_PS(in[1], _mm256_set1_ps(noise[k+1]), out[1]);
+			_MM256_SHAPE_PS(in[2], _mm256_set1_ps(noise[k+2]), out[2]);
+			_MM256_SHAPE_PS(in[3], _mm256_set1_ps(noise[k+3]), out[3]);
+
+			/* sample j+l of the 8 channels */
+			for (l = 0; l < 4; l++) {
+				p[l] = _MM256_PACKS_EPI32(out[l]);
+				if (mode == SHAPED_INTERLEAVED_SWAP)
+					p[l] = _MM_BSWAP_EPI16(p[l]);
+			}
+			if (mode == SHAPED_PLANAR) {
+				/* 4 samples of channel c+2l and c+2l+1 */
+				q[0] = _mm_unpacklo_epi16(p[0], p[1]);
+				q[1] = _mm_unpackhi_epi16(p[0], p[1]);
+				q[2] = _mm_unpacklo_epi16(p[2], p[3]);
+				q[3] = _mm_unpackhi_epi16(p[2], p[3]);
+				p[0] = _mm_unpacklo_epi32(q[0], q[2]);
+				p[1] = _mm_unpackhi_epi32(q[0], q[2]);
+				p[2] = _mm_unpacklo_epi32(q[1], q[3]);
+				p[3] = _mm_unpackhi_epi32(q[1], q[3]);
+				for (l = 0; l < n_lanes; l++)
+					_mm_storel_epi64((__m128i*)((int16_t*)dst[c+l] + j),
+							l & 1 ? _mm_unpackhi_epi64(p[l>>1], p[l>>1]) : p[l>>1]);
+			} else if (n_lanes == 8) {
+				for (l = 0; l < 4; l++)
+					_mm_storeu_si128((__m128i*)&d[(j+l)*n_channels + c], p[l]);
+			} else {
+				uint16_t t[8];
+				for (l = 0; l < 4; l++) {
+					_mm_storeu_si128((__m128i*)t, p[l]);
+					memcpy(&d[(j+l)*n_channels + c], t, n_lanes * sizeof(uint16_t));
+				}
+			}
+		}
+		for (; k < chunk; k++, j++) {
+			in[0] = _mm256_setr_ps(s[0][j], s[1][j], s[2][j], s[3][j],
+					s[4][j], s[5][j], s[6][j], s[7][j]);
+			_MM256_SHAPE_PS(in[0], _mm256_set1_ps(noise[k]), out[0]);
+
+			p[0] = _MM256_PACKS_EPI32(out[0]);
+			if (mode == SHAPED_INTERLEAVED_SWAP)
+				p[0] = _MM_BSWAP_EPI16(p[0]);
+			if (mode == SHAPED_PLANAR) {
+				uint16_t t[8];
+				_mm_storeu_si128((__m128i*)t, p[0]);
+				for (l = 0; l < n_lanes; l++)
+					((uint16_t*)dst[c+l])[j] = t[l];
+			} else if (n_lanes == 8) {
+				_mm_storeu_si128((__m128i*)&d[j*n_channels + c], p[0]);
+			} else {
+				uint16_t t[8];
+				_mm_storeu_si128((__m128i*)t, p[0]);
+				memcpy(&d[j*n_channels + c], t, n_lanes * sizeof(uint16_t));
+			}
+		}
+	}
+
+	/* store the history in the layout of the C version, newest first */
+	for (l = 0; l < n_lanes; l++) {
+		spa_zero(sh[l]->e);
+		sh[l]->idx = 0;
+	}
+	for (n = 0; n < n_ns; n++) {
+		_mm256_storeu_ps(e, h[n]);
+		for (l = 0; l < n_lanes; l++)
+			sh[l]->e[n] = sh[l]->e[n + NS_MAX] = e[l];
+	}
+}
+
+static inline void
+conv_f32d_to_s16_shaped_mode_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples, const int mode)
+{
+	uint32_t i, n_channels = conv->n_channels;
+
+	convert_update_noise(conv, conv->noise, SPA_MIN(n_samples, conv->noise_size));
+
+	/* make the filter length a constant for the common filters */
+	for (i = 0; i < n_channels; i += 8) {
+		uint32_t n_lanes = SPA_MIN(n_channels - i, 8u);
+		switch (conv->n_ns) {
+		case 3:
+			conv_f32d_to_s16_shaped_8s_avx2(conv, dst, src, i, n_lanes, n_samples, 3, mode);
+			break;
+		case 5:
+			conv_f32d_to_s16_shaped_8s_avx2(conv, dst, src, i, n_lanes, n_samples, 5, mode);
+			break;
+		default:
+			conv_f32d_to_s16_shaped_8s_avx2(conv, dst, src, i, n_lanes, n_samples,
+					SPA_MIN(conv->n_ns, (uint32_t)NS_MAX), mode);
+			break;
+		}
+	}
+}
+
+void
+conv_f32d_to_s16d_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_avx2(conv, dst, src, n_samples, SHAPED_PLANAR);
+}
+
+void
+conv_f32d_to_s16_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_avx2(conv, dst, src, n_samples, SHAPED_INTERLEAVED);
+}
+
+void
+conv_f32d_to_s16s_shaped_avx2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_avx2(conv, dst, src, n_samples, SHAPED_INTERLEAVED_SWAP);
+}
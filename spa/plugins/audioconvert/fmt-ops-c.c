@@ -318,80 +318,6 @@ MAKE_D_noise(s24_32, int32_t, F32_TO_S24_32_D);
 MAKE_I_noise(s24_32, int32_t, F32_TO_S24_32_D);
 MAKE_I_noise(s24_32s, int32_t, F32_TO_S24_32S_D);
 
-#define SHAPER(type,s,scale,offs,sh,min,max,d)			\
-({								\
-	type t;							\
-	float v = s * scale + offs;				\
-	for (n = 0; n < n_ns; n++)				\
-		v += sh->e[idx + n] * ns[n];			\
-	t = FTOI(type, v, 1.0f, 0.0f, d, min, max);		\
-	idx = (idx - 1) & NS_MASK;				\
-	sh->e[idx] = sh->e[idx + NS_MAX] = v - t;		\
-	t;							\
-})
-
-#define F32_TO_U8_SH(s,sh,d)	SHAPER(uint8_t, s, U8_SCALE, U8_OFFS, sh, U8_MIN, U8_MAX, d)
-#define F32_TO_S8_SH(s,sh,d)	SHAPER(int8_t, s, S8_SCALE, 0, sh, S8_MIN, S8_MAX, d)
-#define F32_TO_S16_SH(s,sh,d)	SHAPER(int16_t, s, S16_SCALE, 0, sh, S16_MIN, S16_MAX, d)
-#define F32_TO_S16S_SH(s,sh,d)	bswap_16(F32_TO_S16_SH(s,sh,d))
-
-#define MAKE_D_shaped(dname,dtype,func)						\
-void conv_f32d_to_ ##dname## d_shaped_c(struct convert *conv,			\
-		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],	\
-                uint32_t n_samples)						\
-{										\
-	uint32_t i, j, k, chunk, n_channels = conv->n_channels, noise_size = conv->noise_size;	\
-	float *noise = conv->noise;						\
-	const float *ns = conv->ns;						\
-	uint32_t n, n_ns = conv->n_ns;						\
-	convert_update_noise(conv, noise, SPA_MIN(n_samples, noise_size));	\
-	for (i = 0; i < n_channels; i++) {					\
-		const float *s = src[i];					\
-		dtype *d = dst[i];						\
-		struct shaper *sh = &conv->shaper[i];				\
-		uint32_t idx = sh->idx;						\
-		for (j = 0; j < n_samples;) {					\
-			chunk = SPA_MIN(n_samples - j, noise_size);		\
-			for (k = 0; k < chunk; k++, j++)			\
-				d[j] = func (s[j], sh, noise[k]);		\
-		}								\
-		sh->idx = idx;							\
-	}									\
-}
-
-#define MAKE_I_shaped(dname,dtype,func)						\
-void conv_f32d_to_ ##dname## _shaped_c(struct convert *conv,			\
-		void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],	\
-                uint32_t n_samples)						\
-{										\
-	dtype *d0 = dst[0];							\
-	uint32_t i, j, k, chunk, n_channels = conv->n_channels, noise_size = conv->noise_size;	\
-	float *noise = conv->noise;						\
-	const float *ns = conv->ns;						\
-	uint32_t n, n_ns = conv->n_ns;						\
-	convert_update_noise(conv, noise, SPA_MIN(n_samples, noise_size));	\
-	for (i = 0; i < n_channels; i++) {					\
-		const float *s = src[i];					\
-		dtype *d = &d0[i];						\
-		struct shaper *sh = &conv->shaper[i];				\
-		uint32_t idx = sh->idx;						\
-		for (j = 0; j < n_samples;) {					\
-			chunk = SPA_MIN(n_samples - j, noise_size);		\
-			for (k = 0; k < chunk; k++, j++)			\
-				d[j*n_channels] = func (s[j], sh, noise[k]);	\
-		}								\
-		sh->idx = idx;							\
-	}									\
-}
-
-MAKE_D_shaped(u8, uint8_t, F32_TO_U8_SH);
-MAKE_I_shaped(u8, uint8_t, F32_TO_U8_SH);
-MAKE_D_shaped(s8, int8_t, F32_TO_S8_SH);
-MAKE_I_shaped(s8, int8_t, F32_TO_S8_SH);
-MAKE_D_shaped(s16, int16_t, F32_TO_S16_SH);
-MAKE_I_shaped(s16, int16_t, F32_TO_S16_SH);
-MAKE_I_shaped(s16s, uint16_t, F32_TO_S16S_SH);
-
 #define MAKE_DEINTERLEAVE(size1,size2, type,func)					\
 	MAKE_I_TO_D(size1,type,size2,type,func)
 
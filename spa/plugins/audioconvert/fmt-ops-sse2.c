@@ -12,6 +12,9 @@
 #define _MM_CLAMP_SS(r,min,max)				\
 	_mm_min_ss(_mm_max_ss(r, min), max)
 
+#define _MM_BSWAP_EPI16(x)				\
+	_mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8))
+
 static void
 conv_s16_to_f32d_1s_sse2(void *data, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src,
 		uint32_t n_channels, uint32_t n_samples)
@@ -673,6 +676,60 @@ conv_f32d_to_s32_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst[], con
 	}
 }
 
+static void
+conv_f32_to_s32_1_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		const float *noise, uint32_t n_samples)
+{
+	const float *s = src;
+	int32_t *d = dst;
+	uint32_t n, unrolled;
+	__m128 in[1];
+	__m128i out[1];
+	__m128 scale = _mm_set1_ps(S24_SCALE);
+	__m128 int_min = _mm_set1_ps(S24_MIN);
+	__m128 int_max = _mm_set1_ps(S24_MAX);
+
+	if (SPA_IS_ALIGNED(s, 16))
+		unrolled = n_samples & ~3;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 4) {
+		in[0] = _mm_mul_ps(_mm_load_ps(&s[n]), scale);
+		in[0] = _mm_add_ps(in[0], _mm_load_ps(&noise[n]));
+		in[0] = _MM_CLAMP_PS(in[0], int_min, int_max);
+		out[0] = _mm_cvtps_epi32(in[0]);
+		out[0] = _mm_slli_epi32(out[0], 8);
+		_mm_storeu_si128((__m128i*)(&d[n]), out[0]);
+	}
+	for(; n < n_samples; n++) {
+		in[0] = _mm_load_ss(&s[n]);
+		in[0] = _mm_mul_ss(in[0], scale);
+		in[0] = _mm_add_ss(in[0], _mm_load_ss(&noise[n]));
+		in[0] = _MM_CLAMP_SS(in[0], int_min, int_max);
+		d[n] = S24_32_TO_S32(_mm_cvtss_si32(in[0]));
+	}
+}
+
+void
+conv_f32d_to_s32d_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint32_t i, k, chunk, n_channels = conv->n_channels;
+	float *noise = conv->noise;
+
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));
+
+	for(i = 0; i < n_channels; i++) {
+		const float *s = src[i];
+		int32_t *d = dst[i];
+		for(k = 0; k < n_samples; k += chunk) {
+			chunk = SPA_MIN(n_samples - k, conv->noise_size);
+			conv_f32_to_s32_1_noise_sse2(conv, &d[k], &s[k], noise, chunk);
+		}
+	}
+}
+
 static void
 conv_interleave_32_1s_sse2(void *data, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src[],
 		uint32_t n_channels, uint32_t n_samples)
@@ -1365,6 +1422,264 @@ conv_f32d_to_s16d_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst[], co
 	}
 }
 
+static void
+conv_f32d_to_s16s_1s_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst, const void * SPA_RESTRICT src,
+		const float *noise, uint32_t n_channels, uint32_t n_samples)
+{
+	const float *s0 = src;
+	uint16_t *d = dst;
+	uint32_t n, unrolled;
+	__m128 in[2];
+	__m128i out[2];
+	__m128 int_scale = _mm_set1_ps(S16_SCALE);
+	__m128 int_max = _mm_set1_ps(S16_MAX);
+        __m128 int_min = _mm_set1_ps(S16_MIN);
+
+	if (SPA_IS_ALIGNED(s0, 16))
+		unrolled = n_samples & ~7;
+	else
+		unrolled = 0;
+
+	for(n = 0; n < unrolled; n += 8) {
+		in[0] = _mm_mul_ps(_mm_load_ps(&s0[n]), int_scale);
+		in[1] = _mm_mul_ps(_mm_load_ps(&s0[n+4]), int_scale);
+		in[0] = _mm_add_ps(in[0], _mm_load_ps(&noise[n]));
+		in[1] = _mm_add_ps(in[1], _mm_load_ps(&noise[n+4]));
+		out[0] = _mm_cvtps_epi32(in[0]);
+		out[1] = _mm_cvtps_epi32(in[1]);
+		out[0] = _mm_packs_epi32(out[0], out[1]);
+		out[0] = _MM_BSWAP_EPI16(out[0]);
+
+		d[0*n_channels] = _mm_extract_epi16(out[0], 0);
+		d[1*n_channels] = _mm_extract_epi16(out[0], 1);
+		d[2*n_channels] = _mm_extract_epi16(out[0], 2);
+		d[3*n_channels] = _mm_extract_epi16(out[0], 3);
+		d[4*n_channels] = _mm_extract_epi16(out[0], 4);
+		d[5*n_channels] = _mm_extract_epi16(out[0], 5);
+		d[6*n_channels] = _mm_extract_epi16(out[0], 6);
+		d[7*n_channels] = _mm_extract_epi16(out[0], 7);
+		d += 8*n_channels;
+	}
+	for(; n < n_samples; n++) {
+		in[0] = _mm_mul_ss(_mm_load_ss(&s0[n]), int_scale);
+		in[0] = _mm_add_ss(in[0], _mm_load_ss(&noise[n]));
+		in[0] = _MM_CLAMP_SS(in[0], int_min, int_max);
+		*d = bswap_16((uint16_t)_mm_cvtss_si32(in[0]));
+		d += n_channels;
+	}
+}
+
+void
+conv_f32d_to_s16s_noise_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	uint16_t *d = dst[0];
+	uint32_t i, k, chunk, n_channels = conv->n_channels;
+	float *noise = conv->noise;
+
+	convert_update_noise(conv, noise, SPA_MIN(n_samples, conv->noise_size));
+
+	for(i = 0; i < n_channels; i++) {
+		const float *s = src[i];
+		for(k = 0; k < n_samples; k += chunk) {
+			chunk = SPA_MIN(n_samples - k, conv->noise_size);
+			conv_f32d_to_s16s_1s_noise_sse2(conv, &d[i + k*n_channels],
+					&s[k], noise, n_channels, chunk);
+		}
+	}
+}
+
+/* Noise shaped dither, 4 channels at a time with one channel in each lane.
+ * The error feedback of a channel depends on the previous sample so the
+ * channels are vectorized, not the samples. The filter is evaluated in the
+ * same order as the C version, both are built without fast-math and FMA
+ * contraction so that the output and the state of the shapers are exactly
+ * the same. */
+#define SHAPED_PLANAR		0
+#define SHAPED_INTERLEAVED	1
+#define SHAPED_INTERLEAVED_SWAP	2
+
+#define _MM_SHAPE_PS(in,noise,out)					\
+({									\
+	__m128 v, x;							\
+	v = _mm_mul_ps(in, int_scale);					\
+	for (n = 0; n < n_ns; n++)					\
+		v = _mm_add_ps(v, _mm_mul_ps(h[n], f[n]));		\
+	x = _MM_CLAMP_PS(_mm_add_ps(v, noise), int_min, int_max);	\
+	out = _mm_cvtps_epi32(x);					\
+	for (n = n_ns - 1; n > 0; n--)					\
+		h[n] = h[n-1];						\
+	h[0] = _mm_sub_ps(v, _mm_cvtepi32_ps(out));			\
+})
+
+static inline void
+conv_f32d_to_s16_shaped_4s_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t c, uint32_t n_lanes, uint32_t n_samples, const uint32_t n_ns, const int mode)
+{
+	const float *s[4], *noise = conv->noise;
+	struct shaper *sh[4], dummy;
+	uint32_t l, n, j, k, chunk, n_channels = conv->n_channels;
+	uint16_t *d = dst[0];
+	float e[4];
+	__m128 in[4], nz, h[NS_MAX], f[NS_MAX];
+	__m128i out[4], p[2], q[2];
+	__m128 int_scale = _mm_set1_ps(S16_SCALE);
+	__m128 int_max = _mm_set1_ps(S16_MAX);
+	__m128 int_min = _mm_set1_ps(S16_MIN);
+
+	/* unused lanes run on a copy of the first channel */
+	spa_zero(dummy);
+	for (l = 0; l < 4; l++) {
+		s[l] = src[c + (l < n_lanes ? l : 0)];
+		sh[l] = l < n_lanes ? &conv->shaper[c + l] : &dummy;
+	}
+	for (n = 0; n < n_ns; n++) {
+		h[n] = _mm_setr_ps(sh[0]->e[sh[0]->idx + n], sh[1]->e[sh[1]->idx + n],
+				sh[2]->e[sh[2]->idx + n], sh[3]->e[sh[3]->idx + n]);
+		f[n] = _mm_set1_ps(conv->ns[n]);
+	}
+
+	for (j = 0; j < n_samples;) {
+		chunk = SPA_MIN(n_samples - j, conv->noise_size);
+		for (k = 0; k + 4 <= chunk; k += 4, j += 4) {
+			in[0] = _mm_loadu_ps(&s[0][j]);
+			in[1] = _mm_loadu_ps(&s[1][j]);
+			in[2] = _mm_loadu_ps(&s[2][j]);
+			in[3] = _mm_loadu_ps(&s[3][j]);
+			_MM_TRANSPOSE4_PS(in[0], in[1], in[2], in[3]);
+
+			nz = _mm_loadu_ps(&noise[k]);
+			_MM_SHAPE_PS(in[0], _mm_shuffle_ps(nz, nz, _MM_SHUFFLE(0, 0, 0, 0)), out[0]);
+			_MM_SHAPE_PS(in[1], _mm_shuffle_ps(nz, nz, _MM_SHUFFLE(1, 1, 1, 1)), out[1]);
+			_MM_SHAPE_PS(in[2], _mm_shuffle_ps(nz, nz, _MM_SHUFFLE(2, 2, 2, 2)), out[2]);
+			_MM_SHAPE_PS(in[3], _mm_shuffle_ps(nz, nz, _MM_SHUFFLE(3, 3, 3, 3)), out[3]);
+
+			/* samples j and j+1, j+2 and j+3 */
+			p[0] = _mm_packs_epi32(out[0], out[1]);
+			p[1] = _mm_packs_epi32(out[2], out[3]);
+			if (mode == SHAPED_INTERLEAVED_SWAP) {
+				p[0] = _MM_BSWAP_EPI16(p[0]);
+				p[1] = _MM_BSWAP_EPI16(p[1]);
+			}
+			if (mode == SHAPED_PLANAR) {
+				/* 4 samples of channel c, c+1 and c+2, c+3 */
+				q[0] = _mm_unpacklo_epi16(p[0], _mm_unpackhi_epi64(p[0], p[0]));
+				q[1] = _mm_unpacklo_epi16(p[1], _mm_unpackhi_epi64(p[1], p[1]));
+				p[0] = _mm_unpacklo_epi32(q[0], q[1]);
+				p[1] = _mm_unpackhi_epi32(q[0], q[1]);
+				_mm_storel_epi64((__m128i*)((int16_t*)dst[c] + j), p[0]);
+				if (n_lanes > 1)
+					_mm_storel_epi64((__m128i*)((int16_t*)dst[c+1] + j),
+							_mm_unpackhi_epi64(p[0], p[0]));
+				if (n_lanes > 2)
+					_mm_storel_epi64((__m128i*)((int16_t*)dst[c+2] + j), p[1]);
+				if (n_lanes > 3)
+					_mm_storel_epi64((__m128i*)((int16_t*)dst[c+3] + j),
+							_mm_unpackhi_epi64(p[1], p[1]));
+			} else if (n_lanes == 4) {
+				_mm_storel_epi64((__m128i*)&d[(j+0)*n_channels + c], p[0]);
+				_mm_storel_epi64((__m128i*)&d[(j+1)*n_channels + c],
+						_mm_unpackhi_epi64(p[0], p[0]));
+				_mm_storel_epi64((__m128i*)&d[(j+2)*n_channels + c], p[1]);
+				_mm_storel_epi64((__m128i*)&d[(j+3)*n_channels + c],
+						_mm_unpackhi_epi64(p[1], p[1]));
+			} else {
+				uint16_t t[16];
+				_mm_storeu_si128((__m128i*)&t[0], p[0]);
+				_mm_storeu_si128((__m128i*)&t[8], p[1]);
+				for (l = 0; l < n_lanes; l++) {
+					d[(j+0)*n_channels + c + l] = t[l];
+					d[(j+1)*n_channels + c + l] = t[l+4];
+					d[(j+2)*n_channels + c + l] = t[l+8];
+					d[(j+3)*n_channels + c + l] = t[l+12];
+				}
+			}
+		}
+		for (; k < chunk; k++, j++) {
+			in[0] = _mm_setr_ps(s[0][j], s[1][j], s[2][j], s[3][j]);
+			_MM_SHAPE_PS(in[0], _mm_set1_ps(noise[k]), out[0]);
+
+			p[0] = _mm_packs_epi32(out[0], out[0]);
+			if (mode == SHAPED_INTERLEAVED_SWAP)
+				p[0] = _MM_BSWAP_EPI16(p[0]);
+			if (mode == SHAPED_PLANAR) {
+				((int16_t*)dst[c])[j] = _mm_extract_epi16(p[0], 0);
+				if (n_lanes > 1)
+					((int16_t*)dst[c+1])[j] = _mm_extract_epi16(p[0], 1);
+				if (n_lanes > 2)
+					((int16_t*)dst[c+2])[j] = _mm_extract_epi16(p[0], 2);
+				if (n_lanes > 3)
+					((int16_t*)dst[c+3])[j] = _mm_extract_epi16(p[0], 3);
+			} else if (n_lanes == 4) {
+				_mm_storel_epi64((__m128i*)&d[j*n_channels + c], p[0]);
+			} else {
+				uint16_t t[8];
+				_mm_storeu_si128((__m128i*)t, p[0]);
+				for (l = 0; l < n_lanes; l++)
+					d[j*n_channels + c + l] = t[l];
+			}
+		}
+	}
+
+	/* store the history in the layout of the C version, newest first */
+	for (l = 0; l < n_lanes; l++) {
+		spa_zero(sh[l]->e);
+		sh[l]->idx = 0;
+	}
+	for (n = 0; n < n_ns; n++) {
+		_mm_storeu_ps(e, h[n]);
+		for (l = 0; l < n_lanes; l++)
+			sh[l]->e[n] = sh[l]->e[n + NS_MAX] = e[l];
+	}
+}
+
+static inline void
+conv_f32d_to_s16_shaped_mode_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples, const int mode)
+{
+	uint32_t i, n_channels = conv->n_channels;
+
+	convert_update_noise(conv, conv->noise, SPA_MIN(n_samples, conv->noise_size));
+
+	/* make the filter length a constant for the common filters */
+	for (i = 0; i < n_channels; i += 4) {
+		uint32_t n_lanes = SPA_MIN(n_channels - i, 4u);
+		switch (conv->n_ns) {
+		case 3:
+			conv_f32d_to_s16_shaped_4s_sse2(conv, dst, src, i, n_lanes, n_samples, 3, mode);
+			break;
+		case 5:
+			conv_f32d_to_s16_shaped_4s_sse2(conv, dst, src, i, n_lanes, n_samples, 5, mode);
+			break;
+		default:
+			conv_f32d_to_s16_shaped_4s_sse2(conv, dst, src, i, n_lanes, n_samples,
+					SPA_MIN(conv->n_ns, (uint32_t)NS_MAX), mode);
+			break;
+		}
+	}
+}
+
+void
+conv_f32d_to_s16d_shaped_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_sse2(conv, dst, src, n_samples, SHAPED_PLANAR);
+}
+
+void
+conv_f32d_to_s16_shaped_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_sse2(conv, dst, src, n_samples, SHAPED_INTERLEAVED);
+}
+
+void
+conv_f32d_to_s16s_shaped_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
+		uint32_t n_samples)
+{
+	conv_f32d_to_s16_shaped_mode_sse2(conv, dst, src, n_samples, SHAPED_INTERLEAVED_SWAP);
+}
+
 void
 conv_f32d_to_s16_2_sse2(struct convert *conv, void * SPA_RESTRICT dst[], const void * SPA_RESTRICT src[],
 		uint32_t n_samples)
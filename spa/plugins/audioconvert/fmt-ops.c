@@ -179,6 +179,12 @@ static struct conv_info conv_table[] =
 #endif
 	MAKE(F32, S16, 0, conv_f32_to_s16_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_shaped_sse2, SPA_CPU_FLAG_SSE2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_shaped_c, 0, CONV_SHAPE),
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S16P, 0, conv_f32d_to_s16d_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
@@ -191,6 +197,12 @@ static struct conv_info conv_table[] =
 
 	MAKE(F32, S16P, 0, conv_f32_to_s16d_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16, 0, conv_f32d_to_s16_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(F32P, S16, 0, conv_f32d_to_s16_shaped_sse2, SPA_CPU_FLAG_SSE2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_shaped_c, 0, CONV_SHAPE),
 #if defined (HAVE_SSE2)
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
@@ -210,7 +222,16 @@ static struct conv_info conv_table[] =
 #endif
 	MAKE(F32P, S16, 0, conv_f32d_to_s16_c),
 
+#if defined (HAVE_AVX2)
+	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_shaped_avx2, SPA_CPU_FLAG_AVX2, CONV_SHAPE),
+#endif
+#if defined (HAVE_SSE2)
+	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_shaped_sse2, SPA_CPU_FLAG_SSE2, CONV_SHAPE),
+#endif
 	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_shaped_c, 0, CONV_SHAPE),
+#if defined (HAVE_SSE2)
+	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
+#endif
 	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S16_OE, 0, conv_f32d_to_s16s_c),
 
@@ -218,6 +239,9 @@ static struct conv_info conv_table[] =
 	MAKE(F32P, U32, 0, conv_f32d_to_u32_c),
 
 	MAKE(F32, S32, 0, conv_f32_to_s32_c),
+#if defined (HAVE_SSE2)
+	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_noise_sse2, SPA_CPU_FLAG_SSE2, CONV_NOISE),
+#endif
 	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_noise_c, 0, CONV_NOISE),
 	MAKE(F32P, S32P, 0, conv_f32d_to_s32d_c),
 	MAKE(F32, S32P, 0, conv_f32_to_s32d_c),
@@ -366,6 +390,11 @@ struct noise_info {
 
 static struct noise_info noise_table[] =
 {
+#if defined (HAVE_AVX2)
+	MAKE(RECTANGULAR, conv_noise_rect_avx2, SPA_CPU_FLAG_AVX2),
+	MAKE(TRIANGULAR, conv_noise_tri_avx2, SPA_CPU_FLAG_AVX2),
+	MAKE(TRIANGULAR_HF, conv_noise_tri_hf_avx2, SPA_CPU_FLAG_AVX2),
+#endif
 #if defined (HAVE_SSE2)
 	MAKE(RECTANGULAR, conv_noise_rect_sse2, SPA_CPU_FLAG_SSE2),
 	MAKE(TRIANGULAR, conv_noise_tri_sse2, SPA_CPU_FLAG_SSE2),
@@ -284,6 +284,11 @@ DEFINE_NOISE_FUNCTION(rect, sse2);
 DEFINE_NOISE_FUNCTION(tri, sse2);
 DEFINE_NOISE_FUNCTION(tri_hf, sse2);
 #endif
+#if defined(HAVE_AVX2)
+DEFINE_NOISE_FUNCTION(rect, avx2);
+DEFINE_NOISE_FUNCTION(tri, avx2);
+DEFINE_NOISE_FUNCTION(tri_hf, avx2);
+#endif
 
 #undef DEFINE_NOISE_FUNCTION
 
@@ -437,12 +442,17 @@ DEFINE_FUNCTION(s24_to_f32d, sse2);
 DEFINE_FUNCTION(s32_to_f32d, sse2);
 DEFINE_FUNCTION(f32d_to_s32, sse2);
 DEFINE_FUNCTION(f32d_to_s32_noise, sse2);
+DEFINE_FUNCTION(f32d_to_s32d_noise, sse2);
 DEFINE_FUNCTION(f32_to_s16, sse2);
 DEFINE_FUNCTION(f32d_to_s16_2, sse2);
 DEFINE_FUNCTION(f32d_to_s16, sse2);
 DEFINE_FUNCTION(f32d_to_s16_noise, sse2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, sse2);
 DEFINE_FUNCTION(f32d_to_s16d, sse2);
 DEFINE_FUNCTION(f32d_to_s16d_noise, sse2);
+DEFINE_FUNCTION(f32d_to_s16d_shaped, sse2);
+DEFINE_FUNCTION(f32d_to_s16s_noise, sse2);
+DEFINE_FUNCTION(f32d_to_s16s_shaped, sse2);
 DEFINE_FUNCTION(32_to_32d, sse2);
 DEFINE_FUNCTION(32s_to_32d, sse2);
 DEFINE_FUNCTION(32d_to_32, sse2);
@@ -463,6 +473,9 @@ DEFINE_FUNCTION(f32d_to_s32, avx2);
 DEFINE_FUNCTION(f32d_to_s16_4, avx2);
 DEFINE_FUNCTION(f32d_to_s16_2, avx2);
 DEFINE_FUNCTION(f32d_to_s16, avx2);
+DEFINE_FUNCTION(f32d_to_s16_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16d_shaped, avx2);
+DEFINE_FUNCTION(f32d_to_s16s_shaped, avx2);
 #endif
 
 #undef DEFINE_FUNCTION
@@ -3,47 +3,107 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <string.h>
+#include <strings.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
 #include <getopt.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <endian.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <spa/support/log-impl.h>
 #include <spa/debug/mem.h>
+#include <spa/utils/list.h>
 #include <spa/utils/string.h>
 #include <spa/utils/result.h>
+#include <spa/param/audio/raw.h>
 
 #include <sndfile.h>
 
 SPA_LOG_IMPL(logger);
 
 #include "resample.h"
+#include "fmt-ops.h"
 
 #define DEFAULT_QUALITY	RESAMPLE_DEFAULT_QUALITY
 
 #define MAX_SAMPLES	4096u
+#define MAX_CHANNELS	SPA_AUDIO_MAX_CHANNELS
+#define MAX_RATES	16u
 
 struct data {
 	bool verbose;
-	int rate;
+	bool no_mmap;
+	uint32_t rates[MAX_RATES];
+	uint32_t n_rates;
 	int format;
 	int quality;
 	int cpu_flags;
-
-	const char *iname;
-	SF_INFO iinfo;
-	SNDFILE *ifile;
+	uint32_t dither;
+	uint32_t n_threads;
 
 	const char *oname;
-	SF_INFO oinfo;
-	SNDFILE *ofile;
+	const char *odir;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct spa_list tasks;
+	uint32_t pending;
+	uint32_t n_inputs;
+
+	uint32_t n_done;
+	uint32_t n_failed;
+	uint32_t n_mapped;
+	double in_seconds;
+	double out_seconds;
+};
+
+/* An input file, decoded to planar float once and shared by the
+ * jobs that render it at the different output rates. */
+struct input {
+	char *iname;
+	char *rel;
+
+	uint32_t channels;
+	uint32_t rate;
+	int format;
+	uint64_t n_frames;
+	float *planes[MAX_CHANNELS];
+
+	int refcount;
+};
+
+/* One output file. The channels are resampled in groups that can run
+ * on different threads, the last group to finish writes the file. */
+struct job {
+	struct input *in;
+	char *oname;
+	uint32_t rate;
+
+	float *planes[MAX_CHANNELS];
+	uint64_t n_frames[MAX_CHANNELS];
+
+	int remaining;
+	int res;
+};
+
+struct task {
+	struct spa_list link;
+	struct input *in;
+	struct job *job;
+	uint32_t first;
+	uint32_t n_channels;
 };
 
-#define STR_FMTS "(s8|s16|s32|f32|f64)"
+#define STR_FMTS "(s8|s16|s24|s32|f32|f64)"
 
-#define OPTIONS		"hvr:f:q:c:"
+#define OPTIONS		"hvr:f:q:c:o:j:d:M"
 static const struct option long_options[] = {
 	{ "help",	no_argument,		NULL, 'h'},
 	{ "verbose",	no_argument,		NULL, 'v'},
@@ -52,6 +112,10 @@ static const struct option long_options[] = {
 	{ "format",	required_argument,	NULL, 'f' },
 	{ "quality",	required_argument,	NULL, 'q' },
 	{ "cpuflags",	required_argument,	NULL, 'c' },
+	{ "output",	required_argument,	NULL, 'o' },
+	{ "jobs",	required_argument,	NULL, 'j' },
+	{ "dither",	required_argument,	NULL, 'd' },
+	{ "no-mmap",	no_argument,		NULL, 'M' },
 
         { NULL, 0, NULL, 0 }
 };
@@ -63,15 +127,24 @@ static void show_usage(const char *name, bool is_error)
 	fp = is_error ? stderr : stdout;
 
 	fprintf(fp, "%s [options] <infile> <outfile>\n", name);
+	fprintf(fp, "%s [options] -o <outdir> <infile|indir>...\n", name);
 	fprintf(fp,
 		"  -h, --help                            Show this help\n"
 		"  -v  --verbose                         Be verbose\n"
 		"\n");
 	fprintf(fp,
-		"  -r  --rate                            Output sample rate (default as input)\n"
+		"  -r  --rate                            Output sample rate, a comma separated\n"
+		"                                        list renders each rate into a <rate>\n"
+		"                                        subdirectory of outdir (default as input)\n"
 		"  -f  --format                          Output sample format %s (default as input)\n"
 		"  -q  --quality                         Resampler quality (default %u)\n"
 		"  -c  --cpuflags                        CPU flags (default 0)\n"
+		"  -d  --dither                          Dither method for s8 and s16 output\n"
+		"                                        (none|rectangular|triangular|triangular-hf|\n"
+		"                                        wannamaker3|shaped5) (default none)\n"
+		"  -o  --output                          Output directory for batch conversion\n"
+		"  -j  --jobs                            Number of threads (default number of CPUs)\n"
+		"  -M  --no-mmap                         Read WAV input with libsndfile\n"
 		"\n",
 		STR_FMTS, DEFAULT_QUALITY);
 }
@@ -117,148 +190,707 @@ sf_str_to_fmt(const char *str)
 	return -1;
 }
 
-static int open_files(struct data *d)
+static uint64_t get_time_ns(clockid_t clock)
 {
-	d->ifile = sf_open(d->iname, SFM_READ, &d->iinfo);
-        if (d->ifile == NULL) {
-		fprintf(stderr, "error: failed to open input file \"%s\": %s\n",
-				d->iname, sf_strerror(NULL));
-		return -EIO;
-	}
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
 
-	d->oinfo.channels = d->iinfo.channels;
-	d->oinfo.samplerate = d->rate > 0 ? d->rate : d->iinfo.samplerate;
-	d->oinfo.format = d->format > 0 ? d->format : d->iinfo.format;
-	d->oinfo.format |= SF_FORMAT_WAV;
+static int alloc_planes(float **planes, uint32_t n_channels, uint64_t n_frames)
+{
+	uint32_t i;
 
-	d->ofile = sf_open(d->oname, SFM_WRITE, &d->oinfo);
-        if (d->ofile == NULL) {
-		fprintf(stderr, "error: failed to open output file \"%s\": %s\n",
-				d->oname, sf_strerror(NULL));
-		return -EIO;
-	}
-	if (d->verbose) {
-		fprintf(stdout, "input '%s': channels:%d rate:%d format:%s\n",
-				d->iname, d->iinfo.channels, d->iinfo.samplerate,
-				sf_fmt_to_str(d->iinfo.format));
-		fprintf(stdout, "output '%s': channels:%d rate:%d format:%s\n",
-				d->oname, d->oinfo.channels, d->oinfo.samplerate,
-				sf_fmt_to_str(d->oinfo.format));
+	for (i = 0; i < n_channels; i++) {
+		free(planes[i]);
+		if ((planes[i] = malloc(SPA_MAX(n_frames, 1u) * sizeof(float))) == NULL)
+			return -errno;
 	}
 	return 0;
 }
 
-static int close_files(struct data *d)
+static void free_planes(float **planes, uint32_t n_channels)
+{
+	uint32_t i;
+	for (i = 0; i < n_channels; i++) {
+		free(planes[i]);
+		planes[i] = NULL;
+	}
+}
+
+static int deinterleave(struct input *in, uint32_t fmt, const void *data,
+		uint32_t stride, int cpu_flags)
 {
-	if (d->ifile)
-		sf_close(d->ifile);
-	if (d->ofile)
-		sf_close(d->ofile);
+	struct convert conv;
+	const void *src[1];
+	void *dst[MAX_CHANNELS];
+	uint64_t pos;
+	uint32_t i, n;
+	int res;
+
+	spa_zero(conv);
+	conv.src_fmt = fmt;
+	conv.dst_fmt = SPA_AUDIO_FORMAT_F32P;
+	conv.n_channels = in->channels;
+	conv.rate = in->rate;
+	conv.cpu_flags = cpu_flags;
+	if ((res = convert_init(&conv)) < 0)
+		return res;
+
+	for (pos = 0; pos < in->n_frames; pos += n) {
+		n = SPA_MIN(in->n_frames - pos, MAX_SAMPLES);
+		src[0] = SPA_PTROFF(data, pos * stride, void);
+		for (i = 0; i < in->channels; i++)
+			dst[i] = &in->planes[i][pos];
+		convert_process(&conv, dst, src, n);
+	}
+	convert_free(&conv);
 	return 0;
 }
 
-static int do_conversion(struct data *d)
+/* WAV files are mapped and converted straight from the page cache,
+ * other files and formats go through libsndfile. */
+static int load_wav_mmap(struct input *in, int cpu_flags)
 {
-	struct resample r;
-	int channels = d->iinfo.channels;
-	float in[MAX_SAMPLES * channels];
-	float out[MAX_SAMPLES * channels];
-	float ibuf[MAX_SAMPLES * channels];
-	float obuf[MAX_SAMPLES * channels];
-	uint32_t in_len, out_len, queued;
-	uint32_t pin_len, pout_len;
-	size_t read, written;
-	const void *src[channels];
-	void *dst[channels];
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	const uint8_t *p, *fmt = NULL, *data = NULL;
+	uint32_t fmt_size = 0, tag, bits, block_align, sfmt, fmt_id;
+	uint64_t data_size = 0, pos;
+	struct stat st;
+	void *map;
+	int fd, res;
+
+	if ((fd = open(in->iname, O_RDONLY | O_CLOEXEC)) < 0)
+		return -errno;
+	if (fstat(fd, &st) < 0 || st.st_size < 44) {
+		close(fd);
+		return -ENOTSUP;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	res = -ENOTSUP;
+	p = map;
+	if (memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0)
+		goto done;
+
+	for (pos = 12; pos + 8 <= (uint64_t)st.st_size; ) {
+		uint32_t size = p[pos+4] | p[pos+5] << 8 | p[pos+6] << 16 | (uint32_t)p[pos+7] << 24;
+
+		if (memcmp(p + pos, "fmt ", 4) == 0 && size >= 16) {
+			fmt = p + pos + 8;
+			fmt_size = size;
+		} else if (memcmp(p + pos, "data", 4) == 0) {
+			data = p + pos + 8;
+			data_size = SPA_MIN(size, st.st_size - pos - 8);
+			break;
+		}
+		pos += 8 + (uint64_t)size + (size & 1);
+	}
+	if (fmt == NULL || data == NULL)
+		goto done;
+
+	tag = fmt[0] | fmt[1] << 8;
+	in->channels = fmt[2] | fmt[3] << 8;
+	in->rate = fmt[4] | fmt[5] << 8 | fmt[6] << 16 | (uint32_t)fmt[7] << 24;
+	block_align = fmt[12] | fmt[13] << 8;
+	bits = fmt[14] | fmt[15] << 8;
+	if (tag == 0xfffe && fmt_size >= 40)
+		tag = fmt[24] | fmt[25] << 8;
+
+	if (tag == 1 && bits == 16) {
+		fmt_id = SPA_AUDIO_FORMAT_S16;
+		sfmt = SF_FORMAT_PCM_16;
+	} else if (tag == 1 && bits == 24) {
+		fmt_id = SPA_AUDIO_FORMAT_S24;
+		sfmt = SF_FORMAT_PCM_24;
+	} else if (tag == 1 && bits == 32) {
+		fmt_id = SPA_AUDIO_FORMAT_S32;
+		sfmt = SF_FORMAT_PCM_32;
+	} else if (tag == 3 && bits == 32) {
+		fmt_id = SPA_AUDIO_FORMAT_F32;
+		sfmt = SF_FORMAT_FLOAT;
+	} else {
+		goto done;
+	}
+	if (in->channels == 0 || in->channels > MAX_CHANNELS || in->rate == 0 ||
+	    block_align != in->channels * bits / 8)
+		goto done;
+
+	in->format = SF_FORMAT_WAV | sfmt;
+	in->n_frames = data_size / block_align;
+
+	if ((res = alloc_planes(in->planes, in->channels, in->n_frames)) < 0 ||
+	    (res = deinterleave(in, fmt_id, data, block_align, cpu_flags)) < 0)
+		free_planes(in->planes, in->channels);
+done:
+	munmap(map, st.st_size);
+	return res;
+#else
+	return -ENOTSUP;
+#endif
+}
+
+static int load_sndfile(struct input *in, int cpu_flags)
+{
+	SF_INFO info;
+	SNDFILE *file;
+	float *buf = NULL;
+	struct input block;
+	sf_count_t n, pos;
 	uint32_t i;
-	int res, j, k;
-	uint32_t flushing = UINT32_MAX;
+	int res;
+
+	spa_zero(info);
+	file = sf_open(in->iname, SFM_READ, &info);
+	if (file == NULL) {
+		fprintf(stderr, "error: failed to open input file \"%s\": %s\n",
+				in->iname, sf_strerror(NULL));
+		return -EIO;
+	}
+	if (info.channels <= 0 || info.channels > (int)MAX_CHANNELS) {
+		fprintf(stderr, "error: \"%s\": unsupported channels %d\n",
+				in->iname, info.channels);
+		res = -ENOTSUP;
+		goto exit;
+	}
+	in->channels = info.channels;
+	in->rate = info.samplerate;
+	in->format = info.format;
+	in->n_frames = info.frames;
+
+	if ((res = alloc_planes(in->planes, in->channels, in->n_frames)) < 0)
+		goto exit;
+	if ((buf = malloc(MAX_SAMPLES * in->channels * sizeof(float))) == NULL) {
+		res = -errno;
+		goto exit;
+	}
+
+	block = *in;
+	for (pos = 0; pos < info.frames; pos += n) {
+		if ((n = sf_readf_float(file, buf, MAX_SAMPLES)) <= 0)
+			break;
+		n = SPA_MIN(n, info.frames - pos);
+		block.n_frames = n;
+		for (i = 0; i < in->channels; i++)
+			block.planes[i] = &in->planes[i][pos];
+		if ((res = deinterleave(&block, SPA_AUDIO_FORMAT_F32, buf,
+						in->channels * sizeof(float), cpu_flags)) < 0)
+			goto exit;
+	}
+	in->n_frames = pos;
+	res = 0;
+exit:
+	if (res < 0)
+		free_planes(in->planes, in->channels);
+	free(buf);
+	sf_close(file);
+	return res;
+}
+
+static int resample_channels(struct data *d, struct job *job,
+		uint32_t first, uint32_t n_channels)
+{
+	struct input *in = job->in;
+	struct resample r;
+	static const float zero[MAX_SAMPLES];
+	const void *src[MAX_CHANNELS];
+	void *dst[MAX_CHANNELS];
+	uint64_t in_pos = 0, out_pos = 0, size;
+	uint32_t i, in_len, out_len, flushing = UINT32_MAX;
+	int res;
 
 	spa_zero(r);
 	r.cpu_flags = d->cpu_flags;
 	r.log = &logger.log;
-	r.channels = channels;
-	r.i_rate = d->iinfo.samplerate;
-	r.o_rate = d->oinfo.samplerate;
+	r.channels = n_channels;
+	r.i_rate = in->rate;
+	r.o_rate = job->rate;
 	r.quality = d->quality < 0 ? DEFAULT_QUALITY : d->quality;
 	if ((res = resample_native_init(&r)) < 0) {
 		fprintf(stderr, "can't init converter: %s\n", spa_strerror(res));
 		return res;
 	}
 
-	for (j = 0; j < channels; j++)
-		src[j] = &in[MAX_SAMPLES * j];
-	for (j = 0; j < channels; j++)
-		dst[j] = &out[MAX_SAMPLES * j];
+	size = (in->n_frames + resample_delay(&r)) * job->rate / in->rate + 2 * MAX_SAMPLES;
+	if ((res = alloc_planes(&job->planes[first], n_channels, size)) < 0)
+		goto exit;
 
-	read = written = queued = 0;
 	while (true) {
-		pout_len = out_len = MAX_SAMPLES;
+		out_len = SPA_MIN(MAX_SAMPLES, size - out_pos);
 		in_len = SPA_MIN(MAX_SAMPLES, resample_in_len(&r, out_len));
-		in_len -= SPA_MIN(queued, in_len);
 
-		if (in_len > 0) {
-			pin_len = in_len = sf_readf_float(d->ifile, &ibuf[queued * channels], in_len);
+		if (in_pos < in->n_frames) {
+			in_len = SPA_MIN(in_len, in->n_frames - in_pos);
+			for (i = 0; i < n_channels; i++)
+				src[i] = &in->planes[first + i][in_pos];
+		} else {
+			if (flushing == UINT32_MAX)
+				flushing = resample_delay(&r);
+			if (flushing == 0)
+				break;
+			in_len = SPA_MIN(in_len, flushing);
+			for (i = 0; i < n_channels; i++)
+				src[i] = zero;
+		}
+		for (i = 0; i < n_channels; i++)
+			dst[i] = &job->planes[first + i][out_pos];
+
+		resample_process(&r, src, &in_len, dst, &out_len);
 
-			read += pin_len;
+		if (in_pos < in->n_frames)
+			in_pos += in_len;
+		else
+			flushing -= SPA_MIN(in_len, flushing);
+		out_pos += out_len;
 
-			if (pin_len == 0) {
-				if (flushing == 0)
-					break;
-				if (flushing == UINT32_MAX)
-					flushing = resample_delay(&r);
+		if (in_len == 0 && out_len == 0)
+			break;
+	}
+	for (i = 0; i < n_channels; i++)
+		job->n_frames[first + i] = out_pos;
+exit:
+	resample_free(&r);
+	return res;
+}
 
-				pin_len = in_len = SPA_MIN(MAX_SAMPLES, flushing);
-				flushing -= in_len;
+static uint32_t sample_bytes(uint32_t fmt)
+{
+	switch (fmt) {
+	case SPA_AUDIO_FORMAT_U8:
+		return 1;
+	case SPA_AUDIO_FORMAT_S16:
+		return 2;
+	case SPA_AUDIO_FORMAT_S24:
+		return 3;
+	default:
+		return 4;
+	}
+}
 
-				for (k = 0, i = 0; i < pin_len; i++) {
-					for (j = 0; j < channels; j++)
-						ibuf[k++] = 0.0;
-				}
-			}
-		}
-		in_len += queued;
-		pin_len = in_len;
+static int make_dirs(char *path)
+{
+	char *p;
 
-		for (k = 0, i = 0; i < pin_len; i++) {
-			for (j = 0; j < channels; j++) {
-				in[MAX_SAMPLES * j + i] = ibuf[k++];
-			}
+	for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+			*p = '/';
+			return -errno;
 		}
-                resample_process(&r, src, &pin_len, dst, &pout_len);
+		*p = '/';
+	}
+	return 0;
+}
 
-		queued = in_len - pin_len;
-		if (queued)
-			memmove(ibuf, &ibuf[pin_len * channels], queued * channels * sizeof(float));
+static int write_job(struct data *d, struct job *job)
+{
+	struct input *in = job->in;
+	float **planes = job->rate == in->rate ? in->planes : job->planes;
+	SF_INFO info;
+	SNDFILE *file;
+	struct convert conv;
+	const void *src[MAX_CHANNELS];
+	void *dst[1];
+	void *buf = NULL;
+	uint64_t n_frames = UINT64_MAX, pos;
+	uint32_t i, n, stride;
+	bool raw = false;
+	int res;
+
+	if (job->rate == in->rate)
+		n_frames = in->n_frames;
+	else
+		for (i = 0; i < in->channels; i++)
+			n_frames = SPA_MIN(n_frames, job->n_frames[i]);
+
+	spa_zero(info);
+	info.channels = in->channels;
+	info.samplerate = job->rate;
+	info.format = d->format > 0 ? d->format : in->format & SF_FORMAT_SUBMASK;
+	info.format |= SF_FORMAT_WAV;
+
+	if (d->odir != NULL)
+		make_dirs(job->oname);
+
+	file = sf_open(job->oname, SFM_WRITE, &info);
+	if (file == NULL) {
+		fprintf(stderr, "error: failed to open output file \"%s\": %s\n",
+				job->oname, sf_strerror(NULL));
+		return -EIO;
+	}
 
-		if (pout_len > 0) {
-			for (k = 0, i = 0; i < pout_len; i++) {
-				for (j = 0; j < channels; j++) {
-					obuf[k++] = out[MAX_SAMPLES * j + i];
-				}
-			}
-			pout_len = sf_writef_float(d->ofile, obuf, pout_len);
+	/* formats that libsndfile stores as-is are written with the
+	 * fmt-ops kernels, everything else is written as float */
+	spa_zero(conv);
+	conv.src_fmt = SPA_AUDIO_FORMAT_F32P;
+	conv.dst_fmt = SPA_AUDIO_FORMAT_F32;
+	if (sf_command(file, SFC_RAW_DATA_NEEDS_ENDSWAP, NULL, 0) == SF_FALSE) {
+		raw = true;
+		switch (info.format & SF_FORMAT_SUBMASK) {
+		case SF_FORMAT_PCM_16:
+			conv.dst_fmt = SPA_AUDIO_FORMAT_S16;
+			break;
+		case SF_FORMAT_PCM_24:
+			conv.dst_fmt = SPA_AUDIO_FORMAT_S24;
+			break;
+		case SF_FORMAT_PCM_32:
+			conv.dst_fmt = SPA_AUDIO_FORMAT_S32;
+			break;
+		case SF_FORMAT_FLOAT:
+			break;
+		case SF_FORMAT_PCM_U8:
+			conv.dst_fmt = SPA_AUDIO_FORMAT_U8;
+			break;
+		default:
+			raw = false;
+			break;
+		}
+	}
+	conv.n_channels = in->channels;
+	conv.rate = job->rate;
+	conv.cpu_flags = d->cpu_flags;
+	conv.method = d->dither;
+	if ((res = convert_init(&conv)) < 0) {
+		fprintf(stderr, "error: can't convert to %s: %s\n",
+				sf_fmt_to_str(info.format), spa_strerror(res));
+		goto exit;
+	}
 
-			written += pout_len;
+	stride = in->channels * sizeof(float);
+	if ((buf = malloc(MAX_SAMPLES * stride)) == NULL) {
+		res = -errno;
+		goto exit_free;
+	}
+	if (raw)
+		stride = in->channels * sample_bytes(conv.dst_fmt);
+
+	for (pos = 0; pos < n_frames; pos += n) {
+		n = SPA_MIN(n_frames - pos, MAX_SAMPLES);
+		for (i = 0; i < in->channels; i++)
+			src[i] = &planes[i][pos];
+		dst[0] = buf;
+		convert_process(&conv, dst, src, n);
+
+		if (raw)
+			res = sf_write_raw(file, buf, n * stride) == n * stride ? 0 : -EIO;
+		else
+			res = sf_writef_float(file, buf, n) == n ? 0 : -EIO;
+		if (res < 0) {
+			fprintf(stderr, "error: failed to write \"%s\": %s\n",
+					job->oname, sf_strerror(file));
+			goto exit_free;
 		}
 	}
 	if (d->verbose)
-		fprintf(stdout, "read %zu samples, wrote %zu samples\n", read, written);
+		fprintf(stdout, "output '%s': channels:%d rate:%d format:%s frames:%"PRIu64" (%s)\n",
+				job->oname, info.channels, info.samplerate,
+				sf_fmt_to_str(info.format), n_frames, conv.func_name);
+
+	pthread_mutex_lock(&d->lock);
+	d->out_seconds += (double)n_frames / job->rate;
+	pthread_mutex_unlock(&d->lock);
+exit_free:
+	convert_free(&conv);
+exit:
+	free(buf);
+	sf_close(file);
+	return res;
+}
+
+static void queue_task(struct data *d, struct input *in, struct job *job,
+		uint32_t first, uint32_t n_channels, bool prepend)
+{
+	struct task *t;
+
+	if ((t = calloc(1, sizeof(*t))) == NULL) {
+		fprintf(stderr, "error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	t->in = in;
+	t->job = job;
+	t->first = first;
+	t->n_channels = n_channels;
+
+	pthread_mutex_lock(&d->lock);
+	if (prepend)
+		spa_list_prepend(&d->tasks, &t->link);
+	else
+		spa_list_append(&d->tasks, &t->link);
+	d->pending++;
+	pthread_cond_signal(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+}
 
+static void input_unref(struct input *in)
+{
+	if (__atomic_sub_fetch(&in->refcount, 1, __ATOMIC_SEQ_CST) > 0)
+		return;
+	free_planes(in->planes, in->channels);
+	free(in->iname);
+	free(in->rel);
+	free(in);
+}
+
+static void job_done(struct data *d, struct job *job)
+{
+	struct input *in = job->in;
+
+	if (job->res >= 0)
+		job->res = write_job(d, job);
+
+	pthread_mutex_lock(&d->lock);
+	if (job->res < 0)
+		d->n_failed++;
+	else
+		d->n_done++;
+	pthread_mutex_unlock(&d->lock);
+
+	free_planes(job->planes, in->channels);
+	free(job->oname);
+	free(job);
+	input_unref(in);
+}
+
+static char *output_name(struct data *d, struct input *in, uint32_t rate)
+{
+	char *name;
+	int res;
+
+	if (d->odir == NULL)
+		return strdup(d->oname);
+	if (d->n_rates > 1)
+		res = asprintf(&name, "%s/%u/%s.wav", d->odir, rate, in->rel);
+	else
+		res = asprintf(&name, "%s/%s.wav", d->odir, in->rel);
+	return res < 0 ? NULL : name;
+}
+
+/* Load the input, then queue a task per output rate and channel group
+ * in front of the queue so that the planes are freed again early. */
+static void load_input(struct data *d, struct input *in)
+{
+	uint32_t i, n_rates, n_groups, group, first;
+	int res = -ENOTSUP;
+
+	if (!d->no_mmap)
+		res = load_wav_mmap(in, d->cpu_flags);
+	if (res >= 0) {
+		pthread_mutex_lock(&d->lock);
+		d->n_mapped++;
+		pthread_mutex_unlock(&d->lock);
+	} else {
+		res = load_sndfile(in, d->cpu_flags);
+	}
+	if (res < 0) {
+		fprintf(stderr, "error: can't load \"%s\": %s\n", in->iname, spa_strerror(res));
+		pthread_mutex_lock(&d->lock);
+		d->n_failed++;
+		pthread_mutex_unlock(&d->lock);
+		input_unref(in);
+		return;
+	}
+	if (d->verbose)
+		fprintf(stdout, "input '%s': channels:%d rate:%d format:%s frames:%"PRIu64"\n",
+				in->iname, in->channels, in->rate,
+				sf_fmt_to_str(in->format), in->n_frames);
+
+	n_rates = SPA_MAX(d->n_rates, 1u);
+
+	/* split the channels when there are fewer files than threads */
+	n_groups = SPA_CLAMP(d->n_threads / SPA_MAX(d->n_inputs * n_rates, 1u),
+			1u, in->channels);
+
+	pthread_mutex_lock(&d->lock);
+	d->in_seconds += (double)in->n_frames * n_rates / in->rate;
+	pthread_mutex_unlock(&d->lock);
+
+	for (i = 0; i < n_rates; i++) {
+		struct job *job;
+
+		if ((job = calloc(1, sizeof(*job))) == NULL)
+			break;
+		job->in = in;
+		job->rate = d->n_rates > 0 ? d->rates[i] : in->rate;
+		if ((job->oname = output_name(d, in, job->rate)) == NULL) {
+			free(job);
+			break;
+		}
+		__atomic_add_fetch(&in->refcount, 1, __ATOMIC_SEQ_CST);
+
+		if (job->rate == in->rate) {
+			job_done(d, job);
+			continue;
+		}
+		job->remaining = n_groups;
+		for (group = 0, first = 0; group < n_groups; group++) {
+			uint32_t n = (in->channels - first) / (n_groups - group);
+			queue_task(d, NULL, job, first, n, true);
+			first += n;
+		}
+	}
+	input_unref(in);
+}
+
+static void run_task(struct data *d, struct task *t)
+{
+	struct job *job = t->job;
+
+	if (t->in != NULL) {
+		load_input(d, t->in);
+		return;
+	}
+	if (resample_channels(d, job, t->first, t->n_channels) < 0)
+		job->res = -EIO;
+	if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_SEQ_CST) == 0)
+		job_done(d, job);
+}
+
+static void *worker(void *data)
+{
+	struct data *d = data;
+	struct task *t;
+
+	pthread_mutex_lock(&d->lock);
+	while (true) {
+		while (spa_list_is_empty(&d->tasks) && d->pending > 0)
+			pthread_cond_wait(&d->cond, &d->lock);
+		if (spa_list_is_empty(&d->tasks))
+			break;
+
+		t = spa_list_first(&d->tasks, struct task, link);
+		spa_list_remove(&t->link);
+		pthread_mutex_unlock(&d->lock);
+
+		run_task(d, t);
+		free(t);
+
+		pthread_mutex_lock(&d->lock);
+		if (--d->pending == 0)
+			pthread_cond_broadcast(&d->cond);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return NULL;
+}
+
+static int add_input(struct data *d, const char *path, const char *rel)
+{
+	struct input *in;
+	char *ext;
+
+	if ((in = calloc(1, sizeof(*in))) == NULL)
+		return -errno;
+	in->refcount = 1;
+	in->iname = strdup(path);
+	in->rel = strdup(rel);
+	if (in->iname == NULL || in->rel == NULL) {
+		input_unref(in);
+		return -ENOMEM;
+	}
+	if ((ext = strrchr(in->rel, '.')) != NULL && strchr(ext, '/') == NULL)
+		*ext = '\0';
+
+	d->n_inputs++;
+	queue_task(d, in, NULL, 0, 0, false);
 	return 0;
 }
 
+static bool is_audio_file(const char *name)
+{
+	static const char * const exts[] = {
+		".wav", ".wave", ".w64", ".rf64", ".flac", ".ogg", ".opus",
+		".aif", ".aiff", ".caf", ".au", ".snd",
+	};
+	const char *ext = strrchr(name, '.');
+
+	if (ext == NULL)
+		return false;
+	SPA_FOR_EACH_ELEMENT_VAR(exts, e)
+		if (strcasecmp(ext, *e) == 0)
+			return true;
+	return false;
+}
+
+static int add_path(struct data *d, const char *path, size_t base)
+{
+	struct stat st;
+	struct dirent *e;
+	DIR *dir;
+	char *child;
+	int res = 0;
+
+	if (stat(path, &st) < 0) {
+		fprintf(stderr, "error: can't access \"%s\": %m\n", path);
+		return -errno;
+	}
+	if (!S_ISDIR(st.st_mode)) {
+		if (base == 0) {
+			const char *name = strrchr(path, '/');
+			return add_input(d, path, name ? name + 1 : path);
+		}
+		if (!is_audio_file(path))
+			return 0;
+		return add_input(d, path, path + base);
+	}
+	if (base == 0)
+		base = strlen(path) + 1;
+
+	if ((dir = opendir(path)) == NULL) {
+		fprintf(stderr, "error: can't open \"%s\": %m\n", path);
+		return -errno;
+	}
+	while ((e = readdir(dir)) != NULL && res >= 0) {
+		if (e->d_name[0] == '.')
+			continue;
+		if (asprintf(&child, "%s/%s", path, e->d_name) < 0) {
+			res = -ENOMEM;
+			break;
+		}
+		res = add_path(d, child, base);
+		free(child);
+	}
+	closedir(dir);
+	return res;
+}
+
+static int parse_rates(struct data *d, const char *str)
+{
+	char *end;
+	long val;
+
+	d->n_rates = 0;
+	while (*str) {
+		val = strtol(str, &end, 10);
+		if (end == str || val <= 0 || val > INT32_MAX || d->n_rates >= MAX_RATES)
+			return -EINVAL;
+		d->rates[d->n_rates++] = val;
+		str = *end == ',' ? end + 1 : end;
+		if (*end != ',' && *end != '\0')
+			return -EINVAL;
+	}
+	return d->n_rates > 0 ? 0 : -EINVAL;
+}
+
 int main(int argc, char *argv[])
 {
 	int c;
 	int longopt_index = 0, ret;
 	struct data data;
+	pthread_t *threads;
+	uint64_t t_start, t_end, c_start, c_end;
+	double wall, cpu;
+	uint32_t i;
 
 	spa_zero(data);
 
 	logger.log.level = SPA_LOG_LEVEL_DEBUG;
 
 	data.quality = -1;
+	data.dither = DITHER_METHOD_NONE;
 	while ((c = getopt_long(argc, argv, OPTIONS, long_options, &longopt_index)) != -1) {
 		switch (c) {
 		case 'h':
@@ -268,12 +900,10 @@ int main(int argc, char *argv[])
 			data.verbose = true;
 			break;
 		case 'r':
-			ret = atoi(optarg);
-			if (ret <= 0) {
+			if (parse_rates(&data, optarg) < 0) {
 				fprintf(stderr, "error: bad rate %s\n", optarg);
                                 goto error_usage;
 			}
-			data.rate = ret;
 			break;
 		case 'f':
 			ret = sf_str_to_fmt(optarg);
@@ -294,26 +924,91 @@ int main(int argc, char *argv[])
 		case 'c':
 			data.cpu_flags = strtol(optarg, NULL, 0);
 			break;
+		case 'd':
+			data.dither = dither_method_from_label(optarg);
+			if (data.dither == DITHER_METHOD_NONE && !spa_streq(optarg, "none")) {
+				fprintf(stderr, "error: bad dither method %s\n", optarg);
+                                goto error_usage;
+			}
+			break;
+		case 'o':
+			data.odir = optarg;
+			break;
+		case 'j':
+			ret = atoi(optarg);
+			if (ret <= 0) {
+				fprintf(stderr, "error: bad jobs %s\n", optarg);
+                                goto error_usage;
+			}
+			data.n_threads = ret;
+			break;
+		case 'M':
+			data.no_mmap = true;
+			break;
                 default:
 			fprintf(stderr, "error: unknown option '%c'\n", c);
 			goto error_usage;
 		}
 	}
-	if (optind + 1 >= argc) {
-                fprintf(stderr, "error: filename arguments missing (%d %d)\n", optind, argc);
-		goto error_usage;
+	if (data.n_threads == 0)
+		data.n_threads = SPA_MAX(sysconf(_SC_NPROCESSORS_ONLN), 1l);
+
+	pthread_mutex_init(&data.lock, NULL);
+	pthread_cond_init(&data.cond, NULL);
+	spa_list_init(&data.tasks);
+
+	if (data.odir == NULL) {
+		if (optind + 2 != argc) {
+			fprintf(stderr, "error: filename arguments missing (%d %d)\n", optind, argc);
+			goto error_usage;
+		}
+		if (data.n_rates > 1) {
+			fprintf(stderr, "error: multiple rates need an output directory\n");
+			goto error_usage;
+		}
+		data.oname = argv[optind + 1];
+		add_input(&data, argv[optind], argv[optind]);
+	} else {
+		if (optind >= argc) {
+			fprintf(stderr, "error: input arguments missing\n");
+			goto error_usage;
+		}
+		for (; optind < argc; optind++)
+			if (add_path(&data, argv[optind], 0) < 0)
+				return EXIT_FAILURE;
 	}
-        data.iname = argv[optind++];
-        data.oname = argv[optind++];
 
-	if (open_files(&data) < 0)
+	if ((threads = calloc(data.n_threads, sizeof(pthread_t))) == NULL)
 		return EXIT_FAILURE;
 
-	do_conversion(&data);
-
-	close_files(&data);
+	t_start = get_time_ns(CLOCK_MONOTONIC);
+	c_start = get_time_ns(CLOCK_PROCESS_CPUTIME_ID);
+
+	for (i = 0; i < data.n_threads; i++)
+		pthread_create(&threads[i], NULL, worker, &data);
+	for (i = 0; i < data.n_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	t_end = get_time_ns(CLOCK_MONOTONIC);
+	c_end = get_time_ns(CLOCK_PROCESS_CPUTIME_ID);
+	free(threads);
+
+	wall = (t_end - t_start) / 1e9;
+	cpu = (c_end - c_start) / 1e9;
+
+	if (data.verbose || data.odir != NULL) {
+		fprintf(stdout, "%u files written, %u failed, %u inputs mapped, %u threads\n",
+				data.n_done, data.n_failed, data.n_mapped, data.n_threads);
+		fprintf(stdout, "%.3fs of input, %.3fs of output in %.3fs (cpu %.3fs)\n",
+				data.in_seconds, data.out_seconds, wall, cpu);
+		if (wall > 0.0 && cpu > 0.0)
+			fprintf(stdout, "realtime factor: %.1fx, %.1fx per core\n",
+					data.in_seconds / wall, data.in_seconds / cpu);
+	}
+	pthread_cond_destroy(&data.cond);
+	pthread_mutex_destroy(&data.lock);
 
-	return 0;
+	return data.n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
 
 error_usage:
         show_usage(argv[0], true);
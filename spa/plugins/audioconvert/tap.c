@@ -0,0 +1,334 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <spa/utils/result.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/utils/string.h>
+
+#include "tap.h"
+#include "wavfile.h"
+
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.audioconvert.tap");
+
+#define BLOCK_FRAMES	4096
+/* a reader that stalls for longer ends the stream, this also bounds the
+ * time tap_destroy() can block */
+#define SOCKET_TIMEOUT_SEC	1
+
+struct tap {
+	struct spa_log *log;
+	struct tap_info info;
+
+	struct wav_file *file;
+	pthread_t thread;
+	int wakeup_fd;
+	bool running;
+	bool failed;
+
+	/* one ring index for all planes, in bytes of a plane */
+	struct spa_ringbuffer ring;
+	uint32_t n_planes;
+	uint32_t stride;
+	uint32_t size;
+	void *planes[SPA_AUDIO_MAX_CHANNELS];
+	void *blocks[SPA_AUDIO_MAX_CHANNELS];
+
+	uint64_t written;
+	uint64_t dropped;
+};
+
+static const struct tap_format_info {
+	const char *label;
+} tap_format_info[] = {
+	[TAP_FORMAT_AUTO] = { "auto" },
+	[TAP_FORMAT_WAV] = { "wav" },
+	[TAP_FORMAT_RAW] = { "raw" },
+};
+
+enum tap_format tap_format_from_label(const char *label)
+{
+	uint32_t i;
+	for (i = 0; i < SPA_N_ELEMENTS(tap_format_info); i++) {
+		if (spa_streq(tap_format_info[i].label, label))
+			return i;
+	}
+	return TAP_FORMAT_AUTO;
+}
+
+const char *tap_format_to_label(enum tap_format format)
+{
+	if (format >= SPA_N_ELEMENTS(tap_format_info))
+		format = TAP_FORMAT_AUTO;
+	return tap_format_info[format].label;
+}
+
+static uint32_t sample_size(uint32_t format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_U8:
+	case SPA_AUDIO_FORMAT_U8P:
+		return 1;
+	case SPA_AUDIO_FORMAT_S16_LE:
+	case SPA_AUDIO_FORMAT_S16P:
+		return 2;
+	case SPA_AUDIO_FORMAT_S24_LE:
+	case SPA_AUDIO_FORMAT_S24P:
+		return 3;
+	case SPA_AUDIO_FORMAT_S24_32_LE:
+	case SPA_AUDIO_FORMAT_S24_32P:
+	case SPA_AUDIO_FORMAT_S32_LE:
+	case SPA_AUDIO_FORMAT_S32P:
+	case SPA_AUDIO_FORMAT_F32_LE:
+	case SPA_AUDIO_FORMAT_F32P:
+		return 4;
+	case SPA_AUDIO_FORMAT_F64_LE:
+	case SPA_AUDIO_FORMAT_F64P:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+static int open_socket(const char *path)
+{
+	struct sockaddr_un addr;
+	struct timeval tv = { SOCKET_TIMEOUT_SEC, 0 };
+	int fd, res;
+
+	spa_zero(addr);
+	addr.sun_family = AF_UNIX;
+	if (spa_scnprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path) !=
+			(int)strlen(path))
+		return -ENAMETOOLONG;
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -errno;
+	if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0 ||
+	    connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		res = -errno;
+		close(fd);
+		return res;
+	}
+	return fd;
+}
+
+static uint32_t read_block(struct tap *t)
+{
+	uint32_t index, i, n;
+	int32_t avail;
+	ssize_t res;
+
+	avail = spa_ringbuffer_get_read_index(&t->ring, &index);
+	n = SPA_MIN(avail / t->stride, (uint32_t)BLOCK_FRAMES);
+	if (n == 0)
+		return 0;
+
+	for (i = 0; i < t->n_planes; i++)
+		spa_ringbuffer_read_data(&t->ring, t->planes[i], t->size,
+				index & (t->size - 1), t->blocks[i], n * t->stride);
+	spa_ringbuffer_read_update(&t->ring, index + n * t->stride);
+
+	if (!t->failed &&
+	    (res = wav_file_write(t->file, (const void**)t->blocks, n)) < 0) {
+		spa_log_warn(t->log, "%p: write failed, dropping samples: %s",
+				t, spa_strerror(res));
+		t->failed = true;
+	}
+	if (t->failed)
+		__atomic_add_fetch(&t->dropped, n, __ATOMIC_RELAXED);
+	else
+		__atomic_add_fetch(&t->written, n, __ATOMIC_RELAXED);
+	return n;
+}
+
+static void *writer_thread(void *data)
+{
+	struct tap *t = data;
+	uint64_t count;
+	sigset_t mask;
+
+	/* a socket that is closed by the reader fails the write */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	while (true) {
+		if (read_block(t) > 0)
+			continue;
+		if (!__atomic_load_n(&t->running, __ATOMIC_ACQUIRE))
+			break;
+		/* the ring is empty, wait until tap_write() queued a block */
+		if (read(t->wakeup_fd, &count, sizeof(count)) < 0 && errno != EINTR) {
+			spa_log_error(t->log, "%p: wakeup failed: %m", t);
+			break;
+		}
+	}
+	return NULL;
+}
+
+struct tap *tap_new(struct spa_log *log, const char *path, const struct tap_info *info)
+{
+	struct tap *t;
+	struct wav_file_info wi;
+	const struct spa_audio_info_raw *raw = &info->info.info.raw;
+	uint32_t i, ssize, frames, msec;
+	enum tap_format format = info->format;
+	int fd, res;
+
+	if (info->info.media_type != SPA_MEDIA_TYPE_audio ||
+	    info->info.media_subtype != SPA_MEDIA_SUBTYPE_raw ||
+	    raw->rate == 0 || raw->channels == 0 ||
+	    raw->channels > SPA_AUDIO_MAX_CHANNELS ||
+	    (ssize = sample_size(raw->format)) == 0) {
+		errno = ENOTSUP;
+		return NULL;
+	}
+
+	if ((t = calloc(1, sizeof(*t))) == NULL)
+		return NULL;
+
+	t->log = log;
+	t->info = *info;
+	t->wakeup_fd = -1;
+	spa_log_topic_init(log, &log_topic);
+
+	if (SPA_AUDIO_FORMAT_IS_PLANAR(raw->format)) {
+		t->n_planes = raw->channels;
+		t->stride = ssize;
+	} else {
+		t->n_planes = 1;
+		t->stride = ssize * raw->channels;
+	}
+
+	msec = info->buffer_msec ? info->buffer_msec : TAP_DEFAULT_BUFFER_MSEC;
+	msec = SPA_MIN(msec, (uint32_t)TAP_MAX_BUFFER_MSEC);
+	frames = (uint64_t)raw->rate * msec / 1000;
+	frames = SPA_MAX(frames, (uint32_t)BLOCK_FRAMES);
+	t->size = 1;
+	while (t->size < (uint64_t)frames * t->stride)
+		t->size <<= 1;
+
+	spa_ringbuffer_init(&t->ring);
+	for (i = 0; i < t->n_planes; i++) {
+		if ((t->planes[i] = malloc(t->size)) == NULL ||
+		    (t->blocks[i] = malloc(BLOCK_FRAMES * t->stride)) == NULL)
+			goto error_errno;
+	}
+
+	if (spa_strstartswith(path, "unix:")) {
+		if ((fd = open_socket(path + 5)) < 0) {
+			res = fd;
+			goto error;
+		}
+		format = TAP_FORMAT_RAW;
+	} else {
+		if ((fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, 0660)) < 0)
+			goto error_errno;
+		if (format == TAP_FORMAT_AUTO)
+			format = spa_strendswith(path, ".wav") ? TAP_FORMAT_WAV : TAP_FORMAT_RAW;
+	}
+
+	if ((t->wakeup_fd = eventfd(0, EFD_CLOEXEC)) < 0)
+		goto error_errno;
+
+	spa_zero(wi);
+	wi.info = info->info;
+	wi.flags = format == TAP_FORMAT_RAW ? WAV_FILE_FLAG_RAW : 0;
+	if ((t->file = wav_file_open_fd(fd, &wi)) == NULL) {
+		res = -errno;
+		close(fd);
+		goto error;
+	}
+
+	t->running = true;
+	if ((res = pthread_create(&t->thread, NULL, writer_thread, t)) != 0) {
+		res = -res;
+		t->running = false;
+		goto error;
+	}
+
+	spa_log_info(log, "%p: tap to %s format:%s rate:%u channels:%u ring:%u",
+			t, path, tap_format_to_label(format), raw->rate,
+			raw->channels, t->size * t->n_planes);
+	return t;
+
+error_errno:
+	res = -errno;
+error:
+	tap_destroy(t);
+	errno = -res;
+	return NULL;
+}
+
+static void wakeup(struct tap *t)
+{
+	uint64_t count = 1;
+	if (write(t->wakeup_fd, &count, sizeof(count)) != sizeof(count))
+		spa_log_warn(t->log, "%p: wakeup failed: %m", t);
+}
+
+void tap_destroy(struct tap *t)
+{
+	uint32_t i;
+
+	if (t->running) {
+		__atomic_store_n(&t->running, false, __ATOMIC_RELEASE);
+		wakeup(t);
+		pthread_join(t->thread, NULL);
+		spa_log_info(t->log, "%p: tap closed, written:%"PRIu64" dropped:%"PRIu64,
+				t, t->written, t->dropped);
+	}
+	if (t->file)
+		wav_file_close(t->file);
+	if (t->wakeup_fd >= 0)
+		close(t->wakeup_fd);
+	for (i = 0; i < t->n_planes; i++) {
+		free(t->planes[i]);
+		free(t->blocks[i]);
+	}
+	free(t);
+}
+
+uint32_t tap_write(struct tap *t, const void **data, uint32_t n_samples)
+{
+	uint32_t index, i, size = n_samples * t->stride;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&t->ring, &index);
+	if (filled < 0 || (uint32_t)filled + size > t->size) {
+		__atomic_add_fetch(&t->dropped, n_samples, __ATOMIC_RELAXED);
+		return 0;
+	}
+	for (i = 0; i < t->n_planes; i++)
+		spa_ringbuffer_write_data(&t->ring, t->planes[i], t->size,
+				index & (t->size - 1), data[i], size);
+	spa_ringbuffer_write_update(&t->ring, index + size);
+
+	/* the writer drains the ring before it sleeps, wake it up once a
+	 * block is queued */
+	if ((uint32_t)filled < BLOCK_FRAMES * t->stride &&
+	    (uint32_t)filled + size >= BLOCK_FRAMES * t->stride)
+		wakeup(t);
+	return n_samples;
+}
+
+void tap_get_stats(struct tap *t, uint64_t *written, uint64_t *dropped)
+{
+	*written = __atomic_load_n(&t->written, __ATOMIC_RELAXED);
+	*dropped = __atomic_load_n(&t->dropped, __ATOMIC_RELAXED);
+}
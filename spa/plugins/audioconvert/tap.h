@@ -0,0 +1,52 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SPA_AUDIOCONVERT_TAP_H
+#define SPA_AUDIOCONVERT_TAP_H
+
+#include <spa/utils/defs.h>
+#include <spa/support/log.h>
+#include <spa/param/audio/format.h>
+
+#define TAP_DEFAULT_BUFFER_MSEC	2000
+#define TAP_MAX_BUFFER_MSEC	60000
+
+enum tap_format {
+	TAP_FORMAT_AUTO,	/**< WAV when the path ends in .wav, else raw */
+	TAP_FORMAT_WAV,
+	TAP_FORMAT_RAW,
+};
+
+struct tap_info {
+	struct spa_audio_info info;	/**< format of the tapped samples */
+	enum tap_format format;
+	uint32_t buffer_msec;		/**< size of the ring */
+};
+
+/**
+ * Capture tap.
+ *
+ * Copies the samples of the data thread into a ring. A writer thread
+ * writes them to a file or, for a path of the form unix:<path>, streams
+ * them to a local socket. The data thread never blocks, when the ring is
+ * full the samples of the cycle are dropped and counted.
+ *
+ * tap_new() and tap_destroy() must not be called from the data thread.
+ */
+struct tap;
+
+struct tap *tap_new(struct spa_log *log, const char *path, const struct tap_info *info);
+void tap_destroy(struct tap *t);
+
+/** Queue \a n_samples of \a data, in the format of the tap. Can be called
+ * from the data thread. Returns the number of samples queued. */
+uint32_t tap_write(struct tap *t, const void **data, uint32_t n_samples);
+
+/** Samples written out and dropped so far */
+void tap_get_stats(struct tap *t, uint64_t *written, uint64_t *dropped);
+
+enum tap_format tap_format_from_label(const char *label);
+const char *tap_format_to_label(enum tap_format format);
+
+#endif /* SPA_AUDIOCONVERT_TAP_H */
@@ -741,6 +741,101 @@ static void test_noise(void)
 	run_test_noise(SPA_AUDIO_FORMAT_S32, 2, 0);
 }
 
+#define N_DITHER_SAMPLES	1100
+#define N_DITHER_CHANNELS	11
+
+static void init_dither(struct convert *conv, uint32_t fmt, uint32_t method,
+		uint32_t noise_bits, uint32_t n_channels, uint32_t flags)
+{
+	spa_zero(*conv);
+	conv->src_fmt = SPA_AUDIO_FORMAT_F32P;
+	conv->dst_fmt = fmt;
+	conv->method = method;
+	conv->noise_bits = noise_bits;
+	conv->n_channels = n_channels;
+	conv->rate = 48000;
+	conv->cpu_flags = flags;
+	spa_assert_se(convert_init(conv) == 0);
+}
+
+/* the optimized dither must produce exactly the same samples as the C
+ * version, also when the shaper state is carried over between cycles */
+static void run_test_dither(uint32_t fmt, uint32_t method, uint32_t noise_bits,
+		uint32_t n_channels, uint32_t flags)
+{
+	static const uint32_t sizes[] = { 253, 1, 7, N_DITHER_SAMPLES, 64 };
+	static float in[N_DITHER_CHANNELS][N_DITHER_SAMPLES];
+	static uint8_t out[2][N_DITHER_CHANNELS * N_DITHER_SAMPLES * 4];
+	struct convert conv[2];
+	const void *ip[N_DITHER_CHANNELS];
+	void *op[2][N_DITHER_CHANNELS];
+	uint32_t i, j, k, c, n, size = fmt == SPA_AUDIO_FORMAT_S32P ? 4 : 2;
+	bool planar = fmt == SPA_AUDIO_FORMAT_S16P || fmt == SPA_AUDIO_FORMAT_S32P;
+
+	init_dither(&conv[0], fmt, method, noise_bits, n_channels, 0);
+	init_dither(&conv[1], fmt, method, noise_bits, n_channels, flags);
+	if (conv[1].process == conv[0].process)
+		goto done;
+
+	fprintf(stderr, "test dither %s %s, %d channels:\n", conv[0].func_name,
+			conv[1].func_name, n_channels);
+
+	/* the optimized noise generators use a different PRNG */
+	conv[1].update_noise = conv[0].update_noise;
+	memcpy(conv[1].random, conv[0].random, RANDOM_SIZE * sizeof(uint32_t));
+
+	for (i = 0; i < n_channels; i++)
+		ip[i] = in[i];
+
+	for (k = 0, n = 0; k < SPA_N_ELEMENTS(sizes); n += sizes[k++]) {
+		/* sines that clip a little */
+		for (i = 0; i < n_channels; i++)
+			for (j = 0; j < sizes[k]; j++)
+				in[i][j] = 1.2f * sinf((n + j) * (i + 1) * 0.013f);
+
+		for (c = 0; c < 2; c++) {
+			memset(out[c], c, sizeof(out[c]));
+			for (i = 0; i < n_channels; i++)
+				op[c][i] = &out[c][planar ? i * sizes[k] * size : 0];
+			convert_process(&conv[c], op[c], ip, sizes[k]);
+		}
+		compare_mem(k, n_channels, out[0], out[1], n_channels * sizes[k] * size);
+	}
+done:
+	convert_free(&conv[0]);
+	convert_free(&conv[1]);
+}
+
+static void test_dither(void)
+{
+	static const uint32_t channels[] = { 1, 2, 3, 5, 8, 11 };
+	static const uint32_t formats[] = { SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16,
+		SPA_AUDIO_FORMAT_S16_OE };
+	uint32_t flags[] = { cpu_flags, cpu_flags };
+	uint32_t i, j, f;
+
+#if defined(HAVE_AVX2)
+	/* also test the SSE2 versions */
+	flags[1] &= ~SPA_CPU_FLAG_AVX2;
+#endif
+	for (f = 0; f < SPA_N_ELEMENTS(flags); f++) {
+		if (f > 0 && flags[f] == flags[0])
+			continue;
+		for (i = 0; i < SPA_N_ELEMENTS(channels); i++) {
+			for (j = 0; j < SPA_N_ELEMENTS(formats); j++) {
+				run_test_dither(formats[j], DITHER_METHOD_WANNAMAKER_3, 0,
+						channels[i], flags[f]);
+				run_test_dither(formats[j], DITHER_METHOD_LIPSHITZ, 0,
+						channels[i], flags[f]);
+				run_test_dither(formats[j], DITHER_METHOD_TRIANGULAR_HF, 0,
+						channels[i], flags[f]);
+			}
+			run_test_dither(SPA_AUDIO_FORMAT_S32P, DITHER_METHOD_NONE, 4,
+					channels[i], flags[f]);
+		}
+	}
+}
+
 int main(int argc, char *argv[])
 {
 	cpu_flags = get_cpu_flags();
@@ -781,6 +876,7 @@ int main(int argc, char *argv[])
 	test_swaps();
 
 	test_noise();
+	test_dither();
 
 	return 0;
 }
@@ -0,0 +1,356 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/utils/defs.h>
+#include <spa/utils/string.h>
+
+SPA_LOG_IMPL(logger);
+
+#include "tap.h"
+
+#define CHUNK	256
+#define WAV_HEADER_SIZE	44
+
+static char tmpdir[] = "/tmp/test-tap-XXXXXX";
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void init_info(struct tap_info *info, uint32_t format, uint32_t channels)
+{
+	spa_zero(*info);
+	info->info.media_type = SPA_MEDIA_TYPE_audio;
+	info->info.media_subtype = SPA_MEDIA_SUBTYPE_raw;
+	info->info.info.raw.format = format;
+	info->info.info.raw.rate = 48000;
+	info->info.info.raw.channels = channels;
+}
+
+static void *read_file(const char *path, size_t *size)
+{
+	FILE *f;
+	void *data;
+	long len;
+
+	spa_assert_se((f = fopen(path, "r")) != NULL);
+	spa_assert_se(fseek(f, 0, SEEK_END) == 0);
+	spa_assert_se((len = ftell(f)) >= 0);
+	rewind(f);
+	spa_assert_se((data = malloc(len + 1)) != NULL);
+	spa_assert_se(fread(data, 1, len, f) == (size_t)len);
+	fclose(f);
+	*size = len;
+	return data;
+}
+
+static void test_raw_planar(void)
+{
+	struct tap_info info;
+	struct tap *t;
+	char path[128];
+	float left[CHUNK], right[CHUNK], *f;
+	const void *data[2] = { left, right };
+	uint64_t written, dropped;
+	uint32_t i, j, n_chunks = 64;
+	size_t size;
+
+	snprintf(path, sizeof(path), "%s/planar.raw", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_F32P, 2);
+
+	spa_assert_se((t = tap_new(&logger.log, path, &info)) != NULL);
+	for (i = 0; i < n_chunks; i++) {
+		for (j = 0; j < CHUNK; j++) {
+			left[j] = (float)(i * CHUNK + j);
+			right[j] = -(float)(i * CHUNK + j);
+		}
+		spa_assert_se(tap_write(t, data, CHUNK) == CHUNK);
+	}
+	tap_get_stats(t, &written, &dropped);
+	spa_assert_se(dropped == 0);
+	tap_destroy(t);
+
+	/* the writer interleaves */
+	f = read_file(path, &size);
+	spa_assert_se(size == n_chunks * CHUNK * 2 * sizeof(float));
+	for (i = 0; i < n_chunks * CHUNK; i++) {
+		spa_assert_se(f[2*i] == (float)i);
+		spa_assert_se(f[2*i+1] == -(float)i);
+	}
+	free(f);
+	unlink(path);
+}
+
+static void test_wav_interleaved(void)
+{
+	struct tap_info info;
+	struct tap *t;
+	char path[128];
+	int16_t samples[CHUNK * 2];
+	const void *data[1] = { samples };
+	uint8_t *d;
+	uint32_t i, j, n_chunks = 64, n_samples = n_chunks * CHUNK * 2;
+	size_t size;
+
+	snprintf(path, sizeof(path), "%s/interleaved.wav", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_S16, 2);
+
+	spa_assert_se((t = tap_new(&logger.log, path, &info)) != NULL);
+	for (i = 0; i < n_chunks; i++) {
+		for (j = 0; j < CHUNK * 2; j++)
+			samples[j] = (int16_t)(i * CHUNK * 2 + j);
+		spa_assert_se(tap_write(t, data, CHUNK) == CHUNK);
+	}
+	tap_destroy(t);
+
+	d = read_file(path, &size);
+	spa_assert_se(size == WAV_HEADER_SIZE + n_samples * sizeof(int16_t));
+	spa_assert_se(memcmp(d, "RIFF", 4) == 0);
+	spa_assert_se(memcmp(d + 36, "data", 4) == 0);
+	spa_assert_se(d[40] + (d[41] << 8) + (d[42] << 16) + ((uint32_t)d[43] << 24) ==
+			n_samples * sizeof(int16_t));
+	for (i = 0; i < n_samples; i++) {
+		int16_t v;
+		memcpy(&v, d + WAV_HEADER_SIZE + i * sizeof(v), sizeof(v));
+		spa_assert_se(v == (int16_t)i);
+	}
+	free(d);
+	unlink(path);
+}
+
+/* a full ring drops whole cycles and never corrupts what was queued */
+static void test_drops(void)
+{
+	struct tap_info info;
+	struct tap *t;
+	char path[128];
+	int32_t samples[CHUNK], *s;
+	const void *data[1] = { samples };
+	uint64_t written, dropped, queued = 0;
+	uint32_t i, j, n_chunks = 2048, prev;
+	size_t size;
+
+	snprintf(path, sizeof(path), "%s/drops.raw", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_S32, 1);
+	info.buffer_msec = 1;
+
+	spa_assert_se((t = tap_new(&logger.log, path, &info)) != NULL);
+	for (i = 0; i < n_chunks; i++) {
+		for (j = 0; j < CHUNK; j++)
+			samples[j] = i;
+		queued += tap_write(t, data, CHUNK);
+	}
+	tap_destroy(t);
+
+	/* a destroyed tap has flushed everything, the stats are final */
+	s = read_file(path, &size);
+	written = size / sizeof(int32_t);
+	dropped = (uint64_t)n_chunks * CHUNK - queued;
+	printf("drops: written %"PRIu64" dropped %"PRIu64"\n", written, dropped);
+	spa_assert_se(written == queued);
+	spa_assert_se(dropped > 0);
+	spa_assert_se(written % CHUNK == 0);
+
+	for (i = 0, prev = 0; i < written; i += CHUNK) {
+		for (j = 0; j < CHUNK; j++)
+			spa_assert_se(s[i + j] == s[i]);
+		spa_assert_se(i == 0 || (uint32_t)s[i] > prev);
+		prev = s[i];
+	}
+	free(s);
+	unlink(path);
+}
+
+/* a reader that does not read must not stall the data thread */
+static void test_stalled_socket(void)
+{
+	struct tap_info info;
+	struct tap *t;
+	struct sockaddr_un addr;
+	char path[128];
+	float samples[CHUNK * 2];
+	const void *data[1] = { samples };
+	uint64_t written, dropped, t0, t1, max_ns = 0;
+	struct timespec ts = { 0, 100 * SPA_NSEC_PER_USEC };
+	uint32_t i, n_chunks = 10000;
+	int fd, peer;
+
+	spa_zero(addr);
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/tap.sock", tmpdir);
+	spa_assert_se((fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0);
+	spa_assert_se(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+	spa_assert_se(listen(fd, 1) == 0);
+
+	snprintf(path, sizeof(path), "unix:%s/tap.sock", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_F32, 2);
+	info.buffer_msec = 100;
+	spa_assert_se((t = tap_new(&logger.log, path, &info)) != NULL);
+	spa_assert_se((peer = accept(fd, NULL, NULL)) >= 0);
+
+	memset(samples, 0, sizeof(samples));
+	for (i = 0; i < n_chunks; i++) {
+		t0 = get_time_ns();
+		tap_write(t, data, CHUNK);
+		t1 = get_time_ns();
+		max_ns = SPA_MAX(max_ns, t1 - t0);
+		nanosleep(&ts, NULL);
+	}
+	tap_get_stats(t, &written, &dropped);
+
+	t0 = get_time_ns();
+	tap_destroy(t);
+	t1 = get_time_ns();
+
+	printf("stalled: written %"PRIu64" dropped %"PRIu64" max write %"PRIu64"ns destroy %"PRIu64"ms\n",
+			written, dropped, max_ns, (uint64_t)((t1 - t0) / SPA_NSEC_PER_MSEC));
+	spa_assert_se(dropped > 0);
+	spa_assert_se(max_ns < 10 * SPA_NSEC_PER_MSEC);
+	spa_assert_se(t1 - t0 < 5 * SPA_NSEC_PER_SEC);
+
+	close(peer);
+	close(fd);
+	unlink(addr.sun_path);
+}
+
+/* A graph cycle with DSP load that also taps its output. The tap must not
+ * take more than the time left after the load and the capture must be
+ * bit-exact. The tap is timed in CPU time so that a busy machine that
+ * preempts the cycle does not count as an xrun of the tap. */
+#define GRAPH_RATE	48000
+#define GRAPH_QUANTUM	256
+#define GRAPH_CYCLES	200
+#define GRAPH_LOAD	50	/* percent of the cycle spent on the load */
+
+static uint64_t get_cpu_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static uint32_t run_graph(struct tap *t, uint32_t *tap_xruns)
+{
+	int32_t samples[GRAPH_QUANTUM * 2];
+	const void *data[1] = { samples };
+	uint64_t period = GRAPH_QUANTUM * SPA_NSEC_PER_SEC / GRAPH_RATE;
+	uint64_t headroom = period * (100 - GRAPH_LOAD) / 100;
+	uint64_t start, deadline, tap_ns = 0, t0;
+	struct timespec ts;
+	uint32_t i, j, xruns = 0;
+
+	start = get_time_ns();
+	for (i = 0; i < GRAPH_CYCLES; i++) {
+		deadline = start + period;
+		for (j = 0; j < GRAPH_QUANTUM * 2; j++)
+			samples[j] = i * GRAPH_QUANTUM * 2 + j;
+		while (get_time_ns() < start + period * GRAPH_LOAD / 100)
+			;
+		if (t != NULL) {
+			t0 = get_cpu_time_ns();
+			spa_assert_se(tap_write(t, data, GRAPH_QUANTUM) == GRAPH_QUANTUM);
+			tap_ns = get_cpu_time_ns() - t0;
+		}
+		if (get_time_ns() > deadline)
+			xruns++;
+		if (tap_ns > headroom)
+			(*tap_xruns)++;
+		start = deadline;
+		ts.tv_sec = start / SPA_NSEC_PER_SEC;
+		ts.tv_nsec = start % SPA_NSEC_PER_SEC;
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	}
+	return xruns;
+}
+
+static void test_loaded_graph(void)
+{
+	struct tap_info info;
+	struct tap *t;
+	char path[128];
+	uint64_t written, dropped;
+	uint32_t i, base, xruns, tap_xruns = 0;
+	uint8_t *d;
+	size_t size;
+
+	snprintf(path, sizeof(path), "%s/graph.wav", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_S32, 2);
+	info.info.info.raw.rate = GRAPH_RATE;
+
+	base = run_graph(NULL, &tap_xruns);
+
+	spa_assert_se((t = tap_new(&logger.log, path, &info)) != NULL);
+	xruns = run_graph(t, &tap_xruns);
+	tap_get_stats(t, &written, &dropped);
+	tap_destroy(t);
+
+	printf("loaded graph: xruns %u without tap, %u with tap, %u by the tap\n",
+			base, xruns, tap_xruns);
+	spa_assert_se(tap_xruns == 0);
+	spa_assert_se(dropped == 0);
+
+	d = read_file(path, &size);
+	spa_assert_se(size == WAV_HEADER_SIZE + GRAPH_CYCLES * GRAPH_QUANTUM * 2 * sizeof(int32_t));
+	for (i = 0; i < GRAPH_CYCLES * GRAPH_QUANTUM * 2; i++) {
+		int32_t v;
+		memcpy(&v, d + WAV_HEADER_SIZE + i * sizeof(v), sizeof(v));
+		spa_assert_se(v == (int32_t)i);
+	}
+	free(d);
+	unlink(path);
+}
+
+static void test_invalid(void)
+{
+	struct tap_info info;
+	char path[128];
+
+	snprintf(path, sizeof(path), "%s/invalid.raw", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_S24_32_BE, 2);
+	spa_assert_se(tap_new(&logger.log, path, &info) == NULL);
+	spa_assert_se(errno == ENOTSUP);
+
+	snprintf(path, sizeof(path), "unix:%s/nothing.sock", tmpdir);
+	init_info(&info, SPA_AUDIO_FORMAT_F32, 2);
+	spa_assert_se(tap_new(&logger.log, path, &info) == NULL);
+
+	spa_assert_se(tap_format_from_label("wav") == TAP_FORMAT_WAV);
+	spa_assert_se(tap_format_from_label("raw") == TAP_FORMAT_RAW);
+	spa_assert_se(tap_format_from_label("flac") == TAP_FORMAT_AUTO);
+	spa_assert_se(spa_streq(tap_format_to_label(TAP_FORMAT_RAW), "raw"));
+}
+
+int main(int argc, char *argv[])
+{
+	logger.log.level = SPA_LOG_LEVEL_INFO;
+
+	spa_assert_se(mkdtemp(tmpdir) != NULL);
+
+	test_raw_planar();
+	test_wav_interleaved();
+	test_drops();
+	test_stalled_socket();
+	test_loaded_graph();
+	test_invalid();
+
+	rmdir(tmpdir);
+
+	return 0;
+}
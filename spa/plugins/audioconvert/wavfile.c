@@ -36,6 +36,7 @@ struct wav_file {
 	struct spa_audio_info info;
 	int fd;
 	const struct format_info *fi;
+	uint32_t flags;
 
 	uint32_t length;
 
@@ -45,11 +46,22 @@ struct wav_file {
 
 static inline ssize_t write_data(struct wav_file *wf, const void *data, size_t size)
 {
+	const uint8_t *p = data;
+	size_t done = 0;
 	ssize_t len;
-	len = write(wf->fd, data, size);
-	if (len > 0)
-		wf->length += len;
-	return len;
+
+	/* sockets and pipes can take less than asked */
+	while (done < size) {
+		len = write(wf->fd, p + done, size - done);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		done += len;
+	}
+	wf->length += done;
+	return done;
 }
 
 static ssize_t writei(struct wav_file *wf, const void **data, size_t samples)
@@ -66,7 +78,7 @@ static ssize_t name (struct wav_file *wf, const void **data, size_t samples)	\
 {										\
 	uint32_t b, n, k, blocks = wf->blocks, chunk;				\
 	uint8_t buf[BLOCK_SIZE];						\
-	ssize_t res = 0;							\
+	ssize_t res = 0, len;							\
 	type **d = (type**)data;						\
 	uint32_t chunk_size = sizeof(buf) / (blocks * sizeof(type));		\
 	for (n = 0; n < samples; ) {						\
@@ -76,8 +88,10 @@ static ssize_t name (struct wav_file *wf, const void **data, size_t samples)	\
 			for (b = 0; b < blocks; b++)				\
 				*p++ = d[b][n];					\
 		}								\
-		res += write_data(wf, buf,					\
-				chunk * blocks * sizeof(type));			\
+		len = write_data(wf, buf, chunk * blocks * sizeof(type));	\
+		if (len < 0)							\
+			return len;						\
+		res += len;							\
 	}									\
 	return res;								\
 }
@@ -180,21 +194,18 @@ static const struct format_info *find_info(struct wav_file_info *info)
 	return NULL;
 }
 
-static int open_write(struct wav_file *wf, const char *filename, struct wav_file_info *info)
+static int open_write(struct wav_file *wf, int fd, struct wav_file_info *info)
 {
-	int res;
 	const struct format_info *fi;
 
 	fi = find_info(info);
 	if (fi == NULL)
 		return -ENOTSUP;
 
-	if ((wf->fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, 0660)) < 0) {
-		res = -errno;
-		goto exit;
-	}
+	wf->fd = fd;
 	wf->info = info->info;
 	wf->fi = fi;
+	wf->flags = info->flags;
 	if (fi->planar) {
 		wf->stride = fi->bits / 8;
 		wf->blocks = info->info.info.raw.channels;
@@ -203,13 +214,34 @@ static int open_write(struct wav_file *wf, const char *filename, struct wav_file
 		wf->blocks = 1;
 	}
 
-	res = write_headers(wf);
-exit:
-	return res;
+	if (wf->flags & WAV_FILE_FLAG_RAW)
+		return 0;
+	return write_headers(wf);
 }
 
 struct wav_file *
 wav_file_open(const char *filename, const char *mode, struct wav_file_info *info)
+{
+	int fd;
+	struct wav_file *wf;
+
+	if (!spa_streq(mode, "w")) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if ((fd = open(filename, O_WRONLY | O_CREAT | O_CLOEXEC | O_TRUNC, 0660)) < 0)
+		return NULL;
+
+	if ((wf = wav_file_open_fd(fd, info)) == NULL) {
+		int res = errno;
+		close(fd);
+		errno = res;
+	}
+	return wf;
+}
+
+struct wav_file *
+wav_file_open_fd(int fd, struct wav_file_info *info)
 {
 	int res;
 	struct wav_file *wf;
@@ -218,30 +250,24 @@ wav_file_open(const char *filename, const char *mode, struct wav_file_info *info
 	if (wf == NULL)
 		return NULL;
 
-	if (spa_streq(mode, "w")) {
-		if ((res = open_write(wf, filename, info)) < 0)
-			goto exit_free;
-	} else {
-		res = -EINVAL;
-		goto exit_free;
+	if ((res = open_write(wf, fd, info)) < 0) {
+		free(wf);
+		errno = -res;
+		return NULL;
 	}
 	return wf;
-
-exit_free:
-	free(wf);
-	errno = -res;
-	return NULL;
 }
 
 int wav_file_close(struct wav_file *wf)
 {
-	int res;
+	int res = 0;
 
-	CHECK_RES(write_headers(wf));
+	if (!(wf->flags & WAV_FILE_FLAG_RAW))
+		res = write_headers(wf);
 
 	close(wf->fd);
 	free(wf);
-	return 0;
+	return res;
 }
 
 ssize_t wav_file_write(struct wav_file *wf, const void **data, size_t samples)
@@ -27,13 +27,20 @@
 
 struct wav_file;
 
+#define WAV_FILE_FLAG_RAW	(1<<0)	/* no headers, only the samples */
+
 struct wav_file_info {
 	struct spa_audio_info info;
+	uint32_t flags;
 };
 
 struct wav_file *
 wav_file_open(const char *filename, const char *mode, struct wav_file_info *info);
 
+/* write to \a fd, which is closed with the wav_file */
+struct wav_file *
+wav_file_open_fd(int fd, struct wav_file_info *info);
+
 int wav_file_close(struct wav_file *wf);
 
 ssize_t wav_file_write(struct wav_file *wf, const void **data, size_t size);
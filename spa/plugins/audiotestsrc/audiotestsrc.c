@@ -9,6 +9,7 @@
 #include <stdio.h>
 
 #include <spa/support/plugin.h>
+#include <spa/support/cpu.h>
 #include <spa/support/log.h>
 #include <spa/support/system.h>
 #include <spa/support/loop.h>
@@ -25,17 +26,14 @@
 #include <spa/pod/filter.h>
 #include <spa/control/control.h>
 
+#include "render-ops.h"
+
 #define NAME "audiotestsrc"
 
 #define SAMPLES_TO_TIME(this,s)   ((s) * SPA_NSEC_PER_SEC / (port)->current_format.info.raw.rate)
 #define BYTES_TO_SAMPLES(this,b)  ((b)/(port)->bpf)
 #define BYTES_TO_TIME(this,b)     SAMPLES_TO_TIME(this, BYTES_TO_SAMPLES (this, b))
 
-enum wave_type {
-	WAVE_SINE,
-	WAVE_SQUARE,
-};
-
 #define DEFAULT_RATE		48000
 #define DEFAULT_CHANNELS	2
 
@@ -70,10 +68,6 @@ struct buffer {
 	struct spa_list link;
 };
 
-struct impl;
-
-typedef void (*render_func_t) (struct impl *this, void *samples, size_t n_samples);
-
 struct port {
 	uint64_t info_all;
 	struct spa_port_info info;
@@ -85,8 +79,8 @@ struct port {
 	bool have_format;
 	struct spa_audio_info current_format;
 	size_t bpf;
-	render_func_t render_func;
-	float accumulator;
+	struct render_ops ops;
+	struct render_osc osc;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -102,6 +96,7 @@ struct impl {
 	struct spa_loop *data_loop;
 	struct spa_system *data_system;
 
+	uint32_t cpu_flags;
 	uint32_t quantum_limit;
 
 	uint64_t info_all;
@@ -177,6 +172,8 @@ static int impl_node_enum_params(void *object, int seq,
 			spa_pod_builder_string(&b, "Sine wave");
 			spa_pod_builder_int(&b, WAVE_SQUARE);
 			spa_pod_builder_string(&b, "Square wave");
+			spa_pod_builder_int(&b, WAVE_NOISE);
+			spa_pod_builder_string(&b, "White noise");
 			spa_pod_builder_pop(&b, &f[1]);
 			param = spa_pod_builder_pop(&b, &f[0]);
 			break;
@@ -274,6 +271,10 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 			SPA_PROP_frequency, SPA_POD_OPT_Float(&p->freq),
 			SPA_PROP_volume,    SPA_POD_OPT_Float(&p->volume));
 
+		/* unknown wave types render a sine, like before */
+		if (p->wave > WAVE_NOISE)
+			p->wave = WAVE_SINE;
+
 		if (p->live)
 			port->info.flags |= SPA_PORT_FLAG_LIVE;
 		else
@@ -306,7 +307,18 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	return 0;
 }
 
-#include "render.c"
+static int update_render_ops(struct impl *this, struct port *port)
+{
+	if (port->ops.free)
+		render_ops_free(&port->ops);
+
+	port->ops.fmt = port->current_format.info.raw.format;
+	port->ops.n_channels = port->current_format.info.raw.channels;
+	port->ops.cpu_flags = this->cpu_flags;
+	port->ops.wave = this->props.wave;
+
+	return render_ops_init(&port->ops);
+}
 
 static void set_timer(struct impl *this, bool enabled)
 {
@@ -403,9 +415,14 @@ static int make_buffer(struct impl *this)
 	l0 = SPA_MIN(n_bytes, maxsize - offset) / port->bpf;
 	l1 = n_samples - l0;
 
-	port->render_func(this, SPA_PTROFF(data, offset, void), l0);
+	if (port->ops.wave != this->props.wave)
+		update_render_ops(this, port);
+	render_osc_update(&port->osc, port->current_format.info.raw.rate,
+			this->props.freq, this->props.volume);
+
+	render_ops_process(&port->ops, &port->osc, SPA_PTROFF(data, offset, void), l0);
 	if (l1 > 0)
-		port->render_func(this, data, l1);
+		render_ops_process(&port->ops, &port->osc, data, l1);
 
 	d[0].chunk->offset = index;
 	d[0].chunk->size = n_bytes;
@@ -728,8 +745,7 @@ port_set_format(struct impl *this,
 		clear_buffers(this, port);
 	} else {
 		struct spa_audio_info info = { 0 };
-		int idx;
-		const size_t sizes[4] = { 2, 4, 4, 8 };
+		size_t size;
 
 		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
 			return res;
@@ -747,25 +763,25 @@ port_set_format(struct impl *this,
 
 		switch (info.info.raw.format) {
 		case SPA_AUDIO_FORMAT_S16:
-			idx = 0;
+			size = 2;
 			break;
 		case SPA_AUDIO_FORMAT_S32:
-			idx = 1;
-			break;
 		case SPA_AUDIO_FORMAT_F32:
-			idx = 2;
+			size = 4;
 			break;
 		case SPA_AUDIO_FORMAT_F64:
-			idx = 3;
+			size = 8;
 			break;
 		default:
 			return -EINVAL;
 		}
 
-		port->bpf = sizes[idx] * info.info.raw.channels;
+		port->bpf = size * info.info.raw.channels;
 		port->current_format = info;
+		if ((res = update_render_ops(this, port)) < 0)
+			return res;
+		render_osc_init(&port->osc);
 		port->have_format = true;
-		port->render_func = sine_funcs[idx];
 	}
 
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
@@ -1033,6 +1049,7 @@ impl_init(const struct spa_handle_factory *factory,
 {
 	struct impl *this;
 	struct port *port;
+	struct spa_cpu *cpu;
 	uint32_t i;
 
 	spa_return_val_if_fail(factory != NULL, -EINVAL);
@@ -1047,6 +1064,10 @@ impl_init(const struct spa_handle_factory *factory,
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->data_system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataSystem);
 
+	cpu = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_CPU);
+	if (cpu)
+		this->cpu_flags = spa_cpu_get_flags(cpu);
+
 	for (i = 0; info && i < info->n_items; i++) {
 		const char *k = info->items[i].key;
 		const char *s = info->items[i].value;
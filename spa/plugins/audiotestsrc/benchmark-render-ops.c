@@ -0,0 +1,139 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/support/cpu.h>
+#include <spa/param/audio/raw.h>
+
+#include "render-ops.h"
+
+/*
+ * Renders 1024 sample buffers with each generator and output format and
+ * reports the throughput in samples per second, per channel.
+ */
+
+#define N_SAMPLES	1024
+#define MAX_CHANNELS	8
+#define MAX_COUNT	2000
+
+typedef void (*gen_func_t) (struct render_osc *osc, float * SPA_RESTRICT dst,
+		uint32_t n_samples);
+
+static float samp_out[N_SAMPLES * MAX_CHANNELS * 2] SPA_ALIGNED(32);
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* the scalar oscillator that this replaced */
+static void render_sine_ref(struct render_osc *osc, float * SPA_RESTRICT dst,
+		uint32_t n_samples)
+{
+	uint32_t n;
+
+	for (n = 0; n < n_samples; n++) {
+		osc->phase += osc->step;
+		if (osc->phase >= M_PI_M2f)
+			osc->phase -= M_PI_M2f;
+		dst[n] = (float)(sin(osc->phase) * osc->amp);
+	}
+}
+
+static void report(const char *name, const char *impl, uint64_t samples, uint64_t t)
+{
+	fprintf(stderr, "%-12s %-6s %10.2f Msamples/s\n", name, impl, samples * 1e3 / t);
+}
+
+static void run_gen(const char *name, const char *impl, gen_func_t func)
+{
+	struct render_osc osc;
+	uint64_t t, count;
+
+	render_osc_init(&osc);
+	render_osc_update(&osc, 48000, 440.0f, 1.0f);
+
+	t = get_time_ns();
+	for (count = 0; count < MAX_COUNT; count++)
+		func(&osc, samp_out, N_SAMPLES);
+	t = get_time_ns() - t;
+
+	report(name, impl, count * N_SAMPLES, t);
+}
+
+static void run_ops(const char *name, uint32_t wave, uint32_t fmt, uint32_t n_channels,
+		uint32_t cpu_flags)
+{
+	struct render_ops ops;
+	struct render_osc osc;
+	uint64_t t, count;
+	char label[64];
+
+	spa_zero(ops);
+	ops.fmt = fmt;
+	ops.n_channels = n_channels;
+	ops.wave = wave;
+	ops.cpu_flags = cpu_flags;
+	if (render_ops_init(&ops) < 0)
+		return;
+
+	render_osc_init(&osc);
+	render_osc_update(&osc, 48000, 440.0f, 1.0f);
+
+	t = get_time_ns();
+	for (count = 0; count < MAX_COUNT; count++)
+		render_ops_process(&ops, &osc, samp_out, N_SAMPLES);
+	t = get_time_ns() - t;
+
+	snprintf(label, sizeof(label), "%s %uch", name, n_channels);
+	report(label, ops.cpu_flags ? "simd" : "c", count * N_SAMPLES, t);
+
+	render_ops_free(&ops);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		uint32_t fmt;
+	} formats[] = {
+		{ "s16", SPA_AUDIO_FORMAT_S16 },
+		{ "s32", SPA_AUDIO_FORMAT_S32 },
+		{ "f32", SPA_AUDIO_FORMAT_F32 },
+		{ "f64", SPA_AUDIO_FORMAT_F64 },
+	};
+	static const uint32_t channels[] = { 1, 2, 8 };
+	uint32_t i, j, cpu_flags = 0;
+
+#if defined(HAVE_SSE2)
+	cpu_flags |= SPA_CPU_FLAG_SSE2;
+#endif
+
+	run_gen("sine", "ref", render_sine_ref);
+	run_gen("sine", "c", render_sine_c);
+#if defined(HAVE_SSE2)
+	run_gen("sine", "sse2", render_sine_sse2);
+#endif
+	run_gen("square", "c", render_square_c);
+	run_gen("noise", "c", render_noise_c);
+#if defined(HAVE_SSE2)
+	run_gen("noise", "sse2", render_noise_sse2);
+#endif
+
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+		for (j = 0; j < SPA_N_ELEMENTS(channels); j++)
+			run_ops(formats[i].name, WAVE_SINE, formats[i].fmt,
+					channels[j], cpu_flags);
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "render-ops.h"
+
+void render_sine_c(struct render_osc *osc, float * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	float c[RENDER_LANES], s[RENDER_LANES], cr, sr, t, amp = osc->amp;
+	uint32_t n, k;
+
+	for (k = 0; k < RENDER_LANES; k++) {
+		c[k] = cosf(osc->phase + k * osc->step);
+		s[k] = sinf(osc->phase + k * osc->step);
+	}
+	cr = cosf(RENDER_LANES * osc->step);
+	sr = sinf(RENDER_LANES * osc->step);
+
+	for (n = 0; n + RENDER_LANES <= n_samples; n += RENDER_LANES) {
+		for (k = 0; k < RENDER_LANES; k++) {
+			dst[n + k] = s[k] * amp;
+			t = c[k] * cr - s[k] * sr;
+			s[k] = c[k] * sr + s[k] * cr;
+			c[k] = t;
+		}
+	}
+	for (k = 0; n < n_samples; n++, k++)
+		dst[n] = s[k] * amp;
+
+	render_osc_advance(osc, n_samples);
+}
+
+void render_square_c(struct render_osc *osc, float * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	float phase = osc->phase, amp = osc->amp;
+	uint32_t n;
+
+	for (n = 0; n < n_samples; n++) {
+		dst[n] = phase < (float)M_PI ? amp : -amp;
+		phase += osc->step;
+		if (phase >= M_PI_M2f)
+			phase -= M_PI_M2f;
+	}
+	render_osc_advance(osc, n_samples);
+}
+
+void render_noise_c(struct render_osc *osc, float * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	float v[RENDER_LANES], scale = osc->amp / 2147483648.f;
+	uint32_t n, k, x;
+
+	/* all lanes advance on the tail too, like the SIMD versions */
+	for (n = 0; n < n_samples; n += RENDER_LANES) {
+		for (k = 0; k < RENDER_LANES; k++) {
+			x = osc->seed[k];
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			osc->seed[k] = x;
+			v[k] = (float)(int32_t)x * scale;
+		}
+		memcpy(&dst[n], v, SPA_MIN(n_samples - n, RENDER_LANES) * sizeof(float));
+	}
+}
@@ -0,0 +1,72 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#include "render-ops.h"
+
+#include <emmintrin.h>
+
+void render_sine_sse2(struct render_osc *osc, float * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	float c[RENDER_LANES], s[RENDER_LANES];
+	__m128 vc, vs, cr, sr, t, amp = _mm_set1_ps(osc->amp);
+	uint32_t n, k, unrolled;
+
+	for (k = 0; k < RENDER_LANES; k++) {
+		c[k] = cosf(osc->phase + k * osc->step);
+		s[k] = sinf(osc->phase + k * osc->step);
+	}
+	vc = _mm_loadu_ps(c);
+	vs = _mm_loadu_ps(s);
+	cr = _mm_set1_ps(cosf(RENDER_LANES * osc->step));
+	sr = _mm_set1_ps(sinf(RENDER_LANES * osc->step));
+
+	unrolled = n_samples & ~(RENDER_LANES - 1);
+
+	for (n = 0; n < unrolled; n += RENDER_LANES) {
+		_mm_storeu_ps(&dst[n], _mm_mul_ps(vs, amp));
+		t = _mm_sub_ps(_mm_mul_ps(vc, cr), _mm_mul_ps(vs, sr));
+		vs = _mm_add_ps(_mm_mul_ps(vc, sr), _mm_mul_ps(vs, cr));
+		vc = t;
+	}
+	_mm_storeu_ps(s, _mm_mul_ps(vs, amp));
+	for (k = 0; n < n_samples; n++, k++)
+		dst[n] = s[k];
+
+	render_osc_advance(osc, n_samples);
+}
+
+void render_noise_sse2(struct render_osc *osc, float * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	__m128i x = _mm_loadu_si128((__m128i*)osc->seed);
+	__m128 v, scale = _mm_set1_ps(osc->amp / 2147483648.f);
+	float tail[RENDER_LANES];
+	uint32_t n, unrolled;
+
+#define XORSHIFT(x)						\
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));		\
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));		\
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+
+	unrolled = n_samples & ~(RENDER_LANES - 1);
+
+	for (n = 0; n < unrolled; n += RENDER_LANES) {
+		XORSHIFT(x);
+		v = _mm_mul_ps(_mm_cvtepi32_ps(x), scale);
+		_mm_storeu_ps(&dst[n], v);
+	}
+	if (n < n_samples) {
+		XORSHIFT(x);
+		v = _mm_mul_ps(_mm_cvtepi32_ps(x), scale);
+		_mm_storeu_ps(tail, v);
+		memcpy(&dst[n], tail, (n_samples - n) * sizeof(float));
+	}
+#undef XORSHIFT
+	_mm_storeu_si128((__m128i*)osc->seed, x);
+}
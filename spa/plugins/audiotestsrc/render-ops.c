@@ -0,0 +1,154 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+#include <spa/support/cpu.h>
+#include <spa/utils/defs.h>
+#include <spa/param/audio/raw.h>
+
+#include "render-ops.h"
+
+typedef void (*gen_func_t) (struct render_osc *osc, float * SPA_RESTRICT dst,
+		uint32_t n_samples);
+typedef void (*pack_func_t) (void * SPA_RESTRICT dst, const float * SPA_RESTRICT src,
+		uint32_t n_channels, uint32_t n_samples);
+
+struct gen_info {
+	uint32_t wave;
+	uint32_t cpu_flags;
+	gen_func_t generate;
+};
+
+static const struct gen_info gen_table[] =
+{
+#if defined (HAVE_SSE2)
+	{ WAVE_SINE, SPA_CPU_FLAG_SSE2, render_sine_sse2 },
+#endif
+	{ WAVE_SINE, 0, render_sine_c },
+	{ WAVE_SQUARE, 0, render_square_c },
+#if defined (HAVE_SSE2)
+	{ WAVE_NOISE, SPA_CPU_FLAG_SSE2, render_noise_sse2 },
+#endif
+	{ WAVE_NOISE, 0, render_noise_c },
+};
+
+#define MAKE_PACK(name,type,conv)						\
+static void pack_##name(void * SPA_RESTRICT dst, const float * SPA_RESTRICT src,\
+		uint32_t n_channels, uint32_t n_samples)			\
+{										\
+	type *d = dst;								\
+	uint32_t n, c;								\
+	for (n = 0; n < n_samples; n++) {					\
+		type v = conv(src[n]);						\
+		for (c = 0; c < n_channels; c++)				\
+			*d++ = v;						\
+	}									\
+}
+
+#define F32_TO_S16(v)	(int16_t)(SPA_CLAMP(v, -1.0f, 1.0f) * 32767.0f)
+#define F32_TO_S32(v)	(int32_t)(SPA_CLAMP(v, -1.0f, 1.0f) * 2147483647.0)
+#define F32_TO_F32(v)	(v)
+#define F32_TO_F64(v)	(double)(v)
+
+MAKE_PACK(s16, int16_t, F32_TO_S16);
+MAKE_PACK(s32, int32_t, F32_TO_S32);
+MAKE_PACK(f32, float, F32_TO_F32);
+MAKE_PACK(f64, double, F32_TO_F64);
+
+struct pack_info {
+	uint32_t fmt;
+	uint32_t size;
+	pack_func_t pack;
+};
+
+static const struct pack_info pack_table[] =
+{
+	{ SPA_AUDIO_FORMAT_S16, 2, pack_s16 },
+	{ SPA_AUDIO_FORMAT_S32, 4, pack_s32 },
+	{ SPA_AUDIO_FORMAT_F32, 4, pack_f32 },
+	{ SPA_AUDIO_FORMAT_F64, 8, pack_f64 },
+};
+
+#define MATCH_CPU_FLAGS(a,b)	((a) == 0 || ((a) & (b)) == a)
+
+static const struct gen_info *find_gen_info(uint32_t wave, uint32_t cpu_flags)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(gen_table, t) {
+		if (t->wave == wave &&
+		    MATCH_CPU_FLAGS(t->cpu_flags, cpu_flags))
+			return t;
+	}
+	return NULL;
+}
+
+static const struct pack_info *find_pack_info(uint32_t fmt)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(pack_table, t) {
+		if (t->fmt == fmt)
+			return t;
+	}
+	return NULL;
+}
+
+void render_osc_init(struct render_osc *osc)
+{
+	uint32_t k;
+
+	spa_zero(*osc);
+	for (k = 0; k < RENDER_LANES; k++)
+		osc->seed[k] = 0x9e3779b9u * (k + 1);
+}
+
+void render_osc_update(struct render_osc *osc, uint32_t rate, float freq, float volume)
+{
+	osc->step = fmodf(M_PI_M2f * freq / rate, M_PI_M2f);
+	osc->amp = volume;
+}
+
+static void impl_render_ops_process(struct render_ops *ops, struct render_osc *osc,
+		void * SPA_RESTRICT dst, uint32_t n_samples)
+{
+	const struct pack_info *pack = ops->priv;
+	float tmp[RENDER_BLOCK] SPA_ALIGNED(16);
+	uint32_t n, chunk;
+
+	for (n = 0; n < n_samples; n += chunk) {
+		chunk = SPA_MIN(n_samples - n, RENDER_BLOCK);
+		if (pack->fmt == SPA_AUDIO_FORMAT_F32 && ops->n_channels == 1) {
+			ops->generate(osc, dst, chunk);
+		} else {
+			ops->generate(osc, tmp, chunk);
+			pack->pack(dst, tmp, ops->n_channels, chunk);
+		}
+		dst = SPA_PTROFF(dst, chunk * ops->n_channels * pack->size, void);
+	}
+}
+
+static void impl_render_ops_free(struct render_ops *ops)
+{
+	spa_zero(*ops);
+}
+
+int render_ops_init(struct render_ops *ops)
+{
+	const struct gen_info *gen;
+	const struct pack_info *pack;
+
+	if ((gen = find_gen_info(ops->wave, ops->cpu_flags)) == NULL)
+		return -ENOTSUP;
+	if ((pack = find_pack_info(ops->fmt)) == NULL)
+		return -ENOTSUP;
+
+	ops->priv = pack;
+	ops->cpu_flags = gen->cpu_flags;
+	ops->generate = gen->generate;
+	ops->process = impl_render_ops_process;
+	ops->free = impl_render_ops_free;
+
+	return 0;
+}
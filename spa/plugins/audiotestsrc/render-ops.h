@@ -0,0 +1,70 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+enum wave_type {
+	WAVE_SINE,
+	WAVE_SQUARE,
+	WAVE_NOISE,
+};
+
+#define RENDER_LANES	4u
+#define RENDER_BLOCK	256u
+
+#define M_PI_M2f	((float)(M_PI + M_PI))
+
+/* oscillator state, kept between buffers */
+struct render_osc {
+	float phase;			/* [0, 2π) */
+	float step;			/* phase increment per sample */
+	float amp;
+	uint32_t seed[RENDER_LANES];	/* xorshift32 state, one per lane */
+};
+
+void render_osc_init(struct render_osc *osc);
+void render_osc_update(struct render_osc *osc, uint32_t rate, float freq, float volume);
+
+static inline void render_osc_advance(struct render_osc *osc, uint32_t n_samples)
+{
+	osc->phase = fmodf(osc->phase + n_samples * osc->step, M_PI_M2f);
+}
+
+struct render_ops {
+	uint32_t fmt;
+	uint32_t n_channels;
+	uint32_t cpu_flags;
+	uint32_t wave;
+
+	void (*generate) (struct render_osc *osc, float * SPA_RESTRICT dst,
+			uint32_t n_samples);
+	void (*process) (struct render_ops *ops, struct render_osc *osc,
+			void * SPA_RESTRICT dst, uint32_t n_samples);
+	void (*free) (struct render_ops *ops);
+
+	const void *priv;
+};
+
+int render_ops_init(struct render_ops *ops);
+
+#define render_ops_process(ops,...)	(ops)->process(ops, __VA_ARGS__)
+#define render_ops_free(ops)		(ops)->free(ops)
+
+/* renders \a n_samples mono float samples and advances \a osc. The sine
+ * is made by rotating a phasor per lane, which drifts slowly, so
+ * \a n_samples should not be much more than RENDER_BLOCK. */
+#define DEFINE_FUNCTION(name,arch) \
+void render_##name##_##arch(struct render_osc *osc, float * SPA_RESTRICT dst,	\
+		uint32_t n_samples)
+
+DEFINE_FUNCTION(sine, c);
+DEFINE_FUNCTION(square, c);
+DEFINE_FUNCTION(noise, c);
+
+#if defined(HAVE_SSE2)
+DEFINE_FUNCTION(sine, sse2);
+DEFINE_FUNCTION(noise, sse2);
+#endif
@@ -0,0 +1,166 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#include <spa/support/cpu.h>
+#include <spa/param/audio/raw.h>
+
+#include "render-ops.h"
+
+#define N_SAMPLES	4099
+#define RATE		48000
+#define FREQ		440.0f
+/* odd sizes, so the tails and the phase are carried over */
+#define ODD_BLOCK	(RENDER_BLOCK - 3)
+
+typedef void (*gen_func_t) (struct render_osc *osc, float * SPA_RESTRICT dst,
+		uint32_t n_samples);
+
+static float samp_out[N_SAMPLES];
+static float samp_ref[N_SAMPLES];
+
+static void compare_float(const float *m1, const float *m2, uint32_t n, float tolerance)
+{
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		if (fabsf(m1[i] - m2[i]) > tolerance) {
+			fprintf(stderr, "%d: %f != %f\n", i, m1[i], m2[i]);
+			spa_assert_se(false);
+		}
+	}
+}
+
+static void render(gen_func_t func, float *dst, uint32_t n_samples, float volume,
+		uint32_t block)
+{
+	struct render_osc osc;
+	uint32_t n, chunk;
+
+	render_osc_init(&osc);
+	render_osc_update(&osc, RATE, FREQ, volume);
+
+	for (n = 0; n < n_samples; n += chunk) {
+		chunk = SPA_MIN(n_samples - n, block);
+		func(&osc, &dst[n], chunk);
+	}
+}
+
+static void test_sine(void)
+{
+	double step = 2.0 * M_PI * FREQ / RATE;
+	uint32_t i;
+
+	fprintf(stderr, "test_sine\n");
+
+	for (i = 0; i < N_SAMPLES; i++)
+		samp_ref[i] = 0.5 * sin(i * step);
+
+	render(render_sine_c, samp_out, N_SAMPLES, 0.5f, ODD_BLOCK);
+	compare_float(samp_out, samp_ref, N_SAMPLES, 1e-4f);
+#if defined(HAVE_SSE2)
+	render(render_sine_sse2, samp_out, N_SAMPLES, 0.5f, ODD_BLOCK);
+	compare_float(samp_out, samp_ref, N_SAMPLES, 1e-4f);
+#endif
+}
+
+static void test_square(void)
+{
+	uint32_t i, n_pos = 0;
+
+	fprintf(stderr, "test_square\n");
+
+	render(render_square_c, samp_out, N_SAMPLES, 0.25f, ODD_BLOCK);
+	for (i = 0; i < N_SAMPLES; i++) {
+		spa_assert_se(samp_out[i] == 0.25f || samp_out[i] == -0.25f);
+		n_pos += samp_out[i] > 0.0f;
+	}
+	spa_assert_se(abs((int)n_pos - N_SAMPLES / 2) < RATE / FREQ);
+}
+
+static void test_noise(void)
+{
+	double sum = 0.0, sum2 = 0.0;
+	uint32_t i;
+
+	fprintf(stderr, "test_noise\n");
+
+	render(render_noise_c, samp_ref, N_SAMPLES, 1.0f, ODD_BLOCK);
+	for (i = 0; i < N_SAMPLES; i++) {
+		spa_assert_se(samp_ref[i] >= -1.0f && samp_ref[i] <= 1.0f);
+		sum += samp_ref[i];
+		sum2 += samp_ref[i] * samp_ref[i];
+	}
+	/* uniform in [-1, 1], mean 0 and variance 1/3 */
+	spa_assert_se(fabs(sum / N_SAMPLES) < 0.05);
+	spa_assert_se(fabs(sum2 / N_SAMPLES - 1.0 / 3.0) < 0.05);
+
+#if defined(HAVE_SSE2)
+	render(render_noise_sse2, samp_out, N_SAMPLES, 1.0f, ODD_BLOCK);
+	spa_assert_se(memcmp(samp_out, samp_ref, sizeof(samp_ref)) == 0);
+#endif
+}
+
+static void test_pack(void)
+{
+	struct render_ops ops;
+	struct render_osc osc;
+	int16_t s16[N_SAMPLES * 2];
+	double f64[N_SAMPLES];
+	uint32_t i;
+
+	fprintf(stderr, "test_pack\n");
+
+	render(render_sine_c, samp_ref, N_SAMPLES, 2.0f, RENDER_BLOCK);
+
+	spa_zero(ops);
+	ops.fmt = SPA_AUDIO_FORMAT_S16;
+	ops.n_channels = 2;
+	ops.wave = WAVE_SINE;
+	spa_assert_se(render_ops_init(&ops) == 0);
+
+	render_osc_init(&osc);
+	render_osc_update(&osc, RATE, FREQ, 2.0f);
+	render_ops_process(&ops, &osc, s16, N_SAMPLES);
+	for (i = 0; i < N_SAMPLES; i++) {
+		int16_t v = (int16_t)(SPA_CLAMPF(samp_ref[i], -1.0f, 1.0f) * 32767.0f);
+		spa_assert_se(abs(s16[2 * i] - v) <= 4);
+		spa_assert_se(s16[2 * i] == s16[2 * i + 1]);
+	}
+	render_ops_free(&ops);
+
+	ops.fmt = SPA_AUDIO_FORMAT_F64;
+	ops.n_channels = 1;
+	ops.wave = WAVE_NOISE;
+	spa_assert_se(render_ops_init(&ops) == 0);
+
+	render(render_noise_c, samp_ref, N_SAMPLES, 1.0f, RENDER_BLOCK);
+	render_osc_init(&osc);
+	render_osc_update(&osc, RATE, FREQ, 1.0f);
+	render_ops_process(&ops, &osc, f64, N_SAMPLES);
+	for (i = 0; i < N_SAMPLES; i++)
+		spa_assert_se(f64[i] == samp_ref[i]);
+	render_ops_free(&ops);
+
+	ops.fmt = SPA_AUDIO_FORMAT_S24;
+	ops.wave = WAVE_SINE;
+	spa_assert_se(render_ops_init(&ops) == -ENOTSUP);
+}
+
+int main(int argc, char *argv[])
+{
+	test_sine();
+	test_square();
+	test_noise();
+	test_pack();
+
+	return 0;
+}
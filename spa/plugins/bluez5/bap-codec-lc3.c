@@ -802,6 +802,31 @@ static int codec_start_encode (void *data,
 	return 0;
 }
 
+static int codec_get_parts(void *data)
+{
+	struct impl *this = data;
+	return this->channels;
+}
+
+static int codec_encode_part(void *data, uint32_t part,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size)
+{
+	struct impl *this = data;
+	const uint8_t *in = (const uint8_t *)src + (part * 4);
+	uint8_t *out = (uint8_t *)dst + part * this->framelen;
+
+	if (part >= (uint32_t)this->channels || src_size < this->codesize ||
+	    dst_size < (part + 1) * (size_t)this->framelen)
+		return -EINVAL;
+
+	if (SPA_UNLIKELY(lc3_encode(this->enc[part], LC3_PCM_FORMAT_S24, in,
+				this->channels, this->framelen, out) != 0))
+		return -EINVAL;
+
+	return this->framelen;
+}
+
 static int codec_encode(void *data,
 		const void *src, size_t src_size,
 		void *dst, size_t dst_size,
@@ -822,12 +847,9 @@ static int codec_encode(void *data,
 		goto done;
 
 	for (ich = 0; ich < this->channels; ich++) {
-		uint8_t *in = (uint8_t *)src + (ich * 4);
-		uint8_t *out = (uint8_t *)dst + ich * this->framelen;
-		res = lc3_encode(this->enc[ich], LC3_PCM_FORMAT_S24, in, this->channels, this->framelen, out);
-		size += this->framelen;
-		if (SPA_UNLIKELY(res != 0))
-			return -EINVAL;
+		if (SPA_UNLIKELY((res = codec_encode_part(this, ich, src, src_size, dst, dst_size)) < 0))
+			return res;
+		size += res;
 	}
 	*dst_out = size;
 
@@ -846,6 +868,25 @@ static SPA_UNUSED int codec_start_decode (void *data,
 	return 0;
 }
 
+static int codec_decode_part(void *data, uint32_t part,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size)
+{
+	struct impl *this = data;
+	const uint8_t *in = (const uint8_t *)src + part * this->framelen;
+	uint8_t *out = (uint8_t *)dst + (part * 4);
+
+	if (part >= (uint32_t)this->channels || dst_size < this->codesize ||
+	    src_size < (part + 1) * (size_t)this->framelen)
+		return -EINVAL;
+
+	if (SPA_UNLIKELY(lc3_decode(this->dec[part], in, this->framelen,
+				LC3_PCM_FORMAT_S24, out, this->channels) < 0))
+		return -EINVAL;
+
+	return this->framelen;
+}
+
 static SPA_UNUSED int codec_decode(void *data,
 		const void *src, size_t src_size,
 		void *dst, size_t dst_size,
@@ -866,12 +907,9 @@ static SPA_UNUSED int codec_decode(void *data,
 		return -EINVAL;
 
 	for (ich = 0; ich < this->channels; ich++) {
-		uint8_t *in = (uint8_t *)src + ich * this->framelen;
-		uint8_t *out = (uint8_t *)dst + (ich * 4);
-		res = lc3_decode(this->dec[ich], in, this->framelen, LC3_PCM_FORMAT_S24, out, this->channels);
-		if (SPA_UNLIKELY(res < 0))
-			return -EINVAL;
-		consumed += this->framelen;
+		if (SPA_UNLIKELY((res = codec_decode_part(this, ich, src, src_size, dst, dst_size)) < 0))
+			return res;
+		consumed += res;
 	}
 
 	*dst_out = this->codesize;
@@ -909,6 +947,9 @@ const struct media_codec bap_codec_lc3 = {
 	.encode = codec_encode,
 	.start_decode = codec_start_decode,
 	.decode = codec_decode,
+	.get_parts = codec_get_parts,
+	.encode_part = codec_encode_part,
+	.decode_part = codec_decode_part,
 	.reduce_bitpool = codec_reduce_bitpool,
 	.increase_bitpool = codec_increase_bitpool
 };
@@ -0,0 +1,1347 @@
+/* Spa Bluetooth media codec benchmark */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <getopt.h>
+#include <sys/socket.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/support/plugin-loader.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/audio/type-info.h>
+#include <spa/debug/types.h>
+#include <spa/pod/iter.h>
+#include <spa/utils/string.h>
+#include <spa/utils/result.h>
+
+#include "codec-loader.h"
+#include "encode-worker.h"
+#include "codec-pool.h"
+
+SPA_LOG_IMPL(logger);
+
+#define MEDIA_CODEC_LIB_SUFFIX	".so"
+
+#define DEFAULT_DURATION	5.0
+#define DEFAULT_MTU		679
+#define DEFAULT_SIGNAL		"multitone"
+#define DEFAULT_QUANTUM		1024
+#define DEFAULT_LOOKAHEAD	2
+
+#define MAX_CHANNELS		8
+#define MAX_CONFIGS		16
+#define MAX_DELAY		8192u
+#define CORR_WINDOW		4096u
+#define SEGMENT_SIZE		1024
+#define FILL_FRAMES		4
+#define PACKET_SIZE		(8192*8)
+#define PCM_SIZE		(8192*8)
+
+#define CHECK_MIN_SNR		6.0
+
+#define GROUP_MAX_STREAMS	16
+#define GROUP_MAX_TASKS		64
+
+struct loader {
+	struct spa_plugin_loader loader;
+	const char *plugin_dir;
+};
+
+struct handle {
+	void *hnd;
+	struct spa_handle handle SPA_ALIGNED(8);
+};
+
+struct data {
+	bool verbose;
+	bool check;
+	bool data_loop;
+	bool group;
+	double duration;
+	uint32_t mtu;
+	uint32_t link_kbps;
+	const char *signal;
+	const char *codec_name;
+
+	const char *iname;
+	float *file_samples;
+	uint32_t file_frames;
+	uint32_t file_rate;
+	uint32_t file_channels;
+
+	struct loader loader;
+	const struct media_codec * const *codecs;
+	struct spa_handle *system_handle;
+	struct spa_system *system;
+
+	uint32_t n_failed;
+};
+
+struct result {
+	const struct media_codec *codec;
+	struct spa_audio_info info;
+	uint32_t block_frames;
+	uint32_t n_blocks;
+	uint32_t n_packets;
+	uint32_t n_dropped;
+	uint64_t n_bytes;
+	uint64_t enc_ns;
+	uint64_t enc_max_ns;
+	uint64_t dec_ns;
+	uint32_t delay;
+	double snr;
+	double segsnr;
+	double kbps;
+	int n_reduce;
+	int n_increase;
+	bool decoded;
+};
+
+struct loop_stats {
+	uint32_t n_cycles;
+	uint32_t n_packets;
+	uint32_t n_late;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+#define OPTIONS		"hvClgd:m:b:s:c:i:"
+static const struct option long_options[] = {
+	{ "help",	no_argument,		NULL, 'h'},
+	{ "verbose",	no_argument,		NULL, 'v'},
+	{ "check",	no_argument,		NULL, 'C'},
+	{ "data-loop",	no_argument,		NULL, 'l'},
+	{ "group",	no_argument,		NULL, 'g'},
+
+	{ "duration",	required_argument,	NULL, 'd' },
+	{ "mtu",	required_argument,	NULL, 'm' },
+	{ "bitrate",	required_argument,	NULL, 'b' },
+	{ "signal",	required_argument,	NULL, 's' },
+	{ "codec",	required_argument,	NULL, 'c' },
+	{ "input",	required_argument,	NULL, 'i' },
+
+        { NULL, 0, NULL, 0 }
+};
+
+static void show_usage(const char *name, bool is_error)
+{
+	FILE *fp;
+
+	fp = is_error ? stderr : stdout;
+
+	fprintf(fp, "%s [options]\n", name);
+	fprintf(fp,
+		"  -h, --help                            Show this help\n"
+		"  -v  --verbose                         Be verbose\n"
+		"  -C  --check                           Fail on codec errors or bad round-trip quality\n"
+		"  -l  --data-loop                       Measure data loop time per %u frame cycle, with\n"
+		"                                        and without encode worker, on a socketpair\n"
+		"  -g  --group                           Measure encode/decode of an ISO group of streams\n"
+		"                                        with 2, 8 and 16 channels in total, serial and\n"
+		"                                        split over the codec pool\n"
+		"\n", DEFAULT_QUANTUM);
+	fprintf(fp,
+		"  -d  --duration                        Seconds of audio per config (default %.1f)\n"
+		"  -m  --mtu                             Transport MTU (default %u)\n"
+		"  -b  --bitrate                         Simulated link throughput in kbps for ABR (default 0, off)\n"
+		"  -s  --signal                          Synthetic signal (sine|multitone|noise) (default %s)\n"
+		"  -c  --codec                           Only run codecs with this name\n"
+		"  -i  --input                           Use a 16-bit PCM or 32-bit float WAV file as input\n"
+		"\n",
+		DEFAULT_DURATION, DEFAULT_MTU, DEFAULT_SIGNAL);
+}
+
+static struct spa_handle *loader_load(void *object, const char *factory_name, const struct spa_dict *info)
+{
+	struct loader *l = object;
+	spa_handle_factory_enum_func_t enum_func;
+	const struct spa_handle_factory *factory;
+	struct handle *handle;
+	const char *lib;
+	char path[PATH_MAX];
+	uint32_t i;
+	void *hnd;
+	int res;
+
+	if (info == NULL || (lib = spa_dict_lookup(info, SPA_KEY_LIBRARY_NAME)) == NULL)
+		return NULL;
+
+	spa_scnprintf(path, sizeof(path), "%s/%s" MEDIA_CODEC_LIB_SUFFIX, l->plugin_dir, lib);
+
+	if ((hnd = dlopen(path, RTLD_NOW)) == NULL) {
+		spa_log_debug(&logger.log, "can't load %s: %s", path, dlerror());
+		return NULL;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL)
+		goto error_close;
+
+	for (i = 0;;) {
+		if ((res = enum_func(&factory, &i)) <= 0)
+			goto error_close;
+		if (spa_streq(factory->name, factory_name))
+			break;
+	}
+
+	if ((handle = calloc(1, sizeof(struct handle) + spa_handle_factory_get_size(factory, NULL))) == NULL)
+		goto error_close;
+
+	if ((res = spa_handle_factory_init(factory, &handle->handle, NULL, NULL, 0)) < 0) {
+		free(handle);
+		goto error_close;
+	}
+	handle->hnd = hnd;
+	return &handle->handle;
+
+error_close:
+	dlclose(hnd);
+	return NULL;
+}
+
+static int loader_unload(void *object, struct spa_handle *handle)
+{
+	struct handle *h = SPA_CONTAINER_OF(handle, struct handle, handle);
+	void *hnd = h->hnd;
+
+	spa_handle_clear(handle);
+	free(h);
+	dlclose(hnd);
+	return 0;
+}
+
+static const struct spa_plugin_loader_methods loader_methods = {
+	SPA_VERSION_PLUGIN_LOADER_METHODS,
+	.load = loader_load,
+	.unload = loader_unload,
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static uint32_t sample_size(uint32_t format)
+{
+	switch (format) {
+	case SPA_AUDIO_FORMAT_S16:
+		return 2;
+	case SPA_AUDIO_FORMAT_S24:
+		return 3;
+	case SPA_AUDIO_FORMAT_S24_32:
+	case SPA_AUDIO_FORMAT_S32:
+	case SPA_AUDIO_FORMAT_F32:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static void write_samples(uint32_t format, void *dst, const float *src, uint32_t n_samples)
+{
+	uint8_t *d = dst;
+	uint32_t i;
+
+	for (i = 0; i < n_samples; i++) {
+		float v = SPA_CLAMPF(src[i], -1.0f, 1.0f);
+
+		switch (format) {
+		case SPA_AUDIO_FORMAT_S16:
+			((int16_t*)d)[i] = (int16_t)lrintf(v * 32767.0f);
+			break;
+		case SPA_AUDIO_FORMAT_S24:
+		{
+			int32_t s = lrintf(v * 8388607.0f);
+			d[i*3+0] = s;
+			d[i*3+1] = s >> 8;
+			d[i*3+2] = s >> 16;
+			break;
+		}
+		case SPA_AUDIO_FORMAT_S24_32:
+			((int32_t*)d)[i] = lrintf(v * 8388607.0f);
+			break;
+		case SPA_AUDIO_FORMAT_S32:
+			((int32_t*)d)[i] = (int32_t)lrint(v * 2147483647.0);
+			break;
+		case SPA_AUDIO_FORMAT_F32:
+			((float*)d)[i] = v;
+			break;
+		}
+	}
+}
+
+static void read_samples(uint32_t format, float *dst, const void *src, uint32_t n_samples)
+{
+	const uint8_t *s = src;
+	uint32_t i;
+
+	for (i = 0; i < n_samples; i++) {
+		switch (format) {
+		case SPA_AUDIO_FORMAT_S16:
+			dst[i] = ((const int16_t*)s)[i] / 32768.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S24:
+		{
+			int32_t v = (int32_t)(((uint32_t)s[i*3+2] << 24) |
+					((uint32_t)s[i*3+1] << 16) |
+					((uint32_t)s[i*3+0] << 8)) >> 8;
+			dst[i] = v / 8388608.0f;
+			break;
+		}
+		case SPA_AUDIO_FORMAT_S24_32:
+			dst[i] = ((const int32_t*)s)[i] / 8388608.0f;
+			break;
+		case SPA_AUDIO_FORMAT_S32:
+			dst[i] = ((const int32_t*)s)[i] / 2147483648.0f;
+			break;
+		case SPA_AUDIO_FORMAT_F32:
+			dst[i] = ((const float*)s)[i];
+			break;
+		}
+	}
+}
+
+static int read_wav(struct data *d)
+{
+	FILE *f;
+	uint8_t hdr[12], chunk[8], fmt[16];
+	uint16_t tag = 0, bits = 0;
+	uint32_t size, i, n_samples;
+	bool have_fmt = false;
+	void *raw = NULL;
+	int res = -EINVAL;
+
+	if ((f = fopen(d->iname, "r")) == NULL)
+		return -errno;
+
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr, "RIFF", 4) != 0 || memcmp(hdr + 8, "WAVE", 4) != 0)
+		goto done;
+
+	while (fread(chunk, sizeof(chunk), 1, f) == 1) {
+		size = chunk[4] | (chunk[5] << 8) | (chunk[6] << 16) | ((uint32_t)chunk[7] << 24);
+
+		if (memcmp(chunk, "fmt ", 4) == 0 && size >= sizeof(fmt)) {
+			if (fread(fmt, sizeof(fmt), 1, f) != 1)
+				goto done;
+			tag = fmt[0] | (fmt[1] << 8);
+			d->file_channels = fmt[2] | (fmt[3] << 8);
+			d->file_rate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24);
+			bits = fmt[14] | (fmt[15] << 8);
+			fseek(f, size - sizeof(fmt) + (size & 1), SEEK_CUR);
+			have_fmt = true;
+		} else if (memcmp(chunk, "data", 4) == 0 && have_fmt) {
+			if (d->file_channels == 0 || d->file_channels > MAX_CHANNELS)
+				goto done;
+			if (!((tag == 1 && bits == 16) || (tag == 3 && bits == 32))) {
+				res = -ENOTSUP;
+				goto done;
+			}
+			if ((raw = malloc(size)) == NULL) {
+				res = -errno;
+				goto done;
+			}
+			size = fread(raw, 1, size, f);
+			n_samples = size / (bits / 8);
+			d->file_frames = n_samples / d->file_channels;
+			if ((d->file_samples = calloc(n_samples, sizeof(float))) == NULL) {
+				res = -errno;
+				goto done;
+			}
+			for (i = 0; i < n_samples; i++)
+				d->file_samples[i] = bits == 16 ?
+					((int16_t*)raw)[i] / 32768.0f : ((float*)raw)[i];
+			res = 0;
+			goto done;
+		} else {
+			fseek(f, size + (size & 1), SEEK_CUR);
+		}
+	}
+done:
+	free(raw);
+	fclose(f);
+	return res;
+}
+
+static int make_signal(struct data *d, float *samples, uint32_t n_frames,
+		uint32_t rate, uint32_t channels)
+{
+	static const float tones[] = { 100.0f, 440.0f, 1000.0f, 3150.0f, 8000.0f };
+	uint32_t i, c, k;
+	uint32_t seed = 0x12345678;
+
+	if (d->file_samples) {
+		for (i = 0; i < n_frames; i++) {
+			uint32_t src = (uint64_t)i * d->file_rate / rate % d->file_frames;
+			for (c = 0; c < channels; c++)
+				samples[i * channels + c] =
+					d->file_samples[src * d->file_channels + c % d->file_channels];
+		}
+		return 0;
+	}
+
+	for (i = 0; i < n_frames; i++) {
+		for (c = 0; c < channels; c++) {
+			double t = (double)i / rate, v = 0.0;
+
+			if (spa_streq(d->signal, "sine")) {
+				v = 0.5 * sin(2 * M_PI * 1000.0 * t + c);
+			} else if (spa_streq(d->signal, "multitone")) {
+				for (k = 0; k < SPA_N_ELEMENTS(tones); k++)
+					if (tones[k] < rate / 2)
+						v += 0.15 * sin(2 * M_PI * tones[k] * t + c + k);
+			} else if (spa_streq(d->signal, "noise")) {
+				seed = seed * 1103515245 + 12345;
+				v = 0.25 * ((double)(seed >> 8) / (1 << 24) * 2.0 - 1.0);
+			} else {
+				return -EINVAL;
+			}
+			samples[i * channels + c] = v;
+		}
+	}
+	return 0;
+}
+
+static uint32_t find_delay(const float *ref, const float *out, uint32_t n_frames,
+		uint32_t channels)
+{
+	uint32_t lag, i, best = 0, window;
+	double best_corr = -INFINITY;
+
+	if (n_frames <= MAX_DELAY)
+		return 0;
+
+	window = SPA_MIN(CORR_WINDOW, n_frames - MAX_DELAY);
+
+	for (lag = 0; lag < MAX_DELAY; lag++) {
+		double corr = 0.0;
+		for (i = 0; i < window; i++)
+			corr += ref[i * channels] * out[(i + lag) * channels];
+		if (corr > best_corr) {
+			best_corr = corr;
+			best = lag;
+		}
+	}
+	return best;
+}
+
+static void measure_quality(struct result *r, const float *ref, const float *out,
+		uint32_t n_frames, uint32_t channels)
+{
+	uint32_t i, n, seg, n_seg = 0;
+	double sig = 0.0, err = 0.0, segsum = 0.0;
+
+	r->delay = find_delay(ref, out, n_frames, channels);
+	n = (n_frames - r->delay) * channels;
+
+	for (seg = 0; seg + SEGMENT_SIZE * channels <= n; seg += SEGMENT_SIZE * channels) {
+		double s = 0.0, e = 0.0;
+
+		for (i = seg; i < seg + SEGMENT_SIZE * channels; i++) {
+			double diff = out[i + r->delay * channels] - ref[i];
+			s += ref[i] * ref[i];
+			e += diff * diff;
+		}
+		sig += s;
+		err += e;
+		if (s > 0.0) {
+			segsum += SPA_CLAMP(10.0 * log10(s / SPA_MAX(e, 1e-20)), -10.0, 60.0);
+			n_seg++;
+		}
+	}
+	r->snr = 10.0 * log10(sig / SPA_MAX(err, 1e-20));
+	r->segsnr = n_seg > 0 ? segsum / n_seg : 0.0;
+}
+
+static int get_config_info(const struct media_codec *codec, const uint8_t *config,
+		size_t config_size, struct spa_audio_info *info)
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param = NULL;
+	int res;
+
+	if ((res = codec->enum_config(codec, 0, config, config_size,
+					SPA_PARAM_EnumFormat, 0, &b, &param)) != 1)
+		return res < 0 ? res : -ENOENT;
+
+	spa_pod_fixate(param);
+
+	spa_zero(*info);
+	if ((res = spa_format_parse(param, &info->media_type, &info->media_subtype)) < 0)
+		return res;
+	if (info->media_type != SPA_MEDIA_TYPE_audio ||
+	    info->media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		return -ENOTSUP;
+
+	return spa_format_audio_raw_parse(param, &info->info.raw);
+}
+
+static size_t get_mtu(struct data *d, const struct media_codec *codec,
+		const uint8_t *config, size_t config_size)
+{
+	struct bap_endpoint_qos endpoint_qos;
+	struct bap_codec_qos qos;
+
+	if (codec->bap && codec->get_qos) {
+		spa_zero(endpoint_qos);
+		if (codec->get_qos(codec, config, config_size, &endpoint_qos, &qos) == 0)
+			return qos.sdu;
+	}
+	return d->mtu;
+}
+
+static int decode_packet(const struct media_codec *codec, void *dec,
+		const uint8_t *src, size_t src_size, uint8_t *dst, size_t dst_size)
+{
+	int processed;
+	size_t written, avail = dst_size;
+
+	if ((processed = codec->start_decode(dec, src, src_size, NULL, NULL)) < 0)
+		return processed;
+
+	src += processed;
+	src_size -= processed;
+
+	while (src_size > 0) {
+		if ((processed = codec->decode(dec, src, src_size, dst, avail, &written)) <= 0)
+			return processed;
+		if (written > avail)
+			return -ENOSPC;
+		src_size -= processed;
+		src += processed;
+		avail -= written;
+		dst += written;
+	}
+	return dst_size - avail;
+}
+
+/*
+ * Simulate the socket buffer of the transport being drained at link_kbps,
+ * and drive the codec ABR like media-sink does with TIOCOUTQ and EAGAIN.
+ */
+struct link {
+	uint32_t capacity;
+	double queued;
+	double bytes_per_ns;
+	uint64_t now;
+	uint64_t last_error;
+};
+
+static bool link_send(struct link *l, const struct media_codec *codec, void *enc,
+		struct result *r, uint32_t size, uint64_t packet_ns)
+{
+	uint32_t unused;
+
+	l->queued = SPA_MAX(0.0, l->queued - l->bytes_per_ns * packet_ns);
+	l->now += packet_ns;
+
+	unused = l->capacity - SPA_MIN((uint32_t)l->queued, l->capacity);
+	codec->abr_process(enc, unused);
+
+	if (l->queued + size > l->capacity) {
+		if (l->now - l->last_error > SPA_NSEC_PER_SEC / 2) {
+			codec->reduce_bitpool(enc);
+			r->n_reduce++;
+			l->last_error = l->now;
+		}
+		return false;
+	}
+	l->queued += size;
+
+	if (l->now - l->last_error > SPA_NSEC_PER_SEC) {
+		if (unused == l->capacity) {
+			codec->increase_bitpool(enc);
+			r->n_increase++;
+		}
+		l->last_error = l->now;
+	}
+	return true;
+}
+
+static int run_config(struct data *d, const struct media_codec *codec,
+		uint8_t *config, size_t config_size, struct result *r)
+{
+	void *props = NULL, *enc = NULL, *dec = NULL;
+	float *ref = NULL, *out = NULL;
+	uint8_t *pcm = NULL, *packet = NULL, *dpcm = NULL;
+	uint32_t n_frames, n_samples, frame_size, block_size, pos = 0, out_frames = 0;
+	uint32_t rate, channels, timestamp = 0, packet_frames;
+	uint16_t seqnum = 0;
+	struct spa_dict empty = SPA_DICT_INIT(NULL, 0);
+	struct link link;
+	bool fragment = false;
+	size_t mtu;
+	int res;
+
+	spa_zero(*r);
+	r->codec = codec;
+
+	if ((res = get_config_info(codec, config, config_size, &r->info)) < 0)
+		return res;
+
+	rate = r->info.info.raw.rate;
+	channels = r->info.info.raw.channels;
+	if (rate == 0 || channels == 0 || channels > MAX_CHANNELS ||
+	    sample_size(r->info.info.raw.format) == 0)
+		return -ENOTSUP;
+
+	frame_size = channels * sample_size(r->info.info.raw.format);
+	n_frames = (uint32_t)(d->duration * rate);
+	n_samples = n_frames * channels;
+	mtu = get_mtu(d, codec, config, config_size);
+
+	if (codec->init_props)
+		props = codec->init_props(codec, 0, &empty);
+
+	if ((enc = codec->init(codec, 0, config, config_size, &r->info, props, mtu)) == NULL) {
+		res = errno > 0 ? -errno : -EIO;
+		goto done;
+	}
+	if (codec->decode && codec->start_decode)
+		dec = codec->init(codec, MEDIA_CODEC_FLAG_SINK, config, config_size,
+				&r->info, props, mtu);
+
+	block_size = codec->get_block_size(enc);
+	r->block_frames = block_size / frame_size;
+
+	ref = calloc(n_samples, sizeof(float));
+	out = calloc(n_samples + MAX_DELAY * channels, sizeof(float));
+	pcm = calloc(n_frames, frame_size);
+	packet = malloc(PACKET_SIZE);
+	dpcm = malloc(PCM_SIZE);
+	if (!ref || !out || !pcm || !packet || !dpcm) {
+		res = -errno;
+		goto done;
+	}
+
+	if ((res = make_signal(d, ref, n_frames, rate, channels)) < 0)
+		goto done;
+	write_samples(r->info.info.raw.format, pcm, ref, n_samples);
+
+	spa_zero(link);
+	link.capacity = codec->send_buf_size > 0 ? codec->send_buf_size : FILL_FRAMES * mtu;
+	link.bytes_per_ns = d->link_kbps > 0 ? d->link_kbps * 1000.0 / 8 / SPA_NSEC_PER_SEC : INFINITY;
+
+	while (true) {
+		size_t used, out_encoded;
+		int need_flush = 0, processed;
+		uint64_t t1, t2;
+		bool sent;
+
+		t1 = get_time_ns();
+
+		used = codec->start_encode(enc, packet, PACKET_SIZE, ++seqnum, timestamp);
+		packet_frames = 0;
+
+		if (fragment) {
+			if ((res = codec->encode(enc, NULL, 0, packet + used, PACKET_SIZE - used,
+						&out_encoded, &need_flush)) < 0)
+				goto done;
+			used += out_encoded;
+			fragment = false;
+		}
+		while (!need_flush && pos + r->block_frames <= n_frames) {
+			processed = codec->encode(enc, pcm + pos * frame_size, block_size,
+					packet + used, PACKET_SIZE - used,
+					&out_encoded, &need_flush);
+			if (processed < 0) {
+				res = processed;
+				goto done;
+			}
+			if (processed == 0 && !need_flush)
+				break;
+			pos += processed / frame_size;
+			packet_frames += processed / frame_size;
+			r->n_blocks += processed / block_size;
+			used += out_encoded;
+		}
+
+		t2 = get_time_ns();
+		r->enc_ns += t2 - t1;
+		r->enc_max_ns = SPA_MAX(r->enc_max_ns, t2 - t1);
+
+		if (!need_flush)
+			break;
+
+		timestamp += packet_frames;
+		r->n_packets++;
+
+		sent = link_send(&link, codec, enc, r, used,
+				(uint64_t)packet_frames * SPA_NSEC_PER_SEC / rate);
+		if (!sent) {
+			r->n_dropped++;
+		} else {
+			r->n_bytes += used;
+			if (dec) {
+				t1 = get_time_ns();
+				res = decode_packet(codec, dec, packet, used, dpcm, PCM_SIZE);
+				r->dec_ns += get_time_ns() - t1;
+				if (res < 0)
+					goto done;
+				res = SPA_MIN((uint32_t)res / frame_size, n_frames + MAX_DELAY - out_frames);
+				read_samples(r->info.info.raw.format, out + out_frames * channels,
+						dpcm, res * channels);
+				out_frames += res;
+			}
+		}
+		if (need_flush == NEED_FLUSH_FRAGMENT)
+			fragment = true;
+	}
+
+	r->kbps = pos > 0 ? (r->n_bytes * 8.0) * rate / pos / 1000.0 : 0.0;
+
+	if (dec && r->n_dropped == 0 && out_frames > 0) {
+		measure_quality(r, ref, out, SPA_MIN(out_frames, n_frames), channels);
+		r->decoded = true;
+	}
+	res = 0;
+
+done:
+	if (dec)
+		codec->deinit(dec);
+	if (enc)
+		codec->deinit(enc);
+	if (props && codec->clear_props)
+		codec->clear_props(props);
+	free(ref);
+	free(out);
+	free(pcm);
+	free(packet);
+	free(dpcm);
+	return res;
+}
+
+struct sync_encoder {
+	uint8_t packet[PACKET_SIZE];
+	size_t used;
+	int need_flush;
+	bool in_packet;
+	bool fragment;
+	uint16_t seqnum;
+	uint32_t timestamp;
+};
+
+/*
+ * Encode whole blocks from pcm[*pos] up to avail frames the way media-sink
+ * does it on the data loop, sending packets to fd as they complete.
+ */
+static int sync_encode(const struct media_codec *codec, void *enc, struct sync_encoder *e,
+		const uint8_t *pcm, uint32_t *pos, uint32_t avail, uint32_t frame_size,
+		uint32_t block_size, int fd, uint32_t *n_packets)
+{
+	uint32_t block_frames = block_size / frame_size;
+	size_t out_encoded;
+	int processed;
+
+	while (true) {
+		if (!e->in_packet) {
+			e->used = codec->start_encode(enc, e->packet, PACKET_SIZE,
+					++e->seqnum, e->timestamp);
+			e->need_flush = 0;
+			e->in_packet = true;
+			if (e->fragment) {
+				e->fragment = false;
+				if ((processed = codec->encode(enc, NULL, 0, e->packet + e->used,
+							PACKET_SIZE - e->used, &out_encoded,
+							&e->need_flush)) < 0)
+					return processed;
+				e->used += out_encoded;
+			}
+		}
+		while (!e->need_flush && *pos + block_frames <= avail) {
+			processed = codec->encode(enc, pcm + *pos * frame_size, block_size,
+					e->packet + e->used, PACKET_SIZE - e->used,
+					&out_encoded, &e->need_flush);
+			if (processed < 0)
+				return processed;
+			if (processed == 0 && !e->need_flush)
+				return -EINVAL;
+			*pos += processed / frame_size;
+			e->timestamp += processed / frame_size;
+			e->used += out_encoded;
+		}
+		if (!e->need_flush)
+			return 0;
+
+		send(fd, e->packet, e->used, MSG_DONTWAIT | MSG_NOSIGNAL);
+		(*n_packets)++;
+		e->fragment = e->need_flush == NEED_FLUSH_FRAGMENT;
+		e->in_packet = false;
+	}
+}
+
+static void drain_socket(int fd)
+{
+	uint8_t buf[PACKET_SIZE];
+
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0);
+}
+
+/*
+ * Run the sink's per-cycle work with a socketpair as transport: either
+ * encode on the "data loop" like flush_data(), or only queue PCM to the
+ * encode worker and send the packets it has ready. Cycles are paced in
+ * real time so that the worker runs concurrently like it would in the
+ * daemon.
+ */
+static int run_data_loop(struct data *d, const struct media_codec *codec,
+		uint8_t *config, size_t config_size, const struct spa_audio_info *info,
+		bool use_worker, struct loop_stats *st)
+{
+	struct spa_bt_encode_worker *w = NULL;
+	struct sync_encoder *e = NULL;
+	void *props = NULL, *enc = NULL;
+	float *ref = NULL;
+	uint8_t *pcm = NULL;
+	uint32_t rate = info->info.raw.rate, channels = info->info.raw.channels;
+	uint32_t frame_size, block_size, n_frames, pos = 0, avail = 0, queued = 0;
+	struct spa_dict empty = SPA_DICT_INIT(NULL, 0);
+	struct timespec ts;
+	uint64_t next, period;
+	int fds[2] = { -1, -1 };
+	int res;
+
+	spa_zero(*st);
+
+	frame_size = channels * sample_size(info->info.raw.format);
+	n_frames = (uint32_t)(d->duration * rate);
+	n_frames -= n_frames % DEFAULT_QUANTUM;
+	period = (uint64_t)DEFAULT_QUANTUM * SPA_NSEC_PER_SEC / rate;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+		return -errno;
+
+	if (codec->init_props)
+		props = codec->init_props(codec, 0, &empty);
+	if ((enc = codec->init(codec, 0, config, config_size, info, props,
+					get_mtu(d, codec, config, config_size))) == NULL) {
+		res = -EIO;
+		goto done;
+	}
+	block_size = codec->get_block_size(enc);
+
+	ref = calloc((size_t)n_frames * channels, sizeof(float));
+	pcm = calloc(n_frames, frame_size);
+	e = calloc(1, sizeof(*e));
+	if (ref == NULL || pcm == NULL || e == NULL) {
+		res = -errno;
+		goto done;
+	}
+	if ((res = make_signal(d, ref, n_frames, rate, channels)) < 0)
+		goto done;
+	write_samples(info->info.raw.format, pcm, ref, n_frames * channels);
+
+	if (use_worker) {
+		w = spa_bt_encode_worker_create(codec, enc, frame_size, DEFAULT_LOOKAHEAD,
+				&logger.log, d->system, NULL);
+		if (w == NULL) {
+			res = -errno;
+			goto done;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	next = SPA_TIMESPEC_TO_NSEC(&ts);
+
+	while (avail < n_frames) {
+		uint64_t t1, t2;
+
+		t1 = get_time_ns();
+		avail += DEFAULT_QUANTUM;
+
+		if (w) {
+			struct spa_bt_encode_packet *p;
+
+			queued += spa_bt_encode_worker_write(w, pcm + queued * frame_size,
+					(avail - queued) * frame_size) / frame_size;
+			while ((p = spa_bt_encode_worker_peek(w)) != NULL) {
+				send(fds[0], p->data, p->size, MSG_DONTWAIT | MSG_NOSIGNAL);
+				spa_bt_encode_worker_pop(w);
+				st->n_packets++;
+			}
+		} else {
+			if ((res = sync_encode(codec, enc, e, pcm, &pos, avail, frame_size,
+						block_size, fds[0], &st->n_packets)) < 0)
+				goto done;
+		}
+		t2 = get_time_ns();
+
+		st->n_cycles++;
+		st->total_ns += t2 - t1;
+		st->max_ns = SPA_MAX(st->max_ns, t2 - t1);
+
+		drain_socket(fds[1]);
+
+		next += period;
+		if (t2 > next) {
+			st->n_late++;
+		} else {
+			ts.tv_sec = next / SPA_NSEC_PER_SEC;
+			ts.tv_nsec = next % SPA_NSEC_PER_SEC;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+	}
+	res = 0;
+
+done:
+	if (w)
+		spa_bt_encode_worker_destroy(w);
+	if (enc)
+		codec->deinit(enc);
+	if (props && codec->clear_props)
+		codec->clear_props(props);
+	if (fds[0] >= 0)
+		close(fds[0]);
+	if (fds[1] >= 0)
+		close(fds[1]);
+	free(ref);
+	free(pcm);
+	free(e);
+	return res;
+}
+
+struct group_stream {
+	const struct media_codec *codec;
+	void *enc[2];
+	void *dec[2];
+	uint8_t packet[2][PACKET_SIZE];
+	uint8_t out[2][PCM_SIZE];
+	const uint8_t *pcm;
+	size_t header;
+	size_t size;
+};
+
+static int group_encode_part(void *data, uint32_t part)
+{
+	struct group_stream *s = data;
+	return s->codec->encode_part(s->enc[1], part, s->pcm, s->codec->get_block_size(s->enc[1]),
+			s->packet[1] + s->header, PACKET_SIZE - s->header);
+}
+
+static int group_decode_part(void *data, uint32_t part)
+{
+	struct group_stream *s = data;
+	return s->codec->decode_part(s->dec[1], part, s->packet[1] + s->header,
+			s->size - s->header, s->out[1], PCM_SIZE);
+}
+
+/*
+ * Encode and decode an ISO group of streams with the configuration, once
+ * with each stream after the other like the data thread did, and once with
+ * one task per channel on the codec pool like iso-io does now. Both use
+ * their own codec instances and must produce the same data.
+ */
+static int run_group(struct data *d, const struct media_codec *codec,
+		uint8_t *config, size_t config_size, const struct spa_audio_info *info,
+		uint32_t n_channels, struct spa_bt_codec_pool *pool)
+{
+	struct spa_bt_codec_task tasks[GROUP_MAX_TASKS];
+	struct group_stream *streams;
+	struct spa_dict empty = SPA_DICT_INIT(NULL, 0);
+	uint32_t rate = info->info.raw.rate, channels = info->info.raw.channels;
+	uint32_t n_streams = n_channels / channels, n_parts = 0, n_tasks;
+	uint32_t frame_size, block_size = 0, n_frames, n_blocks, i, j, k, pos;
+	uint64_t enc_ns[2] = { 0, 0 }, dec_ns[2] = { 0, 0 }, t;
+	void *props = NULL;
+	float *ref = NULL;
+	uint8_t *pcm = NULL;
+	size_t written;
+	size_t mtu = get_mtu(d, codec, config, config_size);
+	int res = 0;
+
+	/* Group size does not fit this configuration */
+	if (n_streams == 0 || n_streams > GROUP_MAX_STREAMS || n_channels % channels)
+		return 0;
+
+	if ((streams = calloc(n_streams, sizeof(*streams))) == NULL)
+		return -errno;
+
+	if (codec->init_props)
+		props = codec->init_props(codec, 0, &empty);
+
+	for (i = 0; i < n_streams; i++) {
+		struct group_stream *s = &streams[i];
+
+		s->codec = codec;
+		for (j = 0; j < 2; j++) {
+			s->enc[j] = codec->init(codec, 0, config, config_size, info, props, mtu);
+			s->dec[j] = codec->init(codec, MEDIA_CODEC_FLAG_SINK, config, config_size,
+					info, props, mtu);
+			if (s->enc[j] == NULL || s->dec[j] == NULL) {
+				res = -EIO;
+				goto done;
+			}
+		}
+		n_parts = codec->get_parts(s->enc[1]);
+		block_size = codec->get_block_size(s->enc[1]);
+	}
+	if (n_parts == 0 || n_streams * n_parts > GROUP_MAX_TASKS) {
+		res = -ENOTSUP;
+		goto done;
+	}
+
+	frame_size = channels * sample_size(info->info.raw.format);
+	n_frames = (uint32_t)(d->duration * rate);
+	n_blocks = n_frames / (block_size / frame_size);
+	n_frames = n_blocks * (block_size / frame_size);
+
+	ref = calloc((size_t)n_frames * channels, sizeof(float));
+	pcm = calloc(n_frames, frame_size);
+	if (ref == NULL || pcm == NULL) {
+		res = -errno;
+		goto done;
+	}
+	if ((res = make_signal(d, ref, n_frames, rate, channels)) < 0)
+		goto done;
+	write_samples(info->info.raw.format, pcm, ref, n_frames * channels);
+
+	for (k = 0, pos = 0; k < n_blocks; k++, pos += block_size) {
+		int need_flush;
+
+		/* Serial */
+		t = get_time_ns();
+		for (i = 0; i < n_streams; i++) {
+			struct group_stream *s = &streams[i];
+
+			s->pcm = pcm + pos;
+			s->header = codec->start_encode(s->enc[0], s->packet[0], PACKET_SIZE, 0, 0);
+			if ((res = codec->encode(s->enc[0], s->pcm, block_size,
+						s->packet[0] + s->header, PACKET_SIZE - s->header,
+						&written, &need_flush)) < 0)
+				goto done;
+			s->size = s->header + written;
+		}
+		enc_ns[0] += get_time_ns() - t;
+
+		t = get_time_ns();
+		for (i = 0; i < n_streams; i++) {
+			struct group_stream *s = &streams[i];
+			if ((res = decode_packet(codec, s->dec[0], s->packet[0], s->size,
+							s->out[0], PCM_SIZE)) < 0)
+				goto done;
+		}
+		dec_ns[0] += get_time_ns() - t;
+
+		/* Pool */
+		t = get_time_ns();
+		for (i = 0, n_tasks = 0; i < n_streams; i++) {
+			struct group_stream *s = &streams[i];
+
+			codec->start_encode(s->enc[1], s->packet[1], PACKET_SIZE, 0, 0);
+			for (j = 0; j < n_parts; j++)
+				tasks[n_tasks++] = (struct spa_bt_codec_task) {
+					.func = group_encode_part, .data = s, .index = j };
+		}
+		spa_bt_codec_pool_run(pool, tasks, n_tasks, 0);
+		enc_ns[1] += get_time_ns() - t;
+
+		for (i = 0; i < n_tasks; i++)
+			if ((res = tasks[i].res) < 0)
+				goto done;
+
+		t = get_time_ns();
+		for (i = 0, n_tasks = 0; i < n_streams; i++) {
+			struct group_stream *s = &streams[i];
+
+			codec->start_decode(s->dec[1], s->packet[1], s->size, NULL, NULL);
+			for (j = 0; j < n_parts; j++)
+				tasks[n_tasks++] = (struct spa_bt_codec_task) {
+					.func = group_decode_part, .data = s, .index = j };
+		}
+		spa_bt_codec_pool_run(pool, tasks, n_tasks, 0);
+		dec_ns[1] += get_time_ns() - t;
+
+		for (i = 0; i < n_tasks; i++)
+			if ((res = tasks[i].res) < 0)
+				goto done;
+
+		for (i = 0; i < n_streams; i++) {
+			struct group_stream *s = &streams[i];
+
+			if (memcmp(s->packet[0], s->packet[1], s->size) != 0 ||
+			    memcmp(s->out[0], s->out[1], block_size) != 0) {
+				fprintf(stderr, "%s: pool result differs from serial in block %u\n",
+						codec->name, k);
+				res = -EINVAL;
+				goto done;
+			}
+		}
+	}
+
+	printf("  group ch:%-2u streams:%u enc-us serial:%.2f pool:%.2f dec-us serial:%.2f pool:%.2f\n",
+			n_channels, n_streams,
+			enc_ns[0] / (double)SPA_MAX(n_blocks, 1u) / SPA_NSEC_PER_USEC,
+			enc_ns[1] / (double)SPA_MAX(n_blocks, 1u) / SPA_NSEC_PER_USEC,
+			dec_ns[0] / (double)SPA_MAX(n_blocks, 1u) / SPA_NSEC_PER_USEC,
+			dec_ns[1] / (double)SPA_MAX(n_blocks, 1u) / SPA_NSEC_PER_USEC);
+	res = 0;
+
+done:
+	for (i = 0; i < n_streams; i++) {
+		for (j = 0; j < 2; j++) {
+			if (streams[i].enc[j])
+				codec->deinit(streams[i].enc[j]);
+			if (streams[i].dec[j])
+				codec->deinit(streams[i].dec[j]);
+		}
+	}
+	if (props && codec->clear_props)
+		codec->clear_props(props);
+	free(streams);
+	free(ref);
+	free(pcm);
+	return res;
+}
+
+static void print_loop_stats(const char *mode, const struct loop_stats *st)
+{
+	printf("  data-loop %-6s cycles:%u packets:%u avg-us:%.2f max-us:%.2f late:%u\n",
+			mode, st->n_cycles, st->n_packets,
+			st->n_cycles ? st->total_ns / (double)st->n_cycles / SPA_NSEC_PER_USEC : 0.0,
+			st->max_ns / (double)SPA_NSEC_PER_USEC, st->n_late);
+}
+
+static void print_result(struct data *d, const struct result *r, const char *name)
+{
+	double blocks = SPA_MAX(r->n_blocks, 1u);
+	char snr[64];
+
+	if (r->decoded)
+		spa_scnprintf(snr, sizeof(snr), "%7.2f %7.2f %6u",
+				r->snr, r->segsnr, r->delay);
+	else
+		spa_scnprintf(snr, sizeof(snr), "%7s %7s %6s", "-", "-", "-");
+
+	printf("%-22s %6u %2u %-7s %5u %9.2f %9.2f %9.2f %8.1f %s %6u %3d %3d\n",
+			name, r->info.info.raw.rate, r->info.info.raw.channels,
+			spa_debug_type_find_short_name(spa_type_audio_format, r->info.info.raw.format),
+			r->block_frames,
+			r->enc_ns / blocks / SPA_NSEC_PER_USEC,
+			r->enc_max_ns / (double)SPA_NSEC_PER_USEC,
+			r->dec_ns / blocks / SPA_NSEC_PER_USEC,
+			r->kbps, snr, r->n_dropped, r->n_reduce, r->n_increase);
+}
+
+static int run_codec(struct data *d, const struct media_codec *codec)
+{
+	static const struct media_codec_audio_info infos[] = {
+		{ 48000, 2 }, { 44100, 2 }, { 96000, 2 }, { 48000, 1 }, { 16000, 1 },
+	};
+	uint8_t caps[A2DP_MAX_CAPS_SIZE];
+	uint8_t configs[MAX_CONFIGS][A2DP_MAX_CAPS_SIZE];
+	int config_sizes[MAX_CONFIGS];
+	struct spa_dict empty = SPA_DICT_INIT(NULL, 0);
+	uint32_t i, j, n_configs = 0;
+	int caps_size, res;
+
+	if (codec->fill_caps == NULL || codec->select_config == NULL ||
+	    codec->enum_config == NULL)
+		return 0;
+
+	if ((caps_size = codec->fill_caps(codec, MEDIA_CODEC_FLAG_SINK, caps)) < 0) {
+		fprintf(stderr, "%s: fill_caps failed: %s\n", codec->name, spa_strerror(caps_size));
+		return caps_size;
+	}
+
+	for (i = 0; i < SPA_N_ELEMENTS(infos) && n_configs < MAX_CONFIGS; i++) {
+		res = codec->select_config(codec, 0, caps, caps_size, &infos[i], &empty,
+				configs[n_configs]);
+		if (res < 0)
+			continue;
+
+		for (j = 0; j < n_configs; j++)
+			if (config_sizes[j] == res &&
+			    memcmp(configs[j], configs[n_configs], res) == 0)
+				break;
+		if (j == n_configs)
+			config_sizes[n_configs++] = res;
+	}
+
+	if (n_configs == 0) {
+		fprintf(stderr, "%s: no usable configuration\n", codec->name);
+		return -ENOTSUP;
+	}
+
+	for (i = 0; i < n_configs; i++) {
+		struct result r;
+
+		if ((res = run_config(d, codec, configs[i], config_sizes[i], &r)) < 0) {
+			fprintf(stderr, "%s: config %u failed: %s\n", codec->name, i, spa_strerror(res));
+			return res;
+		}
+		print_result(d, &r, codec->name);
+
+		if (d->data_loop && d->system) {
+			struct loop_stats st;
+
+			if ((res = run_data_loop(d, codec, configs[i], config_sizes[i],
+							&r.info, false, &st)) == 0)
+				print_loop_stats("sync", &st);
+			if (res == 0 && (res = run_data_loop(d, codec, configs[i], config_sizes[i],
+							&r.info, true, &st)) == 0)
+				print_loop_stats("worker", &st);
+			if (res < 0)
+				fprintf(stderr, "%s: data loop run failed: %s\n",
+						codec->name, spa_strerror(res));
+		}
+
+		if (d->group && codec->get_parts && codec->encode_part && codec->decode_part) {
+			static const uint32_t group_channels[] = { 2, 8, 16 };
+			struct spa_bt_codec_pool *pool;
+
+			if ((pool = spa_bt_codec_pool_create(spa_bt_codec_pool_default_threads(),
+							&logger.log, NULL)) == NULL)
+				return -errno;
+
+			for (j = 0; j < SPA_N_ELEMENTS(group_channels); j++) {
+				if ((res = run_group(d, codec, configs[i], config_sizes[i],
+								&r.info, group_channels[j], pool)) < 0) {
+					fprintf(stderr, "%s: group run failed: %s\n",
+							codec->name, spa_strerror(res));
+					break;
+				}
+			}
+			spa_bt_codec_pool_destroy(pool);
+			if (res < 0)
+				return res;
+		}
+
+		if (d->check && r.decoded && d->file_samples == NULL &&
+		    !spa_streq(d->signal, "noise") && r.snr < CHECK_MIN_SNR) {
+			fprintf(stderr, "%s: round-trip SNR %.2f dB below %.2f dB\n",
+					codec->name, r.snr, CHECK_MIN_SNR);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data;
+	const char *str;
+	uint32_t i;
+	int c, res;
+
+	spa_zero(data);
+	data.duration = DEFAULT_DURATION;
+	data.mtu = DEFAULT_MTU;
+	data.signal = DEFAULT_SIGNAL;
+
+	while ((c = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_usage(argv[0], false);
+			return EXIT_SUCCESS;
+		case 'v':
+			data.verbose = true;
+			break;
+		case 'C':
+			data.check = true;
+			break;
+		case 'l':
+			data.data_loop = true;
+			break;
+		case 'g':
+			data.group = true;
+			break;
+		case 'd':
+			data.duration = atof(optarg);
+			break;
+		case 'm':
+			data.mtu = atoi(optarg);
+			break;
+		case 'b':
+			data.link_kbps = atoi(optarg);
+			break;
+		case 's':
+			data.signal = optarg;
+			break;
+		case 'c':
+			data.codec_name = optarg;
+			break;
+		case 'i':
+			data.iname = optarg;
+			break;
+		default:
+			show_usage(argv[0], true);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (data.duration <= 0.0 || data.mtu == 0) {
+		show_usage(argv[0], true);
+		return EXIT_FAILURE;
+	}
+
+	logger.log.level = data.verbose ? SPA_LOG_LEVEL_DEBUG : SPA_LOG_LEVEL_WARN;
+
+	if (data.iname && (res = read_wav(&data)) < 0) {
+		fprintf(stderr, "error: can't read \"%s\": %s\n", data.iname, spa_strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	if ((str = getenv("SPA_PLUGIN_DIR")) == NULL)
+		str = PLUGINDIR;
+	data.loader.plugin_dir = str;
+	data.loader.loader.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_PluginLoader,
+			SPA_VERSION_PLUGIN_LOADER,
+			&loader_methods, &data.loader);
+
+	if (data.data_loop) {
+		const struct spa_dict_item items[] = {
+			{ SPA_KEY_LIBRARY_NAME, "support/libspa-support" },
+		};
+		void *iface;
+
+		data.system_handle = loader_load(&data.loader, SPA_NAME_SUPPORT_SYSTEM,
+				&SPA_DICT_INIT_ARRAY(items));
+		if (data.system_handle == NULL ||
+		    spa_handle_get_interface(data.system_handle, SPA_TYPE_INTERFACE_System, &iface) < 0) {
+			fprintf(stderr, "error: can't load system support from %s\n", str);
+			return EXIT_FAILURE;
+		}
+		data.system = iface;
+	}
+
+	data.codecs = load_media_codecs(&data.loader.loader, &logger.log);
+	if (data.codecs == NULL) {
+		fprintf(stderr, "error: can't load codecs from %s: %m\n", str);
+		return EXIT_FAILURE;
+	}
+
+	printf("%-22s %6s %2s %-7s %5s %9s %9s %9s %8s %7s %7s %6s %6s %3s %3s\n",
+			"codec", "rate", "ch", "format", "block",
+			"enc-us", "pkt-max", "dec-us", "kbps",
+			"snr", "segsnr", "delay", "drops", "red", "inc");
+
+	for (i = 0; data.codecs[i]; i++) {
+		const struct media_codec *codec = data.codecs[i];
+
+		if (data.codec_name && !spa_streq(codec->name, data.codec_name))
+			continue;
+
+		if ((res = run_codec(&data, codec)) < 0 && data.check)
+			data.n_failed++;
+	}
+
+	free_media_codecs(data.codecs);
+	if (data.system_handle)
+		loader_unload(&data.loader, data.system_handle);
+	free(data.file_samples);
+
+	return data.n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/* Spa Bluez5 codec worker pool */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <spa/support/log.h>
+#include <spa/support/thread.h>
+#include <spa/utils/result.h>
+
+#include "config.h"
+#include "codec-pool.h"
+
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.pool");
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+
+struct spa_bt_codec_pool {
+	struct spa_log *log;
+	struct spa_thread_utils *thread_utils;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	struct spa_thread *threads[SPA_BT_CODEC_POOL_MAX_THREADS];
+	uint32_t n_threads;
+	bool quit;
+
+	/* Current batch, protected by lock */
+	struct spa_bt_codec_task *tasks;
+	uint32_t n_tasks;
+	uint32_t next;
+	uint32_t running;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/** Run the next task of the batch, called with the lock held */
+static void run_next(struct spa_bt_codec_pool *pool)
+{
+	struct spa_bt_codec_task *t = &pool->tasks[pool->next++];
+
+	pool->running++;
+	pthread_mutex_unlock(&pool->lock);
+
+	t->res = t->func(t->data, t->index);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->running--;
+
+	if (pool->next >= pool->n_tasks && pool->running == 0)
+		pthread_cond_signal(&pool->done_cond);
+}
+
+static void *worker_thread(void *data)
+{
+	struct spa_bt_codec_pool *pool = data;
+
+	pthread_mutex_lock(&pool->lock);
+	while (true) {
+		while (!pool->quit && pool->next >= pool->n_tasks)
+			pthread_cond_wait(&pool->work_cond, &pool->lock);
+		if (pool->quit)
+			break;
+		run_next(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+uint32_t spa_bt_codec_pool_default_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* Leave one CPU for the data thread, which also takes tasks */
+	return SPA_CLAMP(n - 1, 0l, 3l);
+}
+
+static struct spa_thread *start_worker(struct spa_bt_codec_pool *pool, uint32_t index)
+{
+	struct spa_thread *thread;
+	char name[32];
+	struct spa_dict_item items[] = {
+		SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, name),
+	};
+	pthread_t pt;
+	int res;
+
+	if (pool->thread_utils == NULL) {
+		if ((res = -pthread_create(&pt, NULL, worker_thread, pool)) < 0) {
+			errno = -res;
+			return NULL;
+		}
+		return (struct spa_thread*)pt;
+	}
+
+	snprintf(name, sizeof(name), "bluez5-codec-%u", index);
+
+	thread = spa_thread_utils_create(pool->thread_utils,
+			&SPA_DICT_INIT_ARRAY(items), worker_thread, pool);
+	if (thread == NULL)
+		return NULL;
+
+	/* The data thread waits for the workers, so they run with the
+	 * same RT priority to avoid a priority inversion */
+	if ((res = spa_thread_utils_acquire_rt(pool->thread_utils, thread, -1)) < 0)
+		spa_log_warn(pool->log, "%p: can't make worker %u realtime: %s",
+				pool, index, spa_strerror(res));
+	return thread;
+}
+
+struct spa_bt_codec_pool *spa_bt_codec_pool_create(uint32_t n_threads, struct spa_log *log,
+		struct spa_thread_utils *thread_utils)
+{
+	struct spa_bt_codec_pool *pool;
+	pthread_condattr_t attr;
+	uint32_t i;
+	int res;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL)
+		return NULL;
+
+	spa_log_topic_init(log, &log_topic);
+	pool->log = log;
+	pool->thread_utils = thread_utils;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work_cond, NULL);
+	pthread_cond_init(&pool->done_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	n_threads = SPA_MIN(n_threads, (uint32_t)SPA_BT_CODEC_POOL_MAX_THREADS);
+	for (i = 0; i < n_threads; i++) {
+		if ((pool->threads[i] = start_worker(pool, i)) == NULL) {
+			res = -errno;
+			spa_log_warn(pool->log, "%p: can't start worker %u: %s",
+					pool, i, spa_strerror(res));
+			break;
+		}
+		pool->n_threads++;
+	}
+
+	spa_log_info(pool->log, "%p: codec pool with %u workers", pool, pool->n_threads);
+	return pool;
+}
+
+void spa_bt_codec_pool_destroy(struct spa_bt_codec_pool *pool)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->work_cond);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->n_threads; i++) {
+		if (pool->thread_utils)
+			spa_thread_utils_join(pool->thread_utils, pool->threads[i], NULL);
+		else
+			pthread_join((pthread_t)pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->work_cond);
+	pthread_cond_destroy(&pool->done_cond);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+int spa_bt_codec_pool_run(struct spa_bt_codec_pool *pool,
+		struct spa_bt_codec_task *tasks, uint32_t n_tasks, uint64_t deadline)
+{
+	struct timespec ts;
+	uint32_t i, skipped = 0;
+
+	if (n_tasks == 0)
+		return 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->tasks = tasks;
+	pool->n_tasks = n_tasks;
+	pool->next = 0;
+	pool->running = 0;
+
+	if (pool->n_threads > 0 && n_tasks > 1)
+		pthread_cond_broadcast(&pool->work_cond);
+
+	/* Take tasks ourselves while there are any left */
+	while (pool->next < pool->n_tasks) {
+		if (deadline && get_time_ns() >= deadline)
+			break;
+		run_next(pool);
+	}
+
+	ts.tv_sec = deadline / SPA_NSEC_PER_SEC;
+	ts.tv_nsec = deadline % SPA_NSEC_PER_SEC;
+
+	while (pool->next < pool->n_tasks || pool->running > 0) {
+		if (deadline && pool->next < pool->n_tasks &&
+		    pthread_cond_timedwait(&pool->done_cond, &pool->lock, &ts) == ETIMEDOUT) {
+			/* Skip what was not started, wait for what runs */
+			for (i = pool->next; i < pool->n_tasks; i++)
+				tasks[i].res = -ETIMEDOUT;
+			skipped = pool->n_tasks - pool->next;
+			pool->next = pool->n_tasks;
+		} else if (!deadline || pool->next >= pool->n_tasks) {
+			pthread_cond_wait(&pool->done_cond, &pool->lock);
+		}
+	}
+
+	pool->tasks = NULL;
+	pool->n_tasks = 0;
+	pool->next = 0;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	if (skipped > 0) {
+		spa_log_debug(pool->log, "%p: deadline passed, skipped %u/%u tasks",
+				pool, skipped, n_tasks);
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+/* Spa Bluez5 codec worker pool */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SPA_BLUEZ5_CODEC_POOL_H
+#define SPA_BLUEZ5_CODEC_POOL_H
+
+#include <spa/utils/defs.h>
+#include <spa/support/log.h>
+#include <spa/support/thread.h>
+
+#define SPA_BT_CODEC_POOL_MAX_THREADS	8
+
+/**
+ * Codec worker pool.
+ *
+ * Runs a batch of independent tasks, such as the channels of all streams
+ * in an ISO group, on a few worker threads. The calling thread takes
+ * tasks too, and returns when all tasks are done or the deadline passed.
+ *
+ * Tasks that were not started at the deadline are not run and get
+ * -ETIMEDOUT as result. Tasks that already run are always waited for, so
+ * the caller owns the task data again when spa_bt_codec_pool_run() returns.
+ */
+struct spa_bt_codec_task {
+	int (*func) (void *data, uint32_t index);
+	void *data;
+	uint32_t index;
+	int res;		/**< Result of func, or -ETIMEDOUT when not run */
+};
+
+struct spa_bt_codec_pool;
+
+/** Make a pool with \a n_threads workers. With 0 workers, tasks are run
+ * by the caller only. The workers are made with \a thread_utils and get
+ * the default RT priority, or are plain threads when it is NULL. */
+struct spa_bt_codec_pool *spa_bt_codec_pool_create(uint32_t n_threads, struct spa_log *log,
+		struct spa_thread_utils *thread_utils);
+void spa_bt_codec_pool_destroy(struct spa_bt_codec_pool *pool);
+
+/** Number of workers for a pool on this machine */
+uint32_t spa_bt_codec_pool_default_threads(void);
+
+/**
+ * Run \a n_tasks tasks and wait for them until \a deadline (CLOCK_MONOTONIC
+ * nsec, 0 for no deadline). Returns 0 when all tasks ran, -ETIMEDOUT when
+ * some were skipped.
+ */
+int spa_bt_codec_pool_run(struct spa_bt_codec_pool *pool,
+		struct spa_bt_codec_task *tasks, uint32_t n_tasks, uint64_t deadline);
+
+#endif
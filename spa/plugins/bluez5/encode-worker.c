@@ -0,0 +1,393 @@
+/* Spa Bluez5 encode worker */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/thread.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/utils/result.h>
+
+#include "config.h"
+#include "encode-worker.h"
+
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.encode");
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+
+#define PCM_RING_SIZE	(1u << 18)
+#define PCM_RING_MASK	(PCM_RING_SIZE - 1)
+
+struct spa_bt_encode_worker {
+	struct spa_log *log;
+	struct spa_system *data_system;
+
+	const struct media_codec *codec;
+	void *codec_data;
+	uint32_t frame_size;
+	uint32_t block_size;
+	uint32_t lookahead;
+
+	struct spa_thread_utils *thread_utils;
+	struct spa_thread *thread;
+	int wakeup_fd;
+	int ready_fd;
+	bool running;
+
+	/* PCM: data thread -> worker */
+	struct spa_ringbuffer pcm_ring;
+	uint8_t *pcm;
+	uint8_t *block;
+
+	/* Packets: worker -> data thread */
+	struct spa_ringbuffer packet_ring;
+	struct spa_bt_encode_packet packets[SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD];
+
+	/* Frames written and not yet popped, only used by the data thread */
+	uint32_t queued_frames;
+	uint32_t dropped_frames;
+
+	/* Requests from the data thread */
+	int abr_unsent;
+	int reduce_bitpool;
+	int increase_bitpool;
+	void *props;
+
+	/* Worker encoder state */
+	bool in_packet;
+	bool fragment;
+	uint16_t seqnum;
+	uint64_t sample_count;
+};
+
+static void apply_requests(struct spa_bt_encode_worker *w)
+{
+	void *props;
+	int unsent;
+
+	if ((props = __atomic_exchange_n(&w->props, NULL, __ATOMIC_ACQ_REL)) != NULL &&
+	    w->codec->update_props)
+		w->codec->update_props(w->codec_data, props);
+
+	if ((unsent = __atomic_exchange_n(&w->abr_unsent, -1, __ATOMIC_ACQ_REL)) >= 0)
+		w->codec->abr_process(w->codec_data, unsent);
+
+	if (__atomic_exchange_n(&w->reduce_bitpool, 0, __ATOMIC_ACQ_REL)) {
+		int res = w->codec->reduce_bitpool(w->codec_data);
+		spa_log_debug(w->log, "%p: reduce bitpool: %i", w, res);
+	}
+	if (__atomic_exchange_n(&w->increase_bitpool, 0, __ATOMIC_ACQ_REL)) {
+		int res = w->codec->increase_bitpool(w->codec_data);
+		spa_log_debug(w->log, "%p: increase bitpool: %i", w, res);
+	}
+}
+
+/**
+ * Encode into the next free packet slot.
+ * Returns 1 when a packet was completed, 0 when more PCM or a free slot
+ * is needed, < 0 on error.
+ */
+static int encode_packet(struct spa_bt_encode_worker *w)
+{
+	struct spa_bt_encode_packet *p;
+	uint32_t rindex, windex;
+	int32_t avail, filled;
+	size_t out_encoded;
+	int processed;
+
+	filled = spa_ringbuffer_get_write_index(&w->packet_ring, &windex);
+	if (filled >= (int32_t)w->lookahead)
+		return 0;
+
+	p = &w->packets[windex % SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD];
+
+	if (!w->in_packet) {
+		apply_requests(w);
+
+		p->seqnum = ++w->seqnum;
+		p->timestamp = w->sample_count;
+		p->frames = 0;
+		p->blocks = 0;
+		p->need_flush = 0;
+		processed = w->codec->start_encode(w->codec_data, p->data, sizeof(p->data),
+				p->seqnum, p->timestamp);
+		if (processed < 0)
+			goto error;
+		p->size = processed;
+		w->in_packet = true;
+
+		if (w->fragment) {
+			w->fragment = false;
+			processed = w->codec->encode(w->codec_data, NULL, 0,
+					p->data + p->size, sizeof(p->data) - p->size,
+					&out_encoded, &p->need_flush);
+			if (processed < 0)
+				goto error;
+			p->size += out_encoded;
+		}
+	}
+
+	while (!p->need_flush) {
+		avail = spa_ringbuffer_get_read_index(&w->pcm_ring, &rindex);
+		if (avail < (int32_t)w->block_size)
+			return 0;
+
+		spa_ringbuffer_read_data(&w->pcm_ring, w->pcm, PCM_RING_SIZE,
+				rindex & PCM_RING_MASK, w->block, w->block_size);
+
+		processed = w->codec->encode(w->codec_data, w->block, w->block_size,
+				p->data + p->size, sizeof(p->data) - p->size,
+				&out_encoded, &p->need_flush);
+		if (processed == 0 && !p->need_flush)
+			processed = -EINVAL;
+		if (processed < 0) {
+			/* Skip the block that could not be encoded */
+			spa_ringbuffer_read_update(&w->pcm_ring, rindex + w->block_size);
+			__atomic_add_fetch(&w->dropped_frames, w->block_size / w->frame_size,
+					__ATOMIC_RELAXED);
+			goto error;
+		}
+
+		spa_ringbuffer_read_update(&w->pcm_ring, rindex + processed);
+
+		p->frames += processed / w->frame_size;
+		p->blocks += processed / w->block_size;
+		p->size += out_encoded;
+		w->sample_count += processed / w->frame_size;
+	}
+
+	if (p->need_flush == NEED_FLUSH_FRAGMENT)
+		w->fragment = true;
+	w->in_packet = false;
+
+	spa_ringbuffer_write_update(&w->packet_ring, windex + 1);
+	return 1;
+
+error:
+	/* Drop the partial packet and the data it was made of */
+	__atomic_add_fetch(&w->dropped_frames, p->frames, __ATOMIC_RELAXED);
+	w->in_packet = false;
+	w->fragment = false;
+	return processed;
+}
+
+static void *worker_thread(void *data)
+{
+	struct spa_bt_encode_worker *w = data;
+	uint64_t count;
+	int res;
+
+	spa_log_debug(w->log, "%p: encode worker started", w);
+
+	while (__atomic_load_n(&w->running, __ATOMIC_ACQUIRE)) {
+		bool produced = false;
+
+		while ((res = encode_packet(w)) > 0)
+			produced = true;
+
+		if (res < 0)
+			spa_log_warn(w->log, "%p: encode failed: %s", w, spa_strerror(res));
+		if (produced)
+			spa_system_eventfd_write(w->data_system, w->ready_fd, 1);
+
+		if ((res = spa_system_eventfd_read(w->data_system, w->wakeup_fd, &count)) < 0 &&
+		    res != -EINTR)
+			break;
+	}
+
+	spa_log_debug(w->log, "%p: encode worker stopped", w);
+	return NULL;
+}
+
+struct spa_bt_encode_worker *spa_bt_encode_worker_create(const struct media_codec *codec,
+		void *codec_data, uint32_t frame_size, uint32_t lookahead,
+		struct spa_log *log, struct spa_system *data_system,
+		struct spa_thread_utils *thread_utils)
+{
+	struct spa_bt_encode_worker *w;
+	int res, block_size;
+
+	block_size = codec->get_block_size(codec_data);
+	if (block_size <= 0 || (uint32_t)block_size > PCM_RING_SIZE / 4 || frame_size == 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if ((w = calloc(1, sizeof(*w))) == NULL)
+		return NULL;
+
+	spa_log_topic_init(log, &log_topic);
+
+	w->log = log;
+	w->data_system = data_system;
+	w->codec = codec;
+	w->codec_data = codec_data;
+	w->frame_size = frame_size;
+	w->block_size = block_size;
+	w->lookahead = SPA_CLAMP(lookahead, 1u, (uint32_t)SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD);
+	w->abr_unsent = -1;
+	w->seqnum = UINT16_MAX;
+	w->wakeup_fd = -1;
+	w->ready_fd = -1;
+
+	spa_ringbuffer_init(&w->pcm_ring);
+	spa_ringbuffer_init(&w->packet_ring);
+
+	w->pcm = malloc(PCM_RING_SIZE);
+	w->block = malloc(block_size);
+	if (w->pcm == NULL || w->block == NULL) {
+		res = -errno;
+		goto error;
+	}
+
+	/* The worker blocks on wakeup_fd, so it is not made non-blocking */
+	if ((w->wakeup_fd = spa_system_eventfd_create(data_system, SPA_FD_CLOEXEC)) < 0 ||
+	    (w->ready_fd = spa_system_eventfd_create(data_system,
+				SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0) {
+		res = -errno;
+		goto error;
+	}
+
+	w->running = true;
+	if (thread_utils != NULL) {
+		struct spa_dict_item items[] = {
+			SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, "bluez5-encode"),
+		};
+		w->thread = spa_thread_utils_create(thread_utils,
+				&SPA_DICT_INIT_ARRAY(items), worker_thread, w);
+		if (w->thread == NULL) {
+			res = -errno;
+			w->running = false;
+			goto error;
+		}
+		/* the data thread waits for the packets, run with its priority */
+		if ((res = spa_thread_utils_acquire_rt(thread_utils, w->thread, -1)) < 0)
+			spa_log_warn(w->log, "%p: can't acquire realtime priority: %s",
+					w, spa_strerror(res));
+	} else {
+		pthread_t pt;
+		if ((res = -pthread_create(&pt, NULL, worker_thread, w)) < 0) {
+			w->running = false;
+			goto error;
+		}
+		w->thread = (struct spa_thread*)pt;
+	}
+	w->thread_utils = thread_utils;
+
+	spa_log_info(w->log, "%p: %s encode worker block:%d lookahead:%u",
+			w, codec->name, block_size, w->lookahead);
+
+	return w;
+
+error:
+	if (w->wakeup_fd >= 0)
+		spa_system_close(data_system, w->wakeup_fd);
+	if (w->ready_fd >= 0)
+		spa_system_close(data_system, w->ready_fd);
+	free(w->pcm);
+	free(w->block);
+	free(w);
+	errno = -res;
+	return NULL;
+}
+
+void spa_bt_encode_worker_destroy(struct spa_bt_encode_worker *w)
+{
+	__atomic_store_n(&w->running, false, __ATOMIC_RELEASE);
+	spa_system_eventfd_write(w->data_system, w->wakeup_fd, 1);
+	if (w->thread_utils)
+		spa_thread_utils_join(w->thread_utils, w->thread, NULL);
+	else
+		pthread_join((pthread_t)w->thread, NULL);
+
+	spa_system_close(w->data_system, w->wakeup_fd);
+	spa_system_close(w->data_system, w->ready_fd);
+	free(w->pcm);
+	free(w->block);
+	free(w);
+}
+
+int spa_bt_encode_worker_get_fd(struct spa_bt_encode_worker *w)
+{
+	return w->ready_fd;
+}
+
+uint32_t spa_bt_encode_worker_write(struct spa_bt_encode_worker *w, const void *data, uint32_t size)
+{
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&w->pcm_ring, &index);
+	size = SPA_MIN(size, PCM_RING_SIZE - (uint32_t)filled);
+	size -= size % w->frame_size;
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_write_data(&w->pcm_ring, w->pcm, PCM_RING_SIZE,
+			index & PCM_RING_MASK, data, size);
+	spa_ringbuffer_write_update(&w->pcm_ring, index + size);
+
+	w->queued_frames += size / w->frame_size;
+
+	spa_system_eventfd_write(w->data_system, w->wakeup_fd, 1);
+	return size;
+}
+
+uint32_t spa_bt_encode_worker_get_queued_frames(struct spa_bt_encode_worker *w)
+{
+	uint32_t dropped = __atomic_exchange_n(&w->dropped_frames, 0, __ATOMIC_RELAXED);
+
+	w->queued_frames -= SPA_MIN(dropped, w->queued_frames);
+	return w->queued_frames;
+}
+
+struct spa_bt_encode_packet *spa_bt_encode_worker_peek(struct spa_bt_encode_worker *w)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_read_index(&w->packet_ring, &index) <= 0)
+		return NULL;
+
+	return &w->packets[index % SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD];
+}
+
+void spa_bt_encode_worker_pop(struct spa_bt_encode_worker *w)
+{
+	uint32_t index;
+	struct spa_bt_encode_packet *p;
+
+	if (spa_ringbuffer_get_read_index(&w->packet_ring, &index) <= 0)
+		return;
+
+	p = &w->packets[index % SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD];
+	w->queued_frames -= SPA_MIN(p->frames, w->queued_frames);
+
+	spa_ringbuffer_read_update(&w->packet_ring, index + 1);
+
+	/* A slot became free, the worker may continue */
+	spa_system_eventfd_write(w->data_system, w->wakeup_fd, 1);
+}
+
+void spa_bt_encode_worker_abr_process(struct spa_bt_encode_worker *w, size_t unsent)
+{
+	__atomic_store_n(&w->abr_unsent, (int)SPA_MIN(unsent, (size_t)INT32_MAX), __ATOMIC_RELEASE);
+}
+
+void spa_bt_encode_worker_reduce_bitpool(struct spa_bt_encode_worker *w)
+{
+	__atomic_store_n(&w->reduce_bitpool, 1, __ATOMIC_RELEASE);
+}
+
+void spa_bt_encode_worker_increase_bitpool(struct spa_bt_encode_worker *w)
+{
+	__atomic_store_n(&w->increase_bitpool, 1, __ATOMIC_RELEASE);
+}
+
+void spa_bt_encode_worker_update_props(struct spa_bt_encode_worker *w, void *props)
+{
+	__atomic_store_n(&w->props, props, __ATOMIC_RELEASE);
+}
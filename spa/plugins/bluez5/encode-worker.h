@@ -0,0 +1,68 @@
+/* Spa Bluez5 encode worker */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SPA_BLUEZ5_ENCODE_WORKER_H
+#define SPA_BLUEZ5_ENCODE_WORKER_H
+
+#include <spa/utils/defs.h>
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/thread.h>
+
+#include "media-codecs.h"
+
+#define SPA_BT_ENCODE_WORKER_MAX_LOOKAHEAD	8
+#define SPA_BT_ENCODE_WORKER_PACKET_SIZE	8192
+
+/**
+ * Encode worker.
+ *
+ * Runs codec->encode() on a separate thread. The data thread queues PCM
+ * with spa_bt_encode_worker_write() and takes finished packets with
+ * spa_bt_encode_worker_peek() and spa_bt_encode_worker_pop().
+ *
+ * Both queues are single producer, single consumer: only the data thread
+ * may call the write/peek/pop/control functions. The worker owns the
+ * codec data while it runs; bitpool and ABR changes are forwarded to it
+ * and applied before the next packet is started.
+ *
+ * The worker thread is made with \a thread_utils and gets realtime
+ * priority, without thread utils a plain thread is used.
+ */
+struct spa_bt_encode_packet {
+	uint8_t data[SPA_BT_ENCODE_WORKER_PACKET_SIZE];
+	uint32_t size;		/**< Encoded packet size */
+	uint32_t frames;	/**< PCM frames in the packet */
+	uint32_t blocks;	/**< Codec blocks in the packet */
+	uint16_t seqnum;
+	uint32_t timestamp;
+	int need_flush;		/**< NEED_FLUSH_ALL or NEED_FLUSH_FRAGMENT */
+};
+
+struct spa_bt_encode_worker;
+
+struct spa_bt_encode_worker *spa_bt_encode_worker_create(const struct media_codec *codec,
+		void *codec_data, uint32_t frame_size, uint32_t lookahead,
+		struct spa_log *log, struct spa_system *data_system,
+		struct spa_thread_utils *thread_utils);
+void spa_bt_encode_worker_destroy(struct spa_bt_encode_worker *w);
+
+/** Eventfd that becomes readable when a packet is ready. */
+int spa_bt_encode_worker_get_fd(struct spa_bt_encode_worker *w);
+
+/** Queue PCM for encoding. Returns the number of bytes queued. */
+uint32_t spa_bt_encode_worker_write(struct spa_bt_encode_worker *w, const void *data, uint32_t size);
+
+/** Frames queued in the worker that are not yet taken with spa_bt_encode_worker_pop() */
+uint32_t spa_bt_encode_worker_get_queued_frames(struct spa_bt_encode_worker *w);
+
+struct spa_bt_encode_packet *spa_bt_encode_worker_peek(struct spa_bt_encode_worker *w);
+void spa_bt_encode_worker_pop(struct spa_bt_encode_worker *w);
+
+void spa_bt_encode_worker_abr_process(struct spa_bt_encode_worker *w, size_t unsent);
+void spa_bt_encode_worker_reduce_bitpool(struct spa_bt_encode_worker *w);
+void spa_bt_encode_worker_increase_bitpool(struct spa_bt_encode_worker *w);
+void spa_bt_encode_worker_update_props(struct spa_bt_encode_worker *w, void *props);
+
+#endif
@@ -20,6 +20,7 @@
 #include "iso-io.h"
 
 #include "media-codecs.h"
+#include "codec-pool.h"
 #include "defs.h"
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.iso");
@@ -28,6 +29,7 @@ static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.iso");
 
 #define IDLE_TIME	(500 * SPA_NSEC_PER_MSEC)
 #define EMPTY_BUF_SIZE	65536
+#define MAX_TASKS	64
 
 struct group {
 	struct spa_log *log;
@@ -42,6 +44,11 @@ struct group {
 	uint64_t duration;
 	uint32_t paused;
 	bool started;
+
+	struct spa_thread_utils *thread_utils;
+	int32_t pool_threads;		/**< -1 when the pool is disabled */
+	struct spa_bt_codec_pool *pool;
+	struct spa_bt_codec_task tasks[MAX_TASKS];
 };
 
 struct stream {
@@ -56,6 +63,8 @@ struct stream {
 
 	const struct media_codec *codec;
 	uint32_t block_size;
+	uint32_t n_parts;
+	size_t header_size;
 };
 
 struct modify_info
@@ -143,6 +152,99 @@ static int set_timers(struct group *group)
 	return set_timeout(group, group->next);
 }
 
+static int encode_part(void *data, uint32_t part)
+{
+	struct stream *stream = data;
+	size_t used = stream->header_size;
+
+	return stream->codec->encode_part(stream->this.codec_data, part,
+			stream->this.pcm, stream->this.pcm_size,
+			SPA_PTROFF(stream->this.buf, used, void), sizeof(stream->this.buf) - used);
+}
+
+static void finish_encode(struct group *group, uint32_t n_tasks)
+{
+	struct spa_bt_codec_task *t;
+	struct stream *stream;
+	size_t size = 0;
+	bool fail = false;
+	uint32_t i;
+
+	for (i = 0; i < n_tasks; i++) {
+		t = &group->tasks[i];
+		stream = t->data;
+
+		if (t->res < 0)
+			fail = true;
+		else
+			size += t->res;
+
+		/* Last part of the stream */
+		if (i + 1 == n_tasks || group->tasks[i + 1].data != stream) {
+			if (fail)
+				spa_log_debug(group->log, "%p: ISO group:%u encode failed fd:%d: %s",
+						group, group->cig, stream->fd,
+						spa_strerror(t->res < 0 ? t->res : -EINVAL));
+			stream->this.size = fail ? 0 : stream->header_size + size;
+			stream->this.pcm_size = 0;
+			size = 0;
+			fail = false;
+		}
+	}
+}
+
+/*
+ * Encode the PCM blocks of all streams in one batch, with one task per
+ * channel, on the worker pool. The packets are sent on the next timeout,
+ * but don't let the data thread wait for more than half an interval.
+ */
+static void group_encode(struct group *group)
+{
+	struct stream *stream;
+	struct timespec now;
+	uint64_t deadline;
+	uint32_t i, n_tasks = 0;
+	int res;
+
+	spa_system_clock_gettime(group->data_system, CLOCK_MONOTONIC, &now);
+	deadline = SPA_TIMESPEC_TO_NSEC(&now) + group->duration / 2;
+
+	spa_list_for_each(stream, &group->streams, link) {
+		if (!stream->sink || stream->this.pcm_size == 0)
+			continue;
+
+		if (stream->this.pcm_size < stream->block_size || n_tasks + stream->n_parts > MAX_TASKS) {
+			stream->this.pcm_size = 0;
+			continue;
+		}
+
+		res = stream->codec->start_encode(stream->this.codec_data,
+				stream->this.buf, sizeof(stream->this.buf), 0, 0);
+		if (res < 0) {
+			stream->this.pcm_size = 0;
+			continue;
+		}
+		stream->header_size = res;
+
+		for (i = 0; i < stream->n_parts; i++) {
+			group->tasks[n_tasks++] = (struct spa_bt_codec_task) {
+				.func = encode_part,
+				.data = stream,
+				.index = i,
+			};
+		}
+	}
+
+	if (n_tasks == 0)
+		return;
+
+	if ((res = spa_bt_codec_pool_run(group->pool, group->tasks, n_tasks, deadline)) < 0)
+		spa_log_debug(group->log, "%p: ISO group:%u encode: %s",
+				group, group->cig, spa_strerror(res));
+
+	finish_encode(group, n_tasks);
+}
+
 static void group_on_timeout(struct spa_source *source)
 {
 	struct group *group = source->data;
@@ -236,13 +338,18 @@ static void group_on_timeout(struct spa_source *source)
 		}
 	}
 
+	group_encode(group);
+
 	set_timeout(group, group->next);
 }
 
 static struct group *group_create(struct spa_bt_transport *t,
-		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system)
+		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system,
+		struct spa_thread_utils *thread_utils)
 {
+	const struct spa_dict *settings = t->device ? t->device->settings : NULL;
 	struct group *group;
+	const char *str;
 
 	if (t->bap_interval <= 5000) {
 		errno = EINVAL;
@@ -259,8 +366,18 @@ static struct group *group_create(struct spa_bt_transport *t,
 	group->log = log;
 	group->data_loop = data_loop;
 	group->data_system = data_system;
+	group->thread_utils = thread_utils;
 	group->duration = t->bap_interval * SPA_NSEC_PER_USEC;
 
+	/* The codec pool is opt-in until it is measured with real codecs */
+	group->pool_threads = -1;
+	if (settings && (str = spa_dict_lookup(settings, "bluez5.iso-encode-threads")) != NULL) {
+		if (spa_streq(str, "auto"))
+			group->pool_threads = spa_bt_codec_pool_default_threads();
+		else
+			spa_atoi32(str, &group->pool_threads, 0);
+	}
+
 	spa_list_init(&group->streams);
 
 	group->timerfd = spa_system_timerfd_create(group->data_system,
@@ -304,6 +421,9 @@ static void group_destroy(struct group *group)
 	res = spa_loop_invoke(group->data_loop, do_remove_source, 0, NULL, 0, true, group);
 	spa_assert_se(res == 0);
 
+	if (group->pool)
+		spa_bt_codec_pool_destroy(group->pool);
+
 	close(group->timerfd);
 	free(group);
 }
@@ -355,6 +475,21 @@ struct stream *stream_create(struct spa_bt_transport *t, struct group *group)
 	stream->this.format = format;
 	stream->block_size = block_size;
 
+	/* Let the group encode the channels of all streams together */
+	if (sink && group->pool_threads >= 0 &&
+	    stream->codec->get_parts && stream->codec->encode_part) {
+		res = stream->codec->get_parts(codec_data);
+		if (res > 0 && res <= MAX_TASKS) {
+			if (group->pool == NULL)
+				group->pool = spa_bt_codec_pool_create(group->pool_threads,
+						group->log, group->thread_utils);
+			if (group->pool != NULL)
+				stream->this.pcm = malloc(block_size);
+			if (stream->this.pcm != NULL)
+				stream->n_parts = res;
+		}
+	}
+
 	if (sink)
 		stream_silence(stream);
 
@@ -372,12 +507,13 @@ fail:
 }
 
 struct spa_bt_iso_io *spa_bt_iso_io_create(struct spa_bt_transport *t,
-		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system)
+		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system,
+		struct spa_thread_utils *thread_utils)
 {
 	struct stream *stream;
 	struct group *group;
 
-	group = group_create(t, log, data_loop, data_system);
+	group = group_create(t, log, data_loop, data_system, thread_utils);
 	if (group == NULL)
 		return NULL;
 
@@ -416,6 +552,7 @@ void spa_bt_iso_io_destroy(struct spa_bt_iso_io *this)
 		stream->codec->deinit(stream->this.codec_data);
 	stream->this.codec_data = NULL;
 
+	free(stream->this.pcm);
 	free(stream);
 }
 
@@ -455,6 +592,7 @@ void spa_bt_iso_io_set_cb(struct spa_bt_iso_io *this, spa_bt_iso_io_pull_t pull,
 
 	if (pull == NULL) {
 		stream->this.size = 0;
+		stream->this.pcm_size = 0;
 		return;
 	}
 }
@@ -8,6 +8,7 @@
 #include <spa/utils/defs.h>
 #include <spa/support/loop.h>
 #include <spa/support/log.h>
+#include <spa/support/thread.h>
 #include <spa/node/io.h>
 #include <spa/param/audio/format.h>
 
@@ -34,13 +35,19 @@ struct spa_bt_iso_io
 	struct spa_audio_info format;	/**< Audio format */
 	void *codec_data;		/**< Codec data */
 
+	void *pcm;		/**< If not NULL, the pull callback puts one PCM block
+				 * here instead of encoding, and the group encodes it
+				 * with codec_data (read-only) */
+	size_t pcm_size;	/**< Size of the PCM block (set by pull callback) */
+
 	void *user_data;
 };
 
 typedef void (*spa_bt_iso_io_pull_t)(struct spa_bt_iso_io *io);
 
 struct spa_bt_iso_io *spa_bt_iso_io_create(struct spa_bt_transport *t,
-		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system);
+		struct spa_log *log, struct spa_loop *data_loop, struct spa_system *data_system,
+		struct spa_thread_utils *thread_utils);
 struct spa_bt_iso_io *spa_bt_iso_io_attach(struct spa_bt_iso_io *io, struct spa_bt_transport *t);
 void spa_bt_iso_io_destroy(struct spa_bt_iso_io *io);
 void spa_bt_iso_io_set_cb(struct spa_bt_iso_io *io, spa_bt_iso_io_pull_t pull, void *user_data);
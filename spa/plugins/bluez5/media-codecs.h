@@ -137,6 +137,22 @@ struct media_codec {
 		void *dst, size_t dst_size,
 		size_t *dst_out);
 
+	/** Number of parts that encode_part() and decode_part() split a block
+	 * into, 0 when not supported. Different parts of one block can be
+	 * processed concurrently from different threads. */
+	int (*get_parts) (void *data);
+	/** Encode part of the block in \a src into the packet payload \a dst,
+	 * after start_encode(). Returns the number of bytes written. The
+	 * payload size is the sum over all parts. */
+	int (*encode_part) (void *data, uint32_t part,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size);
+	/** Decode part of the packet payload \a src into the block \a dst,
+	 * after start_decode(). Returns the number of bytes consumed. */
+	int (*decode_part) (void *data, uint32_t part,
+		const void *src, size_t src_size,
+		void *dst, size_t dst_size);
+
 	int (*reduce_bitpool) (void *data);
 	int (*increase_bitpool) (void *data);
 
@@ -17,6 +17,7 @@
 #include <spa/utils/names.h>
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
+#include <spa/utils/jitter-buffer.h>
 #include <spa/monitor/device.h>
 
 #include <spa/node/node.h>
@@ -38,8 +39,8 @@
 #include "defs.h"
 #include "rtp.h"
 #include "media-codecs.h"
-#include "rate-control.h"
 #include "iso-io.h"
+#include "encode-worker.h"
 
 static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.bluez5.sink.media");
 #undef SPA_LOG_TOPIC_DEFAULT
@@ -57,6 +58,7 @@ struct props {
 #define MAX_BUFFERS 32
 #define BUFFER_SIZE	(8192*8)
 #define RATE_CTL_DIFF_MAX 0.005
+#define DEFAULT_ENCODE_LOOKAHEAD 2
 
 /* Wait for two cycles before trying to sync ISO. On start/driver reassign,
  * first cycle may have strange number of samples. */
@@ -98,7 +100,7 @@ struct port {
 
 	size_t ready_offset;
 
-	struct spa_bt_rate_control ratectl;
+	struct spa_jitter_rate_control ratectl;
 };
 
 struct impl {
@@ -108,6 +110,7 @@ struct impl {
 	struct spa_log *log;
 	struct spa_loop *data_loop;
 	struct spa_system *data_system;
+	struct spa_thread_utils *thread_utils;
 
 	struct spa_hook_list hooks;
 	struct spa_callbacks callbacks;
@@ -138,6 +141,7 @@ struct impl {
 
 	unsigned int is_duplex:1;
 	unsigned int is_internal:1;
+	unsigned int use_encode_worker:1;
 
 	struct spa_source source;
 	int timerfd;
@@ -145,6 +149,11 @@ struct impl {
 	struct spa_source flush_timer_source;
 	int flush_timerfd;
 
+	struct spa_bt_encode_worker *encode_worker;
+	struct spa_source encode_source;
+	void *encode_codec_data;
+	uint32_t encode_lookahead;
+
 	struct spa_io_clock *clock;
 	struct spa_io_position *position;
 
@@ -459,6 +468,10 @@ static uint32_t get_queued_frames(struct impl *this)
 	bytes += this->tmp_buffer_used;
 	bytes += this->block_count * this->block_size;
 
+	if (this->encode_worker)
+		return bytes / port->frame_size +
+			spa_bt_encode_worker_get_queued_frames(this->encode_worker);
+
 	return bytes / port->frame_size;
 }
 
@@ -545,18 +558,20 @@ static int get_transport_unused_size(struct impl *this)
 	return value;
 }
 
-static int send_buffer(struct impl *this)
+static int send_buffer(struct impl *this, const void *data, uint32_t size)
 {
 	int written, unsent;
 
 	unsent = get_transport_unused_size(this);
 	if (unsent >= 0) {
 		unsent = this->fd_buffer_size - unsent;
-		this->codec->abr_process(this->codec_data, unsent);
+		if (this->encode_worker)
+			spa_bt_encode_worker_abr_process(this->encode_worker, unsent);
+		else
+			this->codec->abr_process(this->codec_data, unsent);
 	}
 
-	written = send(this->flush_source.fd, this->buffer,
-			this->buffer_used, MSG_DONTWAIT | MSG_NOSIGNAL);
+	written = send(this->flush_source.fd, data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
 
 	if (SPA_UNLIKELY(spa_log_level_topic_enabled(this->log, SPA_LOG_TOPIC_DEFAULT, SPA_LOG_LEVEL_TRACE))) {
 		struct timespec ts;
@@ -572,7 +587,7 @@ static int send_buffer(struct impl *this)
 				"%p: send blocks:%d block:%u seq:%u ts:%u size:%u "
 				"wrote:%d dt:%"PRIu64,
 				this, this->block_count, this->block_size, this->seqnum,
-				this->timestamp, this->buffer_used, written, dt);
+				this->timestamp, size, written, dt);
 	}
 
 	if (written < 0) {
@@ -583,6 +598,26 @@ static int send_buffer(struct impl *this)
 	return written;
 }
 
+/*
+ * The ISO group encodes the blocks of all its streams together, so only
+ * hand it the PCM block. The packet is then filled in by the group.
+ */
+static int iso_put_block(struct impl *this, const void *src, size_t src_size,
+		size_t *dst_out, int *need_flush)
+{
+	struct spa_bt_iso_io *iso_io = this->transport->iso_io;
+
+	*dst_out = 0;
+	*need_flush = NEED_FLUSH_ALL;
+
+	if (src_size < this->block_size)
+		return 0;
+
+	memcpy(iso_io->pcm, src, this->block_size);
+	iso_io->pcm_size = this->block_size;
+	return this->block_size;
+}
+
 static int encode_buffer(struct impl *this, const void *data, uint32_t size)
 {
 	int processed;
@@ -612,7 +647,11 @@ static int encode_buffer(struct impl *this, const void *data, uint32_t size)
 		this->tmp_buffer_used = this->block_size - this->tmp_buffer_used;
 	}
 
-	processed = this->codec->encode(this->codec_data,
+	if (this->transport && this->transport->iso_io && this->transport->iso_io->pcm)
+		processed = iso_put_block(this, from_data, from_size,
+				&out_encoded, &this->need_flush);
+	else
+		processed = this->codec->encode(this->codec_data,
 				from_data, from_size,
 				this->buffer + this->buffer_used,
 				sizeof(this->buffer) - this->buffer_used,
@@ -671,7 +710,7 @@ static int flush_buffer(struct impl *this)
 			this->buffer_used, this->block_size);
 
 	if (this->need_flush)
-		return send_buffer(this);
+		return send_buffer(this, this->buffer, this->buffer_used);
 
 	return 0;
 }
@@ -680,6 +719,9 @@ static int add_data(struct impl *this, const void *data, uint32_t size)
 {
 	int processed, total = 0;
 
+	if (this->encode_worker)
+		return spa_bt_encode_worker_write(this->encode_worker, data, size);
+
 	while (size > 0) {
 		processed = encode_buffer(this, data, size);
 
@@ -710,6 +752,142 @@ static void enable_flush_timer(struct impl *this, bool enabled)
 	this->flush_pending = enabled;
 }
 
+static void update_next_flush_time(struct impl *this, uint32_t packet_samples)
+{
+	struct port *port = &this->port;
+	uint64_t packet_time = (uint64_t)packet_samples * SPA_NSEC_PER_SEC
+		/ port->current_format.info.raw.rate;
+
+	/*
+	 * We cannot write all data we have at once, since this can exceed device
+	 * buffers (esp. for the A2DP low-latency codecs) and socket buffers, so
+	 * flush needs to be delayed.
+	 */
+	if (SPA_LIKELY(this->position)) {
+		uint64_t duration_ns;
+
+		/*
+		 * Flush at the time position of the next buffered sample.
+		 */
+		this->next_flush_time = get_reference_time(this, &duration_ns)
+			+ packet_time;
+
+		/*
+		 * We can delay the output by one packet to avoid waiting
+		 * for the next buffer and so make send intervals exactly regular.
+		 * However, this is not needed for A2DP or BAP. The controller
+		 * will do the scheduling for us, and there's also the socket buffer
+		 * in between.
+		 *
+		 * Although in principle this should not be needed, we
+		 * do it regardless in case it helps.
+		 */
+#if 1
+		this->next_flush_time += SPA_MIN(packet_time,
+				duration_ns * (port->n_buffers - 1));
+#endif
+	} else {
+		if (this->next_flush_time == 0)
+			this->next_flush_time = this->process_time;
+		this->next_flush_time += packet_time;
+	}
+}
+
+/*
+ * Packets are encoded by the encode worker; here they are only taken from
+ * its queue and sent out, on the flush timer or when the ISO group pulls.
+ */
+static int flush_encoded(struct impl *this, uint64_t now_time)
+{
+	struct spa_bt_encode_packet *p;
+	int written, unused_buffer;
+
+	if (this->codec_props_changed && this->codec_props) {
+		spa_bt_encode_worker_update_props(this->encode_worker, this->codec_props);
+		this->codec_props_changed = false;
+	}
+
+	if (this->transport->iso_io) {
+		struct spa_bt_iso_io *iso_io = this->transport->iso_io;
+		size_t avail;
+
+		if (!this->iso_pending)
+			return 0;
+		if ((p = spa_bt_encode_worker_peek(this->encode_worker)) == NULL) {
+			spa_log_trace(this->log, "%p: ISO no encoded packet ready", this);
+			return 0;
+		}
+
+		avail = SPA_MIN(p->size, sizeof(iso_io->buf));
+		memcpy(iso_io->buf, p->data, avail);
+		iso_io->size = avail;
+		iso_io->timestamp = get_reference_time(this, NULL) / SPA_NSEC_PER_USEC;
+		this->iso_pending = false;
+
+		spa_log_trace(this->log, "%p: ISO put fd:%d size:%u sn:%u ts:%u now:%"PRIu64,
+				this, this->transport->fd, (unsigned)avail,
+				(unsigned)p->seqnum, (unsigned)iso_io->timestamp,
+				iso_io->now);
+
+		spa_bt_encode_worker_pop(this->encode_worker);
+		return 0;
+	}
+
+	if (this->flush_pending) {
+		spa_log_trace(this->log, "%p: wait for flush timer", this);
+		return 0;
+	}
+
+	if ((p = spa_bt_encode_worker_peek(this->encode_worker)) == NULL) {
+		spa_log_trace(this->log, "%p: no encoded packet ready", this);
+		enable_flush_timer(this, false);
+		return 0;
+	}
+
+	unused_buffer = get_transport_unused_size(this);
+
+	this->seqnum = p->seqnum;
+	this->timestamp = p->timestamp;
+
+	written = send_buffer(this, p->data, p->size);
+
+	if (written == -EAGAIN) {
+		spa_log_trace(this->log, "%p: fail flush", this);
+		if (now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
+			spa_bt_encode_worker_reduce_bitpool(this->encode_worker);
+			spa_log_debug(this->log, "%p: reduce bitpool", this);
+			this->last_error = now_time;
+		}
+		/* Skip the packet, like in the synchronous path */
+		written = p->size;
+	}
+
+	if (written < 0) {
+		spa_log_trace(this->log, "%p: error flushing %s", this,
+				spa_strerror(written));
+		spa_bt_encode_worker_pop(this->encode_worker);
+		enable_flush_timer(this, false);
+		return written;
+	}
+
+	update_next_flush_time(this, p->frames);
+
+	if (now_time - this->last_error > SPA_NSEC_PER_SEC) {
+		if (unused_buffer == (int)this->fd_buffer_size) {
+			spa_bt_encode_worker_increase_bitpool(this->encode_worker);
+			spa_log_debug(this->log, "%p: increase bitpool", this);
+		}
+		this->last_error = now_time;
+	}
+
+	spa_log_trace(this->log, "%p: flush at:%"PRIu64" process:%"PRIu64, this,
+			this->next_flush_time, this->process_time);
+
+	spa_bt_encode_worker_pop(this->encode_worker);
+	enable_flush_timer(this, true);
+	return 0;
+}
+
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	int written;
@@ -725,7 +903,7 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	if (!this->flush_timer_source.loop && !this->transport->iso_io)
 		return -EIO;
 
-	if (this->transport->iso_io && !this->iso_pending)
+	if (this->transport->iso_io && !this->iso_pending && !this->encode_worker)
 		return 0;
 
 	total_frames = 0;
@@ -797,6 +975,9 @@ again:
 		spa_log_trace(this->log, "%p: written %u frames", this, total_frames);
 	}
 
+	if (this->encode_worker)
+		return flush_encoded(this, now_time);
+
 	if (this->transport->iso_io) {
 		struct spa_bt_iso_io *iso_io = this->transport->iso_io;
 
@@ -857,44 +1038,8 @@ again:
 		return written;
 	}
 	else if (written > 0) {
-		/*
-		 * We cannot write all data we have at once, since this can exceed device
-		 * buffers (esp. for the A2DP low-latency codecs) and socket buffers, so
-		 * flush needs to be delayed.
-		 */
-		uint32_t packet_samples = this->block_count * this->block_size
-			/ port->frame_size;
-		uint64_t packet_time = (uint64_t)packet_samples * SPA_NSEC_PER_SEC
-			/ port->current_format.info.raw.rate;
-
-		if (SPA_LIKELY(this->position)) {
-			uint64_t duration_ns;
-
-			/*
-			 * Flush at the time position of the next buffered sample.
-			 */
-			this->next_flush_time = get_reference_time(this, &duration_ns)
-				+ packet_time;
-
-			/*
-			 * We can delay the output by one packet to avoid waiting
-			 * for the next buffer and so make send intervals exactly regular.
-			 * However, this is not needed for A2DP or BAP. The controller
-			 * will do the scheduling for us, and there's also the socket buffer
-			 * in between.
-			 *
-			 * Although in principle this should not be needed, we
-			 * do it regardless in case it helps.
-			 */
-#if 1
-			this->next_flush_time += SPA_MIN(packet_time,
-					duration_ns * (port->n_buffers - 1));
-#endif
-		} else {
-			if (this->next_flush_time == 0)
-				this->next_flush_time = this->process_time;
-			this->next_flush_time += packet_time;
-		}
+		update_next_flush_time(this, this->block_count * this->block_size
+				/ port->frame_size);
 
 		if (this->need_flush == NEED_FLUSH_FRAGMENT) {
 			reset_buffer(this);
@@ -969,7 +1114,7 @@ static void media_iso_pull(struct spa_bt_iso_io *iso_io)
 	double value, target, err, max_err;
 
 	if (this->resync || !this->position) {
-		spa_bt_rate_control_init(&port->ratectl, 0);
+		spa_jitter_rate_control_init(&port->ratectl, 0);
 		goto done;
 	}
 
@@ -995,7 +1140,7 @@ static void media_iso_pull(struct spa_bt_iso_io *iso_io)
 		unsigned int req = err * port->current_format.info.raw.rate / SPA_NSEC_PER_SEC;
 
 		if (req > 0) {
-			spa_bt_rate_control_init(&port->ratectl, 0);
+			spa_jitter_rate_control_init(&port->ratectl, 0);
 			drop_frames(this, req);
 		}
 		spa_log_debug(this->log, "%p: ISO sync skip frames:%u", this, req);
@@ -1004,7 +1149,7 @@ static void media_iso_pull(struct spa_bt_iso_io *iso_io)
 		static const uint8_t empty[8192] = {0};
 
 		if (req > 0) {
-			spa_bt_rate_control_init(&port->ratectl, 0);
+			spa_jitter_rate_control_init(&port->ratectl, 0);
 			req = SPA_MIN(req, sizeof(empty) / port->frame_size);
 			add_data(this, empty, req * port->frame_size);
 		}
@@ -1014,7 +1159,7 @@ static void media_iso_pull(struct spa_bt_iso_io *iso_io)
 		spa_log_debug(this->log, "%p: ISO sync need resync err:%+.3f",
 				this, err / SPA_NSEC_PER_MSEC);
 	} else {
-		spa_bt_rate_control_update(&port->ratectl, err, 0,
+		spa_jitter_rate_control_update(&port->ratectl, err, 0,
 				iso_io->duration, period, RATE_CTL_DIFF_MAX);
 		spa_log_trace(this->log, "%p: ISO sync err:%+.3f value:%.3f target:%.3f (ms) corr:%g",
 				this,
@@ -1075,6 +1220,29 @@ static void media_on_flush_timeout(struct spa_source *source)
 	}
 }
 
+static void media_on_encode_ready(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	struct timespec now;
+	uint64_t count;
+	int res;
+
+	if ((res = spa_system_eventfd_read(this->data_system, source->fd, &count)) < 0) {
+		if (res != -EAGAIN)
+			spa_log_warn(this->log, "error reading eventfd: %s", spa_strerror(res));
+		return;
+	}
+
+	spa_log_trace(this->log, "%p: encoded packets ready", this);
+
+	if (this->transport == NULL || !this->transport_started ||
+	    this->transport->iso_io || this->flush_pending)
+		return;
+
+	spa_system_clock_gettime(this->data_system, CLOCK_MONOTONIC, &now);
+	flush_data(this, SPA_TIMESPEC_TO_NSEC(&now));
+}
+
 static void media_on_timeout(struct spa_source *source)
 {
 	struct impl *this = source->data;
@@ -1148,6 +1316,58 @@ static int do_start_iso_io(struct spa_loop *loop, bool async, uint32_t seq,
 	return 0;
 }
 
+static int start_encode_worker(struct impl *this)
+{
+	struct port *port = &this->port;
+	void *codec_data = this->codec_data;
+
+	if (this->transport->iso_io) {
+		/* The ISO group encodes silence with its own codec data on the data thread */
+		this->encode_codec_data = this->codec->init(this->codec, 0,
+				this->transport->configuration,
+				this->transport->configuration_len,
+				&port->current_format,
+				this->codec_props,
+				this->transport->write_mtu);
+		if (this->encode_codec_data == NULL)
+			return -EIO;
+		codec_data = this->encode_codec_data;
+	}
+
+	this->encode_worker = spa_bt_encode_worker_create(this->codec, codec_data,
+			port->frame_size, this->encode_lookahead, this->log, this->data_system,
+			this->thread_utils);
+	if (this->encode_worker == NULL) {
+		int res = -errno;
+		if (this->encode_codec_data)
+			this->codec->deinit(this->encode_codec_data);
+		this->encode_codec_data = NULL;
+		return res;
+	}
+
+	this->encode_source.data = this;
+	this->encode_source.fd = spa_bt_encode_worker_get_fd(this->encode_worker);
+	this->encode_source.func = media_on_encode_ready;
+	this->encode_source.mask = SPA_IO_IN;
+	this->encode_source.rmask = 0;
+	spa_loop_add_source(this->data_loop, &this->encode_source);
+
+	return 0;
+}
+
+static void stop_encode_worker(struct impl *this)
+{
+	if (this->encode_worker == NULL)
+		return;
+
+	spa_bt_encode_worker_destroy(this->encode_worker);
+	this->encode_worker = NULL;
+
+	if (this->encode_codec_data)
+		this->codec->deinit(this->encode_codec_data);
+	this->encode_codec_data = NULL;
+}
+
 static int transport_start(struct impl *this)
 {
 	int val, size;
@@ -1229,7 +1449,14 @@ static int transport_start(struct impl *this)
 
 	reset_buffer(this);
 
-	spa_bt_rate_control_init(&port->ratectl, 0);
+	if (this->use_encode_worker) {
+		int res;
+		if ((res = start_encode_worker(this)) < 0)
+			spa_log_warn(this->log, "%p: can't start encode worker, encoding on data loop: %s",
+					this, spa_strerror(res));
+	}
+
+	spa_jitter_rate_control_init(&port->ratectl, 0);
 
 	if (!this->transport->iso_io) {
 		this->flush_timer_source.data = this;
@@ -1328,6 +1555,9 @@ static int do_remove_transport_source(struct spa_loop *loop,
 		spa_loop_remove_source(this->data_loop, &this->flush_timer_source);
 	enable_flush_timer(this, false);
 
+	if (this->encode_source.loop)
+		spa_loop_remove_source(this->data_loop, &this->encode_source);
+
 	if (this->transport->iso_io)
 		spa_bt_iso_io_set_cb(this->transport->iso_io, NULL, NULL);
 
@@ -1343,6 +1573,8 @@ static void transport_stop(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_transport_source, 0, NULL, 0, true, this);
 
+	stop_encode_worker(this);
+
 	if (this->codec_data && this->own_codec_data)
 		this->codec->deinit(this->codec_data);
 	this->codec_data = NULL;
@@ -2044,6 +2276,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
 	this->data_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataLoop);
 	this->data_system = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_DataSystem);
+	this->thread_utils = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_ThreadUtils);
 
 	spa_log_topic_init(this->log, &log_topic);
 
@@ -2137,6 +2370,16 @@ impl_init(const struct spa_handle_factory *factory,
 	else
 		this->is_output = true;
 
+	this->encode_lookahead = DEFAULT_ENCODE_LOOKAHEAD;
+	if (this->transport->device->settings) {
+		const struct spa_dict *settings = this->transport->device->settings;
+
+		if ((str = spa_dict_lookup(settings, "bluez5.encode-thread")) != NULL)
+			this->use_encode_worker = spa_atob(str);
+		if ((str = spa_dict_lookup(settings, "bluez5.encode-lookahead")) != NULL)
+			spa_atou32(str, &this->encode_lookahead, 0);
+	}
+
 	reset_props(this, &this->props);
 
 	set_latency(this, false);
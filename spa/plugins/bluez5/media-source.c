@@ -83,7 +83,8 @@ struct port {
 	struct spa_list free;
 	struct spa_list ready;
 
-	struct spa_bt_decode_buffer buffer;
+	struct spa_jitter_buffer buffer;
+	void *buffer_data;
 };
 
 struct impl {
@@ -257,7 +258,7 @@ static int do_reassign_follower(struct spa_loop *loop,
 
 	set_timers(this);
 	if (this->transport_started)
-		spa_bt_decode_buffer_recover(&port->buffer);
+		spa_jitter_buffer_recover(&port->buffer);
 	return 0;
 }
 
@@ -495,7 +496,7 @@ static void media_on_ready_read(struct spa_source *source)
 	}
 
 	/* decode to buffer */
-	buf = spa_bt_decode_buffer_get_write(&port->buffer, &avail);
+	buf = spa_jitter_buffer_get_write(&port->buffer, &avail);
 	spa_log_trace(this->log, "read socket data size:%d, avail:%d", size_read, avail);
 	decoded = decode_data(this, this->buffer_read, size_read, buf, avail);
 	if (decoded < 0) {
@@ -511,7 +512,7 @@ static void media_on_ready_read(struct spa_source *source)
 	if (!this->started)
 		return;
 
-	spa_bt_decode_buffer_write_packet(&port->buffer, decoded);
+	spa_jitter_buffer_write_packet(&port->buffer, decoded);
 
 	dt = SPA_TIMESPEC_TO_NSEC(&this->now);
 	this->now = now;
@@ -657,15 +658,15 @@ static int transport_start(struct impl *this)
 
 	reset_buffers(port);
 
-	spa_bt_decode_buffer_clear(&port->buffer);
-	if ((res = spa_bt_decode_buffer_init(&port->buffer, this->log,
+	spa_bt_decode_buffer_clear(&port->buffer, &port->buffer_data);
+	if ((res = spa_bt_decode_buffer_init(&port->buffer, &port->buffer_data, this->log,
 			port->frame_size, port->current_format.info.raw.rate,
 			this->quantum_limit, this->quantum_limit)) < 0)
 		return res;
 
 	if (this->is_duplex) {
 		/* 80 ms max buffer */
-		spa_bt_decode_buffer_set_max_latency(&port->buffer,
+		spa_jitter_buffer_set_max_latency(&port->buffer,
 				port->current_format.info.raw.rate * 80 / 1000);
 	}
 
@@ -781,7 +782,7 @@ static void transport_stop(struct impl *this)
 		this->codec->deinit(this->codec_data);
 	this->codec_data = NULL;
 
-	spa_bt_decode_buffer_clear(&port->buffer);
+	spa_bt_decode_buffer_clear(&port->buffer, &port->buffer_data);
 }
 
 static int do_stop(struct impl *this)
@@ -1339,7 +1340,7 @@ static void update_target_latency(struct impl *this)
 	 * DBus properties, with some default value on BlueZ side if unspecified.
 	 */
 
-	spa_bt_decode_buffer_set_target_latency(&port->buffer, samples);
+	spa_jitter_buffer_set_target_latency(&port->buffer, samples);
 }
 
 static void process_buffering(struct impl *this)
@@ -1347,17 +1348,13 @@ static void process_buffering(struct impl *this)
 	struct port *port = &this->port;
 	uint32_t duration;
 	const uint32_t samples = get_samples(this, &duration);
-	uint32_t avail;
-	void *buf;
 
 	update_target_latency(this);
 
-	spa_bt_decode_buffer_process(&port->buffer, samples, duration);
+	spa_jitter_buffer_process(&port->buffer, samples, duration);
 
 	setup_matching(this);
 
-	buf = spa_bt_decode_buffer_get_read(&port->buffer, &avail);
-
 	/* copy data to buffers */
 	if (!spa_list_is_empty(&port->free)) {
 		struct buffer *buffer;
@@ -1366,10 +1363,6 @@ static void process_buffering(struct impl *this)
 
 		data_size = samples * port->frame_size;
 
-		avail = SPA_MIN(avail, data_size);
-
-		spa_bt_decode_buffer_read(&port->buffer, avail);
-
 		buffer = spa_list_first(&port->free, struct buffer, link);
 		spa_list_remove(&buffer->link);
 
@@ -1389,11 +1382,8 @@ static void process_buffering(struct impl *this)
 		datas[0].chunk->size = data_size;
 		datas[0].chunk->stride = port->frame_size;
 
-		memcpy(datas[0].data, buf, avail);
-
-		/* pad with silence */
-		if (avail < data_size)
-			memset(SPA_PTROFF(datas[0].data, avail, void), 0, data_size - avail);
+		/* missing data is padded with silence */
+		spa_jitter_buffer_read(&port->buffer, datas[0].data, data_size);
 
 		this->sample_count += samples;
 
@@ -1588,7 +1578,7 @@ static int impl_clear(struct spa_handle *handle)
 	if (this->transport)
 		spa_hook_remove(&this->transport_listener);
 	spa_system_close(this->data_system, this->timerfd);
-	spa_bt_decode_buffer_clear(&port->buffer);
+	spa_bt_decode_buffer_clear(&port->buffer, &port->buffer_data);
 	return 0;
 }
 
@@ -82,7 +82,8 @@ struct port {
 	struct spa_list free;
 	struct spa_list ready;
 
-	struct spa_bt_decode_buffer buffer;
+	struct spa_jitter_buffer buffer;
+	void *buffer_data;
 };
 
 struct impl {
@@ -234,7 +235,7 @@ static int do_reassign_follower(struct spa_loop *loop,
 
 	set_timers(this);
 	if (this->transport_started)
-		spa_bt_decode_buffer_recover(&port->buffer);
+		spa_jitter_buffer_recover(&port->buffer);
 	return 0;
 }
 
@@ -452,7 +453,7 @@ static uint32_t preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_da
 		 * Handle found mSBC packet
 		 */
 
-		buf = spa_bt_decode_buffer_get_write(&port->buffer, &avail);
+		buf = spa_jitter_buffer_get_write(&port->buffer, &avail);
 
 		/* Check sequence number */
 		seq = ((this->msbc_buffer[1] >> 4) & 1) |
@@ -485,7 +486,7 @@ static uint32_t preprocess_and_decode_msbc_data(void *userdata, uint8_t *read_da
 			continue;
 		}
 
-		spa_bt_decode_buffer_write_packet(&port->buffer, written);
+		spa_jitter_buffer_write_packet(&port->buffer, written);
 		decoded += written;
 	}
 
@@ -541,10 +542,10 @@ static int sco_source_cb(void *userdata, uint8_t *read_data, int size_read)
 			return 0;
 		}
 
-		packet = spa_bt_decode_buffer_get_write(&port->buffer, &avail);
+		packet = spa_jitter_buffer_get_write(&port->buffer, &avail);
 		avail = SPA_MIN(avail, (uint32_t)size_read);
 		spa_memmove(packet, read_data, avail);
-		spa_bt_decode_buffer_write_packet(&port->buffer, avail);
+		spa_jitter_buffer_write_packet(&port->buffer, avail);
 
 		decoded = avail;
 	}
@@ -675,14 +676,14 @@ static int transport_start(struct impl *this)
 	/* Reset the buffers and sample count */
 	reset_buffers(port);
 
-	spa_bt_decode_buffer_clear(&port->buffer);
-	if ((res = spa_bt_decode_buffer_init(&port->buffer, this->log,
+	spa_bt_decode_buffer_clear(&port->buffer, &port->buffer_data);
+	if ((res = spa_bt_decode_buffer_init(&port->buffer, &port->buffer_data, this->log,
 			port->frame_size, port->current_format.info.raw.rate,
 			this->quantum_limit, this->quantum_limit)) < 0)
 		return res;
 
 	/* 40 ms max buffer */
-	spa_bt_decode_buffer_set_max_latency(&port->buffer,
+	spa_jitter_buffer_set_max_latency(&port->buffer,
 			port->current_format.info.raw.rate * 40 / 1000);
 
 	/* Init mSBC if needed */
@@ -797,7 +798,7 @@ static void transport_stop(struct impl *this)
 
 	spa_loop_invoke(this->data_loop, do_remove_transport_source, 0, NULL, 0, true, this);
 
-	spa_bt_decode_buffer_clear(&port->buffer);
+	spa_bt_decode_buffer_clear(&port->buffer, &port->buffer_data);
 }
 
 static int do_stop(struct impl *this)
@@ -1303,15 +1304,11 @@ static void process_buffering(struct impl *this)
 	struct port *port = &this->port;
 	uint32_t duration;
 	const uint32_t samples = get_samples(this, &duration);
-	void *buf;
-	uint32_t avail;
 
-	spa_bt_decode_buffer_process(&port->buffer, samples, duration);
+	spa_jitter_buffer_process(&port->buffer, samples, duration);
 
 	setup_matching(this);
 
-	buf = spa_bt_decode_buffer_get_read(&port->buffer, &avail);
-
 	/* copy data to buffers */
 	if (!spa_list_is_empty(&port->free)) {
 		struct buffer *buffer;
@@ -1320,10 +1317,6 @@ static void process_buffering(struct impl *this)
 
 		data_size = samples * port->frame_size;
 
-		avail = SPA_MIN(avail, data_size);
-
-		spa_bt_decode_buffer_read(&port->buffer, avail);
-
 		buffer = spa_list_first(&port->free, struct buffer, link);
 		spa_list_remove(&buffer->link);
 
@@ -1337,11 +1330,8 @@ static void process_buffering(struct impl *this)
 		datas[0].chunk->size = data_size;
 		datas[0].chunk->stride = port->frame_size;
 
-		memcpy(datas[0].data, buf, avail);
-
-		/* pad with silence */
-		if (avail < data_size)
-			memset(SPA_PTROFF(datas[0].data, avail, void), 0, data_size - avail);
+		/* missing data is padded with silence */
+		spa_jitter_buffer_read(&port->buffer, datas[0].data, data_size);
 
 		/* ready buffer if full */
 		spa_log_trace(this->log, "queue %d frames:%d", buffer->id, (int)samples);
@@ -1522,7 +1512,7 @@ static int impl_clear(struct spa_handle *handle)
 	if (this->transport)
 		spa_hook_remove(&this->transport_listener);
 	spa_system_close(this->data_system, this->timerfd);
-	spa_bt_decode_buffer_clear(&this->port.buffer);
+	spa_bt_decode_buffer_clear(&this->port.buffer, &this->port.buffer_data);
 	return 0;
 }
 
@@ -0,0 +1,529 @@
+/* Spa FFmpeg encode/decode round trip benchmark */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+
+#include <spa/support/plugin.h>
+#include <spa/support/loop.h>
+#include <spa/support/log-impl.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/node/utils.h>
+#include <spa/buffer/alloc.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/utils/names.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/string.h>
+#include <spa/utils/result.h>
+
+#include "ffmpeg.h"
+
+SPA_LOG_IMPL(logger);
+
+#define DEFAULT_FRAMES		300
+#define DEFAULT_WIDTH		1280
+#define DEFAULT_HEIGHT		720
+#define DEFAULT_CODEC		"mjpeg"
+
+#define N_IN_BUFFERS		4
+#define N_PKT_BUFFERS		8
+#define N_OUT_BUFFERS		16
+#define MAX_IN_FLIGHT		4
+#define N_TIMES			256
+#define TIMEOUT_NS		(5 * SPA_NSEC_PER_SEC)
+
+#define CHECK_MIN_PSNR		30.0
+
+struct node {
+	struct spa_handle *handle;
+	struct spa_node *node;
+	struct spa_buffer **in_buffers;
+	struct spa_buffer **out_buffers;
+};
+
+struct data {
+	bool verbose;
+	bool check;
+	uint32_t n_frames;
+	uint32_t width;
+	uint32_t height;
+	const char *codec;
+	const char *threads;
+	const char *thread_type;
+
+	struct spa_loop main_loop;
+	struct spa_support support[2];
+
+	struct node enc;
+	struct node dec;
+
+	struct spa_io_buffers src_io;
+	struct spa_io_buffers pkt_io;
+	struct spa_io_buffers out_io;
+
+	uint64_t in_time[N_TIMES];
+	uint64_t fed;
+	uint64_t packets;
+	uint64_t decoded;
+	uint64_t bytes;
+	double latency_sum;
+	double latency_max;
+	double min_psnr;
+};
+
+#define OPTIONS		"hvCf:s:c:t:T:"
+static const struct option long_options[] = {
+	{ "help",	no_argument,		NULL, 'h'},
+	{ "verbose",	no_argument,		NULL, 'v'},
+	{ "check",	no_argument,		NULL, 'C'},
+	{ "frames",	required_argument,	NULL, 'f' },
+	{ "size",	required_argument,	NULL, 's' },
+	{ "codec",	required_argument,	NULL, 'c' },
+	{ "threads",	required_argument,	NULL, 't' },
+	{ "thread-type",required_argument,	NULL, 'T' },
+        { NULL, 0, NULL, 0 }
+};
+
+static void show_usage(const char *name, bool is_error)
+{
+	FILE *fp;
+
+	fp = is_error ? stderr : stdout;
+
+	fprintf(fp, "%s [options]\n", name);
+	fprintf(fp,
+		"  -h, --help                            Show this help\n"
+		"  -v  --verbose                         Be verbose\n"
+		"  -C  --check                           Fail on lost frames or bad quality\n"
+		"\n");
+	fprintf(fp,
+		"  -f  --frames                          Frames to encode and decode (default %u)\n"
+		"  -s  --size                            Size of the test pattern (default %ux%u)\n"
+		"  -c  --codec                           libavcodec encoder (default %s)\n"
+		"  -t  --threads                         Codec threads, 0 is automatic (default 0)\n"
+		"  -T  --thread-type                     frame, slice or frame+slice\n"
+		"\n",
+		DEFAULT_FRAMES, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_CODEC);
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* the nodes only invoke on the main loop to update their params, there
+ * are no listeners here */
+static int loop_invoke(void *object, spa_invoke_func_t func, uint32_t seq,
+		const void *data, size_t size, bool block, void *user_data)
+{
+	return func ? func(object, false, seq, data, size, user_data) : 0;
+}
+
+static const struct spa_loop_methods loop_methods = {
+	SPA_VERSION_LOOP_METHODS,
+	.invoke = loop_invoke,
+};
+
+/* moving bars and a gradient, like the videotestsrc patterns */
+static inline uint8_t pattern_luma(uint32_t x, uint32_t y, uint64_t frame)
+{
+	return ((((x + frame * 4) / 32) & 1) ? 180 : 60) + (y * 48) / DEFAULT_HEIGHT % 48;
+}
+
+static void fill_frame(struct data *d, struct spa_buffer *buf, uint64_t frame)
+{
+	struct spa_data *sd = &buf->datas[0];
+	struct spa_meta_header *h;
+	uint8_t *p = sd->data;
+	uint32_t x, y, cw = (d->width + 1) / 2, ch = (d->height + 1) / 2;
+
+	for (y = 0; y < d->height; y++)
+		for (x = 0; x < d->width; x++)
+			*p++ = pattern_luma(x, y, frame);
+	for (y = 0; y < ch; y++)
+		for (x = 0; x < cw; x++)
+			*p++ = 128 + ((x * 64) / cw);
+	for (y = 0; y < ch; y++)
+		for (x = 0; x < cw; x++)
+			*p++ = 128 - ((y * 64) / ch);
+
+	sd->chunk->offset = 0;
+	sd->chunk->size = p - (uint8_t*)sd->data;
+	sd->chunk->stride = d->width;
+
+	if ((h = spa_buffer_find_meta_data(buf, SPA_META_Header, sizeof(*h))) != NULL) {
+		h->flags = 0;
+		h->pts = frame;
+		h->seq = frame;
+	}
+}
+
+static double luma_psnr(struct data *d, const uint8_t *luma, uint32_t stride, uint64_t frame)
+{
+	uint32_t x, y;
+	double mse = 0.0;
+
+	for (y = 0; y < d->height; y++) {
+		for (x = 0; x < d->width; x++) {
+			double diff = (double)luma[y * stride + x] - pattern_luma(x, y, frame);
+			mse += diff * diff;
+		}
+	}
+	mse /= d->width * d->height;
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+static int make_node(struct data *d, struct node *n, const char *factory_name,
+		const struct spa_dict *props)
+{
+	const struct spa_handle_factory *factory = NULL;
+	uint32_t index = 0;
+	void *iface;
+	int res;
+
+	while (spa_handle_factory_enum(&factory, &index) > 0) {
+		if (spa_streq(factory->name, factory_name))
+			break;
+		factory = NULL;
+	}
+	if (factory == NULL)
+		return -ENOENT;
+
+	if ((n->handle = calloc(1, spa_handle_factory_get_size(factory, props))) == NULL)
+		return -errno;
+	if ((res = spa_handle_factory_init(factory, n->handle, props,
+					d->support, SPA_N_ELEMENTS(d->support))) < 0) {
+		free(n->handle);
+		n->handle = NULL;
+		return res;
+	}
+	if ((res = spa_handle_get_interface(n->handle, SPA_TYPE_INTERFACE_Node, &iface)) < 0)
+		return res;
+	n->node = iface;
+	return 0;
+}
+
+static void free_node(struct node *n)
+{
+	if (n->handle) {
+		spa_handle_clear(n->handle);
+		free(n->handle);
+	}
+	free(n->in_buffers);
+	free(n->out_buffers);
+	spa_zero(*n);
+}
+
+/* allocate buffers as the port asks for in its first Buffers param */
+static struct spa_buffer **alloc_buffers(struct spa_node *node, enum spa_direction direction,
+		uint32_t n_buffers)
+{
+	struct spa_data datas[SPA_FFMPEG_MAX_PLANES];
+	struct spa_meta metas[1];
+	uint32_t aligns[SPA_FFMPEG_MAX_PLANES];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param;
+	uint32_t i, index = 0;
+	int32_t blocks = 1, size = 0, align = 16;
+
+	if (spa_node_port_enum_params_sync(node, direction, 0, SPA_PARAM_Buffers,
+				&index, NULL, &param, &b) != 1)
+		return NULL;
+	if (spa_pod_parse_object(param, SPA_TYPE_OBJECT_ParamBuffers, NULL,
+			SPA_PARAM_BUFFERS_blocks, SPA_POD_OPT_Int(&blocks),
+			SPA_PARAM_BUFFERS_size,   SPA_POD_OPT_Int(&size),
+			SPA_PARAM_BUFFERS_align,  SPA_POD_OPT_Int(&align)) < 0)
+		return NULL;
+	if (blocks < 1 || blocks > SPA_FFMPEG_MAX_PLANES || size <= 0)
+		return NULL;
+
+	metas[0].type = SPA_META_Header;
+	metas[0].size = sizeof(struct spa_meta_header);
+	for (i = 0; i < (uint32_t)blocks; i++) {
+		spa_zero(datas[i]);
+		datas[i].type = SPA_DATA_MemPtr;
+		datas[i].flags = SPA_DATA_FLAG_READWRITE;
+		datas[i].maxsize = size;
+		aligns[i] = align;
+	}
+	return spa_buffer_alloc_array(n_buffers, 0, 1, metas, blocks, datas, aligns);
+}
+
+static int set_format(struct spa_node *node, enum spa_direction direction,
+		uint32_t subtype, struct data *d)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod *param;
+
+	if (subtype == SPA_MEDIA_SUBTYPE_raw)
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_VIDEO_format,    SPA_POD_Id(SPA_VIDEO_FORMAT_I420),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&SPA_RECTANGLE(d->width, d->height)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&SPA_FRACTION(30, 1)));
+	else
+		param = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(subtype),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&SPA_RECTANGLE(d->width, d->height)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&SPA_FRACTION(30, 1)));
+
+	return spa_node_port_set_param(node, direction, 0, SPA_PARAM_Format, 0, param);
+}
+
+static int setup(struct data *d)
+{
+	const AVCodec *codec;
+	struct spa_dict_item items[3];
+	uint32_t n_items = 0, subtype;
+	int res;
+
+	if ((codec = avcodec_find_encoder_by_name(d->codec)) == NULL ||
+	    (subtype = spa_ffmpeg_codec_to_subtype(codec->id)) == SPA_MEDIA_SUBTYPE_unknown) {
+		fprintf(stderr, "unsupported encoder %s\n", d->codec);
+		return -ENOTSUP;
+	}
+
+	if (d->threads)
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREADS, d->threads);
+	if (d->thread_type)
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREAD_TYPE, d->thread_type);
+	if ((res = make_node(d, &d->dec, SPA_NAME_API_CODEC_FFMPEG_DECODER,
+					&SPA_DICT_INIT(items, n_items))) < 0)
+		return res;
+
+	items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_CODEC, d->codec);
+	if ((res = make_node(d, &d->enc, SPA_NAME_API_CODEC_FFMPEG_ENCODER,
+					&SPA_DICT_INIT(items, n_items))) < 0)
+		return res;
+
+	if ((res = set_format(d->enc.node, SPA_DIRECTION_INPUT, SPA_MEDIA_SUBTYPE_raw, d)) < 0 ||
+	    (res = set_format(d->enc.node, SPA_DIRECTION_OUTPUT, subtype, d)) < 0 ||
+	    (res = set_format(d->dec.node, SPA_DIRECTION_INPUT, subtype, d)) < 0 ||
+	    (res = set_format(d->dec.node, SPA_DIRECTION_OUTPUT, SPA_MEDIA_SUBTYPE_raw, d)) < 0)
+		return res;
+
+	/* the encoder output and the decoder input share the buffers and
+	 * the io area, like a link in the graph */
+	d->enc.in_buffers = alloc_buffers(d->enc.node, SPA_DIRECTION_INPUT, N_IN_BUFFERS);
+	d->enc.out_buffers = alloc_buffers(d->enc.node, SPA_DIRECTION_OUTPUT, N_PKT_BUFFERS);
+	d->dec.out_buffers = alloc_buffers(d->dec.node, SPA_DIRECTION_OUTPUT, N_OUT_BUFFERS);
+	if (d->enc.in_buffers == NULL || d->enc.out_buffers == NULL || d->dec.out_buffers == NULL)
+		return -ENOMEM;
+
+	if ((res = spa_node_port_use_buffers(d->enc.node, SPA_DIRECTION_INPUT, 0, 0,
+				d->enc.in_buffers, N_IN_BUFFERS)) < 0 ||
+	    (res = spa_node_port_use_buffers(d->enc.node, SPA_DIRECTION_OUTPUT, 0, 0,
+				d->enc.out_buffers, N_PKT_BUFFERS)) < 0 ||
+	    (res = spa_node_port_use_buffers(d->dec.node, SPA_DIRECTION_INPUT, 0, 0,
+				d->enc.out_buffers, N_PKT_BUFFERS)) < 0 ||
+	    (res = spa_node_port_use_buffers(d->dec.node, SPA_DIRECTION_OUTPUT, 0, 0,
+				d->dec.out_buffers, N_OUT_BUFFERS)) < 0)
+		return res;
+
+	d->src_io = SPA_IO_BUFFERS_INIT;
+	d->pkt_io = SPA_IO_BUFFERS_INIT;
+	d->out_io = SPA_IO_BUFFERS_INIT;
+	spa_node_port_set_io(d->enc.node, SPA_DIRECTION_INPUT, 0, SPA_IO_Buffers,
+			&d->src_io, sizeof(d->src_io));
+	spa_node_port_set_io(d->enc.node, SPA_DIRECTION_OUTPUT, 0, SPA_IO_Buffers,
+			&d->pkt_io, sizeof(d->pkt_io));
+	spa_node_port_set_io(d->dec.node, SPA_DIRECTION_INPUT, 0, SPA_IO_Buffers,
+			&d->pkt_io, sizeof(d->pkt_io));
+	spa_node_port_set_io(d->dec.node, SPA_DIRECTION_OUTPUT, 0, SPA_IO_Buffers,
+			&d->out_io, sizeof(d->out_io));
+
+	if ((res = spa_node_send_command(d->enc.node,
+				&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start))) < 0 ||
+	    (res = spa_node_send_command(d->dec.node,
+				&SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Start))) < 0)
+		return res;
+
+	return 0;
+}
+
+static void output_frame(struct data *d, uint64_t now)
+{
+	struct spa_buffer *buf = d->dec.out_buffers[d->out_io.buffer_id];
+	struct spa_meta_header *h;
+	struct spa_data *sd = &buf->datas[0];
+	uint64_t frame = d->decoded;
+	double latency;
+
+	if ((h = spa_buffer_find_meta_data(buf, SPA_META_Header, sizeof(*h))) != NULL)
+		frame = h->pts;
+
+	latency = (now - d->in_time[frame % N_TIMES]) / 1e6;
+	d->latency_sum += latency;
+	d->latency_max = SPA_MAX(d->latency_max, latency);
+
+	if (d->check) {
+		double psnr = luma_psnr(d, SPA_PTROFF(sd->data, sd->chunk->offset, uint8_t),
+				sd->chunk->stride, frame);
+		d->min_psnr = SPA_MIN(d->min_psnr, psnr);
+	}
+	if (d->verbose)
+		fprintf(stderr, "frame %"PRIu64": %.3f ms\n", frame, latency);
+
+	d->decoded++;
+}
+
+/* Runs the cycles of a graph with a source, the encoder, the decoder and
+ * a sink as fast as the codecs allow. A frame is only produced when less
+ * than MAX_IN_FLIGHT frames wait for the encoder, a source in the graph
+ * would drop them. */
+static int run(struct data *d, double *elapsed)
+{
+	uint64_t t0, now, last = get_time_ns();
+	uint32_t n_buf = 0;
+
+	t0 = last;
+	while (d->decoded < d->n_frames) {
+		bool progress = false;
+
+		now = get_time_ns();
+		if (d->src_io.status != SPA_STATUS_HAVE_DATA &&
+		    d->fed - d->packets < MAX_IN_FLIGHT) {
+			fill_frame(d, d->enc.in_buffers[n_buf], d->fed);
+			d->in_time[d->fed % N_TIMES] = now;
+			d->src_io.buffer_id = n_buf;
+			d->src_io.status = SPA_STATUS_HAVE_DATA;
+			n_buf = (n_buf + 1) % N_IN_BUFFERS;
+			d->fed++;
+		}
+
+		spa_node_process(d->enc.node);
+
+		if (d->pkt_io.status == SPA_STATUS_HAVE_DATA &&
+		    d->pkt_io.buffer_id < N_PKT_BUFFERS) {
+			d->bytes += d->enc.out_buffers[d->pkt_io.buffer_id]->datas[0].chunk->size;
+			d->packets++;
+			progress = true;
+		}
+
+		spa_node_process(d->dec.node);
+
+		if (d->out_io.status == SPA_STATUS_HAVE_DATA &&
+		    d->out_io.buffer_id < N_OUT_BUFFERS) {
+			now = get_time_ns();
+			output_frame(d, now);
+			d->out_io.status = SPA_STATUS_NEED_DATA;
+			progress = true;
+		}
+
+		if (progress) {
+			last = now;
+		} else {
+			if (get_time_ns() - last > TIMEOUT_NS)
+				return -ETIMEDOUT;
+			nanosleep(&(struct timespec) { 0, 100000 }, NULL);
+		}
+	}
+	*elapsed = (get_time_ns() - t0) / 1e9;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0 }, *d = &data;
+	double elapsed;
+	int c, res;
+
+	d->n_frames = DEFAULT_FRAMES;
+	d->width = DEFAULT_WIDTH;
+	d->height = DEFAULT_HEIGHT;
+	d->codec = DEFAULT_CODEC;
+	d->min_psnr = 99.0;
+
+	while ((c = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_usage(argv[0], false);
+			return 0;
+		case 'v':
+			d->verbose = true;
+			break;
+		case 'C':
+			d->check = true;
+			break;
+		case 'f':
+			d->n_frames = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &d->width, &d->height) != 2 ||
+			    d->width == 0 || d->height == 0) {
+				fprintf(stderr, "invalid size %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'c':
+			d->codec = optarg;
+			break;
+		case 't':
+			d->threads = optarg;
+			break;
+		case 'T':
+			d->thread_type = optarg;
+			break;
+		default:
+			show_usage(argv[0], true);
+			return -1;
+		}
+	}
+
+	d->main_loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Loop,
+			SPA_VERSION_LOOP, &loop_methods, d);
+	d->support[0] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Log, &logger.log);
+	d->support[1] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Loop, &d->main_loop);
+	if (d->verbose)
+		logger.log.level = SPA_LOG_LEVEL_INFO;
+
+	if ((res = setup(d)) < 0) {
+		fprintf(stderr, "can't set up %s: %s\n", d->codec, spa_strerror(res));
+		goto done;
+	}
+	if ((res = run(d, &elapsed)) < 0) {
+		fprintf(stderr, "%s: stalled after %"PRIu64" of %u frames\n",
+				d->codec, d->decoded, d->n_frames);
+		goto done;
+	}
+
+	fprintf(stdout, "%s %ux%u: %.1f fps, latency %.3f ms avg %.3f ms max, "
+			"%.1f kbit/frame", d->codec, d->width, d->height,
+			d->n_frames / elapsed, d->latency_sum / d->decoded,
+			d->latency_max, d->bytes * 8.0 / 1000.0 / SPA_MAX(d->packets, 1u));
+	if (d->check)
+		fprintf(stdout, ", luma PSNR %.2f dB min", d->min_psnr);
+	fprintf(stdout, "\n");
+
+	if (d->check && d->min_psnr < CHECK_MIN_PSNR) {
+		fprintf(stderr, "luma PSNR %.2f dB below %.2f dB\n",
+				d->min_psnr, CHECK_MIN_PSNR);
+		res = -EINVAL;
+	}
+done:
+	if (d->enc.node)
+		spa_node_send_command(d->enc.node, &SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Pause));
+	if (d->dec.node)
+		spa_node_send_command(d->dec.node, &SPA_NODE_COMMAND_INIT(SPA_NODE_COMMAND_Pause));
+	free_node(&d->dec);
+	free_node(&d->enc);
+
+	return res < 0 ? 1 : 0;
+}
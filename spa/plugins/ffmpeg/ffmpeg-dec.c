@@ -4,34 +4,67 @@
 
 #include <errno.h>
 #include <stddef.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <spa/utils/string.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/result.h>
 #include <spa/support/plugin.h>
 #include <spa/support/log.h>
+#include <spa/support/loop.h>
 #include <spa/node/node.h>
 #include <spa/node/utils.h>
 #include <spa/node/io.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/param.h>
 #include <spa/param/video/format-utils.h>
 #include <spa/param/video/format.h>
 #include <spa/pod/filter.h>
 
+#include <libavutil/pixdesc.h>
+
 #include "ffmpeg.h"
 
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.ffmpeg.dec");
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
 #define GET_PORT(this,d,p)		(d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
 
-#define MAX_BUFFERS    32
+#define MAX_BUFFERS	32
+#define MAX_PACKETS	16
+#define STRIDE_ALIGN	64
+
+#define DEFAULT_WIDTH	640
+#define DEFAULT_HEIGHT	480
+
+/* an output buffer is free when it is neither held by the codec, as a
+ * frame or reference, nor by the graph */
+#define BUFFER_FLAG_CODEC	(1<<0)
+#define BUFFER_FLAG_GRAPH	(1<<1)
 
 struct buffer {
 	uint32_t id;
 	uint32_t flags;
+	uint32_t codec_refs;
 	struct spa_buffer *outbuf;
-	struct spa_list link;
+	struct spa_meta_header *h;
+	struct spa_ffmpeg_layout layout;
+	struct impl *impl;
+};
+
+struct packet {
+	uint8_t *data;
+	uint32_t size;
+	uint32_t maxsize;
+	int64_t pts;
+	uint32_t flags;
 };
 
 struct port {
@@ -49,9 +82,6 @@ struct port {
 	uint32_t n_buffers;
 
 	struct spa_io_buffers *io;
-
-	struct spa_list free;
-	struct spa_list ready;
 };
 
 struct impl {
@@ -59,6 +89,7 @@ struct impl {
 	struct spa_node node;
 
 	struct spa_log *log;
+	struct spa_loop *main_loop;
 
 	uint64_t info_all;
 	struct spa_node_info info;
@@ -69,6 +100,41 @@ struct impl {
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *avpkt;
+	AVFrame *frame;
+	char thread_type[16];
+	int threads;
+
+	/* the format that the codec produces, the output port offers only
+	 * this format once it is known */
+	enum AVPixelFormat dec_pix_fmt;
+	uint32_t dec_width;
+	uint32_t dec_height;
+
+	struct packet packets[MAX_PACKETS];
+	uint32_t free_packets[MAX_PACKETS];
+	uint32_t n_free_packets;
+
+	/* data thread -> worker */
+	struct spa_ffmpeg_queue packet_queue;
+	struct spa_ffmpeg_queue recycle_queue;
+	/* worker -> data thread */
+	struct spa_ffmpeg_queue done_queue;
+	struct spa_ffmpeg_queue ready_queue;
+
+	struct spa_ffmpeg_worker worker;
+
+	/* the free output buffers and their flags, used by the worker and
+	 * by the codec threads */
+	pthread_mutex_t lock;
+	uint32_t pool[MAX_BUFFERS];
+	uint32_t n_pool;
+
+	uint64_t seq;
+	uint32_t dropped;
+
 	bool started;
 };
 
@@ -91,19 +157,392 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	return -ENOTSUP;
 }
 
+static void pool_put(struct impl *this, struct buffer *b)
+{
+	this->pool[this->n_pool++] = b->id;
+}
+
+static struct buffer *pool_get(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	if (this->n_pool == 0)
+		return NULL;
+	return &port->buffers[this->pool[--this->n_pool]];
+}
+
+/* called with the lock */
+static void buffer_clear_flag(struct impl *this, struct buffer *b, uint32_t flag)
+{
+	if (!SPA_FLAG_IS_SET(b->flags, flag))
+		return;
+	SPA_FLAG_CLEAR(b->flags, flag);
+	if (b->flags == 0)
+		pool_put(this, b);
+}
+
+static void recycle_buffers(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t id;
+
+	pthread_mutex_lock(&this->lock);
+	while (spa_ffmpeg_queue_pop(&this->recycle_queue, &id)) {
+		if (id < port->n_buffers)
+			buffer_clear_flag(this, &port->buffers[id], BUFFER_FLAG_GRAPH);
+	}
+	pthread_mutex_unlock(&this->lock);
+}
+
+static void release_plane(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	struct impl *this = b->impl;
+
+	pthread_mutex_lock(&this->lock);
+	if (--b->codec_refs == 0)
+		buffer_clear_flag(this, b, BUFFER_FLAG_CODEC);
+	pthread_mutex_unlock(&this->lock);
+}
+
+static bool buffer_fits(struct buffer *b, const struct spa_ffmpeg_layout *l)
+{
+	struct spa_data *d = b->outbuf->datas;
+	uint32_t i;
+
+	if (l->n_blocks != b->outbuf->n_datas)
+		return false;
+
+	for (i = 0; i < l->n_blocks; i++) {
+		uint32_t size = l->n_blocks == 1 ?
+			l->offset[l->n_planes-1] + l->size[l->n_planes-1] : l->size[i];
+		if (d[i].data == NULL || d[i].maxsize < size ||
+		    !SPA_IS_ALIGNED(d[i].data, STRIDE_ALIGN))
+			return false;
+	}
+	return true;
+}
+
+/* Let the codec decode straight into a free output buffer when the
+ * layout that the codec needs fits in the buffer. The codec can be using
+ * the buffer as a reference for as long as it needs, the buffer returns
+ * to the pool when both the codec and the graph released it. */
+static int get_buffer2(AVCodecContext *ctx, AVFrame *frame, int flags)
+{
+	struct impl *this = ctx->opaque;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_ffmpeg_layout l;
+	struct buffer *b;
+	int w = frame->width, h = frame->height, i;
+	int align[AV_NUM_DATA_POINTERS];
+
+	if (!port->have_format || port->n_buffers == 0 ||
+	    frame->format != this->dec_pix_fmt ||
+	    (uint32_t)frame->width != this->dec_width ||
+	    (uint32_t)frame->height != this->dec_height)
+		goto fallback;
+
+	avcodec_align_dimensions2(ctx, &w, &h, align);
+	if (spa_ffmpeg_layout_init(&l, frame->format, w, h, STRIDE_ALIGN,
+				port->buffers[0].outbuf->n_datas) < 0)
+		goto fallback;
+
+	pthread_mutex_lock(&this->lock);
+	b = pool_get(this);
+	if (b != NULL && !buffer_fits(b, &l)) {
+		pool_put(this, b);
+		b = NULL;
+	}
+	if (b != NULL)
+		b->flags = BUFFER_FLAG_CODEC;
+	pthread_mutex_unlock(&this->lock);
+
+	if (b == NULL)
+		goto fallback;
+
+	b->layout = l;
+	b->codec_refs = 0;
+	for (i = 0; i < (int)l.n_planes; i++) {
+		struct spa_data *d = &b->outbuf->datas[l.n_blocks == 1 ? 0 : i];
+		uint8_t *data = SPA_PTROFF(d->data, l.offset[i], uint8_t);
+
+		frame->data[i] = data;
+		frame->linesize[i] = l.stride[i];
+		frame->buf[i] = av_buffer_create(data, l.size[i], release_plane, b, 0);
+		if (frame->buf[i] == NULL) {
+			while (--i >= 0)
+				av_buffer_unref(&frame->buf[i]);
+			pthread_mutex_lock(&this->lock);
+			if (b->codec_refs == 0)
+				buffer_clear_flag(this, b, BUFFER_FLAG_CODEC);
+			pthread_mutex_unlock(&this->lock);
+			return AVERROR(ENOMEM);
+		}
+		pthread_mutex_lock(&this->lock);
+		b->codec_refs++;
+		pthread_mutex_unlock(&this->lock);
+	}
+	frame->extended_data = frame->data;
+	return 0;
+
+fallback:
+	return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
+static struct buffer *find_direct_buffer(struct impl *this, const AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t i;
+
+	if (frame->buf[0] == NULL)
+		return NULL;
+	for (i = 0; i < port->n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		if (b->outbuf->datas[0].data == frame->buf[0]->data &&
+		    av_buffer_get_opaque(frame->buf[0]) == b)
+			return b;
+	}
+	return NULL;
+}
+
+static int do_format_changed(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data);
+
+static void check_format(struct impl *this, const AVFrame *frame)
+{
+	if (frame->format == this->dec_pix_fmt &&
+	    (uint32_t)frame->width == this->dec_width &&
+	    (uint32_t)frame->height == this->dec_height)
+		return;
+
+	spa_log_info(this->log, "%p: codec produces %s %dx%d", this,
+			av_get_pix_fmt_name(frame->format), frame->width, frame->height);
+
+	this->dec_pix_fmt = frame->format;
+	this->dec_width = frame->width;
+	this->dec_height = frame->height;
+
+	spa_loop_invoke(this->main_loop, do_format_changed, 0, NULL, 0, false, this);
+}
+
+static bool output_matches(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_video_info_raw *raw = &port->current_format.info.raw;
+
+	return port->have_format && port->n_buffers > 0 &&
+		spa_ffmpeg_pix_fmt_to_format(this->dec_pix_fmt) == raw->format &&
+		raw->size.width == this->dec_width &&
+		raw->size.height == this->dec_height;
+}
+
+static void fill_buffer(struct impl *this, struct buffer *b, const AVFrame *frame)
+{
+	struct spa_buffer *buf = b->outbuf;
+	struct spa_ffmpeg_layout *l = &b->layout;
+	uint32_t i;
+
+	if (l->n_blocks == 1) {
+		buf->datas[0].chunk->offset = 0;
+		buf->datas[0].chunk->size = l->offset[l->n_planes-1] + l->size[l->n_planes-1];
+		buf->datas[0].chunk->stride = l->stride[0];
+	} else {
+		for (i = 0; i < l->n_planes; i++) {
+			buf->datas[i].chunk->offset = 0;
+			buf->datas[i].chunk->size = l->size[i];
+			buf->datas[i].chunk->stride = l->stride[i];
+		}
+	}
+	if (b->h) {
+		b->h->flags = 0;
+		b->h->offset = 0;
+		b->h->seq = this->seq;
+		b->h->pts = frame->best_effort_timestamp;
+		b->h->dts_offset = 0;
+	}
+	this->seq++;
+}
+
+/* copy a frame that was not decoded into an output buffer */
+static struct buffer *copy_frame(struct impl *this, const AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct spa_video_info_raw *raw = &port->current_format.info.raw;
+	struct spa_data *d;
+	struct buffer *b;
+	uint8_t *dst[SPA_FFMPEG_MAX_PLANES];
+	int dst_stride[SPA_FFMPEG_MAX_PLANES];
+	uint32_t i;
+
+	pthread_mutex_lock(&this->lock);
+	if ((b = pool_get(this)) != NULL)
+		b->flags = BUFFER_FLAG_GRAPH;
+	pthread_mutex_unlock(&this->lock);
+
+	if (b == NULL)
+		return NULL;
+
+	/* the same layouts as in the Buffers params */
+	d = b->outbuf->datas;
+	if (b->outbuf->n_datas == 1) {
+		spa_ffmpeg_layout_init(&b->layout, frame->format, raw->size.width,
+				raw->size.height, 4, 1);
+	} else {
+		int w = raw->size.width, h = raw->size.height;
+		int align[AV_NUM_DATA_POINTERS];
+		avcodec_align_dimensions2(this->context, &w, &h, align);
+		spa_ffmpeg_layout_init(&b->layout, frame->format, w, h, STRIDE_ALIGN, 0);
+	}
+
+	for (i = 0; i < b->layout.n_planes; i++) {
+		uint32_t block = b->layout.n_blocks == 1 ? 0 : i;
+		if (d[block].data == NULL ||
+		    b->layout.offset[i] + b->layout.size[i] > d[block].maxsize) {
+			pthread_mutex_lock(&this->lock);
+			buffer_clear_flag(this, b, BUFFER_FLAG_GRAPH);
+			pthread_mutex_unlock(&this->lock);
+			return NULL;
+		}
+		dst[i] = SPA_PTROFF(d[block].data, b->layout.offset[i], uint8_t);
+		dst_stride[i] = b->layout.stride[i];
+	}
+	spa_ffmpeg_copy_planes(dst, dst_stride, frame->data, frame->linesize,
+			frame->format, frame->width, frame->height);
+	return b;
+}
+
+static void output_frame(struct impl *this, AVFrame *frame)
+{
+	struct buffer *b;
+
+	check_format(this, frame);
+
+	if (!output_matches(this)) {
+		this->dropped++;
+		return;
+	}
+	if ((b = find_direct_buffer(this, frame)) != NULL) {
+		pthread_mutex_lock(&this->lock);
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_GRAPH);
+		pthread_mutex_unlock(&this->lock);
+	} else if ((b = copy_frame(this, frame)) == NULL) {
+		spa_log_trace(this->log, "%p: out of buffers", this);
+		this->dropped++;
+		return;
+	}
+	fill_buffer(this, b, frame);
+	spa_ffmpeg_queue_push(&this->ready_queue, b->id);
+}
+
+static void decode_work(void *data)
+{
+	struct impl *this = data;
+	uint32_t index;
+	int res;
+
+	recycle_buffers(this);
+
+	while (spa_ffmpeg_queue_pop(&this->packet_queue, &index)) {
+		struct packet *p = &this->packets[index];
+
+		this->avpkt->data = p->data;
+		this->avpkt->size = p->size;
+		this->avpkt->pts = p->pts;
+		this->avpkt->flags = p->flags;
+
+		res = avcodec_send_packet(this->context, this->avpkt);
+		spa_ffmpeg_queue_push(&this->done_queue, index);
+
+		if (res < 0 && res != AVERROR(EAGAIN)) {
+			spa_log_warn(this->log, "%p: decode error: %d", this, res);
+			continue;
+		}
+		while (avcodec_receive_frame(this->context, this->frame) >= 0) {
+			recycle_buffers(this);
+			output_frame(this, this->frame);
+			av_frame_unref(this->frame);
+		}
+	}
+}
+
+static void reset_buffers(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t i, id;
+
+	spa_ffmpeg_queue_init(&this->packet_queue);
+	spa_ffmpeg_queue_init(&this->done_queue);
+
+	this->n_free_packets = 0;
+	for (i = 0; i < MAX_PACKETS; i++)
+		this->free_packets[this->n_free_packets++] = i;
+
+	pthread_mutex_lock(&this->lock);
+	while (spa_ffmpeg_queue_pop(&this->recycle_queue, &id)) {
+		if (id < port->n_buffers)
+			buffer_clear_flag(this, &port->buffers[id], BUFFER_FLAG_GRAPH);
+	}
+	while (spa_ffmpeg_queue_pop(&this->ready_queue, &id)) {
+		if (id < port->n_buffers)
+			buffer_clear_flag(this, &port->buffers[id], BUFFER_FLAG_GRAPH);
+	}
+	pthread_mutex_unlock(&this->lock);
+}
+
+static int start_decoder(struct impl *this)
+{
+	int res;
+
+	if (this->started)
+		return 0;
+	if (this->context == NULL)
+		return -EIO;
+
+	reset_buffers(this);
+	if ((res = spa_ffmpeg_worker_start(&this->worker, decode_work, this)) < 0)
+		return res;
+	this->started = true;
+	return 0;
+}
+
+static void stop_decoder(struct impl *this)
+{
+	if (!this->started)
+		return;
+
+	spa_ffmpeg_worker_stop(&this->worker);
+	this->started = false;
+
+	/* drops the references of the codec to the output buffers */
+	avcodec_flush_buffers(this->context);
+	reset_buffers(this);
+
+	if (this->dropped)
+		spa_log_info(this->log, "%p: dropped %u frames", this, this->dropped);
+	this->dropped = 0;
+}
+
 static int impl_node_send_command(void *object, const struct spa_command *command)
 {
 	struct impl *this = object;
+	int res;
 
 	if (this == NULL || command == NULL)
 		return -EINVAL;
 
 	switch (SPA_NODE_COMMAND_ID(command)) {
 	case SPA_NODE_COMMAND_Start:
-		this->started = true;
+		if ((res = start_decoder(this)) < 0)
+			return res;
 		break;
 	case SPA_NODE_COMMAND_Pause:
-		this->started = false;
+	case SPA_NODE_COMMAND_Suspend:
+		stop_decoder(this);
+		break;
+	case SPA_NODE_COMMAND_Flush:
+		if (this->started) {
+			stop_decoder(this);
+			return start_decoder(this);
+		}
 		break;
 	default:
 		return -ENOTSUP;
@@ -134,6 +573,18 @@ static void emit_port_info(struct impl *this, struct port *port, bool full)
 	}
 }
 
+static int do_format_changed(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *this = user_data;
+	struct port *port = GET_OUT_PORT(this, 0);
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	port->params[0].user++;
+	emit_port_info(this, port, false);
+	return 0;
+}
+
 static int
 impl_node_add_listener(void *object,
 		struct spa_hook *listener,
@@ -179,6 +630,23 @@ impl_node_remove_port(void *object,
 	return -ENOTSUP;
 }
 
+static uint32_t input_subtype(struct impl *this, uint32_t index)
+{
+	uint32_t i, n = 0, subtype;
+
+	if (this->codec != NULL)
+		return index == 0 ? spa_ffmpeg_codec_to_subtype(this->codec->id) :
+			SPA_MEDIA_SUBTYPE_unknown;
+
+	for (i = 0; (subtype = spa_ffmpeg_subtype_by_index(i)) != SPA_MEDIA_SUBTYPE_unknown; i++) {
+		if (avcodec_find_decoder(spa_ffmpeg_subtype_to_codec(subtype)) == NULL)
+			continue;
+		if (n++ == index)
+			return subtype;
+	}
+	return SPA_MEDIA_SUBTYPE_unknown;
+}
+
 static int port_enum_formats(void *object,
 			     enum spa_direction direction, uint32_t port_id,
 			     uint32_t index,
@@ -186,16 +654,70 @@ static int port_enum_formats(void *object,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
+	struct impl *this = object;
+	struct port *in = GET_IN_PORT(this, 0);
+	struct spa_rectangle size = SPA_RECTANGLE(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+	struct spa_fraction framerate = SPA_FRACTION(25, 1);
+	struct spa_pod_frame f[2];
+	uint32_t subtype;
+
 	if (!IS_VALID_PORT(object, direction, port_id))
 		return -EINVAL;
 
-	switch (index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
+	if (direction == SPA_DIRECTION_INPUT) {
+		if ((subtype = input_subtype(this, index)) == SPA_MEDIA_SUBTYPE_unknown)
+			return 0;
+
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype),
+			SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+								&size,
+								&SPA_RECTANGLE(1, 1),
+								&SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+								&framerate,
+								&SPA_FRACTION(0, 1),
+								&SPA_FRACTION(INT32_MAX, 1)));
+		return 1;
+	}
+
+	if (index > 0)
 		return 0;
+
+	/* the size and format follow from the stream, until the codec has
+	 * decoded a frame, offer what the input format and the codec
+	 * suggest */
+	if (in->have_format) {
+		size = in->current_format.info.raw.size;
+		framerate = in->current_format.info.raw.framerate;
+	}
+	if (this->dec_width > 0)
+		size = SPA_RECTANGLE(this->dec_width, this->dec_height);
+
+	spa_pod_builder_push_object(builder, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(builder,
+		SPA_FORMAT_mediaType,    SPA_POD_Id(SPA_MEDIA_TYPE_video),
+		SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+		0);
+	spa_pod_builder_prop(builder, SPA_FORMAT_VIDEO_format, 0);
+	if (this->dec_pix_fmt != AV_PIX_FMT_NONE) {
+		spa_pod_builder_id(builder, spa_ffmpeg_pix_fmt_to_format(this->dec_pix_fmt));
+	} else {
+		spa_pod_builder_push_choice(builder, &f[1], SPA_CHOICE_Enum, 0);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_I420);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_I420);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_Y42B);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_Y444);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_NV12);
+		spa_pod_builder_pop(builder, &f[1]);
 	}
+	spa_pod_builder_add(builder,
+		SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&size),
+		SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&framerate),
+		0);
+	*param = spa_pod_builder_pop(builder, &f[0]);
 	return 1;
 }
 
@@ -217,8 +739,75 @@ static int port_get_format(void *object,
 	if (index > 0)
 		return 0;
 
-	*param = NULL;
+	if (direction == SPA_DIRECTION_OUTPUT) {
+		*param = spa_format_video_raw_build(builder, SPA_PARAM_Format,
+				&port->current_format.info.raw);
+	} else {
+		struct spa_video_info_raw *raw = &port->current_format.info.raw;
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(port->current_format.media_subtype),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&raw->size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&raw->framerate));
+	}
+	return 1;
+}
 
+static int port_enum_buffers(struct impl *this, struct port *port, uint32_t index,
+		struct spa_pod **param, struct spa_pod_builder *builder)
+{
+	struct spa_video_info_raw *raw = &port->current_format.info.raw;
+	struct spa_ffmpeg_layout l;
+	enum AVPixelFormat pix_fmt;
+	int w, h, align[AV_NUM_DATA_POINTERS];
+	uint32_t i, size = 0;
+
+	if (port->direction == SPA_DIRECTION_INPUT) {
+		if (index > 0)
+			return 0;
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(4, 1, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
+							raw->size.width * raw->size.height * 3 / 2,
+							4096, INT32_MAX),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(0));
+		return 1;
+	}
+
+	pix_fmt = spa_ffmpeg_format_to_pix_fmt(raw->format);
+	w = raw->size.width;
+	h = raw->size.height;
+
+	switch (index) {
+	case 0:
+		/* one block per plane with the padding that the codec needs
+		 * for decoding into the buffers directly */
+		if (this->context)
+			avcodec_align_dimensions2(this->context, &w, &h, align);
+		if (spa_ffmpeg_layout_init(&l, pix_fmt, w, h, STRIDE_ALIGN, 0) < 0)
+			return -EINVAL;
+		for (i = 0; i < l.n_planes; i++)
+			size = SPA_MAX(size, l.size[i]);
+		break;
+	case 1:
+		/* packed frames that the decoded frames are copied into */
+		if (spa_ffmpeg_layout_init(&l, pix_fmt, w, h, 4, 1) < 0)
+			return -EINVAL;
+		size = l.offset[l.n_planes-1] + l.size[l.n_planes-1];
+		break;
+	default:
+		return 0;
+	}
+	*param = spa_pod_builder_add_object(builder,
+		SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+		SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(8, 4, MAX_BUFFERS),
+		SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(l.n_blocks),
+		SPA_PARAM_BUFFERS_size,    SPA_POD_Int(size),
+		SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(l.stride[0]),
+		SPA_PARAM_BUFFERS_align,   SPA_POD_Int(STRIDE_ALIGN));
 	return 1;
 }
 
@@ -229,6 +818,7 @@ impl_node_port_enum_params(void *object, int seq,
 			const struct spa_pod *filter)
 {
 	struct impl *this = object;
+	struct port *port;
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
@@ -236,6 +826,12 @@ impl_node_port_enum_params(void *object, int seq,
 	uint32_t count = 0;
 	int res;
 
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+	spa_return_val_if_fail(IS_VALID_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
 	result.id = id;
 	result.next = start;
       next:
@@ -256,6 +852,39 @@ impl_node_port_enum_params(void *object, int seq,
 			return res;
 		break;
 
+	case SPA_PARAM_Buffers:
+		if (!port->have_format)
+			return -EIO;
+		if ((res = port_enum_buffers(this, port, result.index, &param, &b)) <= 0)
+			return res;
+		break;
+
+	case SPA_PARAM_Meta:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
 	default:
 		return -ENOENT;
 	}
@@ -271,6 +900,55 @@ impl_node_port_enum_params(void *object, int seq,
 	return 0;
 }
 
+static void close_decoder(struct impl *this)
+{
+	stop_decoder(this);
+	avcodec_free_context(&this->context);
+	this->dec_pix_fmt = AV_PIX_FMT_NONE;
+	this->dec_width = this->dec_height = 0;
+}
+
+static int open_decoder(struct impl *this, uint32_t subtype, const struct spa_video_info_raw *info)
+{
+	const AVCodec *codec = this->codec;
+	struct spa_dict_item items[2];
+	char threads[16];
+	uint32_t n_items = 0;
+	int res;
+
+	if (codec == NULL)
+		codec = avcodec_find_decoder(spa_ffmpeg_subtype_to_codec(subtype));
+	if (codec == NULL)
+		return -ENOTSUP;
+
+	if ((this->context = avcodec_alloc_context3(codec)) == NULL)
+		return -ENOMEM;
+
+	if (this->threads >= 0) {
+		snprintf(threads, sizeof(threads), "%d", this->threads);
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREADS, threads);
+	}
+	if (this->thread_type[0])
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREAD_TYPE, this->thread_type);
+	spa_ffmpeg_setup_context(this->context, &SPA_DICT_INIT(items, n_items), this->log);
+
+	this->context->opaque = this;
+	this->context->width = info->size.width;
+	this->context->height = info->size.height;
+	if (codec->capabilities & AV_CODEC_CAP_DR1)
+		this->context->get_buffer2 = get_buffer2;
+
+	if ((res = avcodec_open2(this->context, codec, NULL)) < 0) {
+		spa_log_error(this->log, "%p: can't open %s: %d", this, codec->name, res);
+		avcodec_free_context(&this->context);
+		return -EIO;
+	}
+	spa_log_info(this->log, "%p: opened %s with %d threads (type %d)", this,
+			codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+	return 0;
+}
+
 static int port_set_format(void *object,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
@@ -280,7 +958,7 @@ static int port_set_format(void *object,
 	struct port *port;
 	int res;
 
-	if (this == NULL || format == NULL)
+	if (this == NULL)
 		return -EINVAL;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
@@ -290,24 +968,62 @@ static int port_set_format(void *object,
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_decoder(this);
 	} else {
 		struct spa_video_info info = { 0 };
 
 		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
 			return res;
 
-		if (info.media_type != SPA_MEDIA_TYPE_video &&
-		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		if (info.media_type != SPA_MEDIA_TYPE_video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_OUTPUT) {
+			if (info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+				return -EINVAL;
+			if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
+				return -EINVAL;
+			if (spa_ffmpeg_format_to_pix_fmt(info.info.raw.format) == AV_PIX_FMT_NONE)
+				return -ENOTSUP;
+		} else {
+			struct spa_video_info_raw *raw = &info.info.raw;
+
+			if (spa_ffmpeg_subtype_to_codec(info.media_subtype) == AV_CODEC_ID_NONE ||
+			    (this->codec && spa_ffmpeg_codec_to_subtype(this->codec->id) !=
+					info.media_subtype))
+				return -ENOTSUP;
+			/* the size and framerate are only a hint for the codec */
+			spa_pod_parse_object(format,
+				SPA_TYPE_OBJECT_Format, NULL,
+				SPA_FORMAT_VIDEO_size,      SPA_POD_OPT_Rectangle(&raw->size),
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_OPT_Fraction(&raw->framerate));
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
+			if (direction == SPA_DIRECTION_INPUT) {
+				close_decoder(this);
+				if ((res = open_decoder(this, info.media_subtype, &info.info.raw)) < 0)
+					return res;
+			}
 			port->current_format = info;
 			port->have_format = true;
 		}
 	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
+	if (direction == SPA_DIRECTION_INPUT)
+		do_format_changed(NULL, false, 0, NULL, 0, this);
+
 	return 0;
 }
 
@@ -324,6 +1040,36 @@ impl_node_port_set_param(void *object,
 		return -ENOENT;
 }
 
+static void clear_packets(struct impl *this)
+{
+	uint32_t i;
+
+	for (i = 0; i < MAX_PACKETS; i++) {
+		free(this->packets[i].data);
+		this->packets[i].data = NULL;
+		this->packets[i].maxsize = 0;
+	}
+}
+
+static int alloc_packets(struct impl *this, uint32_t maxsize)
+{
+	uint32_t i;
+
+	clear_packets(this);
+	for (i = 0; i < MAX_PACKETS; i++) {
+		struct packet *p = &this->packets[i];
+
+		/* the codec reads past the end of the packet */
+		p->data = calloc(1, maxsize + AV_INPUT_BUFFER_PADDING_SIZE);
+		if (p->data == NULL) {
+			clear_packets(this);
+			return -errno;
+		}
+		p->maxsize = maxsize;
+	}
+	return 0;
+}
+
 static int
 impl_node_port_use_buffers(void *object,
 				     enum spa_direction direction,
@@ -332,13 +1078,55 @@ impl_node_port_use_buffers(void *object,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
-	if (object == NULL)
-		return -EINVAL;
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i, maxsize = 0;
+	int res;
 
-	if (!IS_VALID_PORT(object, direction, port_id))
-		return -EINVAL;
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(IS_VALID_PORT(this, direction, port_id), -EINVAL);
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (n_buffers > 0 && !port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+
+	/* the codec can still be holding the old buffers */
+	if (direction == SPA_DIRECTION_OUTPUT && this->context)
+		avcodec_flush_buffers(this->context);
+
+	for (i = 0; i < n_buffers; i++) {
+		if (buffers[i]->n_datas < 1 || buffers[i]->n_datas > SPA_FFMPEG_MAX_PLANES)
+			return -EINVAL;
+		maxsize = SPA_MAX(maxsize, buffers[i]->datas[0].maxsize);
+	}
+
+	pthread_mutex_lock(&this->lock);
+	if (direction == SPA_DIRECTION_OUTPUT)
+		this->n_pool = 0;
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		b->id = i;
+		b->flags = 0;
+		b->codec_refs = 0;
+		b->outbuf = buffers[i];
+		b->impl = this;
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+
+		if (direction == SPA_DIRECTION_OUTPUT)
+			pool_put(this, b);
+	}
+	pthread_mutex_unlock(&this->lock);
+	port->n_buffers = n_buffers;
+
+	if (direction == SPA_DIRECTION_INPUT && n_buffers > 0 &&
+	    (res = alloc_packets(this, maxsize)) < 0)
+		return res;
+
+	return 0;
 }
 
 static int
@@ -367,39 +1155,115 @@ impl_node_port_set_io(void *object,
 	return 0;
 }
 
+static void recycle_output(struct impl *this, uint32_t id)
+{
+	spa_ffmpeg_queue_push(&this->recycle_queue, id);
+}
+
+static int queue_packet(struct impl *this, struct buffer *b)
+{
+	struct spa_data *d = &b->outbuf->datas[0];
+	struct packet *p;
+	uint32_t index, offset, size;
+
+	while (spa_ffmpeg_queue_pop(&this->done_queue, &index))
+		this->free_packets[this->n_free_packets++] = index;
+
+	if (this->n_free_packets == 0)
+		return -ENOSPC;
+
+	offset = SPA_MIN(d->chunk->offset, d->maxsize);
+	size = SPA_MIN(d->chunk->size, d->maxsize - offset);
+	if (d->data == NULL || size == 0)
+		return 0;
+
+	p = &this->packets[this->free_packets[this->n_free_packets-1]];
+	if (size > p->maxsize)
+		return -EMSGSIZE;
+
+	this->n_free_packets--;
+	memcpy(p->data, SPA_PTROFF(d->data, offset, void), size);
+	memset(p->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	p->size = size;
+	p->pts = b->h ? b->h->pts : (int64_t)this->seq;
+	p->flags = b->h && !(b->h->flags & SPA_META_HEADER_FLAG_DELTA_UNIT) ? AV_PKT_FLAG_KEY : 0;
+
+	spa_ffmpeg_queue_push(&this->packet_queue, p - this->packets);
+	return 1;
+}
+
+/* The data thread only moves packets and buffer ids between the ports and
+ * the worker, it never waits for the codec. A decoded frame is available
+ * one cycle after its packet. */
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in, *out;
+	struct spa_io_buffers *input, *output;
+	uint32_t id;
+	int res, status = 0;
 
-	if (this == NULL)
-		return -EINVAL;
+	spa_return_val_if_fail(this != NULL, -EINVAL);
 
-	port = &this->out_ports[0];
+	in = GET_IN_PORT(this, 0);
+	out = GET_OUT_PORT(this, 0);
 
-	if ((output = port->io) == NULL)
+	if ((output = out->io) == NULL || (input = in->io) == NULL)
 		return -EIO;
 
-	if (!port->have_format) {
+	if (!out->have_format || !in->have_format || !this->started) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (output->buffer_id < out->n_buffers) {
+		recycle_output(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (input->status == SPA_STATUS_HAVE_DATA &&
+	    input->buffer_id < in->n_buffers) {
+		res = queue_packet(this, &in->buffers[input->buffer_id]);
+		if (res < 0 && res != -ENOSPC)
+			spa_log_warn(this->log, "%p: dropped packet: %s", this,
+					spa_strerror(res));
+		/* when the worker is behind, keep the packet for the next cycle */
+		if (res != -ENOSPC)
+			input->status = SPA_STATUS_NEED_DATA;
+	}
+	spa_ffmpeg_worker_wakeup(&this->worker);
+
+	if (spa_ffmpeg_queue_pop(&this->ready_queue, &id)) {
+		output->buffer_id = id;
+		output->status = SPA_STATUS_HAVE_DATA;
+		status |= SPA_STATUS_HAVE_DATA;
+	}
+	if (input->status == SPA_STATUS_NEED_DATA)
+		status |= SPA_STATUS_NEED_DATA;
+
+	return status;
 }
 
 static int
 impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
 {
-	if (object == NULL)
-		return -EINVAL;
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(port_id == 0, -EINVAL);
 
-	if (port_id != 0)
+	port = GET_OUT_PORT(this, 0);
+	if (buffer_id >= port->n_buffers)
 		return -EINVAL;
 
-	return -ENOTSUP;
+	recycle_output(this, buffer_id);
+	if (this->started)
+		spa_ffmpeg_worker_wakeup(&this->worker);
+	return 0;
 }
 
 static const struct spa_node_methods impl_node = {
@@ -441,8 +1305,18 @@ impl_get_interface(struct spa_handle *handle, const char *type, void **interface
 static int
 impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
+	this = (struct impl *) handle;
+
+	close_decoder(this);
+	av_packet_free(&this->avpkt);
+	av_frame_free(&this->frame);
+	clear_packets(this);
+	pthread_mutex_destroy(&this->lock);
+
 	return 0;
 }
 
@@ -452,14 +1326,32 @@ spa_ffmpeg_dec_get_size(const struct spa_handle_factory *factory, const struct s
 	return sizeof(struct impl);
 }
 
+static void init_port(struct port *port, enum spa_direction direction)
+{
+	port->direction = direction;
+	port->id = 0;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = 0;
+	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->info.params = port->params;
+	port->info.n_params = 5;
+}
+
 int
-spa_ffmpeg_dec_init(struct spa_handle *handle,
+spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
 {
 	struct impl *this;
-	struct port *port;
+	const char *str;
 
 	handle->get_interface = impl_get_interface;
 	handle->clear = impl_clear;
@@ -467,6 +1359,44 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	this = (struct impl *) handle;
 
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(this->log, &log_topic);
+
+	this->main_loop = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Loop);
+	if (this->main_loop == NULL) {
+		spa_log_error(this->log, "a main-loop is needed");
+		return -EINVAL;
+	}
+
+	this->codec = spa_ffmpeg_find_codec(factory, false);
+	this->threads = -1;
+	this->dec_pix_fmt = AV_PIX_FMT_NONE;
+
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_CODEC)) != NULL) {
+		if ((this->codec = avcodec_find_decoder_by_name(str)) == NULL) {
+			spa_log_error(this->log, "unknown decoder %s", str);
+			return -ENOENT;
+		}
+	}
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREADS)) != NULL)
+		this->threads = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREAD_TYPE)) != NULL)
+		snprintf(this->thread_type, sizeof(this->thread_type), "%s", str);
+
+	if (this->codec && spa_ffmpeg_codec_to_subtype(this->codec->id) == SPA_MEDIA_SUBTYPE_unknown) {
+		spa_log_error(this->log, "decoder %s is not supported", this->codec->name);
+		return -ENOTSUP;
+	}
+
+	this->avpkt = av_packet_alloc();
+	this->frame = av_frame_alloc();
+	if (this->avpkt == NULL || this->frame == NULL) {
+		av_packet_free(&this->avpkt);
+		av_frame_free(&this->frame);
+		return -ENOMEM;
+	}
+	pthread_mutex_init(&this->lock, NULL);
+	spa_ffmpeg_queue_init(&this->recycle_queue);
+	spa_ffmpeg_queue_init(&this->ready_queue);
 
 	spa_hook_list_init(&this->hooks);
 
@@ -481,29 +1411,8 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	this->info.flags = SPA_NODE_FLAG_RT;
 	this->info.params = this->params;
 
-	port = GET_IN_PORT(this, 0);
-	port->direction = SPA_DIRECTION_INPUT;
-	port->id = 0;
-	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
-			SPA_PORT_CHANGE_MASK_PARAMS;
-	port->info = SPA_PORT_INFO_INIT();
-	port->info.flags = 0;
-	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
-	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
-	port->info.params = port->params;
-	port->info.n_params = 2;
-
-	port = GET_OUT_PORT(this, 0);
-	port->direction = SPA_DIRECTION_OUTPUT;
-	port->id = 0;
-	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
-			SPA_PORT_CHANGE_MASK_PARAMS;
-	port->info = SPA_PORT_INFO_INIT();
-	port->info.flags = 0;
-	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
-	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
-	port->info.params = port->params;
-	port->info.n_params = 2;
+	init_port(GET_IN_PORT(this, 0), SPA_DIRECTION_INPUT);
+	init_port(GET_OUT_PORT(this, 0), SPA_DIRECTION_OUTPUT);
 
 	return 0;
 }
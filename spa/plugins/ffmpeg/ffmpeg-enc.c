@@ -4,33 +4,50 @@
 
 #include <errno.h>
 #include <stddef.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <spa/utils/string.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/result.h>
 #include <spa/support/plugin.h>
 #include <spa/support/log.h>
 #include <spa/node/node.h>
 #include <spa/node/utils.h>
 #include <spa/node/io.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/param.h>
 #include <spa/param/video/format-utils.h>
+#include <spa/param/video/format.h>
 #include <spa/pod/filter.h>
 
+#include <libavutil/dict.h>
+#include <libavutil/pixdesc.h>
+
 #include "ffmpeg.h"
 
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.ffmpeg.enc");
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
 #define GET_PORT(this,d,p)		(d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
 
-#define MAX_BUFFERS    32
+#define MAX_BUFFERS	32
+#define MAX_FRAMES	8
+#define N_PTS		64
+
+#define DEFAULT_WIDTH	640
+#define DEFAULT_HEIGHT	480
 
 struct buffer {
 	uint32_t id;
 	uint32_t flags;
 	struct spa_buffer *outbuf;
-	struct spa_list link;
+	struct spa_meta_header *h;
 };
 
 struct port {
@@ -48,9 +65,6 @@ struct port {
 	uint32_t n_buffers;
 
 	struct spa_io_buffers *io;
-
-	struct spa_list free;
-	struct spa_list ready;
 };
 
 struct impl {
@@ -68,6 +82,40 @@ struct impl {
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	const AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *avpkt;
+	bool have_packet;
+	char props[512];
+	char thread_type[16];
+	int threads;
+	int64_t bit_rate;
+	int gop_size;
+
+	/* the input frames are copied into these, the codec can keep a
+	 * reference to a frame after it was sent */
+	AVFrame *frames[MAX_FRAMES];
+	uint32_t free_frames[MAX_FRAMES];
+	uint32_t n_free_frames;
+	uint64_t frame_count;
+	int64_t pts[N_PTS];
+
+	/* data thread -> worker */
+	struct spa_ffmpeg_queue frame_queue;
+	struct spa_ffmpeg_queue recycle_queue;
+	/* worker -> data thread */
+	struct spa_ffmpeg_queue done_queue;
+	struct spa_ffmpeg_queue ready_queue;
+
+	struct spa_ffmpeg_worker worker;
+
+	/* free output buffers, only used by the worker */
+	uint32_t pool[MAX_BUFFERS];
+	uint32_t n_pool;
+
+	uint64_t seq;
+	uint32_t dropped;
+
 	bool started;
 };
 
@@ -78,7 +126,8 @@ static int impl_node_enum_params(void *object, int seq,
 	return -ENOTSUP;
 }
 
-static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
+static int impl_node_set_param(void *object,
+					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
 	return -ENOTSUP;
@@ -89,6 +138,262 @@ static int impl_node_set_io(void *object, uint32_t id, void *data, size_t size)
 	return -ENOTSUP;
 }
 
+static void recycle_buffers(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t id;
+
+	while (spa_ffmpeg_queue_pop(&this->recycle_queue, &id)) {
+		if (id < port->n_buffers)
+			this->pool[this->n_pool++] = id;
+	}
+}
+
+/* copy the packet into a free output buffer, returns false when there
+ * is no free buffer yet */
+static bool output_packet(struct impl *this, AVPacket *pkt)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b;
+	struct spa_data *d;
+
+	recycle_buffers(this);
+	if (this->n_pool == 0)
+		return false;
+
+	b = &port->buffers[this->pool[--this->n_pool]];
+	d = &b->outbuf->datas[0];
+
+	if ((uint32_t)pkt->size > d->maxsize) {
+		spa_log_warn(this->log, "%p: packet of %d bytes does not fit in %u",
+				this, pkt->size, d->maxsize);
+		this->pool[this->n_pool++] = b->id;
+		this->dropped++;
+		return true;
+	}
+	memcpy(d->data, pkt->data, pkt->size);
+	d->chunk->offset = 0;
+	d->chunk->size = pkt->size;
+	d->chunk->stride = 0;
+
+	if (b->h) {
+		b->h->flags = (pkt->flags & AV_PKT_FLAG_KEY) ? 0 : SPA_META_HEADER_FLAG_DELTA_UNIT;
+		b->h->offset = 0;
+		b->h->seq = this->seq;
+		b->h->pts = this->pts[(uint64_t)pkt->pts % N_PTS];
+		b->h->dts_offset = pkt->dts - pkt->pts;
+	}
+	this->seq++;
+
+	spa_ffmpeg_queue_push(&this->ready_queue, b->id);
+	return true;
+}
+
+static void receive_packets(struct impl *this)
+{
+	while (true) {
+		if (!this->have_packet) {
+			if (avcodec_receive_packet(this->context, this->avpkt) < 0)
+				break;
+			this->have_packet = true;
+		}
+		/* keep the packet until the graph returns a buffer */
+		if (!output_packet(this, this->avpkt))
+			break;
+		av_packet_unref(this->avpkt);
+		this->have_packet = false;
+	}
+}
+
+static void encode_work(void *data)
+{
+	struct impl *this = data;
+	uint32_t index;
+	int res;
+
+	receive_packets(this);
+
+	while (spa_ffmpeg_queue_pop(&this->frame_queue, &index)) {
+		res = avcodec_send_frame(this->context, this->frames[index]);
+		spa_ffmpeg_queue_push(&this->done_queue, index);
+
+		if (res < 0)
+			spa_log_warn(this->log, "%p: encode error: %d", this, res);
+
+		receive_packets(this);
+	}
+}
+
+static void clear_frames(struct impl *this)
+{
+	uint32_t i;
+	for (i = 0; i < MAX_FRAMES; i++)
+		av_frame_free(&this->frames[i]);
+}
+
+static int alloc_frames(struct impl *this)
+{
+	AVCodecContext *ctx = this->context;
+	uint32_t i;
+
+	clear_frames(this);
+	for (i = 0; i < MAX_FRAMES; i++) {
+		AVFrame *f;
+
+		if ((f = this->frames[i] = av_frame_alloc()) == NULL)
+			goto error;
+		f->format = ctx->pix_fmt;
+		f->width = ctx->width;
+		f->height = ctx->height;
+		if (av_frame_get_buffer(f, 0) < 0)
+			goto error;
+	}
+	return 0;
+error:
+	clear_frames(this);
+	return -ENOMEM;
+}
+
+static void close_encoder(struct impl *this)
+{
+	if (this->started) {
+		spa_ffmpeg_worker_stop(&this->worker);
+		this->started = false;
+	}
+	if (this->have_packet)
+		av_packet_unref(this->avpkt);
+	this->have_packet = false;
+	avcodec_free_context(&this->context);
+	clear_frames(this);
+
+	if (this->dropped)
+		spa_log_info(this->log, "%p: dropped %u frames", this, this->dropped);
+	this->dropped = 0;
+}
+
+static const AVCodec *find_encoder(struct impl *this, uint32_t subtype)
+{
+	if (this->codec)
+		return this->codec;
+	return avcodec_find_encoder(spa_ffmpeg_subtype_to_codec(subtype));
+}
+
+/* the pixel format of the codec for a video format, the codecs can
+ * have several pixel formats with the same layout */
+static enum AVPixelFormat encoder_pix_fmt(const AVCodec *codec, uint32_t format)
+{
+	uint32_t i;
+
+	if (codec->pix_fmts == NULL)
+		return spa_ffmpeg_format_to_pix_fmt(format);
+	for (i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+		if (spa_ffmpeg_pix_fmt_to_format(codec->pix_fmts[i]) == format)
+			return codec->pix_fmts[i];
+	}
+	return AV_PIX_FMT_NONE;
+}
+
+static int open_encoder(struct impl *this)
+{
+	struct port *in = GET_IN_PORT(this, 0), *out = GET_OUT_PORT(this, 0);
+	struct spa_video_info_raw *raw = &in->current_format.info.raw;
+	const AVCodec *codec;
+	AVDictionary *options = NULL;
+	struct spa_dict_item items[4];
+	char threads[16], bit_rate[32], gop_size[16];
+	uint32_t n_items = 0;
+	int res;
+
+	if ((codec = find_encoder(this, out->current_format.media_subtype)) == NULL)
+		return -ENOTSUP;
+
+	if ((this->context = avcodec_alloc_context3(codec)) == NULL)
+		return -ENOMEM;
+
+	if (this->threads >= 0) {
+		snprintf(threads, sizeof(threads), "%d", this->threads);
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREADS, threads);
+	}
+	if (this->thread_type[0])
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_THREAD_TYPE, this->thread_type);
+	if (this->bit_rate > 0) {
+		snprintf(bit_rate, sizeof(bit_rate), "%"PRIi64, this->bit_rate);
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_BIT_RATE, bit_rate);
+	}
+	if (this->gop_size > 0) {
+		snprintf(gop_size, sizeof(gop_size), "%d", this->gop_size);
+		items[n_items++] = SPA_DICT_ITEM_INIT(SPA_KEY_API_FFMPEG_GOP_SIZE, gop_size);
+	}
+	spa_ffmpeg_setup_context(this->context, &SPA_DICT_INIT(items, n_items), this->log);
+
+	this->context->width = raw->size.width;
+	this->context->height = raw->size.height;
+	this->context->pix_fmt = encoder_pix_fmt(codec, raw->format);
+	if (raw->framerate.num > 0 && raw->framerate.denom > 0) {
+		this->context->framerate = (AVRational) { raw->framerate.num, raw->framerate.denom };
+		this->context->time_base = (AVRational) { raw->framerate.denom, raw->framerate.num };
+	} else {
+		this->context->time_base = (AVRational) { 1, 25 };
+	}
+	/* B frames add latency and reorder the output */
+	this->context->max_b_frames = 0;
+
+	if (this->props[0] &&
+	    av_dict_parse_string(&options, this->props, "=", ",", 0) < 0)
+		spa_log_warn(this->log, "%p: invalid options '%s'", this, this->props);
+
+	res = avcodec_open2(this->context, codec, &options);
+	av_dict_free(&options);
+	if (res < 0) {
+		spa_log_error(this->log, "%p: can't open %s: %d", this, codec->name, res);
+		avcodec_free_context(&this->context);
+		return -EIO;
+	}
+	spa_log_info(this->log, "%p: opened %s with %d threads (type %d)", this,
+			codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+	return 0;
+}
+
+static int start_encoder(struct impl *this)
+{
+	struct port *in = GET_IN_PORT(this, 0), *out = GET_OUT_PORT(this, 0);
+	uint32_t i;
+	int res;
+
+	if (this->started)
+		return 0;
+	if (!in->have_format || !out->have_format)
+		return -EIO;
+
+	if ((res = open_encoder(this)) < 0)
+		return res;
+	if ((res = alloc_frames(this)) < 0) {
+		avcodec_free_context(&this->context);
+		return res;
+	}
+
+	spa_ffmpeg_queue_init(&this->frame_queue);
+	spa_ffmpeg_queue_init(&this->done_queue);
+	spa_ffmpeg_queue_init(&this->ready_queue);
+	spa_ffmpeg_queue_init(&this->recycle_queue);
+
+	this->n_free_frames = 0;
+	for (i = 0; i < MAX_FRAMES; i++)
+		this->free_frames[this->n_free_frames++] = i;
+	this->n_pool = 0;
+	for (i = 0; i < out->n_buffers; i++)
+		this->pool[this->n_pool++] = i;
+	this->frame_count = 0;
+
+	if ((res = spa_ffmpeg_worker_start(&this->worker, encode_work, this)) < 0) {
+		avcodec_free_context(&this->context);
+		return res;
+	}
+	this->started = true;
+	return 0;
+}
+
 static int impl_node_send_command(void *object, const struct spa_command *command)
 {
 	struct impl *this = object;
@@ -98,10 +403,16 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 
 	switch (SPA_NODE_COMMAND_ID(command)) {
 	case SPA_NODE_COMMAND_Start:
-		this->started = true;
-		break;
+		return start_encoder(this);
 	case SPA_NODE_COMMAND_Pause:
-		this->started = false;
+	case SPA_NODE_COMMAND_Suspend:
+		close_encoder(this);
+		break;
+	case SPA_NODE_COMMAND_Flush:
+		if (this->started) {
+			close_encoder(this);
+			return start_encoder(this);
+		}
 		break;
 	default:
 		return -ENOTSUP;
@@ -171,19 +482,135 @@ impl_node_add_port(void *object, enum spa_direction direction, uint32_t port_id,
 
 static int
 impl_node_remove_port(void *object,
-				enum spa_direction direction, uint32_t port_id)
+				enum spa_direction direction,
+				uint32_t port_id)
 {
 	return -ENOTSUP;
 }
 
+static uint32_t output_subtype(struct impl *this, uint32_t index)
+{
+	uint32_t i, n = 0, subtype;
+
+	if (this->codec != NULL)
+		return index == 0 ? spa_ffmpeg_codec_to_subtype(this->codec->id) :
+			SPA_MEDIA_SUBTYPE_unknown;
+
+	for (i = 0; (subtype = spa_ffmpeg_subtype_by_index(i)) != SPA_MEDIA_SUBTYPE_unknown; i++) {
+		if (avcodec_find_encoder(spa_ffmpeg_subtype_to_codec(subtype)) == NULL)
+			continue;
+		if (n++ == index)
+			return subtype;
+	}
+	return SPA_MEDIA_SUBTYPE_unknown;
+}
+
 static int port_enum_formats(void *object,
-			enum spa_direction direction, uint32_t port_id,
-			uint32_t index,
-			const struct spa_pod *filter,
-			struct spa_pod **param,
-			struct spa_pod_builder *builder)
+			     enum spa_direction direction, uint32_t port_id,
+			     uint32_t index,
+			     const struct spa_pod *filter,
+			     struct spa_pod **param,
+			     struct spa_pod_builder *builder)
 {
-	return -ENOTSUP;
+	struct impl *this = object;
+	struct port *other = GET_PORT(this, SPA_DIRECTION_REVERSE(direction), 0);
+	struct spa_rectangle size = SPA_RECTANGLE(DEFAULT_WIDTH, DEFAULT_HEIGHT);
+	struct spa_fraction framerate = SPA_FRACTION(25, 1);
+	struct spa_pod_frame f[2];
+	const AVCodec *codec;
+	uint32_t i, j, n_formats = 0, subtype, formats[64];
+
+	if (!IS_VALID_PORT(object, direction, port_id))
+		return -EINVAL;
+
+	if (other->have_format) {
+		size = other->current_format.info.raw.size;
+		framerate = other->current_format.info.raw.framerate;
+	}
+
+	if (direction == SPA_DIRECTION_OUTPUT) {
+		if ((subtype = output_subtype(this, index)) == SPA_MEDIA_SUBTYPE_unknown)
+			return 0;
+
+		if (other->have_format) {
+			*param = spa_pod_builder_add_object(builder,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+				SPA_FORMAT_mediaSubtype,    SPA_POD_Id(subtype),
+				SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&size),
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&framerate));
+		} else {
+			*param = spa_pod_builder_add_object(builder,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype),
+				SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+									&size,
+									&SPA_RECTANGLE(1, 1),
+									&SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+									&framerate,
+									&SPA_FRACTION(0, 1),
+									&SPA_FRACTION(INT32_MAX, 1)));
+		}
+		return 1;
+	}
+
+	if (index > 0)
+		return 0;
+
+	/* the raw formats that the codec takes */
+	codec = find_encoder(this, other->have_format ?
+			other->current_format.media_subtype : SPA_MEDIA_SUBTYPE_unknown);
+
+	spa_pod_builder_push_object(builder, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(builder,
+		SPA_FORMAT_mediaType,    SPA_POD_Id(SPA_MEDIA_TYPE_video),
+		SPA_FORMAT_mediaSubtype, SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+		0);
+	spa_pod_builder_prop(builder, SPA_FORMAT_VIDEO_format, 0);
+	spa_pod_builder_push_choice(builder, &f[1], SPA_CHOICE_Enum, 0);
+	if (codec != NULL && codec->pix_fmts != NULL) {
+		for (i = 0; codec->pix_fmts[i] != AV_PIX_FMT_NONE; i++) {
+			uint32_t format = spa_ffmpeg_pix_fmt_to_format(codec->pix_fmts[i]);
+			if (format == SPA_VIDEO_FORMAT_UNKNOWN)
+				continue;
+			for (j = 0; j < n_formats; j++)
+				if (formats[j] == format)
+					break;
+			if (j < n_formats || n_formats == SPA_N_ELEMENTS(formats))
+				continue;
+			formats[n_formats++] = format;
+			if (n_formats == 1)
+				spa_pod_builder_id(builder, format);
+			spa_pod_builder_id(builder, format);
+		}
+	}
+	if (n_formats == 0) {
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_I420);
+		spa_pod_builder_id(builder, SPA_VIDEO_FORMAT_I420);
+	}
+	spa_pod_builder_pop(builder, &f[1]);
+
+	if (other->have_format) {
+		spa_pod_builder_add(builder,
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&framerate),
+			0);
+	} else {
+		spa_pod_builder_add(builder,
+			SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+								&size,
+								&SPA_RECTANGLE(1, 1),
+								&SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+								&framerate,
+								&SPA_FRACTION(0, 1),
+								&SPA_FRACTION(INT32_MAX, 1)),
+			0);
+	}
+	*param = spa_pod_builder_pop(builder, &f[0]);
+	return 1;
 }
 
 static int port_get_format(void *object,
@@ -195,6 +622,7 @@ static int port_get_format(void *object,
 {
 	struct impl *this = object;
 	struct port *port;
+	struct spa_video_info_raw *raw;
 
 	port = GET_PORT(this, direction, port_id);
 
@@ -204,8 +632,17 @@ static int port_get_format(void *object,
 	if (index > 0)
 		return 0;
 
-	*param = NULL;
-
+	raw = &port->current_format.info.raw;
+	if (direction == SPA_DIRECTION_INPUT) {
+		*param = spa_format_video_raw_build(builder, SPA_PARAM_Format, raw);
+	} else {
+		*param = spa_pod_builder_add_object(builder,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_Format,
+			SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,    SPA_POD_Id(port->current_format.media_subtype),
+			SPA_FORMAT_VIDEO_size,      SPA_POD_Rectangle(&raw->size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&raw->framerate));
+	}
 	return 1;
 }
 
@@ -216,6 +653,7 @@ impl_node_port_enum_params(void *object, int seq,
 			const struct spa_pod *filter)
 {
 	struct impl *this = object;
+	struct port *port;
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
@@ -223,6 +661,12 @@ impl_node_port_enum_params(void *object, int seq,
 	uint32_t count = 0;
 	int res;
 
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(num != 0, -EINVAL);
+	spa_return_val_if_fail(IS_VALID_PORT(this, direction, port_id), -EINVAL);
+
+	port = GET_PORT(this, direction, port_id);
+
 	result.id = id;
 	result.next = start;
       next:
@@ -243,6 +687,65 @@ impl_node_port_enum_params(void *object, int seq,
 			return res;
 		break;
 
+	case SPA_PARAM_Buffers:
+	{
+		struct spa_video_info_raw *raw = &port->current_format.info.raw;
+		struct spa_ffmpeg_layout l;
+
+		if (!port->have_format)
+			return -EIO;
+		if (result.index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (spa_ffmpeg_layout_init(&l, spa_ffmpeg_format_to_pix_fmt(raw->format),
+					raw->size.width, raw->size.height, 4, 1) < 0)
+				return -EINVAL;
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamBuffers, id,
+				SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(4, 1, MAX_BUFFERS),
+				SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+				SPA_PARAM_BUFFERS_size,    SPA_POD_Int(l.offset[l.n_planes-1] +
+								l.size[l.n_planes-1]),
+				SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(l.stride[0]));
+		} else {
+			/* enough for a frame that does not compress */
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamBuffers, id,
+				SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(8, 4, MAX_BUFFERS),
+				SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+				SPA_PARAM_BUFFERS_size,    SPA_POD_Int(raw->size.width *
+								raw->size.height * 3 + 4096),
+				SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(0));
+		}
+		break;
+	}
+	case SPA_PARAM_Meta:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamMeta, id,
+				SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+				SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
+	case SPA_PARAM_IO:
+		switch (result.index) {
+		case 0:
+			param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_ParamIO, id,
+				SPA_PARAM_IO_id,   SPA_POD_Id(SPA_IO_Buffers),
+				SPA_PARAM_IO_size, SPA_POD_Int(sizeof(struct spa_io_buffers)));
+			break;
+		default:
+			return 0;
+		}
+		break;
+
 	default:
 		return -ENOENT;
 	}
@@ -260,15 +763,23 @@ impl_node_port_enum_params(void *object, int seq,
 
 static int port_set_format(void *object,
 			   enum spa_direction direction, uint32_t port_id,
-			   uint32_t flags, const struct spa_pod *format)
+			   uint32_t flags,
+			   const struct spa_pod *format)
 {
 	struct impl *this = object;
 	struct port *port;
 	int res;
 
+	if (this == NULL)
+		return -EINVAL;
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
 	port = GET_PORT(this, direction, port_id);
 
 	if (format == NULL) {
+		close_encoder(this);
 		port->have_format = false;
 	} else {
 		struct spa_video_info info = { 0 };
@@ -276,18 +787,46 @@ static int port_set_format(void *object,
 		if ((res = spa_format_parse(format, &info.media_type, &info.media_subtype)) < 0)
 			return res;
 
-		if (info.media_type != SPA_MEDIA_TYPE_video &&
-		    info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+		if (info.media_type != SPA_MEDIA_TYPE_video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != SPA_MEDIA_SUBTYPE_raw)
+				return -EINVAL;
+			if (spa_format_video_raw_parse(format, &info.info.raw) < 0)
+				return -EINVAL;
+			if (spa_ffmpeg_format_to_pix_fmt(info.info.raw.format) == AV_PIX_FMT_NONE)
+				return -ENOTSUP;
+		} else {
+			struct spa_video_info_raw *raw = &info.info.raw;
+
+			if (find_encoder(this, info.media_subtype) == NULL ||
+			    (this->codec && spa_ffmpeg_codec_to_subtype(this->codec->id) !=
+					info.media_subtype))
+				return -ENOTSUP;
+			spa_pod_parse_object(format,
+				SPA_TYPE_OBJECT_Format, NULL,
+				SPA_FORMAT_VIDEO_size,      SPA_POD_OPT_Rectangle(&raw->size),
+				SPA_FORMAT_VIDEO_framerate, SPA_POD_OPT_Fraction(&raw->framerate));
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
+			close_encoder(this);
 			port->current_format = info;
 			port->have_format = true;
 		}
 	}
+
+	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
+	if (port->have_format) {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
+	} else {
+		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	}
+	emit_port_info(this, port, false);
+
 	return 0;
 }
 
@@ -309,15 +848,39 @@ impl_node_port_use_buffers(void *object,
 				     enum spa_direction direction,
 				     uint32_t port_id,
 				     uint32_t flags,
-				     struct spa_buffer **buffers, uint32_t n_buffers)
+				     struct spa_buffer **buffers,
+				     uint32_t n_buffers)
 {
-	if (object == NULL)
-		return -EINVAL;
+	struct impl *this = object;
+	struct port *port;
+	uint32_t i;
 
-	if (!IS_VALID_PORT(object, direction, port_id))
-		return -EINVAL;
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(IS_VALID_PORT(this, direction, port_id), -EINVAL);
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (n_buffers > 0 && !port->have_format)
+		return -EIO;
+	if (n_buffers > MAX_BUFFERS)
+		return -ENOSPC;
+	if (this->started)
+		return -EBUSY;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+
+		if (buffers[i]->n_datas < 1 || buffers[i]->datas[0].data == NULL)
+			return -EINVAL;
+
+		b->id = i;
+		b->flags = 0;
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -346,39 +909,133 @@ impl_node_port_set_io(void *object,
 	return 0;
 }
 
-static int
-impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+/* The input buffer must be returned at the end of the cycle, so it is
+ * copied into a frame that the codec can keep for as long as it needs. */
+static int queue_frame(struct impl *this, struct buffer *b)
 {
-	if (object == NULL)
-		return -EINVAL;
+	struct port *port = GET_IN_PORT(this, 0);
+	struct spa_video_info_raw *raw = &port->current_format.info.raw;
+	struct spa_data *d = b->outbuf->datas;
+	struct spa_ffmpeg_layout l;
+	uint8_t *src[SPA_FFMPEG_MAX_PLANES];
+	int src_stride[SPA_FFMPEG_MAX_PLANES];
+	AVFrame *f = NULL;
+	uint32_t i, index, offset;
+	enum AVPixelFormat pix_fmt = spa_ffmpeg_format_to_pix_fmt(raw->format);
+
+	while (spa_ffmpeg_queue_pop(&this->done_queue, &index))
+		this->free_frames[this->n_free_frames++] = index;
+
+	/* a frame that the codec still references can't be written */
+	for (i = 0; i < this->n_free_frames; i++) {
+		index = this->free_frames[i];
+		if (av_frame_is_writable(this->frames[index])) {
+			f = this->frames[index];
+			this->free_frames[i] = this->free_frames[--this->n_free_frames];
+			break;
+		}
+	}
+	if (f == NULL)
+		return -ENOSPC;
+
+	if (b->outbuf->n_datas == 1) {
+		offset = SPA_MIN(d[0].chunk->offset, d[0].maxsize);
+		spa_ffmpeg_layout_packed(&l, pix_fmt, raw->size.height, d[0].chunk->stride);
+		for (i = 0; i < l.n_planes; i++) {
+			src[i] = SPA_PTROFF(d[0].data, offset + l.offset[i], uint8_t);
+			src_stride[i] = l.stride[i];
+		}
+		if (offset + l.offset[l.n_planes-1] + l.size[l.n_planes-1] > d[0].maxsize)
+			goto invalid;
+	} else {
+		for (i = 0; i < b->outbuf->n_datas && i < SPA_FFMPEG_MAX_PLANES; i++) {
+			if (d[i].data == NULL)
+				goto invalid;
+			src[i] = SPA_PTROFF(d[i].data, d[i].chunk->offset, uint8_t);
+			src_stride[i] = d[i].chunk->stride;
+		}
+	}
+	spa_ffmpeg_copy_planes(f->data, f->linesize, src, src_stride,
+			pix_fmt, raw->size.width, raw->size.height);
 
-	if (port_id != 0)
-		return -EINVAL;
+	f->pts = this->frame_count++;
+	this->pts[f->pts % N_PTS] = b->h ? b->h->pts : f->pts;
 
-	return -ENOTSUP;
+	spa_ffmpeg_queue_push(&this->frame_queue, index);
+	return 0;
+
+invalid:
+	this->free_frames[this->n_free_frames++] = index;
+	return -EINVAL;
 }
 
 static int impl_node_process(void *object)
 {
 	struct impl *this = object;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in, *out;
+	struct spa_io_buffers *input, *output;
+	uint32_t id;
+	int res, status = 0;
 
-	if (this == NULL)
-		return -EINVAL;
+	spa_return_val_if_fail(this != NULL, -EINVAL);
 
-	if ((output = this->out_ports[0].io) == NULL)
-		return -EIO;
+	in = GET_IN_PORT(this, 0);
+	out = GET_OUT_PORT(this, 0);
 
-	port = &this->out_ports[0];
+	if ((output = out->io) == NULL || (input = in->io) == NULL)
+		return -EIO;
 
-	if (!port->have_format) {
+	if (!this->started) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
 
-	return SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_DATA)
+		return SPA_STATUS_HAVE_DATA;
+
+	if (output->buffer_id < out->n_buffers) {
+		spa_ffmpeg_queue_push(&this->recycle_queue, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (input->status == SPA_STATUS_HAVE_DATA &&
+	    input->buffer_id < in->n_buffers) {
+		res = queue_frame(this, &in->buffers[input->buffer_id]);
+		if (res == -ENOSPC)
+			this->dropped++;
+		else if (res < 0)
+			spa_log_warn(this->log, "%p: invalid buffer: %s", this,
+					spa_strerror(res));
+		input->status = SPA_STATUS_NEED_DATA;
+	}
+	spa_ffmpeg_worker_wakeup(&this->worker);
+
+	if (spa_ffmpeg_queue_pop(&this->ready_queue, &id)) {
+		output->buffer_id = id;
+		output->status = SPA_STATUS_HAVE_DATA;
+		status |= SPA_STATUS_HAVE_DATA;
+	}
+	return status | SPA_STATUS_NEED_DATA;
+}
+
+static int
+impl_node_port_reuse_buffer(void *object, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this = object;
+	struct port *port;
+
+	spa_return_val_if_fail(this != NULL, -EINVAL);
+	spa_return_val_if_fail(port_id == 0, -EINVAL);
+
+	port = GET_OUT_PORT(this, 0);
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	if (this->started) {
+		spa_ffmpeg_queue_push(&this->recycle_queue, buffer_id);
+		spa_ffmpeg_worker_wakeup(&this->worker);
+	}
+	return 0;
 }
 
 static const struct spa_node_methods impl_node = {
@@ -420,8 +1077,15 @@ impl_get_interface(struct spa_handle *handle, const char *type, void **interface
 static int
 impl_clear(struct spa_handle *handle)
 {
+	struct impl *this;
+
 	spa_return_val_if_fail(handle != NULL, -EINVAL);
 
+	this = (struct impl *) handle;
+
+	close_encoder(this);
+	av_packet_free(&this->avpkt);
+
 	return 0;
 }
 
@@ -431,13 +1095,32 @@ spa_ffmpeg_enc_get_size(const struct spa_handle_factory *factory, const struct s
 	return sizeof(struct impl);
 }
 
+static void init_port(struct port *port, enum spa_direction direction)
+{
+	port->direction = direction;
+	port->id = 0;
+	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
+			SPA_PORT_CHANGE_MASK_PARAMS;
+	port->info = SPA_PORT_INFO_INIT();
+	port->info.flags = 0;
+	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Meta, SPA_PARAM_INFO_READ);
+	port->params[2] = SPA_PARAM_INFO(SPA_PARAM_IO, SPA_PARAM_INFO_READ);
+	port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
+	port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, 0);
+	port->info.params = port->params;
+	port->info.n_params = 5;
+}
+
 int
-spa_ffmpeg_enc_init(struct spa_handle *handle,
+spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
-		    const struct spa_support *support, uint32_t n_support)
+		    const struct spa_support *support,
+		    uint32_t n_support)
 {
 	struct impl *this;
-	struct port *port;
+	const char *str;
 
 	handle->get_interface = impl_get_interface;
 	handle->clear = impl_clear;
@@ -445,6 +1128,35 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 	this = (struct impl *) handle;
 
 	this->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(this->log, &log_topic);
+
+	this->codec = spa_ffmpeg_find_codec(factory, true);
+	this->threads = -1;
+
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_CODEC)) != NULL) {
+		if ((this->codec = avcodec_find_encoder_by_name(str)) == NULL) {
+			spa_log_error(this->log, "unknown encoder %s", str);
+			return -ENOENT;
+		}
+	}
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREADS)) != NULL)
+		this->threads = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREAD_TYPE)) != NULL)
+		snprintf(this->thread_type, sizeof(this->thread_type), "%s", str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_BIT_RATE)) != NULL)
+		this->bit_rate = atoll(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_GOP_SIZE)) != NULL)
+		this->gop_size = atoi(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_OPTIONS)) != NULL)
+		snprintf(this->props, sizeof(this->props), "%s", str);
+
+	if (this->codec && spa_ffmpeg_codec_to_subtype(this->codec->id) == SPA_MEDIA_SUBTYPE_unknown) {
+		spa_log_error(this->log, "encoder %s is not supported", this->codec->name);
+		return -ENOTSUP;
+	}
+
+	if ((this->avpkt = av_packet_alloc()) == NULL)
+		return -ENOMEM;
 
 	spa_hook_list_init(&this->hooks);
 
@@ -459,29 +1171,8 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 	this->info.flags = SPA_NODE_FLAG_RT;
 	this->info.params = this->params;
 
-	port = GET_IN_PORT(this, 0);
-	port->direction = SPA_DIRECTION_INPUT;
-	port->id = 0;
-	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
-			SPA_PORT_CHANGE_MASK_PARAMS;
-	port->info = SPA_PORT_INFO_INIT();
-	port->info.flags = 0;
-	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
-	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
-	port->info.params = port->params;
-	port->info.n_params = 2;
-
-	port = GET_OUT_PORT(this, 0);
-	port->direction = SPA_DIRECTION_OUTPUT;
-	port->id = 0;
-	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
-			SPA_PORT_CHANGE_MASK_PARAMS;
-	port->info = SPA_PORT_INFO_INIT();
-	port->info.flags = 0;
-	port->params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
-	port->params[1] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_WRITE);
-	port->info.params = port->params;
-	port->info.n_params = 2;
+	init_port(GET_IN_PORT(this, 0), SPA_DIRECTION_INPUT);
+	init_port(GET_OUT_PORT(this, 0), SPA_DIRECTION_OUTPUT);
 
 	return 0;
 }
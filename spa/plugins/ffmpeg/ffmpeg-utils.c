@@ -0,0 +1,281 @@
+/* Spa FFmpeg support */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spa/support/plugin.h>
+#include <spa/utils/dict.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/utils/string.h>
+#include <spa/param/format.h>
+#include <spa/param/video/raw.h>
+
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+
+#include "ffmpeg.h"
+
+static const struct codec_map {
+	enum AVCodecID id;
+	uint32_t subtype;
+} codec_map[] = {
+	{ AV_CODEC_ID_H264, SPA_MEDIA_SUBTYPE_h264 },
+	{ AV_CODEC_ID_MJPEG, SPA_MEDIA_SUBTYPE_mjpg },
+	{ AV_CODEC_ID_VP8, SPA_MEDIA_SUBTYPE_vp8 },
+	{ AV_CODEC_ID_VP9, SPA_MEDIA_SUBTYPE_vp9 },
+	{ AV_CODEC_ID_MPEG4, SPA_MEDIA_SUBTYPE_mpeg4 },
+	{ AV_CODEC_ID_MPEG2VIDEO, SPA_MEDIA_SUBTYPE_mpeg2 },
+	{ AV_CODEC_ID_MPEG1VIDEO, SPA_MEDIA_SUBTYPE_mpeg1 },
+	{ AV_CODEC_ID_H263, SPA_MEDIA_SUBTYPE_h263 },
+	{ AV_CODEC_ID_VC1, SPA_MEDIA_SUBTYPE_vc1 },
+};
+
+/* the first entry of a format is used to map it to a pixel format */
+static const struct format_map {
+	uint32_t format;
+	enum AVPixelFormat pix_fmt;
+} format_map[] = {
+	{ SPA_VIDEO_FORMAT_I420, AV_PIX_FMT_YUV420P },
+	{ SPA_VIDEO_FORMAT_I420, AV_PIX_FMT_YUVJ420P },
+	{ SPA_VIDEO_FORMAT_NV12, AV_PIX_FMT_NV12 },
+	{ SPA_VIDEO_FORMAT_NV21, AV_PIX_FMT_NV21 },
+	{ SPA_VIDEO_FORMAT_YUY2, AV_PIX_FMT_YUYV422 },
+	{ SPA_VIDEO_FORMAT_UYVY, AV_PIX_FMT_UYVY422 },
+	{ SPA_VIDEO_FORMAT_YVYU, AV_PIX_FMT_YVYU422 },
+	{ SPA_VIDEO_FORMAT_Y42B, AV_PIX_FMT_YUV422P },
+	{ SPA_VIDEO_FORMAT_Y42B, AV_PIX_FMT_YUVJ422P },
+	{ SPA_VIDEO_FORMAT_Y444, AV_PIX_FMT_YUV444P },
+	{ SPA_VIDEO_FORMAT_Y444, AV_PIX_FMT_YUVJ444P },
+	{ SPA_VIDEO_FORMAT_A420, AV_PIX_FMT_YUVA420P },
+	{ SPA_VIDEO_FORMAT_I420_10LE, AV_PIX_FMT_YUV420P10LE },
+	{ SPA_VIDEO_FORMAT_P010_10LE, AV_PIX_FMT_P010LE },
+	{ SPA_VIDEO_FORMAT_GRAY8, AV_PIX_FMT_GRAY8 },
+	{ SPA_VIDEO_FORMAT_GRAY16_LE, AV_PIX_FMT_GRAY16LE },
+	{ SPA_VIDEO_FORMAT_RGB, AV_PIX_FMT_RGB24 },
+	{ SPA_VIDEO_FORMAT_BGR, AV_PIX_FMT_BGR24 },
+	{ SPA_VIDEO_FORMAT_RGBA, AV_PIX_FMT_RGBA },
+	{ SPA_VIDEO_FORMAT_BGRA, AV_PIX_FMT_BGRA },
+	{ SPA_VIDEO_FORMAT_ARGB, AV_PIX_FMT_ARGB },
+	{ SPA_VIDEO_FORMAT_ABGR, AV_PIX_FMT_ABGR },
+	{ SPA_VIDEO_FORMAT_RGBx, AV_PIX_FMT_RGB0 },
+	{ SPA_VIDEO_FORMAT_BGRx, AV_PIX_FMT_BGR0 },
+	{ SPA_VIDEO_FORMAT_xRGB, AV_PIX_FMT_0RGB },
+	{ SPA_VIDEO_FORMAT_xBGR, AV_PIX_FMT_0BGR },
+};
+
+const AVCodec *spa_ffmpeg_find_codec(const struct spa_handle_factory *factory, bool encoder)
+{
+	const char *name = factory->name;
+
+	if (encoder && spa_strstartswith(name, "encoder."))
+		return avcodec_find_encoder_by_name(name + strlen("encoder."));
+	if (!encoder && spa_strstartswith(name, "decoder."))
+		return avcodec_find_decoder_by_name(name + strlen("decoder."));
+	return NULL;
+}
+
+uint32_t spa_ffmpeg_codec_to_subtype(enum AVCodecID id)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(codec_map, m)
+		if (m->id == id)
+			return m->subtype;
+	return SPA_MEDIA_SUBTYPE_unknown;
+}
+
+enum AVCodecID spa_ffmpeg_subtype_to_codec(uint32_t subtype)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(codec_map, m)
+		if (m->subtype == subtype)
+			return m->id;
+	return AV_CODEC_ID_NONE;
+}
+
+uint32_t spa_ffmpeg_subtype_by_index(uint32_t index)
+{
+	if (index >= SPA_N_ELEMENTS(codec_map))
+		return SPA_MEDIA_SUBTYPE_unknown;
+	return codec_map[index].subtype;
+}
+
+uint32_t spa_ffmpeg_pix_fmt_to_format(enum AVPixelFormat pix_fmt)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(format_map, m)
+		if (m->pix_fmt == pix_fmt)
+			return m->format;
+	return SPA_VIDEO_FORMAT_UNKNOWN;
+}
+
+enum AVPixelFormat spa_ffmpeg_format_to_pix_fmt(uint32_t format)
+{
+	SPA_FOR_EACH_ELEMENT_VAR(format_map, m)
+		if (m->format == format)
+			return m->pix_fmt;
+	return AV_PIX_FMT_NONE;
+}
+
+void spa_ffmpeg_setup_context(AVCodecContext *ctx, const struct spa_dict *info,
+		struct spa_log *log)
+{
+	const char *str;
+
+	ctx->thread_count = 0;
+	ctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if (info == NULL)
+		return;
+
+	if ((str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREADS)) != NULL)
+		ctx->thread_count = atoi(str);
+	if ((str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_THREAD_TYPE)) != NULL) {
+		if (spa_streq(str, "frame"))
+			ctx->thread_type = FF_THREAD_FRAME;
+		else if (spa_streq(str, "slice"))
+			ctx->thread_type = FF_THREAD_SLICE;
+		else if (!spa_streq(str, "frame+slice"))
+			spa_log_warn(log, "unknown thread type %s", str);
+	}
+	if ((str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_BIT_RATE)) != NULL)
+		ctx->bit_rate = atoll(str);
+	if ((str = spa_dict_lookup(info, SPA_KEY_API_FFMPEG_GOP_SIZE)) != NULL)
+		ctx->gop_size = atoi(str);
+}
+
+static uint32_t plane_rows(const AVPixFmtDescriptor *desc, uint32_t plane, uint32_t height)
+{
+	/* only the chroma planes of YUV formats are subsampled */
+	if (plane == 0 || plane == 3 || (desc->flags & AV_PIX_FMT_FLAG_RGB))
+		return height;
+	return (height + (1u << desc->log2_chroma_h) - 1) >> desc->log2_chroma_h;
+}
+
+int spa_ffmpeg_layout_init(struct spa_ffmpeg_layout *layout,
+		enum AVPixelFormat pix_fmt, uint32_t width, uint32_t height,
+		uint32_t align, uint32_t n_blocks)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	int i, n_planes = av_pix_fmt_count_planes(pix_fmt);
+	int linesize[4];
+	uint32_t offset = 0;
+
+	if (desc == NULL || n_planes <= 0 || n_planes > SPA_FFMPEG_MAX_PLANES)
+		return -ENOTSUP;
+	if (av_image_fill_linesizes(linesize, pix_fmt, width) < 0)
+		return -EINVAL;
+
+	spa_zero(*layout);
+	layout->n_planes = n_planes;
+	layout->n_blocks = n_blocks == 1 ? 1 : n_planes;
+
+	for (i = 0; i < n_planes; i++) {
+		layout->stride[i] = SPA_ROUND_UP_N((uint32_t)linesize[i], align);
+		layout->rows[i] = plane_rows(desc, i, height);
+		layout->size[i] = layout->stride[i] * layout->rows[i];
+		if (layout->n_blocks == 1) {
+			layout->offset[i] = offset;
+			offset += layout->size[i];
+		}
+	}
+	return 0;
+}
+
+int spa_ffmpeg_layout_packed(struct spa_ffmpeg_layout *layout,
+		enum AVPixelFormat pix_fmt, uint32_t height, uint32_t stride)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	int i, n_planes = av_pix_fmt_count_planes(pix_fmt);
+	uint32_t offset = 0;
+
+	if (desc == NULL || n_planes <= 0 || n_planes > SPA_FFMPEG_MAX_PLANES)
+		return -ENOTSUP;
+
+	spa_zero(*layout);
+	layout->n_planes = n_planes;
+	layout->n_blocks = 1;
+
+	for (i = 0; i < n_planes; i++) {
+		/* the planes have the same width ratio as for a large even width */
+		uint32_t l0 = av_image_get_linesize(pix_fmt, 4096, 0);
+		uint32_t li = av_image_get_linesize(pix_fmt, 4096, i);
+
+		layout->stride[i] = l0 ? (uint64_t)stride * li / l0 : stride;
+		layout->rows[i] = plane_rows(desc, i, height);
+		layout->size[i] = layout->stride[i] * layout->rows[i];
+		layout->offset[i] = offset;
+		offset += layout->size[i];
+	}
+	return 0;
+}
+
+void spa_ffmpeg_copy_planes(uint8_t *dst[SPA_FFMPEG_MAX_PLANES], const int dst_stride[SPA_FFMPEG_MAX_PLANES],
+		uint8_t *const src[SPA_FFMPEG_MAX_PLANES], const int src_stride[SPA_FFMPEG_MAX_PLANES],
+		enum AVPixelFormat pix_fmt, uint32_t width, uint32_t height)
+{
+	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(pix_fmt);
+	int i, n_planes = av_pix_fmt_count_planes(pix_fmt);
+
+	if (desc == NULL)
+		return;
+
+	for (i = 0; i < n_planes && i < SPA_FFMPEG_MAX_PLANES; i++) {
+		int bytewidth = av_image_get_linesize(pix_fmt, width, i);
+
+		if (bytewidth <= 0)
+			continue;
+		av_image_copy_plane(dst[i], dst_stride[i], src[i], src_stride[i],
+				bytewidth, plane_rows(desc, i, height));
+	}
+}
+
+static void *worker_thread(void *data)
+{
+	struct spa_ffmpeg_worker *w = data;
+
+	while (true) {
+		if (sem_wait(&w->sem) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (!__atomic_load_n(&w->running, __ATOMIC_ACQUIRE))
+			break;
+		w->work(w->data);
+	}
+	return NULL;
+}
+
+int spa_ffmpeg_worker_start(struct spa_ffmpeg_worker *w,
+		void (*work) (void *data), void *data)
+{
+	int res;
+
+	if (w->running)
+		return 0;
+
+	w->work = work;
+	w->data = data;
+	if (sem_init(&w->sem, 0, 0) < 0)
+		return -errno;
+
+	w->running = true;
+	if ((res = -pthread_create(&w->thread, NULL, worker_thread, w)) < 0) {
+		w->running = false;
+		sem_destroy(&w->sem);
+		return res;
+	}
+	return 0;
+}
+
+void spa_ffmpeg_worker_stop(struct spa_ffmpeg_worker *w)
+{
+	if (!w->running)
+		return;
+
+	__atomic_store_n(&w->running, false, __ATOMIC_RELEASE);
+	sem_post(&w->sem);
+	pthread_join(w->thread, NULL);
+	sem_destroy(&w->sem);
+}
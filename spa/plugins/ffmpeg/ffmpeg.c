@@ -7,6 +7,8 @@
 
 #include <spa/support/plugin.h>
 #include <spa/node/node.h>
+#include <spa/utils/names.h>
+#include <spa/param/format.h>
 
 #include <libavcodec/avcodec.h>
 
@@ -22,7 +24,7 @@ ffmpeg_dec_init(const struct spa_handle_factory *factory,
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
+	return spa_ffmpeg_dec_init(factory, handle, info, support, n_support);
 }
 
 static int
@@ -35,7 +37,7 @@ ffmpeg_enc_init(const struct spa_handle_factory *factory,
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_enc_init(handle, info, support, n_support);
+	return spa_ffmpeg_enc_init(factory, handle, info, support, n_support);
 }
 
 static const struct spa_interface_info ffmpeg_interfaces[] = {
@@ -104,6 +106,24 @@ static const AVCodec *find_codec_by_index(uint32_t index)
 }
 #endif
 
+/* the generic factories pick the codec from the negotiated format or
+ * the SPA_KEY_API_FFMPEG_CODEC property */
+static const struct spa_handle_factory ffmpeg_dec_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	.name = SPA_NAME_API_CODEC_FFMPEG_DECODER,
+	.get_size = spa_ffmpeg_dec_get_size,
+	.init = ffmpeg_dec_init,
+	.enum_interface_info = ffmpeg_enum_interface_info,
+};
+
+static const struct spa_handle_factory ffmpeg_enc_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	.name = SPA_NAME_API_CODEC_FFMPEG_ENCODER,
+	.get_size = spa_ffmpeg_enc_get_size,
+	.init = ffmpeg_enc_init,
+	.enum_interface_info = ffmpeg_enum_interface_info,
+};
+
 SPA_EXPORT
 int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
 {
@@ -118,10 +138,22 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 	avcodec_register_all();
 #endif
 
-	const AVCodec *c = find_codec_by_index(*index);
+	const AVCodec *c;
+	uint32_t i;
 
-	if (c == NULL)
-		return 0;
+	if (*index < 2) {
+		*factory = *index == 0 ? &ffmpeg_dec_factory : &ffmpeg_enc_factory;
+		(*index)++;
+		return 1;
+	}
+
+	/* only the video codecs that the nodes can negotiate */
+	for (i = *index - 2;; i++) {
+		if ((c = find_codec_by_index(i)) == NULL)
+			return 0;
+		if (spa_ffmpeg_codec_to_subtype(c->id) != SPA_MEDIA_SUBTYPE_unknown)
+			break;
+	}
 
 	if (av_codec_is_encoder(c)) {
 		snprintf(name, sizeof(name), "encoder.%s", c->name);
@@ -134,7 +166,7 @@ int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t
 	}
 
 	*factory = &f;
-	(*index)++;
+	*index = i + 3;
 
 	return 1;
 }
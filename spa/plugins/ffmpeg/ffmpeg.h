@@ -3,18 +3,138 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/support/log.h>
+
+#include <libavcodec/avcodec.h>
 
 struct spa_dict;
 struct spa_handle;
 struct spa_support;
 struct spa_handle_factory;
 
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
+int spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+			struct spa_handle *handle, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
-int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
+int spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+			struct spa_handle *handle, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
 
 size_t spa_ffmpeg_dec_get_size(const struct spa_handle_factory *factory, const struct spa_dict *params);
 size_t spa_ffmpeg_enc_get_size(const struct spa_handle_factory *factory, const struct spa_dict *params);
 
+/** codec of a factory name like "decoder.h264", NULL for the generic
+ * SPA_NAME_API_CODEC_FFMPEG_* factories */
+const AVCodec *spa_ffmpeg_find_codec(const struct spa_handle_factory *factory, bool encoder);
+
+/** media subtype of a codec, or SPA_MEDIA_SUBTYPE_unknown */
+uint32_t spa_ffmpeg_codec_to_subtype(enum AVCodecID id);
+enum AVCodecID spa_ffmpeg_subtype_to_codec(uint32_t subtype);
+/** n-th video media subtype that the codecs can handle */
+uint32_t spa_ffmpeg_subtype_by_index(uint32_t index);
+
+/** video format of a pixel format, or SPA_VIDEO_FORMAT_UNKNOWN */
+uint32_t spa_ffmpeg_pix_fmt_to_format(enum AVPixelFormat pix_fmt);
+enum AVPixelFormat spa_ffmpeg_format_to_pix_fmt(uint32_t format);
+
+/** apply the thread and codec options of the node properties */
+void spa_ffmpeg_setup_context(AVCodecContext *ctx, const struct spa_dict *info,
+		struct spa_log *log);
+
+#define SPA_FFMPEG_MAX_PLANES	4
+
+/**
+ * Layout of a raw frame in the data blocks of a buffer.
+ *
+ * With one block, the planes follow each other and the stride of the
+ * chroma planes is derived from the stride of the first plane. Otherwise
+ * each plane has its own block.
+ */
+struct spa_ffmpeg_layout {
+	uint32_t n_planes;
+	uint32_t n_blocks;
+	uint32_t stride[SPA_FFMPEG_MAX_PLANES];
+	uint32_t offset[SPA_FFMPEG_MAX_PLANES];
+	uint32_t rows[SPA_FFMPEG_MAX_PLANES];
+	uint32_t size[SPA_FFMPEG_MAX_PLANES];
+};
+
+/** Layout for frames of \a width x \a height pixels, including padding.
+ * The strides are aligned to \a align. */
+int spa_ffmpeg_layout_init(struct spa_ffmpeg_layout *layout,
+		enum AVPixelFormat pix_fmt, uint32_t width, uint32_t height,
+		uint32_t align, uint32_t n_blocks);
+
+/** Layout of one block with the first plane at \a stride */
+int spa_ffmpeg_layout_packed(struct spa_ffmpeg_layout *layout,
+		enum AVPixelFormat pix_fmt, uint32_t height, uint32_t stride);
+
+/** Copy the visible part of a frame between planes */
+void spa_ffmpeg_copy_planes(uint8_t *dst[SPA_FFMPEG_MAX_PLANES], const int dst_stride[SPA_FFMPEG_MAX_PLANES],
+		uint8_t *const src[SPA_FFMPEG_MAX_PLANES], const int src_stride[SPA_FFMPEG_MAX_PLANES],
+		enum AVPixelFormat pix_fmt, uint32_t width, uint32_t height);
+
+/**
+ * Queue of indexes between one producer and one consumer thread.
+ */
+#define SPA_FFMPEG_QUEUE_SIZE	64
+
+struct spa_ffmpeg_queue {
+	struct spa_ringbuffer rb;
+	uint32_t items[SPA_FFMPEG_QUEUE_SIZE];
+};
+
+static inline void spa_ffmpeg_queue_init(struct spa_ffmpeg_queue *q)
+{
+	spa_ringbuffer_init(&q->rb);
+}
+
+static inline bool spa_ffmpeg_queue_push(struct spa_ffmpeg_queue *q, uint32_t item)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_write_index(&q->rb, &index) >= SPA_FFMPEG_QUEUE_SIZE)
+		return false;
+	q->items[index & (SPA_FFMPEG_QUEUE_SIZE - 1)] = item;
+	spa_ringbuffer_write_update(&q->rb, index + 1);
+	return true;
+}
+
+static inline bool spa_ffmpeg_queue_pop(struct spa_ffmpeg_queue *q, uint32_t *item)
+{
+	uint32_t index;
+
+	if (spa_ringbuffer_get_read_index(&q->rb, &index) <= 0)
+		return false;
+	*item = q->items[index & (SPA_FFMPEG_QUEUE_SIZE - 1)];
+	spa_ringbuffer_read_update(&q->rb, index + 1);
+	return true;
+}
+
+/**
+ * Thread that runs the codec. The data thread wakes it up with
+ * spa_ffmpeg_worker_wakeup(), which never blocks.
+ */
+struct spa_ffmpeg_worker {
+	pthread_t thread;
+	sem_t sem;
+	bool running;
+	void (*work) (void *data);
+	void *data;
+};
+
+int spa_ffmpeg_worker_start(struct spa_ffmpeg_worker *w,
+		void (*work) (void *data), void *data);
+void spa_ffmpeg_worker_stop(struct spa_ffmpeg_worker *w);
+
+static inline void spa_ffmpeg_worker_wakeup(struct spa_ffmpeg_worker *w)
+{
+	sem_post(&w->sem);
+}
+
 #endif
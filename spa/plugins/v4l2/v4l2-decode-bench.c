@@ -0,0 +1,459 @@
+/* Spa V4l2 MJPEG decoder benchmark */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include "config.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include <jpeglib.h>
+
+#include <spa/support/log-impl.h>
+#include <spa/param/video/raw.h>
+#include <spa/utils/string.h>
+#include <spa/utils/result.h>
+
+#include "v4l2-decode.h"
+
+SPA_LOG_IMPL(logger);
+
+#define DEFAULT_FRAMES		100
+#define DEFAULT_WIDTH		1280
+#define DEFAULT_HEIGHT		720
+#define DEFAULT_THREADS		3
+
+#define MAX_FRAMES		16
+#define MAX_CONSUMERS		4
+
+#define CHECK_MIN_PSNR		30.0
+
+struct frame {
+	uint8_t *data;
+	size_t size;
+};
+
+struct data {
+	bool verbose;
+	bool check;
+	uint32_t n_frames;
+	uint32_t width;
+	uint32_t height;
+	uint32_t max_threads;
+	const char *iname;
+
+	/* synthetic frames */
+	uint8_t *rgb[MAX_FRAMES];
+
+	struct frame frames[MAX_FRAMES];
+	uint32_t n_jpeg;
+	uint8_t *file_data;
+
+	uint32_t n_failed;
+};
+
+static const struct {
+	const char *name;
+	uint32_t format;
+} formats[] = {
+	{ "I420", SPA_VIDEO_FORMAT_I420 },
+	{ "NV12", SPA_VIDEO_FORMAT_NV12 },
+	{ "YUY2", SPA_VIDEO_FORMAT_YUY2 },
+};
+
+#define OPTIONS		"hvCf:s:t:i:"
+static const struct option long_options[] = {
+	{ "help",	no_argument,		NULL, 'h'},
+	{ "verbose",	no_argument,		NULL, 'v'},
+	{ "check",	no_argument,		NULL, 'C'},
+
+	{ "frames",	required_argument,	NULL, 'f' },
+	{ "size",	required_argument,	NULL, 's' },
+	{ "threads",	required_argument,	NULL, 't' },
+	{ "input",	required_argument,	NULL, 'i' },
+
+        { NULL, 0, NULL, 0 }
+};
+
+static void show_usage(const char *name, bool is_error)
+{
+	FILE *fp;
+
+	fp = is_error ? stderr : stdout;
+
+	fprintf(fp, "%s [options]\n", name);
+	fprintf(fp,
+		"  -h, --help                            Show this help\n"
+		"  -v  --verbose                         Be verbose\n"
+		"  -C  --check                           Fail on decode errors, bad quality or when\n"
+		"                                        threaded decoding gives other frames\n"
+		"\n");
+	fprintf(fp,
+		"  -f  --frames                          Frames to decode per run (default %u)\n"
+		"  -s  --size                            Size of the synthetic frames (default %ux%u)\n"
+		"  -t  --threads                         Maximum number of decoder workers (default %u)\n"
+		"  -i  --input                           Decode the frames of an MJPEG file, such as\n"
+		"                                        one captured with v4l2-ctl --stream-to\n"
+		"\n",
+		DEFAULT_FRAMES, DEFAULT_WIDTH, DEFAULT_HEIGHT, DEFAULT_THREADS);
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* user and system time of all threads */
+static uint64_t get_cpu_ns(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return SPA_TIMEVAL_TO_NSEC(&ru.ru_utime) + SPA_TIMEVAL_TO_NSEC(&ru.ru_stime);
+}
+
+/* A moving gradient with blocks, encoded like a UVC camera does, 4:2:2 */
+static int make_frames(struct data *d, int restart_rows)
+{
+	uint32_t i, x, y, w = d->width, h = d->height;
+
+	for (i = 0; i < MAX_FRAMES; i++) {
+		struct jpeg_compress_struct cinfo;
+		struct jpeg_error_mgr jerr;
+		unsigned long size = 0;
+		uint8_t *rgb, *out = NULL;
+
+		if ((rgb = d->rgb[i]) == NULL) {
+			if ((rgb = d->rgb[i] = malloc(w * h * 3)) == NULL)
+				return -errno;
+			for (y = 0; y < h; y++) {
+				for (x = 0; x < w; x++) {
+					uint8_t *p = &rgb[(y * w + x) * 3];
+					p[0] = ((x + i * 8) * 255) / (w + MAX_FRAMES * 8);
+					p[1] = (y * 255) / h;
+					p[2] = (((x + i * 4) / 16 + y / 16) & 1) ? 200 : 40;
+				}
+			}
+		}
+
+		cinfo.err = jpeg_std_error(&jerr);
+		jpeg_create_compress(&cinfo);
+		jpeg_mem_dest(&cinfo, &out, &size);
+		cinfo.image_width = w;
+		cinfo.image_height = h;
+		cinfo.input_components = 3;
+		cinfo.in_color_space = JCS_RGB;
+		jpeg_set_defaults(&cinfo);
+		jpeg_set_quality(&cinfo, 90, TRUE);
+		cinfo.comp_info[0].h_samp_factor = 2;
+		cinfo.comp_info[0].v_samp_factor = 1;
+		cinfo.restart_in_rows = restart_rows;
+
+		jpeg_start_compress(&cinfo, TRUE);
+		while (cinfo.next_scanline < h) {
+			JSAMPROW row = &rgb[cinfo.next_scanline * w * 3];
+			jpeg_write_scanlines(&cinfo, &row, 1);
+		}
+		jpeg_finish_compress(&cinfo);
+		jpeg_destroy_compress(&cinfo);
+
+		free(d->frames[i].data);
+		d->frames[i].data = out;
+		d->frames[i].size = size;
+	}
+	d->n_jpeg = MAX_FRAMES;
+	return 0;
+}
+
+/* Split a stream of JPEG frames on the SOI and EOI markers */
+static int read_frames(struct data *d)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	FILE *f;
+	long size;
+	size_t pos, start = 0;
+	bool in_frame = false;
+	int res = 0;
+
+	if ((f = fopen(d->iname, "r")) == NULL)
+		return -errno;
+	if (fseek(f, 0, SEEK_END) < 0 || (size = ftell(f)) < 0 ||
+	    fseek(f, 0, SEEK_SET) < 0) {
+		res = -errno;
+		goto done;
+	}
+	if ((d->file_data = malloc(size)) == NULL) {
+		res = -errno;
+		goto done;
+	}
+	if (fread(d->file_data, 1, size, f) != (size_t)size) {
+		res = -EIO;
+		goto done;
+	}
+
+	for (pos = 0; pos + 1 < (size_t)size && d->n_jpeg < MAX_FRAMES; pos++) {
+		if (d->file_data[pos] != 0xff)
+			continue;
+		if (!in_frame && d->file_data[pos + 1] == 0xd8) {
+			start = pos;
+			in_frame = true;
+		} else if (in_frame && d->file_data[pos + 1] == 0xd9) {
+			d->frames[d->n_jpeg].data = &d->file_data[start];
+			d->frames[d->n_jpeg].size = pos + 2 - start;
+			d->n_jpeg++;
+			in_frame = false;
+		}
+	}
+	if (d->n_jpeg == 0) {
+		res = -EINVAL;
+		goto done;
+	}
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_decompress(&cinfo);
+	jpeg_mem_src(&cinfo, d->frames[0].data, d->frames[0].size);
+	jpeg_read_header(&cinfo, TRUE);
+	d->width = cinfo.image_width;
+	d->height = cinfo.image_height;
+	jpeg_destroy_decompress(&cinfo);
+done:
+	fclose(f);
+	return res;
+}
+
+static double luma_psnr(struct data *d, uint32_t format, uint32_t stride,
+		const uint8_t *frame, const uint8_t *rgb)
+{
+	uint32_t x, y;
+	double mse = 0.0;
+
+	for (y = 0; y < d->height; y++) {
+		for (x = 0; x < d->width; x++) {
+			const uint8_t *p = &rgb[(y * d->width + x) * 3];
+			double ref = 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+			double v = format == SPA_VIDEO_FORMAT_YUY2 ?
+				frame[y * stride + x * 2] : frame[y * stride + x];
+			mse += (ref - v) * (ref - v);
+		}
+	}
+	mse /= d->width * d->height;
+	return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+}
+
+/* Decode the frames with a decoder per consumer, or one decoder when shared.
+ * Returns the decode time and the CPU time per frame in msec. */
+static int run_decode(struct data *d, uint32_t format, uint32_t n_threads,
+		uint32_t n_decoders, uint8_t *dst, uint32_t size,
+		double *dec_ms, double *cpu_ms)
+{
+	struct spa_v4l2_decoder *dec[MAX_CONSUMERS];
+	uint64_t t0, c0;
+	uint32_t i, j;
+	int res = 0;
+
+	for (j = 0; j < n_decoders; j++) {
+		if ((dec[j] = spa_v4l2_decoder_new(n_threads, &logger.log)) == NULL) {
+			res = -errno;
+			n_decoders = j;
+			goto done;
+		}
+	}
+
+	t0 = get_time_ns();
+	c0 = get_cpu_ns();
+	for (i = 0; i < d->n_frames; i++) {
+		struct frame *f = &d->frames[i % d->n_jpeg];
+
+		for (j = 0; j < n_decoders; j++) {
+			if ((res = spa_v4l2_decoder_decode(dec[j], f->data, f->size, format,
+							d->width, d->height, dst, size)) < 0)
+				goto done;
+		}
+	}
+	*dec_ms = (get_time_ns() - t0) / 1e6 / d->n_frames;
+	*cpu_ms = (get_cpu_ns() - c0) / 1e6 / d->n_frames;
+
+done:
+	for (j = 0; j < n_decoders; j++)
+		spa_v4l2_decoder_free(dec[j]);
+	return res;
+}
+
+static int check_frames(struct data *d, uint32_t format, uint32_t stride,
+		uint32_t size, uint32_t n_threads, uint8_t *ref, uint8_t *out)
+{
+	struct spa_v4l2_decoder *dec, *ref_dec;
+	uint32_t i;
+	int res = 0;
+
+	ref_dec = spa_v4l2_decoder_new(0, &logger.log);
+	dec = spa_v4l2_decoder_new(n_threads, &logger.log);
+	if (ref_dec == NULL || dec == NULL) {
+		res = -errno;
+		goto done;
+	}
+
+	for (i = 0; i < d->n_jpeg; i++) {
+		struct frame *f = &d->frames[i];
+
+		if ((res = spa_v4l2_decoder_decode(ref_dec, f->data, f->size, format,
+						d->width, d->height, ref, size)) < 0 ||
+		    (res = spa_v4l2_decoder_decode(dec, f->data, f->size, format,
+						d->width, d->height, out, size)) < 0)
+			goto done;
+
+		if (memcmp(ref, out, size) != 0) {
+			fprintf(stderr, "frame %u: %u workers decode differently\n", i, n_threads);
+			res = -EINVAL;
+			goto done;
+		}
+		if (d->rgb[i] != NULL) {
+			double psnr = luma_psnr(d, format, stride, ref, d->rgb[i]);
+			if (psnr < CHECK_MIN_PSNR) {
+				fprintf(stderr, "frame %u: luma PSNR %.2f dB below %.2f dB\n",
+						i, psnr, CHECK_MIN_PSNR);
+				res = -EINVAL;
+				goto done;
+			}
+		}
+	}
+done:
+	if (ref_dec)
+		spa_v4l2_decoder_free(ref_dec);
+	if (dec)
+		spa_v4l2_decoder_free(dec);
+	return res;
+}
+
+static void run_format(struct data *d, const char *name, uint32_t format, const char *rst)
+{
+	uint32_t stride, size, n;
+	uint8_t *ref = NULL, *out = NULL;
+	double dec_ms, cpu_ms, shared_ms = 0.0;
+	int res;
+
+	if (spa_v4l2_decoder_layout(format, d->width, d->height, &stride, &size) < 0 ||
+	    (ref = malloc(size)) == NULL || (out = malloc(size)) == NULL) {
+		d->n_failed++;
+		goto done;
+	}
+
+	for (n = 0; n <= d->max_threads; n++) {
+		if (d->check && n > 0 &&
+		    check_frames(d, format, stride, size, n, ref, out) < 0) {
+			d->n_failed++;
+			continue;
+		}
+		if ((res = run_decode(d, format, n, 1, out, size, &dec_ms, &cpu_ms)) < 0) {
+			fprintf(stderr, "%s: decode failed: %s\n", name, spa_strerror(res));
+			d->n_failed++;
+			continue;
+		}
+		printf("%5ux%-5u %-4s %-3s decode workers:%u %8.2f %8.2f\n",
+				d->width, d->height, name, rst, n, dec_ms, cpu_ms);
+		if (n == d->max_threads)
+			shared_ms = cpu_ms;
+	}
+
+	/* a shared decode costs the same for any number of consumers, without
+	 * it every consumer decodes the frame itself */
+	for (n = 1; n <= MAX_CONSUMERS; n++) {
+		if ((res = run_decode(d, format, 0, n, out, size, &dec_ms, &cpu_ms)) < 0) {
+			d->n_failed++;
+			continue;
+		}
+		printf("%5ux%-5u %-4s %-3s consumers:%u      shared-cpu:%6.2f own-cpu:%6.2f\n",
+				d->width, d->height, name, rst, n, shared_ms, cpu_ms);
+	}
+done:
+	free(ref);
+	free(out);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data;
+	uint32_t i, r;
+	int c, res;
+
+	spa_zero(data);
+	data.n_frames = DEFAULT_FRAMES;
+	data.width = DEFAULT_WIDTH;
+	data.height = DEFAULT_HEIGHT;
+	data.max_threads = DEFAULT_THREADS;
+
+	while ((c = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_usage(argv[0], false);
+			return EXIT_SUCCESS;
+		case 'v':
+			data.verbose = true;
+			break;
+		case 'C':
+			data.check = true;
+			break;
+		case 'f':
+			data.n_frames = atoi(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%ux%u", &data.width, &data.height) != 2) {
+				show_usage(argv[0], true);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't':
+			data.max_threads = SPA_MIN((uint32_t)atoi(optarg),
+					(uint32_t)SPA_V4L2_DECODER_MAX_THREADS);
+			break;
+		case 'i':
+			data.iname = optarg;
+			break;
+		default:
+			show_usage(argv[0], true);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (data.n_frames == 0 || data.width == 0 || data.height == 0) {
+		show_usage(argv[0], true);
+		return EXIT_FAILURE;
+	}
+
+	logger.log.level = data.verbose ? SPA_LOG_LEVEL_DEBUG : SPA_LOG_LEVEL_WARN;
+
+	if (data.iname && (res = read_frames(&data)) < 0) {
+		fprintf(stderr, "error: can't read \"%s\": %s\n", data.iname, spa_strerror(res));
+		return EXIT_FAILURE;
+	}
+
+	printf("%-11s %-4s %-3s %-19s %8s %8s\n", "size", "fmt", "rst", "", "ms/frame", "cpu-ms");
+
+	/* synthetic frames without and with a restart marker per MCU row */
+	for (r = 0; r < (data.iname ? 1u : 2u); r++) {
+		if (!data.iname && (res = make_frames(&data, r)) < 0) {
+			fprintf(stderr, "error: can't make frames: %s\n", spa_strerror(res));
+			return EXIT_FAILURE;
+		}
+		for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+			run_format(&data, formats[i].name, formats[i].format,
+					data.iname ? "-" : r ? "yes" : "no");
+	}
+
+	for (i = 0; i < MAX_FRAMES; i++) {
+		free(data.rgb[i]);
+		if (data.file_data == NULL)
+			free(data.frames[i].data);
+	}
+	free(data.file_data);
+
+	return data.n_failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
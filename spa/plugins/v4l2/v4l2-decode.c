@@ -0,0 +1,636 @@
+/* Spa V4l2 MJPEG decoder */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <pthread.h>
+
+#include <jpeglib.h>
+
+#include <spa/param/video/raw.h>
+#include <spa/utils/result.h>
+
+#include "config.h"
+#include "v4l2-decode.h"
+
+static struct spa_log_topic log_topic = SPA_LOG_TOPIC(0, "spa.v4l2.decode");
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+
+/* rows of a slice are a multiple of this, so that I420 and NV12 slices
+ * start on a chroma row and JPEG slices usually on an MCU row */
+#define SLICE_ALIGN	16
+#define MIN_SLICE	64
+#define MAX_SLICES	(SPA_V4L2_DECODER_MAX_THREADS + 1)
+
+struct error_mgr {
+	struct jpeg_error_mgr pub;
+	jmp_buf jmp;
+};
+
+/* Reads a patched copy of the headers, followed by the entropy coded data
+ * of the frame from a restart marker on */
+struct slice_src {
+	struct jpeg_source_mgr pub;
+	const uint8_t *data;
+	size_t size;
+	bool in_data;
+};
+
+struct slice {
+	struct spa_v4l2_decoder *dec;
+
+	struct jpeg_decompress_struct cinfo;
+	struct error_mgr jerr;
+	struct slice_src src;
+
+	uint8_t *header;		/* headers with the slice height */
+	size_t header_size;
+	size_t header_alloc;
+	size_t offset;			/* of the entropy coded data, 0 to skip rows */
+
+	uint8_t *rows;			/* SLICE_ALIGN rows of YCbCr pixels */
+	uint32_t rows_width;
+
+	uint32_t y0, y1;
+	int res;
+};
+
+struct spa_v4l2_decoder {
+	struct spa_log *log;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	pthread_t threads[SPA_V4L2_DECODER_MAX_THREADS];
+	uint32_t n_threads;
+	bool quit;
+
+	struct slice slices[MAX_SLICES];
+
+	/* Current frame, protected by lock */
+	const uint8_t *src;
+	size_t size;
+	uint32_t format;
+	uint32_t width, height;
+	uint32_t stride;
+	uint8_t *dst;
+
+	uint32_t n_slices;
+	uint32_t next;
+	uint32_t running;
+};
+
+/* The parts of the JPEG headers that are needed to decode slices that
+ * start on a restart marker */
+struct jpeg_layout {
+	size_t height_offset;		/* of the height in the SOF header */
+	size_t data_offset;		/* of the entropy coded data */
+	uint32_t width, height;
+	uint32_t mcu_width, mcu_height;
+	uint32_t restart_interval;	/* in MCUs */
+};
+
+static void error_exit(j_common_ptr cinfo)
+{
+	struct error_mgr *err = SPA_CONTAINER_OF(cinfo->err, struct error_mgr, pub);
+	longjmp(err->jmp, 1);
+}
+
+static void output_message(j_common_ptr cinfo)
+{
+	/* corrupt data warnings are common with cheap cameras */
+}
+
+static void src_init(j_decompress_ptr cinfo)
+{
+}
+
+static boolean src_fill(j_decompress_ptr cinfo)
+{
+	static const JOCTET eoi[2] = { 0xff, JPEG_EOI };
+	struct slice_src *src = SPA_CONTAINER_OF(cinfo->src, struct slice_src, pub);
+
+	if (!src->in_data && src->size > 0) {
+		src->pub.next_input_byte = src->data;
+		src->pub.bytes_in_buffer = src->size;
+		src->in_data = true;
+	} else {
+		/* truncated frame, let the decoder end it */
+		src->pub.next_input_byte = eoi;
+		src->pub.bytes_in_buffer = 2;
+	}
+	return TRUE;
+}
+
+static void src_skip(j_decompress_ptr cinfo, long n)
+{
+	struct jpeg_source_mgr *src = cinfo->src;
+
+	while (n > (long)src->bytes_in_buffer) {
+		n -= src->bytes_in_buffer;
+		src_fill(cinfo);
+	}
+	src->next_input_byte += n;
+	src->bytes_in_buffer -= n;
+}
+
+static void src_term(j_decompress_ptr cinfo)
+{
+}
+
+static inline uint32_t read_u16(const uint8_t *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+/* Find the headers of a baseline frame with one interleaved scan */
+static int parse_layout(const uint8_t *data, size_t size, struct jpeg_layout *l)
+{
+	size_t pos = 2, len;
+	uint32_t i, n_comp, max_h = 0, max_v = 0;
+	bool have_sof = false;
+
+	spa_zero(*l);
+	if (size < 4 || data[0] != 0xff || data[1] != 0xd8) /* SOI */
+		return -EINVAL;
+
+	while (pos + 4 <= size) {
+		uint8_t m;
+
+		if (data[pos] != 0xff)
+			return -EINVAL;
+		while (pos < size && data[pos] == 0xff)
+			pos++;
+		if (pos + 3 > size)
+			return -EINVAL;
+
+		m = data[pos++];
+		len = read_u16(&data[pos]);
+		if (len < 2 || pos + len > size)
+			return -EINVAL;
+
+		switch (m) {
+		case 0xc0: /* SOF0 */
+		case 0xc1: /* SOF1 */
+			if (len < 8)
+				return -EINVAL;
+			l->height_offset = pos + 3;
+			l->height = read_u16(&data[pos + 3]);
+			l->width = read_u16(&data[pos + 5]);
+			n_comp = data[pos + 7];
+			if (n_comp != 3 || len < 8 + 3 * n_comp)
+				return -ENOTSUP;
+			for (i = 0; i < n_comp; i++) {
+				uint8_t f = data[pos + 9 + i * 3];
+				max_h = SPA_MAX(max_h, (uint32_t)(f >> 4));
+				max_v = SPA_MAX(max_v, (uint32_t)(f & 0xf));
+			}
+			l->mcu_width = max_h * DCTSIZE;
+			l->mcu_height = max_v * DCTSIZE;
+			have_sof = true;
+			break;
+		case 0xc2 ... 0xc3: /* progressive, lossless */
+		case 0xc5 ... 0xc7:
+		case 0xc9 ... 0xcb:
+		case 0xcd ... 0xcf:
+			return -ENOTSUP;
+		case 0xdd: /* DRI */
+			if (len < 4)
+				return -EINVAL;
+			l->restart_interval = read_u16(&data[pos + 2]);
+			break;
+		case 0xda: /* SOS */
+			if (!have_sof || data[pos + 2] != n_comp)
+				return -ENOTSUP;
+			l->data_offset = pos + len;
+			return 0;
+		}
+		pos += len;
+	}
+	return -EINVAL;
+}
+
+/* Find the offset of the data after the n-th restart marker */
+static size_t find_restart(const uint8_t *data, size_t size, size_t pos, uint32_t n)
+{
+	const uint8_t *p;
+
+	while (n > 0 && (p = memchr(&data[pos], 0xff, size - pos)) != NULL) {
+		pos = p - data + 1;
+		if (pos >= size)
+			break;
+		if (data[pos] >= JPEG_RST0 && data[pos] <= JPEG_RST0 + 7)
+			n--;
+		else if (data[pos] == JPEG_EOI)
+			break;
+	}
+	return n == 0 ? pos + 1 : 0;
+}
+
+static inline uint8_t avg2(uint8_t a, uint8_t b)
+{
+	return (a + b + 1) >> 1;
+}
+
+static inline uint8_t avg4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	return (a + b + c + d + 2) >> 2;
+}
+
+/* Convert n rows of YCbCr pixels, starting at row y of the frame */
+static void convert_rows(struct spa_v4l2_decoder *dec, const uint8_t *rows,
+		uint32_t y, uint32_t n)
+{
+	uint32_t w = dec->width, h = dec->height, stride = dec->stride;
+	uint32_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+	uint32_t i, x, rs = w * 3;
+
+	switch (dec->format) {
+	case SPA_VIDEO_FORMAT_YUY2:
+		for (i = 0; i < n; i++) {
+			const uint8_t *s = &rows[i * rs];
+			uint8_t *d = dec->dst + (size_t)(y + i) * stride;
+
+			for (x = 0; x < w; x += 2) {
+				const uint8_t *s1 = x + 1 < w ? s + 3 : s;
+				d[0] = s[0];
+				d[1] = avg2(s[1], s1[1]);
+				d[2] = s1[0];
+				d[3] = avg2(s[2], s1[2]);
+				s += 6;
+				d += 4;
+			}
+		}
+		break;
+
+	case SPA_VIDEO_FORMAT_I420:
+	case SPA_VIDEO_FORMAT_NV12:
+	{
+		uint8_t *cplane = dec->dst + (size_t)stride * h;
+		bool planar = dec->format == SPA_VIDEO_FORMAT_I420;
+		uint32_t cstride = planar ? stride / 2 : stride;
+
+		for (i = 0; i < n; i++) {
+			const uint8_t *s = &rows[i * rs];
+			uint8_t *d = dec->dst + (size_t)(y + i) * stride;
+
+			for (x = 0; x < w; x++)
+				d[x] = s[x * 3];
+		}
+		for (i = 0; i < n; i += 2) {
+			const uint8_t *s0 = &rows[i * rs];
+			const uint8_t *s1 = i + 1 < n ? s0 + rs : s0;
+			uint32_t cy = (y + i) / 2;
+			uint8_t *u, *v;
+
+			if (planar) {
+				u = cplane + (size_t)cy * cstride;
+				v = cplane + (size_t)cstride * ch + (size_t)cy * cstride;
+			} else {
+				u = cplane + (size_t)cy * cstride;
+				v = u + 1;
+			}
+			for (x = 0; x < cw; x++) {
+				uint32_t x0 = x * 6, x1 = 2 * x + 1 < w ? x0 + 3 : x0;
+				uint8_t cb = avg4(s0[x0 + 1], s0[x1 + 1], s1[x0 + 1], s1[x1 + 1]);
+				uint8_t cr = avg4(s0[x0 + 2], s0[x1 + 2], s1[x0 + 2], s1[x1 + 2]);
+				if (planar) {
+					u[x] = cb;
+					v[x] = cr;
+				} else {
+					u[2 * x] = cb;
+					v[2 * x] = cr;
+				}
+			}
+		}
+		break;
+	}
+	}
+}
+
+static int decode_slice(struct slice *s)
+{
+	struct spa_v4l2_decoder *dec = s->dec;
+	struct jpeg_decompress_struct *cinfo = &s->cinfo;
+	JSAMPROW row[SLICE_ALIGN];
+	uint32_t y, n, i, height;
+
+	if (s->rows_width < dec->width) {
+		free(s->rows);
+		s->rows = malloc((size_t)dec->width * 3 * SLICE_ALIGN);
+		s->rows_width = s->rows ? dec->width : 0;
+		if (s->rows == NULL)
+			return -errno;
+	}
+	for (i = 0; i < SLICE_ALIGN; i++)
+		row[i] = &s->rows[i * dec->width * 3];
+
+	if (setjmp(s->jerr.jmp)) {
+		char msg[JMSG_LENGTH_MAX];
+		cinfo->err->format_message((j_common_ptr)cinfo, msg);
+		spa_log_debug(dec->log, "%p: slice %u-%u: %s", dec, s->y0, s->y1, msg);
+		jpeg_abort_decompress(cinfo);
+		return -EINVAL;
+	}
+
+	cinfo->src = &s->src.pub;
+	if (s->offset > 0) {
+		s->src.pub.next_input_byte = s->header;
+		s->src.pub.bytes_in_buffer = s->header_size;
+		s->src.data = (const uint8_t*)dec->src + s->offset;
+		s->src.size = dec->size - s->offset;
+	} else {
+		s->src.pub.next_input_byte = dec->src;
+		s->src.pub.bytes_in_buffer = dec->size;
+		s->src.data = NULL;
+		s->src.size = 0;
+	}
+	s->src.in_data = false;
+	if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK)
+		goto invalid;
+
+	cinfo->out_color_space = JCS_YCbCr;
+	cinfo->dct_method = JDCT_ISLOW;
+	/* we subsample the chroma again, don't interpolate it */
+	cinfo->do_fancy_upsampling = FALSE;
+	cinfo->do_block_smoothing = FALSE;
+
+	jpeg_start_decompress(cinfo);
+
+	/* a slice from a restart marker is a frame of the slice height */
+	height = s->offset > 0 ? s->y1 - s->y0 : dec->height;
+	if (cinfo->output_width != dec->width || cinfo->output_height != height ||
+	    cinfo->output_components != 3) {
+		spa_log_debug(dec->log, "%p: frame %ux%u:%d, expected %ux%u", dec,
+				cinfo->output_width, cinfo->output_height,
+				cinfo->output_components, dec->width, height);
+		goto invalid;
+	}
+
+	if (s->offset == 0 && s->y0 > 0)
+		jpeg_skip_scanlines(cinfo, s->y0);
+
+	for (y = s->y0; y < s->y1; y += n) {
+		uint32_t want = SPA_MIN(s->y1 - y, (uint32_t)SLICE_ALIGN);
+
+		for (n = 0; n < want; )
+			n += jpeg_read_scanlines(cinfo, &row[n], want - n);
+
+		convert_rows(dec, s->rows, y, n);
+	}
+	/* the other slices have the rest of the frame */
+	jpeg_abort_decompress(cinfo);
+	return 0;
+
+invalid:
+	jpeg_abort_decompress(cinfo);
+	return -EINVAL;
+}
+
+/** Decode the next slice of the frame, called with the lock held */
+static void run_next(struct spa_v4l2_decoder *dec)
+{
+	struct slice *s = &dec->slices[dec->next++];
+
+	dec->running++;
+	pthread_mutex_unlock(&dec->lock);
+
+	s->res = decode_slice(s);
+
+	pthread_mutex_lock(&dec->lock);
+	dec->running--;
+
+	if (dec->next >= dec->n_slices && dec->running == 0)
+		pthread_cond_signal(&dec->done_cond);
+}
+
+static void *worker_thread(void *data)
+{
+	struct spa_v4l2_decoder *dec = data;
+
+	pthread_mutex_lock(&dec->lock);
+	while (true) {
+		while (!dec->quit && dec->next >= dec->n_slices)
+			pthread_cond_wait(&dec->work_cond, &dec->lock);
+		if (dec->quit)
+			break;
+		run_next(dec);
+	}
+	pthread_mutex_unlock(&dec->lock);
+	return NULL;
+}
+
+uint32_t spa_v4l2_decoder_default_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	/* the calling thread decodes a slice as well */
+	return SPA_CLAMP(n - 1, 0l, 3l);
+}
+
+struct spa_v4l2_decoder *spa_v4l2_decoder_new(uint32_t n_threads, struct spa_log *log)
+{
+	struct spa_v4l2_decoder *dec;
+	uint32_t i;
+	int res;
+
+	if ((dec = calloc(1, sizeof(*dec))) == NULL)
+		return NULL;
+
+	spa_log_topic_init(log, &log_topic);
+	dec->log = log;
+
+	for (i = 0; i < MAX_SLICES; i++) {
+		struct slice *s = &dec->slices[i];
+
+		s->dec = dec;
+		s->cinfo.err = jpeg_std_error(&s->jerr.pub);
+		s->jerr.pub.error_exit = error_exit;
+		s->jerr.pub.output_message = output_message;
+		jpeg_create_decompress(&s->cinfo);
+
+		s->src.pub.init_source = src_init;
+		s->src.pub.fill_input_buffer = src_fill;
+		s->src.pub.skip_input_data = src_skip;
+		s->src.pub.resync_to_restart = jpeg_resync_to_restart;
+		s->src.pub.term_source = src_term;
+	}
+
+	pthread_mutex_init(&dec->lock, NULL);
+	pthread_cond_init(&dec->work_cond, NULL);
+	pthread_cond_init(&dec->done_cond, NULL);
+
+	n_threads = SPA_MIN(n_threads, (uint32_t)SPA_V4L2_DECODER_MAX_THREADS);
+	for (i = 0; i < n_threads; i++) {
+		if ((res = -pthread_create(&dec->threads[i], NULL, worker_thread, dec)) < 0) {
+			spa_log_warn(dec->log, "%p: can't start worker %u: %s",
+					dec, i, spa_strerror(res));
+			break;
+		}
+		dec->n_threads++;
+	}
+
+	spa_log_info(dec->log, "%p: MJPEG decoder with %u workers", dec, dec->n_threads);
+	return dec;
+}
+
+void spa_v4l2_decoder_free(struct spa_v4l2_decoder *dec)
+{
+	uint32_t i;
+
+	pthread_mutex_lock(&dec->lock);
+	dec->quit = true;
+	pthread_cond_broadcast(&dec->work_cond);
+	pthread_mutex_unlock(&dec->lock);
+
+	for (i = 0; i < dec->n_threads; i++)
+		pthread_join(dec->threads[i], NULL);
+
+	for (i = 0; i < MAX_SLICES; i++) {
+		jpeg_destroy_decompress(&dec->slices[i].cinfo);
+		free(dec->slices[i].rows);
+		free(dec->slices[i].header);
+	}
+	pthread_cond_destroy(&dec->work_cond);
+	pthread_cond_destroy(&dec->done_cond);
+	pthread_mutex_destroy(&dec->lock);
+	free(dec);
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b != 0) {
+		uint32_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* Start slices on restart markers, when the frame has them, so that each
+ * slice is a complete frame of its own that only needs the data from its
+ * marker on. A slice must start on a RST0 marker, the decoder expects the
+ * markers to count up from there. */
+static uint32_t plan_restart_slices(struct spa_v4l2_decoder *dec, uint32_t n_slices)
+{
+	const uint8_t *data = dec->src;
+	struct jpeg_layout l;
+	uint32_t i, mcu_cols, unit, rows, interval, prev = 0;
+	size_t pos;
+
+	if (n_slices < 2 || parse_layout(data, dec->size, &l) < 0 ||
+	    l.restart_interval == 0 || l.width != dec->width || l.height != dec->height)
+		return 0;
+
+	/* a slice starts on an MCU row that starts a multiple of 8 intervals */
+	mcu_cols = (l.width + l.mcu_width - 1) / l.mcu_width;
+	interval = l.restart_interval * 8;
+	unit = interval / gcd(mcu_cols, interval) * l.mcu_height;
+
+	rows = SPA_ROUND_UP_N((dec->height + n_slices - 1) / n_slices, unit);
+	n_slices = (dec->height + rows - 1) / rows;
+	if (n_slices < 2)
+		return 0;
+
+	pos = l.data_offset;
+	for (i = 0; i < n_slices; i++) {
+		struct slice *s = &dec->slices[i];
+		uint32_t n = (i * rows / l.mcu_height) * mcu_cols / l.restart_interval;
+
+		s->y0 = i * rows;
+		s->y1 = SPA_MIN(s->y0 + rows, dec->height);
+
+		if (i > 0 && (pos = find_restart(data, dec->size, pos, n - prev)) == 0)
+			return 0;
+		s->offset = pos;
+		prev = n;
+
+		if (s->header_alloc < l.data_offset) {
+			free(s->header);
+			s->header_alloc = 0;
+			if ((s->header = malloc(l.data_offset)) == NULL)
+				return 0;
+			s->header_alloc = l.data_offset;
+		}
+		memcpy(s->header, data, l.data_offset);
+		s->header[l.height_offset] = (s->y1 - s->y0) >> 8;
+		s->header[l.height_offset + 1] = (s->y1 - s->y0) & 0xff;
+		s->header_size = l.data_offset;
+	}
+	return n_slices;
+}
+
+int spa_v4l2_decoder_decode(struct spa_v4l2_decoder *dec,
+		const void *src, size_t size,
+		uint32_t format, uint32_t width, uint32_t height,
+		void *dst, size_t maxsize)
+{
+	uint32_t i, stride, frame_size, n_slices, rows;
+	int res;
+
+	if ((res = spa_v4l2_decoder_layout(format, width, height, &stride, &frame_size)) < 0)
+		return res;
+	if (maxsize < frame_size || width == 0 || height == 0)
+		return -ENOSPC;
+
+	n_slices = SPA_MIN(dec->n_threads + 1, height / MIN_SLICE);
+	n_slices = SPA_MAX(n_slices, 1u);
+
+	pthread_mutex_lock(&dec->lock);
+
+	dec->src = src;
+	dec->size = size;
+	dec->format = format;
+	dec->width = width;
+	dec->height = height;
+	dec->stride = stride;
+	dec->dst = dst;
+
+	if ((i = plan_restart_slices(dec, n_slices)) > 0) {
+		n_slices = i;
+	} else {
+		/* without restart markers, the rows that a slice skips are still
+		 * entropy decoded, so more slices than threads only add work */
+		rows = SPA_ROUND_UP_N((height + n_slices - 1) / n_slices, SLICE_ALIGN);
+		n_slices = (height + rows - 1) / rows;
+
+		for (i = 0; i < n_slices; i++) {
+			struct slice *s = &dec->slices[i];
+			s->y0 = i * rows;
+			s->y1 = SPA_MIN(s->y0 + rows, height);
+			s->offset = 0;
+		}
+	}
+	for (i = 0; i < n_slices; i++)
+		dec->slices[i].res = 0;
+	dec->n_slices = n_slices;
+	dec->next = 0;
+	dec->running = 0;
+
+	if (dec->n_threads > 0 && n_slices > 1)
+		pthread_cond_broadcast(&dec->work_cond);
+
+	/* decode slices ourselves while there are any left */
+	while (dec->next < dec->n_slices)
+		run_next(dec);
+	while (dec->running > 0)
+		pthread_cond_wait(&dec->done_cond, &dec->lock);
+
+	dec->n_slices = 0;
+	dec->next = 0;
+
+	pthread_mutex_unlock(&dec->lock);
+
+	res = 0;
+	for (i = 0; i < n_slices; i++) {
+		if (dec->slices[i].res < 0)
+			res = dec->slices[i].res;
+	}
+	return res;
+}
@@ -0,0 +1,93 @@
+/* Spa V4l2 MJPEG decoder */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef SPA_V4L2_DECODE_H
+#define SPA_V4L2_DECODE_H
+
+#include <stddef.h>
+#include <errno.h>
+
+#include <spa/utils/defs.h>
+#include <spa/support/log.h>
+#include <spa/param/video/raw.h>
+
+#define SPA_V4L2_DECODER_MAX_THREADS	8
+
+/**
+ * MJPEG decoder.
+ *
+ * Decodes a JPEG frame into a raw I420, NV12 or YUY2 frame. The frame is
+ * cut into horizontal slices that are decoded on a few worker threads,
+ * the calling thread decodes a slice too.
+ *
+ * All planes of the raw frame are in one block of memory, see
+ * spa_v4l2_decoder_layout().
+ */
+struct spa_v4l2_decoder;
+
+/** Make a decoder with \a n_threads workers. With 0 workers, the frame
+ * is decoded in one slice by the caller. */
+struct spa_v4l2_decoder *spa_v4l2_decoder_new(uint32_t n_threads, struct spa_log *log);
+void spa_v4l2_decoder_free(struct spa_v4l2_decoder *dec);
+
+/** Number of workers for a decoder on this machine */
+uint32_t spa_v4l2_decoder_default_threads(void);
+
+/** Check if the decoder can make raw frames in \a format */
+static inline bool spa_v4l2_decoder_supports(uint32_t format)
+{
+	switch (format) {
+	case SPA_VIDEO_FORMAT_I420:
+	case SPA_VIDEO_FORMAT_NV12:
+	case SPA_VIDEO_FORMAT_YUY2:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Get the layout of a raw frame. The stride is the stride of the first
+ * plane, the chroma planes of I420 have half of it and follow the luma
+ * plane directly.
+ */
+static inline int spa_v4l2_decoder_layout(uint32_t format, uint32_t width, uint32_t height,
+		uint32_t *stride, uint32_t *size)
+{
+	uint32_t s, ch = (height + 1) / 2;
+
+	switch (format) {
+	case SPA_VIDEO_FORMAT_YUY2:
+		s = SPA_ROUND_UP_N(width * 2, 4);
+		*size = s * height;
+		break;
+	case SPA_VIDEO_FORMAT_I420:
+		/* keep the chroma stride at half the luma stride */
+		s = SPA_ROUND_UP_N(width, 8);
+		*size = s * height + 2 * (s / 2) * ch;
+		break;
+	case SPA_VIDEO_FORMAT_NV12:
+		s = SPA_ROUND_UP_N(width, 4);
+		*size = s * height + s * ch;
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	*stride = s;
+	return 0;
+}
+
+/**
+ * Decode \a size bytes of JPEG data in \a src into \a dst of \a maxsize
+ * bytes. The JPEG frame must have the given size.
+ *
+ * Returns 0 on success, a negative errno when the frame could not be
+ * decoded.
+ */
+int spa_v4l2_decoder_decode(struct spa_v4l2_decoder *dec,
+		const void *src, size_t size,
+		uint32_t format, uint32_t width, uint32_t height,
+		void *dst, size_t maxsize);
+
+#endif
@@ -2,10 +2,13 @@
 /* SPDX-FileCopyrightText: Copyright © 2018 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include "config.h"
+
 #include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include <linux/videodev2.h>
 
@@ -28,6 +31,7 @@
 #include <spa/control/control.h>
 
 #include "v4l2.h"
+#include "v4l2-decode.h"
 
 static const char default_device[] = "/dev/video0";
 
@@ -35,6 +39,8 @@ struct props {
 	char device[64];
 	char device_name[128];
 	int device_fd;
+	bool decode;
+	uint32_t decode_threads;
 };
 
 static void reset_props(struct props *props)
@@ -67,6 +73,25 @@ struct control {
 	int32_t value;
 };
 
+#define MAX_CAPTURE	4
+
+/* A buffer of the device when decoding, the frames are decoded into the
+ * buffers of the port */
+struct capture {
+	struct v4l2_buffer v4l2_buffer;
+	void *ptr;
+};
+
+struct decode_job {
+	struct buffer *b;
+	uint32_t index;
+	uint32_t bytesused;
+	uint32_t sequence;
+	uint32_t flags;
+	int64_t pts;
+	int res;
+};
+
 struct port {
 	struct impl *impl;
 
@@ -97,6 +122,27 @@ struct port {
 	uint32_t n_buffers;
 	struct spa_list queue;
 
+	/* MJPEG from the device is decoded into the raw format of the port */
+	bool decode;
+	uint32_t decode_format;
+	uint32_t decode_stride;
+	uint32_t decode_size;
+	struct spa_v4l2_decoder *decoder;
+	struct capture capture[MAX_CAPTURE];
+	uint32_t n_capture;
+	struct spa_list free;		/* port buffers to decode into */
+
+	pthread_t decode_thread;
+	pthread_mutex_t decode_lock;
+	pthread_cond_t decode_cond;
+	bool decode_running;
+	bool decode_quit;
+	bool job_pending;		/* protected by decode_lock */
+	bool job_busy;			/* until the job is back in the data loop */
+	struct decode_job job;
+	bool have_next;
+	struct decode_job next;		/* newest frame that waits for the decoder */
+
 	struct spa_source source;
 
 	uint64_t info_all;
@@ -568,8 +614,10 @@ static int impl_node_port_enum_params(void *object, int seq,
 			SPA_TYPE_OBJECT_ParamBuffers, id,
 			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(4, 1, MAX_BUFFERS),
 			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
-			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->fmt.fmt.pix.sizeimage),
-			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->fmt.fmt.pix.bytesperline));
+			SPA_PARAM_BUFFERS_size,    SPA_POD_Int(port->decode ?
+				port->decode_size : port->fmt.fmt.pix.sizeimage),
+			SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(port->decode ?
+				port->decode_stride : port->fmt.fmt.pix.bytesperline));
 		break;
 
 	case SPA_PARAM_Meta:
@@ -777,7 +825,9 @@ static int impl_node_port_use_buffers(void *object,
 	if (buffers == NULL)
 		return 0;
 
-	if (flags & SPA_NODE_BUFFERS_FLAG_ALLOC) {
+	if (port->decode) {
+		res = decode_use_buffers(this, buffers, n_buffers);
+	} else if (flags & SPA_NODE_BUFFERS_FLAG_ALLOC) {
 		res = spa_v4l2_alloc_buffers(this, buffers, n_buffers);
 	} else {
 		res = spa_v4l2_use_buffers(this, buffers, n_buffers);
@@ -937,6 +987,15 @@ static int impl_get_interface(struct spa_handle *handle, const char *type, void
 
 static int impl_clear(struct spa_handle *handle)
 {
+	struct impl *this = (struct impl *) handle;
+	struct port *port = GET_OUT_PORT(this, 0);
+
+#ifdef HAVE_LIBJPEG
+	if (port->decoder)
+		spa_v4l2_decoder_free(port->decoder);
+#endif
+	pthread_cond_destroy(&port->decode_cond);
+	pthread_mutex_destroy(&port->decode_lock);
 	return 0;
 }
 
@@ -1002,6 +1061,9 @@ impl_init(const struct spa_handle_factory *factory,
 	port = GET_OUT_PORT(this, 0);
 	port->impl = this;
 	spa_list_init(&port->queue);
+	spa_list_init(&port->free);
+	pthread_mutex_init(&port->decode_lock, NULL);
+	pthread_cond_init(&port->decode_cond, NULL);
 	port->info_all = SPA_PORT_CHANGE_MASK_FLAGS |
 			SPA_PORT_CHANGE_MASK_PARAMS;
 	port->info = SPA_PORT_INFO_INIT();
@@ -1024,6 +1086,14 @@ impl_init(const struct spa_handle_factory *factory,
 	port->dev.log = this->log;
 	port->dev.fd = -1;
 
+	this->props.decode_threads = SPA_ID_INVALID;
+#ifdef HAVE_LIBJPEG
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_V4L2_DECODE)))
+		this->props.decode = spa_atob(str);
+	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_V4L2_DECODE_THREADS)))
+		spa_atou32(str, &this->props.decode_threads, 0);
+#endif
+
 	if (info && (str = spa_dict_lookup(info, SPA_KEY_API_V4L2_PATH))) {
 		strncpy(this->props.device, str, 63);
 		if ((res = spa_v4l2_open(&port->dev, this->props.device)) < 0)
@@ -113,6 +113,12 @@ static int spa_v4l2_buffer_recycle(struct impl *this, uint32_t buffer_id)
 	SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_OUTSTANDING);
 	spa_log_trace(this->log, "v4l2 %p: recycle buffer %d", this, buffer_id);
 
+	if (port->decode) {
+		/* not a device buffer, it can be decoded into again */
+		spa_list_append(&port->free, &b->link);
+		return 0;
+	}
+
 	if (xioctl(dev->fd, VIDIOC_QBUF, &b->v4l2_buffer) < 0) {
 		err = errno;
 		spa_log_error(this->log, "'%s' VIDIOC_QBUF: %m", this->props.device);
@@ -138,6 +144,11 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 		b = &port->buffers[i];
 		d = b->outbuf->datas;
 
+		if (port->decode) {
+			if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_MAPPED))
+				munmap(b->ptr, d[0].maxsize);
+			continue;
+		}
 		if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUTSTANDING)) {
 			spa_log_debug(this->log, "queueing outstanding buffer %p", b);
 			spa_v4l2_buffer_recycle(this, i);
@@ -151,6 +162,10 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 		}
 		d[0].type = SPA_ID_INVALID;
 	}
+	for (i = 0; i < port->n_capture; i++)
+		munmap(port->capture[i].ptr, port->capture[i].v4l2_buffer.length);
+	port->n_capture = 0;
+	spa_list_init(&port->free);
 
 	spa_zero(reqbuf);
 	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -505,11 +520,12 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	struct spa_pod_choice *choice;
 	uint32_t filter_media_type, filter_media_subtype, video_format;
 	struct spa_v4l2_device *dev = &port->dev;
-	uint8_t buffer[1024];
-	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024], fbuffer[1024];
+	struct spa_pod_builder b = { 0 }, fb = { 0 };
 	struct spa_pod_frame f[2];
 	struct spa_result_node_params result;
 	uint32_t count = 0;
+	bool decoded;
 
 	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
 		return res;
@@ -542,7 +558,8 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	result.index = result.next++;
 
 	while (port->next_fmtdesc) {
-		if (filter) {
+		/* when decoding, the filter formats are not the device formats */
+		if (filter && !this->props.decode) {
 			struct v4l2_format fmt;
 
 			video_format = enum_filter_format(filter_media_type,
@@ -692,14 +709,25 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 		}
 	}
 
+	decoded = this->props.decode && info->media_subtype == SPA_MEDIA_SUBTYPE_mjpg;
+
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 	spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
 	spa_pod_builder_add(&b,
 			SPA_FORMAT_mediaType,    SPA_POD_Id(info->media_type),
-			SPA_FORMAT_mediaSubtype, SPA_POD_Id(info->media_subtype),
+			SPA_FORMAT_mediaSubtype, SPA_POD_Id(decoded ?
+				SPA_MEDIA_SUBTYPE_raw : info->media_subtype),
 			0);
 
-	if (info->media_subtype == SPA_MEDIA_SUBTYPE_raw) {
+	if (decoded) {
+		spa_pod_builder_add(&b,
+			SPA_FORMAT_VIDEO_format, SPA_POD_CHOICE_ENUM_Id(4,
+					SPA_VIDEO_FORMAT_I420,
+					SPA_VIDEO_FORMAT_I420,
+					SPA_VIDEO_FORMAT_NV12,
+					SPA_VIDEO_FORMAT_YUY2),
+			0);
+	} else if (info->media_subtype == SPA_MEDIA_SUBTYPE_raw) {
 		spa_pod_builder_prop(&b, SPA_FORMAT_VIDEO_format, 0);
 		spa_pod_builder_id(&b, info->format);
 	}
@@ -847,6 +875,12 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	spa_pod_builder_pop(&b, &f[1]);
 	result.param = spa_pod_builder_pop(&b, &f[0]);
 
+	if (this->props.decode && filter) {
+		spa_pod_builder_init(&fb, fbuffer, sizeof(fbuffer));
+		if (spa_pod_filter(&fb, &result.param, result.param, filter) < 0)
+			goto next;
+	}
+
 	spa_node_emit_result(&this->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
 
 	if (++count != num)
@@ -859,6 +893,46 @@ spa_v4l2_enum_format(struct impl *this, int seq,
 	return res;
 }
 
+static bool has_frame_interval(struct spa_v4l2_device *dev, uint32_t fourcc,
+		const struct spa_rectangle *size, const struct spa_fraction *framerate)
+{
+	static const struct spa_fraction step = {1, 1};
+	struct v4l2_frmivalenum frmival;
+
+	spa_zero(frmival);
+	frmival.pixel_format = fourcc;
+	frmival.width = size->width;
+	frmival.height = size->height;
+
+	while (xioctl(dev->fd, VIDIOC_ENUM_FRAMEINTERVALS, &frmival) == 0) {
+		if (filter_framerate(&frmival, framerate, framerate, &step))
+			return true;
+		frmival.index++;
+	}
+	return false;
+}
+
+/* Find the MJPEG format to decode a raw format from, when the device can't
+ * make the raw format at the size and framerate itself */
+static uint32_t find_decode_fourcc(struct impl *this, uint32_t fourcc,
+		const struct spa_video_info_raw *raw)
+{
+	struct spa_v4l2_device *dev = &this->out_ports[0].dev;
+	static const uint32_t decode_fourccs[] = { V4L2_PIX_FMT_MJPEG, V4L2_PIX_FMT_JPEG };
+	uint32_t i;
+
+	if (!this->props.decode || !spa_v4l2_decoder_supports(raw->format))
+		return 0;
+	if (has_frame_interval(dev, fourcc, &raw->size, &raw->framerate))
+		return 0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(decode_fourccs); i++) {
+		if (has_frame_interval(dev, decode_fourccs[i], &raw->size, &raw->framerate))
+			return decode_fourccs[i];
+	}
+	return 0;
+}
+
 static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format, uint32_t flags)
 {
 	struct port *port = &this->out_ports[0];
@@ -870,6 +944,7 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	uint32_t video_format;
 	struct spa_rectangle *size = NULL;
 	struct spa_fraction *framerate = NULL;
+	uint32_t decode_fourcc = 0;
 	bool match;
 
 	spa_zero(fmt);
@@ -925,6 +1000,14 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if ((res = spa_v4l2_open(dev, this->props.device)) < 0)
 		return res;
 
+	if (format->media_subtype == SPA_MEDIA_SUBTYPE_raw &&
+	    (decode_fourcc = find_decode_fourcc(this, info->fourcc, &format->info.raw)) != 0) {
+		spa_log_debug(this->log, "decode %.4s from %.4s", (char *)&fmt.fmt.pix.pixelformat,
+				(char *)&decode_fourcc);
+		fmt.fmt.pix.pixelformat = decode_fourcc;
+		reqfmt = fmt;
+	}
+
 	cmd = (flags & SPA_NODE_PARAM_FLAG_TEST_ONLY) ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(dev->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -966,8 +1049,16 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	port->rate.num = framerate->denom = streamparm.parm.capture.timeperframe.numerator;
 
 	port->fmt = fmt;
+	port->decode = decode_fourcc != 0;
+	if (port->decode) {
+		port->decode_format = video_format;
+		spa_v4l2_decoder_layout(video_format, fmt.fmt.pix.width, fmt.fmt.pix.height,
+				&port->decode_stride, &port->decode_size);
+	}
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_FLAGS | SPA_PORT_CHANGE_MASK_RATE;
-	port->info.flags = (port->alloc_buffers ? SPA_PORT_FLAG_CAN_ALLOC_BUFFERS : 0) |
+	/* decoded frames go into buffers that we can write to */
+	port->info.flags = (port->alloc_buffers && !port->decode ?
+			SPA_PORT_FLAG_CAN_ALLOC_BUFFERS : 0) |
 		SPA_PORT_FLAG_LIVE |
 		SPA_PORT_FLAG_PHYSICAL |
 		SPA_PORT_FLAG_TERMINAL;
@@ -1302,6 +1393,26 @@ done:
 	return res;
 }
 
+static void update_clock(struct impl *this, int64_t pts, uint32_t sequence)
+{
+	struct port *port = &this->out_ports[0];
+
+	if (this->clock) {
+		/* FIXME, we should follow the driver clock and target_ values.
+		 * for now we ignore and use our own. */
+		this->clock->target_rate = port->rate;
+		this->clock->target_duration = 1;
+
+		this->clock->nsec = pts;
+		this->clock->rate = port->rate;
+		this->clock->position = sequence;
+		this->clock->duration = 1;
+		this->clock->delay = 0;
+		this->clock->rate_diff = 1.0;
+		this->clock->next_nsec = pts + 1000000000LL / port->rate.denom;
+	}
+}
+
 static int mmap_read(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
@@ -1321,20 +1432,7 @@ static int mmap_read(struct impl *this)
 	pts = SPA_TIMEVAL_TO_NSEC(&buf.timestamp);
 	spa_log_trace(this->log, "v4l2 %p: have output %d", this, buf.index);
 
-	if (this->clock) {
-		/* FIXME, we should follow the driver clock and target_ values.
-		 * for now we ignore and use our own. */
-		this->clock->target_rate = port->rate;
-		this->clock->target_duration = 1;
-
-		this->clock->nsec = pts;
-		this->clock->rate = port->rate;
-		this->clock->position = buf.sequence;
-		this->clock->duration = 1;
-		this->clock->delay = 0;
-		this->clock->rate_diff = 1.0;
-		this->clock->next_nsec = pts + 1000000000LL / port->rate.denom;
-	}
+	update_clock(this, pts, buf.sequence);
 
 	b = &port->buffers[buf.index];
 	if (b->h) {
@@ -1359,29 +1457,13 @@ static int mmap_read(struct impl *this)
 	return 0;
 }
 
-static void v4l2_on_fd_events(struct spa_source *source)
+/* Hand the oldest queued buffer to the graph */
+static void output_queued(struct impl *this)
 {
-	struct impl *this = source->data;
 	struct spa_io_buffers *io;
 	struct port *port = &this->out_ports[0];
 	struct buffer *b;
 
-	if (source->rmask & SPA_IO_ERR) {
-		struct port *port = &this->out_ports[0];
-		spa_log_error(this->log, "'%p' error %08x", this->props.device, source->rmask);
-		if (port->source.loop)
-			spa_loop_remove_source(this->data_loop, &port->source);
-		return;
-	}
-
-	if (!(source->rmask & SPA_IO_IN)) {
-		spa_log_warn(this->log, "v4l2 %p: spurious wakeup %d", this, source->rmask);
-		return;
-	}
-
-	if (mmap_read(this) < 0)
-		return;
-
 	if (spa_list_is_empty(&port->queue))
 		return;
 
@@ -1407,6 +1489,340 @@ static void v4l2_on_fd_events(struct spa_source *source)
 	spa_node_call_ready(&this->callbacks, SPA_STATUS_HAVE_DATA);
 }
 
+#ifdef HAVE_LIBJPEG
+static void capture_recycle(struct impl *this, uint32_t index)
+{
+	struct port *port = &this->out_ports[0];
+
+	if (xioctl(port->dev.fd, VIDIOC_QBUF, &port->capture[index].v4l2_buffer) < 0)
+		spa_log_warn(this->log, "'%s' VIDIOC_QBUF: %m", this->props.device);
+}
+
+static void decode_submit(struct impl *this, const struct decode_job *job)
+{
+	struct port *port = &this->out_ports[0];
+	struct decode_job j = *job;
+
+	if (port->job_busy) {
+		/* when the decoder is behind, only the newest frame waits */
+		if (port->have_next)
+			capture_recycle(this, port->next.index);
+		port->next = j;
+		port->have_next = true;
+		return;
+	}
+	if (spa_list_is_empty(&port->free)) {
+		spa_log_trace(this->log, "v4l2 %p: no buffer to decode %u into",
+				this, j.sequence);
+		capture_recycle(this, j.index);
+		return;
+	}
+	j.b = spa_list_first(&port->free, struct buffer, link);
+	spa_list_remove(&j.b->link);
+
+	port->job_busy = true;
+
+	pthread_mutex_lock(&port->decode_lock);
+	port->job = j;
+	port->job_pending = true;
+	pthread_cond_signal(&port->decode_cond);
+	pthread_mutex_unlock(&port->decode_lock);
+}
+
+static int do_decoded(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+	struct port *port = &this->out_ports[0];
+	const struct decode_job *job = data;
+	struct buffer *b = job->b;
+	struct spa_data *d;
+
+	capture_recycle(this, job->index);
+	port->job_busy = false;
+
+	if (job->res < 0) {
+		spa_log_debug(this->log, "v4l2 %p: can't decode frame %u: %s",
+				this, job->sequence, spa_strerror(job->res));
+		spa_list_append(&port->free, &b->link);
+	} else {
+		if (b->h) {
+			b->h->flags = 0;
+			if (job->flags & V4L2_BUF_FLAG_ERROR)
+				b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+			b->h->offset = 0;
+			b->h->seq = job->sequence;
+			b->h->pts = job->pts;
+			b->h->dts_offset = 0;
+		}
+		d = b->outbuf->datas;
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = port->decode_size;
+		d[0].chunk->stride = port->decode_stride;
+		d[0].chunk->flags = 0;
+		if (job->flags & V4L2_BUF_FLAG_ERROR)
+			d[0].chunk->flags |= SPA_CHUNK_FLAG_CORRUPTED;
+
+		spa_list_append(&port->queue, &b->link);
+
+		update_clock(this, job->pts, job->sequence);
+		output_queued(this);
+	}
+
+	if (port->have_next) {
+		port->have_next = false;
+		decode_submit(this, &port->next);
+	}
+	return 0;
+}
+
+static void *decode_thread(void *data)
+{
+	struct impl *this = data;
+	struct port *port = &this->out_ports[0];
+	struct decode_job job;
+
+	pthread_mutex_lock(&port->decode_lock);
+	while (true) {
+		while (!port->decode_quit && !port->job_pending)
+			pthread_cond_wait(&port->decode_cond, &port->decode_lock);
+		if (port->decode_quit)
+			break;
+
+		job = port->job;
+		port->job_pending = false;
+		pthread_mutex_unlock(&port->decode_lock);
+
+		job.res = spa_v4l2_decoder_decode(port->decoder,
+				port->capture[job.index].ptr, job.bytesused,
+				port->decode_format,
+				port->fmt.fmt.pix.width, port->fmt.fmt.pix.height,
+				job.b->ptr, job.b->outbuf->datas[0].maxsize);
+
+		spa_loop_invoke(this->data_loop, do_decoded, 0, &job, sizeof(job), false, this);
+
+		pthread_mutex_lock(&port->decode_lock);
+	}
+	pthread_mutex_unlock(&port->decode_lock);
+	return NULL;
+}
+
+static int decode_read(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	struct v4l2_buffer buf;
+	struct decode_job job;
+
+	spa_zero(buf);
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+
+	if (xioctl(port->dev.fd, VIDIOC_DQBUF, &buf) < 0)
+		return -errno;
+
+	spa_log_trace(this->log, "v4l2 %p: have frame %d", this, buf.index);
+
+	spa_zero(job);
+	job.index = buf.index;
+	job.bytesused = buf.bytesused;
+	job.sequence = buf.sequence;
+	job.flags = buf.flags;
+	job.pts = SPA_TIMEVAL_TO_NSEC(&buf.timestamp);
+
+	decode_submit(this, &job);
+	return 0;
+}
+
+static int capture_init(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	struct spa_v4l2_device *dev = &port->dev;
+	struct v4l2_requestbuffers reqbuf;
+	uint32_t i;
+
+	port->memtype = V4L2_MEMORY_MMAP;
+
+	spa_zero(reqbuf);
+	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.memory = port->memtype;
+	reqbuf.count = MAX_CAPTURE;
+
+	if (xioctl(dev->fd, VIDIOC_REQBUFS, &reqbuf) < 0) {
+		spa_log_error(this->log, "'%s' VIDIOC_REQBUFS: %m", this->props.device);
+		return -errno;
+	}
+	if (reqbuf.count == 0) {
+		spa_log_error(this->log, "'%s' can't allocate buffers", this->props.device);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < SPA_MIN(reqbuf.count, (uint32_t)MAX_CAPTURE); i++) {
+		struct capture *c = &port->capture[i];
+
+		spa_zero(c->v4l2_buffer);
+		c->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		c->v4l2_buffer.memory = port->memtype;
+		c->v4l2_buffer.index = i;
+
+		if (xioctl(dev->fd, VIDIOC_QUERYBUF, &c->v4l2_buffer) < 0) {
+			spa_log_error(this->log, "'%s' VIDIOC_QUERYBUF: %m", this->props.device);
+			return -errno;
+		}
+		c->ptr = mmap(NULL, c->v4l2_buffer.length, PROT_READ, MAP_SHARED,
+				dev->fd, c->v4l2_buffer.m.offset);
+		if (c->ptr == MAP_FAILED) {
+			spa_log_error(this->log, "'%s' mmap: %m", this->props.device);
+			return -errno;
+		}
+		port->n_capture++;
+
+		capture_recycle(this, i);
+	}
+	spa_log_info(this->log, "%s: decoding %.4s from %u buffers into %u buffers",
+			dev->path, (char *)&port->fmt.fmt.pix.pixelformat,
+			port->n_capture, port->n_buffers);
+	return 0;
+}
+
+static int decode_use_buffers(struct impl *this, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct port *port = &this->out_ports[0];
+	uint32_t i;
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d;
+
+		b->id = i;
+		b->outbuf = buffers[i];
+		b->flags = 0;
+		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+
+		if (buffers[i]->n_datas < 1) {
+			spa_log_error(this->log, "invalid memory on buffer %p", buffers[i]);
+			return -EINVAL;
+		}
+		d = buffers[i]->datas;
+
+		if (d[0].maxsize < port->decode_size) {
+			spa_log_error(this->log, "buffer %p too small %u < %u",
+					buffers[i], d[0].maxsize, port->decode_size);
+			return -ENOSPC;
+		}
+		if (d[0].data != NULL) {
+			b->ptr = d[0].data;
+		} else if (d[0].type == SPA_DATA_MemFd) {
+			b->ptr = mmap(NULL, d[0].maxsize, PROT_READ | PROT_WRITE, MAP_SHARED,
+					d[0].fd, d[0].mapoffset);
+			if (b->ptr == MAP_FAILED)
+				return -errno;
+			SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+		} else {
+			spa_log_error(this->log, "can't decode into buffers of type %d", d[0].type);
+			return -EINVAL;
+		}
+		spa_list_append(&port->free, &b->link);
+		port->n_buffers++;
+	}
+	return capture_init(this);
+}
+
+static int decode_start(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+	uint32_t n_threads = this->props.decode_threads;
+	int res;
+
+	if (port->decoder == NULL) {
+		if (n_threads == SPA_ID_INVALID)
+			n_threads = spa_v4l2_decoder_default_threads();
+		if ((port->decoder = spa_v4l2_decoder_new(n_threads, this->log)) == NULL)
+			return -errno;
+	}
+
+	port->decode_quit = false;
+	port->job_pending = false;
+	port->job_busy = false;
+	port->have_next = false;
+
+	if ((res = -pthread_create(&port->decode_thread, NULL, decode_thread, this)) < 0) {
+		spa_log_error(this->log, "can't start decoder thread: %s", spa_strerror(res));
+		return res;
+	}
+	port->decode_running = true;
+	return 0;
+}
+
+static void decode_stop(struct impl *this)
+{
+	struct port *port = &this->out_ports[0];
+
+	if (!port->decode_running)
+		return;
+
+	pthread_mutex_lock(&port->decode_lock);
+	port->decode_quit = true;
+	pthread_cond_signal(&port->decode_cond);
+	pthread_mutex_unlock(&port->decode_lock);
+
+	pthread_join(port->decode_thread, NULL);
+	port->decode_running = false;
+}
+#else
+static inline int decode_read(struct impl *this)
+{
+	return -ENOTSUP;
+}
+static inline void capture_recycle(struct impl *this, uint32_t index)
+{
+}
+static inline int decode_use_buffers(struct impl *this, struct spa_buffer **buffers,
+		uint32_t n_buffers)
+{
+	return -ENOTSUP;
+}
+static inline int decode_start(struct impl *this)
+{
+	return -ENOTSUP;
+}
+static inline void decode_stop(struct impl *this)
+{
+}
+#endif
+
+static void v4l2_on_fd_events(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	struct port *port = &this->out_ports[0];
+
+	if (source->rmask & SPA_IO_ERR) {
+		spa_log_error(this->log, "'%p' error %08x", this->props.device, source->rmask);
+		if (port->source.loop)
+			spa_loop_remove_source(this->data_loop, &port->source);
+		return;
+	}
+
+	if (!(source->rmask & SPA_IO_IN)) {
+		spa_log_warn(this->log, "v4l2 %p: spurious wakeup %d", this, source->rmask);
+		return;
+	}
+
+	/* decoded frames are output when the decoder is done with them */
+	if (port->decode) {
+		decode_read(this);
+		return;
+	}
+
+	if (mmap_read(this) < 0)
+		return;
+
+	output_queued(this);
+}
+
 static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers, uint32_t n_buffers)
 {
 	struct port *port = &this->out_ports[0];
@@ -1681,6 +2097,7 @@ static int spa_v4l2_stream_on(struct impl *this)
 	struct port *port = &this->out_ports[0];
 	struct spa_v4l2_device *dev = &port->dev;
 	enum v4l2_buf_type type;
+	int res;
 
 	if (dev->fd == -1)
 		return -EIO;
@@ -1693,10 +2110,15 @@ static int spa_v4l2_stream_on(struct impl *this)
 
 	spa_log_debug(this->log, "starting");
 
+	if (port->decode && (res = decode_start(this)) < 0)
+		return res;
+
 	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	if (xioctl(dev->fd, VIDIOC_STREAMON, &type) < 0) {
+		res = -errno;
 		spa_log_error(this->log, "'%s' VIDIOC_STREAMON: %m", this->props.device);
-		return -errno;
+		decode_stop(this);
+		return res;
 	}
 
 	port->source.func = v4l2_on_fd_events;
@@ -1739,6 +2161,10 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_log_debug(this->log, "stopping");
 
+	/* the last decoded frame is handed to the data loop before the
+	 * source is removed there */
+	decode_stop(this);
+
 	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, port);
 
 	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
@@ -1746,13 +2172,25 @@ static int spa_v4l2_stream_off(struct impl *this)
 		spa_log_error(this->log, "'%s' VIDIOC_STREAMOFF: %m", this->props.device);
 		return -errno;
 	}
-	for (i = 0; i < port->n_buffers; i++) {
-		struct buffer *b;
+	if (port->decode) {
+		for (i = 0; i < port->n_capture; i++)
+			capture_recycle(this, i);
+
+		spa_list_init(&port->free);
+		for (i = 0; i < port->n_buffers; i++) {
+			struct buffer *b = &port->buffers[i];
+			if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUTSTANDING))
+				spa_list_append(&port->free, &b->link);
+		}
+	} else {
+		for (i = 0; i < port->n_buffers; i++) {
+			struct buffer *b;
 
-		b = &port->buffers[i];
-		if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUTSTANDING)) {
-			if (xioctl(dev->fd, VIDIOC_QBUF, &b->v4l2_buffer) < 0)
-				spa_log_warn(this->log, "VIDIOC_QBUF: %s", strerror(errno));
+			b = &port->buffers[i];
+			if (!SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_OUTSTANDING)) {
+				if (xioctl(dev->fd, VIDIOC_QBUF, &b->v4l2_buffer) < 0)
+					spa_log_warn(this->log, "VIDIOC_QBUF: %s", strerror(errno));
+			}
 		}
 	}
 	spa_list_init(&port->queue);
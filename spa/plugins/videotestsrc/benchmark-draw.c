@@ -0,0 +1,79 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "draw.c"
+
+/*
+ * Draws 1920x1080 frames of each pattern and format into a ring of
+ * N_BUFFERS buffers, like videotestsrc does, and with a new buffer for
+ * each frame, which always needs a copy of the cached pattern.
+ */
+
+#define WIDTH		1920
+#define HEIGHT		1080
+#define N_BUFFERS	4
+#define MAX_COUNT	200
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void run(const char *name, uint32_t pattern, uint32_t format, int bpp, bool reuse)
+{
+	struct draw d = { 0 };
+	uint8_t *buffers[N_BUFFERS];
+	uint32_t gen[N_BUFFERS] = { 0 };
+	int i, stride = SPA_ROUND_UP_N(bpp * WIDTH, 4);
+	uint64_t t, count;
+
+	spa_assert_se(draw_init(&d, format, WIDTH, HEIGHT, stride) == 0);
+	for (i = 0; i < N_BUFFERS; i++)
+		spa_assert_se((buffers[i] = malloc(stride * HEIGHT)) != NULL);
+
+	t = get_time_ns();
+	for (count = 0; count < MAX_COUNT; count++) {
+		i = count % N_BUFFERS;
+		if (!reuse)
+			gen[i] = 0;
+		spa_assert_se(draw(&d, pattern, buffers[i], &gen[i]) == 0);
+	}
+	t = get_time_ns() - t;
+
+	fprintf(stderr, "%-12s %-5s %-8s %8.1f frames/s %8.1f Mpixels/s\n",
+			name, format == SPA_VIDEO_FORMAT_RGB ? "RGB" : "UYVY",
+			reuse ? "reuse" : "copy",
+			count * 1e9 / t, count * WIDTH * HEIGHT * 1e3 / t);
+
+	for (i = 0; i < N_BUFFERS; i++)
+		free(buffers[i]);
+	draw_clear(&d);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct {
+		const char *name;
+		uint32_t pattern;
+	} patterns[] = {
+		{ "smpte", PATTERN_SMPTE },
+		{ "smpte-snow", PATTERN_SMPTE_SNOW },
+		{ "snow", PATTERN_SNOW },
+	};
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(patterns); i++) {
+		run(patterns[i].name, patterns[i].pattern, SPA_VIDEO_FORMAT_RGB, 3, true);
+		run(patterns[i].name, patterns[i].pattern, SPA_VIDEO_FORMAT_RGB, 3, false);
+		run(patterns[i].name, patterns[i].pattern, SPA_VIDEO_FORMAT_UYVY, 2, true);
+		run(patterns[i].name, patterns[i].pattern, SPA_VIDEO_FORMAT_UYVY, 2, false);
+	}
+	return 0;
+}
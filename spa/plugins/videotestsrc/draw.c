@@ -3,6 +3,17 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/param/video/raw.h>
+
+enum pattern {
+	PATTERN_SMPTE_SNOW,
+	PATTERN_SNOW,
+	PATTERN_SMPTE,
+};
 
 typedef enum {
 	GRAY = 0,
@@ -50,6 +61,33 @@ static Pixel colors[N_COLORS] = {
 
 /* YUV values are computed in init_colors() */
 
+/* luma of the gray R = G = B = i, the chroma of gray is 128 */
+static uint8_t gray_y[256];
+
+#define SNOW_LANES	8
+
+/*
+ * The static part of the pattern is drawn once in the cache and copied
+ * into the buffers that don't have it yet. Only the snow is drawn for
+ * each frame.
+ */
+struct draw {
+	uint32_t format;
+	int width;
+	int height;
+	int stride;
+
+	uint32_t pattern;
+	uint8_t *cache;
+	uint32_t cache_gen;	/* changes when the cache is redrawn */
+
+	/* the snow is in the lines from snow_y and from pixel snow_x */
+	int snow_y;
+	int snow_x;
+	uint8_t *noise;
+	uint32_t seed[SNOW_LANES];
+};
+
 typedef struct _DrawingData DrawingData;
 
 typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
@@ -93,6 +131,11 @@ static void init_colors(void)
 	for (i = 0; i < N_COLORS; i++) {
 		update_yuv(&colors[i]);
 	}
+	for (i = 0; i < 256; i++) {
+		Pixel p = { i, i, i, 0, 0, 0 };
+		update_yuv(&p);
+		gray_y[i] = p.Y;
+	}
 }
 
 static void draw_pixel_rgb(DrawingData * dd, int x, Pixel * color)
@@ -115,27 +158,19 @@ static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
 	}
 }
 
-static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
+static int drawing_data_init(DrawingData * dd, struct draw *d, uint8_t *data)
 {
-	struct port *port = &this->port;
-	struct spa_video_info *format = &port->current_format;
-	struct spa_rectangle *size = &format->info.raw.size;
-
-	if ((format->media_type != SPA_MEDIA_TYPE_video) ||
-	    (format->media_subtype != SPA_MEDIA_SUBTYPE_raw))
-		return -ENOTSUP;
-
-	if (format->info.raw.format == SPA_VIDEO_FORMAT_RGB) {
+	if (d->format == SPA_VIDEO_FORMAT_RGB) {
 		dd->draw_pixel = draw_pixel_rgb;
-	} else if (format->info.raw.format == SPA_VIDEO_FORMAT_UYVY) {
+	} else if (d->format == SPA_VIDEO_FORMAT_UYVY) {
 		dd->draw_pixel = draw_pixel_uyvy;
 	} else
 		return -ENOTSUP;
 
-	dd->line = data;
-	dd->width = size->width;
-	dd->height = size->height;
-	dd->stride = port->stride;
+	dd->line = (char *) data;
+	dd->width = d->width;
+	dd->height = d->height;
+	dd->stride = d->stride;
 
 	return 0;
 }
@@ -154,27 +189,40 @@ static inline void next_line(DrawingData * dd)
 	dd->line += dd->stride;
 }
 
-static void draw_smpte_snow(DrawingData * dd)
+/* copy the line before \a dd->line to the \a n_lines lines from \a dd->line */
+static inline void repeat_line(DrawingData * dd, int n_lines)
+{
+	int i;
+
+	for (i = 0; i < n_lines; i++) {
+		memcpy(dd->line, dd->line - dd->stride, dd->stride);
+		next_line(dd);
+	}
+}
+
+/* draws the SMPTE bars up to the snow */
+static void draw_smpte(DrawingData * dd, struct draw *d)
 {
 	int h, w;
 	int y1, y2;
-	int i, j;
+	int j, x = 0;
 
 	w = dd->width;
 	h = dd->height;
 	y1 = 2 * h / 3;
 	y2 = 3 * h / 4;
 
-	for (i = 0; i < y1; i++) {
+	if (y1 > 0) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
 			draw_pixels(dd, x1, j, x2 - x1);
 		}
 		next_line(dd);
+		repeat_line(dd, y1 - 1);
 	}
 
-	for (i = y1; i < y2; i++) {
+	if (y2 > y1) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
@@ -183,11 +231,10 @@ static void draw_smpte_snow(DrawingData * dd)
 			draw_pixels(dd, x1, c, x2 - x1);
 		}
 		next_line(dd);
+		repeat_line(dd, y2 - y1 - 1);
 	}
 
-	for (i = y2; i < h; i++) {
-		int x = 0;
-
+	if (h > y2) {
 		/* negative I */
 		draw_pixels(dd, x, NEG_I, w / 6);
 		x += w / 6;
@@ -208,61 +255,170 @@ static void draw_smpte_snow(DrawingData * dd)
 		draw_pixels(dd, x, LIGHT_BLACK, w / 12);
 		x += w / 12;
 
-		/* war of the ants (a.k.a. snow) */
-		for (j = x; j < w; j++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, j, &p);
+		if (d->pattern == PATTERN_SMPTE) {
+			/* black instead of the snow */
+			draw_pixels(dd, x, BLACK, w - x);
 		}
-
 		next_line(dd);
+		repeat_line(dd, h - y2 - 1);
 	}
+	d->snow_y = y2;
+	d->snow_x = x;
 }
 
-static void draw_snow(DrawingData * dd)
+/* xorshift32 in SNOW_LANES lanes, which the compiler vectorizes */
+static void fill_noise(struct draw *d, int n_bytes)
 {
-	int x, y;
-
-	for (y = 0; y < dd->height; y++) {
-		for (x = 0; x < dd->width; x++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, x, &p);
+	uint32_t x[SNOW_LANES];
+	int i, k;
+
+	memcpy(x, d->seed, sizeof(x));
+	for (i = 0; i < n_bytes; i += sizeof(x)) {
+		for (k = 0; k < SNOW_LANES; k++) {
+			x[k] ^= x[k] << 13;
+			x[k] ^= x[k] >> 17;
+			x[k] ^= x[k] << 5;
 		}
+		memcpy(&d->noise[i], x, sizeof(x));
+	}
+	memcpy(d->seed, x, sizeof(x));
+}
 
-		next_line(dd);
+/* war of the ants (a.k.a. snow), in gray */
+static void draw_snow(struct draw *d, uint8_t *data, int y, int x)
+{
+	int i, j, n = d->width - x;
+	uint8_t *line, *r = d->noise;
+
+	if (n <= 0)
+		return;
+
+	for (i = y; i < d->height; i++) {
+		line = data + i * d->stride;
+
+		fill_noise(d, n);
+
+		if (d->format == SPA_VIDEO_FORMAT_RGB) {
+			line += 3 * x;
+			for (j = 0; j < n; j++) {
+				line[3 * j + 0] = r[j];
+				line[3 * j + 1] = r[j];
+				line[3 * j + 2] = r[j];
+			}
+		} else {
+			j = 0;
+			if (x & 1) {
+				line[2 * (x - 1) + 3] = gray_y[r[j++]];
+			}
+			for (; j + 1 < n; j += 2) {
+				uint8_t *p = &line[2 * (x + j)];
+				p[0] = 128;
+				p[1] = gray_y[r[j]];
+				p[2] = 128;
+				p[3] = gray_y[r[j + 1]];
+			}
+			if (j < n) {
+				uint8_t *p = &line[2 * (x + j)];
+				p[0] = 128;
+				p[1] = gray_y[r[j]];
+				p[2] = 128;
+			}
+		}
 	}
 }
 
-static int draw(struct impl *this, char *data)
+static void draw_clear(struct draw *d)
 {
-	DrawingData dd;
-	int res;
+	free(d->cache);
+	free(d->noise);
+	d->cache = NULL;
+	d->noise = NULL;
+}
+
+static int draw_init(struct draw *d, uint32_t format, int width, int height, int stride)
+{
+	int k;
+
+	if (format != SPA_VIDEO_FORMAT_RGB &&
+	    format != SPA_VIDEO_FORMAT_UYVY)
+		return -ENOTSUP;
 
 	init_colors();
 
-	if ((res = drawing_data_init(&dd, this, data)) < 0)
-		return res;
+	draw_clear(d);
+	d->format = format;
+	d->width = width;
+	d->height = height;
+	d->stride = stride;
+	d->cache = calloc(height, stride);
+	d->noise = calloc(1, SPA_ROUND_UP_N(width, SNOW_LANES * 4));
+	if (d->cache == NULL || d->noise == NULL) {
+		draw_clear(d);
+		return -errno;
+	}
+	d->pattern = SPA_ID_INVALID;
+	for (k = 0; k < SNOW_LANES; k++)
+		d->seed[k] = 0x9e3779b9u * (k + 1);
+	return 0;
+}
+
+static int update_cache(struct draw *d, uint32_t pattern)
+{
+	DrawingData dd;
+	int res;
 
-	switch (this->props.pattern) {
+	d->pattern = pattern;
+	d->cache_gen++;
+
+	switch (pattern) {
 	case PATTERN_SMPTE_SNOW:
-		draw_smpte_snow(&dd);
+	case PATTERN_SMPTE:
+		if ((res = drawing_data_init(&dd, d, d->cache)) < 0)
+			return res;
+		draw_smpte(&dd, d);
+		if (pattern == PATTERN_SMPTE)
+			d->snow_y = d->height;
 		break;
 	case PATTERN_SNOW:
-		draw_snow(&dd);
+		d->snow_y = 0;
+		d->snow_x = 0;
 		break;
 	default:
+		d->pattern = SPA_ID_INVALID;
 		return -ENOTSUP;
 	}
 	return 0;
 }
+
+/* draws a frame in \a data. \a gen is the cache generation that \a data
+ * has and is updated */
+static int draw(struct draw *d, uint32_t pattern, uint8_t *data, uint32_t *gen)
+{
+	int res;
+
+	if (d->cache == NULL)
+		return -EIO;
+
+	if (d->pattern != pattern &&
+	    (res = update_cache(d, pattern)) < 0)
+		return res;
+
+	if (*gen != d->cache_gen) {
+		if (d->snow_y > 0)
+			memcpy(data, d->cache, d->snow_y * d->stride);
+		if (d->snow_y < d->height && d->snow_x > 0)
+			memcpy(data + d->snow_y * d->stride, d->cache + d->snow_y * d->stride,
+					(d->height - d->snow_y) * d->stride);
+		*gen = d->cache_gen;
+	}
+
+	switch (pattern) {
+	case PATTERN_SMPTE_SNOW:
+	case PATTERN_SNOW:
+		draw_snow(d, data, d->snow_y, d->snow_x);
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
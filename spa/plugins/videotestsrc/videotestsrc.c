@@ -28,10 +28,7 @@
 #define FRAMES_TO_TIME(port,f) ((port->current_format.info.raw.framerate.denom * (f) * SPA_NSEC_PER_SEC) / \
                                 (port->current_format.info.raw.framerate.num))
 
-enum pattern {
-	PATTERN_SMPTE_SNOW,
-	PATTERN_SNOW,
-};
+#include "draw.c"
 
 #define DEFAULT_LIVE true
 #define DEFAULT_PATTERN PATTERN_SMPTE_SNOW
@@ -56,6 +53,7 @@ struct buffer {
 	bool outstanding;
 	struct spa_meta_header *h;
 	struct spa_list link;
+	uint32_t gen;
 };
 
 struct port {
@@ -69,6 +67,7 @@ struct port {
 	struct spa_video_info current_format;
 	size_t bpp;
 	int stride;
+	struct draw draw;
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -155,6 +154,8 @@ static int impl_node_enum_params(void *object, int seq,
 			spa_pod_builder_string(&b, "SMPTE snow");
 			spa_pod_builder_int(&b, PATTERN_SNOW);
 			spa_pod_builder_string(&b, "Snow");
+			spa_pod_builder_int(&b, PATTERN_SMPTE);
+			spa_pod_builder_string(&b, "SMPTE");
 			spa_pod_builder_pop(&b, &f[1]);
 			param = spa_pod_builder_pop(&b, &f[0]);
 			break;
@@ -233,11 +234,10 @@ static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 	return 0;
 }
 
-#include "draw.c"
-
 static int fill_buffer(struct impl *this, struct buffer *b)
 {
-	return draw(this, b->outbuf->datas[0].data);
+	return draw(&this->port.draw, this->props.pattern,
+			b->outbuf->datas[0].data, &b->gen);
 }
 
 static void set_timer(struct impl *this, bool enabled)
@@ -611,6 +611,7 @@ static int port_set_format(struct impl *this, struct port *port,
 	if (format == NULL) {
 		port->have_format = false;
 		clear_buffers(this, port);
+		draw_clear(&port->draw);
 	} else {
 		struct spa_video_info info = { 0 };
 
@@ -637,14 +638,18 @@ static int port_set_format(struct impl *this, struct port *port,
 		    info.info.raw.framerate.denom == 0)
 			return -EINVAL;
 
+		port->stride = SPA_ROUND_UP_N(port->bpp * info.info.raw.size.width, 4);
+		if ((res = draw_init(&port->draw, info.info.raw.format,
+				info.info.raw.size.width, info.info.raw.size.height,
+				port->stride)) < 0)
+			return res;
+
 		port->current_format = info;
 		port->have_format = true;
 	}
 
 	port->info.change_mask |= SPA_PORT_CHANGE_MASK_PARAMS;
 	if (port->have_format) {
-		struct spa_video_info_raw *raw_info = &port->current_format.info.raw;
-		port->stride = SPA_ROUND_UP_N(port->bpp * raw_info->size.width, 4);
 		port->params[3] = SPA_PARAM_INFO(SPA_PARAM_Format, SPA_PARAM_INFO_READWRITE);
 		port->params[4] = SPA_PARAM_INFO(SPA_PARAM_Buffers, SPA_PARAM_INFO_READ);
 	} else {
@@ -708,6 +713,7 @@ impl_node_port_use_buffers(void *object,
 		b->outbuf = buffers[i];
 		b->outstanding = false;
 		b->h = spa_buffer_find_meta_data(buffers[i], SPA_META_Header, sizeof(*b->h));
+		b->gen = 0;
 
 		if (d[0].data == NULL) {
 			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
@@ -854,6 +860,8 @@ static int impl_clear(struct spa_handle *handle)
 		spa_loop_invoke(this->data_loop, do_remove_timer, 0, NULL, 0, true, this);
 	spa_system_close(this->data_system, this->timer_source.fd);
 
+	draw_clear(&this->port.draw);
+
 	return 0;
 }
 
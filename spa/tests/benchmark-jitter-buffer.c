@@ -0,0 +1,379 @@
+/* Simple Plugin API */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/dll.h>
+#include <spa/utils/ringbuffer.h>
+#include <spa/utils/jitter-buffer.h>
+
+/*
+ * Replays packet arrival traces through a receiver and compares the
+ * jitter buffer with the fixed target spa_dll receiver that RTP used
+ * before. Traces are built in, or read from a file with one
+ * "<arrival usec> <frames>" line per packet.
+ */
+
+#define RATE		48000
+#define FRAME_SIZE	4
+#define QUANTUM		1024
+#define RING_FRAMES	(1u << 15)
+#define RESERVE		QUANTUM
+#define MAX_PACKETS	(1u << 20)
+
+struct packet {
+	uint64_t time;		/* arrival in nsec */
+	uint32_t frames;
+};
+
+struct trace {
+	const char *name;
+	struct packet *packets;
+	uint32_t n_packets;
+	uint64_t duration;
+};
+
+struct result {
+	uint32_t cycles;
+	uint32_t underruns;
+	uint64_t concealed;
+	uint64_t dropped;
+	double latency_avg;	/* msec */
+	double latency_max;	/* msec */
+	double cpu_ns;		/* per cycle */
+};
+
+struct receiver {
+	const char *name;
+	void *(*create) (int32_t target);
+	void (*destroy) (void *r);
+	void (*write) (void *r, const void *data, uint32_t frames);
+	/* consume up to samples, return rate correction and concealed frames */
+	double (*read) (void *r, void *dst, uint32_t samples, uint32_t *concealed);
+	uint32_t (*level) (void *r);
+};
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+/* jitter buffer receiver */
+struct jb_receiver {
+	struct spa_jitter_buffer jb;
+	uint8_t data[(RING_FRAMES + RESERVE) * FRAME_SIZE];
+};
+
+static void *jb_create(int32_t target)
+{
+	struct jb_receiver *r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	spa_jitter_buffer_init(&r->jb, NULL, r->data, RING_FRAMES * FRAME_SIZE,
+			FRAME_SIZE, RATE, RESERVE);
+	spa_jitter_buffer_set_target_latency(&r->jb, target);
+	return r;
+}
+
+static void jb_write(void *data, const void *src, uint32_t frames)
+{
+	struct jb_receiver *r = data;
+	uint32_t avail;
+	void *dst;
+
+	/* decode in place, like the Bluetooth sources */
+	dst = spa_jitter_buffer_get_write(&r->jb, &avail);
+	frames = SPA_MIN(frames, avail / FRAME_SIZE);
+	memcpy(dst, src, frames * FRAME_SIZE);
+	spa_jitter_buffer_write_packet(&r->jb, frames * FRAME_SIZE);
+}
+
+static double jb_read(void *data, void *dst, uint32_t samples, uint32_t *concealed)
+{
+	struct jb_receiver *r = data;
+	uint32_t size = samples * FRAME_SIZE;
+
+	spa_jitter_buffer_process(&r->jb, samples, QUANTUM);
+	*concealed = (size - spa_jitter_buffer_read(&r->jb, dst, size)) / FRAME_SIZE;
+	return r->jb.corr;
+}
+
+static uint32_t jb_level(void *data)
+{
+	struct jb_receiver *r = data;
+	return spa_jitter_buffer_get_size(&r->jb);
+}
+
+static void *jb_create_auto(int32_t target)
+{
+	return jb_create(0);
+}
+
+/* the previous RTP receiver: fixed target with spa_dll on the fill level */
+struct dll_receiver {
+	struct spa_ringbuffer ring;
+	struct spa_dll dll;
+	int32_t target;
+	bool first;
+	uint8_t data[RING_FRAMES * FRAME_SIZE];
+};
+
+static void *dll_create(int32_t target)
+{
+	struct dll_receiver *r = calloc(1, sizeof(*r));
+	if (r == NULL)
+		return NULL;
+	spa_ringbuffer_init(&r->ring);
+	spa_dll_init(&r->dll);
+	spa_dll_set_bw(&r->dll, SPA_DLL_BW_MIN, 128, RATE);
+	r->target = target;
+	r->first = true;
+	return r;
+}
+
+static void dll_write(void *data, const void *src, uint32_t frames)
+{
+	struct dll_receiver *r = data;
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&r->ring, &index);
+	if (filled + frames > RING_FRAMES)
+		return;
+	spa_ringbuffer_write_data(&r->ring, r->data, sizeof(r->data),
+			(index % RING_FRAMES) * FRAME_SIZE, src, frames * FRAME_SIZE);
+	spa_ringbuffer_write_update(&r->ring, index + frames);
+}
+
+static double dll_read(void *data, void *dst, uint32_t samples, uint32_t *concealed)
+{
+	struct dll_receiver *r = data;
+	uint32_t index;
+	int32_t avail;
+	double corr = 1.0;
+
+	avail = spa_ringbuffer_get_read_index(&r->ring, &index);
+	if (avail < (int32_t)samples) {
+		memset(dst, 0, samples * FRAME_SIZE);
+		*concealed = samples;
+		return 1.0;
+	}
+	if (r->first) {
+		if (avail > r->target) {
+			index += avail - r->target;
+			avail = r->target;
+		}
+		r->first = false;
+	} else if (avail > r->target * 8) {
+		index += avail - r->target;
+		avail = r->target;
+	}
+	corr = spa_dll_update(&r->dll, SPA_CLAMP((double)(r->target - avail), -RATE / 100.0, RATE / 100.0));
+
+	spa_ringbuffer_read_data(&r->ring, r->data, sizeof(r->data),
+			(index % RING_FRAMES) * FRAME_SIZE, dst, samples * FRAME_SIZE);
+	spa_ringbuffer_read_update(&r->ring, index + samples);
+	*concealed = 0;
+	return corr;
+}
+
+static uint32_t dll_level(void *data)
+{
+	struct dll_receiver *r = data;
+	uint32_t index;
+	return SPA_MAX(spa_ringbuffer_get_read_index(&r->ring, &index), 0);
+}
+
+static const struct receiver receivers[] = {
+	{ "jitter-auto", jb_create_auto, free, jb_write, jb_read, jb_level },
+	{ "jitter-fixed", jb_create, free, jb_write, jb_read, jb_level },
+	{ "dll-fixed", dll_create, free, dll_write, dll_read, dll_level },
+};
+
+/* deterministic pseudo random numbers so that runs are comparable */
+static uint32_t rand_state = 1;
+
+static double rand_uniform(void)
+{
+	rand_state = rand_state * 1103515245 + 12345;
+	return ((rand_state >> 8) & 0xffffff) / (double)0x1000000;
+}
+
+static int make_trace(struct trace *t, const char *name, double seconds)
+{
+	static const uint32_t pattern_a[] = { 5, 5, 20 };
+	static const uint32_t pattern_b[] = { 3, 3, 4, 30 };
+	const uint32_t frames = RATE / 100;
+	const uint64_t period = 10 * SPA_NSEC_PER_MSEC;
+	double drift = 1.0;
+	uint64_t time = 0, sent = 0;
+	uint32_t i, n = (uint32_t)(seconds * 100);
+
+	t->name = name;
+	t->packets = calloc(n, sizeof(struct packet));
+	if (t->packets == NULL)
+		return -errno;
+	t->n_packets = n;
+
+	if (strcmp(name, "drift") == 0)
+		drift = 1.0 + 300e-6;
+
+	for (i = 0; i < n; i++) {
+		uint64_t nominal = (uint64_t)(sent * period / drift);
+		int64_t jitter = 0;
+
+		if (strcmp(name, "bt-5-5-20") == 0) {
+			/* 10 ms packets grouped in intervals of 5, 5 and 20 ms */
+			if (i > 0)
+				time += pattern_a[i % SPA_N_ELEMENTS(pattern_a)] * SPA_NSEC_PER_MSEC;
+		} else if (strcmp(name, "bt-3-3-4-30") == 0) {
+			if (i > 0)
+				time += pattern_b[i % SPA_N_ELEMENTS(pattern_b)] * SPA_NSEC_PER_MSEC;
+		} else if (strcmp(name, "wifi") == 0) {
+			/* up to 8 ms random jitter and a 60 ms stall every 5 s */
+			jitter = (int64_t)(rand_uniform() * 8 * SPA_NSEC_PER_MSEC);
+			if (i % 500 == 250)
+				jitter += 60 * SPA_NSEC_PER_MSEC;
+			time = SPA_MAX(time, nominal + jitter);
+		} else {
+			time = nominal + (int64_t)(rand_uniform() * SPA_NSEC_PER_MSEC);
+		}
+		t->packets[i].time = time;
+		t->packets[i].frames = frames;
+		sent++;
+	}
+	t->duration = t->packets[n - 1].time;
+	return 0;
+}
+
+static int load_trace(struct trace *t, const char *path)
+{
+	FILE *f;
+	unsigned long long usec;
+	unsigned int frames;
+	uint32_t n = 0;
+
+	if ((f = fopen(path, "r")) == NULL)
+		return -errno;
+
+	t->name = path;
+	t->packets = calloc(MAX_PACKETS, sizeof(struct packet));
+	if (t->packets == NULL) {
+		fclose(f);
+		return -errno;
+	}
+	while (n < MAX_PACKETS && fscanf(f, "%llu %u", &usec, &frames) == 2) {
+		t->packets[n].time = usec * SPA_NSEC_PER_USEC;
+		t->packets[n].frames = SPA_MIN(frames, (unsigned int)QUANTUM * 4);
+		n++;
+	}
+	fclose(f);
+
+	if (n == 0) {
+		free(t->packets);
+		return -EINVAL;
+	}
+	t->n_packets = n;
+	t->duration = t->packets[n - 1].time;
+	return 0;
+}
+
+static int run(const struct receiver *rx, const struct trace *t, int32_t target, struct result *res)
+{
+	static uint8_t packet[QUANTUM * 4 * FRAME_SIZE];
+	static uint8_t out[QUANTUM * 2 * FRAME_SIZE];
+	const uint64_t cycle = (uint64_t)QUANTUM * SPA_NSEC_PER_SEC / RATE;
+	uint64_t now, cpu = 0, latency = 0;
+	uint32_t next = 0, max_level = 0;
+	double corr = 1.0, frac = 0.0;
+	void *r;
+
+	spa_zero(*res);
+	if ((r = rx->create(target)) == NULL)
+		return -errno;
+
+	for (now = 0; now <= t->duration; now += cycle) {
+		uint32_t samples, concealed, level;
+		uint64_t t1;
+		double want;
+
+		t1 = get_time_ns();
+		while (next < t->n_packets && t->packets[next].time <= now) {
+			rx->write(r, packet, t->packets[next].frames);
+			next++;
+		}
+		/* the resampler asks for more or less data to follow corr */
+		want = QUANTUM * corr + frac;
+		samples = (uint32_t)want;
+		frac = want - samples;
+		samples = SPA_MIN(samples, (uint32_t)QUANTUM * 2);
+
+		level = rx->level(r);
+		corr = rx->read(r, out, samples, &concealed);
+		cpu += get_time_ns() - t1;
+
+		res->cycles++;
+		if (concealed > 0)
+			res->underruns++;
+		res->concealed += concealed;
+		latency += level;
+		max_level = SPA_MAX(max_level, level);
+	}
+	res->latency_avg = res->cycles ? latency * 1000.0 / res->cycles / RATE : 0.0;
+	res->latency_max = max_level * 1000.0 / RATE;
+	res->cpu_ns = res->cycles ? cpu / (double)res->cycles : 0.0;
+
+	rx->destroy(r);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	static const char * const names[] = { "bt-5-5-20", "bt-3-3-4-30", "wifi", "drift" };
+	struct trace traces[SPA_N_ELEMENTS(names) + 1];
+	uint32_t i, j, n_traces = 0;
+	int32_t target = RATE * 40 / 1000;
+	int res;
+
+	if (argc > 1) {
+		if ((res = load_trace(&traces[n_traces], argv[1])) < 0) {
+			fprintf(stderr, "can't load trace %s: %s\n", argv[1], strerror(-res));
+			return -1;
+		}
+		n_traces++;
+	} else {
+		for (i = 0; i < SPA_N_ELEMENTS(names); i++) {
+			if ((res = make_trace(&traces[n_traces], names[i], 120.0)) < 0)
+				return -1;
+			n_traces++;
+		}
+	}
+
+	printf("%-12s %-13s %8s %9s %10s %8s %8s %8s\n", "trace", "receiver",
+			"cycles", "underrun", "concealed", "avg-ms", "max-ms", "cpu-ns");
+
+	for (i = 0; i < n_traces; i++) {
+		for (j = 0; j < SPA_N_ELEMENTS(receivers); j++) {
+			struct result r;
+
+			if ((res = run(&receivers[j], &traces[i], target, &r)) < 0)
+				return -1;
+
+			printf("%-12s %-13s %8u %9u %10"PRIu64" %8.2f %8.2f %8.1f\n",
+					traces[i].name, receivers[j].name, r.cycles,
+					r.underruns, r.concealed, r.latency_avg,
+					r.latency_max, r.cpu_ns);
+		}
+		free(traces[i].packets);
+	}
+	return 0;
+}
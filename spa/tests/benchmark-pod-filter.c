@@ -0,0 +1,158 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <spa/pod/builder.h>
+#include <spa/pod/vararg.h>
+#include <spa/pod/filter.h>
+#include <spa/param/video/raw.h>
+
+/*
+ * A camera with N_SIZES sizes for each of N_FORMATS formats and an enum of
+ * framerates, like v4l2 enumerates them, is linked to a consumer with
+ * N_FILTERS formats. Only the last filter matches, and only with the
+ * last camera format. Compares filtering every pair with
+ * spa_pod_filter_intersect().
+ */
+
+#define N_SIZES		32
+#define N_FORMATS	4
+#define N_PODS		(N_SIZES * N_FORMATS)
+#define N_FILTERS	16
+#define MAX_COUNT	10000
+
+static uint8_t pod_buffer[N_PODS * 256];
+static uint8_t filter_buffer[N_FILTERS * 256];
+
+static struct spa_pod *pods[N_PODS];
+static struct spa_pod *filters[N_FILTERS];
+static struct spa_pod_filter_key keys[N_PODS];
+
+static const uint32_t formats[N_FORMATS] = {
+	SPA_VIDEO_FORMAT_YUY2,
+	SPA_VIDEO_FORMAT_NV12,
+	SPA_VIDEO_FORMAT_RGB,
+	SPA_VIDEO_FORMAT_I420,
+};
+
+static void build(void)
+{
+	struct spa_pod_builder b;
+	uint32_t i;
+
+	spa_pod_builder_init(&b, pod_buffer, sizeof(pod_buffer));
+	for (i = 0; i < N_PODS; i++) {
+		struct spa_rectangle size = SPA_RECTANGLE(64 + 32 * (i % N_SIZES),
+				48 + 24 * (i % N_SIZES));
+		pods[i] = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			SPA_FORMAT_VIDEO_format,   SPA_POD_Id(formats[i / N_SIZES]),
+			SPA_FORMAT_VIDEO_size,     SPA_POD_Rectangle(&size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_ENUM_Fraction(5,
+							&SPA_FRACTION(30, 1),
+							&SPA_FRACTION(30, 1),
+							&SPA_FRACTION(25, 1),
+							&SPA_FRACTION(15, 1),
+							&SPA_FRACTION(10, 1)));
+		spa_pod_filter_key_init(&keys[i], pods[i]);
+	}
+
+	spa_pod_builder_init(&b, filter_buffer, sizeof(filter_buffer));
+	for (i = 0; i < N_FILTERS - 1; i++) {
+		/* compressed formats and sizes the camera doesn't have */
+		if (i % 2)
+			filters[i] = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_mjpg),
+				SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+								&SPA_RECTANGLE(320, 240),
+								&SPA_RECTANGLE(1, 1),
+								&SPA_RECTANGLE(8192, 8192)));
+		else
+			filters[i] = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+				SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+				SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+				SPA_FORMAT_VIDEO_format,   SPA_POD_CHOICE_ENUM_Id(3,
+								SPA_VIDEO_FORMAT_BGRx,
+								SPA_VIDEO_FORMAT_BGRx,
+								SPA_VIDEO_FORMAT_RGBA),
+				SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+								&SPA_RECTANGLE(320, 240),
+								&SPA_RECTANGLE(1, 1),
+								&SPA_RECTANGLE(8192, 8192)));
+	}
+	filters[i] = spa_pod_builder_add_object(&b,
+		SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+		SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+		SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+		SPA_FORMAT_VIDEO_format,   SPA_POD_Id(SPA_VIDEO_FORMAT_I420),
+		SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+						&SPA_RECTANGLE(1056, 792),
+						&SPA_RECTANGLE(1056, 792),
+						&SPA_RECTANGLE(8192, 8192)),
+		SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+						&SPA_FRACTION(15, 1),
+						&SPA_FRACTION(0, 1),
+						&SPA_FRACTION(15, 1)));
+}
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int filter_all(struct spa_pod_builder *b, struct spa_pod **result)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < N_FILTERS; i++)
+		for (j = 0; j < N_PODS; j++)
+			if (spa_pod_filter(b, result, pods[j], filters[i]) >= 0)
+				return 1;
+	return 0;
+}
+
+static int filter_intersect(struct spa_pod_builder *b, struct spa_pod **result)
+{
+	return spa_pod_filter_intersect(b, result, keys, N_PODS,
+			(const struct spa_pod * const *)filters, N_FILTERS, NULL, NULL);
+}
+
+static void run(const char *name, int (*func)(struct spa_pod_builder *b, struct spa_pod **result))
+{
+	uint8_t buffer[4096];
+	struct spa_pod_builder b;
+	struct spa_pod *result = NULL;
+	uint64_t t1, t2, count;
+
+	fprintf(stderr, "%s: ", name);
+	t1 = get_time_ns();
+	for (count = 0; count < MAX_COUNT; count++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		spa_assert_se(func(&b, &result) == 1);
+	}
+	t2 = get_time_ns();
+	fprintf(stderr, "elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec\n",
+			t2 - t1, count, count * (uint64_t)SPA_NSEC_PER_SEC / (t2 - t1));
+}
+
+int main(int argc, char *argv[])
+{
+	build();
+
+	fprintf(stderr, "%d formats against %d filters\n", N_PODS, N_FILTERS);
+	run("filter all pairs", filter_all);
+	run("filter intersect", filter_intersect);
+
+	return 0;
+}
@@ -25,13 +25,26 @@ static void on_stream_destroy(void *d)
 	stream->stream = NULL;
 }
 
+static void on_source_stream_io_changed(void *data, uint32_t id, void *area, uint32_t size)
+{
+	struct stream *stream = data;
+
+	switch (id) {
+	case SPA_IO_RateMatch:
+		stream->io_rate_match = area;
+		break;
+	case SPA_IO_Position:
+		stream->io_position = area;
+		break;
+	}
+}
+
 static void on_source_stream_process(void *data)
 {
 	struct stream *stream = data;
 	struct pw_buffer *buf;
 	struct spa_data *d;
-	uint32_t index, n_bytes;
-	int32_t avail, wanted;
+	uint32_t n_bytes, avail, wanted, duration;
 
 	if ((buf = pw_stream_dequeue_buffer(stream->stream)) == NULL) {
 		pw_log_debug("out of buffers: %m");
@@ -42,22 +55,20 @@ static void on_source_stream_process(void *data)
 
 	wanted = buf->requested ? buf->requested * stream->stride : d[0].maxsize;
 
-	n_bytes = SPA_MIN(d[0].maxsize, (uint32_t)wanted);
+	n_bytes = SPA_MIN(d[0].maxsize, wanted);
+	n_bytes -= n_bytes % stream->stride;
 
-	avail = spa_ringbuffer_get_read_index(&stream->ring, &index);
+	duration = stream->io_position ? stream->io_position->clock.duration :
+		n_bytes / stream->stride;
 
-	if (avail < wanted) {
-		pw_log_debug("capture underrun %d < %d", avail, wanted);
-		memset(d[0].data, 0, n_bytes);
-	} else {
-		spa_ringbuffer_read_data(&stream->ring,
-				stream->buffer_data,
-				stream->buffer_size,
-				index % stream->buffer_size,
-				d[0].data, n_bytes);
-		index += n_bytes;
-		spa_ringbuffer_read_update(&stream->ring, index);
-	}
+	spa_jitter_buffer_process(&stream->jbuf, n_bytes / stream->stride, duration);
+	spa_jitter_buffer_update_rate_match(&stream->jbuf, stream->io_rate_match, true);
+
+	avail = spa_jitter_buffer_get_avail(&stream->jbuf);
+	if (avail < n_bytes)
+		pw_log_debug("capture underrun %u < %u", avail, n_bytes);
+
+	spa_jitter_buffer_read(&stream->jbuf, d[0].data, n_bytes);
 
 	d[0].chunk->size = n_bytes;
 	d[0].chunk->stride = stream->stride;
@@ -70,6 +81,7 @@ static void on_source_stream_process(void *data)
 static const struct pw_stream_events source_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.destroy = on_stream_destroy,
+	.io_changed = on_source_stream_io_changed,
 	.process = on_source_stream_process
 };
 
@@ -315,6 +327,11 @@ struct stream *server_create_stream(struct server *server,
 	stream->info.info.raw.channels = 8;
 	stream->stride = stream->info.info.raw.channels * 4;
 
+	if (direction == SPA_DIRECTION_INPUT)
+		spa_jitter_buffer_init(&stream->jbuf, pw_log_get(), stream->buffer_data,
+				stream->buffer_size, stream->stride,
+				stream->info.info.raw.rate, 0);
+
 	n_params = 0;
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 	params[n_params++] = spa_format_audio_raw_build(&b,
@@ -448,23 +465,17 @@ error_close:
 static void handle_iec61883_packet(struct stream *stream,
 		struct avb_packet_iec61883 *p, int len)
 {
-	uint32_t index, n_bytes;
-	int32_t filled;
+	uint32_t n_bytes;
 
-	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
 	n_bytes = ntohs(p->data_len) - 8;
+	n_bytes -= n_bytes % stream->stride;
 
-	if (filled + n_bytes > stream->buffer_size) {
+	if (n_bytes > stream->jbuf.size) {
 		pw_log_debug("capture overrun");
-	} else {
-		spa_ringbuffer_write_data(&stream->ring,
-				stream->buffer_data,
-				stream->buffer_size,
-				index % stream->buffer_size,
-				p->payload, n_bytes);
-		index += n_bytes;
-		spa_ringbuffer_write_update(&stream->ring, index);
+		return;
 	}
+	/* on overrun the oldest data is dropped */
+	spa_jitter_buffer_write(&stream->jbuf, p->payload, n_bytes);
 }
 
 static void on_socket_data(void *data, int fd, uint32_t mask)
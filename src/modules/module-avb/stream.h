@@ -11,6 +11,7 @@
 #include <net/if.h>
 
 #include <spa/utils/ringbuffer.h>
+#include <spa/utils/jitter-buffer.h>
 #include <spa/param/audio/format.h>
 
 #include <pipewire/pipewire.h>
@@ -60,6 +61,10 @@ struct stream {
 	void *buffer_data;
 	size_t buffer_size;
 
+	struct spa_jitter_buffer jbuf;
+	struct spa_io_rate_match *io_rate_match;
+	struct spa_io_position *io_position;
+
 	uint64_t format;
 	uint32_t stride;
 	struct spa_audio_info info;
@@ -106,6 +106,7 @@ do_deactivate_link(struct spa_loop *loop,
 	struct link *link = user_data;
 	pw_log_trace("link %p deactivate", link);
 	spa_list_remove(&link->target.link);
+	pw_impl_node_update_targets(link->data->node);
 	return 0;
 }
 
@@ -864,6 +865,7 @@ do_activate_link(struct spa_loop *loop,
 	struct node_data *d = link->data;
 	pw_log_trace("link %p activate", link);
 	spa_list_append(&d->node->rt.target_list, &link->target.link);
+	pw_impl_node_update_targets(d->node);
 	return 0;
 }
 
@@ -880,7 +882,8 @@ client_node_set_activation(void *_data,
 	struct pw_impl_node *node = data->node;
 	struct pw_memmap *mm;
 	void *ptr;
-	struct link *link;
+	struct link *link, *l;
+	uint32_t n_links;
 	int res = 0;
 
 	if (memid == SPA_ID_INVALID) {
@@ -917,6 +920,10 @@ client_node_set_activation(void *_data,
 		link->target.fd = signalfd;
 		spa_list_append(&data->links, &link->link);
 
+		n_links = 0;
+		spa_list_for_each(l, &data->links, link)
+			n_links++;
+		pw_impl_node_reserve_targets(node, n_links);
 		pw_loop_invoke(data->data_loop,
                        do_activate_link, SPA_ID_INVALID, NULL, 0, false, link);
 
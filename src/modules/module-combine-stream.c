@@ -46,6 +46,8 @@
  * - `node.description`: a human readable name for the stream
  * - `combine.mode` = capture | playback | sink | source, default sink
  * - `combine.latency-compensate`: use delay buffers to match stream latencies
+ * - `combine.link-mode`: link the sink monitor ports directly to the devices
+ *                     instead of copying into a stream per device, sink mode only.
  * - `combine.props = {}`: properties to be passed to the sink/source
  * - `stream.props = {}`: properties to be passed to the streams
  * - `stream.rules = {}`: rules for matching streams, use create-stream actions
@@ -72,6 +74,22 @@
  * - `combine.audio.position`: map the combine audio positions to the stream positions.
  *                     combine input channels are mapped one-by-one to stream output channels.
  *
+ * Streams mapping the same channel overlap and are mixed together.
+ *
+ * ## Link mode
+ *
+ * With `combine.link-mode = true`, no stream is made for the devices. The
+ * monitor ports of the combine sink are linked to the input ports of the
+ * devices instead, with `audio.position` naming the device ports. The graph
+ * shares the monitor buffers between all links, so no samples are copied
+ * per device, and device ports that receive more than one channel mix them.
+ *
+ * The monitor ports are made by the session manager for Audio/Sink nodes.
+ *
+ * When latency compensation is enabled, a delay filter is inserted in front
+ * of the devices that need to be delayed. Devices with the largest latency
+ * stay linked directly.
+ *
  * ## Example configuration
  *
  *\code{.unparsed}
@@ -209,6 +227,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 
 #define MODULE_USAGE	"( node.latency=<latency as fraction> ) "				\
 			"( combine.mode=<mode of stream, playback|capture|sink|source>, default:sink ) "	\
+			"( combine.link-mode=<link the devices to the sink monitor ports> ) "	\
 			"( node.name=<name of the stream> ) "					\
 			"( node.description=<description of the stream> ) "			\
 			"( audio.channels=<number of channels, default:"SPA_STRINGIFY(DEFAULT_CHANNELS) "> ) "	\
@@ -218,6 +237,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( stream.rules=<properties> ) "
 
 #define DELAYBUF_MAX_SIZE	(20 * sizeof(float) * 96000)
+#define MIXBUF_SIZE		1024u
 
 
 static const struct spa_dict_item module_props[] = {
@@ -265,12 +285,32 @@ struct impl {
 	int64_t latency_offset;
 
 	struct spa_audio_info_raw info;
+	uint32_t rate;
+	uint32_t quantum;		/* for link mode */
 
 	unsigned int do_disconnect:1;
 	unsigned int latency_compensate:1;
+	unsigned int link_mode:1;
 
 	struct spa_list streams;
 	uint32_t n_streams;
+
+	struct spa_list ports;		/* for link mode */
+};
+
+struct port {
+	struct spa_list link;
+	uint32_t id;
+	uint32_t node_id;
+	enum pw_direction direction;
+	uint32_t channel;
+	unsigned int monitor:1;
+};
+
+struct link {
+	struct pw_proxy *proxy;
+	uint32_t output_port;
+	uint32_t input_port;
 };
 
 struct ringbuffer {
@@ -293,6 +333,7 @@ struct stream {
 
 	struct spa_audio_info_raw info;
 	uint32_t remap[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t n_remap;
 	uint32_t rate;
 
 	void *delaybuf;
@@ -301,9 +342,25 @@ struct stream {
 	int64_t delay_nsec;		/* for main loop */
 	int64_t data_delay_nsec;	/* for data loop */
 
+	/* link mode */
+	struct pw_properties *filter_props;
+	struct pw_filter *filter;
+	struct spa_hook filter_listener;
+	uint32_t filter_id;
+	void *in_ports[SPA_AUDIO_MAX_CHANNELS];
+	void *out_ports[SPA_AUDIO_MAX_CHANNELS];
+
+	struct pw_proxy *port;
+	struct spa_hook port_listener;
+	uint32_t port_id;
+
+	struct link links[SPA_AUDIO_MAX_CHANNELS * 2];
+	uint32_t n_links;
+
 	unsigned int ready:1;
 	unsigned int added:1;
 	unsigned int have_latency:1;
+	unsigned int linked:1;
 };
 
 static uint32_t channel_from_name(const char *name)
@@ -379,6 +436,29 @@ static void ringbuffer_memcpy(struct ringbuffer *r, void *dst, void *src, uint32
 	}
 }
 
+/* like ringbuffer_memcpy() but adds to the first filled bytes of dst */
+static void ringbuffer_mix(struct ringbuffer *r, float *dst, uint32_t filled,
+		void *src, uint32_t size)
+{
+	float tmp[MIXBUF_SIZE];
+	uint32_t i, n, done = 0;
+	uint32_t n_samples = size / sizeof(float), n_filled = filled / sizeof(float);
+
+	while (done < n_samples) {
+		n = SPA_MIN(n_samples - done, MIXBUF_SIZE);
+
+		ringbuffer_memcpy(r, tmp, SPA_PTROFF(src, done * sizeof(float), void),
+				n * sizeof(float));
+
+		for (i = 0; i < n; i++, done++) {
+			if (done < n_filled)
+				dst[done] += tmp[i];
+			else
+				dst[done] = tmp[i];
+		}
+	}
+}
+
 static void ringbuffer_copy(struct ringbuffer *dst, struct ringbuffer *src)
 {
 	uint32_t l0, l1;
@@ -418,8 +498,19 @@ static void apply_latency_offset(struct spa_latency_info *latency, int64_t offse
 
 static int64_t get_stream_delay(struct stream *s)
 {
+	struct impl *impl = s->impl;
 	struct pw_time t;
 
+	if (s->stream == NULL) {
+		/* link mode, use the latency of the device port */
+		if (!s->have_latency || impl->rate == 0)
+			return INT64_MIN;
+
+		return s->latency.min_ns +
+			(int64_t)((s->latency.min_quantum * impl->quantum + s->latency.min_rate) *
+				SPA_NSEC_PER_SEC / impl->rate);
+	}
+
 	if (pw_stream_get_time_n(s->stream, &t, sizeof(t)) < 0 ||
 			t.rate.denom == 0)
 		return INT64_MIN;
@@ -494,6 +585,121 @@ static int do_replace_delay(struct spa_loop *loop, bool async, uint32_t seq,
 	return 0;
 }
 
+static void filter_destroy(void *d)
+{
+	struct stream *s = d;
+	spa_hook_remove(&s->filter_listener);
+	s->filter = NULL;
+}
+
+static void update_links(struct impl *impl);
+
+static void filter_state_changed(void *d, enum pw_filter_state old,
+		enum pw_filter_state state, const char *error)
+{
+	struct stream *s = d;
+
+	switch (state) {
+	case PW_FILTER_STATE_ERROR:
+		pw_log_error("stream %d delay filter error: %s", s->id, error);
+		break;
+	case PW_FILTER_STATE_PAUSED:
+		s->filter_id = pw_filter_get_node_id(s->filter);
+		update_links(s->impl);
+		break;
+	default:
+		break;
+	}
+}
+
+static void filter_process(void *d, struct spa_io_position *position)
+{
+	struct stream *s = d;
+	uint32_t i, n_samples = position->clock.duration;
+
+	for (i = 0; i < s->info.channels; i++) {
+		float *in, *out;
+
+		if (s->out_ports[i] == NULL ||
+		    (out = pw_filter_get_dsp_buffer(s->out_ports[i], n_samples)) == NULL)
+			continue;
+
+		in = s->in_ports[i] ? pw_filter_get_dsp_buffer(s->in_ports[i], n_samples) : NULL;
+		if (in == NULL)
+			memset(out, 0, n_samples * sizeof(float));
+		else
+			ringbuffer_memcpy(&s->delay[i], out, in, n_samples * sizeof(float));
+	}
+}
+
+static const struct pw_filter_events filter_events = {
+	PW_VERSION_FILTER_EVENTS,
+	.destroy = filter_destroy,
+	.state_changed = filter_state_changed,
+	.process = filter_process,
+};
+
+static void unlink_stream(struct stream *s)
+{
+	uint32_t i;
+
+	for (i = 0; i < s->n_links; i++)
+		pw_proxy_destroy(s->links[i].proxy);
+	s->n_links = 0;
+	s->linked = false;
+}
+
+static int create_delay_filter(struct stream *s)
+{
+	struct impl *impl = s->impl;
+	uint32_t i;
+	int res;
+
+	pw_log_info("stream %d: add delay filter", s->id);
+
+	s->filter = pw_filter_new(impl->core, "Combine delay", s->filter_props);
+	s->filter_props = NULL;
+	if (s->filter == NULL)
+		return -errno;
+
+	pw_filter_add_listener(s->filter, &s->filter_listener, &filter_events, s);
+
+	for (i = 0; i < s->info.channels; i++) {
+		const char *str;
+		char name[256];
+
+		str = spa_debug_type_find_short_name(spa_type_audio_channel,
+				s->info.position[i]);
+
+		snprintf(name, sizeof(name), "input_%s", str ? str : "UNK");
+		s->in_ports[i] = pw_filter_add_port(s->filter,
+				PW_DIRECTION_INPUT,
+				PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+				pw_properties_new(
+					PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+					PW_KEY_AUDIO_CHANNEL, str ? str : "UNK",
+					PW_KEY_PORT_NAME, name,
+					NULL), NULL, 0);
+
+		snprintf(name, sizeof(name), "output_%s", str ? str : "UNK");
+		s->out_ports[i] = pw_filter_add_port(s->filter,
+				PW_DIRECTION_OUTPUT,
+				PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+				pw_properties_new(
+					PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+					PW_KEY_AUDIO_CHANNEL, str ? str : "UNK",
+					PW_KEY_PORT_NAME, name,
+					NULL), NULL, 0);
+	}
+
+	if ((res = pw_filter_connect(s->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0)) < 0)
+		return res;
+
+	/* relink through the filter when its ports appear */
+	unlink_stream(s);
+	return 0;
+}
+
 static void resize_delay(struct stream *stream, uint32_t size)
 {
 	struct replace_delay_info info;
@@ -545,14 +751,24 @@ static void update_delay(struct impl *impl)
 	}
 
 	spa_list_for_each(s, &impl->streams, link) {
-		uint32_t size = 0;
+		uint32_t size = 0, rate = s->stream ? s->rate : impl->rate;
 
 		if (s->delay_nsec != INT64_MIN) {
 			int64_t delay = max_delay - s->delay_nsec;
-			size = delay * s->rate / SPA_NSEC_PER_SEC;
+			size = delay * rate / SPA_NSEC_PER_SEC;
 			size *= sizeof(float);
 		}
 
+		/* in link mode, only the devices that need a delay get a filter */
+		if (size > 0 && impl->link_mode && s->filter == NULL) {
+			int res;
+			if ((res = create_delay_filter(s)) < 0) {
+				pw_log_error("stream %d: can't create delay filter: %s",
+						s->id, spa_strerror(res));
+				continue;
+			}
+		}
+
 		resize_delay(s, size);
 	}
 
@@ -624,6 +840,17 @@ static void remove_stream(struct stream *s, bool destroy)
 		pw_stream_destroy(s->stream);
 	}
 
+	unlink_stream(s);
+	if (s->port) {
+		spa_hook_remove(&s->port_listener);
+		pw_proxy_destroy(s->port);
+	}
+	if (s->filter) {
+		spa_hook_remove(&s->filter_listener);
+		pw_filter_destroy(s->filter);
+	}
+	pw_properties_free(s->filter_props);
+
 	free(s->delaybuf);
 	free(s);
 }
@@ -718,6 +945,211 @@ static const struct pw_stream_events stream_events = {
 	.param_changed = stream_param_changed,
 };
 
+static void port_param(void *data, int seq, uint32_t id, uint32_t index,
+		uint32_t next, const struct spa_pod *param)
+{
+	struct stream *s = data;
+	struct spa_latency_info latency;
+
+	if (id != SPA_PARAM_Latency || param == NULL ||
+	    spa_latency_parse(param, &latency) < 0 ||
+	    latency.direction != get_combine_direction(s->impl))
+		return;
+
+	s->have_latency = true;
+	s->latency = latency;
+
+	update_delay(s->impl);
+	update_latency(s->impl);
+}
+
+static const struct pw_port_events port_events = {
+	PW_VERSION_PORT_EVENTS,
+	.param = port_param,
+};
+
+static struct port *find_port(struct impl *impl, uint32_t node_id,
+		enum pw_direction direction, uint32_t channel, bool monitor)
+{
+	struct port *p;
+	spa_list_for_each(p, &impl->ports, link)
+		if (p->node_id == node_id && p->direction == direction &&
+		    p->channel == channel && p->monitor == monitor)
+			return p;
+	return NULL;
+}
+
+static void add_port(struct impl *impl, uint32_t id, const struct spa_dict *props)
+{
+	struct port *p;
+	const char *str;
+
+	if ((str = spa_dict_lookup(props, PW_KEY_NODE_ID)) == NULL)
+		return;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return;
+
+	p->id = id;
+	p->node_id = atoi(str);
+	str = spa_dict_lookup(props, PW_KEY_PORT_DIRECTION);
+	p->direction = spa_streq(str, "out") ? PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT;
+	str = spa_dict_lookup(props, PW_KEY_AUDIO_CHANNEL);
+	p->channel = str ? channel_from_name(str) : SPA_AUDIO_CHANNEL_UNKNOWN;
+	str = spa_dict_lookup(props, PW_KEY_PORT_MONITOR);
+	p->monitor = str ? spa_atob(str) : false;
+
+	spa_list_append(&impl->ports, &p->link);
+}
+
+static void remove_port(struct impl *impl, uint32_t id)
+{
+	struct port *p;
+	struct stream *s;
+	uint32_t i;
+
+	spa_list_for_each(p, &impl->ports, link) {
+		if (p->id == id)
+			break;
+	}
+	if (spa_list_is_end(p, &impl->ports, link))
+		return;
+
+	spa_list_for_each(s, &impl->streams, link) {
+		if (s->port_id == id && s->port) {
+			spa_hook_remove(&s->port_listener);
+			pw_proxy_destroy(s->port);
+			s->port = NULL;
+		}
+		for (i = 0; i < s->n_links; i++) {
+			if (s->links[i].output_port == id || s->links[i].input_port == id) {
+				unlink_stream(s);
+				break;
+			}
+		}
+	}
+	spa_list_remove(&p->link);
+	free(p);
+}
+
+static int make_link(struct impl *impl, struct stream *s, struct port *out, struct port *in)
+{
+	struct pw_properties *props;
+	struct link *l = &s->links[s->n_links];
+	const char *str;
+
+	props = pw_properties_new(NULL, NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props, PW_KEY_LINK_OUTPUT_NODE, "%u", out->node_id);
+	pw_properties_setf(props, PW_KEY_LINK_OUTPUT_PORT, "%u", out->id);
+	pw_properties_setf(props, PW_KEY_LINK_INPUT_NODE, "%u", in->node_id);
+	pw_properties_setf(props, PW_KEY_LINK_INPUT_PORT, "%u", in->id);
+	pw_properties_set(props, PW_KEY_OBJECT_LINGER, "false");
+	if ((str = pw_properties_get(impl->stream_props, PW_KEY_NODE_PASSIVE)) != NULL)
+		pw_properties_set(props, PW_KEY_LINK_PASSIVE, str);
+
+	l->proxy = pw_core_create_object(impl->core,
+			"link-factory", PW_TYPE_INTERFACE_Link, PW_VERSION_LINK,
+			&props->dict, 0);
+	pw_properties_free(props);
+
+	if (l->proxy == NULL)
+		return -errno;
+
+	l->output_port = out->id;
+	l->input_port = in->id;
+	s->n_links++;
+	return 0;
+}
+
+static int link_stream(struct impl *impl, struct stream *s)
+{
+	struct port *src[SPA_AUDIO_MAX_CHANNELS], *dst[SPA_AUDIO_MAX_CHANNELS];
+	struct port *fin[SPA_AUDIO_MAX_CHANNELS], *fout[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t i, n_channels = SPA_MIN(s->info.channels, s->n_remap);
+	int res;
+
+	if (s->linked || impl->combine_id == 0)
+		return 0;
+	if (s->filter != NULL && s->filter_id == 0)
+		return 0;
+
+	/* wait until all ports are known */
+	for (i = 0; i < n_channels; i++) {
+		uint32_t channel = s->info.position[i];
+
+		src[i] = dst[i] = fin[i] = fout[i] = NULL;
+		if (s->remap[i] >= impl->info.channels)
+			continue;
+
+		src[i] = find_port(impl, impl->combine_id, PW_DIRECTION_OUTPUT,
+				impl->info.position[s->remap[i]], true);
+		dst[i] = find_port(impl, s->id, PW_DIRECTION_INPUT, channel, false);
+		if (src[i] == NULL || dst[i] == NULL)
+			return 0;
+
+		if (s->filter != NULL) {
+			fin[i] = find_port(impl, s->filter_id, PW_DIRECTION_INPUT, channel, false);
+			fout[i] = find_port(impl, s->filter_id, PW_DIRECTION_OUTPUT, channel, false);
+			if (fin[i] == NULL || fout[i] == NULL)
+				return 0;
+		}
+	}
+
+	for (i = 0; i < n_channels; i++) {
+		if (src[i] == NULL)
+			continue;
+
+		pw_log_info("stream %d: link port %d -> %d%s", s->id, src[i]->id, dst[i]->id,
+				s->filter ? " with delay" : "");
+
+		if (s->filter != NULL) {
+			if ((res = make_link(impl, s, src[i], fin[i])) < 0 ||
+			    (res = make_link(impl, s, fout[i], dst[i])) < 0)
+				goto error;
+		} else {
+			if ((res = make_link(impl, s, src[i], dst[i])) < 0)
+				goto error;
+		}
+
+		/* follow the latency of the device */
+		if (s->port == NULL) {
+			uint32_t ids[] = { SPA_PARAM_Latency };
+
+			s->port = pw_registry_bind(impl->registry, dst[i]->id,
+					PW_TYPE_INTERFACE_Port, PW_VERSION_PORT, 0);
+			if (s->port != NULL) {
+				s->port_id = dst[i]->id;
+				pw_port_add_listener((struct pw_port*)s->port,
+						&s->port_listener, &port_events, s);
+				pw_port_subscribe_params((struct pw_port*)s->port,
+						ids, SPA_N_ELEMENTS(ids));
+			}
+		}
+	}
+	s->linked = true;
+	return 0;
+
+error:
+	pw_log_error("stream %d: can't create link: %s", s->id, spa_strerror(res));
+	unlink_stream(s);
+	return res;
+}
+
+static void update_links(struct impl *impl)
+{
+	struct stream *s;
+
+	if (!impl->link_mode)
+		return;
+
+	spa_list_for_each(s, &impl->streams, link)
+		link_stream(impl, s);
+}
+
 struct stream_info {
 	struct impl *impl;
 	uint32_t id;
@@ -777,6 +1209,7 @@ static int create_stream(struct stream_info *info)
 		}
 		pw_log_info("remap %d -> %d", i, s->remap[i]);
 	}
+	s->n_remap = remap_info.channels;
 
 	str = pw_properties_get(impl->props, PW_KEY_NODE_DESCRIPTION);
 	if (str == NULL)
@@ -798,6 +1231,15 @@ static int create_stream(struct stream_info *info)
 	if (pw_properties_get(info->stream_props, PW_KEY_NODE_NAME) == NULL)
 		pw_properties_setf(info->stream_props, PW_KEY_NODE_NAME,
 				"output.%s_%s", str, node_name);
+
+	if (impl->link_mode) {
+		/* the device is linked to the monitor ports, keep the
+		 * properties for when a delay filter is needed */
+		s->filter_props = info->stream_props;
+		info->stream_props = NULL;
+		goto done;
+	}
+
 	if (pw_properties_get(info->stream_props, PW_KEY_TARGET_OBJECT) == NULL)
 		pw_properties_set(info->stream_props, PW_KEY_TARGET_OBJECT, node_name);
 
@@ -833,7 +1275,9 @@ static int create_stream(struct stream_info *info)
 			direction, PW_ID_ANY, flags, params, n_params)) < 0)
 		goto error;
 
+done:
 	pw_data_loop_invoke(impl->data_loop, do_add_stream, 0, NULL, 0, true, s);
+	update_links(impl);
 	update_delay(impl);
 	return 0;
 
@@ -873,6 +1317,12 @@ static void registry_event_global(void *data, uint32_t id,
 	const char *str;
 	struct stream_info info;
 
+	if (impl->link_mode && spa_streq(type, PW_TYPE_INTERFACE_Port) && props != NULL) {
+		add_port(impl, id, props);
+		update_links(impl);
+		return;
+	}
+
 	if (!spa_streq(type, PW_TYPE_INTERFACE_Node) || props == NULL)
 		return;
 
@@ -901,6 +1351,9 @@ static void registry_event_global_remove(void *data, uint32_t id)
 	struct impl *impl = data;
 	struct stream *s;
 
+	if (impl->link_mode)
+		remove_port(impl, id);
+
 	s = find_stream(impl, id);
 	if (s == NULL)
 		return;
@@ -935,6 +1388,7 @@ static void combine_state_changed(void *d, enum pw_stream_state old,
 		clear_delaybuf(impl);
 		impl->combine_id = pw_stream_get_node_id(impl->combine);
 		pw_log_info("got combine id %d", impl->combine_id);
+		update_links(impl);
 		break;
 	case PW_STREAM_STATE_STREAMING:
 		break;
@@ -1031,6 +1485,7 @@ static void combine_output_process(void *d)
 	struct pw_buffer *in, *out;
 	struct stream *s;
 	bool delay_changed = false;
+	uint32_t filled[SPA_AUDIO_MAX_CHANNELS] = { 0 };
 
 	if ((out = pw_stream_dequeue_buffer(impl->combine)) == NULL) {
 		pw_log_debug("out of buffers: %m");
@@ -1054,31 +1509,33 @@ static void combine_output_process(void *d)
 
 		for (j = 0; j < in->buffer->n_datas; j++) {
 			struct spa_data *ds, *dd;
-			uint32_t outsize = 0, remap;
-			int32_t stride = 0;
+			uint32_t remap;
 
 			ds = &in->buffer->datas[j];
 
-			/* FIXME, need to do mixing for overlapping streams */
 			remap = s->remap[j];
-			if (remap < out->buffer->n_datas) {
+			if (remap < SPA_MIN(out->buffer->n_datas, SPA_AUDIO_MAX_CHANNELS)) {
 				uint32_t offs, size;
+				void *src;
 
 				dd = &out->buffer->datas[remap];
 
 				offs = SPA_MIN(ds->chunk->offset, ds->maxsize);
 				size = SPA_MIN(ds->chunk->size, ds->maxsize - offs);
 				size = SPA_MIN(size, dd->maxsize);
+				src = SPA_PTROFF(ds->data, offs, void);
 
-				ringbuffer_memcpy(&s->delay[j],
-					dd->data, SPA_PTROFF(ds->data, offs, void), size);
+				/* mix streams that map to the same channel */
+				if (filled[remap] == 0)
+					ringbuffer_memcpy(&s->delay[j], dd->data, src, size);
+				else
+					ringbuffer_mix(&s->delay[j], dd->data, filled[remap], src, size);
 
-				outsize = SPA_MAX(outsize, size);
-				stride = SPA_MAX(stride, ds->chunk->stride);
+				filled[remap] = SPA_MAX(filled[remap], size);
 
 				dd->chunk->offset = 0;
-				dd->chunk->size = outsize;
-				dd->chunk->stride = stride;
+				dd->chunk->size = filled[remap];
+				dd->chunk->stride = ds->chunk->stride;
 			}
 		}
 		pw_stream_queue_buffer(s->stream, in);
@@ -1089,11 +1546,43 @@ static void combine_output_process(void *d)
 		pw_loop_signal_event(impl->main_loop, impl->update_delay_event);
 }
 
+static void combine_link_process(void *d)
+{
+	struct impl *impl = d;
+	struct pw_buffer *in;
+	uint32_t quantum = 0;
+
+	/* the devices are fed from the monitor ports, nothing to copy */
+	if ((in = pw_stream_dequeue_buffer(impl->combine)) == NULL) {
+		pw_log_debug("out of buffers: %m");
+		return;
+	}
+	if (in->buffer->n_datas > 0)
+		quantum = in->buffer->datas[0].chunk->size / sizeof(float);
+	pw_stream_queue_buffer(impl->combine, in);
+
+	if (impl->latency_compensate && quantum != impl->quantum) {
+		impl->quantum = quantum;
+		pw_loop_signal_event(impl->main_loop, impl->update_delay_event);
+	}
+}
+
 static void combine_param_changed(void *d, uint32_t id, const struct spa_pod *param)
 {
 	struct impl *impl = d;
 
 	switch (id) {
+	case SPA_PARAM_Format:
+	{
+		struct spa_audio_info_raw info;
+
+		if (param == NULL || spa_format_audio_raw_parse(param, &info) < 0)
+			impl->rate = 0;
+		else
+			impl->rate = info.rate;
+		update_delay(impl);
+		break;
+	}
 	case SPA_PARAM_Props: {
 		int64_t latency_offset;
 		uint8_t buffer[1024];
@@ -1157,7 +1646,8 @@ static int create_combine(struct impl *impl)
 
 	if (impl->mode == MODE_SINK || impl->mode == MODE_CAPTURE) {
 		direction = PW_DIRECTION_INPUT;
-		impl->combine_events.process = combine_input_process;
+		impl->combine_events.process = impl->link_mode ?
+			combine_link_process : combine_input_process;
 	} else {
 		direction = PW_DIRECTION_OUTPUT;
 		impl->combine_events.process = combine_output_process;
@@ -1227,10 +1717,16 @@ static const struct pw_proxy_events core_proxy_events = {
 static void impl_destroy(struct impl *impl)
 {
 	struct stream *s;
+	struct port *p;
 
 	spa_list_consume(s, &impl->streams, link)
 		destroy_stream(s);
 
+	spa_list_consume(p, &impl->ports, link) {
+		spa_list_remove(&p->link);
+		free(p);
+	}
+
 	if (impl->combine)
 		pw_stream_destroy(impl->combine);
 
@@ -1300,6 +1796,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	impl->data_loop = pw_context_get_data_loop(context);
 
 	spa_list_init(&impl->streams);
+	spa_list_init(&impl->ports);
 
 	if (args == NULL)
 		args = "";
@@ -1335,6 +1832,12 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	if ((str = pw_properties_get(props, "combine.latency-compensate")) != NULL)
 		impl->latency_compensate = spa_atob(str);
+	if ((str = pw_properties_get(props, "combine.link-mode")) != NULL)
+		impl->link_mode = spa_atob(str);
+	if (impl->link_mode && impl->mode != MODE_SINK) {
+		pw_log_warn("combine.link-mode needs combine.mode=sink, disabled");
+		impl->link_mode = false;
+	}
 
 	impl->combine_props = pw_properties_new(NULL, NULL);
 	impl->stream_props = pw_properties_new(NULL, NULL);
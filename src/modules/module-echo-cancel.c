@@ -33,7 +33,7 @@
 #include <spa/support/plugin-loader.h>
 #include <spa/interfaces/audio/aec.h>
 
-#include <spa/plugins/audioconvert/wavfile.h>
+#include <spa/plugins/audioconvert/tap.h>
 
 #include <pipewire/impl.h>
 #include <pipewire/pipewire.h>
@@ -237,7 +237,7 @@ struct impl {
 	bool monitor_mode;
 
 	char wav_path[512];
-	struct wav_file *wav_file;
+	struct tap *tap;
 };
 
 static inline void aec_run(struct impl *impl, const float *rec[], const float *play[],
@@ -245,44 +245,62 @@ static inline void aec_run(struct impl *impl, const float *rec[], const float *p
 {
 	spa_audio_aec_run(impl->aec, rec, play, out, n_samples);
 
-	if (SPA_UNLIKELY(impl->wav_path[0])) {
-		if (impl->wav_file == NULL) {
-			struct wav_file_info info;
-
-			spa_zero(info);
-			info.info.media_type = SPA_MEDIA_TYPE_audio;
-			info.info.media_subtype = SPA_MEDIA_SUBTYPE_raw;
-			info.info.info.raw.format = SPA_AUDIO_FORMAT_F32P;
-			info.info.info.raw.rate = impl->rec_info.rate;
-			info.info.info.raw.channels = impl->play_info.channels +
-				impl->rec_info.channels + impl->out_info.channels;
-
-			impl->wav_file = wav_file_open(impl->wav_path,
-					"w", &info);
-			if (impl->wav_file == NULL)
-				pw_log_warn("can't open wav path '%s': %m",
-						impl->wav_path);
-		}
-		if (impl->wav_file) {
-			uint32_t i, n, c = impl->play_info.channels +
-				impl->rec_info.channels + impl->out_info.channels;
-			const float *data[c];
-
-			for (i = n = 0; i < impl->play_info.channels; i++)
-				data[n++] = play[i];
-			for (i = 0; i < impl->rec_info.channels; i++)
-				data[n++] = rec[i];
-			for (i = 0; i < impl->out_info.channels; i++)
-				data[n++] = out[i];
+	if (SPA_UNLIKELY(impl->tap != NULL)) {
+		uint32_t i, n, c = impl->play_info.channels +
+			impl->rec_info.channels + impl->out_info.channels;
+		const float *data[c];
 
-			wav_file_write(impl->wav_file, (void*)data, n_samples);
-		} else {
+		for (i = n = 0; i < impl->play_info.channels; i++)
+			data[n++] = play[i];
+		for (i = 0; i < impl->rec_info.channels; i++)
+			data[n++] = rec[i];
+		for (i = 0; i < impl->out_info.channels; i++)
+			data[n++] = out[i];
+
+		tap_write(impl->tap, (const void**)data, n_samples);
+	}
+}
+
+static int do_set_tap(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	impl->tap = *(struct tap **)data;
+	return 0;
+}
+
+static void set_tap(struct impl *impl, struct tap *tap)
+{
+	struct tap *old = impl->tap;
+
+	pw_data_loop_invoke(pw_context_get_data_loop(impl->context),
+			do_set_tap, 0, &tap, sizeof(tap), true, impl);
+	if (old)
+		tap_destroy(old);
+}
+
+static void update_tap(struct impl *impl)
+{
+	struct tap_info info;
+	struct tap *tap = NULL;
+
+	if (impl->wav_path[0]) {
+		spa_zero(info);
+		info.info.media_type = SPA_MEDIA_TYPE_audio;
+		info.info.media_subtype = SPA_MEDIA_SUBTYPE_raw;
+		info.info.info.raw.format = SPA_AUDIO_FORMAT_F32P;
+		info.info.info.raw.rate = impl->rec_info.rate;
+		info.info.info.raw.channels = impl->play_info.channels +
+			impl->rec_info.channels + impl->out_info.channels;
+		info.format = TAP_FORMAT_WAV;
+
+		if ((tap = tap_new(pw_log_get(), impl->wav_path, &info)) == NULL) {
+			pw_log_warn("can't open wav path '%s': %m", impl->wav_path);
 			spa_zero(impl->wav_path);
 		}
-	} else if (impl->wav_file != NULL) {
-		wav_file_close(impl->wav_file);
-		impl->wav_file = NULL;
 	}
+	if (tap != NULL || impl->tap != NULL)
+		set_tap(impl, tap);
 }
 
 static void process(struct impl *impl)
@@ -667,6 +685,7 @@ static int set_params(struct impl* impl, const struct spa_pod *params)
 		if (spa_streq(name, "debug.aec.wav-path")) {
 			spa_scnprintf(impl->wav_path,
 				sizeof(impl->wav_path), "%s", value);
+			update_tap(impl);
 		}
 	}
 	spa_audio_aec_set_params(impl->aec, params);
@@ -1103,6 +1122,8 @@ static void impl_destroy(struct impl *impl)
 		pw_stream_destroy(impl->playback);
 	if (impl->sink)
 		pw_stream_destroy(impl->sink);
+	if (impl->tap)
+		tap_destroy(impl->tap);
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
 	if (impl->spa_handle)
@@ -31,10 +31,20 @@
  * Because both ends of the loopback are built with streams, the session manager can
  * manage the configuration and connection with the sinks and sources.
  *
+ * A virtual sink or source can also be made with one node, see `loopback.mode`
+ * below. The node has DSP ports on both sides and copies the input ports to the
+ * output ports, the conversion is done by the peer nodes. The side of the node
+ * that is not the virtual device is linked by the module to the `target.object`
+ * of that side. This uses one node and no converters for each loopback.
+ *
  * ## Module Options
  *
  * - `node.description`: a human readable name for the loopback streams
  * - `target.delay.sec`: delay in seconds as float (Since 0.3.60)
+ * - `loopback.mode`: `streams` (default) or `node`. The `node` mode needs
+ *   a capture side with media.class Audio/Sink or a playback side with media.class
+ *   Audio/Source and a `target.object` for the other side. The module falls back
+ *   to streams when this is not the case.
  * - `capture.props = {}`: properties to be passed to the input stream
  * - `playback.props = {}`: properties to be passed to the output stream
  *
@@ -137,6 +147,7 @@ static const struct spa_dict_item module_props[] = {
 				"( audio.channels=<number of channels> ) "
 				"( audio.position=<channel map> ) "
 				"( target.delay.sec=<delay as seconds in float> ) "
+				"( loopback.mode=<streams|node> ) "
 				"( capture.props=<properties> ) "
 				"( playback.props=<properties> ) " },
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
@@ -154,6 +165,30 @@ static const struct spa_dict_item module_props[] = {
 
 #include <pipewire/pipewire.h>
 
+/* for the node mode, the delay line is made for this rate at least */
+#define DELAY_MIN_RATE	48000u
+
+struct port {
+	struct spa_list link;
+	uint32_t id;
+	uint32_t node_id;
+	enum pw_direction direction;
+	uint32_t channel;
+	unsigned int monitor:1;
+};
+
+struct link {
+	struct pw_proxy *proxy;
+	uint32_t output_port;
+	uint32_t input_port;
+};
+
+struct ringbuffer {
+	void *buf;
+	uint32_t idx;
+	uint32_t size;
+};
+
 struct impl {
 	struct pw_context *context;
 
@@ -184,6 +219,37 @@ struct impl {
 	struct spa_ringbuffer buffer;
 	uint8_t *buffer_data;
 	uint32_t buffer_size;
+
+	/* node mode */
+	unsigned int node_mode:1;
+	unsigned int linked:1;
+	struct pw_properties *filter_props;
+	struct pw_filter *filter;
+	struct spa_hook filter_listener;
+	uint32_t filter_id;
+	uint32_t n_channels;
+	void *in_ports[SPA_AUDIO_MAX_CHANNELS];
+	void *out_ports[SPA_AUDIO_MAX_CHANNELS];
+
+	/* the ports of the filter in this direction are linked to the target */
+	enum pw_direction target_direction;
+	struct spa_audio_info_raw target_info;
+	char *target;
+	uint32_t target_id;
+	int target_seq;
+	bool target_ready;
+	bool target_passive;
+
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	struct spa_list ports;
+	struct link links[SPA_AUDIO_MAX_CHANNELS];
+	uint32_t n_links;
+
+	void *delay_data;
+	uint32_t delay_max;		/* bytes per channel */
+	uint32_t delay_rate;
+	struct ringbuffer delay[SPA_AUDIO_MAX_CHANNELS];
 };
 
 static void capture_destroy(void *d)
@@ -487,6 +553,479 @@ static int setup_streams(struct impl *impl)
 	return 0;
 }
 
+static uint32_t channel_from_name(const char *name)
+{
+	int i;
+	for (i = 0; spa_type_audio_channel[i].name; i++) {
+		if (spa_streq(name, spa_debug_type_short_name(spa_type_audio_channel[i].name)))
+			return spa_type_audio_channel[i].type;
+	}
+	return SPA_AUDIO_CHANNEL_UNKNOWN;
+}
+
+static void ringbuffer_memcpy(struct ringbuffer *r, void *dst, void *src, uint32_t size)
+{
+	uint32_t avail;
+
+	avail = SPA_MIN(size, r->size);
+
+	/* buf to dst */
+	if (avail > 0) {
+		spa_ringbuffer_read_data(NULL, r->buf, r->size, r->idx, dst, avail);
+		dst = SPA_PTROFF(dst, avail, void);
+	}
+
+	/* src to dst */
+	if (size > avail) {
+		memcpy(dst, src, size - avail);
+		src = SPA_PTROFF(src, size - avail, void);
+	}
+
+	/* src to buf */
+	if (avail > 0) {
+		spa_ringbuffer_write_data(NULL, r->buf, r->size, r->idx, src, avail);
+		r->idx = (r->idx + avail) % r->size;
+	}
+}
+
+/* The largest rate the graph runs at, the delay line is made for it so
+ * that it does not need to grow on the data thread */
+static uint32_t get_max_rate(struct impl *impl)
+{
+	const struct pw_properties *props = pw_context_get_properties(impl->context);
+	uint32_t rate = SPA_MAX(impl->capture_info.rate, impl->playback_info.rate), r;
+	struct spa_json it[2];
+	const char *str;
+	char v[256];
+
+	rate = SPA_MAX(rate, DELAY_MIN_RATE);
+	if (spa_atou32(pw_properties_get(props, "default.clock.rate"), &r, 0))
+		rate = SPA_MAX(rate, r);
+
+	if ((str = pw_properties_get(props, "default.clock.allowed-rates")) == NULL)
+		return rate;
+
+	spa_json_init(&it[0], str, strlen(str));
+	if (spa_json_enter_array(&it[0], &it[1]) <= 0)
+		spa_json_init(&it[1], str, strlen(str));
+
+	while (spa_json_get_string(&it[1], v, sizeof(v)) > 0) {
+		if (spa_atou32(v, &r, 0))
+			rate = SPA_MAX(rate, r);
+	}
+	return rate;
+}
+
+static void update_delay(struct impl *impl, uint32_t rate)
+{
+	uint32_t i, size;
+
+	size = (uint32_t)(rate * impl->target_delay) * sizeof(float);
+	if (size > impl->delay_max) {
+		pw_log_warn("delay line too small for rate %u, delay shortened to %f",
+				rate, (float)impl->delay_max / sizeof(float) / rate);
+		size = impl->delay_max;
+	}
+	for (i = 0; i < impl->n_channels; i++) {
+		struct ringbuffer *r = &impl->delay[i];
+		r->buf = SPA_PTROFF(impl->delay_data, i * impl->delay_max, void);
+		r->idx = 0;
+		r->size = size;
+		memset(r->buf, 0, size);
+	}
+	impl->delay_rate = rate;
+}
+
+static void filter_process(void *d, struct spa_io_position *position)
+{
+	struct impl *impl = d;
+	uint32_t i, n_samples = position->clock.duration;
+
+	if (impl->delay_data != NULL && impl->delay_rate != position->clock.rate.denom)
+		update_delay(impl, position->clock.rate.denom);
+
+	for (i = 0; i < impl->n_channels; i++) {
+		float *in, *out;
+
+		if (impl->out_ports[i] == NULL ||
+		    (out = pw_filter_get_dsp_buffer(impl->out_ports[i], n_samples)) == NULL)
+			continue;
+
+		in = impl->in_ports[i] ? pw_filter_get_dsp_buffer(impl->in_ports[i], n_samples) : NULL;
+		if (in == NULL)
+			memset(out, 0, n_samples * sizeof(float));
+		else if (impl->delay_data != NULL)
+			ringbuffer_memcpy(&impl->delay[i], out, in, n_samples * sizeof(float));
+		else
+			memcpy(out, in, n_samples * sizeof(float));
+	}
+}
+
+static void update_links(struct impl *impl);
+
+static void filter_destroy(void *d)
+{
+	struct impl *impl = d;
+	spa_hook_remove(&impl->filter_listener);
+	impl->filter = NULL;
+}
+
+static void filter_state_changed(void *d, enum pw_filter_state old,
+		enum pw_filter_state state, const char *error)
+{
+	struct impl *impl = d;
+
+	switch (state) {
+	case PW_FILTER_STATE_PAUSED:
+		impl->filter_id = pw_filter_get_node_id(impl->filter);
+		update_links(impl);
+		break;
+	case PW_FILTER_STATE_UNCONNECTED:
+		pw_log_info("module %p: unconnected", impl);
+		pw_impl_module_schedule_destroy(impl->module);
+		break;
+	case PW_FILTER_STATE_ERROR:
+		pw_log_info("module %p: error: %s", impl, error);
+		break;
+	default:
+		break;
+	}
+}
+
+static const struct pw_filter_events filter_events = {
+	PW_VERSION_FILTER_EVENTS,
+	.destroy = filter_destroy,
+	.state_changed = filter_state_changed,
+	.process = filter_process,
+};
+
+static void unlink_filter(struct impl *impl)
+{
+	uint32_t i;
+
+	for (i = 0; i < impl->n_links; i++)
+		pw_proxy_destroy(impl->links[i].proxy);
+	impl->n_links = 0;
+	impl->linked = false;
+}
+
+/* Find the port of a node for a channel, or else the port at the index.
+ * Monitor ports are only used when no other port matches. */
+static struct port *find_port(struct impl *impl, uint32_t node_id,
+		enum pw_direction direction, uint32_t channel, uint32_t index)
+{
+	struct port *p, *found;
+	uint32_t n, monitor;
+
+	for (monitor = 0; monitor < 2; monitor++) {
+		found = NULL;
+		n = 0;
+		spa_list_for_each(p, &impl->ports, link) {
+			if (p->node_id != node_id || p->direction != direction ||
+			    p->monitor != monitor)
+				continue;
+			if (channel != SPA_AUDIO_CHANNEL_UNKNOWN && p->channel == channel)
+				return p;
+			if (n++ == index)
+				found = p;
+		}
+		if (found != NULL)
+			return found;
+	}
+	return NULL;
+}
+
+static void add_port(struct impl *impl, uint32_t id, const struct spa_dict *props)
+{
+	struct port *p;
+	const char *str;
+
+	if ((str = spa_dict_lookup(props, PW_KEY_NODE_ID)) == NULL)
+		return;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return;
+
+	p->id = id;
+	p->node_id = atoi(str);
+	str = spa_dict_lookup(props, PW_KEY_PORT_DIRECTION);
+	p->direction = spa_streq(str, "out") ? PW_DIRECTION_OUTPUT : PW_DIRECTION_INPUT;
+	str = spa_dict_lookup(props, PW_KEY_AUDIO_CHANNEL);
+	p->channel = str ? channel_from_name(str) : SPA_AUDIO_CHANNEL_UNKNOWN;
+	str = spa_dict_lookup(props, PW_KEY_PORT_MONITOR);
+	p->monitor = str ? spa_atob(str) : false;
+
+	spa_list_append(&impl->ports, &p->link);
+}
+
+static void remove_port(struct impl *impl, uint32_t id)
+{
+	struct port *p;
+	uint32_t i;
+
+	spa_list_for_each(p, &impl->ports, link) {
+		if (p->id == id)
+			break;
+	}
+	if (spa_list_is_end(p, &impl->ports, link))
+		return;
+
+	for (i = 0; i < impl->n_links; i++) {
+		if (impl->links[i].output_port == id || impl->links[i].input_port == id) {
+			unlink_filter(impl);
+			break;
+		}
+	}
+	spa_list_remove(&p->link);
+	free(p);
+}
+
+static int make_link(struct impl *impl, struct port *out, struct port *in)
+{
+	struct pw_properties *props;
+	struct link *l = &impl->links[impl->n_links];
+
+	props = pw_properties_new(NULL, NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props, PW_KEY_LINK_OUTPUT_NODE, "%u", out->node_id);
+	pw_properties_setf(props, PW_KEY_LINK_OUTPUT_PORT, "%u", out->id);
+	pw_properties_setf(props, PW_KEY_LINK_INPUT_NODE, "%u", in->node_id);
+	pw_properties_setf(props, PW_KEY_LINK_INPUT_PORT, "%u", in->id);
+	pw_properties_set(props, PW_KEY_OBJECT_LINGER, "false");
+	if (impl->target_passive)
+		pw_properties_set(props, PW_KEY_LINK_PASSIVE, "true");
+
+	l->proxy = pw_core_create_object(impl->core,
+			"link-factory", PW_TYPE_INTERFACE_Link, PW_VERSION_LINK,
+			&props->dict, 0);
+	pw_properties_free(props);
+
+	if (l->proxy == NULL)
+		return -errno;
+
+	l->output_port = out->id;
+	l->input_port = in->id;
+	impl->n_links++;
+	return 0;
+}
+
+static void update_links(struct impl *impl)
+{
+	struct port *fp[SPA_AUDIO_MAX_CHANNELS], *tp[SPA_AUDIO_MAX_CHANNELS];
+	enum pw_direction dir = impl->target_direction;
+	uint32_t i;
+	int res;
+
+	if (impl->linked || impl->filter_id == 0 || !impl->target_ready)
+		return;
+
+	/* wait until the ports of the filter are known, the ports of the
+	 * target are known when target_ready is set */
+	for (i = 0; i < impl->target_info.channels; i++) {
+		uint32_t channel = impl->target_info.position[i];
+
+		fp[i] = find_port(impl, impl->filter_id, dir, channel, i);
+		tp[i] = find_port(impl, impl->target_id, pw_direction_reverse(dir), channel, i);
+		if (fp[i] == NULL)
+			return;
+	}
+
+	for (i = 0; i < impl->target_info.channels; i++) {
+		if (tp[i] == NULL)
+			continue;
+
+		pw_log_info("module %p: link port %d %s %d", impl, fp[i]->id,
+				dir == PW_DIRECTION_OUTPUT ? "->" : "<-", tp[i]->id);
+
+		if (dir == PW_DIRECTION_OUTPUT)
+			res = make_link(impl, fp[i], tp[i]);
+		else
+			res = make_link(impl, tp[i], fp[i]);
+		if (res < 0) {
+			pw_log_error("module %p: can't create link: %s", impl, spa_strerror(res));
+			unlink_filter(impl);
+			return;
+		}
+	}
+	impl->linked = impl->n_links > 0;
+}
+
+static void registry_event_global(void *data, uint32_t id,
+			uint32_t permissions, const char *type, uint32_t version,
+			const struct spa_dict *props)
+{
+	struct impl *impl = data;
+
+	if (props == NULL)
+		return;
+
+	if (spa_streq(type, PW_TYPE_INTERFACE_Port)) {
+		add_port(impl, id, props);
+		update_links(impl);
+	}
+	else if (spa_streq(type, PW_TYPE_INTERFACE_Node) && impl->target_id == 0) {
+		if (!spa_streq(spa_dict_lookup(props, PW_KEY_NODE_NAME), impl->target) &&
+		    !spa_streq(spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL), impl->target))
+			return;
+		pw_log_info("module %p: target %s is node %d", impl, impl->target, id);
+		impl->target_id = id;
+		/* link when all ports of the target are announced */
+		impl->target_seq = pw_core_sync(impl->core, PW_ID_CORE, impl->target_seq);
+	}
+}
+
+static void registry_event_global_remove(void *data, uint32_t id)
+{
+	struct impl *impl = data;
+
+	if (id == impl->target_id) {
+		pw_log_info("module %p: target %s removed", impl, impl->target);
+		impl->target_id = 0;
+		impl->target_ready = false;
+		unlink_filter(impl);
+		return;
+	}
+	remove_port(impl, id);
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_event_global,
+	.global_remove = registry_event_global_remove,
+};
+
+static int add_ports(struct impl *impl, enum pw_direction direction,
+		const struct spa_audio_info_raw *info, void **ports)
+{
+	uint32_t i;
+
+	for (i = 0; i < info->channels; i++) {
+		const char *str;
+		char name[256];
+
+		str = spa_debug_type_find_short_name(spa_type_audio_channel,
+				info->position[i]);
+		if (str == NULL)
+			str = "UNK";
+
+		snprintf(name, sizeof(name), "%s_%s",
+				direction == PW_DIRECTION_INPUT ? "input" : "output", str);
+		ports[i] = pw_filter_add_port(impl->filter,
+				direction,
+				PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+				pw_properties_new(
+					PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+					PW_KEY_AUDIO_CHANNEL, str,
+					PW_KEY_PORT_NAME, name,
+					NULL), NULL, 0);
+		if (ports[i] == NULL)
+			return -errno;
+	}
+	return 0;
+}
+
+static int setup_filter(struct impl *impl)
+{
+	struct spa_audio_info_raw *in_info, *out_info;
+	int res;
+
+	/* the ports need a channel layout, use the one of the other side or
+	 * stereo */
+	in_info = &impl->capture_info;
+	out_info = &impl->playback_info;
+	if (in_info->channels == 0 && out_info->channels == 0) {
+		in_info->channels = 2;
+		in_info->position[0] = SPA_AUDIO_CHANNEL_FL;
+		in_info->position[1] = SPA_AUDIO_CHANNEL_FR;
+	}
+	if (in_info->channels == 0)
+		*in_info = *out_info;
+	else if (out_info->channels == 0)
+		*out_info = *in_info;
+	impl->n_channels = SPA_MAX(in_info->channels, out_info->channels);
+	impl->target_info = impl->target_direction == PW_DIRECTION_OUTPUT ?
+		*out_info : *in_info;
+
+	if (impl->target_delay > 0.0f) {
+		uint32_t rate = get_max_rate(impl);
+		impl->delay_max = (uint32_t)(rate * impl->target_delay) * sizeof(float);
+		impl->delay_data = calloc(impl->n_channels, impl->delay_max);
+		if (impl->delay_data == NULL) {
+			pw_log_warn("can't allocate delay buffer, delay disabled: %m");
+			impl->delay_max = 0;
+		}
+	}
+
+	impl->filter = pw_filter_new(impl->core, "loopback", impl->filter_props);
+	impl->filter_props = NULL;
+	if (impl->filter == NULL)
+		return -errno;
+
+	pw_filter_add_listener(impl->filter,
+			&impl->filter_listener,
+			&filter_events, impl);
+
+	/* channels that are only on the output side are silent */
+	if ((res = add_ports(impl, PW_DIRECTION_INPUT, in_info, impl->in_ports)) < 0 ||
+	    (res = add_ports(impl, PW_DIRECTION_OUTPUT, out_info, impl->out_ports)) < 0)
+		return res;
+
+	if ((res = pw_filter_connect(impl->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0)) < 0)
+		return res;
+
+	impl->registry = pw_core_get_registry(impl->core, PW_VERSION_REGISTRY, 0);
+	if (impl->registry == NULL)
+		return -errno;
+
+	pw_registry_add_listener(impl->registry, &impl->registry_listener,
+			&registry_events, impl);
+
+	pw_log_info("module %p: %u channels, target %s delay:%f", impl,
+			impl->n_channels, impl->target, impl->target_delay);
+	return 0;
+}
+
+/* Check if the loopback can be made with one node. One side must be a
+ * virtual device, the other side is linked to its target by the module. */
+static int prepare_node_mode(struct impl *impl)
+{
+	struct pw_properties *device, *other;
+	const char *str;
+
+	if (spa_streq(pw_properties_get(impl->capture_props, PW_KEY_MEDIA_CLASS), "Audio/Sink")) {
+		device = impl->capture_props;
+		other = impl->playback_props;
+		impl->target_direction = PW_DIRECTION_OUTPUT;
+	} else if (spa_streq(pw_properties_get(impl->playback_props, PW_KEY_MEDIA_CLASS), "Audio/Source")) {
+		device = impl->playback_props;
+		other = impl->capture_props;
+		impl->target_direction = PW_DIRECTION_INPUT;
+	} else {
+		pw_log_warn("loopback.mode=node needs a virtual Audio/Sink or Audio/Source, "
+				"using streams");
+		return -ENOTSUP;
+	}
+
+	if ((str = pw_properties_get(other, PW_KEY_TARGET_OBJECT)) == NULL &&
+	    (str = pw_properties_get(other, "node.target")) == NULL) {
+		pw_log_warn("loopback.mode=node needs a target.object, using streams");
+		return -ENOTSUP;
+	}
+	if ((impl->target = strdup(str)) == NULL)
+		return -errno;
+
+	impl->target_passive = spa_atob(pw_properties_get(other, PW_KEY_NODE_PASSIVE));
+
+	impl->filter_props = pw_properties_copy(device);
+	if (impl->filter_props == NULL)
+		return -errno;
+
+	return 0;
+}
+
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
 {
 	struct impl *impl = data;
@@ -503,8 +1042,20 @@ static void core_error(void *data, uint32_t id, int seq, int res, const char *me
 		pw_impl_module_schedule_destroy(impl->module);
 }
 
+static void core_done(void *data, uint32_t id, int seq)
+{
+	struct impl *impl = data;
+
+	if (id != PW_ID_CORE || seq != impl->target_seq || impl->target_id == 0)
+		return;
+
+	impl->target_ready = true;
+	update_links(impl);
+}
+
 static const struct pw_core_events core_events = {
 	PW_VERSION_CORE_EVENTS,
+	.done = core_done,
 	.error = core_error,
 };
 
@@ -522,6 +1073,20 @@ static const struct pw_proxy_events core_proxy_events = {
 
 static void impl_destroy(struct impl *impl)
 {
+	struct port *p;
+
+	if (impl->registry) {
+		spa_hook_remove(&impl->registry_listener);
+		pw_proxy_destroy((struct pw_proxy*)impl->registry);
+	}
+	unlink_filter(impl);
+	spa_list_consume(p, &impl->ports, link) {
+		spa_list_remove(&p->link);
+		free(p);
+	}
+	if (impl->filter)
+		pw_filter_destroy(impl->filter);
+
 	/* deactivate both streams before destroying any of them */
 	if (impl->capture)
 		pw_stream_set_active(impl->capture, false);
@@ -538,6 +1103,9 @@ static void impl_destroy(struct impl *impl)
 
 	pw_properties_free(impl->capture_props);
 	pw_properties_free(impl->playback_props);
+	pw_properties_free(impl->filter_props);
+	free(impl->target);
+	free(impl->delay_data);
 	free(impl);
 }
 
@@ -553,16 +1121,6 @@ static const struct pw_impl_module_events module_events = {
 	.destroy = module_destroy,
 };
 
-static uint32_t channel_from_name(const char *name)
-{
-	int i;
-	for (i = 0; spa_type_audio_channel[i].name; i++) {
-		if (spa_streq(name, spa_debug_type_short_name(spa_type_audio_channel[i].name)))
-			return spa_type_audio_channel[i].type;
-	}
-	return SPA_AUDIO_CHANNEL_UNKNOWN;
-}
-
 static void parse_position(struct spa_audio_info_raw *info, const char *val, size_t len)
 {
 	struct spa_json it[2];
@@ -642,6 +1200,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	impl->module = module;
 	impl->context = context;
+	spa_list_init(&impl->ports);
 
 	if (pw_properties_get(props, PW_KEY_NODE_GROUP) == NULL)
 		pw_properties_setf(props, PW_KEY_NODE_GROUP, "loopback-%u-%u", pid, id);
@@ -659,6 +1218,8 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	if ((str = pw_properties_get(props, "target.delay.sec")) != NULL)
 		spa_atof(str, &impl->target_delay);
+	if ((str = pw_properties_get(props, "loopback.mode")) != NULL)
+		impl->node_mode = spa_streq(str, "node");
 	if (impl->target_delay > 0.0f &&
 	    pw_properties_get(props, PW_KEY_NODE_LATENCY) == NULL)
 		/* a source and sink (USB) usually have a 1.5 quantum delay, so we use
@@ -696,6 +1257,9 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	parse_audio_info(impl->capture_props, &impl->capture_info);
 	parse_audio_info(impl->playback_props, &impl->playback_info);
 
+	if (impl->node_mode && prepare_node_mode(impl) < 0)
+		impl->node_mode = false;
+
 	if (pw_properties_get(impl->capture_props, PW_KEY_MEDIA_NAME) == NULL)
 		pw_properties_setf(impl->capture_props, PW_KEY_MEDIA_NAME, "%s input",
 				pw_properties_get(impl->capture_props, PW_KEY_NODE_DESCRIPTION));
@@ -728,7 +1292,12 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 			&impl->core_listener,
 			&core_events, impl);
 
-	setup_streams(impl);
+	if (impl->node_mode)
+		res = setup_filter(impl);
+	else
+		res = setup_streams(impl);
+	if (res < 0)
+		pw_log_error("can't create loopback: %s", spa_strerror(res));
 
 	pw_impl_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
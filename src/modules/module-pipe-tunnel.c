@@ -31,6 +31,8 @@
 #include <pipewire/impl.h>
 #include <pipewire/i18n.h>
 
+#include <module-pipe-tunnel/pipe-io.h>
+
 /** \page page_module_pipe_tunnel PipeWire Module: Unix Pipe Tunnel
  *
  * The pipe-tunnel module provides a source or sink that tunnels all audio to
@@ -40,6 +42,13 @@
  *
  * - `tunnel.mode`: the desired tunnel to create. (Default `playback`)
  * - `pipe.filename`: the filename of the pipe.
+ * - `pipe.mode`: `fifo` or `shm`, the kind of pipe. (Default `fifo`)
+ * - `pipe.size`: the size in bytes of the fifo, 0 keeps the system
+ *                default. (Default 0)
+ * - `pipe.zerocopy`: give the buffer memory to the fifo with vmsplice
+ *                instead of copying. (Default false)
+ * - `pipe.shm.size`: the size in bytes of the shm ring, a power of 2.
+ *                (Default 1048576)
  * - `stream.props`: Extra properties for the local stream.
  *
  * When `tunnel.mode` is `capture`, a capture stream on the default source is
@@ -58,6 +67,29 @@
  * `/tmp/fifo_output` will be created that can be written and read respectively,
  * depending on the selected `tunnel.mode`.
  *
+ * Only whole frames are read from the fifo. A partial frame stays in the
+ * fifo until the writer completes it and a frame that only partially fits
+ * in the fifo is completed on the next write, so that the samples never
+ * get out of alignment.
+ *
+ * With `pipe.zerocopy`, the sink and capture modes don't copy the samples
+ * into the fifo but let the fifo reference the buffer memory. The buffer
+ * is only recycled when the peer has read the samples, so this needs a
+ * peer that read()s the fifo regularly. A peer that splice()s the data out
+ * of the fifo would see the buffer memory change. Make the fifo large
+ * enough to hold a few quanta with `pipe.size`.
+ *
+ * When `pipe.mode` is `shm`, `pipe.filename` is a file that both sides
+ * mmap, by default `/dev/shm/pipewire-pipe-input` or
+ * `/dev/shm/pipewire-pipe-output`. The file starts with a
+ * `struct pipe_shm_header` (see module-pipe-tunnel/pipe-io.h) with the
+ * sample format and a \ref spa_ringbuffer. The ring data starts at
+ * `data_offset`. The writer moves the write index and the reader the read
+ * index, both by whole frames. There are no wakeups, the peer polls the
+ * indexes. Frames that don't fit in the ring are dropped. The first side
+ * to open an empty file creates the ring, the other side must use the same
+ * format.
+ *
  * ## General options
  *
  * Options with well-known behavior.
@@ -105,6 +137,11 @@
 
 #define DEFAULT_CAPTURE_FILENAME	"/tmp/fifo_input"
 #define DEFAULT_PLAYBACK_FILENAME	"/tmp/fifo_output"
+#define DEFAULT_CAPTURE_SHM		"/dev/shm/pipewire-pipe-input"
+#define DEFAULT_PLAYBACK_SHM		"/dev/shm/pipewire-pipe-output"
+#define DEFAULT_SHM_SIZE		(1u<<20)
+
+#define MAX_HELD	8
 
 #define DEFAULT_FORMAT "S16"
 #define DEFAULT_RATE 48000
@@ -125,6 +162,10 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( audio.position=<channel map> ) "			\
 			"( tunnel.mode=capture|playback|sink|source )"		\
 			"( pipe.filename=<filename> )"				\
+			"( pipe.mode=fifo|shm )"				\
+			"( pipe.size=<fifo size in bytes> )"			\
+			"( pipe.zerocopy=<bool> )"				\
+			"( pipe.shm.size=<ring size in bytes> )"		\
 			"( stream.props=<properties> ) "
 
 
@@ -156,6 +197,7 @@ struct impl {
 	char *filename;
 	unsigned int unlink_fifo;
 	int fd;
+	struct pipe_io io;
 
 	struct pw_properties *stream_props;
 	enum pw_direction direction;
@@ -165,8 +207,15 @@ struct impl {
 	uint32_t frame_size;
 
 	unsigned int do_disconnect:1;
-	uint32_t leftover_count;
-	uint8_t *leftover;
+	unsigned int shm:1;
+	unsigned int zerocopy:1;
+
+	/* buffers that are still referenced by the fifo */
+	struct {
+		struct pw_buffer *buf;
+		uint64_t end;
+	} held[MAX_HELD];
+	uint32_t n_held;
 };
 
 static void stream_destroy(void *d)
@@ -194,18 +243,58 @@ static void stream_state_changed(void *d, enum pw_stream_state old,
 	}
 }
 
+static void release_held(struct impl *impl)
+{
+	uint64_t consumed;
+	uint32_t i;
+
+	if (impl->n_held == 0)
+		return;
+
+	consumed = pipe_io_consumed(&impl->io);
+	for (i = 0; i < impl->n_held; i++) {
+		if (impl->held[i].end > consumed)
+			break;
+		pw_stream_queue_buffer(impl->stream, impl->held[i].buf);
+	}
+	impl->n_held -= i;
+	memmove(impl->held, &impl->held[i], impl->n_held * sizeof(impl->held[0]));
+}
+
+static void stream_remove_buffer(void *data, struct pw_buffer *buf)
+{
+	struct impl *impl = data;
+	uint32_t i;
+
+	for (i = 0; i < impl->n_held; i++) {
+		if (impl->held[i].buf != buf)
+			continue;
+		impl->n_held--;
+		memmove(&impl->held[i], &impl->held[i+1],
+				(impl->n_held - i) * sizeof(impl->held[0]));
+		break;
+	}
+}
+
 static void playback_stream_process(void *data)
 {
 	struct impl *impl = data;
 	struct pw_buffer *buf;
 	uint32_t i, size, offs;
-	ssize_t written;
+	uint64_t queued;
+	ssize_t res;
+	bool splice;
+
+	release_held(impl);
 
 	if ((buf = pw_stream_dequeue_buffer(impl->stream)) == NULL) {
 		pw_log_debug("out of buffers: %m");
 		return;
 	}
 
+	splice = impl->zerocopy && impl->n_held < MAX_HELD;
+	queued = impl->io.queued;
+
 	for (i = 0; i < buf->buffer->n_datas; i++) {
 		struct spa_data *d;
 		d = &buf->buffer->datas[i];
@@ -213,24 +302,26 @@ static void playback_stream_process(void *data)
 		offs = SPA_MIN(d->chunk->offset, d->maxsize);
 		size = SPA_MIN(d->chunk->size, d->maxsize - offs);
 
-		while (size > 0) {
-			written = write(impl->fd, SPA_MEMBER(d->data, offs, void), size);
-			if (written < 0) {
-				if (errno == EINTR) {
-					/* retry if interrupted */
-					continue;
-				} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-					/* Don't continue writing */
-					break;
-				} else {
-					pw_log_warn("Failed to write to pipe sink");
-				}
-			}
-			offs += written;
-			size -= written;
+		if (impl->shm) {
+			if (pipe_io_shm_write(&impl->io, SPA_PTROFF(d->data, offs, void), size) < size)
+				pw_log_trace("ring full, dropped %u bytes", size);
+			continue;
 		}
+		if (splice)
+			res = pipe_io_vmsplice(&impl->io, SPA_PTROFF(d->data, offs, void), size);
+		else
+			res = pipe_io_write(&impl->io, SPA_PTROFF(d->data, offs, void), size);
+
+		if (res < 0)
+			pw_log_warn("Failed to write to pipe sink: %s", spa_strerror(res));
+	}
+	if (splice && impl->io.queued != queued) {
+		impl->held[impl->n_held].buf = buf;
+		impl->held[impl->n_held].end = impl->io.queued;
+		impl->n_held++;
+	} else {
+		pw_stream_queue_buffer(impl->stream, buf);
 	}
-	pw_stream_queue_buffer(impl->stream, buf);
 }
 
 static void capture_stream_process(void *data)
@@ -255,27 +346,18 @@ static void capture_stream_process(void *data)
 
 	d->chunk->offset = 0;
 	d->chunk->stride = impl->frame_size;
-	d->chunk->size = SPA_MIN(req, impl->leftover_count);
-	memcpy(d->data, impl->leftover, d->chunk->size);
-	req -= d->chunk->size;
-
-	nread = read(impl->fd, SPA_PTROFF(d->data, d->chunk->size, void), req);
-	if (nread < 0) {
-		const bool important = !(errno == EINTR
-					 || errno == EAGAIN
-					 || errno == EWOULDBLOCK);
-
-		if (important)
-			pw_log_warn("failed to read from pipe (%s): %s",
-				    impl->filename, strerror(errno));
-	}
-	else {
-		d->chunk->size += nread;
-	}
+	d->chunk->size = 0;
+
+	if (impl->shm)
+		nread = pipe_io_shm_read(&impl->io, d->data, req);
+	else
+		nread = pipe_io_read_frames(&impl->io, d->data, req);
 
-	impl->leftover_count = d->chunk->size % impl->frame_size;
-	d->chunk->size -= impl->leftover_count;
-	memcpy(impl->leftover, SPA_PTROFF(d->data, d->chunk->size, void), impl->leftover_count);
+	if (nread < 0)
+		pw_log_warn("failed to read from pipe (%s): %s",
+			    impl->filename, spa_strerror(nread));
+	else
+		d->chunk->size = nread;
 
 	pw_stream_queue_buffer(impl->stream, buf);
 }
@@ -284,6 +366,7 @@ static const struct pw_stream_events playback_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.destroy = stream_destroy,
 	.state_changed = stream_state_changed,
+	.remove_buffer = stream_remove_buffer,
 	.process = playback_stream_process
 };
 
@@ -341,6 +424,7 @@ static int create_fifo(struct impl *impl)
 	const char *filename;
 	bool do_unlink_fifo = false;
 	int fd = -1, res;
+	uint32_t size;
 
 	if ((filename = pw_properties_get(impl->props, "pipe.filename")) == NULL)
 		filename = impl->direction == PW_DIRECTION_INPUT ?
@@ -381,6 +465,10 @@ static int create_fifo(struct impl *impl)
 		pw_log_error("'%s' is not a FIFO.", filename);
 		goto error;
 	}
+	if ((size = pw_properties_get_uint32(impl->props, "pipe.size", 0)) > 0 &&
+	    fcntl(fd, F_SETPIPE_SZ, size) < 0)
+		pw_log_warn("can't set size of '%s' to %u: %m", filename, size);
+
 	pw_log_info("%s fifo '%s' with format:%s channels:%d rate:%d",
 			impl->direction == PW_DIRECTION_OUTPUT ? "reading from" : "writing to",
 			filename,
@@ -390,6 +478,7 @@ static int create_fifo(struct impl *impl)
 	impl->filename = strdup(filename);
 	impl->unlink_fifo = do_unlink_fifo;
 	impl->fd = fd;
+	pipe_io_init(&impl->io, fd, impl->frame_size);
 	return 0;
 
 error:
@@ -400,6 +489,53 @@ error:
 	return res;
 }
 
+static int create_shm(struct impl *impl)
+{
+	const char *filename;
+	bool do_unlink = false;
+	uint32_t size;
+	int fd, res;
+
+	if ((filename = pw_properties_get(impl->props, "pipe.filename")) == NULL)
+		filename = impl->direction == PW_DIRECTION_INPUT ?
+			DEFAULT_CAPTURE_SHM :
+			DEFAULT_PLAYBACK_SHM;
+
+	size = pw_properties_get_uint32(impl->props, "pipe.shm.size", DEFAULT_SHM_SIZE);
+
+	if ((fd = open(filename, O_RDWR | O_CLOEXEC | O_CREAT | O_EXCL, 0666)) >= 0) {
+		if (fchmod(fd, 0666) < 0)
+			pw_log_warn("chmod('%s'): %s", filename, spa_strerror(-errno));
+		do_unlink = true;
+	} else if (errno != EEXIST ||
+	    (fd = open(filename, O_RDWR | O_CLOEXEC, 0)) < 0) {
+		res = -errno;
+		pw_log_error("open('%s'): %s", filename, spa_strerror(res));
+		return res;
+	}
+
+	pipe_io_init(&impl->io, -1, impl->frame_size);
+	res = pipe_io_map_shm(&impl->io, fd, size, impl->info.format,
+			impl->info.rate, impl->info.channels);
+	close(fd);
+	if (res < 0) {
+		pw_log_error("can't map ring '%s' of size %u: %s", filename, size,
+				res == -EMEDIUMTYPE ? "different format" : spa_strerror(res));
+		if (do_unlink)
+			unlink(filename);
+		return res;
+	}
+	pw_log_info("%s shm ring '%s' of size %u with format:%s channels:%d rate:%d",
+			impl->direction == PW_DIRECTION_OUTPUT ? "reading from" : "writing to",
+			filename, impl->io.shm->size,
+			spa_debug_type_find_name(spa_type_audio_format, impl->info.format),
+			impl->info.channels, impl->info.rate);
+
+	impl->filename = strdup(filename);
+	impl->unlink_fifo = do_unlink;
+	return 0;
+}
+
 static void core_error(void *data, uint32_t id, int seq, int res, const char *message)
 {
 	struct impl *impl = data;
@@ -442,11 +578,11 @@ static void impl_destroy(struct impl *impl)
 	}
 	if (impl->fd >= 0)
 		close(impl->fd);
+	pipe_io_unmap_shm(&impl->io);
 
 	pw_properties_free(impl->stream_props);
 	pw_properties_free(impl->props);
 
-	free(impl->leftover);
 	free(impl);
 }
 
@@ -662,12 +798,16 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 
 	copy_props(impl, props, PW_KEY_NODE_RATE);
 
-	impl->leftover = calloc(1, impl->frame_size);
-	if (impl->leftover == NULL) {
-		res = -errno;
-		pw_log_error("can't alloc leftover buffer: %m");
+	if ((str = pw_properties_get(props, "pipe.mode")) == NULL)
+		str = "fifo";
+	if (spa_streq(str, "shm")) {
+		impl->shm = true;
+	} else if (!spa_streq(str, "fifo")) {
+		pw_log_error("invalid pipe.mode '%s'", str);
+		res = -EINVAL;
 		goto error;
 	}
+	impl->zerocopy = pw_properties_get_bool(props, "pipe.zerocopy", false);
 
 	impl->core = pw_context_get_object(impl->context, PW_TYPE_INTERFACE_Core);
 	if (impl->core == NULL) {
@@ -692,7 +832,11 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 			&impl->core_listener,
 			&core_events, impl);
 
-	if ((res = create_fifo(impl)) < 0)
+	if (impl->shm)
+		res = create_shm(impl);
+	else
+		res = create_fifo(impl);
+	if (res < 0)
 		goto error;
 
 	if ((res = create_stream(impl)) < 0)
@@ -0,0 +1,282 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#include <spa/utils/defs.h>
+
+#include <module-pipe-tunnel/pipe-io.h>
+
+/*
+ * Moves TOTAL_BYTES of 64 channel F32 samples, in quanta of QUANTUM frames,
+ * through a pipe with a cat or dd peer and through a shm ring with a reader
+ * thread, in the way module-pipe-tunnel does.
+ */
+
+#define CHANNELS	64
+#define FRAME_SIZE	(CHANNELS * 4)
+#define QUANTUM		1024
+#define QUANTUM_SIZE	(QUANTUM * FRAME_SIZE)
+#define N_BUFFERS	8
+#define PIPE_SIZE	(1u<<20)
+#define SHM_SIZE	(1u<<22)
+#define TOTAL_BYTES	(1ull<<30)
+
+static uint8_t buffers[N_BUFFERS][QUANTUM_SIZE] __attribute__((aligned(4096)));
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *name, uint64_t bytes, uint64_t t)
+{
+	fprintf(stdout, "%-28s %8.1f MB/s %10.1f quanta/s\n", name,
+			bytes * 1e3 / t, bytes * 1e9 / t / QUANTUM_SIZE);
+}
+
+static pid_t spawn(int fd, int target, const char *cmd)
+{
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		dup2(fd, target);
+		execl("/bin/sh", "sh", "-c", cmd, NULL);
+		_exit(127);
+	}
+	return pid;
+}
+
+static int make_pipe(int fds[2], int nonblock_end)
+{
+	if (pipe2(fds, O_CLOEXEC) < 0)
+		return -errno;
+	fcntl(fds[0], F_SETPIPE_SZ, PIPE_SIZE);
+	fcntl(fds[nonblock_end], F_SETFL, O_NONBLOCK);
+	return 0;
+}
+
+static void wait_fd(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	poll(&pfd, 1, -1);
+}
+
+static int bench_write(bool splice)
+{
+	struct pipe_io io;
+	struct {
+		uint8_t *data;
+		uint64_t end;
+	} held[N_BUFFERS];
+	uint32_t n_held = 0, next = 0, i;
+	uint64_t t, sent = 0;
+	int fds[2], status, res;
+	pid_t pid;
+
+	if ((res = make_pipe(fds, 1)) < 0)
+		return res;
+	pid = spawn(fds[0], STDIN_FILENO, "cat > /dev/null");
+	close(fds[0]);
+
+	pipe_io_init(&io, fds[1], FRAME_SIZE);
+
+	t = get_time_ns();
+	while (sent < TOTAL_BYTES) {
+		uint8_t *data;
+		ssize_t r;
+
+		if (splice) {
+			/* recycle the buffers that cat has read */
+			uint64_t consumed = pipe_io_consumed(&io);
+			for (i = 0; i < n_held && held[i].end <= consumed; i++);
+			n_held -= i;
+			memmove(held, &held[i], n_held * sizeof(held[0]));
+			if (n_held == N_BUFFERS) {
+				wait_fd(fds[1], POLLOUT);
+				continue;
+			}
+		}
+		data = buffers[next++ % N_BUFFERS];
+		data[0] = next;
+
+		r = splice ?
+			pipe_io_vmsplice(&io, data, QUANTUM_SIZE) :
+			pipe_io_write(&io, data, QUANTUM_SIZE);
+		if (r < 0) {
+			fprintf(stderr, "write: %s\n", strerror(-r));
+			break;
+		}
+		if (splice && r > 0) {
+			held[n_held].data = data;
+			held[n_held].end = io.queued;
+			n_held++;
+		}
+		sent += r;
+		if (r < QUANTUM_SIZE)
+			wait_fd(fds[1], POLLOUT);
+	}
+	close(fds[1]);
+	waitpid(pid, &status, 0);
+	t = get_time_ns() - t;
+
+	report(splice ? "vmsplice -> cat" : "write -> cat", sent, t);
+	return 0;
+}
+
+static int bench_read(void)
+{
+	struct pipe_io io;
+	uint64_t t, received = 0;
+	int fds[2], status, res;
+	char cmd[256];
+	pid_t pid;
+
+	if ((res = make_pipe(fds, 0)) < 0)
+		return res;
+
+	/* a block size that is not a multiple of the frame size */
+	snprintf(cmd, sizeof(cmd), "dd if=/dev/zero bs=%u count=%llu status=none",
+			FRAME_SIZE * 100 + 7,
+			(unsigned long long)(TOTAL_BYTES / (FRAME_SIZE * 100 + 7)));
+	pid = spawn(fds[1], STDOUT_FILENO, cmd);
+	close(fds[1]);
+
+	pipe_io_init(&io, fds[0], FRAME_SIZE);
+
+	t = get_time_ns();
+	while (true) {
+		ssize_t r = pipe_io_read_frames(&io, buffers[0], QUANTUM_SIZE);
+		if (r < 0) {
+			fprintf(stderr, "read: %s\n", strerror(-r));
+			break;
+		}
+		if (r % FRAME_SIZE) {
+			fprintf(stderr, "read a partial frame of %zd bytes\n", r);
+			res = -EIO;
+			break;
+		}
+		received += r;
+		if (r == 0) {
+			struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+			poll(&pfd, 1, -1);
+			if (pfd.revents & POLLHUP) {
+				int avail;
+				if (ioctl(fds[0], FIONREAD, &avail) < 0 || avail < FRAME_SIZE)
+					break;
+			}
+		}
+	}
+	t = get_time_ns() - t;
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+
+	report("dd -> read frames", received, t);
+	return res;
+}
+
+struct shm_reader {
+	struct pipe_io io;
+	uint64_t received;
+	bool done;
+};
+
+static void *shm_read_thread(void *data)
+{
+	struct shm_reader *r = data;
+	static uint8_t buf[QUANTUM_SIZE];
+
+	while (true) {
+		bool done = __atomic_load_n(&r->done, __ATOMIC_ACQUIRE);
+		uint32_t n = pipe_io_shm_read(&r->io, buf, sizeof(buf));
+
+		r->received += n;
+		if (n == 0 && done)
+			break;
+	}
+	return NULL;
+}
+
+static int bench_shm(void)
+{
+	struct pipe_io io;
+	struct shm_reader reader;
+	char path[] = "/tmp/bench-pipe-io-XXXXXX";
+	uint64_t t, sent = 0;
+	pthread_t thread;
+	int fd, res;
+
+	if ((fd = mkstemp(path)) < 0)
+		return -errno;
+	unlink(path);
+
+	pipe_io_init(&io, -1, FRAME_SIZE);
+	pipe_io_init(&reader.io, -1, FRAME_SIZE);
+	reader.received = 0;
+	reader.done = false;
+
+	if ((res = pipe_io_map_shm(&io, fd, SHM_SIZE, 0, 48000, CHANNELS)) < 0 ||
+	    (res = pipe_io_map_shm(&reader.io, fd, 0, 0, 48000, CHANNELS)) < 0) {
+		close(fd);
+		return res;
+	}
+	close(fd);
+
+	pthread_create(&thread, NULL, shm_read_thread, &reader);
+
+	t = get_time_ns();
+	while (sent < TOTAL_BYTES) {
+		uint32_t w = pipe_io_shm_write(&io, buffers[0], QUANTUM_SIZE);
+		sent += w;
+		if (w < QUANTUM_SIZE)
+			sched_yield();
+	}
+	__atomic_store_n(&reader.done, true, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	t = get_time_ns() - t;
+
+	pipe_io_unmap_shm(&reader.io);
+	pipe_io_unmap_shm(&io);
+
+	if (reader.received != sent) {
+		fprintf(stderr, "shm: sent %"PRIu64" received %"PRIu64"\n",
+				sent, reader.received);
+		return -EIO;
+	}
+	report("shm ring -> thread", sent, t);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int res = 0;
+
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stdout, "%u channels F32, %u frames per quantum\n", CHANNELS, QUANTUM);
+
+	if ((res = bench_write(false)) < 0 ||
+	    (res = bench_write(true)) < 0 ||
+	    (res = bench_read()) < 0 ||
+	    (res = bench_shm()) < 0) {
+		fprintf(stderr, "failed: %s\n", strerror(-res));
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
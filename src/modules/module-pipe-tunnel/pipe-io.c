@@ -0,0 +1,256 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <spa/utils/defs.h>
+
+#include <module-pipe-tunnel/pipe-io.h>
+
+void pipe_io_init(struct pipe_io *io, int fd, uint32_t frame_size)
+{
+	spa_zero(*io);
+	io->fd = fd;
+	io->frame_size = frame_size;
+}
+
+/* write the end of the last partial frame, the pipe only ever holds whole
+ * frames after this. */
+static int flush_tail(struct pipe_io *io)
+{
+	ssize_t res;
+
+	while (io->tail_size > 0) {
+		res = write(io->fd, io->tail, io->tail_size);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return 0;
+			return -errno;
+		}
+		io->queued += res;
+		io->tail_size -= res;
+		memmove(io->tail, io->tail + res, io->tail_size);
+	}
+	return 1;
+}
+
+/* the pipe took \a done bytes of \a data, keep the rest of the frame */
+static size_t keep_tail(struct pipe_io *io, const uint8_t *data, size_t done, size_t size)
+{
+	uint32_t part = done % io->frame_size;
+
+	if (part > 0 && done < size) {
+		io->tail_size = SPA_MIN(io->frame_size - part, size - done);
+		memcpy(io->tail, data + done, io->tail_size);
+		done += io->tail_size;
+	}
+	return done;
+}
+
+static ssize_t transfer(struct pipe_io *io, const void *data, size_t size, bool splice)
+{
+	size_t done = 0;
+	ssize_t res;
+	int r;
+
+	if ((r = flush_tail(io)) <= 0)
+		return r;
+
+	while (done < size) {
+		if (splice) {
+			struct iovec iov = {
+				.iov_base = SPA_PTROFF(data, done, void),
+				.iov_len = size - done,
+			};
+			res = vmsplice(io->fd, &iov, 1, SPLICE_F_NONBLOCK);
+		} else {
+			res = write(io->fd, SPA_PTROFF(data, done, void), size - done);
+		}
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			return -errno;
+		}
+		io->queued += res;
+		done += res;
+	}
+	return keep_tail(io, data, done, size);
+}
+
+ssize_t pipe_io_write(struct pipe_io *io, const void *data, size_t size)
+{
+	return transfer(io, data, size, false);
+}
+
+ssize_t pipe_io_vmsplice(struct pipe_io *io, const void *data, size_t size)
+{
+	return transfer(io, data, size, true);
+}
+
+uint64_t pipe_io_consumed(struct pipe_io *io)
+{
+	int avail;
+
+	if (ioctl(io->fd, FIONREAD, &avail) < 0)
+		return 0;
+	return io->queued - SPA_MIN((uint64_t)avail, io->queued);
+}
+
+ssize_t pipe_io_read_frames(struct pipe_io *io, void *data, size_t size)
+{
+	int avail;
+	ssize_t res;
+
+	if (ioctl(io->fd, FIONREAD, &avail) < 0)
+		return -errno;
+
+	size = SPA_ROUND_DOWN(SPA_MIN((size_t)avail, size), io->frame_size);
+	if (size == 0)
+		return 0;
+
+	while ((res = read(io->fd, data, size)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		return -errno;
+	}
+	return res;
+}
+
+static inline bool is_power_of_2(uint32_t v)
+{
+	return v != 0 && (v & (v - 1)) == 0;
+}
+
+static int map_shm(struct pipe_io *io, int fd, uint32_t size,
+		uint32_t format, uint32_t rate, uint32_t channels)
+{
+	struct pipe_shm_header hdr;
+	struct stat st;
+	size_t total;
+	void *mem;
+
+	if (fstat(fd, &st) < 0)
+		return -errno;
+
+	if (st.st_size == 0) {
+		if (!is_power_of_2(size))
+			return -EINVAL;
+
+		spa_zero(hdr);
+		hdr.version = PIPE_SHM_VERSION;
+		hdr.data_offset = PIPE_SHM_DATA_OFFSET;
+		hdr.size = size;
+		hdr.frame_size = io->frame_size;
+		hdr.format = format;
+		hdr.rate = rate;
+		hdr.channels = channels;
+		spa_ringbuffer_init(&hdr.ring);
+
+		if (ftruncate(fd, hdr.data_offset + hdr.size) < 0)
+			return -errno;
+		if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			return errno ? -errno : -EIO;
+
+		/* the magic marks the ring as complete */
+		hdr.magic = PIPE_SHM_MAGIC;
+		if (pwrite(fd, &hdr.magic, sizeof(hdr.magic), 0) != sizeof(hdr.magic))
+			return errno ? -errno : -EIO;
+	} else {
+		if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			return -EINVAL;
+		if (hdr.magic != PIPE_SHM_MAGIC || hdr.version != PIPE_SHM_VERSION ||
+		    hdr.data_offset < sizeof(hdr) ||
+		    !is_power_of_2(hdr.size) ||
+		    (uint64_t)st.st_size < (uint64_t)hdr.data_offset + hdr.size)
+			return -EINVAL;
+		if (hdr.frame_size != io->frame_size || hdr.format != format ||
+		    hdr.rate != rate || hdr.channels != channels)
+			return -EMEDIUMTYPE;
+	}
+
+	total = hdr.data_offset + hdr.size;
+	mem = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		return -errno;
+
+	io->shm = mem;
+	io->shm_size = total;
+	io->shm_data = SPA_PTROFF(mem, hdr.data_offset, uint8_t);
+	return 0;
+}
+
+int pipe_io_map_shm(struct pipe_io *io, int fd, uint32_t size,
+		uint32_t format, uint32_t rate, uint32_t channels)
+{
+	int res;
+
+	/* serialize with a peer that creates the ring at the same time */
+	if (flock(fd, LOCK_EX) < 0)
+		return -errno;
+	res = map_shm(io, fd, size, format, rate, channels);
+	flock(fd, LOCK_UN);
+	return res;
+}
+
+void pipe_io_unmap_shm(struct pipe_io *io)
+{
+	if (io->shm)
+		munmap(io->shm, io->shm_size);
+	io->shm = NULL;
+	io->shm_data = NULL;
+	io->shm_size = 0;
+}
+
+uint32_t pipe_io_shm_write(struct pipe_io *io, const void *data, uint32_t size)
+{
+	struct pipe_shm_header *shm = io->shm;
+	uint32_t index, avail;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&shm->ring, &index);
+	avail = shm->size - SPA_CLAMP(filled, 0, (int32_t)shm->size);
+
+	size = SPA_ROUND_DOWN(SPA_MIN(size, avail), io->frame_size);
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_write_data(&shm->ring, io->shm_data, shm->size,
+			index & (shm->size - 1), data, size);
+	spa_ringbuffer_write_update(&shm->ring, index + size);
+	return size;
+}
+
+uint32_t pipe_io_shm_read(struct pipe_io *io, void *data, uint32_t size)
+{
+	struct pipe_shm_header *shm = io->shm;
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_read_index(&shm->ring, &index);
+	if (filled <= 0)
+		return 0;
+
+	size = SPA_ROUND_DOWN(SPA_MIN(size, (uint32_t)filled), io->frame_size);
+	if (size == 0)
+		return 0;
+
+	spa_ringbuffer_read_data(&shm->ring, io->shm_data, shm->size,
+			index & (shm->size - 1), data, size);
+	spa_ringbuffer_read_update(&shm->ring, index + size);
+	return size;
+}
@@ -0,0 +1,91 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_PIPE_IO_H
+#define PIPEWIRE_PIPE_IO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <spa/utils/ringbuffer.h>
+#include <spa/param/audio/raw.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PIPE_SHM_MAGIC		0x54505750	/* "PWPT" */
+#define PIPE_SHM_VERSION	1
+#define PIPE_SHM_DATA_OFFSET	4096
+
+/**
+ * Header of a shared memory ring. The ring data starts at data_offset
+ * bytes from the start of the file. The writer only updates the write
+ * index, the reader only the read index and both only move them by
+ * whole frames.
+ */
+struct pipe_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t data_offset;
+	uint32_t size;			/**< size of the ring, a power of 2 */
+	uint32_t frame_size;
+	uint32_t format;		/**< enum spa_audio_format */
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t padding[8];
+	struct spa_ringbuffer ring;
+};
+
+struct pipe_io {
+	int fd;
+	uint32_t frame_size;
+
+	/* total bytes given to the pipe */
+	uint64_t queued;
+
+	/* the end of a frame that only partially fit in the pipe */
+	uint32_t tail_size;
+	uint8_t tail[SPA_AUDIO_MAX_CHANNELS * 8];
+
+	struct pipe_shm_header *shm;
+	size_t shm_size;
+	uint8_t *shm_data;
+};
+
+void pipe_io_init(struct pipe_io *io, int fd, uint32_t frame_size);
+
+/** Copy the data into the pipe. Returns the number of bytes taken or
+ * a negative errno. A full pipe drops the remaining frames. */
+ssize_t pipe_io_write(struct pipe_io *io, const void *data, size_t size);
+
+/** Give the pages of \a data to the pipe without copying. The memory must
+ * not change until pipe_io_consumed() is past io->queued. */
+ssize_t pipe_io_vmsplice(struct pipe_io *io, const void *data, size_t size);
+
+/** The number of bytes that the peer has read from the pipe */
+uint64_t pipe_io_consumed(struct pipe_io *io);
+
+/** Read whole frames, at most \a size bytes. A partial frame stays in
+ * the pipe until the peer completes it. */
+ssize_t pipe_io_read_frames(struct pipe_io *io, void *data, size_t size);
+
+/** Map the ring in \a fd. An empty file is initialized with a ring of
+ * \a size bytes, an existing ring must have the same format. */
+int pipe_io_map_shm(struct pipe_io *io, int fd, uint32_t size,
+		uint32_t format, uint32_t rate, uint32_t channels);
+void pipe_io_unmap_shm(struct pipe_io *io);
+
+/** Copy whole frames into the ring. Frames that don't fit are dropped.
+ * Returns the number of bytes written. */
+uint32_t pipe_io_shm_write(struct pipe_io *io, const void *data, uint32_t size);
+
+/** Copy whole frames from the ring, returns the number of bytes read */
+uint32_t pipe_io_shm_read(struct pipe_io *io, void *data, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_PIPE_IO_H */
@@ -50,11 +50,12 @@
 PW_LOG_TOPIC(mod_topic, "mod." NAME);
 #define PW_LOG_TOPIC_DEFAULT mod_topic
 
-#define TMP_BUFFER		(16 * 1024)
+#define TMP_BUFFER		(64 * 1024)
 #define MAX_BUFFER		(8 * 1024 * 1024)
 #define MIN_FLUSH		(16 * 1024)
 #define DEFAULT_IDLE		5
 #define DEFAULT_INTERVAL	1
+#define LINK_INTERVAL		(100 * SPA_NSEC_PER_MSEC)
 
 int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
@@ -163,6 +164,38 @@ static void flush_timeout(void *data, uint64_t expirations)
 		pw_profiler_resource_profile(resource, &p->pod);
 }
 
+static void add_link_blocks(struct spa_pod_builder *b, struct pw_impl_node *node)
+{
+	struct pw_node_target *t;
+	struct pw_impl_port *p;
+	struct pw_impl_port_mix *mix;
+
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		if (t->node == NULL)
+			continue;
+
+		spa_list_for_each(p, &t->node->rt.input_mix, rt.node_link) {
+			spa_list_for_each(mix, &p->rt.mix_list, rt_link) {
+				struct pw_impl_link *l = SPA_CONTAINER_OF(mix,
+						struct pw_impl_link, rt.in_mix);
+				struct pw_impl_link_stats *s = &l->rt.stats;
+
+				spa_pod_builder_prop(b, SPA_PROFILER_linkBlock, 0);
+				spa_pod_builder_add_struct(b,
+					SPA_POD_Int(l->info.id),
+					SPA_POD_Int(l->info.output_node_id),
+					SPA_POD_Int(l->info.output_port_id),
+					SPA_POD_Int(l->info.input_node_id),
+					SPA_POD_Int(l->info.input_port_id),
+					SPA_POD_Long(s->bytes),
+					SPA_POD_Long(s->buffers),
+					SPA_POD_Long(s->mixed),
+					SPA_POD_Int(s->underruns));
+			}
+		}
+	}
+}
+
 static void context_do_profile(void *data, struct pw_impl_node *node)
 {
 	struct impl *impl = data;
@@ -247,6 +280,11 @@ static void context_do_profile(void *data, struct pw_impl_node *node)
 			SPA_POD_Int(na->status),
 			SPA_POD_Fraction(&latency));
 	}
+
+	/* the link counters accumulate, no need to send them every cycle */
+	if (a->signal_time / LINK_INTERVAL != a->prev_signal_time / LINK_INTERVAL)
+		add_link_blocks(&b, node);
+
 	spa_pod_builder_pop(&b, &f[0]);
 
 	if (b.state.offset > sizeof(impl->tmp))
@@ -22,6 +22,7 @@ struct pw_loop;
 struct pw_context;
 struct pw_work_queue;
 struct pw_properties;
+struct props_cache;
 
 struct defs {
 	struct spa_fraction min_req;
@@ -64,6 +65,7 @@ struct impl {
 	struct pw_map modules;
 
 	struct spa_list free_messages;
+	struct props_cache *props_cache;
 	struct defs defs;
 	struct stats stat;
 };
@@ -219,6 +219,7 @@ static void client_event_info(void *data, const struct pw_client_info *info)
 
 	if (changed) {
 		o->this.changed += changed;
+		o->this.generation++;
 		core_sync(o->manager);
 	}
 }
@@ -260,6 +261,7 @@ static void module_event_info(void *data, const struct pw_module_info *info)
 
 	if (changed) {
 		o->this.changed += changed;
+		o->this.generation++;
 		core_sync(o->manager);
 	}
 }
@@ -332,6 +334,7 @@ static void device_event_info(void *data, const struct pw_device_info *info)
 	}
 	if (changed) {
 		o->this.changed += changed;
+		o->this.generation++;
 		core_sync(o->manager);
 	}
 }
@@ -447,6 +450,7 @@ static void node_event_info(void *data, const struct pw_node_info *info)
 	}
 	if (changed) {
 		o->this.changed += changed;
+		o->this.generation++;
 		core_sync(o->manager);
 	}
 }
@@ -72,6 +72,7 @@ struct pw_manager_object {
 	                       const char *message, const char *params, char **response);
 
 	int changed;
+	uint32_t generation;		/**< changes when the info changes */
 	void *info;
 	struct spa_param_info *params;
 	uint32_t n_params;
@@ -643,6 +643,18 @@ int message_put(struct message *m, ...)
 	return 0;
 }
 
+int message_put_raw(struct message *m, const void *data, uint32_t size)
+{
+	if (ensure_size(m, size) > 0)
+		memcpy(m->data + m->length, data, size);
+	m->length += size;
+
+	if (m->length > m->allocated)
+		return -ENOMEM;
+
+	return 0;
+}
+
 int message_dump(enum spa_log_level level, struct message *m)
 {
 	int res;
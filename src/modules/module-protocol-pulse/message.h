@@ -50,6 +50,8 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 void message_free(struct message *msg, bool dequeue, bool destroy);
 int message_get(struct message *m, ...);
 int message_put(struct message *m, ...);
+/** Append already encoded tags */
+int message_put_raw(struct message *m, const void *data, uint32_t size);
 int message_dump(enum spa_log_level level, struct message *m);
 
 #endif /* PULSE_SERVER_MESSAGE_H */
@@ -0,0 +1,281 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pipewire/array.h>
+#include <pipewire/log.h>
+#include <pipewire/pipewire.h>
+
+#include "log.h"
+#include "manager.h"
+#include "message.h"
+#include "props-cache.h"
+
+#define REF_KEY	"props-cache"
+
+struct item {
+	uint64_t serial;		/**< object serial, 0 when unused */
+	uint64_t stamp;			/**< changes every time the item is stored */
+	uint64_t card_serial;
+	uint32_t n_props;
+	uint32_t n_card_props;
+	uint32_t source_size;		/**< flattened props and card props */
+	uint32_t size;			/**< encoded proplist */
+	uint8_t *data;			/**< source followed by the encoded proplist */
+};
+
+struct entry {
+	struct item items[PROPS_CACHE_KIND_MAX];
+};
+
+/* what the client last used, stored on the object of its manager */
+struct ref {
+	struct {
+		uint64_t stamp;
+		uint64_t card_serial;
+		uint32_t generation;
+		uint32_t card_generation;
+	} kinds[PROPS_CACHE_KIND_MAX];
+};
+
+struct props_cache {
+	struct pw_array entries;	/**< struct entry * indexed by object id */
+	uint64_t stamp;
+};
+
+struct props_cache *props_cache_new(void)
+{
+	struct props_cache *cache;
+
+	if ((cache = calloc(1, sizeof(*cache))) == NULL)
+		return NULL;
+
+	pw_array_init(&cache->entries, 64 * sizeof(struct entry *));
+	return cache;
+}
+
+static void entry_free(struct entry *e)
+{
+	uint32_t i;
+	for (i = 0; i < PROPS_CACHE_KIND_MAX; i++)
+		free(e->items[i].data);
+	free(e);
+}
+
+void props_cache_free(struct props_cache *cache)
+{
+	struct entry **e;
+
+	pw_array_for_each(e, &cache->entries) {
+		if (*e)
+			entry_free(*e);
+	}
+	pw_array_clear(&cache->entries);
+	free(cache);
+}
+
+static struct entry *find_entry(struct props_cache *cache, uint32_t id)
+{
+	if (id >= pw_array_get_len(&cache->entries, struct entry *))
+		return NULL;
+	return *pw_array_get_unchecked(&cache->entries, id, struct entry *);
+}
+
+static struct entry *ensure_entry(struct props_cache *cache, uint32_t id)
+{
+	struct entry **e;
+
+	while (id >= pw_array_get_len(&cache->entries, struct entry *)) {
+		if ((e = pw_array_add(&cache->entries, sizeof(struct entry *))) == NULL)
+			return NULL;
+		*e = NULL;
+	}
+	e = pw_array_get_unchecked(&cache->entries, id, struct entry *);
+	if (*e == NULL)
+		*e = calloc(1, sizeof(struct entry));
+	return *e;
+}
+
+static const struct spa_dict *card_props(struct pw_manager_object *card)
+{
+	struct pw_device_info *info = card ? card->info : NULL;
+	return info ? info->props : NULL;
+}
+
+static uint32_t dict_size(const struct spa_dict *dict)
+{
+	const struct spa_dict_item *it;
+	uint32_t size = 0;
+
+	if (dict == NULL)
+		return 0;
+	spa_dict_for_each(it, dict)
+		size += strlen(it->key) + strlen(it->value) + 2;
+	return size;
+}
+
+static uint8_t *dict_flatten(uint8_t *p, const struct spa_dict *dict)
+{
+	const struct spa_dict_item *it;
+	size_t l;
+
+	if (dict == NULL)
+		return p;
+	spa_dict_for_each(it, dict) {
+		l = strlen(it->key) + 1;
+		memcpy(p, it->key, l);
+		p += l;
+		l = strlen(it->value) + 1;
+		memcpy(p, it->value, l);
+		p += l;
+	}
+	return p;
+}
+
+static const uint8_t *dict_match(const uint8_t *p, const uint8_t *end,
+		const struct spa_dict *dict)
+{
+	const struct spa_dict_item *it;
+	size_t l;
+
+	if (dict == NULL)
+		return p;
+	spa_dict_for_each(it, dict) {
+		l = strlen(it->key) + 1;
+		if ((size_t)(end - p) < l || memcmp(p, it->key, l) != 0)
+			return NULL;
+		p += l;
+		l = strlen(it->value) + 1;
+		if ((size_t)(end - p) < l || memcmp(p, it->value, l) != 0)
+			return NULL;
+		p += l;
+	}
+	return p;
+}
+
+static bool item_match(struct item *item, const struct spa_dict *props,
+		const struct spa_dict *cprops)
+{
+	const uint8_t *p = item->data, *end = p + item->source_size;
+
+	if (item->n_props != (props ? props->n_items : 0) ||
+	    item->n_card_props != (cprops ? cprops->n_items : 0))
+		return false;
+	if ((p = dict_match(p, end, props)) == NULL ||
+	    (p = dict_match(p, end, cprops)) == NULL)
+		return false;
+	return p == end;
+}
+
+static void ref_update(struct pw_manager_object *o, enum props_cache_kind kind,
+		struct item *item, struct pw_manager_object *card)
+{
+	struct ref *ref;
+
+	if ((ref = pw_manager_object_add_data(o, REF_KEY, sizeof(struct ref))) == NULL)
+		return;
+	ref->kinds[kind].stamp = item->stamp;
+	ref->kinds[kind].generation = o->generation;
+	ref->kinds[kind].card_serial = card ? card->serial : 0;
+	ref->kinds[kind].card_generation = card ? card->generation : 0;
+}
+
+bool props_cache_put(struct props_cache *cache, struct message *m,
+		enum props_cache_kind kind, struct pw_manager_object *o,
+		const struct spa_dict *props, struct pw_manager_object *card)
+{
+	struct entry *e;
+	struct item *item;
+	struct ref *ref;
+
+	if ((e = find_entry(cache, o->id)) == NULL)
+		return false;
+	item = &e->items[kind];
+	if (item->stamp == 0 || item->serial != o->serial || item->card_serial != (card ? card->serial : 0))
+		return false;
+
+	/* nothing changed for this client since it last used the item */
+	ref = pw_manager_object_get_data(o, REF_KEY);
+	if (ref == NULL ||
+	    ref->kinds[kind].stamp != item->stamp ||
+	    ref->kinds[kind].generation != o->generation ||
+	    ref->kinds[kind].card_serial != item->card_serial ||
+	    ref->kinds[kind].card_generation != (card ? card->generation : 0)) {
+		/* another client stored it or something changed, the
+		 * properties decide */
+		if (!item_match(item, props, card_props(card)))
+			return false;
+		ref_update(o, kind, item, card);
+	}
+	message_put_raw(m, item->data + item->source_size, item->size);
+	return true;
+}
+
+void props_cache_store(struct props_cache *cache, const struct message *m,
+		uint32_t offset, enum props_cache_kind kind, struct pw_manager_object *o,
+		const struct spa_dict *props, struct pw_manager_object *card)
+{
+	const struct spa_dict *cprops = card_props(card);
+	struct entry *e;
+	struct item *item;
+	uint32_t source_size, size;
+	uint8_t *data;
+
+	if (m->length > m->allocated || offset > m->length)
+		return;
+
+	if ((e = ensure_entry(cache, o->id)) == NULL)
+		return;
+	item = &e->items[kind];
+
+	source_size = dict_size(props) + dict_size(cprops);
+	size = m->length - offset;
+	if ((data = realloc(item->data, source_size + size)) == NULL) {
+		free(item->data);
+		spa_zero(*item);
+		return;
+	}
+	dict_flatten(dict_flatten(data, props), cprops);
+	memcpy(data + source_size, m->data + offset, size);
+
+	item->serial = o->serial;
+	item->stamp = ++cache->stamp;
+	item->card_serial = card ? card->serial : 0;
+	item->n_props = props ? props->n_items : 0;
+	item->n_card_props = cprops ? cprops->n_items : 0;
+	item->source_size = source_size;
+	item->size = size;
+	item->data = data;
+
+	ref_update(o, kind, item, card);
+
+	pw_log_trace("%p: stored id:%u serial:%"PRIu64" kind:%u size:%u",
+			cache, o->id, o->serial, kind, size);
+}
+
+void props_cache_remove(struct props_cache *cache, struct pw_manager_object *o)
+{
+	struct entry *e;
+	uint32_t i;
+
+	if ((e = find_entry(cache, o->id)) == NULL)
+		return;
+
+	/* the id could already be in use by a new object */
+	for (i = 0; i < PROPS_CACHE_KIND_MAX; i++) {
+		if (e->items[i].serial == o->serial) {
+			free(e->items[i].data);
+			spa_zero(e->items[i]);
+		}
+	}
+	for (i = 0; i < PROPS_CACHE_KIND_MAX; i++) {
+		if (e->items[i].serial != 0)
+			return;
+	}
+	entry_free(e);
+	*pw_array_get_unchecked(&cache->entries, o->id, struct entry *) = NULL;
+}
@@ -0,0 +1,56 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PULSE_SERVER_PROPS_CACHE_H
+#define PULSE_SERVER_PROPS_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <spa/utils/dict.h>
+
+struct message;
+struct pw_manager_object;
+
+enum props_cache_kind {
+	PROPS_CACHE_CLIENT,
+	PROPS_CACHE_MODULE,
+	PROPS_CACHE_CARD,
+	PROPS_CACHE_SINK,
+	PROPS_CACHE_SOURCE,
+	PROPS_CACHE_MONITOR,
+	PROPS_CACHE_SINK_INPUT,
+	PROPS_CACHE_SOURCE_OUTPUT,
+	PROPS_CACHE_KIND_MAX,
+};
+
+/**
+ * Cache of the encoded proplists of the introspection replies.
+ *
+ * Every client has its own manager and its own copy of the objects, the
+ * cache is shared and keyed by the object serial. An entry is reused when
+ * the object (and card) did not change in the manager of the client since
+ * the client last used it, or else when the properties are still the same
+ * as the ones the entry was encoded from.
+ */
+struct props_cache;
+
+struct props_cache *props_cache_new(void);
+void props_cache_free(struct props_cache *cache);
+
+/** Append the cached proplist of \a o to \a m. Returns false when there is
+ * no valid entry, the caller then writes the proplist and stores it with
+ * props_cache_store(). */
+bool props_cache_put(struct props_cache *cache, struct message *m,
+		enum props_cache_kind kind, struct pw_manager_object *o,
+		const struct spa_dict *props, struct pw_manager_object *card);
+
+void props_cache_store(struct props_cache *cache, const struct message *m,
+		uint32_t offset, enum props_cache_kind kind, struct pw_manager_object *o,
+		const struct spa_dict *props, struct pw_manager_object *card);
+
+/** Drop the entries of an object that was removed */
+void props_cache_remove(struct props_cache *cache, struct pw_manager_object *o);
+
+#endif /* PULSE_SERVER_PROPS_CACHE_H */
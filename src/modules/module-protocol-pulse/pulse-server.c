@@ -47,6 +47,7 @@
 #include "module.h"
 #include "operation.h"
 #include "pending-sample.h"
+#include "props-cache.h"
 #include "quirks.h"
 #include "reply.h"
 #include "sample.h"
@@ -893,6 +894,8 @@ static void manager_removed(void *data, struct pw_manager_object *o)
 
 	send_object_event(client, o, SUBSCRIPTION_EVENT_REMOVE);
 
+	props_cache_remove(client->impl->props_cache, o);
+
 	send_default_change_subscribe_event(client, pw_manager_object_is_sink(o), pw_manager_object_is_source_or_monitor(o));
 
 	if (spa_streq(o->type, PW_TYPE_INTERFACE_Metadata)) {
@@ -3388,6 +3391,38 @@ static int do_drain_stream(struct client *client, uint32_t command, uint32_t tag
 	return 0;
 }
 
+static int put_proplist(struct client *client, struct message *m,
+		enum props_cache_kind kind, struct pw_manager_object *o,
+		const struct spa_dict *props, struct pw_manager_object *card)
+{
+	struct impl *impl = client->impl;
+	struct pw_device_info *card_info = card ? card->info : NULL;
+	struct pw_properties *merged = NULL;
+	uint32_t offset = m->length;
+
+	if (props_cache_put(impl->props_cache, m, kind, o, props, card))
+		return 0;
+
+	if ((card_info && card_info->props) || kind == PROPS_CACHE_MONITOR) {
+		merged = pw_properties_new_dict(props);
+		if (merged == NULL)
+			return -ENOMEM;
+
+		if (card_info && card_info->props)
+			pw_properties_add(merged, card_info->props);
+
+		if (kind == PROPS_CACHE_MONITOR)
+			pw_properties_set(merged, PW_KEY_DEVICE_CLASS, "monitor");
+	}
+	message_put(m, TAG_PROPLIST, merged ? &merged->dict : props, TAG_INVALID);
+
+	pw_properties_free(merged);
+
+	props_cache_store(impl->props_cache, m, offset, kind, o, props, card);
+
+	return 0;
+}
+
 static int fill_client_info(struct client *client, struct message *m,
 		struct pw_manager_object *o)
 {
@@ -3408,11 +3443,8 @@ static int fill_client_info(struct client *client, struct message *m,
 		TAG_U32, id_to_index(manager, module_id),	/* module index */
 		TAG_STRING, "PipeWire",				/* driver */
 		TAG_INVALID);
-	if (client->version >= 13) {
-		message_put(m,
-			TAG_PROPLIST, info->props,
-			TAG_INVALID);
-	}
+	if (client->version >= 13)
+		put_proplist(client, m, PROPS_CACHE_CLIENT, o, info->props, NULL);
 	return 0;
 }
 
@@ -3436,11 +3468,8 @@ static int fill_module_info(struct client *client, struct message *m,
 			TAG_BOOLEAN, false,		/* auto unload deprecated */
 			TAG_INVALID);
 	}
-	if (client->version >= 15) {
-		message_put(m,
-			TAG_PROPLIST, info->props,
-			TAG_INVALID);
-	}
+	if (client->version >= 15)
+		put_proplist(client, m, PROPS_CACHE_MODULE, o, info->props, NULL);
 	return 0;
 }
 
@@ -3565,8 +3594,8 @@ static int fill_card_info(struct client *client, struct message *m,
 	}
 	message_put(m,
 		TAG_STRING, card_info.active_profile_name,	/* active profile name */
-		TAG_PROPLIST, info->props,
 		TAG_INVALID);
+	put_proplist(client, m, PROPS_CACHE_CARD, o, info->props, NULL);
 
 	if (client->version >= 26) {
 		uint32_t n_ports;
@@ -3645,27 +3674,6 @@ static int fill_card_info(struct client *client, struct message *m,
 	return 0;
 }
 
-static int fill_sink_info_proplist(struct message *m, const struct spa_dict *sink_props,
-		const struct pw_manager_object *card)
-{
-	struct pw_device_info *card_info = card ? card->info : NULL;
-	struct pw_properties *props = NULL;
-
-	if (card_info && card_info->props) {
-		props = pw_properties_new_dict(sink_props);
-		if (props == NULL)
-			return -ENOMEM;
-
-		pw_properties_add(props, card_info->props);
-		sink_props = &props->dict;
-	}
-	message_put(m, TAG_PROPLIST, sink_props, TAG_INVALID);
-
-	pw_properties_free(props);
-
-	return 0;
-}
-
 static bool validate_device_info(struct device_info *dev_info)
 {
 	return sample_spec_valid(&dev_info->ss) &&
@@ -3764,7 +3772,7 @@ static int fill_sink_info(struct client *client, struct message *m,
 
 	if (client->version >= 13) {
 		int res;
-		if ((res = fill_sink_info_proplist(m, info->props, card)) < 0)
+		if ((res = put_proplist(client, m, PROPS_CACHE_SINK, o, info->props, card)) < 0)
 			return res;
 		message_put(m,
 			TAG_USEC, 0LL,			/* requested latency */
@@ -3855,32 +3863,6 @@ static int fill_sink_info(struct client *client, struct message *m,
 	return 0;
 }
 
-static int fill_source_info_proplist(struct message *m, const struct spa_dict *source_props,
-		const struct pw_manager_object *card, const bool is_monitor)
-{
-	struct pw_device_info *card_info = card ? card->info : NULL;
-	struct pw_properties *props = NULL;
-
-	if ((card_info && card_info->props) || is_monitor) {
-		props = pw_properties_new_dict(source_props);
-		if (props == NULL)
-			return -ENOMEM;
-
-		if (card_info && card_info->props)
-			pw_properties_add(props, card_info->props);
-
-		if (is_monitor)
-			pw_properties_set(props, PW_KEY_DEVICE_CLASS, "monitor");
-
-		source_props = &props->dict;
-	}
-	message_put(m, TAG_PROPLIST, source_props, TAG_INVALID);
-
-	pw_properties_free(props);
-
-	return 0;
-}
-
 static int fill_source_info(struct client *client, struct message *m,
 		struct pw_manager_object *o)
 {
@@ -3975,7 +3957,9 @@ static int fill_source_info(struct client *client, struct message *m,
 
 	if (client->version >= 13) {
 		int res;
-		if ((res = fill_source_info_proplist(m, info->props, card, is_monitor)) < 0)
+		if ((res = put_proplist(client, m,
+				is_monitor ? PROPS_CACHE_MONITOR : PROPS_CACHE_SOURCE,
+				o, info->props, card)) < 0)
 			return res;
 		message_put(m,
 			TAG_USEC, 0LL,			/* requested latency */
@@ -4109,9 +4093,7 @@ static int fill_sink_input_info(struct client *client, struct message *m,
 			TAG_BOOLEAN, dev_info.volume_info.mute,	/* muted */
 			TAG_INVALID);
 	if (client->version >= 13)
-		message_put(m,
-			TAG_PROPLIST, info->props,
-			TAG_INVALID);
+		put_proplist(client, m, PROPS_CACHE_SINK_INPUT, o, info->props, NULL);
 	if (client->version >= 19)
 		message_put(m,
 			TAG_BOOLEAN, info->state != PW_NODE_STATE_RUNNING,		/* corked */
@@ -4185,9 +4167,7 @@ static int fill_source_output_info(struct client *client, struct message *m,
 		TAG_STRING, "PipeWire",			/* driver */
 		TAG_INVALID);
 	if (client->version >= 13)
-		message_put(m,
-			TAG_PROPLIST, info->props,
-			TAG_INVALID);
+		put_proplist(client, m, PROPS_CACHE_SOURCE_OUTPUT, o, info->props, NULL);
 	if (client->version >= 19)
 		message_put(m,
 			TAG_BOOLEAN, info->state != PW_NODE_STATE_RUNNING,		/* corked */
@@ -5382,6 +5362,11 @@ static void impl_clear(struct impl *impl)
 	pw_map_for_each(&impl->samples, impl_free_sample, impl);
 	pw_map_clear(&impl->samples);
 
+	if (impl->props_cache) {
+		props_cache_free(impl->props_cache);
+		impl->props_cache = NULL;
+	}
+
 	spa_hook_list_clean(&impl->hooks);
 
 #ifdef HAVE_DBUS
@@ -5539,6 +5524,9 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	spa_list_init(&impl->cleanup_clients);
 	spa_list_init(&impl->free_messages);
 
+	if ((impl->props_cache = props_cache_new()) == NULL)
+		goto error_free;
+
 	str = pw_properties_get(props, "server.address");
 	if (str == NULL) {
 		pw_properties_setf(props, "server.address",
@@ -0,0 +1,254 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/dict.h>
+#include <spa/utils/string.h>
+
+#include <pipewire/pipewire.h>
+
+#include "internal.h"
+#include "manager.h"
+#include "message.h"
+#include "props-cache.h"
+
+#define NAME "protocol-pulse"
+PW_LOG_TOPIC(mod_topic, "mod." NAME);
+PW_LOG_TOPIC(pulse_conn, "conn." NAME);
+
+#define MAX_ITEMS	8
+
+/*
+ * Every client has its own manager with its own copy of the objects. The
+ * cache only keeps data on the objects, so the objects here are not in a
+ * manager and keep the data themselves.
+ */
+struct object {
+	struct pw_manager_object this;
+	struct pw_device_info info;
+	struct spa_dict_item items[MAX_ITEMS];
+	struct spa_dict props;
+	void *data;
+	size_t size;
+};
+
+void *pw_manager_object_add_data(struct pw_manager_object *obj, const char *key, size_t size)
+{
+	struct object *o = SPA_CONTAINER_OF(obj, struct object, this);
+
+	spa_assert_se(spa_streq(key, "props-cache"));
+	if (o->data == NULL || o->size != size) {
+		free(o->data);
+		o->data = calloc(1, size);
+		o->size = size;
+	}
+	return o->data;
+}
+
+void *pw_manager_object_get_data(struct pw_manager_object *obj, const char *key)
+{
+	struct object *o = SPA_CONTAINER_OF(obj, struct object, this);
+
+	spa_assert_se(spa_streq(key, "props-cache"));
+	return o->data;
+}
+
+static struct impl impl;
+
+static void object_init(struct object *o, uint32_t id, uint64_t serial,
+		const char *name, const char *description)
+{
+	spa_zero(*o);
+	o->this.id = id;
+	o->this.serial = serial;
+	o->this.generation = 1;
+	o->items[0] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NAME, name);
+	o->items[1] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_DESCRIPTION, description);
+	o->items[2] = SPA_DICT_ITEM_INIT(PW_KEY_MEDIA_CLASS, "Audio/Sink");
+	o->props = SPA_DICT_INIT(o->items, 3);
+	o->info.props = &o->props;
+	o->this.info = &o->info;
+}
+
+static void object_clear(struct object *o)
+{
+	free(o->data);
+	o->data = NULL;
+}
+
+/* what the client would see without the cache */
+static struct message *encode(struct object *o, struct object *card)
+{
+	struct spa_dict_item items[MAX_ITEMS * 2];
+	struct spa_dict dict;
+	struct message *m;
+	uint32_t i, n_items = 0;
+
+	for (i = 0; i < o->props.n_items; i++)
+		items[n_items++] = o->props.items[i];
+	for (i = 0; card && i < card->props.n_items; i++)
+		items[n_items++] = card->props.items[i];
+	dict = SPA_DICT_INIT(items, n_items);
+
+	spa_assert_se((m = message_alloc(&impl, -1, 0)) != NULL);
+	message_put(m,
+		TAG_U32, o->this.id,
+		TAG_PROPLIST, &dict,
+		TAG_INVALID);
+	return m;
+}
+
+/* the introspection reply, the proplist comes from the cache when it can */
+static struct message *reply(struct object *o, struct object *card, bool *hit)
+{
+	struct message *m, *full;
+	uint32_t offset;
+
+	spa_assert_se((m = message_alloc(&impl, -1, 0)) != NULL);
+	message_put(m, TAG_U32, o->this.id, TAG_INVALID);
+	offset = m->length;
+
+	*hit = props_cache_put(impl.props_cache, m, PROPS_CACHE_SINK, &o->this,
+			&o->props, card ? &card->this : NULL);
+	if (!*hit) {
+		full = encode(o, card);
+		message_put_raw(m, full->data + sizeof(uint8_t) + sizeof(uint32_t),
+				full->length - sizeof(uint8_t) - sizeof(uint32_t));
+		message_free(full, false, true);
+		props_cache_store(impl.props_cache, m, offset, PROPS_CACHE_SINK, &o->this,
+				&o->props, card ? &card->this : NULL);
+	}
+	return m;
+}
+
+static void check_reply(struct object *o, struct object *card, bool expect_hit)
+{
+	struct message *m, *full;
+	bool hit;
+
+	m = reply(o, card, &hit);
+	full = encode(o, card);
+	spa_assert_se(hit == expect_hit);
+	spa_assert_se(m->length == full->length);
+	spa_assert_se(memcmp(m->data, full->data, m->length) == 0);
+	message_free(m, false, true);
+	message_free(full, false, true);
+}
+
+static void test_hit(void)
+{
+	struct object a, b;
+
+	object_init(&a, 40, 400, "sink", "Sink");
+	check_reply(&a, NULL, false);
+	check_reply(&a, NULL, true);
+	check_reply(&a, NULL, true);
+
+	/* the same object in the manager of another client */
+	object_init(&b, 40, 400, "sink", "Sink");
+	b.this.generation = 5;
+	check_reply(&b, NULL, true);
+	check_reply(&a, NULL, true);
+
+	props_cache_remove(impl.props_cache, &a.this);
+	object_clear(&a);
+	object_clear(&b);
+}
+
+static void test_changed(void)
+{
+	struct object a, b;
+
+	object_init(&a, 41, 410, "sink", "Sink");
+	object_init(&b, 41, 410, "sink", "Sink");
+	check_reply(&a, NULL, false);
+	check_reply(&b, NULL, true);
+
+	/* the client sees the new description in the next reply */
+	a.items[1].value = "Renamed Sink";
+	a.this.generation++;
+	check_reply(&a, NULL, false);
+	check_reply(&a, NULL, true);
+
+	/* the other client did not see the change yet */
+	check_reply(&b, NULL, false);
+	/* and the entry it stored is not used for the new properties */
+	check_reply(&a, NULL, false);
+
+	/* a property is added */
+	b.items[1].value = "Renamed Sink";
+	b.items[3] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NICK, "nick");
+	b.props.n_items = 4;
+	b.this.generation++;
+	check_reply(&b, NULL, false);
+	check_reply(&b, NULL, true);
+
+	props_cache_remove(impl.props_cache, &a.this);
+	object_clear(&a);
+	object_clear(&b);
+}
+
+static void test_card(void)
+{
+	struct object a, card;
+
+	object_init(&card, 30, 300, "card", "Card");
+	object_init(&a, 42, 420, "sink", "Sink");
+	check_reply(&a, &card, false);
+	check_reply(&a, &card, true);
+
+	card.items[1].value = "Renamed Card";
+	card.this.generation++;
+	check_reply(&a, &card, false);
+	check_reply(&a, &card, true);
+
+	/* the card is gone */
+	check_reply(&a, NULL, false);
+
+	props_cache_remove(impl.props_cache, &a.this);
+	object_clear(&a);
+	object_clear(&card);
+}
+
+static void test_removed(void)
+{
+	struct object a, b;
+
+	object_init(&a, 43, 430, "sink", "Sink");
+	check_reply(&a, NULL, false);
+	check_reply(&a, NULL, true);
+	props_cache_remove(impl.props_cache, &a.this);
+	check_reply(&a, NULL, false);
+
+	/* a new object with the same id */
+	object_init(&b, 43, 431, "sink", "Sink");
+	check_reply(&b, NULL, false);
+
+	/* removing the old object leaves the new one */
+	props_cache_remove(impl.props_cache, &a.this);
+	check_reply(&b, NULL, true);
+
+	props_cache_remove(impl.props_cache, &b.this);
+	object_clear(&a);
+	object_clear(&b);
+}
+
+int main(int argc, char *argv[])
+{
+	spa_list_init(&impl.free_messages);
+	spa_assert_se((impl.props_cache = props_cache_new()) != NULL);
+
+	test_hit();
+	test_changed();
+	test_card();
+	test_removed();
+
+	props_cache_free(impl.props_cache);
+
+	return 0;
+}
@@ -29,6 +29,8 @@
 
 #include <pipewire/impl.h>
 
+#include <module-protocol-simple/fanout.h>
+
 /** \page page_module_protocol_simple PipeWire Module: Protocol Simple
  *
  * The simple protocol provides a bidirectional audio stream on a network
@@ -37,16 +39,26 @@
  * It is meant to be used with the `simple protocol player` app, available on
  * Android to play and record a stream.
  *
- * Each client that connects will create a capture and/or playback stream,
- * depending on the configuration options.
+ * Each client that connects will create a playback stream and/or receive
+ * the data of the capture stream, depending on the configuration options.
+ *
+ * All clients of a server share one capture stream. The captured data is
+ * kept in a buffer from where it is sent to each client without blocking.
+ * A client that can't keep up falls behind until it lags more than
+ * `capture.backlog`, what happens then is selected with `capture.overrun`.
  *
  * ## Module Options
  *
  *  - `capture`: boolean if capture is enabled. This will create a capture stream
- *               for each connected client.
+ *               that is shared by the connected clients.
  *  - `playback`: boolean if playback is enabled. This will create a playback
  *               stream for each connected client.
  *  - `capture.node`: an optional node serial or name to use for capture.
+ *  - `capture.backlog`: the max amount of capture data in milliseconds that
+ *               a client can lag behind, default 1000.
+ *  - `capture.overrun`: what to do with a client that lags more than the
+ *               backlog, `skip` to skip to the newest data or `disconnect`
+ *               to disconnect the client, default `skip`.
  *  - `playback.node`: an optional node serial or name to use for playback.
  *  - `server.address = []`: an array of server addresses to listen on as
  *                            tcp:(<ip>:)<port>.
@@ -84,6 +96,11 @@
  *         # To make the capture stream capture the monitor ports
  *         #stream.capture.sink = false
  *         #
+ *         # How far in milliseconds a client can lag behind and what
+ *         # to do when it lags more, skip or disconnect
+ *         #capture.backlog = 1000
+ *         #capture.overrun = skip
+ *         #
  *         # The node name or id to use for playback.
  *         #playback.node = null
  *         #
@@ -116,6 +133,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 #define DEFAULT_CHANNELS 2
 #define DEFAULT_POSITION "[ FL FR ]"
 #define DEFAULT_LATENCY "1024/44100"
+#define DEFAULT_BACKLOG 1000
+#define DEFAULT_OVERRUN "skip"
 
 #define MAX_CLIENTS	10
 
@@ -125,6 +144,8 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 			"( node.latency=<num/denom, default:"DEFAULT_LATENCY"> ) "	\
 			"( node.rate=<1/rate, default:1/"SPA_STRINGIFY(DEFAULT_RATE)"> ) "	\
 			"( capture.node=<source-target> ( stream.capture.sink=true )) "	\
+			"( capture.backlog=<msec, default:"SPA_STRINGIFY(DEFAULT_BACKLOG)"> ) "	\
+			"( capture.overrun=<skip|disconnect, default:"DEFAULT_OVERRUN"> ) "	\
 			"( playback.node=<sink-target> ) "				\
 			"( audio.rate=<sample-rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "		\
 			"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "		\
@@ -154,6 +175,9 @@ struct impl {
 
 	struct spa_audio_info_raw info;
 	uint32_t frame_size;
+
+	uint32_t backlog;
+	enum fanout_overrun overrun;
 };
 
 struct client {
@@ -165,10 +189,10 @@ struct client {
         struct spa_hook core_proxy_listener;
 
 	struct spa_source *source;
+	uint32_t mask;
 	char name[128];
 
-	struct pw_stream *capture;
-	struct spa_hook capture_listener;
+	struct fanout_reader reader;
 
 	struct pw_stream *playback;
 	struct spa_hook playback_listener;
@@ -188,9 +212,18 @@ struct server {
 	uint32_t type;
 	struct sockaddr_un addr;
 	struct spa_source *source;
+	char name[512];
 
 	struct spa_list client_list;
 	uint32_t n_clients;
+
+	/* the capture stream, shared by all clients */
+	struct pw_core *core;
+	struct spa_hook core_proxy_listener;
+	struct pw_stream *capture;
+	struct spa_hook capture_listener;
+	struct spa_source *capture_event;
+	struct fanout fanout;
 };
 
 static void client_disconnect(struct client *client)
@@ -206,6 +239,17 @@ static void client_disconnect(struct client *client)
 		pw_loop_destroy_source(impl->loop, client->source);
 }
 
+static void server_stop_capture(struct server *server)
+{
+	if (server->capture)
+		pw_stream_destroy(server->capture);
+	if (server->core) {
+		spa_hook_remove(&server->core_proxy_listener);
+		pw_core_disconnect(server->core);
+		server->core = NULL;
+	}
+}
+
 static void client_free(struct client *client)
 {
 	struct impl *impl = client->impl;
@@ -217,10 +261,9 @@ static void client_free(struct client *client)
 	pw_work_queue_cancel(impl->work_queue, client, SPA_ID_INVALID);
 
 	spa_list_remove(&client->link);
-	client->server->n_clients--;
+	if (--client->server->n_clients == 0)
+		server_stop_capture(client->server);
 
-	if (client->capture)
-		pw_stream_destroy(client->capture);
 	if (client->playback)
 		pw_stream_destroy(client->playback);
 	if (client->core) {
@@ -247,6 +290,38 @@ static void client_cleanup(struct client *client)
 	}
 }
 
+static void client_send(struct client *client)
+{
+	struct impl *impl = client->impl;
+	struct server *server = client->server;
+	uint64_t skipped = client->reader.skipped;
+	bool blocked = client->reader.blocked;
+	ssize_t res;
+
+	if (client->disconnect || client->cleanup)
+		return;
+
+	res = fanout_send(&server->fanout, &client->reader, client->source->fd);
+	if (res < 0) {
+		if (res == -ENOBUFS)
+			pw_log_info("%p: client:%p [%s] lags more than the backlog",
+					impl, client, client->name);
+		else if (res != -EPIPE && res != -ECONNRESET)
+			pw_log_warn("%p: client:%p [%s] send error %zd (%s)", impl,
+					client, client->name, res, spa_strerror(res));
+		client_cleanup(client);
+		return;
+	}
+	if (client->reader.skipped != skipped)
+		pw_log_debug("%p: client:%p [%s] skipped %"PRIu64" bytes", impl,
+				client, client->name, client->reader.skipped - skipped);
+
+	/* wait until the socket can take more data when it was full */
+	if (client->reader.blocked != blocked)
+		pw_loop_update_io(impl->loop, client->source,
+				client->mask | (client->reader.blocked ? SPA_IO_OUT : 0));
+}
+
 static void
 on_client_data(void *data, int fd, uint32_t mask)
 {
@@ -254,6 +329,9 @@ on_client_data(void *data, int fd, uint32_t mask)
 	struct impl *impl = client->impl;
 	int res;
 
+	if (mask & SPA_IO_OUT)
+		client_send(client);
+
 	if (mask & SPA_IO_HUP) {
 		res = -EPIPE;
 		goto error;
@@ -276,16 +354,14 @@ error:
 
 static void capture_process(void *data)
 {
-	struct client *client = data;
-	struct impl *impl = client->impl;
+	struct server *server = data;
+	struct impl *impl = server->impl;
 	struct pw_buffer *buf;
 	struct spa_data *d;
 	uint32_t size, offset;
-	int res;
 
-	if ((buf = pw_stream_dequeue_buffer(client->capture)) == NULL) {
-		pw_log_debug("%p: client:%p [%s] out of capture buffers: %m", impl,
-				client, client->name);
+	if ((buf = pw_stream_dequeue_buffer(server->capture)) == NULL) {
+		pw_log_debug("%p: server:%p out of capture buffers: %m", impl, server);
 		return;
 	}
 	d = &buf->buffer->datas[0];
@@ -293,24 +369,21 @@ static void capture_process(void *data)
 	offset = SPA_MIN(d->chunk->offset, d->maxsize);
 	size = SPA_MIN(d->chunk->size, d->maxsize - offset);
 
-	while (size > 0) {
-		res = send(client->source->fd,
-				SPA_PTROFF(d->data, offset, void),
-				size,
-				MSG_NOSIGNAL | MSG_DONTWAIT);
-		if (res < 0) {
-			if (errno == EINTR)
-				continue;
-			if (errno != EAGAIN && errno != EWOULDBLOCK)
-				pw_log_warn("%p: client:%p [%s] send error %d: %m", impl,
-						client, client->name, res);
-			client_cleanup(client);
-			break;
-		}
-		offset += res;
-		size -= res;
-	}
-	pw_stream_queue_buffer(client->capture, buf);
+	fanout_write(&server->fanout, SPA_PTROFF(d->data, offset, void), size);
+
+	pw_stream_queue_buffer(server->capture, buf);
+
+	/* the clients are served from the main loop */
+	pw_loop_signal_event(impl->loop, server->capture_event);
+}
+
+static void on_capture_event(void *data, uint64_t count)
+{
+	struct server *server = data;
+	struct client *c, *t;
+
+	spa_list_for_each_safe(c, t, &server->client_list, link)
+		client_send(c);
 }
 
 static void playback_process(void *data)
@@ -363,11 +436,39 @@ static void playback_process(void *data)
 	pw_stream_queue_buffer(client->playback, buf);
 }
 
+static void server_cleanup_clients(struct server *server)
+{
+	struct client *c;
+
+	spa_list_for_each(c, &server->client_list, link)
+		client_cleanup(c);
+}
+
 static void capture_destroy(void *data)
 {
-	struct client *client = data;
-	spa_hook_remove(&client->capture_listener);
-	client->capture = NULL;
+	struct server *server = data;
+	spa_hook_remove(&server->capture_listener);
+	server->capture = NULL;
+}
+
+static void on_capture_state_changed(void *data, enum pw_stream_state old,
+                enum pw_stream_state state, const char *error)
+{
+	struct server *server = data;
+	struct impl *impl = server->impl;
+
+	switch (state) {
+	case PW_STREAM_STATE_ERROR:
+	case PW_STREAM_STATE_UNCONNECTED:
+		if (server->n_clients > 0) {
+			pw_log_info("%p: server:%p capture stream error %s",
+					impl, server, pw_stream_state_as_string(state));
+			server_cleanup_clients(server);
+		}
+		break;
+	default:
+		break;
+	}
 }
 
 static void on_stream_state_changed(void *data, enum pw_stream_state old,
@@ -401,7 +502,7 @@ static void playback_destroy(void *data)
 static const struct pw_stream_events capture_stream_events = {
 	PW_VERSION_STREAM_EVENTS,
 	.destroy = capture_destroy,
-	.state_changed = on_stream_state_changed,
+	.state_changed = on_capture_state_changed,
 	.process = capture_process
 };
 
@@ -412,90 +513,147 @@ static const struct pw_stream_events playback_stream_events = {
 	.process = playback_process
 };
 
-static int create_streams(struct impl *impl, struct client *client)
+static const char *get_latency(struct impl *impl)
 {
-	uint32_t n_params;
-	const struct spa_pod *params[1];
-	uint8_t buffer[1024];
-	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
-	struct pw_properties *props;
 	const char *latency;
-	int res;
 
 	if ((latency = pw_properties_get(impl->props, PW_KEY_NODE_LATENCY)) == NULL)
 		latency = DEFAULT_LATENCY;
+	return latency;
+}
 
-	if (impl->capture) {
-		props = pw_properties_new(
-			PW_KEY_NODE_LATENCY, latency,
-			PW_KEY_NODE_RATE, pw_properties_get(impl->props, PW_KEY_NODE_RATE),
-			PW_KEY_TARGET_OBJECT, pw_properties_get(impl->props, "capture.node"),
-			PW_KEY_STREAM_CAPTURE_SINK, pw_properties_get(impl->props,
-				PW_KEY_STREAM_CAPTURE_SINK),
-			PW_KEY_NODE_NETWORK, "true",
+static struct pw_core *connect_core(struct server *server)
+{
+	struct impl *impl = server->impl;
+	struct pw_properties *props;
+
+	props = pw_properties_new(
+			PW_KEY_CLIENT_API, "protocol-simple",
+			PW_KEY_REMOTE_NAME,
+				pw_properties_get(impl->props, PW_KEY_REMOTE_NAME),
 			NULL);
-		if (props == NULL)
-			return -errno;
+	if (props == NULL)
+		return NULL;
 
-		pw_properties_setf(props,
-				PW_KEY_MEDIA_NAME, "%s capture", client->name);
-		client->capture = pw_stream_new(client->core,
-				pw_properties_get(props, PW_KEY_MEDIA_NAME),
-				props);
-		if (client->capture == NULL)
-			return -errno;
+	pw_properties_setf(props,
+			"protocol.server.type", "%s",
+			server->type == SERVER_TYPE_INET ? "tcp" : "unix");
 
-		pw_stream_add_listener(client->capture, &client->capture_listener,
-				&capture_stream_events, client);
-	}
-	if (impl->playback) {
-		props = pw_properties_new(
-			PW_KEY_NODE_LATENCY, latency,
-			PW_KEY_NODE_RATE, pw_properties_get(impl->props, PW_KEY_NODE_RATE),
-			PW_KEY_TARGET_OBJECT, pw_properties_get(impl->props, "playback.node"),
-			PW_KEY_NODE_NETWORK, "true",
-			NULL);
-		if (props == NULL)
-			return -errno;
+	if (server->type == SERVER_TYPE_INET)
+		pw_properties_set(props, PW_KEY_CLIENT_ACCESS, "restricted");
+
+	return pw_context_connect(impl->context, props, 0);
+}
+
+static void on_server_core_proxy_destroy(void *data)
+{
+	struct server *server = data;
+	spa_hook_remove(&server->core_proxy_listener);
+	server->core = NULL;
+	server_cleanup_clients(server);
+}
+
+static const struct pw_proxy_events server_core_proxy_events = {
+	PW_VERSION_CORE_EVENTS,
+	.destroy = on_server_core_proxy_destroy,
+};
+
+static int server_start_capture(struct server *server)
+{
+	struct impl *impl = server->impl;
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct pw_properties *props;
 
-		pw_properties_setf(props,
-				PW_KEY_MEDIA_NAME, "%s playback", client->name);
+	if (server->capture != NULL) {
+		if (server->core != NULL)
+			return 0;
+		/* the connection was lost, start again */
+		pw_stream_destroy(server->capture);
+	}
 
-		client->playback = pw_stream_new(client->core,
-				pw_properties_get(props, PW_KEY_MEDIA_NAME),
-				props);
-		if (client->playback == NULL)
+	if (server->core == NULL) {
+		if ((server->core = connect_core(server)) == NULL)
 			return -errno;
 
-		pw_stream_add_listener(client->playback, &client->playback_listener,
-				&playback_stream_events, client);
+		pw_proxy_add_listener((struct pw_proxy*)server->core,
+				&server->core_proxy_listener, &server_core_proxy_events,
+				server);
 	}
 
-	n_params = 0;
-	params[n_params++] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
+	props = pw_properties_new(
+		PW_KEY_NODE_LATENCY, get_latency(impl),
+		PW_KEY_NODE_RATE, pw_properties_get(impl->props, PW_KEY_NODE_RATE),
+		PW_KEY_TARGET_OBJECT, pw_properties_get(impl->props, "capture.node"),
+		PW_KEY_STREAM_CAPTURE_SINK, pw_properties_get(impl->props,
+			PW_KEY_STREAM_CAPTURE_SINK),
+		PW_KEY_NODE_NETWORK, "true",
+		NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props,
+			PW_KEY_MEDIA_NAME, "%s capture", server->name);
+	server->capture = pw_stream_new(server->core,
+			pw_properties_get(props, PW_KEY_MEDIA_NAME),
+			props);
+	if (server->capture == NULL)
+		return -errno;
+
+	pw_stream_add_listener(server->capture, &server->capture_listener,
+			&capture_stream_events, server);
+
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
 				&impl->info);
 
-	if (impl->capture) {
-		if ((res = pw_stream_connect(client->capture,
-				PW_DIRECTION_INPUT,
-				PW_ID_ANY,
-				PW_STREAM_FLAG_AUTOCONNECT |
-				PW_STREAM_FLAG_MAP_BUFFERS |
-				PW_STREAM_FLAG_RT_PROCESS,
-				params, n_params)) < 0)
-			return res;
-	}
-	if (impl->playback) {
-		if ((res = pw_stream_connect(client->playback,
-				PW_DIRECTION_OUTPUT,
-				PW_ID_ANY,
-				PW_STREAM_FLAG_AUTOCONNECT |
-				PW_STREAM_FLAG_MAP_BUFFERS |
-				PW_STREAM_FLAG_RT_PROCESS,
-				params, n_params)) < 0)
-			return res;
-	}
-	return 0;
+	return pw_stream_connect(server->capture,
+			PW_DIRECTION_INPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1);
+}
+
+static int create_playback(struct impl *impl, struct client *client)
+{
+	const struct spa_pod *params[1];
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct pw_properties *props;
+
+	props = pw_properties_new(
+		PW_KEY_NODE_LATENCY, get_latency(impl),
+		PW_KEY_NODE_RATE, pw_properties_get(impl->props, PW_KEY_NODE_RATE),
+		PW_KEY_TARGET_OBJECT, pw_properties_get(impl->props, "playback.node"),
+		PW_KEY_NODE_NETWORK, "true",
+		NULL);
+	if (props == NULL)
+		return -errno;
+
+	pw_properties_setf(props,
+			PW_KEY_MEDIA_NAME, "%s playback", client->name);
+
+	client->playback = pw_stream_new(client->core,
+			pw_properties_get(props, PW_KEY_MEDIA_NAME),
+			props);
+	if (client->playback == NULL)
+		return -errno;
+
+	pw_stream_add_listener(client->playback, &client->playback_listener,
+			&playback_stream_events, client);
+
+	params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat,
+				&impl->info);
+
+	return pw_stream_connect(client->playback,
+			PW_DIRECTION_OUTPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, 1);
 }
 
 static void on_core_proxy_destroy(void *data)
@@ -518,9 +676,8 @@ on_connect(void *data, int fd, uint32_t mask)
 	struct impl *impl = server->impl;
 	struct sockaddr_in addr;
 	socklen_t addrlen;
-	int client_fd, val;
+	int client_fd, val, res;
 	struct client *client = NULL;
-	struct pw_properties *props = NULL;
 
 	addrlen = sizeof(addr);
 	client_fd = accept4(fd, (struct sockaddr *) &addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
@@ -545,28 +702,18 @@ on_connect(void *data, int fd, uint32_t mask)
 	if (inet_ntop(addr.sin_family, &addr.sin_addr.s_addr, client->name, sizeof(client->name)) == NULL)
 		snprintf(client->name, sizeof(client->name), "client %d", client_fd);
 
+	client->mask = SPA_IO_ERR | SPA_IO_HUP;
 	client->source = pw_loop_add_io(impl->loop,
 					client_fd,
-					SPA_IO_ERR | SPA_IO_HUP,
+					client->mask,
 					true, on_client_data, client);
 	if (client->source == NULL)
 		goto error;
 
 	pw_log_info("%p: client:%p [%s] connected", impl, client, client->name);
 
-	props = pw_properties_new(
-			PW_KEY_CLIENT_API, "protocol-simple",
-			PW_KEY_REMOTE_NAME,
-				pw_properties_get(impl->props, PW_KEY_REMOTE_NAME),
-			NULL);
-	if (props == NULL)
-		goto error;
-
-	pw_properties_setf(props,
-			"protocol.server.type", "%s",
-			server->type == SERVER_TYPE_INET ? "tcp" : "unix");
-
 	if (server->type == SERVER_TYPE_UNIX) {
+		errno = ENOTSUP;
 		goto error;
 	} else if (server->type == SERVER_TYPE_INET) {
 		val = 1;
@@ -578,25 +725,29 @@ on_connect(void *data, int fd, uint32_t mask)
 		if (setsockopt(client_fd, IPPROTO_IP, IP_TOS,
 					(const void *) &val, sizeof(val)) < 0)
 	            pw_log_warn("IP_TOS failed: %m");
-
-		pw_properties_set(props, PW_KEY_CLIENT_ACCESS, "restricted");
 	}
 
-	client->core = pw_context_connect(impl->context, props, 0);
-	props = NULL;
-	if (client->core == NULL)
-		goto error;
-
-	pw_proxy_add_listener((struct pw_proxy*)client->core,
-			&client->core_proxy_listener, &core_proxy_events,
-			client);
+	if (impl->capture) {
+		if ((res = server_start_capture(server)) < 0) {
+			errno = -res;
+			goto error;
+		}
+		fanout_reader_init(&server->fanout, &client->reader);
+	}
+	if (impl->playback) {
+		client->core = connect_core(server);
+		if (client->core == NULL)
+			goto error;
 
-	create_streams(impl, client);
+		pw_proxy_add_listener((struct pw_proxy*)client->core,
+				&client->core_proxy_listener, &core_proxy_events,
+				client);
 
+		create_playback(impl, client);
+	}
 	return;
 error:
 	pw_log_error("%p: failed to create client: %m", impl);
-	pw_properties_free(props);
 	if (client != NULL)
 		client_free(client);
 	return;
@@ -673,8 +824,12 @@ static void server_free(struct server *server)
 	spa_list_remove(&server->link);
 	spa_list_consume(c, &server->client_list, link)
 		client_free(c);
+	server_stop_capture(server);
 	if (server->source)
 		pw_loop_destroy_source(impl->loop, server->source);
+	if (server->capture_event)
+		pw_loop_destroy_source(impl->loop, server->capture_event);
+	fanout_clear(&server->fanout);
 	free(server);
 }
 
@@ -690,6 +845,22 @@ static struct server *create_server(struct impl *impl, const char *address)
 	server->impl = impl;
 	spa_list_init(&server->client_list);
 	spa_list_append(&impl->server_list, &server->link);
+	snprintf(server->name, sizeof(server->name), "%s", address);
+
+	if (impl->capture) {
+		/* the backlog in bytes, from the backlog in msec */
+		uint64_t backlog = (uint64_t)impl->backlog * impl->info.rate / 1000 * impl->frame_size;
+
+		res = fanout_init(&server->fanout, SPA_MIN(backlog, UINT32_MAX / 4),
+				impl->frame_size, impl->overrun);
+		if (res < 0)
+			goto error;
+		server->capture_event = pw_loop_add_event(impl->loop, on_capture_event, server);
+		if (server->capture_event == NULL) {
+			res = -errno;
+			goto error;
+		}
+	}
 
 	if (spa_strstartswith(address, "tcp:")) {
 		fd = make_inet_socket(server, address+4);
@@ -821,6 +992,18 @@ static int parse_params(struct impl *impl)
 	}
 	impl->frame_size *= impl->info.channels;
 
+	impl->backlog = pw_properties_get_uint32(impl->props, "capture.backlog", DEFAULT_BACKLOG);
+	if ((str = pw_properties_get(impl->props, "capture.overrun")) == NULL)
+		str = DEFAULT_OVERRUN;
+	if (spa_streq(str, "skip"))
+		impl->overrun = FANOUT_OVERRUN_SKIP;
+	else if (spa_streq(str, "disconnect"))
+		impl->overrun = FANOUT_OVERRUN_DISCONNECT;
+	else {
+		pw_log_error("invalid capture.overrun '%s'", str);
+		return -EINVAL;
+	}
+
 	if ((str = pw_properties_get(impl->props, "server.address")) == NULL)
 		str = DEFAULT_SERVER;
 
@@ -0,0 +1,139 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <spa/utils/defs.h>
+
+#include <module-protocol-simple/fanout.h>
+
+#define MIN_SIZE	4096u
+
+int fanout_init(struct fanout *f, uint32_t backlog, uint32_t frame_size,
+		enum fanout_overrun overrun)
+{
+	uint32_t size = MIN_SIZE;
+
+	if (frame_size == 0)
+		return -EINVAL;
+
+	spa_zero(*f);
+	backlog = SPA_MAX(SPA_ROUND_DOWN(backlog, frame_size), frame_size);
+	/* the data a reader lags behind must never be overwritten */
+	while (size < backlog * 2) {
+		if (size > UINT32_MAX / 2)
+			return -EINVAL;
+		size *= 2;
+	}
+	if ((f->data = calloc(1, size)) == NULL)
+		return -errno;
+
+	spa_ringbuffer_init(&f->ring);
+	f->size = size;
+	f->backlog = backlog;
+	f->frame_size = frame_size;
+	f->overrun = overrun;
+	return 0;
+}
+
+void fanout_clear(struct fanout *f)
+{
+	free(f->data);
+	f->data = NULL;
+}
+
+uint32_t fanout_write(struct fanout *f, const void *data, uint32_t size)
+{
+	uint32_t index, skip = 0;
+
+	size = SPA_ROUND_DOWN(size, f->frame_size);
+	if (size > f->size) {
+		/* only the newest frames fit */
+		skip = SPA_ROUND_UP(size - f->size, f->frame_size);
+		data = SPA_PTROFF(data, skip, const void);
+		size -= skip;
+	}
+	if (size == 0)
+		return skip;
+
+	spa_ringbuffer_get_write_index(&f->ring, &index);
+	spa_ringbuffer_write_data(&f->ring, f->data, f->size,
+			index & (f->size - 1), data, size);
+	spa_ringbuffer_write_update(&f->ring, index + size);
+
+	return size + skip;
+}
+
+void fanout_reader_init(struct fanout *f, struct fanout_reader *r)
+{
+	spa_zero(*r);
+	spa_ringbuffer_get_write_index(&f->ring, &r->index);
+}
+
+uint32_t fanout_reader_avail(struct fanout *f, struct fanout_reader *r)
+{
+	uint32_t index;
+
+	spa_ringbuffer_get_write_index(&f->ring, &index);
+	return index - r->index;
+}
+
+ssize_t fanout_send(struct fanout *f, struct fanout_reader *r, int fd)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+	uint32_t avail, offset;
+	ssize_t res, total = 0;
+
+	r->blocked = false;
+
+	while ((avail = fanout_reader_avail(f, r)) > 0) {
+		if (avail > f->backlog) {
+			if (f->overrun == FANOUT_OVERRUN_DISCONNECT)
+				return -ENOBUFS;
+			if (r->offset == 0) {
+				/* skip to the newest data, the write index
+				 * is always at the start of a frame */
+				r->index += avail;
+				r->skipped += avail;
+				break;
+			}
+			/* complete the frame before skipping */
+			avail = f->frame_size - r->offset;
+		}
+
+		offset = r->index & (f->size - 1);
+		iov[0].iov_base = SPA_PTROFF(f->data, offset, void);
+		iov[0].iov_len = SPA_MIN(avail, f->size - offset);
+		iov[1].iov_base = f->data;
+		iov[1].iov_len = avail - iov[0].iov_len;
+
+		spa_zero(msg);
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov[1].iov_len > 0 ? 2 : 1;
+
+		res = sendmsg(fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				r->blocked = true;
+				break;
+			}
+			return -errno;
+		}
+		r->index += res;
+		r->offset = (r->offset + res) % f->frame_size;
+		total += res;
+		if ((uint32_t)res < avail) {
+			r->blocked = true;
+			break;
+		}
+	}
+	return total;
+}
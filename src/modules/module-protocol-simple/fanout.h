@@ -0,0 +1,67 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_PROTOCOL_SIMPLE_FANOUT_H
+#define PIPEWIRE_PROTOCOL_SIMPLE_FANOUT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <spa/utils/ringbuffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum fanout_overrun {
+	FANOUT_OVERRUN_SKIP,		/**< skip the reader ahead to the newest data */
+	FANOUT_OVERRUN_DISCONNECT,	/**< fail the reader with -ENOBUFS */
+};
+
+/**
+ * A byte ring with one writer and any number of readers. The writer
+ * never waits for the readers, it overwrites the oldest data. Each
+ * reader has its own read index and must not lag more than the
+ * backlog, which is at most half of the ring.
+ */
+struct fanout {
+	struct spa_ringbuffer ring;
+	uint8_t *data;
+	uint32_t size;			/**< size of the ring, a power of 2 */
+	uint32_t backlog;		/**< max bytes a reader can lag */
+	uint32_t frame_size;
+	enum fanout_overrun overrun;
+};
+
+struct fanout_reader {
+	uint32_t index;
+	uint32_t offset;		/**< offset of the index in the current frame */
+	uint64_t skipped;		/**< total bytes skipped on overrun */
+	unsigned int blocked:1;		/**< the socket was full in the last send */
+};
+
+int fanout_init(struct fanout *f, uint32_t backlog, uint32_t frame_size,
+		enum fanout_overrun overrun);
+void fanout_clear(struct fanout *f);
+
+/** Append the whole frames of \a data to the ring. Does not block and can
+ * be called from the realtime thread. Returns the number of bytes taken. */
+uint32_t fanout_write(struct fanout *f, const void *data, uint32_t size);
+
+/** Make \a r start reading from the newest data */
+void fanout_reader_init(struct fanout *f, struct fanout_reader *r);
+
+/** Number of bytes that \a r still has to read */
+uint32_t fanout_reader_avail(struct fanout *f, struct fanout_reader *r);
+
+/** Send the available data of \a r to the socket \a fd without blocking.
+ * Sets \a r->blocked when the socket could not take everything. Returns
+ * the number of bytes sent or a negative errno. */
+ssize_t fanout_send(struct fanout *f, struct fanout_reader *r, int fd);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* PIPEWIRE_PROTOCOL_SIMPLE_FANOUT_H */
@@ -0,0 +1,339 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#include <module-protocol-simple/fanout.h>
+
+/*
+ * Each frame is a sequence number and its inverse, a frame that is
+ * made from parts of two frames or a skip that is not on a frame
+ * boundary fails the checks.
+ */
+#define FRAME_SIZE	8
+#define QUANTUM		256
+#define N_QUANTA	400
+#define BACKLOG		(4 * QUANTUM * FRAME_SIZE)
+#define SOCK_BUF	4096
+
+struct check {
+	uint32_t seq;		/* the next frame that is written */
+	uint32_t last;		/* the last frame that was received */
+	uint64_t received;
+	uint32_t n_gaps;
+	uint8_t partial[FRAME_SIZE];
+	uint32_t n_partial;
+};
+
+static void write_quantum(struct fanout *f, struct check *c)
+{
+	uint32_t data[QUANTUM * 2], i;
+
+	for (i = 0; i < QUANTUM; i++, c->seq++) {
+		data[2 * i + 0] = c->seq;
+		data[2 * i + 1] = ~c->seq;
+	}
+	spa_assert_se(fanout_write(f, data, sizeof(data)) == sizeof(data));
+}
+
+static void check_frame(struct check *c, const uint8_t *frame)
+{
+	uint32_t v[2];
+
+	memcpy(v, frame, sizeof(v));
+	spa_assert_se(v[0] == ~v[1]);
+	if (c->received > 0) {
+		spa_assert_se(v[0] > c->last);
+		c->n_gaps += v[0] != c->last + 1;
+	}
+	c->last = v[0];
+	c->received += FRAME_SIZE;
+}
+
+/* read what is in the socket without blocking */
+static void drain(int fd, struct check *c)
+{
+	uint8_t buf[4096];
+	ssize_t res, i;
+
+	while (true) {
+		res = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (res == 0 || (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)))
+			break;
+		spa_assert_se(res > 0);
+		for (i = 0; i < res; i++) {
+			c->partial[c->n_partial++] = buf[i];
+			if (c->n_partial == FRAME_SIZE) {
+				check_frame(c, c->partial);
+				c->n_partial = 0;
+			}
+		}
+	}
+}
+
+static void set_buffers(int fd)
+{
+	int val = SOCK_BUF;
+	setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val));
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val));
+}
+
+static void make_unix_pair(int fds[2])
+{
+	spa_assert_se(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) == 0);
+	set_buffers(fds[0]);
+	set_buffers(fds[1]);
+}
+
+static void make_tcp_pair(int fds[2])
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd;
+
+	spa_assert_se((lfd = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+	spa_zero(addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	spa_assert_se(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+	spa_assert_se(listen(lfd, 1) == 0);
+	spa_assert_se(getsockname(lfd, (struct sockaddr*)&addr, &len) == 0);
+
+	spa_assert_se((fds[1] = socket(AF_INET, SOCK_STREAM, 0)) >= 0);
+	set_buffers(fds[1]);
+	spa_assert_se(connect(fds[1], (struct sockaddr*)&addr, sizeof(addr)) == 0);
+	spa_assert_se((fds[0] = accept4(lfd, NULL, NULL, SOCK_NONBLOCK)) >= 0);
+	set_buffers(fds[0]);
+	close(lfd);
+}
+
+/* a reader that keeps up gets all the data */
+static void test_fast(int fds[2])
+{
+	struct fanout f;
+	struct fanout_reader r;
+	struct check c;
+	uint32_t i;
+
+	spa_zero(c);
+	spa_assert_se(fanout_init(&f, BACKLOG, FRAME_SIZE, FANOUT_OVERRUN_SKIP) == 0);
+	fanout_reader_init(&f, &r);
+
+	for (i = 0; i < N_QUANTA; i++) {
+		write_quantum(&f, &c);
+		do {
+			spa_assert_se(fanout_send(&f, &r, fds[0]) >= 0);
+			drain(fds[1], &c);
+		} while (fanout_reader_avail(&f, &r) > 0);
+	}
+	spa_assert_se(r.skipped == 0);
+	spa_assert_se(c.n_gaps == 0);
+	spa_assert_se(c.received == (uint64_t)N_QUANTA * QUANTUM * FRAME_SIZE);
+	spa_assert_se(c.last == c.seq - 1);
+
+	fanout_clear(&f);
+}
+
+/* a reader that doesn't read skips whole frames and gets the newest data */
+static void test_slow(int fds[2])
+{
+	struct fanout f;
+	struct fanout_reader r;
+	struct check c;
+	uint32_t i, n_blocked = 0;
+
+	spa_zero(c);
+	spa_assert_se(fanout_init(&f, BACKLOG, FRAME_SIZE, FANOUT_OVERRUN_SKIP) == 0);
+	fanout_reader_init(&f, &r);
+
+	for (i = 0; i < N_QUANTA; i++) {
+		write_quantum(&f, &c);
+		spa_assert_se(fanout_send(&f, &r, fds[0]) >= 0);
+		n_blocked += r.blocked;
+		spa_assert_se(fanout_reader_avail(&f, &r) <= BACKLOG);
+		/* read a little, now and then */
+		if (i % 16 == 0)
+			drain(fds[1], &c);
+	}
+	spa_assert_se(n_blocked > 0);
+	spa_assert_se(r.skipped > 0);
+	spa_assert_se(r.skipped % FRAME_SIZE == 0);
+
+	do {
+		spa_assert_se(fanout_send(&f, &r, fds[0]) >= 0);
+		drain(fds[1], &c);
+	} while (fanout_reader_avail(&f, &r) > 0 || r.blocked);
+	drain(fds[1], &c);
+
+	spa_assert_se(c.n_gaps > 0);
+	spa_assert_se(c.n_partial == 0);
+	spa_assert_se(c.received + r.skipped == (uint64_t)N_QUANTA * QUANTUM * FRAME_SIZE);
+	spa_assert_se(c.last == c.seq - 1);
+
+	fanout_clear(&f);
+}
+
+static void test_disconnect(int fds[2])
+{
+	struct fanout f;
+	struct fanout_reader r;
+	struct check c;
+	uint32_t i;
+	ssize_t res = 0;
+
+	spa_zero(c);
+	spa_assert_se(fanout_init(&f, BACKLOG, FRAME_SIZE, FANOUT_OVERRUN_DISCONNECT) == 0);
+	fanout_reader_init(&f, &r);
+
+	for (i = 0; i < N_QUANTA && res >= 0; i++) {
+		write_quantum(&f, &c);
+		res = fanout_send(&f, &r, fds[0]);
+	}
+	spa_assert_se(res == -ENOBUFS);
+	spa_assert_se(r.skipped == 0);
+
+	fanout_clear(&f);
+}
+
+/* several readers of one ring, one of them is slow */
+static void test_fanout(void)
+{
+	struct fanout f;
+	struct fanout_reader r[3];
+	struct check w, c[3];
+	int fds[3][2];
+	uint32_t i, j;
+
+	make_unix_pair(fds[0]);
+	make_unix_pair(fds[1]);
+	make_tcp_pair(fds[2]);
+
+	spa_zero(w);
+	spa_assert_se(fanout_init(&f, BACKLOG, FRAME_SIZE, FANOUT_OVERRUN_SKIP) == 0);
+	for (j = 0; j < 3; j++) {
+		spa_zero(c[j]);
+		fanout_reader_init(&f, &r[j]);
+	}
+
+	for (i = 0; i < N_QUANTA; i++) {
+		write_quantum(&f, &w);
+		for (j = 0; j < 3; j++) {
+			spa_assert_se(fanout_send(&f, &r[j], fds[j][0]) >= 0);
+			if (j != 1 || i % 32 == 0)
+				drain(fds[j][1], &c[j]);
+		}
+	}
+	for (j = 0; j < 3; j++) {
+		do {
+			spa_assert_se(fanout_send(&f, &r[j], fds[j][0]) >= 0);
+			drain(fds[j][1], &c[j]);
+		} while (fanout_reader_avail(&f, &r[j]) > 0 || r[j].blocked);
+
+		spa_assert_se(c[j].received + r[j].skipped ==
+				(uint64_t)N_QUANTA * QUANTUM * FRAME_SIZE);
+		spa_assert_se(c[j].last == w.seq - 1);
+		close(fds[j][0]);
+		close(fds[j][1]);
+	}
+	spa_assert_se(r[1].skipped > 0);
+
+	fanout_clear(&f);
+}
+
+/* a writer thread and a reader that is slower than the writer */
+struct thread_data {
+	int fd;
+	struct check c;
+	volatile bool done;
+};
+
+static void *reader_thread(void *data)
+{
+	struct thread_data *d = data;
+	struct timespec ts = { 0, 100000 };
+
+	while (!d->done) {
+		drain(d->fd, &d->c);
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+static void test_thread(int fds[2])
+{
+	struct fanout f;
+	struct fanout_reader r;
+	struct thread_data d;
+	struct timespec ts = { 0, 10000 };
+	pthread_t thread;
+	uint32_t i;
+
+	spa_zero(d);
+	d.fd = fds[1];
+	spa_assert_se(fanout_init(&f, BACKLOG, FRAME_SIZE, FANOUT_OVERRUN_SKIP) == 0);
+	fanout_reader_init(&f, &r);
+	spa_assert_se(pthread_create(&thread, NULL, reader_thread, &d) == 0);
+
+	for (i = 0; i < N_QUANTA * 4; i++) {
+		write_quantum(&f, &d.c);
+		spa_assert_se(fanout_send(&f, &r, fds[0]) >= 0);
+		nanosleep(&ts, NULL);
+	}
+	while (fanout_reader_avail(&f, &r) > 0 || r.blocked) {
+		spa_assert_se(fanout_send(&f, &r, fds[0]) >= 0);
+		nanosleep(&ts, NULL);
+	}
+	shutdown(fds[0], SHUT_WR);
+	d.done = true;
+	pthread_join(thread, NULL);
+	drain(fds[1], &d.c);
+
+	spa_assert_se(d.c.n_partial == 0);
+	spa_assert_se(d.c.received + r.skipped == (uint64_t)N_QUANTA * 4 * QUANTUM * FRAME_SIZE);
+
+	fanout_clear(&f);
+}
+
+static void run(const char *name, void (*func)(int fds[2]), void (*make)(int fds[2]))
+{
+	int fds[2];
+
+	fprintf(stderr, "%s\n", name);
+	make(fds);
+	func(fds);
+	close(fds[0]);
+	close(fds[1]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fanout f;
+
+	spa_assert_se(fanout_init(&f, BACKLOG, 0, FANOUT_OVERRUN_SKIP) == -EINVAL);
+
+	run("unix fast", test_fast, make_unix_pair);
+	run("unix slow", test_slow, make_unix_pair);
+	run("unix disconnect", test_disconnect, make_unix_pair);
+	run("unix thread", test_thread, make_unix_pair);
+	run("tcp fast", test_fast, make_tcp_pair);
+	run("tcp slow", test_slow, make_tcp_pair);
+	run("tcp disconnect", test_disconnect, make_tcp_pair);
+	run("tcp thread", test_thread, make_tcp_pair);
+
+	fprintf(stderr, "fanout\n");
+	test_fanout();
+
+	return 0;
+}
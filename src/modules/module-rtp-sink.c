@@ -54,6 +54,10 @@
  * - `sess.ts-offset = <int>`: an offset to apply to the timestamp, default -1 = random offset
  * - `sess.ts-refclk = <string>`: the name of a reference clock
  * - `sess.media = <string>`: the media type audio|midi|opus, default audio
+ * - `opus.bitrate = <int>`: max opus bitrate, default 48000 per channel
+ * - `opus.min-bitrate = <int>`: min opus bitrate, default 8000 per channel
+ * - `opus.fec = <bool>`: opus in-band FEC, default true
+ * - `opus.dtx = <bool>`: opus discontinuous transmission, default false
  * - `stream.props = {}`: properties to be passed to the stream
  *
  * ## General options
@@ -130,6 +134,10 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
 		"( sess.min-ptime=<minimum packet time in milliseconds, default:2> ) "			\
 		"( sess.max-ptime=<maximum packet time in milliseconds, default:20> ) "			\
  		"( sess.media=<string, the media type audio|midi|opus, default audio> ) "		\
+		"( opus.bitrate=<max opus bitrate, default 48000 per channel> ) "			\
+		"( opus.min-bitrate=<min opus bitrate, default 8000 per channel> ) "			\
+		"( opus.fec=<bool, opus in-band FEC, default true> ) "					\
+		"( opus.dtx=<bool, opus DTX, default false> ) "						\
 		"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "					\
 		"( audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "			\
 		"( audio.channels=<number of channels, default:"SPA_STRINGIFY(DEFAULT_CHANNELS)"> ) "	\
@@ -175,6 +183,7 @@ struct impl {
 	socklen_t dst_len;
 
 	int rtp_fd;
+	struct spa_source *rtcp_source;
 };
 
 static void stream_destroy(void *d)
@@ -201,6 +210,21 @@ static void stream_send_packet(void *data, struct iovec *iov, size_t iovlen)
 		pw_log_debug("sendmsg() failed: %m");
 }
 
+static void on_rtcp_io(void *data, int fd, uint32_t mask)
+{
+	struct impl *impl = data;
+	uint8_t buffer[2048];
+	ssize_t len;
+
+	if (mask & SPA_IO_IN) {
+		/* receiver reports come back on the connected socket */
+		while ((len = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+			if (impl->stream)
+				rtp_stream_receive_packet(impl->stream, buffer, len);
+		}
+	}
+}
+
 static void stream_state_changed(void *data, bool started, const char *error)
 {
 	struct impl *impl = data;
@@ -332,6 +356,8 @@ static void impl_destroy(struct impl *impl)
 	if (impl->core && impl->do_disconnect)
 		pw_core_disconnect(impl->core);
 
+	if (impl->rtcp_source)
+		pw_loop_destroy_source(impl->loop, impl->rtcp_source);
 	if (impl->rtp_fd != -1)
 		close(impl->rtp_fd);
 
@@ -455,6 +481,10 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	copy_props(impl, props, "sess.max-ptime");
 	copy_props(impl, props, "sess.latency.msec");
 	copy_props(impl, props, "sess.ts-refclk");
+	copy_props(impl, props, "opus.bitrate");
+	copy_props(impl, props, "opus.min-bitrate");
+	copy_props(impl, props, "opus.fec");
+	copy_props(impl, props, "opus.dtx");
 
 	str = pw_properties_get(props, "local.ifname");
 	impl->ifname = str ? strdup(str) : NULL;
@@ -532,6 +562,14 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 		goto out;
 	}
 
+	impl->rtcp_source = pw_loop_add_io(impl->loop, impl->rtp_fd,
+			SPA_IO_IN, false, on_rtcp_io, impl);
+	if (impl->rtcp_source == NULL) {
+		res = -errno;
+		pw_log_error("can't create rtcp source: %m");
+		goto out;
+	}
+
 	pw_impl_module_add_listener(module, &impl->module_listener, &module_events, impl);
 
 	pw_impl_module_update_properties(module, &SPA_DICT_INIT_ARRAY(module_info));
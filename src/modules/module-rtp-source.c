@@ -46,7 +46,11 @@
  * - `local.ifname = <str>`: interface name to use
  * - `node.always-process = <bool>`: true to receive even when not running
  * - `sess.latency.msec = <str>`: target network latency in milliseconds, default 100
- * - `sess.media = <string>`: the media type audio|midi|opus, default audio
+ * - `sess.media = <string>`: the media type audio|midi|opus, default audio.
+ *   An opus receiver sends RTCP receiver reports back to the sender, which
+ *   adapts its bitrate and FEC to the packet loss.
+ * - `opus.fec = <bool>`: the sender uses opus in-band FEC, default true. Lost
+ *   packets are then concealed and recovered with it, else they are silence.
  * - `stream.props = {}`: properties to be passed to the stream
  *
  * ## General options
@@ -106,6 +110,7 @@ PW_LOG_TOPIC_STATIC(mod_topic, "mod." NAME);
  		"source.port=<int, source port> "								\
 		"( sess.latency.msec=<target network latency, default "SPA_STRINGIFY(DEFAULT_SESS_LATENCY)"> ) "\
  		"( sess.media=<string, the media type audio|midi|opus, default audio> ) "			\
+		"( opus.fec=<bool, the sender uses opus in-band FEC, default true> ) "				\
 		"( audio.format=<format, default:"DEFAULT_FORMAT"> ) "						\
 		"( audio.rate=<sample rate, default:"SPA_STRINGIFY(DEFAULT_RATE)"> ) "				\
 		"( audio.channels=<number of channels, default:"SPA_STRINGIFY(DEFAULT_CHANNELS)"> ) "		\
@@ -147,6 +152,9 @@ struct impl {
 	socklen_t src_len;
 	struct spa_source *source;
 
+	struct sockaddr_storage sender_addr;
+	socklen_t sender_len;
+
 	unsigned receiving:1;
 };
 
@@ -158,7 +166,9 @@ on_rtp_io(void *data, int fd, uint32_t mask)
 	uint8_t buffer[2048];
 
 	if (mask & SPA_IO_IN) {
-		if ((len = recv(fd, buffer, sizeof(buffer), 0)) < 0)
+		impl->sender_len = sizeof(impl->sender_addr);
+		if ((len = recvfrom(fd, buffer, sizeof(buffer), 0,
+				(struct sockaddr*)&impl->sender_addr, &impl->sender_len)) < 0)
 			goto receive_error;
 
 		if (len < 12)
@@ -334,10 +344,30 @@ static void stream_state_changed(void *data, bool started, const char *error)
 	}
 }
 
+static void stream_send_report(void *data, struct iovec *iov, size_t iovlen)
+{
+	struct impl *impl = data;
+	struct msghdr msg;
+
+	if (impl->source == NULL || impl->sender_len == 0)
+		return;
+
+	/* reply to the sender of the packet that is being received */
+	spa_zero(msg);
+	msg.msg_name = &impl->sender_addr;
+	msg.msg_namelen = impl->sender_len;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovlen;
+
+	if (sendmsg(impl->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+		pw_log_debug("sendmsg() failed: %m");
+}
+
 static const struct rtp_stream_events stream_events = {
 	RTP_VERSION_STREAM_EVENTS,
 	.destroy = stream_destroy,
 	.state_changed = stream_state_changed,
+	.send_report = stream_send_report,
 };
 
 static void on_timer_event(void *data, uint64_t expirations)
@@ -488,6 +518,7 @@ int pipewire__module_init(struct pw_impl_module *module, const char *args)
 	copy_props(impl, props, "sess.max-ptime");
 	copy_props(impl, props, "sess.latency.msec");
 	copy_props(impl, props, "sess.ts-direct");
+	copy_props(impl, props, "opus.fec");
 
 	str = pw_properties_get(props, "local.ifname");
 	impl->ifname = str ? strdup(str) : NULL;
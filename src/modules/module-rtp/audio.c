@@ -7,8 +7,9 @@ static void rtp_audio_process_playback(void *data)
 	struct impl *impl = data;
 	struct pw_buffer *buf;
 	struct spa_data *d;
-	uint32_t wanted, timestamp, target_buffer, stride, maxsize;
-	int32_t avail;
+	uint32_t wanted, duration, target_buffer, stride, maxsize, avail;
+	uint32_t timestamp;
+	int32_t filled;
 
 	if ((buf = pw_stream_dequeue_buffer(impl->stream)) == NULL) {
 		pw_log_debug("Out of stream buffers: %m");
@@ -20,72 +21,66 @@ static void rtp_audio_process_playback(void *data)
 
 	maxsize = d[0].maxsize / stride;
 	wanted = buf->requested ? SPA_MIN(buf->requested, maxsize) : maxsize;
+	duration = impl->io_position ? impl->io_position->clock.duration : wanted;
+
+	target_buffer = impl->target_buffer;
 
 	if (impl->io_position && impl->direct_timestamp) {
 		/* in direct mode, read directly from the timestamp index,
 		 * because sender and receiver are in sync, this would keep
-		 * target_buffer of samples available. */
-		spa_ringbuffer_read_update(&impl->ring,
+		 * target_buffer of samples available. The jitter buffer is
+		 * only used as the ring. */
+		spa_ringbuffer_read_update(&impl->jbuf.ring,
 				impl->io_position->clock.position);
+		filled = spa_ringbuffer_get_read_index(&impl->jbuf.ring, &timestamp);
+
+		if (filled < (int32_t)wanted) {
+			enum spa_log_level level;
+			memset(d[0].data, 0, wanted * stride);
+			if (impl->have_sync) {
+				impl->have_sync = false;
+				level = SPA_LOG_LEVEL_WARN;
+			} else {
+				level = SPA_LOG_LEVEL_DEBUG;
+			}
+			pw_log(level, "underrun %d/%u < %u",
+					filled, target_buffer, wanted);
+		} else {
+			spa_ringbuffer_read_data(&impl->jbuf.ring,
+					impl->jbuf.data, impl->jbuf.size,
+					(timestamp % impl->jbuf.n_frames) * stride,
+					d[0].data, wanted * stride);
+			spa_ringbuffer_read_update(&impl->jbuf.ring, timestamp + wanted);
+		}
+		goto done;
 	}
-	avail = spa_ringbuffer_get_read_index(&impl->ring, &timestamp);
 
-	target_buffer = impl->target_buffer;
+	spa_jitter_buffer_process(&impl->jbuf, wanted, duration);
+	avail = spa_jitter_buffer_get_avail(&impl->jbuf) / stride;
 
-	if (avail < (int32_t)wanted) {
+	if (avail < wanted) {
 		enum spa_log_level level;
-		memset(d[0].data, 0, wanted * stride);
 		if (impl->have_sync) {
 			impl->have_sync = false;
 			level = SPA_LOG_LEVEL_WARN;
 		} else {
 			level = SPA_LOG_LEVEL_DEBUG;
 		}
-		pw_log(level, "underrun %d/%u < %u",
+		pw_log(level, "underrun %u/%u < %u",
 					avail, target_buffer, wanted);
 	} else {
-		float error, corr;
-		if (impl->first) {
-			if ((uint32_t)avail > target_buffer) {
-				uint32_t skip = avail - target_buffer;
-				pw_log_debug("first: avail:%d skip:%u target:%u",
-							avail, skip, target_buffer);
-				timestamp += skip;
-				avail = target_buffer;
-			}
-			impl->first = false;
-		} else if (avail > (int32_t)SPA_MIN(target_buffer * 8, BUFFER_SIZE / stride)) {
-			pw_log_warn("overrun %u > %u", avail, target_buffer * 8);
-			timestamp += avail - target_buffer;
-			avail = target_buffer;
-		}
-		if (!impl->direct_timestamp) {
-			/* when not using direct timestamp and clocks are not
-			 * in sync, try to adjust our playback rate to keep the
-			 * requested target_buffer bytes in the ringbuffer */
-			error = (float)target_buffer - (float)avail;
-			error = SPA_CLAMP(error, -impl->max_error, impl->max_error);
-
-			corr = spa_dll_update(&impl->dll, error);
-
-			pw_log_debug("avail:%u target:%u error:%f corr:%f", avail,
-					target_buffer, error, corr);
-
-			if (impl->io_rate_match) {
-				SPA_FLAG_SET(impl->io_rate_match->flags,
-						SPA_IO_RATE_MATCH_FLAG_ACTIVE);
-				impl->io_rate_match->rate = 1.0f / corr;
-			}
-		}
-		spa_ringbuffer_read_data(&impl->ring,
-				impl->buffer,
-				BUFFER_SIZE,
-				(timestamp * stride) & BUFFER_MASK,
-				d[0].data, wanted * stride);
-
-		timestamp += wanted;
-		spa_ringbuffer_read_update(&impl->ring, timestamp);
+		/* when not using direct timestamp and clocks are not
+		 * in sync, adjust our playback rate to keep the
+		 * requested target_buffer samples in the ringbuffer */
+		spa_jitter_buffer_update_rate_match(&impl->jbuf,
+				impl->io_rate_match, true);
+
+		pw_log_debug("avail:%u target:%u level:%d corr:%f", avail,
+				target_buffer, impl->jbuf.stats.level, impl->jbuf.corr);
 	}
+	spa_jitter_buffer_read(&impl->jbuf, d[0].data, wanted * stride);
+
+done:
 	d[0].chunk->size = wanted * stride;
 	d[0].chunk->stride = stride;
 	d[0].chunk->offset = 0;
@@ -135,7 +130,7 @@ static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	plen = len - hlen;
 	samples = plen / stride;
 
-	filled = spa_ringbuffer_get_write_index(&impl->ring, &expected_write);
+	filled = spa_ringbuffer_get_write_index(&impl->jbuf.ring, &expected_write);
 
 	/* we always write to timestamp + delay */
 	write = timestamp + impl->target_buffer;
@@ -147,32 +142,23 @@ static int rtp_audio_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 
 		/* we read from timestamp, keeping target_buffer of data
 		 * in the ringbuffer. */
-		impl->ring.readindex = timestamp;
-		impl->ring.writeindex = write;
+		spa_jitter_buffer_reset(&impl->jbuf, timestamp, write);
+		spa_jitter_buffer_recover(&impl->jbuf);
 		filled = impl->target_buffer;
-
-		spa_dll_init(&impl->dll);
-		spa_dll_set_bw(&impl->dll, SPA_DLL_BW_MIN, 128, impl->rate);
-		memset(impl->buffer, 0, BUFFER_SIZE);
 		impl->have_sync = true;
 	} else if (expected_write != write) {
 		pw_log_debug("unexpected write (%u != %u)",
 				write, expected_write);
 	}
 
-	if (filled + samples > BUFFER_SIZE / stride) {
+	if (filled + samples > impl->jbuf.n_frames) {
 		pw_log_debug("capture overrun %u + %u > %u", filled, samples,
-				BUFFER_SIZE / stride);
+				impl->jbuf.n_frames);
 		impl->have_sync = false;
 	} else {
 		pw_log_debug("got samples:%u", samples);
-		spa_ringbuffer_write_data(&impl->ring,
-				impl->buffer,
-				BUFFER_SIZE,
-				(write * stride) & BUFFER_MASK,
-				&buffer[hlen], (samples * stride));
-		write += samples;
-		spa_ringbuffer_write_update(&impl->ring, write);
+		spa_jitter_buffer_write_at(&impl->jbuf, write,
+				&buffer[hlen], samples * stride);
 	}
 	return 0;
 
@@ -306,8 +292,13 @@ static int rtp_audio_init(struct impl *impl, enum spa_direction direction)
 {
 	if (direction == SPA_DIRECTION_INPUT)
 		impl->stream_events.process = rtp_audio_process_capture;
-	else
+	else {
 		impl->stream_events.process = rtp_audio_process_playback;
+		/* the receiver uses the buffer memory for the jitter buffer */
+		spa_jitter_buffer_init(&impl->jbuf, pw_log_get(), impl->buffer,
+				BUFFER_SIZE, impl->stride, impl->rate, 0);
+		spa_jitter_buffer_set_target_latency(&impl->jbuf, impl->target_buffer);
+	}
 	impl->receive_rtp = rtp_audio_receive;
 	return 0;
 }
@@ -0,0 +1,137 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_RTP_OPUS_CODEC_H
+#define PIPEWIRE_RTP_OPUS_CODEC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <opus/opus.h>
+#include <opus/opus_multistream.h>
+
+#include <spa/utils/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* the max frames of one opus packet, 120ms at 48KHz */
+#define RTP_OPUS_MAX_FRAMES	5760
+
+/* the loss limits of the loss based controller of draft-ietf-rmcat-gcc */
+#define RTP_OPUS_LOSS_LOW	0.02f
+#define RTP_OPUS_LOSS_HIGH	0.10f
+
+/**
+ * Bitrate and expected packet loss of the encoder, updated from the
+ * fraction lost in receiver reports. The bitrate is lowered with high
+ * loss, slowly raised with low loss and left alone in between. The
+ * expected loss follows increases immediately and decays slowly, it
+ * sets the amount of in-band FEC.
+ */
+struct rtp_opus_rate {
+	uint32_t min_bitrate;
+	uint32_t max_bitrate;
+	float bitrate;
+	float loss;		/**< expected loss in percent */
+};
+
+static inline void rtp_opus_rate_init(struct rtp_opus_rate *r, uint32_t min_bitrate,
+		uint32_t max_bitrate, float loss)
+{
+	r->min_bitrate = SPA_MIN(min_bitrate, max_bitrate);
+	r->max_bitrate = max_bitrate;
+	r->bitrate = max_bitrate;
+	r->loss = loss;
+}
+
+/** Update with the \a fraction lost of a receiver report, in 1/256 */
+static inline void rtp_opus_rate_update(struct rtp_opus_rate *r, uint8_t fraction)
+{
+	float loss = fraction / 256.0f;
+
+	if (loss > RTP_OPUS_LOSS_HIGH)
+		r->bitrate *= 1.0f - 0.5f * loss;
+	else if (loss < RTP_OPUS_LOSS_LOW)
+		r->bitrate *= 1.05f;
+	r->bitrate = SPA_CLAMP(r->bitrate, (float)r->min_bitrate, (float)r->max_bitrate);
+
+	loss *= 100.0f;
+	if (loss > r->loss)
+		r->loss = loss;
+	else
+		r->loss = 0.8f * r->loss + 0.2f * loss;
+}
+
+static inline int rtp_opus_encoder_setup(OpusMSEncoder *enc, uint32_t bitrate,
+		bool fec, bool dtx, uint32_t loss)
+{
+	int res;
+
+	if ((res = opus_multistream_encoder_ctl(enc, OPUS_SET_BITRATE(bitrate))) != OPUS_OK ||
+	    (res = opus_multistream_encoder_ctl(enc, OPUS_SET_INBAND_FEC(fec))) != OPUS_OK ||
+	    (res = opus_multistream_encoder_ctl(enc, OPUS_SET_DTX(dtx))) != OPUS_OK ||
+	    (res = opus_multistream_encoder_ctl(enc, OPUS_SET_PACKET_LOSS_PERC(loss))) != OPUS_OK)
+		return res;
+	return OPUS_OK;
+}
+
+/**
+ * Fill the \a frames before the packet in \a data, that were not received.
+ * When \a lost is set, packets were lost and the last of them is recovered
+ * from the in-band FEC of the packet. The rest is made by the packet loss
+ * concealment of the decoder, which also makes the comfort noise of a DTX
+ * gap. What can't be concealed is silence.
+ *
+ * \param dst room for \a frames frames of \a channels floats
+ * \param fec_frames set to the number of frames recovered by FEC
+ * \return the number of frames made by the decoder
+ */
+static inline uint32_t rtp_opus_conceal(OpusMSDecoder *dec, const uint8_t *data, int32_t len,
+		bool lost, uint32_t rate, uint32_t channels, float *dst, uint32_t frames,
+		uint32_t *fec_frames)
+{
+	uint32_t n = 0, chunk, fec = 0, quantum = rate / 400;
+	int res;
+
+	if (lost) {
+		res = opus_packet_get_nb_samples(data, len, rate);
+		if (res > 0 && (uint32_t)res <= frames)
+			fec = res;
+	}
+
+	/* the decoder conceals in multiples of 2.5ms */
+	while (n + fec < frames) {
+		chunk = SPA_MIN(frames - fec - n, (uint32_t)RTP_OPUS_MAX_FRAMES);
+		chunk -= chunk % quantum;
+		if (chunk == 0)
+			break;
+		res = opus_multistream_decode_float(dec, NULL, 0,
+				&dst[n * channels], chunk, 0);
+		if (res <= 0)
+			break;
+		n += res;
+	}
+	*fec_frames = 0;
+	if (fec > 0 && n + fec == frames) {
+		res = opus_multistream_decode_float(dec, data, len,
+				&dst[n * channels], fec, 1);
+		if (res > 0) {
+			*fec_frames = res;
+			n += res;
+		}
+	}
+	if (n < frames)
+		memset(&dst[n * channels], 0, (frames - n) * channels * sizeof(float));
+
+	return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_RTP_OPUS_CODEC_H */
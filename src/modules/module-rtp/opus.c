@@ -4,8 +4,50 @@
 
 #ifdef HAVE_OPUS
 
-#include <opus/opus.h>
-#include <opus/opus_multistream.h>
+#include <pipewire/thread-loop.h>
+
+#include <module-rtp/opus-codec.h>
+
+#define OPUS_REPORT_MSEC	1000
+#define OPUS_DEFAULT_LOSS	5
+/* older packets are dropped as reordered, larger jumps resync */
+#define OPUS_MAX_MISORDER	16
+
+struct rtp_opus {
+	OpusMSEncoder *enc;
+	OpusMSDecoder *dec;
+	uint32_t channels;
+
+	/* sender, encodes in the thread loop */
+	struct pw_thread_loop *thread;
+	struct spa_source *flush_event;
+	float *pcm;
+	uint8_t *out;
+	uint32_t out_size;
+
+	/* resync of the read index, set from the data loop */
+	uint32_t sync_gen;
+	uint32_t sync_seen;
+	uint32_t sync_index;
+
+	/* rate control, updated from receiver reports in the main loop */
+	struct rtp_opus_rate rate;
+	uint32_t bitrate;
+	uint32_t loss;
+	uint32_t cur_bitrate;
+	uint32_t cur_loss;
+
+	unsigned fec:1;
+	unsigned dtx:1;
+	unsigned in_dtx:1;
+
+	/* receiver */
+	struct rtp_loss_stats stats;
+	uint32_t report_ssrc;
+	uint32_t last_report;
+	uint64_t fec_frames;
+	uint64_t concealed;
+};
 
 static void rtp_opus_process_playback(void *data)
 {
@@ -99,15 +141,36 @@ static void rtp_opus_process_playback(void *data)
 	pw_stream_queue_buffer(impl->stream, buf);
 }
 
+static void rtp_opus_send_report(struct impl *impl, uint32_t timestamp)
+{
+	struct rtp_opus *op = impl->stream_data;
+	struct rtcp_rr rr;
+	struct iovec iov[1];
+	uint8_t fraction;
+
+	if (timestamp - op->last_report < impl->rate * OPUS_REPORT_MSEC / 1000)
+		return;
+	op->last_report = timestamp;
+
+	iov[0].iov_base = &rr;
+	iov[0].iov_len = rtcp_build_rr(&op->stats, op->report_ssrc,
+			ntohl(impl->ssrc), &rr, sizeof(rr), &fraction);
+
+	pw_log_debug("report lost:%u/256 fec:%"PRIu64" concealed:%"PRIu64,
+			fraction, op->fec_frames, op->concealed);
+
+	rtp_stream_emit_send_report(impl, iov, 1);
+}
+
 static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 {
 	struct rtp_header *hdr;
 	ssize_t hlen, plen;
 	uint16_t seq;
-	uint32_t timestamp, samples, write, expected_write;
+	uint32_t timestamp, write, expected_write, fec;
 	uint32_t stride = impl->stride;
-	OpusMSDecoder *dec = impl->stream_data;
-	int32_t filled;
+	struct rtp_opus *op = impl->stream_data;
+	int32_t filled, lost = 0, gap = 0;
 	int res;
 
 	if (len < 12)
@@ -127,10 +190,20 @@ static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	impl->have_ssrc = true;
 
 	seq = ntohs(hdr->sequence_number);
-	if (impl->have_seq && impl->seq != seq) {
-		pw_log_info("unexpected seq (%d != %d) SSRC:%u",
-				seq, impl->seq, hdr->ssrc);
-		impl->have_sync = false;
+	rtp_loss_stats_update(&op->stats, seq);
+
+	if (impl->have_seq) {
+		lost = (int16_t)(seq - impl->seq);
+		if (lost < 0 && lost >= -OPUS_MAX_MISORDER) {
+			pw_log_debug("late packet seq:%u expected:%u", seq, impl->seq);
+			return 0;
+		} else if (lost < 0) {
+			/* a restarted sender starts from a random seq */
+			pw_log_info("unexpected seq (%d != %d) SSRC:%u",
+					seq, impl->seq, hdr->ssrc);
+			impl->have_sync = false;
+			lost = 0;
+		}
 	}
 	impl->seq = seq + 1;
 	impl->have_seq = true;
@@ -146,6 +219,21 @@ static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 	/* we always write to timestamp + delay */
 	write = timestamp + impl->target_buffer;
 
+	if (impl->have_sync) {
+		/* the gap is from lost packets or from DTX */
+		gap = (int32_t)(write - expected_write);
+		if (gap < 0 || gap > (int32_t)impl->target_buffer) {
+			/* the marker is set on the first packet after a DTX
+			 * gap, a long gap was played as silence */
+			pw_log(hdr->m ? SPA_LOG_LEVEL_DEBUG : SPA_LOG_LEVEL_INFO,
+					"unexpected write (%u != %u) lost:%d SSRC:%u",
+					write, expected_write, lost, hdr->ssrc);
+			impl->have_sync = false;
+			gap = 0;
+		} else if (lost > 0) {
+			pw_log_debug("lost %d packets, gap:%d", lost, gap);
+		}
+	}
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u seq:%u ts_offset:%u SSRC:%u target:%u direct:%u",
 				timestamp, seq, impl->ts_offset, impl->ssrc,
@@ -154,41 +242,57 @@ static int rtp_opus_receive(struct impl *impl, uint8_t *buffer, ssize_t len)
 		/* we read from timestamp, keeping target_buffer of data
 		 * in the ringbuffer. */
 		impl->ring.readindex = timestamp;
-		impl->ring.writeindex = write;
+		impl->ring.writeindex = expected_write = write;
 		filled = impl->target_buffer;
+		op->last_report = timestamp;
 
 		spa_dll_init(&impl->dll);
 		spa_dll_set_bw(&impl->dll, SPA_DLL_BW_MIN, 128, impl->rate);
 		memset(impl->buffer, 0, BUFFER_SIZE);
 		impl->have_sync = true;
-	} else if (expected_write != write) {
-		pw_log_debug("unexpected write (%u != %u)",
-				write, expected_write);
 	}
 
-	if (filled + plen > BUFFER_SIZE2 / stride) {
-		pw_log_debug("capture overrun %u + %zd > %u", filled, plen,
+	if (filled + gap + RTP_OPUS_MAX_FRAMES > (int32_t)(BUFFER_SIZE2 / stride)) {
+		pw_log_debug("capture overrun %u + %d > %u", filled, gap,
 				BUFFER_SIZE2 / stride);
 		impl->have_sync = false;
 	} else {
-		uint32_t index = (write * stride) & BUFFER_MASK2, end;
-
-		res = opus_multistream_decode_float(dec,
+		uint32_t index = (expected_write * stride) & BUFFER_MASK2, end, n = 0;
+		float *dst = (float*)&impl->buffer[index];
+
+		if (gap > 0 && lost > 0 && !op->fec) {
+			/* concealment alone is worse than silence */
+			memset(dst, 0, gap * stride);
+			n = gap;
+		} else if (gap > 0) {
+			/* FEC, or the comfort noise of a DTX gap */
+			rtp_opus_conceal(op->dec, &buffer[hlen], plen, lost > 0,
+					impl->rate, op->channels, dst, gap, &fec);
+			op->fec_frames += fec;
+			op->concealed += gap - fec;
+			n = gap;
+		}
+		res = opus_multistream_decode_float(op->dec,
 				&buffer[hlen], plen,
-				(float*)&impl->buffer[index], 2880,
+				&dst[n * op->channels], RTP_OPUS_MAX_FRAMES,
 				0);
+		if (res < 0) {
+			pw_log_warn("decode error: %s", opus_strerror(res));
+			res = 0;
+		}
+		n += res;
 
-		end = index + (res * stride);
+		end = index + (n * stride);
 		/* fold to the lower part of the ringbuffer when overflow */
 		if (end > BUFFER_SIZE2)
 			memmove(impl->buffer, &impl->buffer[BUFFER_SIZE2], end - BUFFER_SIZE2);
 
-		pw_log_debug("receiving %zd len:%d timestamp:%d %u", plen, res, timestamp, index);
-		samples = res;
+		pw_log_debug("receiving %zd len:%d gap:%d timestamp:%d %u",
+				plen, res, gap, timestamp, index);
 
-		write += samples;
-		spa_ringbuffer_write_update(&impl->ring, write);
+		spa_ringbuffer_write_update(&impl->ring, expected_write + n);
 	}
+	rtp_opus_send_report(impl, timestamp);
 	return 0;
 
 short_packet:
@@ -207,22 +311,48 @@ unexpected_ssrc:
 	return -EINVAL;
 }
 
-static void rtp_opus_flush_packets(struct impl *impl)
+static void rtp_opus_update_encoder(struct impl *impl)
 {
+	struct rtp_opus *op = impl->stream_data;
+	uint32_t bitrate, loss;
+
+	bitrate = __atomic_load_n(&op->bitrate, __ATOMIC_RELAXED);
+	if (bitrate != op->cur_bitrate) {
+		opus_multistream_encoder_ctl(op->enc, OPUS_SET_BITRATE(bitrate));
+		op->cur_bitrate = bitrate;
+	}
+	loss = __atomic_load_n(&op->loss, __ATOMIC_RELAXED);
+	if (loss != op->cur_loss) {
+		opus_multistream_encoder_ctl(op->enc, OPUS_SET_PACKET_LOSS_PERC(loss));
+		op->cur_loss = loss;
+	}
+}
+
+/* runs in the opus thread loop */
+static void rtp_opus_flush_packets(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct rtp_opus *op = impl->stream_data;
 	int32_t avail, tosend;
-	uint32_t stride, timestamp, offset;
-	uint8_t out[1280];
+	uint32_t stride, timestamp, gen;
 	struct iovec iov[2];
 	struct rtp_header header;
-	OpusMSEncoder *enc = impl->stream_data;
 	int res = 0;
 
+	gen = __atomic_load_n(&op->sync_gen, __ATOMIC_ACQUIRE);
+	if (gen != op->sync_seen) {
+		spa_ringbuffer_read_update(&impl->ring, op->sync_index);
+		__atomic_store_n(&op->sync_seen, gen, __ATOMIC_RELEASE);
+	}
+
 	avail = spa_ringbuffer_get_read_index(&impl->ring, &timestamp);
 	tosend = impl->psamples;
 
 	if (avail < tosend)
 		return;
 
+	rtp_opus_update_encoder(impl);
+
 	stride = impl->stride;
 
 	spa_zero(header);
@@ -232,42 +362,53 @@ static void rtp_opus_flush_packets(struct impl *impl)
 
 	iov[0].iov_base = &header;
 	iov[0].iov_len = sizeof(header);
-	iov[1].iov_base = out;
+	iov[1].iov_base = op->out;
 	iov[1].iov_len = 0;
 
-	offset = 0;
 	while (avail >= tosend) {
-		header.sequence_number = htons(impl->seq);
-		header.timestamp = htonl(impl->ts_offset + timestamp);
-
-		res = opus_multistream_encode_float(enc,
-				(const float*)&impl->buffer[offset * stride], tosend,
-				out, sizeof(out));
+		spa_ringbuffer_read_data(&impl->ring,
+				impl->buffer,
+				BUFFER_SIZE,
+				(timestamp * stride) & BUFFER_MASK,
+				op->pcm, tosend * stride);
+
+		res = opus_multistream_encode_float(op->enc,
+				op->pcm, tosend, op->out, op->out_size);
+
+		if (res < 0) {
+			pw_log_warn("encode error: %s", opus_strerror(res));
+		} else if (res <= 2 && op->dtx) {
+			/* nothing to send in DTX, the receiver conceals the
+			 * gap in the timestamps */
+			op->in_dtx = true;
+		} else {
+			header.m = op->in_dtx;
+			header.sequence_number = htons(impl->seq);
+			header.timestamp = htonl(impl->ts_offset + timestamp);
+			op->in_dtx = false;
 
-		pw_log_debug("sending %d len:%d timestamp:%d", tosend, res, timestamp);
-		iov[1].iov_len = res;
+			pw_log_debug("sending %d len:%d timestamp:%d", tosend, res, timestamp);
+			iov[1].iov_len = res;
 
-		rtp_stream_emit_send_packet(impl, iov, 2);
+			rtp_stream_emit_send_packet(impl, iov, 2);
 
-		impl->seq++;
+			impl->seq++;
+		}
 		timestamp += tosend;
-		offset += tosend;
 		avail -= tosend;
 	}
-
-	pw_log_debug("move %d offset:%d", avail, offset);
-	memmove(impl->buffer, &impl->buffer[offset * stride], avail * stride);
-
 	spa_ringbuffer_read_update(&impl->ring, timestamp);
 }
 
 static void rtp_opus_process_capture(void *data)
 {
 	struct impl *impl = data;
+	struct rtp_opus *op = impl->stream_data;
 	struct pw_buffer *buf;
 	struct spa_data *d;
 	uint32_t offs, size, timestamp, expected_timestamp, stride;
 	int32_t filled, wanted;
+	bool synced;
 
 	if ((buf = pw_stream_dequeue_buffer(impl->stream)) == NULL) {
 		pw_log_debug("Out of stream buffers: %m");
@@ -288,17 +429,23 @@ static void rtp_opus_process_capture(void *data)
 	} else
 		timestamp = expected_timestamp;
 
+	/* the read index is only valid when the encoder thread has seen
+	 * the last sync */
+	synced = __atomic_load_n(&op->sync_seen, __ATOMIC_ACQUIRE) == op->sync_gen;
+
 	if (!impl->have_sync) {
 		pw_log_info("sync to timestamp:%u seq:%u ts_offset:%u SSRC:%u",
 				timestamp, impl->seq, impl->ts_offset, impl->ssrc);
-		impl->ring.readindex = impl->ring.writeindex = expected_timestamp = timestamp;
-		memset(impl->buffer, 0, BUFFER_SIZE);
+		impl->ring.writeindex = expected_timestamp = timestamp;
+		op->sync_index = timestamp;
+		__atomic_store_n(&op->sync_gen, op->sync_gen + 1, __ATOMIC_RELEASE);
 		impl->have_sync = true;
+		synced = false;
 	} else {
 		if (SPA_ABS((int32_t)expected_timestamp - (int32_t)timestamp) > 32) {
 			pw_log_warn("expected %u != timestamp %u", expected_timestamp, timestamp);
 			impl->have_sync = false;
-		} else if (filled + wanted > (int32_t)(BUFFER_SIZE / stride)) {
+		} else if (synced && filled + wanted > (int32_t)(BUFFER_SIZE / stride)) {
 			pw_log_warn("overrun %u + %u > %u", filled, wanted, BUFFER_SIZE / stride);
 			impl->have_sync = false;
 		}
@@ -307,19 +454,109 @@ static void rtp_opus_process_capture(void *data)
 	spa_ringbuffer_write_data(&impl->ring,
 			impl->buffer,
 			BUFFER_SIZE,
-			(filled * stride) & BUFFER_MASK,
+			(expected_timestamp * stride) & BUFFER_MASK,
 			SPA_PTROFF(d[0].data, offs, void), wanted * stride);
 	expected_timestamp += wanted;
 	spa_ringbuffer_write_update(&impl->ring, expected_timestamp);
 
 	pw_stream_queue_buffer(impl->stream, buf);
 
-	rtp_opus_flush_packets(impl);
+	/* wake up the encoder when there is a packet */
+	if (!synced || filled + wanted >= (int32_t)impl->psamples)
+		pw_loop_signal_event(pw_thread_loop_get_loop(op->thread), op->flush_event);
+}
+
+static int rtp_opus_receive_rtcp(struct impl *impl, uint8_t *buffer, ssize_t len)
+{
+	struct rtp_opus *op = impl->stream_data;
+	uint8_t fraction;
+	int res;
+
+	if (op->enc == NULL)
+		return 0;
+	if ((res = rtcp_parse_rr(buffer, len, impl->ssrc, &fraction)) <= 0)
+		return res;
+
+	rtp_opus_rate_update(&op->rate, fraction);
+
+	pw_log_debug("report lost:%u/256 bitrate:%.0f loss:%.1f%%",
+			fraction, op->rate.bitrate, op->rate.loss);
+
+	__atomic_store_n(&op->bitrate, (uint32_t)op->rate.bitrate, __ATOMIC_RELAXED);
+	__atomic_store_n(&op->loss, SPA_MIN((uint32_t)(op->rate.loss + 0.5f), 100u),
+			__ATOMIC_RELAXED);
+	return 0;
+}
+
+static void rtp_opus_deinit(struct impl *impl, enum spa_direction direction)
+{
+	struct rtp_opus *op = impl->stream_data;
+
+	if (op == NULL)
+		return;
+	if (op->thread) {
+		pw_thread_loop_stop(op->thread);
+		if (op->flush_event)
+			pw_loop_destroy_source(pw_thread_loop_get_loop(op->thread),
+					op->flush_event);
+		pw_thread_loop_destroy(op->thread);
+	}
+	if (op->enc)
+		opus_multistream_encoder_destroy(op->enc);
+	if (op->dec)
+		opus_multistream_decoder_destroy(op->dec);
+	free(op->pcm);
+	free(op->out);
+	free(op);
+	impl->stream_data = NULL;
+}
+
+static int rtp_opus_init_encoder(struct impl *impl, struct rtp_opus *op,
+		const struct pw_properties *props)
+{
+	uint32_t max_bitrate, min_bitrate;
+	int res;
+
+	max_bitrate = pw_properties_get_uint32(props, "opus.bitrate", op->channels * 48000);
+	min_bitrate = pw_properties_get_uint32(props, "opus.min-bitrate", op->channels * 8000);
+	op->fec = pw_properties_get_bool(props, "opus.fec", true);
+	op->dtx = pw_properties_get_bool(props, "opus.dtx", false);
+
+	rtp_opus_rate_init(&op->rate, min_bitrate, max_bitrate,
+			op->fec ? OPUS_DEFAULT_LOSS : 0);
+	op->bitrate = op->cur_bitrate = (uint32_t)op->rate.bitrate;
+	op->loss = op->cur_loss = (uint32_t)op->rate.loss;
+
+	if ((res = rtp_opus_encoder_setup(op->enc, op->cur_bitrate,
+			op->fec, op->dtx, op->cur_loss)) != OPUS_OK) {
+		pw_log_error("opus setup error: %s", opus_strerror(res));
+		return -EINVAL;
+	}
+	pw_log_info("opus bitrate:%u-%u fec:%u dtx:%u", min_bitrate, max_bitrate,
+			op->fec, op->dtx);
+
+	op->out_size = SPA_MAX(impl->mtu, 128u + sizeof(struct rtp_header)) -
+		sizeof(struct rtp_header);
+	op->pcm = calloc(impl->psamples, impl->stride);
+	op->out = malloc(op->out_size);
+	if (op->pcm == NULL || op->out == NULL)
+		return -errno;
+
+	if ((op->thread = pw_thread_loop_new("rtp-opus", NULL)) == NULL)
+		return -errno;
+	op->flush_event = pw_loop_add_event(pw_thread_loop_get_loop(op->thread),
+			rtp_opus_flush_packets, impl);
+	if (op->flush_event == NULL)
+		return -errno;
+	if ((res = pw_thread_loop_start(op->thread)) < 0)
+		return res;
+	return 0;
 }
 
 static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
 {
-	int err;
+	struct rtp_opus *op;
+	int err, res = 0;
 	unsigned char mapping[64];
 	uint32_t i;
 
@@ -336,34 +573,56 @@ static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
 	else
 		impl->psamples = 120;
 
-	for (i = 0; i < impl->info.info.opus.channels; i++)
+	if ((op = calloc(1, sizeof(*op))) == NULL)
+		return -errno;
+	impl->stream_data = op;
+	impl->deinit = rtp_opus_deinit;
+
+	op->channels = impl->info.info.opus.channels;
+	for (i = 0; i < op->channels; i++)
 		mapping[i] = i;
 
 	impl->receive_rtp = rtp_opus_receive;
+	impl->receive_rtcp = rtp_opus_receive_rtcp;
 	if (direction == SPA_DIRECTION_INPUT) {
 		impl->stream_events.process = rtp_opus_process_capture;
 
-		impl->stream_data = opus_multistream_encoder_create(
+		op->enc = opus_multistream_encoder_create(
 			impl->info.info.opus.rate,
-			impl->info.info.opus.channels,
-			impl->info.info.opus.channels, 0,
+			op->channels,
+			op->channels, 0,
 			mapping,
 			OPUS_APPLICATION_AUDIO,
 			&err);
+		if (op->enc)
+			res = rtp_opus_init_encoder(impl, op,
+					pw_stream_get_properties(impl->stream));
 	}
 	else {
 		impl->stream_events.process = rtp_opus_process_playback;
 
-		impl->stream_data = opus_multistream_decoder_create(
+		impl->first = true;
+		impl->max_error = ERROR_MSEC * impl->rate / 1000;
+		spa_dll_init(&impl->dll);
+		spa_dll_set_bw(&impl->dll, SPA_DLL_BW_MIN, 128, impl->rate);
+
+		op->dec = opus_multistream_decoder_create(
 			impl->info.info.opus.rate,
-			impl->info.info.opus.channels,
-			impl->info.info.opus.channels, 0,
+			op->channels,
+			op->channels, 0,
 			mapping,
 			&err);
+		op->report_ssrc = pw_rand32();
+		op->fec = pw_properties_get_bool(pw_stream_get_properties(impl->stream),
+				"opus.fec", true);
 	}
-	if (!impl->stream_data)
+	if (!op->enc && !op->dec) {
 		pw_log_error("opus error: %d", err);
-	return impl->stream_data ? 0 : err;
+		res = err;
+	}
+	if (res < 0)
+		rtp_opus_deinit(impl, direction);
+	return res;
 }
 #else
 static int rtp_opus_init(struct impl *impl, enum spa_direction direction)
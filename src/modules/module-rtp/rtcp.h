@@ -0,0 +1,194 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_RTCP_H
+#define PIPEWIRE_RTCP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTCP_SR		200
+#define RTCP_RR		201
+
+struct rtcp_header {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	unsigned rc:5;
+	unsigned p:1;
+	unsigned v:2;
+#elif __BYTE_ORDER == __BIG_ENDIAN
+	unsigned v:2;
+	unsigned p:1;
+	unsigned rc:5;
+#else
+#error "Unknown byte order"
+#endif
+	uint8_t pt;
+	uint16_t length;		/* in 32 bit words minus one */
+} __attribute__ ((packed));
+
+struct rtcp_report_block {
+	uint32_t ssrc;
+	uint32_t lost;			/* fraction lost (8 bits), cumulative lost (24 bits) */
+	uint32_t last_seq;		/* extended highest sequence number */
+	uint32_t jitter;
+	uint32_t lsr;
+	uint32_t dlsr;
+} __attribute__ ((packed));
+
+struct rtcp_rr {
+	struct rtcp_header hdr;
+	uint32_t ssrc;
+	struct rtcp_report_block block[1];
+} __attribute__ ((packed));
+
+/* RTP and RTCP on the same port are told apart by the payload type, see
+ * RFC 5761 */
+static inline bool rtcp_is_rtcp(const uint8_t *data, size_t len)
+{
+	return len >= sizeof(struct rtcp_header) &&
+		(data[0] >> 6) == 2 && data[1] >= 192 && data[1] <= 223;
+}
+
+#define RTP_MAX_DROPOUT		3000
+#define RTP_MAX_MISORDER	100
+
+/** Sequence number statistics of a receiver, see RFC 3550 A.1 and A.3 */
+struct rtp_loss_stats {
+	uint16_t base_seq;
+	uint16_t max_seq;
+	uint32_t cycles;
+	uint32_t received;
+	uint32_t expected_prior;
+	uint32_t received_prior;
+	bool init;
+};
+
+static inline void rtp_loss_stats_init(struct rtp_loss_stats *s, uint16_t seq)
+{
+	spa_zero(*s);
+	s->base_seq = s->max_seq = seq;
+	s->init = true;
+}
+
+static inline void rtp_loss_stats_update(struct rtp_loss_stats *s, uint16_t seq)
+{
+	uint16_t udelta = seq - s->max_seq;
+
+	if (!s->init) {
+		rtp_loss_stats_init(s, seq);
+	} else if (udelta < RTP_MAX_DROPOUT) {
+		if (seq < s->max_seq)
+			s->cycles += 1u << 16;
+		s->max_seq = seq;
+	} else if (udelta <= (1u << 16) - RTP_MAX_MISORDER) {
+		/* a large jump, the sender restarted */
+		rtp_loss_stats_init(s, seq);
+	}
+	/* else a duplicate or reordered packet */
+	s->received++;
+}
+
+/**
+ * Write a receiver report about \a media_ssrc to \a data. The fraction
+ * lost is for the packets since the previous report.
+ *
+ * \return the size of the report or 0 when it does not fit
+ */
+static inline size_t rtcp_build_rr(struct rtp_loss_stats *s, uint32_t ssrc,
+		uint32_t media_ssrc, void *data, size_t size, uint8_t *fraction)
+{
+	struct rtcp_rr *rr = data;
+	uint32_t extended_max, expected, expected_interval, received_interval;
+	int32_t lost, lost_interval;
+	uint8_t frac;
+
+	if (size < sizeof(*rr))
+		return 0;
+
+	extended_max = s->cycles + s->max_seq;
+	expected = extended_max - s->base_seq + 1;
+	lost = SPA_CLAMP((int32_t)(expected - s->received), -0x800000, 0x7fffff);
+
+	expected_interval = expected - s->expected_prior;
+	s->expected_prior = expected;
+	received_interval = s->received - s->received_prior;
+	s->received_prior = s->received;
+	lost_interval = (int32_t)(expected_interval - received_interval);
+
+	if (expected_interval == 0 || lost_interval <= 0)
+		frac = 0;
+	else
+		frac = SPA_MIN(((uint64_t)lost_interval << 8) / expected_interval, 255u);
+
+	spa_zero(*rr);
+	rr->hdr.v = 2;
+	rr->hdr.rc = 1;
+	rr->hdr.pt = RTCP_RR;
+	rr->hdr.length = htons(sizeof(*rr) / 4 - 1);
+	rr->ssrc = htonl(ssrc);
+	rr->block[0].ssrc = htonl(media_ssrc);
+	rr->block[0].lost = htonl(((uint32_t)frac << 24) | (lost & 0xffffff));
+	rr->block[0].last_seq = htonl(extended_max);
+
+	if (fraction)
+		*fraction = frac;
+	return sizeof(*rr);
+}
+
+/**
+ * Find the report block about \a media_ssrc in the compound RTCP packet
+ * \a data.
+ *
+ * \return 1 and the fraction lost when found, 0 when not found or a
+ *   negative errno for an invalid packet
+ */
+static inline int rtcp_parse_rr(const void *data, size_t len, uint32_t media_ssrc,
+		uint8_t *fraction)
+{
+	const uint8_t *p = data;
+
+	while (len >= sizeof(struct rtcp_header)) {
+		const struct rtcp_header *hdr = (const struct rtcp_header*)p;
+		size_t plen = (ntohs(hdr->length) + 1) * 4, offset;
+		uint32_t i;
+
+		if (hdr->v != 2 || plen > len)
+			return -EINVAL;
+
+		/* the report blocks start after the sender info in a SR */
+		offset = sizeof(*hdr) + 4 + (hdr->pt == RTCP_SR ? 20 : 0);
+		if (hdr->pt == RTCP_SR || hdr->pt == RTCP_RR) {
+			for (i = 0; i < hdr->rc; i++) {
+				struct rtcp_report_block block;
+
+				if (offset + sizeof(block) > plen)
+					return -EINVAL;
+				memcpy(&block, p + offset, sizeof(block));
+				if (ntohl(block.ssrc) == media_ssrc) {
+					*fraction = ntohl(block.lost) >> 24;
+					return 1;
+				}
+				offset += sizeof(block);
+			}
+		}
+		p += plen;
+		len -= plen;
+	}
+	return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_RTCP_H */
@@ -9,6 +9,7 @@
 #include <spa/utils/json.h>
 #include <spa/utils/ringbuffer.h>
 #include <spa/utils/dll.h>
+#include <spa/utils/jitter-buffer.h>
 #include <spa/param/audio/format-utils.h>
 #include <spa/control/control.h>
 #include <spa/debug/types.h>
@@ -20,6 +21,7 @@
 #include <pipewire/impl.h>
 
 #include <module-rtp/rtp.h>
+#include <module-rtp/rtcp.h>
 #include <module-rtp/stream.h>
 #include <module-rtp/apple-midi.h>
 
@@ -34,6 +36,7 @@
 #define rtp_stream_emit_state_changed(s,n,e)	rtp_stream_emit(s, state_changed,0,n,e)
 #define rtp_stream_emit_send_packet(s,i,l)	rtp_stream_emit(s, send_packet,0,i,l)
 #define rtp_stream_emit_send_feedback(s,seq)	rtp_stream_emit(s, send_feedback,0,seq)
+#define rtp_stream_emit_send_report(s,i,l)	rtp_stream_emit(s, send_report,1,i,l)
 
 struct impl {
 	struct spa_audio_info info;
@@ -63,6 +66,7 @@ struct impl {
 
 	struct spa_ringbuffer ring;
 	uint8_t buffer[BUFFER_SIZE];
+	struct spa_jitter_buffer jbuf;
 
 	struct spa_io_rate_match *io_rate_match;
 	struct spa_io_position *io_position;
@@ -80,8 +84,11 @@ struct impl {
 	unsigned have_sync:1;
 	unsigned receiving:1;
 	unsigned first:1;
+	unsigned sender:1;
 
 	int (*receive_rtp)(struct impl *impl, uint8_t *buffer, ssize_t len);
+	int (*receive_rtcp)(struct impl *impl, uint8_t *buffer, ssize_t len);
+	void (*deinit)(struct impl *impl, enum spa_direction direction);
 };
 
 #include "module-rtp/audio.c"
@@ -274,7 +281,7 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 		goto out;
 		return NULL;
 	}
-	impl->first = true;
+	impl->sender = direction == PW_DIRECTION_INPUT;
 	spa_hook_list_init(&impl->listener_list);
 	impl->stream_events = stream_events;
 
@@ -395,7 +402,6 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 	latency_msec = pw_properties_get_uint32(props,
 			"sess.latency.msec", DEFAULT_SESS_LATENCY);
 	impl->target_buffer = msec_to_samples(impl, latency_msec);
-	impl->max_error = msec_to_samples(impl, ERROR_MSEC);
 
 	pw_properties_setf(props, PW_KEY_NODE_RATE, "1/%d", impl->rate);
 	if (direction == PW_DIRECTION_INPUT) {
@@ -420,8 +426,6 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 		pw_properties_set(props, "rtp.ts-refclk", str);
 	}
 
-	spa_dll_init(&impl->dll);
-	spa_dll_set_bw(&impl->dll, SPA_DLL_BW_MIN, 128, impl->rate);
 	impl->corr = 1.0;
 
 	impl->stream = pw_stream_new(core, "rtp-session", props);
@@ -455,7 +459,8 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 		params[n_params++] = spa_format_audio_build(&b,
 				SPA_PARAM_EnumFormat, &impl->stream_info);
 		flags |= PW_STREAM_FLAG_AUTOCONNECT;
-		rtp_opus_init(impl, direction);
+		if ((res = rtp_opus_init(impl, direction)) < 0)
+			goto out;
 		break;
 	default:
 		res = -EINVAL;
@@ -483,6 +488,13 @@ struct rtp_stream *rtp_stream_new(struct pw_core *core,
 
 	return (struct rtp_stream*)impl;
 out:
+	if (impl) {
+		if (impl->stream)
+			pw_stream_destroy(impl->stream);
+		if (impl->deinit)
+			impl->deinit(impl, (enum spa_direction)direction);
+		free(impl);
+	}
 	pw_properties_free(props);
 	errno = -res;
 	return NULL;
@@ -497,6 +509,10 @@ void rtp_stream_destroy(struct rtp_stream *s)
 	if (impl->stream)
 		pw_stream_destroy(impl->stream);
 
+	if (impl->deinit)
+		impl->deinit(impl, impl->sender ?
+				SPA_DIRECTION_INPUT : SPA_DIRECTION_OUTPUT);
+
 	spa_hook_list_clean(&impl->listener_list);
 	free(impl);
 }
@@ -504,6 +520,11 @@ void rtp_stream_destroy(struct rtp_stream *s)
 int rtp_stream_receive_packet(struct rtp_stream *s, uint8_t *buffer, size_t len)
 {
 	struct impl *impl = (struct impl*)s;
+
+	if (rtcp_is_rtcp(buffer, len))
+		return impl->receive_rtcp ? impl->receive_rtcp(impl, buffer, len) : 0;
+	if (impl->sender)
+		return 0;
 	return impl->receive_rtp(impl, buffer, len);
 }
 
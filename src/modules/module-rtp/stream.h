@@ -24,7 +24,7 @@ struct rtp_stream;
 #define DEFAULT_MAX_PTIME	20
 
 struct rtp_stream_events {
-#define RTP_VERSION_STREAM_EVENTS        0
+#define RTP_VERSION_STREAM_EVENTS        1
 	uint32_t version;
 
 	void (*destroy) (void *data);
@@ -34,6 +34,9 @@ struct rtp_stream_events {
 	void (*send_packet) (void *data, struct iovec *iov, size_t iovlen);
 
 	void (*send_feedback) (void *data, uint32_t senum);
+
+	/* since 1, send a RTCP report back to the sender */
+	void (*send_report) (void *data, struct iovec *iov, size_t iovlen);
 };
 
 struct rtp_stream *rtp_stream_new(struct pw_core *core,
@@ -0,0 +1,431 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+#include <module-rtp/rtp.h>
+#include <module-rtp/rtcp.h>
+#include <module-rtp/opus-codec.h>
+
+#define RATE		48000
+#define FRAMES		960
+#define N_PACKETS	500
+#define BITRATE		24000
+#define LOSS_PERC	10
+
+static uint32_t rnd_state = 0x12345678;
+
+/* a deterministic stand-in for netem */
+static uint32_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/* voiced harmonics and some noise with a syllable envelope, roughly
+ * like speech. A purely tonal signal makes the decoder ring after a
+ * loss, which is not what we want to measure. */
+static void make_signal(float *dst, uint32_t frames, uint32_t channels, uint32_t offset)
+{
+	static uint32_t seed = 1;
+	static double noise = 0.0;
+	uint32_t i, j, h;
+
+	for (i = 0; i < frames; i++) {
+		double t = (double)(offset + i) / RATE, v = 0.0;
+		double f0 = 150.0 + 50.0 * sin(2 * M_PI * 0.7 * t);
+		double env = 0.5 + 0.5 * sin(2 * M_PI * 4.0 * t);
+
+		for (h = 1; h <= 3; h++)
+			v += sin(2 * M_PI * f0 * h * t) / h;
+		seed = seed * 1664525u + 1013904223u;
+		noise = 0.9 * noise + 0.1 * ((seed >> 8) / 8388608.0 - 1.0);
+		for (j = 0; j < channels; j++)
+			dst[i * channels + j] = 0.2 * env * v + 0.5 * noise;
+	}
+}
+
+static double get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void test_rr(void)
+{
+	struct rtp_loss_stats s;
+	uint8_t buffer[256], fraction = 0, parsed = 0;
+	size_t len;
+	uint32_t i;
+
+	/* every 10th packet is lost, over a wraparound */
+	spa_zero(s);
+	for (i = 0; i < 1000; i++) {
+		if (i % 10 != 5)
+			rtp_loss_stats_update(&s, (uint16_t)(65000 + i));
+	}
+	len = rtcp_build_rr(&s, 1, 0x11223344, buffer, sizeof(buffer), &fraction);
+	spa_assert_se(len == sizeof(struct rtcp_rr));
+	spa_assert_se(rtcp_is_rtcp(buffer, len));
+	spa_assert_se(fraction == 25);
+
+	spa_assert_se(rtcp_parse_rr(buffer, len, 0x11223344, &parsed) == 1);
+	spa_assert_se(parsed == fraction);
+	spa_assert_se(rtcp_parse_rr(buffer, len, 0x55667788, &parsed) == 0);
+	spa_assert_se(rtcp_parse_rr(buffer, len - 4, 0x11223344, &parsed) == -EINVAL);
+
+	/* no loss since the last report */
+	for (i = 1000; i < 1100; i++)
+		rtp_loss_stats_update(&s, (uint16_t)(65000 + i));
+	rtcp_build_rr(&s, 1, 0x11223344, buffer, sizeof(buffer), &fraction);
+	spa_assert_se(fraction == 0);
+}
+
+static void test_rate(void)
+{
+	struct rtp_opus_rate r;
+	uint32_t i;
+
+	rtp_opus_rate_init(&r, 8000, 48000, 5);
+	spa_assert_se(r.bitrate == 48000);
+
+	/* 20% loss lowers the bitrate to the minimum */
+	for (i = 0; i < 20; i++)
+		rtp_opus_rate_update(&r, 51);
+	spa_assert_se(r.bitrate == 8000);
+	spa_assert_se(r.loss > 19.0f && r.loss < 21.0f);
+
+	/* 5% loss keeps the bitrate */
+	rtp_opus_rate_update(&r, 13);
+	spa_assert_se(r.bitrate == 8000);
+
+	/* no loss slowly raises the bitrate again */
+	rtp_opus_rate_update(&r, 0);
+	spa_assert_se(r.bitrate > 8000 && r.bitrate < 9000);
+	for (i = 0; i < 100; i++)
+		rtp_opus_rate_update(&r, 0);
+	spa_assert_se(r.bitrate == 48000);
+	spa_assert_se(r.loss < 1.0f);
+}
+
+/* the gaps are silence and the decoder does not know about the loss,
+ * with packet loss concealment and with concealment and in-band FEC */
+enum {
+	MODE_SILENCE,
+	MODE_PLC,
+	MODE_FEC,
+	MODE_REF,
+	N_MODES,
+};
+
+static const char *mode_names[] = { "silence", "plc", "plc+fec", "lossless" };
+
+struct decoder {
+	OpusMSDecoder *dec;
+	float *out;
+	uint32_t expected;
+	uint64_t fec_frames;
+};
+
+static void decode(struct decoder *d, uint32_t mode, const uint8_t *data, int32_t len,
+		uint32_t timestamp, bool lost)
+{
+	uint32_t gap = timestamp - d->expected, fec = 0;
+	int res;
+
+	spa_assert_se(timestamp + FRAMES <= N_PACKETS * FRAMES);
+	if (gap > 0) {
+		if (mode == MODE_SILENCE)
+			memset(&d->out[d->expected], 0, gap * sizeof(float));
+		else
+			rtp_opus_conceal(d->dec, data, len, mode == MODE_FEC && lost,
+					RATE, 1, &d->out[d->expected], gap, &fec);
+		d->fec_frames += fec;
+	}
+	res = opus_multistream_decode_float(d->dec, data, len,
+			&d->out[timestamp], RTP_OPUS_MAX_FRAMES, 0);
+	spa_assert_se(res == FRAMES);
+	d->expected = timestamp + res;
+}
+
+static double snr(const float *ref, const float *out, uint32_t n)
+{
+	double sig = 0.0, err = 0.0;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		sig += ref[i] * ref[i];
+		err += (ref[i] - out[i]) * (ref[i] - out[i]);
+	}
+	return 10.0 * log10(sig / SPA_MAX(err, 1e-20));
+}
+
+/* send opus over UDP loopback with packet loss and send back the
+ * receiver reports */
+static void test_loopback(void)
+{
+	struct sockaddr_in addr, from;
+	socklen_t alen = sizeof(addr);
+	int rx, tx, err;
+	unsigned char mapping[1] = { 0 };
+	OpusMSEncoder *enc;
+	struct decoder d[N_MODES];
+	struct rtp_loss_stats stats;
+	struct rtp_opus_rate rate;
+	float pcm[FRAMES];
+	uint8_t packet[1280], buffer[1280];
+	struct rtp_header *hdr = (struct rtp_header*)packet;
+	uint32_t i, j, n_lost = 0, n_reports = 0, timestamp;
+	uint16_t seq;
+	uint8_t fraction;
+	double res[N_MODES];
+	ssize_t len;
+
+	spa_assert_se((rx = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+	spa_assert_se((tx = socket(AF_INET, SOCK_DGRAM, 0)) >= 0);
+	spa_zero(addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	spa_assert_se(bind(rx, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+	spa_assert_se(getsockname(rx, (struct sockaddr*)&addr, &alen) == 0);
+	spa_assert_se(connect(tx, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+
+	enc = opus_multistream_encoder_create(RATE, 1, 1, 0, mapping,
+			OPUS_APPLICATION_AUDIO, &err);
+	spa_assert_se(enc != NULL);
+	spa_assert_se(rtp_opus_encoder_setup(enc, BITRATE, true, false, LOSS_PERC) == OPUS_OK);
+	opus_multistream_encoder_ctl(enc, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+
+	for (i = 0; i < N_MODES; i++) {
+		d[i].dec = opus_multistream_decoder_create(RATE, 1, 1, 0, mapping, &err);
+		spa_assert_se(d[i].dec != NULL);
+		spa_assert_se((d[i].out = calloc(N_PACKETS * FRAMES, sizeof(float))) != NULL);
+		d[i].expected = 0;
+		d[i].fec_frames = 0;
+	}
+	spa_zero(stats);
+	rtp_opus_rate_init(&rate, 8000, BITRATE, LOSS_PERC);
+
+	for (i = 0; i < N_PACKETS; i++) {
+		make_signal(pcm, FRAMES, 1, i * FRAMES);
+
+		spa_zero(*hdr);
+		hdr->v = 2;
+		hdr->pt = 127;
+		hdr->sequence_number = htons(i);
+		hdr->timestamp = htonl(i * FRAMES);
+		hdr->ssrc = htonl(0x11223344);
+		err = opus_multistream_encode_float(enc, pcm, FRAMES,
+				packet + sizeof(*hdr), sizeof(packet) - sizeof(*hdr));
+		spa_assert_se(err > 0);
+		len = sizeof(*hdr) + err;
+
+		/* the reference decodes all packets */
+		decode(&d[MODE_REF], MODE_REF, packet + sizeof(*hdr), err, i * FRAMES, false);
+
+		if (i > 0 && i < N_PACKETS - 1 && rnd() % 100 < LOSS_PERC)
+			n_lost++;
+		else
+			spa_assert_se(send(tx, packet, len, 0) == len);
+
+		/* the loopback delivers the packet in the send */
+		alen = sizeof(from);
+		len = recvfrom(rx, buffer, sizeof(buffer), MSG_DONTWAIT,
+				(struct sockaddr*)&from, &alen);
+		if (len >= 0) {
+			spa_assert_se(len > (ssize_t)sizeof(*hdr));
+			spa_assert_se(!rtcp_is_rtcp(buffer, len));
+
+			hdr = (struct rtp_header*)buffer;
+			seq = ntohs(hdr->sequence_number);
+			timestamp = ntohl(hdr->timestamp);
+			rtp_loss_stats_update(&stats, seq);
+
+			for (j = 0; j < MODE_REF; j++)
+				decode(&d[j], j, buffer + sizeof(*hdr), len - sizeof(*hdr),
+						timestamp, seq != d[j].expected / FRAMES);
+			hdr = (struct rtp_header*)packet;
+		} else {
+			spa_assert_se(errno == EAGAIN);
+		}
+
+		/* a report every second, back to where the packets came from */
+		if (i % 50 == 49) {
+			len = rtcp_build_rr(&stats, 1, 0x11223344, buffer, sizeof(buffer), &fraction);
+			spa_assert_se(sendto(rx, buffer, len, 0, (struct sockaddr*)&from, alen) == len);
+
+			len = recv(tx, buffer, sizeof(buffer), 0);
+			spa_assert_se(rtcp_is_rtcp(buffer, len));
+			spa_assert_se(rtcp_parse_rr(buffer, len, 0x11223344, &fraction) == 1);
+			rtp_opus_rate_update(&rate, fraction);
+			n_reports++;
+		}
+	}
+	for (i = 0; i < N_MODES; i++)
+		res[i] = snr(d[MODE_REF].out, d[i].out, N_PACKETS * FRAMES);
+
+	fprintf(stderr, "lost %u/%u packets, %u reports, bitrate:%.0f loss:%.1f%%\n",
+			n_lost, N_PACKETS, n_reports, rate.bitrate, rate.loss);
+	for (i = 0; i < MODE_REF; i++)
+		fprintf(stderr, "  %-8s SNR %6.2f dB, %"PRIu64" frames recovered by FEC\n",
+				mode_names[i], res[i], d[i].fec_frames);
+
+	spa_assert_se(n_lost > 0);
+	spa_assert_se(n_reports == N_PACKETS / 50);
+	spa_assert_se(rate.loss > 2.0f);
+	spa_assert_se(d[MODE_FEC].fec_frames > 0);
+	spa_assert_se(res[MODE_FEC] > res[MODE_SILENCE]);
+
+	opus_multistream_encoder_destroy(enc);
+	for (i = 0; i < N_MODES; i++) {
+		opus_multistream_decoder_destroy(d[i].dec);
+		free(d[i].out);
+	}
+	close(rx);
+	close(tx);
+}
+
+/*
+ * The time spent in the data loop per cycle, when the encoder runs in
+ * the cycle and when it runs in a thread that is woken with an eventfd.
+ */
+#define CYCLE_CHANNELS	2
+#define CYCLE_QUANTUM	256
+#define CYCLE_COUNT	4000
+#define CYCLE_SIZE	(1u << 20)
+
+struct cycle {
+	OpusMSEncoder *enc;
+	struct spa_ringbuffer ring;
+	float *buffer;
+	int fd;
+	uint32_t n_packets;
+	volatile bool done;
+};
+
+static void cycle_encode(struct cycle *c)
+{
+	float pcm[FRAMES * CYCLE_CHANNELS];
+	uint8_t out[1280];
+	uint32_t index;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&c->ring, &index);
+	while (avail >= FRAMES) {
+		spa_ringbuffer_read_data(&c->ring, c->buffer, CYCLE_SIZE,
+				(index * sizeof(pcm) / FRAMES) & (CYCLE_SIZE - 1),
+				pcm, sizeof(pcm));
+		spa_assert_se(opus_multistream_encode_float(c->enc, pcm, FRAMES,
+					out, sizeof(out)) > 0);
+		index += FRAMES;
+		avail -= FRAMES;
+		c->n_packets++;
+	}
+	spa_ringbuffer_read_update(&c->ring, index);
+}
+
+static void *cycle_thread(void *data)
+{
+	struct cycle *c = data;
+	uint64_t count;
+
+	while (read(c->fd, &count, sizeof(count)) == sizeof(count) && !c->done)
+		cycle_encode(c);
+	return NULL;
+}
+
+static double run_cycles(bool threaded, double *max)
+{
+	struct cycle c;
+	unsigned char mapping[2] = { 0, 1 };
+	float pcm[CYCLE_QUANTUM * CYCLE_CHANNELS];
+	uint32_t i, index, stride = CYCLE_CHANNELS * sizeof(float);
+	uint64_t one = 1;
+	pthread_t thread;
+	double total = 0.0, t;
+	int err;
+
+	spa_zero(c);
+	c.enc = opus_multistream_encoder_create(RATE, CYCLE_CHANNELS, CYCLE_CHANNELS, 0,
+			mapping, OPUS_APPLICATION_AUDIO, &err);
+	spa_assert_se(c.enc != NULL);
+	spa_assert_se(rtp_opus_encoder_setup(c.enc, 96000, true, false, LOSS_PERC) == OPUS_OK);
+	spa_assert_se((c.buffer = calloc(1, CYCLE_SIZE)) != NULL);
+	spa_ringbuffer_init(&c.ring);
+	spa_assert_se((c.fd = eventfd(0, EFD_CLOEXEC)) >= 0);
+	if (threaded)
+		spa_assert_se(pthread_create(&thread, NULL, cycle_thread, &c) == 0);
+
+	*max = 0.0;
+	for (i = 0; i < CYCLE_COUNT; i++) {
+		make_signal(pcm, CYCLE_QUANTUM, CYCLE_CHANNELS, i * CYCLE_QUANTUM);
+
+		t = get_time();
+		spa_ringbuffer_get_write_index(&c.ring, &index);
+		spa_ringbuffer_write_data(&c.ring, c.buffer, CYCLE_SIZE,
+				(index * stride) & (CYCLE_SIZE - 1), pcm, sizeof(pcm));
+		spa_ringbuffer_write_update(&c.ring, index + CYCLE_QUANTUM);
+		if (threaded)
+			spa_assert_se(write(c.fd, &one, sizeof(one)) == sizeof(one));
+		else
+			cycle_encode(&c);
+		t = get_time() - t;
+
+		total += t;
+		*max = SPA_MAX(*max, t);
+	}
+	if (threaded) {
+		c.done = true;
+		spa_assert_se(write(c.fd, &one, sizeof(one)) == sizeof(one));
+		pthread_join(thread, NULL);
+	}
+	spa_assert_se(c.n_packets > 0);
+
+	close(c.fd);
+	free(c.buffer);
+	opus_multistream_encoder_destroy(c.enc);
+
+	return total / CYCLE_COUNT;
+}
+
+static void test_cycle_time(void)
+{
+	double avg_rt, max_rt, avg_thread, max_thread;
+
+	avg_rt = run_cycles(false, &max_rt);
+	avg_thread = run_cycles(true, &max_thread);
+
+	fprintf(stderr, "data loop time per cycle: encode in cycle avg:%.1fus max:%.1fus, "
+			"encode in thread avg:%.1fus max:%.1fus\n",
+			avg_rt * 1e6, max_rt * 1e6, avg_thread * 1e6, max_thread * 1e6);
+
+	spa_assert_se(avg_thread < avg_rt);
+}
+
+int main(int argc, char *argv[])
+{
+	test_rr();
+	test_rate();
+	test_loopback();
+	test_cycle_time();
+	return 0;
+}
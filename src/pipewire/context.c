@@ -17,6 +17,8 @@
 #include <spa/support/plugin.h>
 #include <spa/support/plugin-loader.h>
 #include <spa/node/utils.h>
+#include <spa/pod/dynamic.h>
+#include <spa/pod/filter.h>
 #include <spa/utils/names.h>
 #include <spa/utils/string.h>
 #include <spa/debug/types.h>
@@ -36,12 +38,21 @@ struct impl {
 	struct pw_context this;
 	struct spa_handle *dbus_handle;
 	struct spa_plugin_loader plugin_loader;
+	struct spa_thread_utils thread_utils;
 	unsigned int recalc:1;
 	unsigned int recalc_pending:1;
 
 	struct pw_data_loop *data_loop_impl;
+
+	struct spa_source *latency_event;
+	struct spa_list latency_list;
+	uint32_t latency_pass;
 };
 
+/* Latency updates that keep requeueing ports after this many rounds are
+ * assumed to be oscillating and are dropped. */
+#define MAX_LATENCY_ROUNDS	64
+
 
 struct factory_entry {
 	regex_t regex;
@@ -143,6 +154,58 @@ static void init_plugin_loader(struct impl *impl)
 		impl);
 }
 
+/* the thread utils of the plugins follow the ones configured in the context,
+ * the realtime module installs them after the plugins got their support */
+static struct spa_thread_utils *get_thread_utils(struct impl *impl)
+{
+	return impl->this.thread_utils ? impl->this.thread_utils : pw_thread_utils_get();
+}
+
+static struct spa_thread *impl_thread_create(void *object, const struct spa_dict *props,
+		void *(*start)(void*), void *arg)
+{
+	return spa_thread_utils_create(get_thread_utils(object), props, start, arg);
+}
+
+static int impl_thread_join(void *object, struct spa_thread *thread, void **retval)
+{
+	return spa_thread_utils_join(get_thread_utils(object), thread, retval);
+}
+
+static int impl_thread_get_rt_range(void *object, const struct spa_dict *props,
+		int *min, int *max)
+{
+	return spa_thread_utils_get_rt_range(get_thread_utils(object), props, min, max);
+}
+
+static int impl_thread_acquire_rt(void *object, struct spa_thread *thread, int priority)
+{
+	return spa_thread_utils_acquire_rt(get_thread_utils(object), thread, priority);
+}
+
+static int impl_thread_drop_rt(void *object, struct spa_thread *thread)
+{
+	return spa_thread_utils_drop_rt(get_thread_utils(object), thread);
+}
+
+static const struct spa_thread_utils_methods impl_thread_utils = {
+	SPA_VERSION_THREAD_UTILS_METHODS,
+	.create = impl_thread_create,
+	.join = impl_thread_join,
+	.get_rt_range = impl_thread_get_rt_range,
+	.acquire_rt = impl_thread_acquire_rt,
+	.drop_rt = impl_thread_drop_rt,
+};
+
+static void init_thread_utils(struct impl *impl)
+{
+	impl->thread_utils.iface = SPA_INTERFACE_INIT(
+		SPA_TYPE_INTERFACE_ThreadUtils,
+		SPA_VERSION_THREAD_UTILS,
+		&impl_thread_utils,
+		impl);
+}
+
 static int do_data_loop_setup(struct spa_loop *loop, bool async, uint32_t seq,
 		const void *data, size_t size, void *user_data)
 {
@@ -160,6 +223,120 @@ static int do_data_loop_setup(struct spa_loop *loop, bool async, uint32_t seq,
 	return 0;
 }
 
+/* Number of hops from the node to the start (input) or the end (output)
+ * of the graph, computed once per latency pass. */
+static uint32_t node_latency_depth(struct pw_impl_node *node, enum pw_direction direction,
+		uint32_t pass)
+{
+	struct pw_impl_port *p;
+	struct pw_impl_link *l;
+	uint32_t depth = 0;
+
+	if (node == NULL)
+		return 0;
+	if (node->latency_pass[direction] == pass)
+		return node->latency_depth[direction];
+
+	/* mark as visited first, in case the graph has loops */
+	node->latency_pass[direction] = pass;
+	node->latency_depth[direction] = 0;
+
+	if (direction == PW_DIRECTION_INPUT) {
+		spa_list_for_each(p, &node->input_ports, link)
+			spa_list_for_each(l, &p->links, input_link)
+				if (!l->feedback)
+					depth = SPA_MAX(depth, node_latency_depth(l->output->node,
+								direction, pass) + 1);
+	} else {
+		spa_list_for_each(p, &node->output_ports, link)
+			spa_list_for_each(l, &p->links, output_link)
+				if (!l->feedback)
+					depth = SPA_MAX(depth, node_latency_depth(l->input->node,
+								direction, pass) + 1);
+	}
+	node->latency_depth[direction] = depth;
+	return depth;
+}
+
+static void do_latency_pass(void *data, uint64_t count)
+{
+	struct impl *impl = data;
+	struct pw_context *this = &impl->this;
+	struct pw_impl_port *port, *p;
+	struct spa_list round;
+	struct timespec ts[2];
+	uint32_t rounds = 0, n_ports = 0, n_changed = 0, n_sent = 0;
+	uint64_t elapsed_us;
+
+	if (spa_list_is_empty(&impl->latency_list))
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts[0]);
+	spa_list_init(&round);
+
+	/* Updating a port makes its node update the latency of its other ports,
+	 * which queues the peers of those ports again. Keep going until nothing
+	 * changes anymore. */
+	while (!spa_list_is_empty(&impl->latency_list)) {
+		if (rounds++ == MAX_LATENCY_ROUNDS) {
+			pw_log_warn("%p: latency did not settle after %d rounds",
+					this, MAX_LATENCY_ROUNDS);
+			spa_list_consume(port, &impl->latency_list, latency_link) {
+				spa_list_remove(&port->latency_link);
+				port->latency_queued = false;
+			}
+			break;
+		}
+		impl->latency_pass++;
+
+		/* The input latency of a port depends on the ports upstream and
+		 * the output latency on the ports downstream, update those first */
+		spa_list_consume(port, &impl->latency_list, latency_link) {
+			uint32_t depth = node_latency_depth(port->node, port->direction,
+					impl->latency_pass);
+
+			spa_list_remove(&port->latency_link);
+			spa_list_for_each(p, &round, latency_link)
+				if (node_latency_depth(p->node, p->direction, impl->latency_pass) > depth)
+					break;
+			spa_list_append(&p->latency_link, &port->latency_link);
+		}
+
+		spa_list_consume(port, &round, latency_link) {
+			spa_list_remove(&port->latency_link);
+			port->latency_queued = false;
+			if (port->node == NULL)
+				continue;
+
+			n_ports++;
+			if (pw_impl_port_recalc_latency(port) > 0) {
+				n_changed++;
+				if (port->have_latency_param)
+					n_sent++;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts[1]);
+	elapsed_us = (SPA_TIMESPEC_TO_NSEC(&ts[1]) - SPA_TIMESPEC_TO_NSEC(&ts[0])) / SPA_NSEC_PER_USEC;
+
+	pw_log_info("%p: latency pass: %u rounds %u ports %u changed %u params %"PRIu64"us",
+			this, rounds, n_ports, n_changed, n_sent, elapsed_us);
+}
+
+void pw_context_queue_latency(struct pw_context *context, struct pw_impl_port *port)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+
+	if (port->latency_queued || port->destroying)
+		return;
+
+	if (spa_list_is_empty(&impl->latency_list))
+		pw_loop_signal_event(context->main_loop, impl->latency_event);
+
+	spa_list_append(&impl->latency_list, &port->latency_link);
+	port->latency_queued = true;
+}
+
 /** Create a new context object
  *
  * \param main_loop the main loop to use
@@ -189,6 +366,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	}
 
 	this = &impl->this;
+	spa_list_init(&impl->latency_list);
 
 	pw_log_debug("%p: new", this);
 
@@ -300,7 +478,14 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		goto error_free;
 	}
 
+	impl->latency_event = pw_loop_add_event(this->main_loop, do_latency_pass, impl);
+	if (impl->latency_event == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
 	init_plugin_loader(impl);
+	init_thread_utils(impl);
 
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, this->main_loop->system);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_Loop, this->main_loop->loop);
@@ -308,6 +493,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataSystem, this->data_system);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, this->data_loop->loop);
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_PluginLoader, &impl->plugin_loader);
+	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_ThreadUtils, &impl->thread_utils);
 
 	if ((str = pw_properties_get(properties, "support.dbus")) == NULL ||
 	    pw_properties_parse_bool(str)) {
@@ -439,6 +625,9 @@ void pw_context_destroy(struct pw_context *context)
 	if (context->work_queue)
 		pw_work_queue_destroy(context->work_queue);
 
+	if (impl->latency_event)
+		pw_loop_destroy_source(context->main_loop, impl->latency_event);
+
 	pw_properties_free(context->properties);
 	pw_properties_free(context->conf);
 
@@ -671,6 +860,62 @@ SPA_PRINTF_FUNC(7, 8) int pw_context_debug_port_params(struct pw_context *this,
         return 0;
 }
 
+/* Enumerate all formats of a port once, so that the formats of the peer
+ * that can't match any of them are skipped before the node filters them */
+static int port_format_keys(struct pw_impl_port *port,
+		struct spa_pod_dynamic_builder *b, struct pw_array *keys)
+{
+	struct pw_array offsets;
+	struct spa_pod_filter_key *key;
+	struct spa_pod *param;
+	uint32_t idx = 0, *o;
+	int res;
+
+	pw_array_init(&offsets, 64 * sizeof(uint32_t));
+
+	while ((res = spa_node_port_enum_params_sync(port->node->node,
+					port->direction, port->port_id,
+					SPA_PARAM_EnumFormat, &idx,
+					NULL, &param, &b->b)) == 1) {
+		/* the builder can move, keep the offsets */
+		if ((o = pw_array_add(&offsets, sizeof(uint32_t))) == NULL) {
+			res = -errno;
+			goto done;
+		}
+		*o = SPA_PTRDIFF(param, b->b.data);
+	}
+	if (res < 0)
+		goto done;
+
+	pw_array_for_each(o, &offsets) {
+		if ((key = pw_array_add(keys, sizeof(*key))) == NULL) {
+			res = -errno;
+			goto done;
+		}
+		spa_pod_filter_key_init(key, SPA_PTROFF(b->b.data, *o, struct spa_pod));
+	}
+	res = pw_array_get_len(keys, struct spa_pod_filter_key);
+done:
+	pw_array_clear(&offsets);
+	return res;
+}
+
+static bool format_can_match(struct pw_array *keys, const struct spa_pod *filter)
+{
+	struct spa_pod_filter_key fkey, *key;
+
+	if (filter == NULL || pw_array_get_len(keys, struct spa_pod_filter_key) == 0)
+		return true;
+
+	spa_pod_filter_key_init(&fkey, filter);
+	pw_array_for_each(key, keys) {
+		if (spa_pod_filter_key_match(key, &fkey) &&
+		    spa_pod_filter_compatible(key->pod, filter))
+			return true;
+	}
+	return false;
+}
+
 /** Find a common format between two ports
  *
  * \param context a context object
@@ -701,8 +946,13 @@ int pw_context_find_format(struct pw_context *context,
 	int res;
 	uint32_t iidx = 0, oidx = 0;
 	struct spa_pod_builder fb = { 0 };
-	uint8_t fbuf[4096];
+	uint8_t fbuf[4096], obuf[4096];
 	struct spa_pod *filter;
+	struct spa_pod_dynamic_builder ob;
+	struct pw_array okeys;
+
+	spa_pod_dynamic_builder_init(&ob, obuf, sizeof(obuf), 4096);
+	pw_array_init(&okeys, 64 * sizeof(struct spa_pod_filter_key));
 
 	out_state = output->state;
 	in_state = input->state;
@@ -776,6 +1026,12 @@ int pw_context_find_format(struct pw_context *context,
 			}
 		}
 	} else if (in_state == PW_IMPL_PORT_STATE_CONFIGURE && out_state == PW_IMPL_PORT_STATE_CONFIGURE) {
+		/* without the output formats nothing is skipped */
+		if ((res = port_format_keys(output, &ob, &okeys)) < 0) {
+			pw_log_debug("%p: can't enum output formats: %s", context,
+					spa_strerror(res));
+			pw_array_reset(&okeys);
+		}
 	      again:
 		/* both ports need a format */
 		pw_log_debug("%p: do enum input %d", context, iidx);
@@ -795,6 +1051,11 @@ int pw_context_find_format(struct pw_context *context,
 				goto error;
 			}
 		}
+		if (!format_can_match(&okeys, filter)) {
+			pw_log_debug("%p: skip input format %d", context, iidx);
+			goto again;
+		}
+
 		pw_log_debug("%p: enum output %d with filter: %p", context, oidx, filter);
 		pw_log_format(SPA_LOG_LEVEL_DEBUG, filter);
 
@@ -817,11 +1078,14 @@ int pw_context_find_format(struct pw_context *context,
 		*error = spa_aprintf("error bad node state");
 		goto error;
 	}
+done:
+	pw_array_clear(&okeys);
+	spa_pod_dynamic_builder_clean(&ob);
 	return res;
 error:
 	if (res == 0)
 		res = -EINVAL;
-	return res;
+	goto done;
 }
 
 static int ensure_state(struct pw_impl_node *node, bool running)
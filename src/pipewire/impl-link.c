@@ -101,6 +101,7 @@ static void pw_node_peer_activate(struct pw_node_peer *peer)
 			state->required++;
 			peer->target.active = true;
 		}
+		pw_impl_node_update_targets(peer->output);
 	}
 	pw_log_trace("%p: node:%s state:%p pending:%d/%d", peer->output,
 			peer->target.name, state, state->pending, state->required);
@@ -118,6 +119,7 @@ static void pw_node_peer_deactivate(struct pw_node_peer *peer)
 			state->required--;
 			peer->target.active = false;
 		}
+		pw_impl_node_update_targets(peer->output);
 	}
 	pw_log_trace("%p: node:%s state:%p pending:%d/%d", peer->output,
 			peer->target.name, state, state->pending, state->required);
@@ -672,6 +674,7 @@ int pw_impl_link_activate(struct pw_impl_link *this)
 			return res;
 		impl->io_set = true;
 	}
+	pw_impl_node_reserve_targets(this->output->node, 0);
 	pw_loop_invoke(this->output->node->data_loop,
 	       do_activate_link, SPA_ID_INVALID, NULL, 0, false, this);
 
@@ -775,7 +778,7 @@ static void input_remove(struct pw_impl_link *this, struct pw_impl_port *port)
 	spa_list_remove(&this->input_link);
 	pw_impl_port_emit_link_removed(this->input, this);
 
-	pw_impl_port_recalc_latency(this->input);
+	pw_context_queue_latency(this->context, this->input);
 
 	if ((res = pw_impl_port_use_buffers(port, mix, 0, NULL, 0)) < 0) {
 		pw_log_warn("%p: port %p clear error %s", this, port, spa_strerror(res));
@@ -804,7 +807,7 @@ static void output_remove(struct pw_impl_link *this, struct pw_impl_port *port)
 	spa_list_remove(&this->output_link);
 	pw_impl_port_emit_link_removed(this->output, this);
 
-	pw_impl_port_recalc_latency(this->output);
+	pw_context_queue_latency(this->context, this->output);
 
 	/* we don't clear output buffers when the link goes away. They will get
 	 * cleared when the node goes to suspend */
@@ -993,7 +996,7 @@ static void input_port_latency_changed(void *data)
 	struct impl *impl = data;
 	struct pw_impl_link *this = &impl->this;
 	if (!this->feedback)
-		pw_impl_port_recalc_latency(this->output);
+		pw_context_queue_latency(this->context, this->output);
 }
 
 static void output_port_latency_changed(void *data)
@@ -1001,7 +1004,7 @@ static void output_port_latency_changed(void *data)
 	struct impl *impl = data;
 	struct pw_impl_link *this = &impl->this;
 	if (!this->feedback)
-		pw_impl_port_recalc_latency(this->input);
+		pw_context_queue_latency(this->context, this->input);
 }
 
 static const struct pw_impl_port_events input_port_events = {
@@ -1313,8 +1316,8 @@ struct pw_impl_link *pw_context_create_link(struct pw_context *context,
 
 	try_link_controls(impl, output, input);
 
-	pw_impl_port_recalc_latency(output);
-	pw_impl_port_recalc_latency(input);
+	pw_context_queue_latency(context, output);
+	pw_context_queue_latency(context, input);
 
 	if (impl->onode != impl->inode)
 		this->peer = pw_node_peer_ref(impl->onode, impl->inode);
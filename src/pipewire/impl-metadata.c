@@ -21,33 +21,263 @@ PW_LOG_TOPIC_EXTERN(log_metadata);
 
 #define pw_metadata_emit_property(hooks,...)	pw_metadata_emit(hooks,property, 0, ##__VA_ARGS__)
 
-struct metadata {
-	struct spa_interface iface;
-	struct pw_array storage;
-	struct spa_hook_list hooks;		/**< event listeners */
+struct subject {
+	struct subject *next;		/**< next in hash bucket */
+	uint32_t id;
+	struct spa_list items;		/**< items of the subject */
+	struct spa_list clear_link;	/**< in cleared list of the batch */
+	unsigned int cleared:1;
 };
 
 struct item {
+	struct item *next;		/**< next in hash bucket */
+	struct spa_list link;		/**< in all items, in the order they were added */
+	struct spa_list subject_link;	/**< in items of the subject */
+	struct spa_list pending_link;	/**< in pending list of the batch */
+	struct subject *s;
+	uint32_t hash;
+	uint32_t subject;
+	char *key;
+	char *type;
+	char *value;			/**< NULL when removed in the current batch */
+	unsigned int pending:1;
+};
+
+struct change {
 	uint32_t subject;
 	char *key;
 	char *type;
 	char *value;
 };
 
-static void clear_item(struct item *item)
+struct metadata {
+	struct spa_interface iface;
+	struct spa_list items;
+	struct spa_hook_list hooks;		/**< event listeners */
+
+	/* hash index on (subject, key) */
+	struct item **item_hash;
+	uint32_t item_mask;
+	uint32_t n_items;
+
+	/* hash index on subject */
+	struct subject **subject_hash;
+	uint32_t subject_mask;
+	uint32_t n_subjects;
+
+	/* changes are applied right away, the events are emitted when the
+	 * outermost batch is committed */
+	uint32_t batch;
+	struct spa_list pending;
+	struct spa_list cleared;
+};
+
+#define INITIAL_HASH_SIZE	64
+
+static uint32_t hash_key(uint32_t subject, const char *key)
+{
+	uint32_t h = 0x811c9dc5 ^ subject;
+	while (*key) {
+		h ^= (uint8_t)*key++;
+		h *= 0x01000193;
+	}
+	return h;
+}
+
+static inline uint32_t hash_subject(uint32_t subject)
+{
+	return subject * 0x9e3779b1;
+}
+
+static int grow_item_hash(struct metadata *this)
 {
+	uint32_t i, size = this->item_hash ? (this->item_mask + 1) * 2 : INITIAL_HASH_SIZE;
+	struct item **hash, *item, *next;
+
+	if ((hash = calloc(size, sizeof(*hash))) == NULL)
+		return -errno;
+
+	for (i = 0; this->item_hash && i <= this->item_mask; i++) {
+		for (item = this->item_hash[i]; item; item = next) {
+			next = item->next;
+			item->next = hash[item->hash & (size - 1)];
+			hash[item->hash & (size - 1)] = item;
+		}
+	}
+	free(this->item_hash);
+	this->item_hash = hash;
+	this->item_mask = size - 1;
+	return 0;
+}
+
+static int grow_subject_hash(struct metadata *this)
+{
+	uint32_t i, size = this->subject_hash ? (this->subject_mask + 1) * 2 : INITIAL_HASH_SIZE;
+	struct subject **hash, *s, *next;
+
+	if ((hash = calloc(size, sizeof(*hash))) == NULL)
+		return -errno;
+
+	for (i = 0; this->subject_hash && i <= this->subject_mask; i++) {
+		for (s = this->subject_hash[i]; s; s = next) {
+			uint32_t b = hash_subject(s->id) & (size - 1);
+			next = s->next;
+			s->next = hash[b];
+			hash[b] = s;
+		}
+	}
+	free(this->subject_hash);
+	this->subject_hash = hash;
+	this->subject_mask = size - 1;
+	return 0;
+}
+
+static struct subject *find_subject(struct metadata *this, uint32_t subject)
+{
+	struct subject *s;
+
+	if (this->subject_hash == NULL)
+		return NULL;
+
+	for (s = this->subject_hash[hash_subject(subject) & this->subject_mask]; s; s = s->next)
+		if (s->id == subject)
+			return s;
+	return NULL;
+}
+
+static struct subject *add_subject(struct metadata *this, uint32_t subject)
+{
+	struct subject *s;
+	uint32_t b;
+
+	if (this->n_subjects >= this->subject_mask / 2 + 1 || this->subject_hash == NULL)
+		if (grow_subject_hash(this) < 0)
+			return NULL;
+
+	if ((s = calloc(1, sizeof(*s))) == NULL)
+		return NULL;
+
+	s->id = subject;
+	spa_list_init(&s->items);
+	b = hash_subject(subject) & this->subject_mask;
+	s->next = this->subject_hash[b];
+	this->subject_hash[b] = s;
+	this->n_subjects++;
+	return s;
+}
+
+static void free_subject(struct metadata *this, struct subject *s)
+{
+	struct subject **p;
+
+	for (p = &this->subject_hash[hash_subject(s->id) & this->subject_mask]; *p; p = &(*p)->next) {
+		if (*p == s) {
+			*p = s->next;
+			break;
+		}
+	}
+	this->n_subjects--;
+	free(s);
+}
+
+static struct item *find_item(struct metadata *this, uint32_t subject, const char *key, uint32_t hash)
+{
+	struct item *item;
+
+	if (this->item_hash == NULL)
+		return NULL;
+
+	for (item = this->item_hash[hash & this->item_mask]; item; item = item->next)
+		if (item->hash == hash && item->subject == subject && spa_streq(item->key, key))
+			return item;
+	return NULL;
+}
+
+static struct item *add_item(struct metadata *this, uint32_t subject, const char *key, uint32_t hash)
+{
+	struct item *item;
+	struct subject *s;
+	uint32_t b;
+
+	if (this->n_items >= this->item_mask / 2 + 1 || this->item_hash == NULL)
+		if (grow_item_hash(this) < 0)
+			return NULL;
+
+	if ((s = find_subject(this, subject)) == NULL &&
+	    (s = add_subject(this, subject)) == NULL)
+		return NULL;
+
+	if ((item = calloc(1, sizeof(*item))) == NULL)
+		goto error;
+	if ((item->key = strdup(key)) == NULL)
+		goto error_free;
+
+	item->s = s;
+	item->hash = hash;
+	item->subject = subject;
+	b = hash & this->item_mask;
+	item->next = this->item_hash[b];
+	this->item_hash[b] = item;
+	this->n_items++;
+	spa_list_append(&this->items, &item->link);
+	spa_list_append(&s->items, &item->subject_link);
+	return item;
+
+error_free:
+	free(item);
+error:
+	if (spa_list_is_empty(&s->items) && !s->cleared)
+		free_subject(this, s);
+	return NULL;
+}
+
+static void free_item(struct metadata *this, struct item *item)
+{
+	struct subject *s = item->s;
+	struct item **p;
+
+	for (p = &this->item_hash[item->hash & this->item_mask]; *p; p = &(*p)->next) {
+		if (*p == item) {
+			*p = item->next;
+			break;
+		}
+	}
+	this->n_items--;
+	spa_list_remove(&item->link);
+	spa_list_remove(&item->subject_link);
+	if (item->pending)
+		spa_list_remove(&item->pending_link);
+
 	free(item->key);
 	free(item->type);
 	free(item->value);
-	spa_zero(*item);
+	free(item);
+
+	if (spa_list_is_empty(&s->items) && !s->cleared)
+		free_subject(this, s);
 }
 
-static void set_item(struct item *item, uint32_t subject, const char *key, const char *type, const char *value)
+static void mark_pending(struct metadata *this, struct item *item)
 {
-	item->subject = subject;
-	item->key = strdup(key);
-	item->type = type ? strdup(type) : NULL;
-	item->value = strdup(value);
+	if (!item->pending) {
+		spa_list_append(&this->pending, &item->pending_link);
+		item->pending = true;
+	}
+}
+
+static void unmark_pending(struct item *item)
+{
+	if (item->pending) {
+		spa_list_remove(&item->pending_link);
+		item->pending = false;
+	}
+}
+
+static void remove_item(struct item *item)
+{
+	free(item->type);
+	free(item->value);
+	item->type = item->value = NULL;
 }
 
 static int change_item(struct item *item, const char *type, const char *value)
@@ -69,7 +299,9 @@ static int change_item(struct item *item, const char *type, const char *value)
 static void emit_properties(struct metadata *this)
 {
 	struct item *item;
-	pw_array_for_each(item, &this->storage) {
+	spa_list_for_each(item, &this->items, link) {
+		if (item->value == NULL)
+			continue;
 		pw_log_debug("metadata %p: %d %s %s %s",
 				this, item->subject, item->key, item->type, item->value);
 		pw_metadata_emit_property(&this->hooks,
@@ -102,85 +334,150 @@ static int impl_add_listener(void *object,
         return 0;
 }
 
-static struct item *find_item(struct pw_array *storage, uint32_t subject, const char *key)
+static void metadata_begin(struct metadata *this)
 {
-	struct item *item;
+	this->batch++;
+}
 
-	pw_array_for_each(item, storage) {
-		if (item->subject == subject && (key == NULL || spa_streq(item->key, key)))
-			return item;
-	}
-	return NULL;
+static int add_change(struct pw_array *changes, uint32_t subject,
+		const char *key, const char *type, const char *value)
+{
+	struct change *c;
+
+	if ((c = pw_array_add(changes, sizeof(*c))) == NULL)
+		return -errno;
+
+	c->subject = subject;
+	c->key = key ? strdup(key) : NULL;
+	c->type = type ? strdup(type) : NULL;
+	c->value = value ? strdup(value) : NULL;
+	return 0;
 }
 
-static int clear_subjects(struct metadata *this, struct pw_array *storage, uint32_t subject)
+/* Emit one event for each cleared subject and for the final value of each
+ * changed item. The events are collected first so that the listeners can
+ * make new changes. */
+static void metadata_commit(struct metadata *this)
 {
-	struct item *item;
-	uint32_t removed = 0;
+	struct pw_array changes;
+	struct subject *s;
+	struct item *item, *t;
+	struct change *c;
 
-	while (true) {
-		item = find_item(storage, subject, NULL);
-		if (item == NULL)
-			break;
+	if (this->batch == 0 || --this->batch > 0)
+		return;
+
+	if (spa_list_is_empty(&this->cleared) && spa_list_is_empty(&this->pending))
+		return;
+
+	pw_array_init(&changes, 64);
 
-		pw_log_debug("%p: remove id:%d key:%s", this, subject, item->key);
+	spa_list_consume(s, &this->cleared, clear_link) {
+		spa_list_remove(&s->clear_link);
 
-		clear_item(item);
-		pw_array_remove(storage, item);
-		removed++;
+		add_change(&changes, s->id, NULL, NULL, NULL);
+
+		/* the pending items of the subject are the ones that were set
+		 * again after clearing */
+		spa_list_for_each_safe(item, t, &s->items, subject_link)
+			if (item->value == NULL && !item->pending)
+				free_item(this, item);
+
+		s->cleared = false;
+		if (spa_list_is_empty(&s->items))
+			free_subject(this, s);
 	}
-	if (removed > 0)
-		pw_metadata_emit_property(&this->hooks, subject, NULL, NULL, NULL);
+	spa_list_consume(item, &this->pending, pending_link) {
+		unmark_pending(item);
 
-	return 0;
+		add_change(&changes, item->subject, item->key, item->type, item->value);
+
+		if (item->value == NULL)
+			free_item(this, item);
+	}
+
+	pw_array_for_each(c, &changes) {
+		pw_metadata_emit_property(&this->hooks,
+				c->subject, c->key, c->type, c->value);
+		free(c->key);
+		free(c->type);
+		free(c->value);
+	}
+	pw_array_clear(&changes);
 }
 
-static void clear_items(struct metadata *this)
+static int clear_subject(struct metadata *this, uint32_t subject)
 {
+	struct subject *s;
 	struct item *item;
-	struct pw_array tmp;
+	uint32_t removed = 0;
 
-	/* copy to tmp and reinitialize the storage so that the callbacks
-	 * will operate on the new empty metadata. Otherwise, if a callbacks
-	 * adds new metadata we just keep on emptying the metadata forever. */
-	tmp = this->storage;
-	pw_array_init(&this->storage, 4096);
+	if ((s = find_subject(this, subject)) == NULL)
+		return 0;
 
-	pw_array_consume(item, &tmp)
-		clear_subjects(this, &tmp, item->subject);
-	pw_array_clear(&tmp);
+	spa_list_for_each(item, &s->items, subject_link) {
+		/* an item removed earlier in the batch still needs its event,
+		 * which the event of the subject covers */
+		if (item->value != NULL || item->pending) {
+			pw_log_debug("%p: remove id:%d key:%s", this, subject, item->key);
+			removed++;
+		}
+		remove_item(item);
+		unmark_pending(item);
+	}
+	if (removed > 0 && !s->cleared) {
+		spa_list_append(&this->cleared, &s->clear_link);
+		s->cleared = true;
+	}
+	return 0;
 }
 
-static int impl_set_property(void *object,
+static void clear_items(struct metadata *this)
+{
+	struct subject *s;
+	uint32_t i;
+
+	/* nothing is freed until the commit */
+	metadata_begin(this);
+	for (i = 0; this->subject_hash && i <= this->subject_mask; i++)
+		for (s = this->subject_hash[i]; s; s = s->next)
+			clear_subject(this, s->id);
+	metadata_commit(this);
+}
+
+static int set_property(struct metadata *this,
 			uint32_t subject,
 			const char *key,
 			const char *type,
 			const char *value)
 {
-	struct metadata *this = object;
-	struct item *item = NULL;
+	struct item *item;
+	uint32_t hash;
 	int changed = 0;
 
-	pw_log_debug("%p: id:%d key:%s type:%s value:%s", this, subject, key, type, value);
-
 	if (key == NULL)
-		return clear_subjects(this, &this->storage, subject);
+		return clear_subject(this, subject);
+
+	hash = hash_key(subject, key);
+	item = find_item(this, subject, key, hash);
 
-	item = find_item(&this->storage, subject, key);
 	if (value == NULL) {
-		if (item != NULL) {
-			clear_item(item);
-			pw_array_remove(&this->storage, item);
-			type = NULL;
+		if (item != NULL && item->value != NULL) {
+			remove_item(item);
 			changed++;
 			pw_log_info("%p: remove id:%d key:%s", this,
 					subject, key);
 		}
-	} else if (item == NULL) {
-		item = pw_array_add(&this->storage, sizeof(*item));
-		if (item == NULL)
+	} else if (item == NULL || item->value == NULL) {
+		if (item == NULL &&
+		    (item = add_item(this, subject, key, hash)) == NULL)
 			return -errno;
-		set_item(item, subject, key, type, value);
+		if ((item->value = strdup(value)) == NULL) {
+			if (!item->pending)
+				free_item(this, item);
+			return -errno;
+		}
+		item->type = type ? strdup(type) : NULL;
 		changed++;
 		pw_log_info("%p: add id:%d key:%s type:%s value:%s", this,
 				subject, key, type, value);
@@ -193,13 +490,29 @@ static int impl_set_property(void *object,
 				subject, key, type, value);
 	}
 
-	if (changed) {
-		pw_metadata_emit_property(&this->hooks,
-					subject, key, type, value);
-	}
+	if (changed)
+		mark_pending(this, item);
 	return 0;
 }
 
+static int impl_set_property(void *object,
+			uint32_t subject,
+			const char *key,
+			const char *type,
+			const char *value)
+{
+	struct metadata *this = object;
+	int res;
+
+	pw_log_debug("%p: id:%d key:%s type:%s value:%s", this, subject, key, type, value);
+
+	metadata_begin(this);
+	res = set_property(this, subject, key, type, value);
+	metadata_commit(this);
+
+	return res;
+}
+
 static int impl_clear(void *object)
 {
 	struct metadata *this = object;
@@ -220,16 +533,26 @@ static struct pw_metadata *metadata_init(struct metadata *this)
 			PW_TYPE_INTERFACE_Metadata,
 			PW_VERSION_METADATA,
 			&impl_metadata, this);
-	pw_array_init(&this->storage, 4096);
+	spa_list_init(&this->items);
+	spa_list_init(&this->pending);
+	spa_list_init(&this->cleared);
         spa_hook_list_init(&this->hooks);
 	return (struct pw_metadata*)&this->iface;
 }
 
 static void metadata_reset(struct metadata *this)
 {
+	struct item *item;
+
 	spa_hook_list_clean(&this->hooks);
+	this->batch = 0;
 	clear_items(this);
-	pw_array_clear(&this->storage);
+	spa_list_consume(item, &this->items, link)
+		free_item(this, item);
+	free(this->item_hash);
+	free(this->subject_hash);
+	this->item_hash = NULL;
+	this->subject_hash = NULL;
 }
 
 struct impl {
@@ -605,3 +928,25 @@ int pw_impl_metadata_set_propertyf(struct pw_impl_metadata *metadata,
 
 	return res;
 }
+
+SPA_EXPORT
+int pw_impl_metadata_begin(struct pw_impl_metadata *metadata)
+{
+	struct impl *impl = SPA_CONTAINER_OF(metadata, struct impl, this);
+	if (metadata->metadata != (struct pw_metadata*)&impl->def.iface)
+		return -ENOTSUP;
+	metadata_begin(&impl->def);
+	return 0;
+}
+
+SPA_EXPORT
+int pw_impl_metadata_commit(struct pw_impl_metadata *metadata)
+{
+	struct impl *impl = SPA_CONTAINER_OF(metadata, struct impl, this);
+	if (metadata->metadata != (struct pw_metadata*)&impl->def.iface)
+		return -ENOTSUP;
+	if (impl->def.batch == 0)
+		return -EINVAL;
+	metadata_commit(&impl->def);
+	return 0;
+}
@@ -83,6 +83,16 @@ int pw_impl_metadata_set_propertyf(struct pw_impl_metadata *metadata,
 			uint32_t subject, const char *key, const char *type,
 			const char *fmt, ...) SPA_PRINTF_FUNC(5,6);
 
+/** Start a batch of changes. Until the matching pw_impl_metadata_commit(),
+ * changes are applied to the store but no events are emitted. Batches can
+ * be nested. Returns -ENOTSUP when a custom implementation is used. */
+int pw_impl_metadata_begin(struct pw_impl_metadata *metadata);
+
+/** End a batch of changes. When the outermost batch ends, every listener
+ * gets the final value of each changed key once, cleared subjects are
+ * emitted first. */
+int pw_impl_metadata_commit(struct pw_impl_metadata *metadata);
+
 /**
  * \}
  */
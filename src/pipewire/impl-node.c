@@ -113,6 +113,8 @@ static void add_node(struct pw_impl_node *this, struct pw_impl_node *driver)
 				this, dstate, dstate->pending, dstate->required,
 				nstate, nstate->pending, nstate->required);
 	}
+	pw_impl_node_update_targets(driver);
+	pw_impl_node_update_targets(this);
 }
 
 /* called from the data loop and undoes the changes done in add_node.  */
@@ -120,6 +122,7 @@ static void remove_node(struct pw_impl_node *this)
 {
 	struct pw_node_activation_state *dstate, *nstate;
 	struct pw_node_target *t;
+	struct pw_impl_node *driver = this->rt.driver_target.node;
 
 	if (this->exported)
 		return;
@@ -149,6 +152,87 @@ static void remove_node(struct pw_impl_node *this)
 	spa_list_remove(&this->rt.driver_target.link);
 
 	spa_zero(this->rt.driver_target);
+
+	if (driver != NULL)
+		pw_impl_node_update_targets(driver);
+	pw_impl_node_update_targets(this);
+}
+
+SPA_EXPORT
+void pw_impl_node_update_targets(struct pw_impl_node *node)
+{
+	struct pw_node_target_slot *slots = node->rt.targets;
+	struct pw_node_target *t;
+	uint32_t n_targets = 0;
+
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		if (n_targets >= node->rt.max_targets) {
+			/* not reserved, trigger_targets and node_ready walk
+			 * the list instead */
+			pw_log_warn("%p: more than %u targets", node, node->rt.max_targets);
+			node->rt.n_targets = 0;
+			return;
+		}
+		slots[n_targets++] = (struct pw_node_target_slot) {
+			.activation = t->activation,
+			.system = t->system,
+			.fd = t->fd,
+			.id = t->id,
+			.target = t,
+		};
+	}
+	node->rt.n_targets = n_targets;
+}
+
+struct swap_targets {
+	struct pw_impl_node *node;
+	struct pw_node_target_slot *slots;
+	uint32_t max_targets;
+};
+
+static int
+do_swap_targets(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct swap_targets *d = user_data;
+	struct pw_impl_node *node = d->node;
+
+	SPA_SWAP(node->rt.targets, d->slots);
+	node->rt.max_targets = d->max_targets;
+	pw_impl_node_update_targets(node);
+	return 0;
+}
+
+SPA_EXPORT
+int pw_impl_node_reserve_targets(struct pw_impl_node *node, uint32_t extra)
+{
+	struct swap_targets d;
+	struct pw_impl_node *follower;
+	struct pw_node_peer *peer;
+	uint32_t n_targets;
+
+	/* the followers when driving, the peers, our driver and the extra
+	 * targets of the caller */
+	n_targets = 1 + extra;
+	spa_list_for_each(follower, &node->follower_list, follower_link)
+		n_targets++;
+	spa_list_for_each(peer, &node->peer_list, link)
+		n_targets++;
+	if (n_targets <= node->rt.max_targets)
+		return 0;
+
+	d.node = node;
+	d.max_targets = SPA_ROUND_UP_N(n_targets, 16u);
+	if ((d.slots = calloc(d.max_targets, sizeof(*d.slots))) == NULL) {
+		pw_log_warn("%p: can't allocate %u targets: %m", node, d.max_targets);
+		return -errno;
+	}
+
+	/* the data loop copies the targets to the new array, we free the old
+	 * one when it is done */
+	pw_loop_invoke(node->data_loop, do_swap_targets, SPA_ID_INVALID, NULL, 0, true, &d);
+	free(d.slots);
+	return 0;
 }
 
 static int
@@ -367,6 +451,8 @@ static void node_update_state(struct pw_impl_node *node, enum pw_node_state stat
 				node->driving, node->driver, node->added);
 
 		if (res >= 0) {
+			pw_impl_node_reserve_targets(node, 0);
+			pw_impl_node_reserve_targets(node->driver_node, 0);
 			pw_loop_invoke(node->data_loop, do_node_add, 1, NULL, 0, true, node);
 		}
 		if (node->driving && node->driver) {
@@ -895,6 +981,8 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 		pw_log_debug("%p: set position: %s", node, spa_strerror(res));
 	}
 
+	pw_impl_node_reserve_targets(node, 0);
+	pw_impl_node_reserve_targets(driver, 0);
 	pw_loop_invoke(node->data_loop,
 		       do_move_nodes, SPA_ID_INVALID, &driver, sizeof(struct pw_impl_node *),
 		       true, impl);
@@ -1139,26 +1227,39 @@ static inline void node_trigger(struct pw_impl_node *this)
 		pw_log_warn("node %p: write failed %m", this);
 }
 
+static inline void trigger_target(struct pw_impl_node *this, struct pw_node_activation *a,
+		struct spa_system *system, int fd, uint64_t nsec)
+{
+	struct pw_node_activation_state *state = &a->state[0];
+
+	pw_log_trace_fp("%p: state:%p pending:%d/%d", this, state,
+			state->pending, state->required);
+
+	if (pw_node_activation_state_dec(state, 1)) {
+		a->status = PW_NODE_ACTIVATION_TRIGGERED;
+		a->signal_time = nsec;
+		if (SPA_UNLIKELY(spa_system_eventfd_write(system, fd, 1) < 0))
+			pw_log_warn("node %p: write failed %m", this);
+	}
+}
+
 /* called from data-loop when all the targets of a node need to be triggered */
 static inline int trigger_targets(struct pw_impl_node *this, int status, uint64_t nsec)
 {
+	struct pw_node_target_slot *s;
 	struct pw_node_target *t;
+	uint32_t i;
 
 	pw_log_trace_fp("%p: %s trigger targets %"PRIu64, this, this->name, nsec);
 
-	spa_list_for_each(t, &this->rt.target_list, link) {
-		struct pw_node_activation *a = t->activation;
-		struct pw_node_activation_state *state = &a->state[0];
-
-		pw_log_trace_fp("%p: state:%p pending:%d/%d", t->node, state,
-                                state->pending, state->required);
-
-		if (pw_node_activation_state_dec(state, 1)) {
-			a->status = PW_NODE_ACTIVATION_TRIGGERED;
-			a->signal_time = nsec;
-			if (SPA_UNLIKELY(spa_system_eventfd_write(t->system, t->fd, 1) < 0))
-				pw_log_warn("node %p: write failed %m", this);
+	if (SPA_LIKELY(this->rt.n_targets > 0)) {
+		for (i = 0; i < this->rt.n_targets; i++) {
+			s = &this->rt.targets[i];
+			trigger_target(this, s->activation, s->system, s->fd, nsec);
 		}
+	} else {
+		spa_list_for_each(t, &this->rt.target_list, link)
+			trigger_target(this, t->activation, t->system, t->fd, nsec);
 	}
 	return 0;
 }
@@ -1184,6 +1285,66 @@ static inline void calculate_stats(struct pw_impl_node *this,  struct pw_node_ac
 			a->cpu_load[0], a->cpu_load[1], a->cpu_load[2]);
 }
 
+static inline void update_link_stats(struct pw_impl_node *driver, struct pw_impl_link *link,
+		bool mixed)
+{
+	struct pw_impl_link_stats *s = &link->rt.stats;
+	struct pw_impl_port *out = link->output;
+	struct pw_node_activation *a = out->node->rt.target.activation;
+	struct spa_buffer *b;
+	uint32_t i, id;
+
+	/* the driver is processed last, its status says nothing about the
+	 * data it produced at the start of the cycle */
+	if (out->node != driver &&
+	    (a->status != PW_NODE_ACTIVATION_FINISHED ||
+	     !(a->state[0].status & SPA_STATUS_HAVE_DATA))) {
+		s->underruns++;
+		return;
+	}
+	id = link->io->buffer_id;
+	if (id >= out->buffers.n_buffers)
+		return;
+
+	b = out->buffers.buffers[id];
+	for (i = 0; i < b->n_datas; i++) {
+		if (b->datas[i].chunk != NULL)
+			s->bytes += b->datas[i].chunk->size;
+	}
+	s->buffers++;
+	if (mixed)
+		s->mixed++;
+}
+
+/* Account the buffers that went over the links of the graph in this cycle.
+ * The io areas, chunks and activations are shared memory, so this also works
+ * for links between nodes in other processes. Only done when the profiler
+ * runs, the flag is in the shared activation of the driver. */
+static inline void update_links_stats(struct pw_impl_node *driver)
+{
+	struct pw_node_target *t;
+	struct pw_impl_port *p;
+	struct pw_impl_port_mix *mix;
+
+	if (SPA_LIKELY(!SPA_FLAG_IS_SET(driver->rt.target.activation->flags,
+					PW_NODE_ACTIVATION_FLAG_PROFILER)))
+		return;
+
+	spa_list_for_each(t, &driver->rt.target_list, link) {
+		if (t->node == NULL)
+			continue;
+		spa_list_for_each(p, &t->node->rt.input_mix, rt.node_link) {
+			/* with more than one link, the input mixer copies */
+			bool mixed = p->rt.mix_list.next != p->rt.mix_list.prev;
+
+			spa_list_for_each(mix, &p->rt.mix_list, rt_link)
+				update_link_stats(driver,
+						SPA_CONTAINER_OF(mix, struct pw_impl_link, rt.in_mix),
+						mixed);
+		}
+	}
+}
+
 /* The main processing entry point of a node. This is called from the data-loop and usually
  * as a result of signaling the eventfd of the node.
  *
@@ -1244,6 +1405,7 @@ static inline int process_node(void *data)
 		/* calculate CPU time when finished */
 		a->signal_time = this->driver_start;
 		calculate_stats(this, a);
+		update_links_stats(this);
 		pw_context_driver_emit_complete(this->context, this);
 	}
 
@@ -1731,6 +1893,33 @@ static inline void update_position(struct pw_impl_node *node, int all_ready, uin
 		a->position.offset += a->position.clock.duration;
 }
 
+/* Reset a target of the driver for the next cycle and collect its sync and
+ * segment info. Returns true when the target has reposition info. */
+static inline bool reset_target(struct pw_node_activation *a, struct pw_node_activation *ta,
+		uint32_t id, const uint32_t owner[2], uint32_t reposition_owner,
+		uint64_t *min_timeout, int update_sync, int target_sync, int *all_ready)
+{
+	ta->status = PW_NODE_ACTIVATION_NOT_TRIGGERED;
+	pw_node_activation_state_reset(&ta->state[0]);
+
+	/* update extra segment info if it is the owner */
+	if (SPA_UNLIKELY(id == owner[0]))
+		a->position.segments[0].bar = ta->segment.bar;
+	if (SPA_UNLIKELY(id == owner[1]))
+		a->position.segments[0].video = ta->segment.video;
+
+	*min_timeout = SPA_MIN(*min_timeout, ta->sync_timeout);
+
+	if (SPA_UNLIKELY(update_sync)) {
+		ta->pending_sync = target_sync;
+		ta->pending_new_pos = target_sync;
+	} else {
+		*all_ready &= ta->pending_sync == false;
+	}
+	/* this is the node with reposition info */
+	return SPA_UNLIKELY(id == reposition_owner);
+}
+
 /* Called from the data-loop and it is the starting point for driver nodes.
  * Most of the logic here is to check for reposition updates and transport changes.
  */
@@ -1743,6 +1932,7 @@ static int node_ready(void *data, int status)
 	struct pw_node_target *t, *reposition_target = NULL;;
 	struct pw_impl_port *p;
 	uint64_t nsec;
+	uint32_t i;
 
 	pw_log_trace_fp("%p: ready driver:%d exported:%d %p status:%d added:%d", node,
 			node->driver, node->exported, driver, status, node->added);
@@ -1770,6 +1960,7 @@ static int node_ready(void *data, int status)
 					state, a->position.clock.duration,
 					state->pending, state->required);
 			check_states(node, nsec);
+			update_links_stats(node);
 			pw_context_driver_emit_incomplete(node->context, node);
 		}
 
@@ -1792,30 +1983,18 @@ again:
 		update_sync = !all_ready;
 		target_sync = sync_type == SYNC_START ? true : false;
 
-		spa_list_for_each(t, &driver->rt.target_list, link) {
-			struct pw_node_activation *ta = t->activation;
-			uint32_t id = t->id;
-
-			ta->status = PW_NODE_ACTIVATION_NOT_TRIGGERED;
-			pw_node_activation_state_reset(&ta->state[0]);
-
-			/* this is the node with reposition info */
-			if (SPA_UNLIKELY(id == reposition_owner))
-				reposition_target = t;
-
-			/* update extra segment info if it is the owner */
-			if (SPA_UNLIKELY(id == owner[0]))
-				a->position.segments[0].bar = ta->segment.bar;
-			if (SPA_UNLIKELY(id == owner[1]))
-				a->position.segments[0].video = ta->segment.video;
-
-			min_timeout = SPA_MIN(min_timeout, ta->sync_timeout);
-
-			if (SPA_UNLIKELY(update_sync)) {
-				ta->pending_sync = target_sync;
-				ta->pending_new_pos = target_sync;
-			} else {
-				all_ready &= ta->pending_sync == false;
+		if (SPA_LIKELY(driver->rt.n_targets > 0)) {
+			for (i = 0; i < driver->rt.n_targets; i++) {
+				struct pw_node_target_slot *s = &driver->rt.targets[i];
+				if (reset_target(a, s->activation, s->id, owner, reposition_owner,
+						&min_timeout, update_sync, target_sync, &all_ready))
+					reposition_target = s->target;
+			}
+		} else {
+			spa_list_for_each(t, &driver->rt.target_list, link) {
+				if (reset_target(a, t->activation, t->id, owner, reposition_owner,
+						&min_timeout, update_sync, target_sync, &all_ready))
+					reposition_target = t;
 			}
 		}
 
@@ -2018,6 +2197,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	spa_hook_list_clean(&node->listener_list);
 
 	pw_memblock_unref(node->activation);
+	free(node->rt.targets);
 
 	pw_param_clear(&impl->param_list, SPA_ID_INVALID);
 	pw_param_clear(&impl->pending_list, SPA_ID_INVALID);
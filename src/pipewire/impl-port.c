@@ -1211,6 +1211,11 @@ void pw_impl_port_destroy(struct pw_impl_port *port)
 
 	pw_impl_port_unlink(port);
 
+	if (port->latency_queued) {
+		spa_list_remove(&port->latency_link);
+		port->latency_queued = false;
+	}
+
 	pw_log_debug("%p: control destroy", port);
 	spa_list_consume(control, &port->control_list[0], port_link)
 		pw_control_destroy(control);
@@ -1432,6 +1437,7 @@ int pw_impl_port_recalc_latency(struct pw_impl_port *port)
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	bool changed;
+	int res;
 
 	if (port->destroying)
 		return 0;
@@ -1490,11 +1496,13 @@ int pw_impl_port_recalc_latency(struct pw_impl_port *port)
 	*current = latency;
 
 	if (!port->have_latency_param)
-		return 0;
+		return 1;
 
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 	param = spa_latency_build(&b, SPA_PARAM_Latency, &latency);
-	return pw_impl_port_set_param(port, SPA_PARAM_Latency, 0, param);
+	if ((res = pw_impl_port_set_param(port, SPA_PARAM_Latency, 0, param)) < 0)
+		return res;
+	return 1;
 }
 
 SPA_EXPORT
@@ -600,6 +600,17 @@ struct pw_node_target {
 	unsigned int active:1;
 };
 
+/* Dense copy of a target in the target_list. The data loop walks an array
+ * of these instead of the list so that signaling many targets does not
+ * chase list pointers through the heap. */
+struct pw_node_target_slot {
+	struct pw_node_activation *activation;
+	struct spa_system *system;
+	int fd;
+	uint32_t id;
+	struct pw_node_target *target;
+};
+
 static inline void copy_target(struct pw_node_target *dst, const struct pw_node_target *src)
 {
 	dst->id = src->id;
@@ -754,6 +765,9 @@ struct pw_impl_node {
 
 	uint32_t port_user_data_size;	/**< extra size for port user data */
 
+	uint32_t latency_pass[2];	/**< latency pass of latency_depth, by direction */
+	uint32_t latency_depth[2];	/**< hops to the edge of the graph, by direction */
+
 	struct spa_list driver_link;
 	struct pw_impl_node *driver_node;
 	struct spa_list follower_list;
@@ -790,6 +804,11 @@ struct pw_impl_node {
 
 		struct spa_list target_list;		/* list of targets to signal after
 							 * this node */
+		struct pw_node_target_slot *targets;	/* array with target_list, allocated
+							 * on the main thread */
+		uint32_t n_targets;			/* 0 when the targets did not fit
+							 * and the list is used */
+		uint32_t max_targets;
 		struct pw_node_target driver_target;	/* driver target that we signal */
 		struct spa_list input_mix;		/* our input ports (and mixers) */
 		struct spa_list output_mix;		/* output ports (and mixers) */
@@ -920,6 +939,8 @@ struct pw_impl_port {
 	struct spa_latency_info latency[2];	/**< latencies */
 	unsigned int have_latency_param:1;
 	unsigned int ignore_latency:1;
+	unsigned int latency_queued:1;		/**< in the latency list of the context */
+	struct spa_list latency_link;
 
 	void *owner_data;		/**< extra owner data */
 	void *user_data;                /**< extra user data */
@@ -951,6 +972,15 @@ struct pw_node_peer {
 #define pw_impl_link_emit_state_changed(l,...)	pw_impl_link_emit(l, state_changed, 0, __VA_ARGS__)
 #define pw_impl_link_emit_port_unlinked(l,p)	pw_impl_link_emit(l, port_unlinked, 0, p)
 
+/** Counters of a link, accumulated on the data loop of the driver */
+struct pw_impl_link_stats {
+	uint64_t bytes;			/**< bytes in the chunks of the buffers */
+	uint64_t buffers;		/**< buffers that went over the link */
+	uint64_t mixed;			/**< buffers that were copied into a mix with
+					  *  other links, the others were passed on */
+	uint32_t underruns;		/**< cycles where the output had no data */
+};
+
 struct pw_impl_link {
 	struct pw_context *context;		/**< context object */
 	struct spa_list link;			/**< link in context link_list */
@@ -979,6 +1009,7 @@ struct pw_impl_link {
 	struct {
 		struct pw_impl_port_mix out_mix;	/**< port added to the output mixer */
 		struct pw_impl_port_mix in_mix;		/**< port added to the input mixer */
+		struct pw_impl_link_stats stats;	/**< updated by the driver after each cycle */
 	} rt;
 
 	void *user_data;
@@ -1234,6 +1265,10 @@ void pw_proxy_remove(struct pw_proxy *proxy);
 
 int pw_context_recalc_graph(struct pw_context *context, const char *reason);
 
+/** Queue a latency recalculation of a port. All queued ports are updated in
+ * one pass from the main loop. */
+void pw_context_queue_latency(struct pw_context *context, struct pw_impl_port *port);
+
 void pw_impl_port_update_info(struct pw_impl_port *port, const struct spa_port_info *info);
 
 int pw_impl_port_register(struct pw_impl_port *port,
@@ -1307,6 +1342,16 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 
 int pw_impl_node_trigger(struct pw_impl_node *node);
 
+/** Rebuild the target array after the target_list changed, called from
+ * the data loop. This does not allocate, the array must have been made
+ * large enough with pw_impl_node_reserve_targets(). */
+void pw_impl_node_update_targets(struct pw_impl_node *node);
+
+/** Grow the target array for all possible targets of \a node and \a extra
+ * more, called from the main thread before targets are added on the data
+ * loop */
+int pw_impl_node_reserve_targets(struct pw_impl_node *node, uint32_t extra);
+
 /** Prepare a link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
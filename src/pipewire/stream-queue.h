@@ -0,0 +1,95 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#ifndef PIPEWIRE_STREAM_QUEUE_H
+#define PIPEWIRE_STREAM_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <spa/utils/defs.h>
+#include <spa/utils/ringbuffer.h>
+
+/*
+ * A bounded single producer, single consumer queue of buffer ids.
+ *
+ * One thread pushes and one other thread pops, without locks. A batch of
+ * ids is published or released with one update of the ring index.
+ */
+
+#define ID_QUEUE_SIZE	64u
+#define ID_QUEUE_MASK	(ID_QUEUE_SIZE-1)
+
+struct id_queue {
+	uint32_t ids[ID_QUEUE_SIZE];
+	struct spa_ringbuffer ring;
+};
+
+static inline void id_queue_init(struct id_queue *queue)
+{
+	spa_ringbuffer_init(&queue->ring);
+}
+
+/** Push at most \a n_ids ids, returns the number of ids pushed */
+static inline uint32_t id_queue_push(struct id_queue *queue, const uint32_t *ids, uint32_t n_ids)
+{
+	uint32_t index, i;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&queue->ring, &index);
+	n_ids = SPA_MIN(n_ids, ID_QUEUE_SIZE - (uint32_t)SPA_CLAMP(filled, 0, (int32_t)ID_QUEUE_SIZE));
+
+	for (i = 0; i < n_ids; i++)
+		queue->ids[(index + i) & ID_QUEUE_MASK] = ids[i];
+	if (n_ids > 0)
+		spa_ringbuffer_write_update(&queue->ring, index + n_ids);
+	return n_ids;
+}
+
+/** Copy at most \a n_ids ids without removing them, returns the number
+ * of ids copied. Use id_queue_skip() to remove them. */
+static inline uint32_t id_queue_peek(struct id_queue *queue, uint32_t *ids, uint32_t n_ids)
+{
+	uint32_t index, i;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&queue->ring, &index);
+	n_ids = SPA_MIN(n_ids, (uint32_t)SPA_MAX(avail, 0));
+
+	for (i = 0; i < n_ids; i++)
+		ids[i] = queue->ids[(index + i) & ID_QUEUE_MASK];
+	return n_ids;
+}
+
+/** Remove \a n_ids ids that were returned by id_queue_peek() */
+static inline void id_queue_skip(struct id_queue *queue, uint32_t n_ids)
+{
+	uint32_t index;
+
+	if (n_ids == 0)
+		return;
+	spa_ringbuffer_get_read_index(&queue->ring, &index);
+	spa_ringbuffer_read_update(&queue->ring, index + n_ids);
+}
+
+/** Pop at most \a n_ids ids, returns the number of ids popped */
+static inline uint32_t id_queue_pop(struct id_queue *queue, uint32_t *ids, uint32_t n_ids)
+{
+	n_ids = id_queue_peek(queue, ids, n_ids);
+	id_queue_skip(queue, n_ids);
+	return n_ids;
+}
+
+static inline bool id_queue_is_empty(struct id_queue *queue)
+{
+	uint32_t index;
+	return spa_ringbuffer_get_read_index(&queue->ring, &index) < 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PIPEWIRE_STREAM_QUEUE_H */
@@ -23,14 +23,13 @@
 
 #include "pipewire/pipewire.h"
 #include "pipewire/stream.h"
+#include "pipewire/stream-queue.h"
 #include "pipewire/private.h"
 
 PW_LOG_TOPIC_EXTERN(log_stream);
 #define PW_LOG_TOPIC_DEFAULT log_stream
 
-#define MAX_BUFFERS	64
-
-#define MASK_BUFFERS	(MAX_BUFFERS-1)
+#define MAX_BUFFERS	ID_QUEUE_SIZE
 
 static bool mlock_warned = false;
 
@@ -47,8 +46,7 @@ struct buffer {
 };
 
 struct queue {
-	uint32_t ids[MAX_BUFFERS];
-	struct spa_ringbuffer ring;
+	struct id_queue ids;
 	uint64_t incount;
 	uint64_t outcount;
 };
@@ -154,6 +152,7 @@ struct stream {
 	unsigned int allow_mlock:1;
 	unsigned int warn_mlock:1;
 	unsigned int process_rt:1;
+	unsigned int process_poll:1;
 	unsigned int driving:1;
 	unsigned int using_trigger:1;
 	unsigned int trigger:1;
@@ -305,8 +304,6 @@ static int update_params(struct stream *impl, uint32_t id,
 
 static inline int queue_push(struct stream *stream, struct queue *queue, struct buffer *buffer)
 {
-	uint32_t index;
-
 	if (SPA_FLAG_IS_SET(buffer->flags, BUFFER_FLAG_QUEUED) ||
 	    buffer->id >= stream->n_buffers)
 		return -EINVAL;
@@ -314,32 +311,26 @@ static inline int queue_push(struct stream *stream, struct queue *queue, struct
 	SPA_FLAG_SET(buffer->flags, BUFFER_FLAG_QUEUED);
 	queue->incount += buffer->this.size;
 
-	spa_ringbuffer_get_write_index(&queue->ring, &index);
-	queue->ids[index & MASK_BUFFERS] = buffer->id;
-	spa_ringbuffer_write_update(&queue->ring, index + 1);
+	id_queue_push(&queue->ids, &buffer->id, 1);
 
 	return 0;
 }
 
 static inline bool queue_is_empty(struct stream *stream, struct queue *queue)
 {
-	uint32_t index;
-	return spa_ringbuffer_get_read_index(&queue->ring, &index) < 1;
+	return id_queue_is_empty(&queue->ids);
 }
 
 static inline struct buffer *queue_pop(struct stream *stream, struct queue *queue)
 {
-	uint32_t index, id;
+	uint32_t id;
 	struct buffer *buffer;
 
-	if (spa_ringbuffer_get_read_index(&queue->ring, &index) < 1) {
+	if (id_queue_pop(&queue->ids, &id, 1) == 0) {
 		errno = EPIPE;
 		return NULL;
 	}
 
-	id = queue->ids[index & MASK_BUFFERS];
-	spa_ringbuffer_read_update(&queue->ring, index + 1);
-
 	buffer = &stream->buffers[id];
 	queue->outcount += buffer->this.size;
 	SPA_FLAG_CLEAR(buffer->flags, BUFFER_FLAG_QUEUED);
@@ -348,7 +339,7 @@ static inline struct buffer *queue_pop(struct stream *stream, struct queue *queu
 }
 static inline void clear_queue(struct stream *stream, struct queue *queue)
 {
-	spa_ringbuffer_init(&queue->ring);
+	id_queue_init(&queue->ids);
 	queue->incount = queue->outcount;
 }
 
@@ -388,16 +379,15 @@ static struct buffer *get_buffer(struct pw_stream *stream, uint32_t id)
 
 static inline uint32_t update_requested(struct stream *impl)
 {
-	uint32_t index, id, res = 0;
+	uint32_t id, res = 0;
 	struct buffer *buffer;
 	struct spa_io_rate_match *r = impl->rate_match;
 
-	if (spa_ringbuffer_get_read_index(&impl->dequeued.ring, &index) < 1) {
+	if (id_queue_peek(&impl->dequeued.ids, &id, 1) == 0) {
 		pw_log_debug("%p: no free buffers %d", impl, impl->n_buffers);
 		return impl->using_trigger ? 1 : 0;
 	}
 
-	id = impl->dequeued.ids[index & MASK_BUFFERS];
 	buffer = &impl->buffers[id];
 	if (r) {
 		buffer->this.requested = r->size;
@@ -426,6 +416,8 @@ static inline void call_process(struct stream *impl)
 	pw_log_trace_fp("%p: call process rt:%u", impl, impl->process_rt);
 	if (impl->direction == SPA_DIRECTION_OUTPUT && update_requested(impl) <= 0)
 		return;
+	if (impl->process_poll)
+		return;
 	if (impl->process_rt)
 		spa_callbacks_call_fast(&impl->rt_callbacks, struct pw_stream_events, process, 0);
 	else
@@ -1502,8 +1494,8 @@ stream_new(struct pw_context *context, const char *name,
 	this->name = name ? strdup(name) : NULL;
 	this->node_id = SPA_ID_INVALID;
 
-	spa_ringbuffer_init(&impl->dequeued.ring);
-	spa_ringbuffer_init(&impl->queued.ring);
+	id_queue_init(&impl->dequeued.ids);
+	id_queue_init(&impl->queued.ids);
 	spa_list_init(&impl->param_list);
 
 	spa_hook_list_init(&this->listener_list);
@@ -1875,7 +1867,9 @@ pw_stream_connect(struct pw_stream *stream,
 	else
 		impl->node_methods.process = impl_node_process_output;
 
-	impl->process_rt = SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RT_PROCESS);
+	impl->process_poll = SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_POLL);
+	impl->process_rt = SPA_FLAG_IS_SET(flags, PW_STREAM_FLAG_RT_PROCESS) &&
+		!impl->process_poll;
 
 	impl->impl_node.iface = SPA_INTERFACE_INIT(
 			SPA_TYPE_INTERFACE_Node,
@@ -2300,9 +2294,9 @@ int pw_stream_get_time_n(struct pw_stream *stream, struct pw_time *time, size_t
 	if (size >= offsetof(struct pw_time, queued_buffers))
 		time->buffered = buffered;
 	if (size >= offsetof(struct pw_time, avail_buffers))
-		time->queued_buffers = spa_ringbuffer_get_read_index(&impl->queued.ring, &index);
+		time->queued_buffers = spa_ringbuffer_get_read_index(&impl->queued.ids.ring, &index);
 	if (size >= sizeof(struct pw_time))
-		time->avail_buffers = spa_ringbuffer_get_read_index(&impl->dequeued.ring, &index);
+		time->avail_buffers = spa_ringbuffer_get_read_index(&impl->dequeued.ids.ring, &index);
 
 	pw_log_trace_fp("%p: %"PRIi64" %"PRIi64" %"PRIu64" %d/%d %"PRIu64" %"
 			PRIu64" %"PRIu64" %"PRIu64" %"PRIu64, stream,
@@ -2325,28 +2319,15 @@ do_trigger_deprecated(struct spa_loop *loop,
 SPA_EXPORT
 struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream)
 {
-	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
-	struct buffer *b;
-	int res;
+	struct pw_buffer *buffer;
 
-	if ((b = queue_pop(impl, &impl->dequeued)) == NULL) {
-		res = -errno;
+	/* a busy buffer stays in the queue, only the data thread pushes */
+	if (pw_stream_dequeue_buffers(stream, &buffer, 1) == 0) {
 		pw_log_trace_fp("%p: no more buffers: %m", stream);
-		errno = -res;
 		return NULL;
 	}
-	pw_log_trace_fp("%p: dequeue buffer %d size:%"PRIu64, stream, b->id, b->this.size);
-
-	if (b->busy && impl->direction == SPA_DIRECTION_OUTPUT) {
-		if (ATOMIC_INC(b->busy->count) > 1) {
-			ATOMIC_DEC(b->busy->count);
-			queue_push(impl, &impl->dequeued, b);
-			pw_log_trace_fp("%p: buffer busy", stream);
-			errno = EBUSY;
-			return NULL;
-		}
-	}
-	return &b->this;
+	pw_log_trace_fp("%p: dequeue buffer %p size:%"PRIu64, stream, buffer, buffer->size);
+	return buffer;
 }
 
 SPA_EXPORT
@@ -2372,6 +2353,79 @@ int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer)
 	return res;
 }
 
+SPA_EXPORT
+int pw_stream_dequeue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	uint32_t ids[MAX_BUFFERS], i, n;
+
+	n = id_queue_peek(&impl->dequeued.ids, ids, SPA_MIN(n_buffers, MAX_BUFFERS));
+
+	for (i = 0; i < n; i++) {
+		struct buffer *b = &impl->buffers[ids[i]];
+
+		/* leave a busy buffer in the queue, we can't push it back
+		 * from this thread */
+		if (b->busy && impl->direction == SPA_DIRECTION_OUTPUT &&
+		    ATOMIC_INC(b->busy->count) > 1) {
+			ATOMIC_DEC(b->busy->count);
+			break;
+		}
+		impl->dequeued.outcount += b->this.size;
+		SPA_FLAG_CLEAR(b->flags, BUFFER_FLAG_QUEUED);
+		buffers[i] = &b->this;
+	}
+	id_queue_skip(&impl->dequeued.ids, i);
+
+	pw_log_trace_fp("%p: dequeue %u/%u buffers", stream, i, n_buffers);
+	if (i == 0)
+		errno = n == 0 ? EPIPE : EBUSY;
+	return i;
+}
+
+SPA_EXPORT
+int pw_stream_queue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers)
+{
+	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
+	uint32_t ids[MAX_BUFFERS], i;
+	struct buffer *b;
+
+	if (n_buffers > MAX_BUFFERS)
+		return -EINVAL;
+
+	for (i = 0; i < n_buffers; i++) {
+		b = SPA_CONTAINER_OF(buffers[i], struct buffer, this);
+		if (SPA_FLAG_IS_SET(b->flags, BUFFER_FLAG_QUEUED) ||
+		    b->id >= impl->n_buffers)
+			goto invalid;
+		SPA_FLAG_SET(b->flags, BUFFER_FLAG_QUEUED);
+		ids[i] = b->id;
+	}
+	for (i = 0; i < n_buffers; i++) {
+		b = &impl->buffers[ids[i]];
+		if (b->busy)
+			ATOMIC_DEC(b->busy->count);
+		impl->queued.incount += b->this.size;
+	}
+	pw_log_trace_fp("%p: queue %u buffers", stream, n_buffers);
+	id_queue_push(&impl->queued.ids, ids, n_buffers);
+
+	if (n_buffers > 0 && impl->direction == SPA_DIRECTION_OUTPUT &&
+	    impl->driving && !impl->using_trigger) {
+		pw_log_debug("deprecated: use pw_stream_trigger_process() to drive the stream.");
+		return pw_loop_invoke(impl->data_loop,
+			do_trigger_deprecated, 1, NULL, 0, false, impl);
+	}
+	return 0;
+
+invalid:
+	while (i-- > 0)
+		SPA_FLAG_CLEAR(impl->buffers[ids[i]].flags, BUFFER_FLAG_QUEUED);
+	return -EINVAL;
+}
+
 static int
 do_flush(struct spa_loop *loop,
                  bool async, uint32_t seq, const void *data, size_t size, void *user_data)
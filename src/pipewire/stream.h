@@ -139,6 +139,29 @@ extern "C" {
  * The process event is emitted when PipeWire has emptied a buffer that
  * can now be refilled.
  *
+ * \subsection ssec_buffer_queues Buffer queues
+ *
+ * The stream passes buffers to and from the application with two lock-free
+ * single producer, single consumer queues. All dequeue calls must be made
+ * from one thread and all queue calls from one thread, which can be the
+ * same thread. The other end of both queues is the data thread. No locks
+ * are taken and no syscalls are made, so the calls can be made from a
+ * realtime thread. A busy buffer is left in the queue, dequeue then fails
+ * with EBUSY until the buffer is no longer in use.
+ *
+ * One exception is an output stream that drives the graph without
+ * \ref pw_stream_trigger_process(). Queueing a buffer then wakes up the
+ * data thread to start a cycle, which is deprecated.
+ *
+ * \ref pw_stream_dequeue_buffers() and \ref pw_stream_queue_buffers()
+ * move a batch of buffers with one update of the queue.
+ *
+ * Without \ref PW_STREAM_FLAG_RT_PROCESS, the process event is emitted
+ * from the main loop, which costs a wakeup of the main loop for each
+ * cycle. An application that runs its own thread can use
+ * \ref PW_STREAM_FLAG_POLL instead. The process event is then not
+ * emitted and the application polls the queues.
+ *
  * \section sec_stream_disconnect Disconnect
  *
  * Use \ref pw_stream_disconnect() to disconnect a stream after use.
@@ -375,6 +398,11 @@ enum pw_stream_flags {
 							  *  needs to be called. This can be used
 							  *  when the output of the stream depends
 							  *  on input from other streams. */
+	PW_STREAM_FLAG_POLL		= (1 << 10),	/**< don't emit the process event. The
+							  *  application polls for buffers from
+							  *  its own thread with
+							  *  pw_stream_dequeue_buffers().
+							  *  Since 0.3.72 */
 };
 
 /** Create a new unconneced \ref pw_stream
@@ -484,6 +512,19 @@ struct pw_buffer *pw_stream_dequeue_buffer(struct pw_stream *stream);
 /** Submit a buffer for playback or recycle a buffer for capture. */
 int pw_stream_queue_buffer(struct pw_stream *stream, struct pw_buffer *buffer);
 
+/** Get at most \a n_buffers buffers in queue order.
+ * \return the number of buffers, 0 with errno set to EPIPE when there are
+ * no buffers or to EBUSY when the next buffer is still busy.
+ * Since 0.3.72 */
+int pw_stream_dequeue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers);
+
+/** Queue \a n_buffers buffers in order. Either all buffers are queued or,
+ * when one of them can't be queued, none of them.
+ * \return 0 on success, < 0 on error. Since 0.3.72 */
+int pw_stream_queue_buffers(struct pw_stream *stream,
+		struct pw_buffer **buffers, uint32_t n_buffers);
+
 /** Activate or deactivate the stream */
 int pw_stream_set_active(struct pw_stream *stream, bool active);
 
@@ -0,0 +1,191 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+#include <pipewire/extensions/metadata.h>
+
+/*
+ * Fills a metadata object with N_ENTRIES keys, spread over N_SUBJECTS
+ * subjects, updates them and clears the subjects again while N_LISTENERS
+ * listeners are subscribed. Every step is done with one event per change
+ * and in one batch.
+ */
+
+#define N_ENTRIES	10000
+#define N_SUBJECTS	100
+#define N_LISTENERS	50
+
+struct listener {
+	struct spa_hook hook;
+	uint64_t events;
+};
+
+static struct listener listeners[N_LISTENERS];
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int metadata_property(void *data, uint32_t subject, const char *key,
+		const char *type, const char *value)
+{
+	struct listener *l = data;
+	l->events++;
+	return 0;
+}
+
+static const struct pw_metadata_events metadata_events = {
+	PW_VERSION_METADATA_EVENTS,
+	.property = metadata_property,
+};
+
+static uint64_t count_events(void)
+{
+	uint64_t i, events = 0;
+	for (i = 0; i < N_LISTENERS; i++) {
+		events += listeners[i].events;
+		listeners[i].events = 0;
+	}
+	return events;
+}
+
+static void set_entries(struct pw_impl_metadata *m, const char *prefix)
+{
+	char key[64], value[64];
+	uint32_t i;
+
+	for (i = 0; i < N_ENTRIES; i++) {
+		snprintf(key, sizeof(key), "key.%u", i / N_SUBJECTS);
+		snprintf(value, sizeof(value), "%s-%u", prefix, i);
+		pw_impl_metadata_set_property(m, i % N_SUBJECTS, key, "Spa:String", value);
+	}
+}
+
+static void clear_subjects(struct pw_impl_metadata *m)
+{
+	uint32_t i;
+	for (i = 0; i < N_SUBJECTS; i++)
+		pw_impl_metadata_set_property(m, i, NULL, NULL, NULL);
+}
+
+static int run(struct pw_impl_metadata *m, bool batch)
+{
+	static const struct {
+		const char *name;
+		const char *prefix;
+		uint64_t events;
+	} steps[] = {
+		{ "add", "a", N_ENTRIES },
+		{ "update", "b", N_ENTRIES },
+		{ "clear", NULL, N_SUBJECTS },
+	};
+	uint32_t i;
+	int res = 0;
+
+	for (i = 0; i < SPA_N_ELEMENTS(steps); i++) {
+		uint64_t t1, t2, events;
+
+		t1 = get_time_ns();
+		if (batch)
+			pw_impl_metadata_begin(m);
+		if (steps[i].prefix)
+			set_entries(m, steps[i].prefix);
+		else
+			clear_subjects(m);
+		if (batch)
+			pw_impl_metadata_commit(m);
+		t2 = get_time_ns();
+
+		events = count_events();
+		fprintf(stderr, "%-8s %-7s: %8.3f ms, %"PRIu64" events\n",
+				batch ? "batch" : "single", steps[i].name,
+				(t2 - t1) / 1e6, events);
+
+		if (events != steps[i].events * N_LISTENERS) {
+			fprintf(stderr, "expected %"PRIu64" events\n",
+					steps[i].events * N_LISTENERS);
+			res = -1;
+		}
+	}
+	return res;
+}
+
+static int run_coalesce(struct pw_impl_metadata *m)
+{
+	uint64_t events;
+
+	/* all values of a key in a batch make one event, a cleared subject
+	 * makes one event for the subject and one for each key set after it */
+	pw_impl_metadata_begin(m);
+	set_entries(m, "a");
+	set_entries(m, "b");
+	clear_subjects(m);
+	pw_impl_metadata_set_property(m, 0, "key.0", NULL, "c");
+	pw_impl_metadata_commit(m);
+
+	events = count_events();
+	fprintf(stderr, "%-8s %-7s: %"PRIu64" events\n", "batch", "merge", events);
+
+	pw_impl_metadata_set_property(m, 0, NULL, NULL, NULL);
+	count_events();
+
+	return events == (N_SUBJECTS + 1) * N_LISTENERS ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct pw_impl_metadata *m;
+	struct pw_metadata *iface;
+	uint32_t i;
+	int res = 0;
+
+	pw_init(&argc, &argv);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	if (context == NULL) {
+		fprintf(stderr, "can't create context: %m\n");
+		return -1;
+	}
+	m = pw_context_create_metadata(context, "benchmark", NULL, 0);
+	if (m == NULL) {
+		fprintf(stderr, "can't create metadata: %m\n");
+		return -1;
+	}
+	iface = pw_impl_metadata_get_implementation(m);
+
+	for (i = 0; i < N_LISTENERS; i++)
+		pw_metadata_add_listener(iface, &listeners[i].hook,
+				&metadata_events, &listeners[i]);
+
+	if (run(m, false) < 0)
+		res = -1;
+	if (run(m, true) < 0)
+		res = -1;
+	if (run_coalesce(m) < 0)
+		res = -1;
+
+	for (i = 0; i < N_LISTENERS; i++)
+		spa_hook_remove(&listeners[i].hook);
+
+	pw_impl_metadata_destroy(m);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+	pw_deinit();
+
+	return res;
+}
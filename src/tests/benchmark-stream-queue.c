@@ -0,0 +1,92 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+#include <pipewire/stream-queue.h>
+
+/*
+ * Cycles N_BUFFERS buffer ids between a data thread and an application
+ * thread through the two queues of a stream, moving BATCH ids per call,
+ * and reports the time per buffer.
+ */
+
+#define N_BUFFERS	ID_QUEUE_SIZE
+#define N_MOVES		(1u<<24)
+
+struct side {
+	struct id_queue *from;
+	struct id_queue *to;
+	uint32_t batch;
+	uint64_t empty;
+};
+
+static struct id_queue dequeued;
+static struct id_queue queued;
+
+static inline uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void *run_side(void *data)
+{
+	struct side *s = data;
+	uint32_t ids[N_BUFFERS], moved = 0, n;
+
+	while (moved < N_MOVES) {
+		if ((n = id_queue_pop(s->from, ids, s->batch)) == 0) {
+			s->empty++;
+			sched_yield();
+			continue;
+		}
+		id_queue_push(s->to, ids, n);
+		moved += n;
+	}
+	return NULL;
+}
+
+static void run(uint32_t batch)
+{
+	struct side data = { &queued, &dequeued, batch, 0 };
+	struct side app = { &dequeued, &queued, batch, 0 };
+	pthread_t data_thread, app_thread;
+	uint32_t i, ids[N_BUFFERS];
+	uint64_t t;
+
+	id_queue_init(&dequeued);
+	id_queue_init(&queued);
+	for (i = 0; i < N_BUFFERS; i++)
+		ids[i] = i;
+	id_queue_push(&dequeued, ids, N_BUFFERS);
+
+	t = get_time_ns();
+	pthread_create(&data_thread, NULL, run_side, &data);
+	pthread_create(&app_thread, NULL, run_side, &app);
+	pthread_join(data_thread, NULL);
+	pthread_join(app_thread, NULL);
+	t = get_time_ns() - t;
+
+	fprintf(stdout, "batch %2u: %6.2f ns/buffer %8.2f Mbuffers/s, empty polls %"PRIu64"/%"PRIu64"\n",
+			batch, (double)t / N_MOVES, N_MOVES * 1e3 / t,
+			data.empty, app.empty);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t batches[] = { 1, 4, 8, 16, 32 };
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(batches); i++)
+		run(batches[i]);
+
+	return 0;
+}
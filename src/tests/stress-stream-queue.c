@@ -0,0 +1,143 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <time.h>
+
+#include <pipewire/stream-queue.h>
+
+/*
+ * Cycles all buffer ids through the two queues of a stream. The data
+ * thread moves ids from the queued to the dequeued queue and the
+ * application thread back, both in batches of a random size. Every id
+ * must be owned by one side only and come out of a queue in the order it
+ * went in.
+ */
+
+#define N_BUFFERS	ID_QUEUE_SIZE
+#define MAX_BATCH	8
+#define DEFAULT_CYCLES	(1u<<24)
+
+static struct id_queue dequeued;
+static struct id_queue queued;
+static uint32_t cycles;
+static sem_t sem;
+
+/* written by the pushing side before the push, checked by the popper */
+static uint32_t owner[N_BUFFERS];
+static uint32_t seq[2][N_BUFFERS];
+
+static uint32_t random_batch(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return 1 + ((*state >> 16) % MAX_BATCH);
+}
+
+static uint32_t move_ids(struct id_queue *from, struct id_queue *to,
+		uint32_t side, uint32_t *state, uint32_t *in_seq, uint32_t *out_seq)
+{
+	uint32_t ids[MAX_BATCH], i, n;
+
+	n = id_queue_pop(from, ids, random_batch(state));
+	for (i = 0; i < n; i++) {
+		uint32_t id = ids[i];
+
+		spa_assert_se(id < N_BUFFERS);
+		spa_assert_se(owner[id] == side);
+		spa_assert_se(seq[side][id] == (*in_seq)++);
+
+		owner[id] = !side;
+		seq[!side][id] = (*out_seq)++;
+	}
+	spa_assert_se(id_queue_push(to, ids, n) == n);
+	return n;
+}
+
+static void *data_start(void *arg)
+{
+	uint32_t state = 1, in_seq = 0, out_seq = N_BUFFERS, moved = 0;
+
+	printf("data thread started on cpu: %d\n", sched_getcpu());
+
+	while (moved < cycles) {
+		uint32_t n = move_ids(&queued, &dequeued, 0, &state, &in_seq, &out_seq);
+		if (n == 0)
+			sched_yield();
+		moved += n;
+	}
+	sem_post(&sem);
+	return NULL;
+}
+
+static void *app_start(void *arg)
+{
+	uint32_t state = 2, in_seq = 0, out_seq = 0, moved = 0;
+
+	printf("application thread started on cpu: %d\n", sched_getcpu());
+
+	while (moved < cycles) {
+		uint32_t n = move_ids(&dequeued, &queued, 1, &state, &in_seq, &out_seq);
+		if (n == 0)
+			sched_yield();
+		moved += n;
+	}
+	sem_post(&sem);
+	return NULL;
+}
+
+#define exit_error(msg) \
+do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+int main(int argc, char *argv[])
+{
+	pthread_t data_thread, app_thread;
+	uint32_t i, ids[N_BUFFERS];
+
+	printf("starting stream queue stress test\n");
+
+	if (argc > 1)
+		sscanf(argv[1], "%u", &cycles);
+	else
+		cycles = DEFAULT_CYCLES;
+
+	printf("buffers: %u, moves per thread: %u\n", N_BUFFERS, cycles);
+
+	id_queue_init(&dequeued);
+	id_queue_init(&queued);
+
+	/* all buffers start with the application, like a playback stream */
+	for (i = 0; i < N_BUFFERS; i++) {
+		ids[i] = i;
+		owner[i] = 1;
+		seq[1][i] = i;
+	}
+	spa_assert_se(id_queue_push(&dequeued, ids, N_BUFFERS) == N_BUFFERS);
+	spa_assert_se(id_queue_push(&dequeued, ids, 1) == 0);
+
+	if (sem_init(&sem, 0, 0) != 0)
+		exit_error("init_sem");
+
+	pthread_create(&data_thread, NULL, data_start, NULL);
+	pthread_create(&app_thread, NULL, app_start, NULL);
+
+	while (sem_wait(&sem) == -1 && errno == EINTR)
+		continue;
+	while (sem_wait(&sem) == -1 && errno == EINTR)
+		continue;
+
+	pthread_join(data_thread, NULL);
+	pthread_join(app_thread, NULL);
+
+	printf("dequeued read %u written %u, queued read %u written %u\n",
+			dequeued.ring.readindex, dequeued.ring.writeindex,
+			queued.ring.readindex, queued.ring.writeindex);
+
+	return 0;
+}
@@ -0,0 +1,1093 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <getopt.h>
+#include <locale.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/keys.h>
+#include <spa/utils/names.h>
+#include <spa/pod/parser.h>
+#include <spa/param/profiler.h>
+
+#include <pipewire/impl.h>
+#include <pipewire/filter.h>
+#include <pipewire/extensions/profiler.h>
+
+extern char **environ;
+
+#define MAX_NAME		128
+#define MAX_CHAINS		512
+#define MAX_NODES		64
+#define MAX_HOPS		(MAX_NODES + 2)
+#define MAX_QUANTA		16
+
+#define DEFAULT_CHAINS		4
+#define DEFAULT_NODES		4
+#define DEFAULT_RATE		48000
+#define DEFAULT_QUANTA		"64,256,1024"
+#define DEFAULT_DURATION	5.0
+#define DEFAULT_WARMUP		1.0
+
+/* The profiler flushes at least once per second */
+#define DRAIN_TIME		1.5
+
+#define NODE_PREFIX		"bench-"
+#define FAN_OUT_NAME		NODE_PREFIX "fan-out"
+#define FAN_IN_NAME		NODE_PREFIX "fan-in"
+
+struct data;
+
+struct node {
+	struct spa_list link;
+	struct data *data;
+	struct pw_filter *filter;
+	struct spa_hook listener;
+	void *in;
+	void *out;
+};
+
+struct client {
+	pid_t pid;
+	uint64_t cpu_start;
+	uint64_t cpu;
+};
+
+struct stats {
+	struct pw_array values;
+};
+
+struct summary {
+	double min, avg, p50, p99, max;
+	uint32_t count;
+};
+
+struct result {
+	uint32_t cycles;
+	uint32_t dropped;
+	uint32_t xruns;
+	uint32_t late;
+	uint32_t incomplete;
+	double dsp_load;
+
+	struct stats complete;
+	struct stats wakeup;
+	struct stats process;
+	struct stats hops[MAX_HOPS];
+
+	struct rusage ru_start;
+	struct rusage ru_end;
+};
+
+enum state {
+	STATE_SETUP,
+	STATE_WARMUP,
+	STATE_MEASURE,
+	STATE_DRAIN,
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+
+	struct pw_proxy *profiler;
+	struct spa_hook profiler_listener;
+
+	struct pw_impl_node *driver;
+	struct spa_source *timer;
+
+	uint32_t n_chains;
+	uint32_t n_nodes;
+	uint32_t n_remote;
+	uint32_t rate;
+	uint32_t load_usec;
+	bool fan_in;
+	bool fan_out;
+	bool json;
+	double duration;
+	double warmup;
+	uint32_t quanta[MAX_QUANTA];
+	uint32_t n_quanta;
+	char server[MAX_NAME];
+
+	struct spa_list nodes;
+	struct client clients[MAX_CHAINS];
+	uint32_t n_clients;
+
+	struct pw_array node_ids;
+	uint32_t n_ports;
+	uint32_t n_ports_expected;
+
+	struct pw_array links;
+
+	enum state state;
+	uint32_t run;
+	uint64_t start;
+	uint64_t end;
+	int64_t last_count;
+	int32_t last_xruns;
+	struct result result;
+
+	int res;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void stats_init(struct stats *s)
+{
+	pw_array_init(&s->values, 4096);
+}
+
+static void stats_clear(struct stats *s)
+{
+	pw_array_reset(&s->values);
+}
+
+static void stats_free(struct stats *s)
+{
+	pw_array_clear(&s->values);
+}
+
+static void stats_add(struct stats *s, int64_t value)
+{
+	int64_t *v;
+	if ((v = pw_array_add(&s->values, sizeof(int64_t))) != NULL)
+		*v = value;
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t va = *(const int64_t*)a, vb = *(const int64_t*)b;
+	return va < vb ? -1 : va > vb ? 1 : 0;
+}
+
+static void stats_summary(struct stats *s, struct summary *sum)
+{
+	int64_t *v = s->values.data, total = 0;
+	uint32_t i, n = pw_array_get_len(&s->values, int64_t);
+
+	spa_zero(*sum);
+	if (n == 0)
+		return;
+
+	qsort(v, n, sizeof(int64_t), cmp_int64);
+	for (i = 0; i < n; i++)
+		total += v[i];
+
+	sum->count = n;
+	sum->min = v[0] / 1000.0;
+	sum->max = v[n - 1] / 1000.0;
+	sum->avg = total / (double)n / 1000.0;
+	sum->p50 = v[n / 2] / 1000.0;
+	sum->p99 = v[SPA_MIN(n - 1, n * 99 / 100)] / 1000.0;
+}
+
+static uint64_t rusage_ns(const struct rusage *ru)
+{
+	return SPA_TIMEVAL_TO_USEC(&ru->ru_utime) * 1000 +
+		SPA_TIMEVAL_TO_USEC(&ru->ru_stime) * 1000;
+}
+
+static uint64_t client_cpu_ns(pid_t pid)
+{
+	char path[64], buf[1024], *p;
+	unsigned long utime = 0, stime = 0;
+	FILE *f;
+	size_t len;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	if ((f = fopen(path, "re")) == NULL)
+		return 0;
+	len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = '\0';
+
+	/* skip pid and (comm), which can contain spaces */
+	if ((p = strrchr(buf, ')')) == NULL ||
+	    sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+			    &utime, &stime) != 2)
+		return 0;
+
+	return (uint64_t)(utime + stime) * SPA_NSEC_PER_SEC / sysconf(_SC_CLK_TCK);
+}
+
+/** Position of a node in its chain, 0 for the fan-out node */
+static int node_hop(struct data *d, const char *name)
+{
+	uint32_t chain, pos;
+
+	if (spa_streq(name, FAN_OUT_NAME))
+		return 0;
+	if (spa_streq(name, FAN_IN_NAME))
+		return d->n_nodes + 1;
+	if (sscanf(name, NODE_PREFIX "%u-%u", &chain, &pos) == 2 && pos <= d->n_nodes)
+		return pos;
+	return -1;
+}
+
+static void on_process(void *userdata, struct spa_io_position *position)
+{
+	struct node *n = userdata;
+	struct data *d = n->data;
+	uint32_t n_samples = position->clock.duration;
+	float *in = NULL, *out = NULL;
+
+	if (n->in)
+		in = pw_filter_get_dsp_buffer(n->in, n_samples);
+	if (n->out)
+		out = pw_filter_get_dsp_buffer(n->out, n_samples);
+
+	if (out != NULL) {
+		if (in != NULL)
+			memcpy(out, in, n_samples * sizeof(float));
+		else
+			memset(out, 0, n_samples * sizeof(float));
+	}
+	if (d->load_usec > 0) {
+		uint64_t end = get_time_ns() + d->load_usec * SPA_NSEC_PER_USEC;
+		while (get_time_ns() < end);
+	}
+}
+
+static const struct pw_filter_events filter_events = {
+	PW_VERSION_FILTER_EVENTS,
+	.process = on_process,
+};
+
+static struct node *node_new(struct data *d, struct pw_core *core, const char *name,
+		bool input, bool output)
+{
+	struct node *n;
+
+	if ((n = calloc(1, sizeof(*n))) == NULL)
+		return NULL;
+
+	n->data = d;
+	spa_list_append(&d->nodes, &n->link);
+	n->filter = pw_filter_new(core, name,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, name,
+				PW_KEY_MEDIA_TYPE, "Audio",
+				PW_KEY_MEDIA_CATEGORY, "Filter",
+				PW_KEY_MEDIA_ROLE, "DSP",
+				PW_KEY_NODE_ALWAYS_PROCESS, "true",
+				NULL));
+	if (n->filter == NULL)
+		return NULL;
+
+	pw_filter_add_listener(n->filter, &n->listener, &filter_events, n);
+
+	if (input)
+		n->in = pw_filter_add_port(n->filter, PW_DIRECTION_INPUT,
+				PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+				pw_properties_new(
+					PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+					PW_KEY_PORT_NAME, "in",
+					NULL),
+				NULL, 0);
+	if (output)
+		n->out = pw_filter_add_port(n->filter, PW_DIRECTION_OUTPUT,
+				PW_FILTER_PORT_FLAG_MAP_BUFFERS, 0,
+				pw_properties_new(
+					PW_KEY_FORMAT_DSP, "32 bit float mono audio",
+					PW_KEY_PORT_NAME, "out",
+					NULL),
+				NULL, 0);
+
+	if (pw_filter_connect(n->filter, PW_FILTER_FLAG_RT_PROCESS, NULL, 0) < 0)
+		return NULL;
+
+	return n;
+}
+
+static int make_chain(struct data *d, struct pw_core *core, uint32_t chain)
+{
+	char name[MAX_NAME];
+	uint32_t i;
+
+	for (i = 1; i <= d->n_nodes; i++) {
+		snprintf(name, sizeof(name), NODE_PREFIX "%u-%u", chain, i);
+		if (node_new(d, core, name, true, true) == NULL)
+			return -errno;
+	}
+	return 0;
+}
+
+static void destroy_nodes(struct data *d)
+{
+	struct node *n;
+
+	spa_list_consume(n, &d->nodes, link) {
+		spa_list_remove(&n->link);
+		if (n->filter) {
+			spa_hook_remove(&n->listener);
+			pw_filter_destroy(n->filter);
+		}
+		free(n);
+	}
+}
+
+static void set_timeout(struct data *d, double seconds)
+{
+	struct timespec value = {
+		.tv_sec = (time_t)seconds,
+		.tv_nsec = (long)((seconds - (time_t)seconds) * SPA_NSEC_PER_SEC) + 1,
+	};
+	pw_loop_update_timer(pw_main_loop_get_loop(d->loop), d->timer, &value, NULL, false);
+}
+
+static void reset_result(struct data *d)
+{
+	struct result *r = &d->result;
+	uint32_t i;
+
+	r->cycles = r->dropped = r->xruns = r->late = r->incomplete = 0;
+	r->dsp_load = 0.0;
+	stats_clear(&r->complete);
+	stats_clear(&r->wakeup);
+	stats_clear(&r->process);
+	for (i = 0; i < MAX_HOPS; i++)
+		stats_clear(&r->hops[i]);
+	d->last_count = -1;
+	d->last_xruns = -1;
+}
+
+static void start_run(struct data *d)
+{
+	struct spa_dict_item items[2];
+	char quantum[32], rate[32];
+
+	snprintf(quantum, sizeof(quantum), "%u", d->quanta[d->run]);
+	snprintf(rate, sizeof(rate), "%u", d->rate);
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_FORCE_QUANTUM, quantum);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_FORCE_RATE, rate);
+	pw_impl_node_update_properties(d->driver, &SPA_DICT_INIT_ARRAY(items));
+
+	if (!d->json)
+		fprintf(stderr, "quantum %u: warming up for %.1fs\n", d->quanta[d->run], d->warmup);
+
+	d->state = STATE_WARMUP;
+	set_timeout(d, d->warmup);
+}
+
+static void print_summary(struct data *d, const char *label, struct summary *s, bool more)
+{
+	if (d->json)
+		printf("\"%s\":{\"min\":%.2f,\"avg\":%.2f,\"p50\":%.2f,\"p99\":%.2f,\"max\":%.2f}%s",
+				label, s->min, s->avg, s->p50, s->p99, s->max, more ? "," : "");
+	else
+		printf("  %-10s min:%9.2f avg:%9.2f p50:%9.2f p99:%9.2f max:%9.2f usec\n",
+				label, s->min, s->avg, s->p50, s->p99, s->max);
+}
+
+static void report_run(struct data *d)
+{
+	struct result *r = &d->result;
+	struct summary complete, wakeup, process, hop;
+	double wall = (d->end - d->start) / (double)SPA_NSEC_PER_SEC;
+	double server_cpu, client_cpu = 0.0;
+	uint32_t i, n_hops = d->n_nodes + 2;
+
+	server_cpu = (rusage_ns(&r->ru_end) - rusage_ns(&r->ru_start)) /
+		(double)SPA_NSEC_PER_SEC / wall * 100.0;
+	for (i = 0; i < d->n_clients; i++)
+		client_cpu += d->clients[i].cpu / (double)SPA_NSEC_PER_SEC / wall * 100.0;
+
+	stats_summary(&r->complete, &complete);
+	stats_summary(&r->wakeup, &wakeup);
+	stats_summary(&r->process, &process);
+
+	if (d->json) {
+		printf("{\"quantum\":%u,\"rate\":%u,\"chains\":%u,\"nodes\":%u,\"remote\":%u,"
+				"\"fan-in\":%s,\"fan-out\":%s,\"load-usec\":%u,"
+				"\"cycles\":%u,\"dropped\":%u,\"xruns\":%u,\"late\":%u,\"incomplete\":%u,",
+				d->quanta[d->run], d->rate, d->n_chains, d->n_nodes, d->n_remote,
+				d->fan_in ? "true" : "false", d->fan_out ? "true" : "false",
+				d->load_usec, r->cycles, r->dropped, r->xruns, r->late, r->incomplete);
+	} else {
+		printf("quantum:%u rate:%u chains:%u nodes:%u remote:%u fan-in:%s fan-out:%s load:%uus\n",
+				d->quanta[d->run], d->rate, d->n_chains, d->n_nodes, d->n_remote,
+				d->fan_in ? "yes" : "no", d->fan_out ? "yes" : "no", d->load_usec);
+		printf("  cycles:%u dropped:%u xruns:%u late:%u incomplete:%u\n",
+				r->cycles, r->dropped, r->xruns, r->late, r->incomplete);
+	}
+	print_summary(d, "complete", &complete, true);
+	print_summary(d, "wakeup", &wakeup, true);
+	print_summary(d, "process", &process, true);
+
+	if (d->json)
+		printf("\"hops\":[");
+	for (i = 0; i < n_hops; i++) {
+		stats_summary(&r->hops[i], &hop);
+		if (d->json)
+			printf("{\"hop\":%u,\"count\":%u,\"avg\":%.2f,\"p99\":%.2f,\"max\":%.2f}%s",
+					i, hop.count, hop.avg, hop.p99, hop.max,
+					i + 1 < n_hops ? "," : "");
+		else if (hop.count > 0)
+			printf("  hop %-6u wakeup avg:%9.2f p99:%9.2f max:%9.2f usec\n",
+					i, hop.avg, hop.p99, hop.max);
+	}
+	if (d->json)
+		printf("],\"cpu\":{\"server\":%.2f,\"clients\":%.2f},\"dsp-load\":%.4f}\n",
+				server_cpu, client_cpu, r->cycles ? r->dsp_load / r->cycles : 0.0);
+	else
+		printf("  cpu server:%.2f%% clients:%.2f%% dsp-load:%.4f\n",
+				server_cpu, client_cpu, r->cycles ? r->dsp_load / r->cycles : 0.0);
+	fflush(stdout);
+}
+
+static void on_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+	uint32_t i;
+
+	switch (d->state) {
+	case STATE_WARMUP:
+		reset_result(d);
+		getrusage(RUSAGE_SELF, &d->result.ru_start);
+		for (i = 0; i < d->n_clients; i++)
+			d->clients[i].cpu_start = client_cpu_ns(d->clients[i].pid);
+		d->start = get_time_ns();
+		d->end = d->start + (uint64_t)(d->duration * SPA_NSEC_PER_SEC);
+		d->state = STATE_MEASURE;
+		set_timeout(d, d->duration);
+		break;
+	case STATE_MEASURE:
+		getrusage(RUSAGE_SELF, &d->result.ru_end);
+		for (i = 0; i < d->n_clients; i++)
+			d->clients[i].cpu = client_cpu_ns(d->clients[i].pid) -
+				d->clients[i].cpu_start;
+		d->state = STATE_DRAIN;
+		set_timeout(d, DRAIN_TIME);
+		break;
+	case STATE_DRAIN:
+		report_run(d);
+		if (++d->run < d->n_quanta) {
+			start_run(d);
+		} else {
+			d->res = 0;
+			pw_main_loop_quit(d->loop);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void link_ports(struct data *d, const char *out_node, const char *in_node)
+{
+	struct pw_properties *props;
+	struct pw_proxy **link;
+
+	if ((link = pw_array_add(&d->links, sizeof(*link))) == NULL)
+		return;
+
+	props = pw_properties_new(
+			PW_KEY_LINK_OUTPUT_NODE, out_node,
+			PW_KEY_LINK_OUTPUT_PORT, "out",
+			PW_KEY_LINK_INPUT_NODE, in_node,
+			PW_KEY_LINK_INPUT_PORT, "in",
+			NULL);
+	*link = pw_core_create_object(d->core,
+			"link-factory", PW_TYPE_INTERFACE_Link, PW_VERSION_LINK,
+			&props->dict, 0);
+	pw_properties_free(props);
+}
+
+static void link_graph(struct data *d)
+{
+	char out_node[MAX_NAME], in_node[MAX_NAME];
+	uint32_t c, i;
+
+	for (c = 0; c < d->n_chains; c++) {
+		for (i = 1; i < d->n_nodes; i++) {
+			snprintf(out_node, sizeof(out_node), NODE_PREFIX "%u-%u", c, i);
+			snprintf(in_node, sizeof(in_node), NODE_PREFIX "%u-%u", c, i + 1);
+			link_ports(d, out_node, in_node);
+		}
+		if (d->fan_out) {
+			snprintf(in_node, sizeof(in_node), NODE_PREFIX "%u-%u", c, 1);
+			link_ports(d, FAN_OUT_NAME, in_node);
+		}
+		if (d->fan_in) {
+			snprintf(out_node, sizeof(out_node), NODE_PREFIX "%u-%u", c, d->n_nodes);
+			link_ports(d, out_node, FAN_IN_NAME);
+		}
+	}
+	if (!d->json)
+		fprintf(stderr, "graph ready: %u nodes, %u links\n",
+				(uint32_t)pw_array_get_len(&d->node_ids, uint32_t),
+				(uint32_t)pw_array_get_len(&d->links, struct pw_proxy *));
+}
+
+static bool is_bench_node(struct data *d, uint32_t id)
+{
+	uint32_t *n;
+	pw_array_for_each(n, &d->node_ids)
+		if (*n == id)
+			return true;
+	return false;
+}
+
+static void profiler_profile(void *data, const struct spa_pod *pod)
+{
+	struct data *d = data;
+	struct result *r = &d->result;
+	struct spa_pod *o;
+	struct spa_pod_prop *p;
+
+	if (d->state != STATE_MEASURE && d->state != STATE_DRAIN)
+		return;
+
+	SPA_POD_STRUCT_FOREACH(pod, o) {
+		struct spa_io_clock clock;
+		int64_t count = 0, signal = 0, awake = 0, finish = 0, prev_signal;
+		int32_t xruns = 0, status = 0;
+		float cpu_load[3] = { 0.0f, 0.0f, 0.0f };
+		uint32_t id;
+		const char *name;
+		bool incomplete = false;
+		int hop;
+
+		if (!spa_pod_is_object_type(o, SPA_TYPE_OBJECT_Profiler))
+			continue;
+
+		spa_zero(clock);
+
+		/* The info and clock blocks come first, followers last */
+		SPA_POD_OBJECT_FOREACH((struct spa_pod_object*)o, p) {
+			switch (p->key) {
+			case SPA_PROFILER_info:
+				spa_pod_parse_struct(&p->value,
+						SPA_POD_Long(&count),
+						SPA_POD_Float(&cpu_load[0]),
+						SPA_POD_Float(&cpu_load[1]),
+						SPA_POD_Float(&cpu_load[2]),
+						SPA_POD_Int(&xruns));
+				break;
+			case SPA_PROFILER_clock:
+				spa_pod_parse_struct(&p->value,
+						SPA_POD_Int(&clock.flags),
+						SPA_POD_Int(&clock.id),
+						SPA_POD_Stringn(clock.name, sizeof(clock.name)),
+						SPA_POD_Long(&clock.nsec),
+						SPA_POD_Fraction(&clock.rate),
+						SPA_POD_Long(&clock.position),
+						SPA_POD_Long(&clock.duration));
+				/* only cycles of this run, in the measure window */
+				if (clock.nsec < d->start || clock.nsec >= d->end ||
+				    clock.duration != d->quanta[d->run])
+					goto next;
+				break;
+			case SPA_PROFILER_driverBlock:
+				if (clock.duration == 0 ||
+				    spa_pod_parse_struct(&p->value,
+						SPA_POD_Int(&id),
+						SPA_POD_String(&name),
+						SPA_POD_Long(&prev_signal),
+						SPA_POD_Long(&signal),
+						SPA_POD_Long(&awake),
+						SPA_POD_Long(&finish),
+						SPA_POD_Int(&status)) < 0)
+					goto next;
+
+				if (d->last_count >= 0 && count > d->last_count + 1)
+					r->dropped += count - d->last_count - 1;
+				d->last_count = count;
+				if (d->last_xruns >= 0 && xruns > d->last_xruns)
+					r->xruns += xruns - d->last_xruns;
+				d->last_xruns = xruns;
+
+				r->cycles++;
+				r->dsp_load += cpu_load[0];
+				if (finish > signal) {
+					stats_add(&r->complete, finish - signal);
+					if ((uint64_t)(finish - signal) * d->rate >
+					    clock.duration * SPA_NSEC_PER_SEC)
+						r->late++;
+				}
+				break;
+			case SPA_PROFILER_followerBlock:
+				if (clock.duration == 0 ||
+				    spa_pod_parse_struct(&p->value,
+						SPA_POD_Int(&id),
+						SPA_POD_String(&name),
+						SPA_POD_Long(&prev_signal),
+						SPA_POD_Long(&signal),
+						SPA_POD_Long(&awake),
+						SPA_POD_Long(&finish),
+						SPA_POD_Int(&status)) < 0)
+					break;
+				if ((hop = node_hop(d, name)) < 0)
+					break;
+				/* a follower that did not finish in this cycle still
+				 * has the times of an older cycle */
+				if (signal <= 0 || awake < signal || finish < awake) {
+					incomplete = true;
+					break;
+				}
+				stats_add(&r->wakeup, awake - signal);
+				stats_add(&r->hops[hop], awake - signal);
+				stats_add(&r->process, finish - awake);
+				break;
+			default:
+				break;
+			}
+		}
+		if (incomplete)
+			r->incomplete++;
+next:
+		continue;
+	}
+}
+
+static const struct pw_profiler_events profiler_events = {
+	PW_VERSION_PROFILER_EVENTS,
+	.profile = profiler_profile,
+};
+
+static void registry_event_global(void *data, uint32_t id,
+				  uint32_t permissions, const char *type, uint32_t version,
+				  const struct spa_dict *props)
+{
+	struct data *d = data;
+	const char *str;
+	uint32_t *node_id, owner;
+
+	if (spa_streq(type, PW_TYPE_INTERFACE_Profiler)) {
+		if (d->profiler != NULL)
+			return;
+		d->profiler = pw_registry_bind(d->registry, id, type, PW_VERSION_PROFILER, 0);
+		if (d->profiler == NULL) {
+			pw_log_error("failed to bind profiler: %m");
+			return;
+		}
+		pw_proxy_add_object_listener(d->profiler, &d->profiler_listener,
+				&profiler_events, d);
+	}
+	else if (spa_streq(type, PW_TYPE_INTERFACE_Node)) {
+		if (props == NULL ||
+		    (str = spa_dict_lookup(props, PW_KEY_NODE_NAME)) == NULL ||
+		    !spa_strstartswith(str, NODE_PREFIX))
+			return;
+		if ((node_id = pw_array_add(&d->node_ids, sizeof(uint32_t))) != NULL)
+			*node_id = id;
+	}
+	else if (spa_streq(type, PW_TYPE_INTERFACE_Port)) {
+		if (props == NULL ||
+		    (str = spa_dict_lookup(props, PW_KEY_NODE_ID)) == NULL ||
+		    !spa_atou32(str, &owner, 0) ||
+		    !is_bench_node(d, owner))
+			return;
+
+		if (++d->n_ports == d->n_ports_expected && d->state == STATE_SETUP) {
+			link_graph(d);
+			start_run(d);
+		}
+	}
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_event_global,
+};
+
+static void on_core_error(void *_data, uint32_t id, int seq, int res, const char *message)
+{
+	struct data *d = _data;
+
+	pw_log_error("error id:%u seq:%d res:%d (%s): %s",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.error = on_core_error,
+};
+
+static void do_quit(void *data, int signal_number)
+{
+	struct data *d = data;
+	pw_main_loop_quit(d->loop);
+}
+
+static int spawn_client(struct data *d, const char *self, uint32_t chain)
+{
+	char chain_str[16], nodes_str[16], load_str[16];
+	char *argv[] = {
+		(char *)self, "--client", chain_str,
+		"--nodes", nodes_str, "--load", load_str, NULL
+	};
+	struct client *c = &d->clients[d->n_clients];
+	int res;
+
+	snprintf(chain_str, sizeof(chain_str), "%u", chain);
+	snprintf(nodes_str, sizeof(nodes_str), "%u", d->n_nodes);
+	snprintf(load_str, sizeof(load_str), "%u", d->load_usec);
+
+	if ((res = posix_spawn(&c->pid, "/proc/self/exe", NULL, NULL, argv, environ)) != 0)
+		return -res;
+
+	d->n_clients++;
+	return 0;
+}
+
+static void stop_clients(struct data *d)
+{
+	uint32_t i;
+
+	for (i = 0; i < d->n_clients; i++)
+		kill(d->clients[i].pid, SIGTERM);
+	for (i = 0; i < d->n_clients; i++)
+		waitpid(d->clients[i].pid, NULL, 0);
+	d->n_clients = 0;
+}
+
+/** Remote client mode: run one chain in this process, connected to the
+ * server of the parent pw-bench */
+static int run_client(struct data *d, uint32_t chain)
+{
+	struct pw_loop *l;
+	int res;
+
+	if ((d->loop = pw_main_loop_new(NULL)) == NULL)
+		return -errno;
+
+	l = pw_main_loop_get_loop(d->loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, d);
+	pw_loop_add_signal(l, SIGTERM, do_quit, d);
+
+	if ((d->context = pw_context_new(l, NULL, 0)) == NULL)
+		return -errno;
+
+	if ((d->core = pw_context_connect(d->context, NULL, 0)) == NULL)
+		return -errno;
+
+	pw_core_add_listener(d->core, &d->core_listener, &core_events, d);
+
+	if ((res = make_chain(d, d->core, chain)) < 0)
+		return res;
+
+	pw_main_loop_run(d->loop);
+
+	destroy_nodes(d);
+	spa_hook_remove(&d->core_listener);
+	pw_context_destroy(d->context);
+	pw_main_loop_destroy(d->loop);
+	return 0;
+}
+
+static int parse_quanta(struct data *d, const char *str)
+{
+	char **vals;
+	int i, n_vals, res = 0;
+
+	vals = pw_split_strv(str, ",", MAX_QUANTA + 1, &n_vals);
+	if (vals == NULL)
+		return -errno;
+
+	d->n_quanta = 0;
+	for (i = 0; i < n_vals; i++) {
+		if (d->n_quanta >= MAX_QUANTA ||
+		    !spa_atou32(vals[i], &d->quanta[d->n_quanta], 0) ||
+		    d->quanta[d->n_quanta] == 0) {
+			res = -EINVAL;
+			break;
+		}
+		d->n_quanta++;
+	}
+	pw_free_strv(vals);
+
+	return res < 0 ? res : d->n_quanta > 0 ? 0 : -EINVAL;
+}
+
+static void show_help(const char *name, bool error)
+{
+	fprintf(error ? stderr : stdout, "%s [options]\n"
+		"  -h, --help                            Show this help\n"
+		"      --version                         Show version\n"
+		"  -c, --chains=N                        Number of chains (default %d)\n"
+		"  -n, --nodes=N                         Nodes per chain (default %d)\n"
+		"  -o, --fan-out                         Add a node that feeds all chains\n"
+		"  -i, --fan-in                          Add a node that mixes all chains\n"
+		"  -R, --remote=N                        Chains run by remote clients (default 0)\n"
+		"  -q, --quantum=LIST                    Comma separated quanta (default %s)\n"
+		"  -r, --rate=RATE                       Graph rate (default %d)\n"
+		"  -d, --duration=SECONDS                Measure time per quantum (default %.1f)\n"
+		"  -w, --warmup=SECONDS                  Settle time per quantum (default %.1f)\n"
+		"  -l, --load=USEC                       Busy time per node and cycle (default 0)\n"
+		"  -j, --json                            Print one JSON object per quantum\n",
+		name, DEFAULT_CHAINS, DEFAULT_NODES, DEFAULT_QUANTA, DEFAULT_RATE,
+		DEFAULT_DURATION, DEFAULT_WARMUP);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = {
+		.n_chains = DEFAULT_CHAINS,
+		.n_nodes = DEFAULT_NODES,
+		.rate = DEFAULT_RATE,
+		.duration = DEFAULT_DURATION,
+		.warmup = DEFAULT_WARMUP,
+		.res = -1,
+	};
+	struct data *d = &data;
+	struct pw_loop *l;
+	struct pw_impl_factory *factory;
+	struct pw_proxy **link;
+	const char *quanta = DEFAULT_QUANTA;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "version",	no_argument,		NULL, 'V' },
+		{ "chains",	required_argument,	NULL, 'c' },
+		{ "nodes",	required_argument,	NULL, 'n' },
+		{ "fan-out",	no_argument,		NULL, 'o' },
+		{ "fan-in",	no_argument,		NULL, 'i' },
+		{ "remote",	required_argument,	NULL, 'R' },
+		{ "quantum",	required_argument,	NULL, 'q' },
+		{ "rate",	required_argument,	NULL, 'r' },
+		{ "duration",	required_argument,	NULL, 'd' },
+		{ "warmup",	required_argument,	NULL, 'w' },
+		{ "load",	required_argument,	NULL, 'l' },
+		{ "json",	no_argument,		NULL, 'j' },
+		{ "client",	required_argument,	NULL, 'C' },
+		{ NULL, 0, NULL, 0}
+	};
+	int c, client = -1;
+	uint32_t i;
+
+	setlocale(LC_ALL, "");
+	pw_init(&argc, &argv);
+
+	while ((c = getopt_long(argc, argv, "hVc:n:oiR:q:r:d:w:l:jC:", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(argv[0], false);
+			return 0;
+		case 'V':
+			printf("%s\n"
+				"Compiled with libpipewire %s\n"
+				"Linked with libpipewire %s\n",
+				argv[0],
+				pw_get_headers_version(),
+				pw_get_library_version());
+			return 0;
+		case 'c':
+			data.n_chains = atoi(optarg);
+			break;
+		case 'n':
+			data.n_nodes = atoi(optarg);
+			break;
+		case 'o':
+			data.fan_out = true;
+			break;
+		case 'i':
+			data.fan_in = true;
+			break;
+		case 'R':
+			data.n_remote = atoi(optarg);
+			break;
+		case 'q':
+			quanta = optarg;
+			break;
+		case 'r':
+			data.rate = atoi(optarg);
+			break;
+		case 'd':
+			data.duration = atof(optarg);
+			break;
+		case 'w':
+			data.warmup = atof(optarg);
+			break;
+		case 'l':
+			data.load_usec = atoi(optarg);
+			break;
+		case 'j':
+			data.json = true;
+			break;
+		case 'C':
+			client = atoi(optarg);
+			break;
+		default:
+			show_help(argv[0], true);
+			return -1;
+		}
+	}
+
+	if (data.n_chains < 1 || data.n_chains > MAX_CHAINS ||
+	    data.n_nodes < 1 || data.n_nodes > MAX_NODES ||
+	    data.n_remote > data.n_chains || data.rate == 0 ||
+	    data.duration <= 0.0 || data.warmup < 0.0) {
+		fprintf(stderr, "invalid graph options\n");
+		show_help(argv[0], true);
+		return -1;
+	}
+	if (parse_quanta(d, quanta) < 0) {
+		fprintf(stderr, "invalid quantum list '%s'\n", quanta);
+		return -1;
+	}
+
+	spa_list_init(&data.nodes);
+	pw_array_init(&data.node_ids, 64);
+	pw_array_init(&data.links, 64);
+
+	if (client >= 0) {
+		if ((c = run_client(d, client)) < 0)
+			fprintf(stderr, "client %d failed: %s\n", client, spa_strerror(c));
+		pw_array_clear(&data.node_ids);
+		pw_array_clear(&data.links);
+		pw_deinit();
+		return c < 0 ? -1 : 0;
+	}
+
+	stats_init(&data.result.complete);
+	stats_init(&data.result.wakeup);
+	stats_init(&data.result.process);
+	for (i = 0; i < MAX_HOPS; i++)
+		stats_init(&data.result.hops[i]);
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL) {
+		fprintf(stderr, "Can't create main loop: %m\n");
+		return -1;
+	}
+
+	l = pw_main_loop_get_loop(data.loop);
+	pw_loop_add_signal(l, SIGINT, do_quit, &data);
+	pw_loop_add_signal(l, SIGTERM, do_quit, &data);
+	data.timer = pw_loop_add_timer(l, on_timeout, &data);
+
+	/* The graph runs in this process. Remote clients connect to our
+	 * own socket, so we don't disturb or depend on a running server. */
+	snprintf(data.server, sizeof(data.server), "pw-bench-%d", (int)getpid());
+	data.context = pw_context_new(l,
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				PW_KEY_CORE_NAME, data.server,
+				PW_KEY_CORE_DAEMON, data.n_remote > 0 ? "true" : "false",
+				NULL),
+			0);
+	if (data.context == NULL) {
+		fprintf(stderr, "Can't create context: %m\n");
+		return -1;
+	}
+
+	pw_context_load_module(data.context, "libpipewire-module-rt", NULL, NULL);
+	if (pw_context_load_module(data.context, "libpipewire-module-protocol-native", NULL, NULL) == NULL ||
+	    pw_context_load_module(data.context, PW_EXTENSION_MODULE_PROFILER, NULL, NULL) == NULL ||
+	    pw_context_load_module(data.context, "libpipewire-module-spa-node-factory", NULL, NULL) == NULL ||
+	    pw_context_load_module(data.context, "libpipewire-module-client-node", NULL, NULL) == NULL ||
+	    pw_context_load_module(data.context, "libpipewire-module-link-factory", NULL, NULL) == NULL) {
+		fprintf(stderr, "Can't load modules: %m\n");
+		goto exit;
+	}
+
+	if ((factory = pw_context_find_factory(data.context, "spa-node-factory")) == NULL ||
+	    (data.driver = pw_impl_factory_create_object(factory, NULL,
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+			pw_properties_new(
+				SPA_KEY_FACTORY_NAME, SPA_NAME_SUPPORT_NODE_DRIVER,
+				SPA_KEY_LIBRARY_NAME, "support/libspa-support",
+				PW_KEY_NODE_NAME, NODE_PREFIX "driver",
+				PW_KEY_PRIORITY_DRIVER, "1",
+				NULL),
+			SPA_ID_INVALID)) == NULL) {
+		fprintf(stderr, "Can't create driver: %m\n");
+		goto exit;
+	}
+
+	data.core = pw_context_connect_self(data.context, NULL, 0);
+	if (data.core == NULL) {
+		fprintf(stderr, "Can't connect: %m\n");
+		goto exit;
+	}
+	pw_core_add_listener(data.core, &data.core_listener, &core_events, &data);
+
+	data.registry = pw_core_get_registry(data.core, PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(data.registry, &data.registry_listener,
+			&registry_events, &data);
+
+	data.n_ports_expected = data.n_chains * data.n_nodes * 2 +
+		(data.fan_out ? 1 : 0) + (data.fan_in ? 1 : 0);
+
+	if (data.fan_out && node_new(d, data.core, FAN_OUT_NAME, false, true) == NULL)
+		goto exit_node;
+	if (data.fan_in && node_new(d, data.core, FAN_IN_NAME, true, false) == NULL)
+		goto exit_node;
+	for (i = 0; i < data.n_chains - data.n_remote; i++)
+		if (make_chain(d, data.core, i) < 0)
+			goto exit_node;
+
+	setenv("PIPEWIRE_REMOTE", data.server, 1);
+	for (; i < data.n_chains; i++) {
+		if ((c = spawn_client(d, argv[0], i)) < 0) {
+			fprintf(stderr, "Can't start client: %s\n", spa_strerror(c));
+			goto exit;
+		}
+	}
+
+	pw_main_loop_run(data.loop);
+
+	if (data.state == STATE_SETUP)
+		fprintf(stderr, "graph not ready: %u of %u ports\n",
+				data.n_ports, data.n_ports_expected);
+	goto exit;
+
+exit_node:
+	fprintf(stderr, "Can't create node: %m\n");
+exit:
+	stop_clients(d);
+	pw_array_for_each(link, &data.links)
+		if (*link)
+			pw_proxy_destroy(*link);
+	destroy_nodes(d);
+	if (data.profiler) {
+		spa_hook_remove(&data.profiler_listener);
+		pw_proxy_destroy(data.profiler);
+	}
+	if (data.registry) {
+		spa_hook_remove(&data.registry_listener);
+		pw_proxy_destroy((struct pw_proxy*)data.registry);
+	}
+	if (data.core) {
+		spa_hook_remove(&data.core_listener);
+		pw_core_disconnect(data.core);
+	}
+	pw_context_destroy(data.context);
+	pw_main_loop_destroy(data.loop);
+
+	stats_free(&data.result.complete);
+	stats_free(&data.result.wakeup);
+	stats_free(&data.result.process);
+	for (i = 0; i < MAX_HOPS; i++)
+		stats_free(&data.result.hops[i]);
+	pw_array_clear(&data.node_ids);
+	pw_array_clear(&data.links);
+
+	pw_deinit();
+
+	return data.res;
+}
@@ -20,16 +20,22 @@
 #include <spa/utils/result.h>
 #include <spa/utils/string.h>
 #include <spa/pod/iter.h>
+#include <spa/pod/parser.h>
+#include <spa/param/profiler.h>
 #include <spa/debug/types.h>
 #include <spa/utils/json.h>
 #include <spa/utils/ansi.h>
 #include <spa/utils/string.h>
 
 #include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
 #include <pipewire/extensions/metadata.h>
+#include <pipewire/extensions/profiler.h>
 
 #define INDENT 2
 
+#define STATS_TIMEOUT	2
+
 static bool colors = false;
 
 #define NORMAL	(colors ? SPA_ANSI_RESET : "")
@@ -50,6 +56,10 @@ struct data {
 	struct pw_registry *registry;
 	struct spa_hook registry_listener;
 
+	struct pw_proxy *profiler;
+	struct spa_hook profiler_listener;
+	struct spa_source *stats_timer;
+
 	struct spa_list object_list;
 
 	const char *pattern;
@@ -64,6 +74,16 @@ struct data {
 	uint32_t state;
 
 	unsigned int monitor:1;
+	unsigned int stats:1;
+	unsigned int have_stats:1;
+};
+
+struct link_stats {
+	uint64_t bytes;
+	uint64_t buffers;
+	uint64_t mixed;
+	uint32_t underruns;
+	unsigned int valid:1;
 };
 
 struct param {
@@ -97,6 +117,7 @@ struct object {
 
 	const struct class *class;
 	void *info;
+	struct link_stats stats;
 	struct spa_param_info *params;
 	uint32_t n_params;
 
@@ -1062,6 +1083,14 @@ static void link_dump(struct object *o)
 	put_value(d, "error", i->error);
 	put_pod(d, "format", i->format);
 	put_dict(d, "props", i->props);
+	if (o->stats.valid) {
+		put_begin(d, "stats", "{", 0);
+		put_int(d, "bytes", o->stats.bytes);
+		put_int(d, "buffers", o->stats.buffers);
+		put_int(d, "mixed", o->stats.mixed);
+		put_int(d, "underruns", o->stats.underruns);
+		put_end(d, "}", 0);
+	}
 	put_end(d, "}", 0);
 }
 
@@ -1257,6 +1286,97 @@ static const struct class metadata_class = {
 	.name_key = PW_KEY_METADATA_NAME,
 };
 
+/* profiler */
+static int link_stats_update(struct data *d, const struct spa_pod *pod)
+{
+	struct object *o;
+	struct link_stats s;
+	uint32_t id = 0, output_node, output_port, input_node, input_port;
+	int res;
+
+	spa_zero(s);
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&output_node),
+			SPA_POD_Int(&output_port),
+			SPA_POD_Int(&input_node),
+			SPA_POD_Int(&input_port),
+			SPA_POD_Long(&s.bytes),
+			SPA_POD_Long(&s.buffers),
+			SPA_POD_Long(&s.mixed),
+			SPA_POD_Int(&s.underruns))) < 0)
+		return res;
+
+	if ((o = find_object(d, id)) == NULL || o->class != &link_class)
+		return 0;
+
+	s.valid = true;
+	if (memcmp(&o->stats, &s, sizeof(s)) == 0)
+		return 0;
+
+	o->stats = s;
+	o->changed++;
+	return 1;
+}
+
+static void profiler_profile(void *data, const struct spa_pod *pod)
+{
+	struct data *d = data;
+	struct spa_pod *o;
+	struct spa_pod_prop *p;
+	int changed = 0;
+
+	SPA_POD_STRUCT_FOREACH(pod, o) {
+		if (!spa_pod_is_object_type(o, SPA_TYPE_OBJECT_Profiler))
+			continue;
+
+		SPA_POD_OBJECT_FOREACH((struct spa_pod_object*)o, p) {
+			if (p->key != SPA_PROFILER_linkBlock)
+				continue;
+			if (link_stats_update(d, &p->value) > 0)
+				changed++;
+			d->have_stats = true;
+		}
+	}
+	if (changed || (d->have_stats && !d->monitor))
+		core_sync(d);
+}
+
+static const struct pw_profiler_events profiler_events = {
+	PW_VERSION_PROFILER_EVENTS,
+	.profile = profiler_profile,
+};
+
+static void stats_timeout(void *data, uint64_t expirations)
+{
+	struct data *d = data;
+
+	/* nothing is running, dump without stats */
+	pw_log_debug("no link stats after %d seconds", STATS_TIMEOUT);
+	d->have_stats = true;
+	core_sync(d);
+}
+
+static void bind_profiler(struct data *d, uint32_t id, const char *type)
+{
+	struct timespec value;
+
+	d->profiler = pw_registry_bind(d->registry, id, type, PW_VERSION_PROFILER, 0);
+	if (d->profiler == NULL) {
+		pw_log_error("can't bind profiler %u: %m", id);
+		return;
+	}
+	pw_proxy_add_object_listener(d->profiler, &d->profiler_listener,
+			&profiler_events, d);
+
+	if (!d->monitor) {
+		value.tv_sec = STATS_TIMEOUT;
+		value.tv_nsec = 0;
+		pw_loop_update_timer(pw_main_loop_get_loop(d->loop),
+				d->stats_timer, &value, NULL, false);
+	}
+}
+
 static const struct class *classes[] =
 {
 	&core_class,
@@ -1315,6 +1435,10 @@ static void registry_event_global(void *data, uint32_t id,
 	struct data *d = data;
 	struct object *o;
 
+	if (d->stats && d->profiler == NULL &&
+	    spa_streq(type, PW_TYPE_INTERFACE_Profiler))
+		bind_profiler(d, id, type);
+
 	o = calloc(1, sizeof(*o));
 	if (o == NULL) {
 		pw_log_error("can't alloc object for %u %s/%d: %m", id, type, version);
@@ -1488,6 +1612,10 @@ static void on_core_done(void *data, uint32_t id, int seq)
 			object_update_params(&o->param_list, &o->pending_list,
 					o->n_params, o->params);
 
+		/* wait for the link stats before the one and only dump */
+		if (!d->monitor && d->profiler != NULL && !d->have_stats)
+			return;
+
 		dump_objects(d);
 		if (!d->monitor)
 			pw_main_loop_quit(d->loop);
@@ -1514,6 +1642,7 @@ static void show_help(struct data *data, const char *name, bool error)
 		"      --version                         Show version\n"
 		"  -r, --remote                          Remote daemon name\n"
 		"  -m, --monitor                         monitor changes\n"
+		"  -s, --stats                           add the link counters of the profiler\n"
 		"  -N, --no-colors                       disable color output\n"
 		"  -C, --color[=WHEN]                    whether to enable color support. WHEN is `never`, `always`, or `auto`\n",
 		name);
@@ -1530,6 +1659,7 @@ int main(int argc, char *argv[])
 		{ "version",	no_argument,		NULL, 'V' },
 		{ "remote",	required_argument,	NULL, 'r' },
 		{ "monitor",	no_argument,		NULL, 'm' },
+		{ "stats",	no_argument,		NULL, 's' },
 		{ "no-colors",	no_argument,		NULL, 'N' },
 		{ "color",	optional_argument,	NULL, 'C' },
 		{ NULL, 0, NULL, 0}
@@ -1544,7 +1674,7 @@ int main(int argc, char *argv[])
 		colors = true;
 	setlinebuf(data.out);
 
-	while ((c = getopt_long(argc, argv, "hVr:mNC", long_options, NULL)) != -1) {
+	while ((c = getopt_long(argc, argv, "hVr:msNC", long_options, NULL)) != -1) {
 		switch (c) {
 		case 'h' :
 			show_help(&data, argv[0], false);
@@ -1563,6 +1693,9 @@ int main(int argc, char *argv[])
 		case 'm' :
 			data.monitor = true;
 			break;
+		case 's' :
+			data.stats = true;
+			break;
 		case 'N' :
 			colors = false;
 			break;
@@ -1605,6 +1738,11 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	if (data.stats) {
+		pw_context_load_module(data.context, PW_EXTENSION_MODULE_PROFILER, NULL, NULL);
+		data.stats_timer = pw_loop_add_timer(l, stats_timeout, &data);
+	}
+
 	data.core = pw_context_connect(data.context,
 			pw_properties_new(
 				PW_KEY_REMOTE_NAME, opt_remote,
@@ -1632,6 +1770,10 @@ int main(int argc, char *argv[])
 		object_destroy(o);
 	if (data.info)
 		pw_core_info_free(data.info);
+	if (data.profiler) {
+		spa_hook_remove(&data.profiler_listener);
+		pw_proxy_destroy(data.profiler);
+	}
 
 	spa_hook_remove(&data.registry_listener);
 	pw_proxy_destroy((struct pw_proxy*)data.registry);
@@ -0,0 +1,371 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2024 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <getopt.h>
+#include <locale.h>
+
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/defs.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/parser.h>
+#include <spa/param/props.h>
+
+#include <pipewire/pipewire.h>
+
+enum state {
+	STATE_FIND,
+	STATE_START,
+	STATE_RUNNING,
+	STATE_STOP,
+};
+
+struct data {
+	struct pw_main_loop *loop;
+
+	const char *opt_remote;
+	const char *opt_node;
+	const char *opt_format;
+	uint32_t opt_buffer_msec;
+	bool opt_stop;
+	bool opt_detach;
+	char path[PATH_MAX];
+
+	struct pw_context *context;
+
+	struct pw_core *core;
+	struct spa_hook core_listener;
+
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+
+	struct pw_node *node;
+	struct spa_hook node_listener;
+	uint32_t node_id;
+
+	enum state state;
+	int sync;
+	int res;
+};
+
+static void set_tap(struct data *d, const char *path)
+{
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	struct spa_pod_frame f[2];
+	struct spa_pod *param;
+
+	spa_pod_builder_push_object(&b, &f[0], SPA_TYPE_OBJECT_Props, SPA_PARAM_Props);
+	spa_pod_builder_prop(&b, SPA_PROP_params, 0);
+	spa_pod_builder_push_struct(&b, &f[1]);
+	if (path[0] != '\0') {
+		spa_pod_builder_string(&b, "debug.tap.format");
+		spa_pod_builder_string(&b, d->opt_format ? d->opt_format : "auto");
+		if (d->opt_buffer_msec) {
+			spa_pod_builder_string(&b, "debug.tap.buffer-msec");
+			spa_pod_builder_int(&b, d->opt_buffer_msec);
+		}
+	}
+	spa_pod_builder_string(&b, "debug.tap.path");
+	spa_pod_builder_string(&b, path);
+	spa_pod_builder_pop(&b, &f[1]);
+	param = spa_pod_builder_pop(&b, &f[0]);
+
+	pw_node_set_param(d->node, SPA_PARAM_Props, 0, param);
+}
+
+static void stop_tap(struct data *d)
+{
+	/* get the final stats before the tap goes away */
+	pw_node_enum_params(d->node, 0, SPA_PARAM_Props, 0, 0, NULL);
+	set_tap(d, "");
+	d->state = STATE_STOP;
+	d->sync = pw_core_sync(d->core, PW_ID_CORE, d->sync);
+}
+
+static void node_event_param(void *data, int seq,
+			uint32_t id, uint32_t index, uint32_t next,
+			const struct spa_pod *param)
+{
+	struct data *d = data;
+	struct spa_pod_parser prs;
+	struct spa_pod_frame f;
+	struct spa_pod *params = NULL;
+	const char *path = "", *key, *str;
+	int64_t written = -1, dropped = -1;
+
+	if (spa_pod_parse_object(param, SPA_TYPE_OBJECT_Props, NULL,
+			SPA_PROP_params, SPA_POD_OPT_Pod(&params)) < 0 ||
+	    params == NULL)
+		return;
+
+	spa_pod_parser_pod(&prs, params);
+	if (spa_pod_parser_push_struct(&prs, &f) < 0)
+		return;
+
+	while (spa_pod_parser_get_string(&prs, &key) >= 0) {
+		if (spa_streq(key, "debug.tap.path")) {
+			if (spa_pod_parser_get_string(&prs, &str) >= 0)
+				path = str;
+		} else if (spa_streq(key, "debug.tap.written")) {
+			spa_pod_parser_get_long(&prs, &written);
+		} else if (spa_streq(key, "debug.tap.dropped")) {
+			spa_pod_parser_get_long(&prs, &dropped);
+		} else if (spa_pod_parser_next(&prs) == NULL)
+			break;
+	}
+	if (written < 0) {
+		printf("node %u: no tap\n", d->node_id);
+		return;
+	}
+	printf("tap '%s': written %"PRIi64" samples, dropped %"PRIi64" samples\n",
+			path, written, dropped);
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.param = node_event_param,
+};
+
+static void registry_event_global(void *data, uint32_t id, uint32_t permissions,
+				  const char *type, uint32_t version,
+				  const struct spa_dict *props)
+{
+	struct data *d = data;
+	const char *name;
+	uint32_t node_id;
+
+	if (d->node != NULL || !spa_streq(type, PW_TYPE_INTERFACE_Node) || props == NULL)
+		return;
+
+	name = spa_dict_lookup(props, PW_KEY_NODE_NAME);
+	if (!(spa_atou32(d->opt_node, &node_id, 0) && node_id == id) &&
+	    !spa_streq(name, d->opt_node))
+		return;
+
+	d->node_id = id;
+	d->node = pw_registry_bind(d->registry, id, type, PW_VERSION_NODE, 0);
+	pw_node_add_listener(d->node, &d->node_listener, &node_events, d);
+
+	if (d->opt_stop) {
+		stop_tap(d);
+	} else {
+		printf("tapping node %u (%s) to '%s'\n", id, name, d->path);
+		set_tap(d, d->path);
+		d->state = STATE_START;
+		d->sync = pw_core_sync(d->core, PW_ID_CORE, d->sync);
+	}
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_event_global,
+};
+
+static void on_core_done(void *data, uint32_t id, int seq)
+{
+	struct data *d = data;
+
+	if (id != PW_ID_CORE || d->sync != seq)
+		return;
+
+	switch (d->state) {
+	case STATE_FIND:
+		fprintf(stderr, "node '%s' not found\n", d->opt_node);
+		d->res = -ENOENT;
+		pw_main_loop_quit(d->loop);
+		break;
+	case STATE_START:
+		if (d->opt_detach) {
+			pw_main_loop_quit(d->loop);
+			break;
+		}
+		d->state = STATE_RUNNING;
+		printf("press Ctrl-C to stop\n");
+		break;
+	case STATE_STOP:
+		pw_main_loop_quit(d->loop);
+		break;
+	default:
+		break;
+	}
+}
+
+static void on_core_error(void *data, uint32_t id, int seq, int res, const char *message)
+{
+	struct data *d = data;
+
+	pw_log_error("error id:%u seq:%d res:%d (%s): %s",
+			id, seq, res, spa_strerror(res), message);
+
+	if (id == PW_ID_CORE && res == -EPIPE)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = on_core_done,
+	.error = on_core_error,
+};
+
+static void do_quit(void *userdata, int signal_number)
+{
+	struct data *d = userdata;
+
+	if (d->state == STATE_RUNNING)
+		stop_tap(d);
+	else
+		pw_main_loop_quit(d->loop);
+}
+
+static void show_help(struct data *data, const char *name, bool error)
+{
+        fprintf(error ? stderr : stdout, "%s [options] <node> [ <path> ]\n"
+		"  -h, --help                            Show this help\n"
+		"      --version                         Show version\n"
+		"  -r, --remote                          Remote daemon name\n"
+		"  -f, --format                          File format: auto, wav or raw (default: auto)\n"
+		"  -b, --buffer-msec                     Capture buffer size in milliseconds\n"
+		"  -d, --detach                          Leave the tap running and exit\n"
+		"  -s, --stop                            Stop the tap and show the stats\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { 0, };
+	int c;
+	static const struct option long_options[] = {
+		{ "help",	no_argument,		NULL, 'h' },
+		{ "version",	no_argument,		NULL, 'V' },
+		{ "remote",	required_argument,	NULL, 'r' },
+		{ "format",	required_argument,	NULL, 'f' },
+		{ "buffer-msec",	required_argument,	NULL, 'b' },
+		{ "detach",	no_argument,		NULL, 'd' },
+		{ "stop",	no_argument,		NULL, 's' },
+		{ NULL,	0, NULL, 0}
+	};
+
+	setlinebuf(stdout);
+
+	setlocale(LC_ALL, "");
+	pw_init(&argc, &argv);
+
+	while ((c = getopt_long(argc, argv, "hVr:f:b:ds", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'h':
+			show_help(&data, argv[0], false);
+			return 0;
+		case 'V':
+			printf("%s\n"
+				"Compiled with libpipewire %s\n"
+				"Linked with libpipewire %s\n",
+				argv[0],
+				pw_get_headers_version(),
+				pw_get_library_version());
+			return 0;
+		case 'r':
+			data.opt_remote = optarg;
+			break;
+		case 'f':
+			data.opt_format = optarg;
+			break;
+		case 'b':
+			if (!spa_atou32(optarg, &data.opt_buffer_msec, 0)) {
+				fprintf(stderr, "invalid buffer size '%s'\n", optarg);
+				return -1;
+			}
+			break;
+		case 'd':
+			data.opt_detach = true;
+			break;
+		case 's':
+			data.opt_stop = true;
+			break;
+		default:
+			show_help(&data, argv[0], true);
+			return -1;
+		}
+	}
+
+	if (optind < argc)
+		data.opt_node = argv[optind++];
+	if (data.opt_node == NULL || (!data.opt_stop && optind >= argc)) {
+		show_help(&data, argv[0], true);
+		return -1;
+	}
+	if (!data.opt_stop) {
+		const char *path = argv[optind++];
+		char cwd[PATH_MAX];
+		int len;
+
+		/* the server opens the path, make it independent of our cwd */
+		if (path[0] == '/' || spa_strstartswith(path, "unix:") ||
+		    getcwd(cwd, sizeof(cwd)) == NULL)
+			len = snprintf(data.path, sizeof(data.path), "%s", path);
+		else
+			len = snprintf(data.path, sizeof(data.path), "%s/%s", cwd, path);
+		if (len < 0 || (size_t)len >= sizeof(data.path)) {
+			fprintf(stderr, "path too long: %s\n", path);
+			return -1;
+		}
+	}
+
+	data.loop = pw_main_loop_new(NULL);
+	if (data.loop == NULL) {
+		fprintf(stderr, "can't create mainloop: %m\n");
+		return -1;
+	}
+	pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGINT, do_quit, &data);
+	pw_loop_add_signal(pw_main_loop_get_loop(data.loop), SIGTERM, do_quit, &data);
+
+	data.context = pw_context_new(pw_main_loop_get_loop(data.loop), NULL, 0);
+	if (data.context == NULL) {
+		fprintf(stderr, "can't create context: %m\n");
+		return -1;
+	}
+
+	data.core = pw_context_connect(data.context,
+			pw_properties_new(
+				PW_KEY_REMOTE_NAME, data.opt_remote,
+				NULL),
+			0);
+	if (data.core == NULL) {
+		fprintf(stderr, "can't connect: %m\n");
+		return -1;
+	}
+
+	pw_core_add_listener(data.core,
+			&data.core_listener,
+			&core_events, &data);
+
+	data.registry = pw_core_get_registry(data.core,
+			PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(data.registry,
+			&data.registry_listener,
+			&registry_events, &data);
+
+	data.sync = pw_core_sync(data.core, PW_ID_CORE, data.sync);
+
+	pw_main_loop_run(data.loop);
+
+	if (data.node) {
+		spa_hook_remove(&data.node_listener);
+		pw_proxy_destroy((struct pw_proxy*)data.node);
+	}
+	spa_hook_remove(&data.registry_listener);
+	pw_proxy_destroy((struct pw_proxy*)data.registry);
+	spa_hook_remove(&data.core_listener);
+	pw_core_disconnect(data.core);
+	pw_context_destroy(data.context);
+	pw_main_loop_destroy(data.loop);
+	pw_deinit();
+
+	return data.res;
+}
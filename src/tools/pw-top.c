@@ -57,6 +57,26 @@ struct node {
 	struct spa_hook object_listener;
 };
 
+struct link_stats {
+	uint64_t bytes;
+	uint64_t buffers;
+	uint64_t mixed;
+	uint32_t underruns;
+};
+
+struct link {
+	struct spa_list link;
+	uint32_t id;
+	uint32_t output_node;
+	uint32_t output_port;
+	uint32_t input_node;
+	uint32_t input_port;
+	struct link_stats stats;
+	struct link_stats prev;
+	struct link_stats rate;		/* difference over the last refresh period */
+	uint32_t generation;
+};
+
 struct data {
 	struct pw_main_loop *loop;
 	struct pw_context *context;
@@ -75,8 +95,10 @@ struct data {
 
 	int n_nodes;
 	struct spa_list node_list;
+	struct spa_list link_list;
 	uint32_t generation;
 	unsigned pending_refresh:1;
+	unsigned show_links:1;
 
 	WINDOW *win;
 };
@@ -371,6 +393,60 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	return 0;
 }
 
+static struct link *find_link(struct data *d, uint32_t id)
+{
+	struct link *l;
+	spa_list_for_each(l, &d->link_list, link) {
+		if (l->id == id)
+			return l;
+	}
+	return NULL;
+}
+
+static void remove_link(struct data *d, struct link *l)
+{
+	spa_list_remove(&l->link);
+	d->pending_refresh = true;
+	free(l);
+}
+
+static int process_link_block(struct data *d, const struct spa_pod *pod, struct point *point)
+{
+	struct link *l;
+	struct link_stats s;
+	uint32_t id = 0, output_node = 0, output_port = 0, input_node = 0, input_port = 0;
+	int res;
+
+	spa_zero(s);
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&output_node),
+			SPA_POD_Int(&output_port),
+			SPA_POD_Int(&input_node),
+			SPA_POD_Int(&input_port),
+			SPA_POD_Long(&s.bytes),
+			SPA_POD_Long(&s.buffers),
+			SPA_POD_Long(&s.mixed),
+			SPA_POD_Int(&s.underruns))) < 0)
+		return res;
+
+	if ((l = find_link(d, id)) == NULL) {
+		if ((l = calloc(1, sizeof(*l))) == NULL)
+			return -errno;
+		l->id = id;
+		l->prev = s;
+		spa_list_append(&d->link_list, &l->link);
+		d->pending_refresh = true;
+	}
+	l->output_node = output_node;
+	l->output_port = output_port;
+	l->input_node = input_node;
+	l->input_port = input_port;
+	l->stats = s;
+	l->generation = d->generation;
+	return 0;
+}
+
 static const char *print_time(char *buf, bool active, size_t len, uint64_t val)
 {
 	if (val == (uint64_t)-1 || !active)
@@ -469,6 +545,68 @@ static void print_node(struct data *d, struct driver *i, struct node *n, int y)
 			n->name);
 }
 
+static const char *node_name(struct data *d, uint32_t id)
+{
+	struct node *n = find_node(d, id);
+	return n ? n->name : "";
+}
+
+static void print_link(struct data *d, struct link *l, int y)
+{
+	struct link_stats *r = &l->rate;
+	char out[MAX_NAME + 16], in[MAX_NAME + 16];
+
+	snprintf(out, sizeof(out), "%s:%u", node_name(d, l->output_node), l->output_port);
+	snprintf(in, sizeof(in), "%s:%u", node_name(d, l->input_node), l->input_port);
+
+	mvwprintw(d->win, y, 0, "%4.1u %6.1u %6.1u %9.1f %6"PRIu64" %5.1f %6u %s -> %s",
+			l->id, l->output_node, l->input_node,
+			r->bytes / 1024.0,
+			r->buffers,
+			r->buffers ? 100.0 * r->mixed / r->buffers : 0.0,
+			l->stats.underruns,
+			out, in);
+}
+
+static void update_links(struct data *d)
+{
+	struct link *l, *t;
+
+	spa_list_for_each_safe(l, t, &d->link_list, link) {
+		if (d->generation > l->generation + 22) {
+			remove_link(d, l);
+			continue;
+		}
+		l->rate.bytes = l->stats.bytes - l->prev.bytes;
+		l->rate.buffers = l->stats.buffers - l->prev.buffers;
+		l->rate.mixed = l->stats.mixed - l->prev.mixed;
+		l->prev = l->stats;
+	}
+}
+
+static void refresh_links(struct data *d)
+{
+	struct link *l;
+	int y = 1;
+
+	wclear(d->win);
+	wattron(d->win, A_REVERSE);
+	wprintw(d->win, "%-*.*s", COLS, COLS, "  ID    OUT     IN     KiB/s  BUF/s  MIX%  UNDER OUTPUT -> INPUT ");
+	wattroff(d->win, A_REVERSE);
+	wprintw(d->win, "\n");
+
+	spa_list_for_each(l, &d->link_list, link) {
+		print_link(d, l, y++);
+		if (y > LINES)
+			break;
+	}
+	wmove(d->win, y, 0);
+	wclrtobot(d->win);
+
+	wrefresh(d->win);
+	d->pending_refresh = false;
+}
+
 static void clear_node(struct node *n)
 {
 	n->driver = n;
@@ -481,6 +619,11 @@ static void do_refresh(struct data *d)
 	struct node *n, *t, *f;
 	int y = 1;
 
+	if (d->show_links) {
+		refresh_links(d);
+		return;
+	}
+
 	wclear(d->win);
 	wattron(d->win, A_REVERSE);
 	wprintw(d->win, "%-*.*s", COLS, COLS, "S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q  ERR FORMAT           NAME ");
@@ -521,6 +664,7 @@ static void do_timeout(void *data, uint64_t expirations)
 {
 	struct data *d = data;
 	d->generation++;
+	update_links(d);
 	do_refresh(d);
 }
 
@@ -551,6 +695,9 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			case SPA_PROFILER_followerBlock:
 				process_follower_block(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_linkBlock:
+				process_link_block(d, &p->value, &point);
+				break;
 			default:
 				break;
 			}
@@ -704,6 +851,10 @@ static void do_handle_io(void *data, int fd, uint32_t mask)
 		case 'q':
 			pw_main_loop_quit(d->loop);
 			break;
+		case 'l':
+			d->show_links = !d->show_links;
+			do_refresh(d);
+			break;
 		default:
 			do_refresh(d);
 			break;
@@ -725,11 +876,13 @@ int main(int argc, char *argv[])
 	int c;
 	struct timespec value, interval;
 	struct node *n;
+	struct link *k;
 
 	setlocale(LC_ALL, "");
 	pw_init(&argc, &argv);
 
 	spa_list_init(&data.node_list);
+	spa_list_init(&data.link_list);
 
 	while ((c = getopt_long(argc, argv, "hVr:o:", long_options, NULL)) != -1) {
 		switch (c) {
@@ -811,6 +964,8 @@ int main(int argc, char *argv[])
 
 	spa_list_consume(n, &data.node_list, link)
 		remove_node(&data, n);
+	spa_list_consume(k, &data.link_list, link)
+		remove_link(&data, k);
 
 	if (data.profiler) {
 		spa_hook_remove(&data.profiler_listener);
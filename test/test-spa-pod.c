@@ -9,6 +9,7 @@
 #include <spa/pod/iter.h>
 #include <spa/pod/parser.h>
 #include <spa/pod/vararg.h>
+#include <spa/pod/filter.h>
 #include <spa/debug/pod.h>
 #include <spa/param/format.h>
 #include <spa/param/video/raw.h>
@@ -1668,6 +1669,121 @@ PWTEST(pod_overflow2)
 	return PWTEST_PASS;
 }
 
+static struct spa_pod *build_video_format(struct spa_pod_builder *b, uint32_t i)
+{
+	static const uint32_t subtypes[] = { SPA_MEDIA_SUBTYPE_raw, SPA_MEDIA_SUBTYPE_mjpg };
+	uint32_t subtype = subtypes[(i / 7) % 2];
+	struct spa_rectangle size = SPA_RECTANGLE(160 * (1 + i % 4), 120 * (1 + i % 4));
+	struct spa_fraction rate = SPA_FRACTION(15 * (1 + i % 3), 1);
+
+	switch (i % 3) {
+	case 0:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype),
+			SPA_FORMAT_VIDEO_format,   SPA_POD_CHOICE_ENUM_Id(3,
+							SPA_VIDEO_FORMAT_I420,
+							SPA_VIDEO_FORMAT_I420,
+							SPA_VIDEO_FORMAT_YUY2),
+			SPA_FORMAT_VIDEO_size,     SPA_POD_Rectangle(&size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_Fraction(&rate));
+	case 1:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype),
+			SPA_FORMAT_VIDEO_format,   SPA_POD_Id(i % 2 ?
+							SPA_VIDEO_FORMAT_RGBA :
+							SPA_VIDEO_FORMAT_YUY2),
+			SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+							&size,
+							&SPA_RECTANGLE(1, 1),
+							&size),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_ENUM_Fraction(3,
+							&rate,
+							&rate,
+							&SPA_FRACTION(60, 1)));
+	default:
+		return spa_pod_builder_add_object(b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_video),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(subtype),
+			SPA_FORMAT_VIDEO_format,   SPA_POD_CHOICE_ENUM_Id(3,
+							SPA_VIDEO_FORMAT_RGBA,
+							SPA_VIDEO_FORMAT_RGBA,
+							SPA_VIDEO_FORMAT_I420),
+			SPA_FORMAT_VIDEO_size,     SPA_POD_CHOICE_RANGE_Rectangle(
+							&size,
+							&size,
+							&SPA_RECTANGLE(4096, 4096)),
+			SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+							&rate,
+							&SPA_FRACTION(0, 1),
+							&rate));
+	}
+}
+
+PWTEST(pod_filter_intersect)
+{
+#define N_PODS 24
+	uint8_t buffer[16384], result[1024];
+	struct spa_pod_builder b, rb;
+	struct spa_pod *pods[N_PODS], *res;
+	struct spa_pod_filter_key keys[N_PODS];
+	uint32_t i, j, n_compatible = 0, n_filtered = 0;
+	uint32_t pi = SPA_ID_INVALID, fi = SPA_ID_INVALID;
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	for (i = 0; i < N_PODS; i++) {
+		pods[i] = build_video_format(&b, i);
+		spa_assert_se(pods[i] != NULL);
+		spa_pod_filter_key_init(&keys[i], pods[i]);
+		spa_assert_se(keys[i].media_type == SPA_MEDIA_TYPE_video);
+	}
+
+	/* the check never rejects a pair that the filter accepts */
+	for (i = 0; i < N_PODS; i++) {
+		for (j = 0; j < N_PODS; j++) {
+			bool compatible = spa_pod_filter_compatible(pods[j], pods[i]);
+
+			spa_pod_builder_init(&rb, result, sizeof(result));
+			if (spa_pod_filter(&rb, &res, pods[j], pods[i]) >= 0) {
+				spa_assert_se(compatible);
+				n_filtered++;
+				if (pi == SPA_ID_INVALID) {
+					pi = j;
+					fi = i;
+				}
+			}
+			n_compatible += compatible;
+		}
+	}
+	spa_assert_se(pi != SPA_ID_INVALID);
+	spa_assert_se(fi != SPA_ID_INVALID);
+	spa_assert_se(n_filtered < N_PODS * N_PODS);
+	spa_assert_se(n_compatible < N_PODS * N_PODS);
+
+	/* and the intersection picks the same pair as a full scan */
+	spa_pod_builder_init(&rb, result, sizeof(result));
+	spa_assert_se(spa_pod_filter_intersect(&rb, &res, keys, N_PODS,
+				(const struct spa_pod * const *)pods, N_PODS, &j, &i) == 1);
+	spa_assert_se(j == pi);
+	spa_assert_se(i == fi);
+	spa_assert_se(spa_pod_is_object_type(res, SPA_TYPE_OBJECT_Format));
+
+	/* nothing intersects with a different media type */
+	pods[0] = spa_pod_builder_add_object(&b,
+			SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw));
+	spa_assert_se(pods[0] != NULL);
+	spa_assert_se(spa_pod_filter_intersect(&rb, &res, keys + 1, N_PODS - 1,
+				(const struct spa_pod * const *)pods, 1, NULL, NULL) == 0);
+#undef N_PODS
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(spa_pod)
 {
 	pwtest_add(pod_abi_sizes, PWTEST_NOARG);
@@ -1682,6 +1798,7 @@ PWTEST_SUITE(spa_pod)
 	pwtest_add(pod_static, PWTEST_NOARG);
 	pwtest_add(pod_overflow, PWTEST_NOARG);
 	pwtest_add(pod_overflow2, PWTEST_NOARG);
+	pwtest_add(pod_filter_intersect, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
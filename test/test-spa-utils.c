@@ -15,6 +15,7 @@
 #include <spa/utils/list.h>
 #include <spa/utils/hook.h>
 #include <spa/utils/ringbuffer.h>
+#include <spa/utils/jitter-buffer.h>
 #include <spa/utils/string.h>
 #include <spa/utils/type.h>
 #include <spa/utils/ansi.h>
@@ -468,6 +469,68 @@ PWTEST(utils_ringbuffer)
 	return PWTEST_PASS;
 }
 
+PWTEST(utils_jitter_buffer)
+{
+	struct spa_jitter_buffer jb;
+	uint16_t data[16 + 4], out[8];
+	uint16_t *p;
+	uint32_t avail, i, n;
+
+	/* 16 frames ring with 4 frames reserve for in place writes */
+	spa_jitter_buffer_init(&jb, NULL, data, 16 * sizeof(uint16_t),
+			sizeof(uint16_t), 48000, 4);
+	pwtest_int_eq(jb.n_frames, 16U);
+	pwtest_int_eq(spa_jitter_buffer_get_size(&jb), 0U);
+
+	/* nothing can be read while buffering */
+	for (i = 0; i < 3; i++) {
+		p = spa_jitter_buffer_get_write(&jb, &avail);
+		pwtest_int_ge(avail, 4 * sizeof(uint16_t));
+		for (n = 0; n < 4; n++)
+			p[n] = i * 4 + n;
+		spa_jitter_buffer_write_packet(&jb, 4 * sizeof(uint16_t));
+	}
+	pwtest_int_eq(spa_jitter_buffer_get_size(&jb), 12U);
+	pwtest_int_eq(spa_jitter_buffer_get_avail(&jb), 0U);
+
+	spa_jitter_buffer_process(&jb, 8, 8);
+	pwtest_bool_false(jb.buffering);
+	pwtest_int_eq(spa_jitter_buffer_read(&jb, out, sizeof(out)), sizeof(out));
+	for (n = 0; n < 8; n++)
+		pwtest_int_eq(out[n], n);
+
+	/* the write at offset 12 spills past the end and wraps around */
+	p = spa_jitter_buffer_get_write(&jb, &avail);
+	pwtest_int_eq(avail, 8 * sizeof(uint16_t));
+	for (n = 0; n < 6; n++)
+		p[n] = 12 + n;
+	spa_jitter_buffer_write_packet(&jb, 6 * sizeof(uint16_t));
+	pwtest_int_eq(data[0], 16);
+	pwtest_int_eq(data[1], 17);
+
+	pwtest_int_eq(spa_jitter_buffer_read(&jb, out, sizeof(out)), sizeof(out));
+	for (n = 0; n < 8; n++)
+		pwtest_int_eq(out[n], 8 + n);
+
+	/* underrun is filled with silence */
+	pwtest_int_eq(spa_jitter_buffer_read(&jb, out, sizeof(out)), 2 * sizeof(uint16_t));
+	pwtest_int_eq(out[0], 16);
+	pwtest_int_eq(out[1], 17);
+	for (n = 2; n < 8; n++)
+		pwtest_int_eq(out[n], 0);
+	pwtest_int_eq(jb.stats.concealed, 6U);
+
+	/* overrun drops the oldest data */
+	spa_jitter_buffer_reset(&jb, 100, 110);
+	pwtest_int_eq(spa_jitter_buffer_get_size(&jb), 10U);
+	spa_jitter_buffer_write_at(&jb, 110, out, sizeof(out));
+	pwtest_int_eq(spa_jitter_buffer_get_size(&jb), 16U);
+	pwtest_int_eq(jb.ring.readindex, 102U);
+	pwtest_int_eq(jb.stats.dropped, 2U);
+
+	return PWTEST_PASS;
+}
+
 PWTEST(utils_strtol)
 {
 	int32_t v = 0xabcd;
@@ -1001,6 +1064,7 @@ PWTEST_SUITE(spa_utils)
 	pwtest_add(utils_list, PWTEST_NOARG);
 	pwtest_add(utils_hook, PWTEST_NOARG);
 	pwtest_add(utils_ringbuffer, PWTEST_NOARG);
+	pwtest_add(utils_jitter_buffer, PWTEST_NOARG);
 	pwtest_add(utils_strtol, PWTEST_NOARG);
 	pwtest_add(utils_strtoul, PWTEST_NOARG);
 	pwtest_add(utils_strtoll, PWTEST_NOARG);